@@ -0,0 +1,4 @@
+#pragma once
+
+FUNC_DriverDispatch              AhciDispatchReadWrite;
+FUNC_DriverDispatch              AhciDispatchDeviceControl;
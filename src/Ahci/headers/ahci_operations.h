@@ -0,0 +1,77 @@
+#pragma once
+
+STATUS
+AhciInitializeController(
+    IN                              PPCI_DEVICE_DESCRIPTION     PciDevice,
+    OUT_PTR                         PAHCI_CONTROLLER*           Controller
+    );
+
+void
+AhciUninitializeController(
+    IN                              PAHCI_CONTROLLER            Controller
+    );
+
+//******************************************************************************
+// Function:     AhciInitializePort
+// Description:  Sets up the command list and the received FIS area of the
+//               port, identifies the attached disk and enables the port
+//               interrupts.
+// Returns:      STATUS - STATUS_DEVICE_NOT_CONNECTED if no device is attached
+//               to the port and STATUS_DEVICE_NOT_SUPPORTED if the device is
+//               not an ATA disk.
+// Parameter:    IN PAHCI_CONTROLLER Controller
+// Parameter:    IN DWORD PortIndex
+// Parameter:    IN PDEVICE_OBJECT Device - device whose extension is the
+//               AHCI_PORT structure.
+//******************************************************************************
+STATUS
+AhciInitializePort(
+    IN                              PAHCI_CONTROLLER            Controller,
+    IN                              DWORD                       PortIndex,
+    IN                              PDEVICE_OBJECT              Device
+    );
+
+void
+AhciUninitializePort(
+    IN                              PDEVICE_OBJECT              Device
+    );
+
+//******************************************************************************
+// Function:     AhciEnableInterrupts
+// Description:  Registers the interrupt handler of the controller (MSI if the
+//               controller supports it) and enables the HBA interrupts. A
+//               single interrupt services all the ports of the controller.
+// Returns:      STATUS
+// Parameter:    IN PAHCI_CONTROLLER Controller
+// Parameter:    IN PPCI_DEVICE_DESCRIPTION PciDevice
+// Parameter:    IN PDEVICE_OBJECT Device - any of the port devices of the
+//               controller.
+//******************************************************************************
+STATUS
+AhciEnableInterrupts(
+    IN                              PAHCI_CONTROLLER            Controller,
+    IN                              PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN                              PDEVICE_OBJECT              Device
+    );
+
+//******************************************************************************
+// Function:     AhciReadWriteSectors
+// Description:  Transfers SectorCount sectors directly from/to Buffer. The
+//               request is split in commands of at most
+//               AHCI_MAX_BYTES_PER_COMMAND bytes which are all queued to the
+//               device at once if it supports NCQ.
+// Returns:      STATUS
+// Parameter:    OUT QWORD* SectorsReadWritten - number of sectors for which
+//               the commands completed successfully.
+//******************************************************************************
+STATUS
+AhciReadWriteSectors(
+    IN                              PAHCI_PORT                  Port,
+    IN                              QWORD                       SectorIndex,
+    IN                              QWORD                       SectorCount,
+    _When_(WriteOperation, IN_READS_BYTES(SectorCount*SECTOR_SIZE))
+    _When_(!WriteOperation, OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
+                                    PVOID                       Buffer,
+    OUT                             QWORD*                      SectorsReadWritten,
+    IN                              BOOLEAN                     WriteOperation
+    );
@@ -0,0 +1,259 @@
+#pragma once
+
+// AHCI 1.3.1 Specification
+
+// The HBA registers are mapped through BAR5 (ABAR)
+#define AHCI_ABAR_INDEX                         5
+
+#define AHCI_MAX_PORTS                          32
+#define AHCI_MAX_COMMAND_SLOTS                  32
+
+// Generic Host Control - Capabilities (CAP)
+#define AHCI_CAP_NUMBER_OF_PORTS_MASK           0x1F
+#define AHCI_CAP_COMMAND_SLOTS_SHIFT            8
+#define AHCI_CAP_COMMAND_SLOTS_MASK             0x1F
+#define AHCI_CAP_SUPPORTS_NCQ                   (1UL<<30)
+#define AHCI_CAP_SUPPORTS_64_BIT                (1UL<<31)
+
+// Generic Host Control - Global HBA Control (GHC)
+#define AHCI_GHC_HBA_RESET                      (1UL<<0)
+#define AHCI_GHC_INTERRUPT_ENABLE               (1UL<<1)
+#define AHCI_GHC_AHCI_ENABLE                    (1UL<<31)
+
+// Port x Command and Status (PxCMD)
+#define AHCI_PORT_CMD_START                     (1UL<<0)
+#define AHCI_PORT_CMD_SPIN_UP_DEVICE            (1UL<<1)
+#define AHCI_PORT_CMD_POWER_ON_DEVICE           (1UL<<2)
+#define AHCI_PORT_CMD_FIS_RECEIVE_ENABLE        (1UL<<4)
+#define AHCI_PORT_CMD_FIS_RECEIVE_RUNNING       (1UL<<14)
+#define AHCI_PORT_CMD_LIST_RUNNING              (1UL<<15)
+
+// Port x Interrupt Status/Enable (PxIS, PxIE)
+#define AHCI_PORT_INT_D2H_REGISTER_FIS          (1UL<<0)
+#define AHCI_PORT_INT_PIO_SETUP_FIS             (1UL<<1)
+#define AHCI_PORT_INT_DMA_SETUP_FIS             (1UL<<2)
+#define AHCI_PORT_INT_SET_DEVICE_BITS_FIS       (1UL<<3)
+#define AHCI_PORT_INT_DESCRIPTOR_PROCESSED      (1UL<<5)
+#define AHCI_PORT_INT_INTERFACE_FATAL_ERROR     (1UL<<27)
+#define AHCI_PORT_INT_HOST_BUS_DATA_ERROR       (1UL<<28)
+#define AHCI_PORT_INT_HOST_BUS_FATAL_ERROR      (1UL<<29)
+#define AHCI_PORT_INT_TASK_FILE_ERROR           (1UL<<30)
+
+#define AHCI_PORT_INT_ERROR_MASK                (AHCI_PORT_INT_INTERFACE_FATAL_ERROR |  \
+                                                 AHCI_PORT_INT_HOST_BUS_DATA_ERROR |    \
+                                                 AHCI_PORT_INT_HOST_BUS_FATAL_ERROR |   \
+                                                 AHCI_PORT_INT_TASK_FILE_ERROR)
+
+// the interrupts we want for command completion: D2H for non-queued
+// commands and Set Device Bits for NCQ commands
+#define AHCI_PORT_INT_COMPLETION_MASK           (AHCI_PORT_INT_D2H_REGISTER_FIS |       \
+                                                 AHCI_PORT_INT_SET_DEVICE_BITS_FIS |    \
+                                                 AHCI_PORT_INT_ERROR_MASK)
+
+// Port x Task File Data (PxTFD)
+#define AHCI_PORT_TFD_STATUS_ERR                (1UL<<0)
+#define AHCI_PORT_TFD_STATUS_DRQ                (1UL<<3)
+#define AHCI_PORT_TFD_STATUS_BSY                (1UL<<7)
+#define AHCI_PORT_TFD_ERROR_SHIFT               8
+
+// Port x Serial ATA Status (PxSSTS)
+#define AHCI_PORT_SSTS_DET_MASK                 0xF
+#define AHCI_PORT_SSTS_DET_PRESENT              0x3
+#define AHCI_PORT_SSTS_IPM_SHIFT                8
+#define AHCI_PORT_SSTS_IPM_MASK                 0xF
+#define AHCI_PORT_SSTS_IPM_ACTIVE               0x1
+
+// Port x Signature (PxSIG)
+#define AHCI_PORT_SIGNATURE_ATA                 0x00000101
+
+// FIS types
+#define AHCI_FIS_TYPE_REGISTER_H2D              0x27
+
+// ATA commands issued through the HBA
+#define AHCI_ATA_CMD_IDENTIFY                   0xEC
+#define AHCI_ATA_CMD_READ_DMA_EXT               0x25
+#define AHCI_ATA_CMD_WRITE_DMA_EXT              0x35
+#define AHCI_ATA_CMD_READ_FPDMA_QUEUED          0x60
+#define AHCI_ATA_CMD_WRITE_FPDMA_QUEUED         0x61
+
+#define AHCI_ATA_DEVICE_LBA                     (1<<6)
+
+// IDENTIFY DEVICE response, word offsets
+#define AHCI_IDENTIFY_QUEUE_DEPTH_WORD          75
+#define AHCI_IDENTIFY_QUEUE_DEPTH_MASK          0x1F
+#define AHCI_IDENTIFY_SATA_CAPABILITIES_WORD    76
+#define AHCI_IDENTIFY_SATA_SUPPORTS_NCQ         (1<<8)
+#define AHCI_IDENTIFY_COMMAND_SET_WORD          83
+#define AHCI_IDENTIFY_COMMAND_SET_LBA48         (1<<10)
+#define AHCI_IDENTIFY_LBA48_SECTORS_WORD        100
+
+// Data Base Address must be WORD aligned and the byte count even
+#define AHCI_PRD_ALIGNMENT                      2
+#define AHCI_PRD_MAX_BYTE_COUNT                 (4 * MB_SIZE)
+
+#pragma pack(push,1)
+
+#pragma warning(push)
+
+// warning C4201: nonstandard extension used: nameless struct/union
+#pragma warning(disable:4201)
+
+// warning C4214: nonstandard extension used: bit field types other than int
+#pragma warning(disable:4214)
+
+typedef volatile struct _AHCI_PORT_REGISTERS
+{
+    DWORD                               CommandListBase;
+    DWORD                               CommandListBaseUpper;
+    DWORD                               FisBase;
+    DWORD                               FisBaseUpper;
+
+    // 0x10
+    DWORD                               InterruptStatus;
+    DWORD                               InterruptEnable;
+    DWORD                               Command;
+    DWORD                               __Reserved0;
+
+    // 0x20
+    DWORD                               TaskFileData;
+    DWORD                               Signature;
+    DWORD                               SataStatus;
+    DWORD                               SataControl;
+
+    // 0x30
+    DWORD                               SataError;
+    DWORD                               SataActive;
+    DWORD                               CommandIssue;
+    DWORD                               SataNotification;
+
+    // 0x40
+    DWORD                               FisSwitchingControl;
+    DWORD                               DeviceSleep;
+    DWORD                               __Reserved1[10];
+
+    // 0x70
+    DWORD                               VendorSpecific[4];
+} AHCI_PORT_REGISTERS, *PAHCI_PORT_REGISTERS;
+STATIC_ASSERT(sizeof(AHCI_PORT_REGISTERS) == 0x80);
+
+typedef volatile struct _AHCI_HBA_REGISTERS
+{
+    DWORD                               Capabilities;
+    DWORD                               GlobalHostControl;
+    DWORD                               InterruptStatus;
+    DWORD                               PortsImplemented;
+
+    // 0x10
+    DWORD                               Version;
+    DWORD                               CccControl;
+    DWORD                               CccPorts;
+    DWORD                               EnclosureManagementLocation;
+
+    // 0x20
+    DWORD                               EnclosureManagementControl;
+    DWORD                               Capabilities2;
+    DWORD                               BiosHandoff;
+
+    BYTE                                __Reserved0[0xA0 - 0x2C];
+    BYTE                                VendorSpecific[0x100 - 0xA0];
+
+    // 0x100
+    AHCI_PORT_REGISTERS                 Ports[AHCI_MAX_PORTS];
+} AHCI_HBA_REGISTERS, *PAHCI_HBA_REGISTERS;
+STATIC_ASSERT(sizeof(AHCI_HBA_REGISTERS) == 0x1100);
+
+typedef struct _AHCI_FIS_REGISTER_H2D
+{
+    BYTE                                FisType;
+
+    BYTE                                PortMultiplier  :   4;
+    BYTE                                __Reserved0     :   3;
+
+    // 1 => Command, 0 => Control
+    BYTE                                CommandBit      :   1;
+
+    BYTE                                Command;
+    BYTE                                FeatureLow;
+
+    BYTE                                Lba0;
+    BYTE                                Lba1;
+    BYTE                                Lba2;
+    BYTE                                Device;
+
+    BYTE                                Lba3;
+    BYTE                                Lba4;
+    BYTE                                Lba5;
+    BYTE                                FeatureHigh;
+
+    // for NCQ commands bits 7:3 of CountLow hold the tag
+    BYTE                                CountLow;
+    BYTE                                CountHigh;
+    BYTE                                Icc;
+    BYTE                                Control;
+
+    BYTE                                __Reserved1[4];
+} AHCI_FIS_REGISTER_H2D, *PAHCI_FIS_REGISTER_H2D;
+STATIC_ASSERT(sizeof(AHCI_FIS_REGISTER_H2D) == 20);
+
+typedef struct _AHCI_COMMAND_HEADER
+{
+    // length of the command FIS in DWORDs
+    WORD                                CommandFisLength    :   5;
+    WORD                                Atapi               :   1;
+    WORD                                Write               :   1;
+    WORD                                Prefetchable        :   1;
+    WORD                                Reset               :   1;
+    WORD                                Bist                :   1;
+    WORD                                ClearBusyOnOk       :   1;
+    WORD                                __Reserved0         :   1;
+    WORD                                PortMultiplier      :   4;
+
+    // number of entries in the PRD table
+    WORD                                PrdtLength;
+
+    // updated by the HBA
+    volatile DWORD                      PrdByteCount;
+
+    // must be 128 byte aligned
+    DWORD                               CommandTableBase;
+    DWORD                               CommandTableBaseUpper;
+
+    DWORD                               __Reserved1[4];
+} AHCI_COMMAND_HEADER, *PAHCI_COMMAND_HEADER;
+STATIC_ASSERT(sizeof(AHCI_COMMAND_HEADER) == 32);
+
+typedef struct _AHCI_PRD_ENTRY
+{
+    DWORD                               DataBase;
+    DWORD                               DataBaseUpper;
+    DWORD                               __Reserved0;
+
+    // byte count - 1, bit 0 must always be set
+    DWORD                               ByteCount               :   22;
+    DWORD                               __Reserved1             :   9;
+    DWORD                               InterruptOnCompletion   :   1;
+} AHCI_PRD_ENTRY, *PAHCI_PRD_ENTRY;
+STATIC_ASSERT(sizeof(AHCI_PRD_ENTRY) == 16);
+
+// Number of PRD entries in each command table, with 4KB pages this is enough
+// for a 128KB command even if the buffer does not start at a page boundary
+#define AHCI_PRDT_ENTRIES_PER_COMMAND           40
+
+typedef struct _AHCI_COMMAND_TABLE
+{
+    BYTE                                CommandFis[64];
+    BYTE                                AtapiCommand[16];
+    BYTE                                __Reserved0[48];
+
+    AHCI_PRD_ENTRY                      Prdt[AHCI_PRDT_ENTRIES_PER_COMMAND];
+} AHCI_COMMAND_TABLE, *PAHCI_COMMAND_TABLE;
+STATIC_ASSERT(sizeof(AHCI_COMMAND_TABLE) % 128 == 0);
+
+#define AHCI_COMMAND_LIST_SIZE                  (AHCI_MAX_COMMAND_SLOTS * sizeof(AHCI_COMMAND_HEADER))
+#define AHCI_COMMAND_LIST_ALIGNMENT             1024
+
+#define AHCI_RECEIVED_FIS_SIZE                  256
+#define AHCI_RECEIVED_FIS_ALIGNMENT             256
+
+#pragma warning(pop)
+#pragma pack(pop)
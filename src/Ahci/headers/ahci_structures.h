@@ -0,0 +1,64 @@
+#pragma once
+
+#include "ex_event.h"
+
+// Requests are split in commands of at most this size, which are queued
+// to the device simultaneously when it supports NCQ
+#define AHCI_MAX_BYTES_PER_COMMAND              (128 * KB_SIZE)
+
+typedef struct _AHCI_CONTROLLER
+{
+    PAHCI_HBA_REGISTERS         Registers;
+
+    DWORD                       PortsImplemented;
+
+    // number of command slots supported by the HBA for each port
+    DWORD                       NumberOfCommandSlots;
+
+    BOOLEAN                     NcqSupported;
+    BOOLEAN                     Addressing64Bit;
+
+    // the device object of each port with an attached disk, the interrupt
+    // handler uses them to dispatch the completions of each port
+    PDEVICE_OBJECT              PortDevices[AHCI_MAX_PORTS];
+} AHCI_CONTROLLER, *PAHCI_CONTROLLER;
+
+typedef struct _AHCI_PORT
+{
+    PAHCI_CONTROLLER            Controller;
+    PAHCI_PORT_REGISTERS        Registers;
+    DWORD                       PortIndex;
+
+    BOOLEAN                     Initialized;
+    QWORD                       TotalSectors;
+
+    // TRUE if both the HBA and the device support NCQ
+    BOOLEAN                     NcqEnabled;
+
+    // maximum number of commands we issue simultaneously: 1 without NCQ,
+    // else the minimum between the slots of the HBA and the device depth
+    DWORD                       QueueDepth;
+
+    // Memory shared with the HBA: command list, received FIS area and the
+    // command tables for all the slots in a single contiguous allocation
+    PVOID                       DmaMemory;
+    DWORD                       DmaMemorySize;
+    PAHCI_COMMAND_HEADER        CommandList;
+    PAHCI_COMMAND_TABLE         CommandTables;
+    PHYSICAL_ADDRESS            CommandTablesPhysicalAddress;
+
+    // slots issued to the device which did not complete yet, set by the
+    // issuer and cleared by the interrupt handler
+    volatile DWORD              OutstandingSlots;
+
+    // slots which were outstanding when an error interrupt was received
+    volatile DWORD              FailedSlots;
+    volatile DWORD              TaskFileData;
+
+    // signaled by the interrupt handler each time commands complete
+    EX_EVENT                    CommandsCompleted;
+
+    // Statistics
+    QWORD                       CommandsIssued;
+    DWORD                       MaxOutstandingCommands;
+} AHCI_PORT, *PAHCI_PORT;
@@ -0,0 +1,191 @@
+#include "ahci_base.h"
+#include "ahci.h"
+#include "ahci_dispatch.h"
+#include "ahci_operations.h"
+
+static
+BOOLEAN
+_AhciInitializeControllerPorts(
+    INOUT       PDRIVER_OBJECT              Driver,
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN          PAHCI_CONTROLLER            Controller
+    );
+
+STATUS
+(__cdecl AhciDriverEntry)(
+    INOUT       PDRIVER_OBJECT      Driver
+    )
+{
+    STATUS status;
+    PPCI_DEVICE_DESCRIPTION* pPciDevices;
+    DWORD i;
+    PAHCI_CONTROLLER pController;
+    BOOLEAN foundDevice;
+    DWORD noOfDevices;
+    PCI_SPEC pciSpec;
+
+    ASSERT(NULL != Driver);
+
+    LOG_FUNC_START;
+
+    status = STATUS_SUCCESS;
+    pPciDevices = NULL;
+    pController = NULL;
+    foundDevice = FALSE;
+    noOfDevices = 0;
+    i = 0;
+    memzero(&pciSpec, sizeof(PCI_SPEC));
+
+    pciSpec.MatchClass = TRUE;
+    pciSpec.MatchSubclass = TRUE;
+
+    pciSpec.Description.ClassCode = PciDeviceClassMassStorageController;
+    pciSpec.Description.Subclass = PciMassStorageSATA;
+
+    status = IoGetPciDevicesMatchingSpecification( pciSpec, &pPciDevices, &noOfDevices);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoGetPciDevicesMatchingSpecification", status);
+        return status;
+    }
+    ASSERT(noOfDevices == 0 || pPciDevices != NULL);
+    LOGL("Found %d SATA controllers\n", noOfDevices );
+
+    Driver->DispatchFunctions[IRP_MJ_READ] = AhciDispatchReadWrite;
+    Driver->DispatchFunctions[IRP_MJ_WRITE] = AhciDispatchReadWrite;
+    Driver->DispatchFunctions[IRP_MJ_DEVICE_CONTROL] = AhciDispatchDeviceControl;
+
+    for (i = 0; i < noOfDevices; ++i)
+    {
+        ASSERT(pPciDevices[i] != NULL);
+
+        status = AhciInitializeController(pPciDevices[i], &pController);
+        if (!SUCCEEDED(status))
+        {
+            LOG_WARNING("AhciInitializeController failed with status: 0x%x\n", status);
+            continue;
+        }
+
+        if (!_AhciInitializeControllerPorts(Driver, pPciDevices[i], pController))
+        {
+            // no disks on this controller, we don't need it anymore
+            AhciUninitializeController(pController);
+            pController = NULL;
+            continue;
+        }
+
+        foundDevice = TRUE;
+        pController = NULL;
+    }
+
+    if (NULL != pPciDevices)
+    {
+        IoFreeTemporaryData(pPciDevices);
+        pPciDevices = NULL;
+    }
+
+    if (foundDevice)
+    {
+        // if we found at least a device we succeeded
+        status = STATUS_SUCCESS;
+    }
+
+    LOG_FUNC_END;
+
+    return status;
+}
+
+static
+BOOLEAN
+_AhciInitializeControllerPorts(
+    INOUT       PDRIVER_OBJECT              Driver,
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN          PAHCI_CONTROLLER            Controller
+    )
+{
+    STATUS status;
+    DWORD i;
+    PDEVICE_OBJECT pPortDevice;
+    PDEVICE_OBJECT pFirstPortDevice;
+
+    ASSERT(NULL != Driver);
+    ASSERT(NULL != PciDevice);
+    ASSERT(NULL != Controller);
+
+    pPortDevice = NULL;
+    pFirstPortDevice = NULL;
+
+    // each port gets its own device object, so requests to different disks
+    // are not serialized behind each other
+    for (i = 0; i < AHCI_MAX_PORTS; ++i)
+    {
+        if (!IsBooleanFlagOn(Controller->PortsImplemented, 1UL << i))
+        {
+            continue;
+        }
+
+        if (NULL == pPortDevice)
+        {
+            pPortDevice = IoCreateDevice(Driver, sizeof(AHCI_PORT), DeviceTypeHarddiskController);
+            if (NULL == pPortDevice)
+            {
+                LOG_FUNC_ERROR_ALLOC("IoCreateDevice", sizeof(AHCI_PORT));
+                break;
+            }
+            pPortDevice->DeviceAlignment = SECTOR_SIZE;
+        }
+
+        status = AhciInitializePort(Controller, i, pPortDevice);
+        if (!SUCCEEDED(status))
+        {
+            if (STATUS_DEVICE_NOT_CONNECTED != status)
+            {
+                LOG_WARNING("AhciInitializePort failed for port %u with status: 0x%x\n", i, status);
+            }
+
+            // the device object is reused for the next port
+            memzero(IoGetDeviceExtension(pPortDevice), sizeof(AHCI_PORT));
+            continue;
+        }
+        LOG("AhciInitializePort succeeded for port %u\n", i);
+
+        if (NULL == pFirstPortDevice)
+        {
+            pFirstPortDevice = pPortDevice;
+        }
+        pPortDevice = NULL;
+    }
+
+    if (NULL != pPortDevice)
+    {
+        IoDeleteDevice(pPortDevice);
+        pPortDevice = NULL;
+    }
+
+    if (NULL == pFirstPortDevice)
+    {
+        return FALSE;
+    }
+
+    status = AhciEnableInterrupts(Controller, PciDevice, pFirstPortDevice);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("AhciEnableInterrupts", status);
+
+        // without interrupts no command would ever complete
+        for (i = 0; i < AHCI_MAX_PORTS; ++i)
+        {
+            if (NULL != Controller->PortDevices[i])
+            {
+                pPortDevice = Controller->PortDevices[i];
+
+                AhciUninitializePort(pPortDevice);
+                IoDeleteDevice(pPortDevice);
+            }
+        }
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,208 @@
+#include "ahci_base.h"
+#include "ahci_dispatch.h"
+#include "ahci_operations.h"
+
+#define LBA48_MAX_VALUE                 0x0000'FFFF'FFFF'FFFFULL
+
+__forceinline
+static
+STATUS
+_AhciCheckAlignment(
+    IN                                          QWORD           Size,
+    IN                                          QWORD           Offset
+    )
+{
+    if (!IsAddressAligned(Size, SECTOR_SIZE))
+    {
+        return STATUS_DEVICE_DATA_ALIGNMENT_ERROR;
+    }
+
+    if (!IsAddressAligned(Offset, SECTOR_SIZE))
+    {
+        return STATUS_DEVICE_DATA_ALIGNMENT_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+__forceinline
+static
+STATUS
+_AhciCheckIOParameters(
+    IN                                          PAHCI_PORT      Device,
+    IN                                          QWORD           SectorIndex,
+    IN                                          QWORD           SectorCount
+    )
+{
+    ASSERT(NULL != Device);
+
+    if (!Device->Initialized)
+    {
+        return STATUS_DEVICE_NOT_INITIALIZED;
+    }
+
+    if (SectorIndex >= Device->TotalSectors)
+    {
+        // how can we read at an index higher than our total sector count?
+        return STATUS_DEVICE_SECTOR_OFFSET_EXCEEDED;
+    }
+
+    if (SectorIndex >= LBA48_MAX_VALUE)
+    {
+        // sector index is only a 48-bit value
+        return STATUS_DEVICE_SECTOR_OFFSET_EXCEEDED;
+    }
+
+    if (Device->TotalSectors - SectorIndex < SectorCount)
+    {
+        // sorry, we really don't have that much
+        return STATUS_DEVICE_SECTOR_COUNT_EXCEEDED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+(__cdecl AhciDispatchReadWrite)(
+    INOUT       PDEVICE_OBJECT      DeviceObject,
+    INOUT       PIRP                Irp
+    )
+{
+    PAHCI_PORT pPort;
+    QWORD sectorIndex;
+    QWORD sectorCount;
+    PIO_STACK_LOCATION pStackLocation;
+    STATUS status;
+    QWORD sizeInBytes;
+    QWORD offset;
+    QWORD sectorsRead;
+    BOOLEAN writeOperation;
+
+    ASSERT(NULL != DeviceObject);
+    ASSERT(NULL != Irp);
+
+    pPort = NULL;
+    sectorIndex = 0;
+    sectorCount = 0;
+    pStackLocation = NULL;
+    status = STATUS_SUCCESS;
+    sizeInBytes = 0;
+    offset = 0;
+    sectorsRead = 0;
+    writeOperation = FALSE;
+
+    pPort = IoGetDeviceExtension(DeviceObject);
+    ASSERT(NULL != pPort);
+
+    pStackLocation = IoGetCurrentIrpStackLocation(Irp);
+
+    ASSERT(IRP_MJ_READ == pStackLocation->MajorFunction || IRP_MJ_WRITE == pStackLocation->MajorFunction);
+    writeOperation = IRP_MJ_WRITE == pStackLocation->MajorFunction;
+
+    sizeInBytes = pStackLocation->Parameters.ReadWrite.Length;
+    offset = pStackLocation->Parameters.ReadWrite.Offset;
+
+    LOG_TRACE_STORAGE("Offset: 0x%X\n", offset);
+    LOG_TRACE_STORAGE("Size in bytes: 0x%x\n", sizeInBytes);
+
+    __try
+    {
+        status = _AhciCheckAlignment(sizeInBytes, offset);
+        if (!SUCCEEDED(status))
+        {
+            __leave;
+        }
+
+        LOG_TRACE_STORAGE("Sizes are properly aligned to sector size\n");
+
+        sectorIndex = offset / SECTOR_SIZE;
+        sectorCount = sizeInBytes / SECTOR_SIZE;
+
+        LOG_TRACE_STORAGE("Sector index, Sector count: 0x%X, 0x%X\n", sectorIndex, sectorCount);
+
+        // larger requests are split in multiple commands by
+        // AhciReadWriteSectors, but the whole buffer must be described by a
+        // single MDL
+        if (sizeInBytes > MAX_DWORD)
+        {
+            status = STATUS_DEVICE_SECTOR_COUNT_EXCEEDED;
+            __leave;
+        }
+
+        status = _AhciCheckIOParameters(pPort, sectorIndex, sectorCount);
+        if (!SUCCEEDED(status))
+        {
+            __leave;
+        }
+
+        LOG_TRACE_STORAGE("IO parameters are valid\n");
+        LOG_TRACE_STORAGE("Sector index: 0x%X\n", sectorIndex);
+        LOG_TRACE_STORAGE("Sector count: 0x%X\n", sectorCount);
+
+        status = AhciReadWriteSectors(pPort, sectorIndex, sectorCount, Irp->Buffer, &sectorsRead, writeOperation);
+    }
+    __finally
+    {
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = sectorsRead * SECTOR_SIZE;
+
+        // complete IRP
+        IoCompleteIrp(Irp);
+        Irp = NULL;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+(__cdecl AhciDispatchDeviceControl)(
+    INOUT       PDEVICE_OBJECT      DeviceObject,
+    INOUT       PIRP                Irp
+    )
+{
+    STATUS status;
+    PIO_STACK_LOCATION pStackLocation;
+    DWORD information;
+    PAHCI_PORT pPort;
+
+    ASSERT(NULL != DeviceObject);
+    ASSERT(NULL != Irp);
+
+    status = STATUS_SUCCESS;
+    pStackLocation = IoGetCurrentIrpStackLocation(Irp);
+    information = 0;
+    pPort = IoGetDeviceExtension(DeviceObject);
+    ASSERT(NULL != pPort);
+
+    ASSERT(IRP_MJ_DEVICE_CONTROL == pStackLocation->MajorFunction);
+
+    switch (pStackLocation->Parameters.DeviceControl.IoControlCode)
+    {
+    case IOCTL_DISK_GET_LENGTH_INFO:
+        {
+            GET_LENGTH_INFORMATION result;
+
+            information = sizeof(GET_LENGTH_INFORMATION);
+            memzero(&result, information);
+
+            if (pStackLocation->Parameters.DeviceControl.OutputBufferLength < information)
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            result.Length = pPort->TotalSectors * SECTOR_SIZE;
+
+            // copy result
+            memcpy(pStackLocation->Parameters.DeviceControl.OutputBuffer, &result, information);
+        }
+        break;
+    default:
+        status = STATUS_UNSUPPORTED;
+    }
+
+    Irp->IoStatus.Status = status;
+    Irp->IoStatus.Information = information;
+
+    return STATUS_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,1077 @@
+#include "ahci_base.h"
+#include "ahci_operations.h"
+
+// Layout of the first page of the memory shared with the HBA by each port,
+// the command tables start on the next page
+#define AHCI_COMMAND_LIST_OFFSET                0
+#define AHCI_RECEIVED_FIS_OFFSET                (AHCI_COMMAND_LIST_OFFSET + AHCI_COMMAND_LIST_SIZE)
+#define AHCI_IDENTIFY_BUFFER_OFFSET             (AHCI_RECEIVED_FIS_OFFSET + AHCI_RECEIVED_FIS_SIZE)
+#define AHCI_COMMAND_TABLES_OFFSET              PAGE_SIZE
+
+STATIC_ASSERT(AHCI_IDENTIFY_BUFFER_OFFSET + SECTOR_SIZE <= AHCI_COMMAND_TABLES_OFFSET);
+
+// Number of register reads after which we give up waiting for the HBA
+#define AHCI_POLL_MAX_ITERATIONS                0x100000
+
+// Position in the MDL of the first byte not yet described by a PRD table
+typedef struct _AHCI_DMA_CURSOR
+{
+    DWORD                       PairIndex;
+    DWORD                       PairOffset;
+} AHCI_DMA_CURSOR, *PAHCI_DMA_CURSOR;
+
+static FUNC_InterruptFunction           _AhciInterrupt;
+
+static
+STATUS
+_AhciStopPort(
+    IN          PAHCI_PORT_REGISTERS                        Registers
+    );
+
+static
+STATUS
+_AhciStartPort(
+    IN          PAHCI_PORT_REGISTERS                        Registers
+    );
+
+static
+STATUS
+_AhciRecoverPort(
+    INOUT       PAHCI_PORT                                  Port
+    );
+
+static
+STATUS
+_AhciIdentifyDevice(
+    INOUT       PAHCI_PORT                                  Port,
+    OUT_WRITES_ALL(SECTOR_SIZE/sizeof(WORD))
+                PWORD                                       Identify
+    );
+
+static
+void
+_AhciSetupCommand(
+    INOUT       PAHCI_PORT                                  Port,
+    IN          DWORD                                       Slot,
+    IN          BYTE                                        Command,
+    IN          QWORD                                       SectorIndex,
+    IN          WORD                                        SectorCount,
+    IN          WORD                                        NumberOfPrdEntries,
+    IN          BOOLEAN                                     WriteOperation
+    );
+
+static
+STATUS
+_AhciBuildPrdTable(
+    IN          PAHCI_PORT                                  Port,
+    INOUT       PAHCI_COMMAND_TABLE                         CommandTable,
+    IN          PMDL                                        Mdl,
+    INOUT       PAHCI_DMA_CURSOR                            Cursor,
+    IN          QWORD                                       BytesRemaining,
+    OUT         WORD*                                       NumberOfPrdEntries,
+    OUT         DWORD*                                      BytesInTable
+    );
+
+static
+void
+_AhciAdvanceDmaCursor(
+    IN          PMDL                                        Mdl,
+    INOUT       PAHCI_DMA_CURSOR                            Cursor,
+    IN          DWORD                                       Bytes
+    );
+
+__forceinline
+static
+BOOLEAN
+_AhciWaitForBitsCleared(
+    IN          volatile DWORD*                             Register,
+    IN          DWORD                                       Mask
+    )
+{
+    DWORD i;
+
+    for (i = 0; i < AHCI_POLL_MAX_ITERATIONS; ++i)
+    {
+        if (0 == (*Register & Mask))
+        {
+            return TRUE;
+        }
+
+        _mm_pause();
+    }
+
+    return FALSE;
+}
+
+__forceinline
+static
+void
+_AhciSetPhysicalAddress(
+    OUT         volatile DWORD*                             Low,
+    OUT         volatile DWORD*                             High,
+    IN          QWORD                                       PhysicalAddress
+    )
+{
+    *Low = (DWORD)QWORD_LOW(PhysicalAddress);
+    *High = (DWORD)QWORD_HIGH(PhysicalAddress);
+}
+
+STATUS
+AhciInitializeController(
+    IN                              PPCI_DEVICE_DESCRIPTION     PciDevice,
+    OUT_PTR                         PAHCI_CONTROLLER*           Controller
+    )
+{
+    STATUS status;
+    PAHCI_CONTROLLER pController;
+    PPCI_BAR pBar;
+    PHYSICAL_ADDRESS abarPa;
+    DWORD capabilities;
+
+    LOG_FUNC_START;
+
+    if (NULL == PciDevice)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Controller)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+    pController = NULL;
+    pBar = &PciDevice->DeviceData->Header.Device.Bar[AHCI_ABAR_INDEX];
+    abarPa = NULL;
+    capabilities = 0;
+
+    __try
+    {
+        if (0 != pBar->MemorySpace.Zero || PCI_MEM_SPACE_32_BIT != pBar->MemorySpace.Type)
+        {
+            LOG_WARNING("ABAR 0x%x is not a 32-bit memory space BAR\n", pBar->Raw);
+            status = STATUS_DEVICE_NOT_SUPPORTED;
+            __leave;
+        }
+
+        pController = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(AHCI_CONTROLLER), HEAP_AHCI_TAG, 0);
+        if (NULL == pController)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(AHCI_CONTROLLER));
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        abarPa = PCI_GET_PA_FROM_MEM_ADDR(pBar);
+        LOG_TRACE_STORAGE("ABAR PA at 0x%X\n", abarPa);
+
+        pController->Registers = IoMapMemory(abarPa, sizeof(AHCI_HBA_REGISTERS), PAGE_RIGHTS_READWRITE);
+        if (NULL == pController->Registers)
+        {
+            LOG_ERROR("IoMapMemory could not map PA 0x%X\n", abarPa);
+            status = STATUS_MEMORY_CANNOT_BE_MAPPED;
+            __leave;
+        }
+
+        // we talk to the HBA only through the AHCI mechanism
+        pController->Registers->GlobalHostControl = pController->Registers->GlobalHostControl | AHCI_GHC_AHCI_ENABLE;
+
+        // no interrupts until the ports are set up
+        pController->Registers->GlobalHostControl = pController->Registers->GlobalHostControl & (~AHCI_GHC_INTERRUPT_ENABLE);
+        pController->Registers->InterruptStatus = pController->Registers->InterruptStatus;
+
+        capabilities = pController->Registers->Capabilities;
+
+        pController->NumberOfCommandSlots = ((capabilities >> AHCI_CAP_COMMAND_SLOTS_SHIFT) & AHCI_CAP_COMMAND_SLOTS_MASK) + 1;
+        pController->NcqSupported = IsBooleanFlagOn(capabilities, AHCI_CAP_SUPPORTS_NCQ);
+        pController->Addressing64Bit = IsBooleanFlagOn(capabilities, AHCI_CAP_SUPPORTS_64_BIT);
+        pController->PortsImplemented = pController->Registers->PortsImplemented;
+
+        LOG_TRACE_STORAGE("AHCI version: 0x%x\n", pController->Registers->Version);
+        LOG_TRACE_STORAGE("Ports implemented: 0x%x\n", pController->PortsImplemented);
+        LOG_TRACE_STORAGE("Command slots: %u\n", pController->NumberOfCommandSlots);
+        LOG_TRACE_STORAGE("NCQ supported: %u\n", pController->NcqSupported);
+        LOG_TRACE_STORAGE("64-bit addressing: %u\n", pController->Addressing64Bit);
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            if (NULL != pController)
+            {
+                AhciUninitializeController(pController);
+                pController = NULL;
+            }
+        }
+        else
+        {
+            *Controller = pController;
+        }
+
+        LOG_FUNC_END;
+    }
+
+    return status;
+}
+
+void
+AhciUninitializeController(
+    IN                              PAHCI_CONTROLLER            Controller
+    )
+{
+    ASSERT(NULL != Controller);
+
+    if (NULL != Controller->Registers)
+    {
+        Controller->Registers->GlobalHostControl = Controller->Registers->GlobalHostControl & (~AHCI_GHC_INTERRUPT_ENABLE);
+
+        IoUnmapMemory((PVOID)Controller->Registers, sizeof(AHCI_HBA_REGISTERS));
+        Controller->Registers = NULL;
+    }
+
+    ExFreePoolWithTag(Controller, HEAP_AHCI_TAG);
+}
+
+STATUS
+AhciInitializePort(
+    IN                              PAHCI_CONTROLLER            Controller,
+    IN                              DWORD                       PortIndex,
+    IN                              PDEVICE_OBJECT              Device
+    )
+{
+    STATUS status;
+    PAHCI_PORT pPort;
+    PAHCI_PORT_REGISTERS pRegisters;
+    DWORD sataStatus;
+    PHYSICAL_ADDRESS dmaPa;
+    DWORD i;
+    PWORD pIdentify;
+    DWORD deviceQueueDepth;
+
+    LOG_FUNC_START;
+
+    if (NULL == Controller)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (PortIndex >= AHCI_MAX_PORTS)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Device)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    status = STATUS_SUCCESS;
+    pPort = IoGetDeviceExtension(Device);
+    ASSERT(NULL != pPort);
+    pRegisters = &Controller->Registers->Ports[PortIndex];
+    dmaPa = NULL;
+    pIdentify = NULL;
+    deviceQueueDepth = 0;
+
+    pPort->Controller = Controller;
+    pPort->Registers = pRegisters;
+    pPort->PortIndex = PortIndex;
+
+    __try
+    {
+        sataStatus = pRegisters->SataStatus;
+        if ((sataStatus & AHCI_PORT_SSTS_DET_MASK) != AHCI_PORT_SSTS_DET_PRESENT ||
+            ((sataStatus >> AHCI_PORT_SSTS_IPM_SHIFT) & AHCI_PORT_SSTS_IPM_MASK) != AHCI_PORT_SSTS_IPM_ACTIVE)
+        {
+            status = STATUS_DEVICE_NOT_CONNECTED;
+            __leave;
+        }
+
+        if (AHCI_PORT_SIGNATURE_ATA != pRegisters->Signature)
+        {
+            LOG_TRACE_STORAGE("Port %u has signature 0x%x, not an ATA disk\n", PortIndex, pRegisters->Signature);
+            status = STATUS_DEVICE_NOT_SUPPORTED;
+            __leave;
+        }
+
+        status = _AhciStopPort(pRegisters);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_AhciStopPort", status);
+            __leave;
+        }
+
+        pPort->DmaMemorySize = AHCI_COMMAND_TABLES_OFFSET + Controller->NumberOfCommandSlots * sizeof(AHCI_COMMAND_TABLE);
+        pPort->DmaMemory = IoAllocateContinuousMemoryEx(pPort->DmaMemorySize, TRUE);
+        if (NULL == pPort->DmaMemory)
+        {
+            LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemoryEx", pPort->DmaMemorySize);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+        ASSERT(IsAddressAligned(pPort->DmaMemory, PAGE_SIZE));
+        memzero(pPort->DmaMemory, pPort->DmaMemorySize);
+
+        dmaPa = IoGetPhysicalAddress(pPort->DmaMemory);
+        ASSERT(NULL != dmaPa);
+        if (!Controller->Addressing64Bit && (QWORD)dmaPa + pPort->DmaMemorySize - 1 > MAX_DWORD)
+        {
+            status = STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
+            __leave;
+        }
+
+        pPort->CommandList = (PAHCI_COMMAND_HEADER)((PBYTE)pPort->DmaMemory + AHCI_COMMAND_LIST_OFFSET);
+        pPort->CommandTables = (PAHCI_COMMAND_TABLE)((PBYTE)pPort->DmaMemory + AHCI_COMMAND_TABLES_OFFSET);
+        pPort->CommandTablesPhysicalAddress = PtrOffset(dmaPa, AHCI_COMMAND_TABLES_OFFSET);
+
+        _AhciSetPhysicalAddress(&pRegisters->CommandListBase,
+                                &pRegisters->CommandListBaseUpper,
+                                (QWORD)dmaPa + AHCI_COMMAND_LIST_OFFSET);
+        _AhciSetPhysicalAddress(&pRegisters->FisBase,
+                                &pRegisters->FisBaseUpper,
+                                (QWORD)dmaPa + AHCI_RECEIVED_FIS_OFFSET);
+
+        // each slot has its own command table, they never change
+        for (i = 0; i < Controller->NumberOfCommandSlots; ++i)
+        {
+            _AhciSetPhysicalAddress(&pPort->CommandList[i].CommandTableBase,
+                                    &pPort->CommandList[i].CommandTableBaseUpper,
+                                    (QWORD)pPort->CommandTablesPhysicalAddress + i * sizeof(AHCI_COMMAND_TABLE));
+        }
+
+        // clear any errors and interrupts left behind by the firmware
+        pRegisters->SataError = MAX_DWORD;
+        pRegisters->InterruptEnable = 0;
+        pRegisters->InterruptStatus = MAX_DWORD;
+
+        status = _AhciStartPort(pRegisters);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_AhciStartPort", status);
+            __leave;
+        }
+
+        status = ExEventInit(&pPort->CommandsCompleted, ExEventTypeSynchronization, FALSE);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ExEventInit", status);
+            __leave;
+        }
+
+        pIdentify = (PWORD)((PBYTE)pPort->DmaMemory + AHCI_IDENTIFY_BUFFER_OFFSET);
+
+        status = _AhciIdentifyDevice(pPort, pIdentify);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_AhciIdentifyDevice", status);
+            __leave;
+        }
+
+        if (!IsBooleanFlagOn(pIdentify[AHCI_IDENTIFY_COMMAND_SET_WORD], AHCI_IDENTIFY_COMMAND_SET_LBA48))
+        {
+            LOG_WARNING("We do not know how to operate disks without 48-bit address support :(\n");
+            status = STATUS_DEVICE_NOT_SUPPORTED;
+            __leave;
+        }
+
+        pPort->TotalSectors = *((QWORD*)&pIdentify[AHCI_IDENTIFY_LBA48_SECTORS_WORD]);
+
+        pPort->NcqEnabled = Controller->NcqSupported &&
+                            IsBooleanFlagOn(pIdentify[AHCI_IDENTIFY_SATA_CAPABILITIES_WORD], AHCI_IDENTIFY_SATA_SUPPORTS_NCQ);
+        if (pPort->NcqEnabled)
+        {
+            deviceQueueDepth = (pIdentify[AHCI_IDENTIFY_QUEUE_DEPTH_WORD] & AHCI_IDENTIFY_QUEUE_DEPTH_MASK) + 1;
+            pPort->QueueDepth = min(Controller->NumberOfCommandSlots, deviceQueueDepth);
+        }
+        else
+        {
+            pPort->QueueDepth = 1;
+        }
+
+        LOG("AHCI port %u: 0x%X sectors, NCQ: %u, queue depth: %u\n",
+            PortIndex, pPort->TotalSectors, pPort->NcqEnabled, pPort->QueueDepth);
+
+        // from now on all the commands complete through interrupts
+        pRegisters->InterruptStatus = MAX_DWORD;
+        pRegisters->InterruptEnable = AHCI_PORT_INT_COMPLETION_MASK;
+
+        Controller->PortDevices[PortIndex] = Device;
+        pPort->Initialized = TRUE;
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            AhciUninitializePort(Device);
+        }
+
+        LOG_FUNC_END;
+    }
+
+    return status;
+}
+
+void
+AhciUninitializePort(
+    IN                              PDEVICE_OBJECT              Device
+    )
+{
+    PAHCI_PORT pPort;
+
+    ASSERT(NULL != Device);
+
+    pPort = IoGetDeviceExtension(Device);
+    ASSERT(NULL != pPort);
+
+    if (NULL != pPort->DmaMemory)
+    {
+        pPort->Registers->InterruptEnable = 0;
+
+        // the HBA must not touch the memory after we free it
+        _AhciStopPort(pPort->Registers);
+
+        IoFreeContinuousMemory(pPort->DmaMemory);
+        pPort->DmaMemory = NULL;
+    }
+
+    if (NULL != pPort->Controller && Device == pPort->Controller->PortDevices[pPort->PortIndex])
+    {
+        pPort->Controller->PortDevices[pPort->PortIndex] = NULL;
+    }
+
+    pPort->Initialized = FALSE;
+}
+
+STATUS
+AhciEnableInterrupts(
+    IN                              PAHCI_CONTROLLER            Controller,
+    IN                              PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN                              PDEVICE_OBJECT              Device
+    )
+{
+    STATUS status;
+    IO_INTERRUPT ioInterrupt;
+
+    ASSERT(NULL != Controller);
+    ASSERT(NULL != PciDevice);
+    ASSERT(NULL != Device);
+
+    memzero(&ioInterrupt, sizeof(IO_INTERRUPT));
+
+    // if the controller is MSI capable the interrupt will be delivered
+    // through MSI, else through the IO APIC
+    ioInterrupt.Type = IoInterruptTypePci;
+    ioInterrupt.Irql = IrqlStorageLevel;
+    ioInterrupt.ServiceRoutine = _AhciInterrupt;
+    ioInterrupt.Exclusive = FALSE;
+    ioInterrupt.Pci.PciDevice = PciDevice;
+
+    status = IoRegisterInterrupt(&ioInterrupt, Device);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoRegisterInterrupt", status);
+        return status;
+    }
+
+    Controller->Registers->InterruptStatus = Controller->Registers->InterruptStatus;
+    Controller->Registers->GlobalHostControl = Controller->Registers->GlobalHostControl | AHCI_GHC_INTERRUPT_ENABLE;
+
+    return status;
+}
+
+STATUS
+AhciReadWriteSectors(
+    IN                              PAHCI_PORT                  Port,
+    IN                              QWORD                       SectorIndex,
+    IN                              QWORD                       SectorCount,
+    _When_(WriteOperation, IN_READS_BYTES(SectorCount*SECTOR_SIZE))
+    _When_(!WriteOperation, OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
+                                    PVOID                       Buffer,
+    OUT                             QWORD*                      SectorsReadWritten,
+    IN                              BOOLEAN                     WriteOperation
+    )
+{
+    STATUS status;
+    PMDL pMdl;
+    AHCI_DMA_CURSOR cursor;
+    QWORD sectorsIssued;
+    QWORD sectorsDone;
+    DWORD pendingSlots;
+    DWORD completedSlots;
+    DWORD slotMask;
+    DWORD noOfPendingSlots;
+    WORD sectorsInSlot[AHCI_MAX_COMMAND_SLOTS];
+    BYTE command;
+    DWORD i;
+
+    if (NULL == Port)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (0 == SectorCount || SectorCount * SECTOR_SIZE > MAX_DWORD)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (NULL == Buffer)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (NULL == SectorsReadWritten)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    status = STATUS_SUCCESS;
+    pMdl = NULL;
+    memzero(&cursor, sizeof(AHCI_DMA_CURSOR));
+    sectorsIssued = 0;
+    sectorsDone = 0;
+    pendingSlots = 0;
+    noOfPendingSlots = 0;
+    slotMask = (AHCI_MAX_COMMAND_SLOTS == Port->QueueDepth) ? MAX_DWORD : ((1UL << Port->QueueDepth) - 1);
+    memzero(sectorsInSlot, sizeof(sectorsInSlot));
+
+    if (Port->NcqEnabled)
+    {
+        command = WriteOperation ? AHCI_ATA_CMD_WRITE_FPDMA_QUEUED : AHCI_ATA_CMD_READ_FPDMA_QUEUED;
+    }
+    else
+    {
+        command = WriteOperation ? AHCI_ATA_CMD_WRITE_DMA_EXT : AHCI_ATA_CMD_READ_DMA_EXT;
+    }
+
+    __try
+    {
+        // the HBA transfers directly to/from the caller's buffer
+        status = IoAllocateMdl(Buffer, (DWORD)(SectorCount * SECTOR_SIZE), NULL, &pMdl);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoAllocateMdl", status);
+            __leave;
+        }
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+        while (TRUE)
+        {
+            DWORD slotsToIssue = 0;
+
+            // fill the queue: each free slot gets the next chunk of the request,
+            // after a failure we only wait for the commands already issued
+            for (i = 0; SUCCEEDED(status) && i < Port->QueueDepth && sectorsIssued < SectorCount; ++i)
+            {
+                WORD noOfPrdEntries;
+                DWORD bytesInCommand;
+
+                if (IsBooleanFlagOn(pendingSlots | slotsToIssue, 1UL << i))
+                {
+                    continue;
+                }
+
+                status = _AhciBuildPrdTable(Port,
+                                            &Port->CommandTables[i],
+                                            pMdl,
+                                            &cursor,
+                                            (SectorCount - sectorsIssued) * SECTOR_SIZE,
+                                            &noOfPrdEntries,
+                                            &bytesInCommand);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("_AhciBuildPrdTable", status);
+                    break;
+                }
+
+                sectorsInSlot[i] = (WORD)(bytesInCommand / SECTOR_SIZE);
+
+                _AhciSetupCommand(Port, i, command, SectorIndex + sectorsIssued, sectorsInSlot[i], noOfPrdEntries, WriteOperation);
+
+                sectorsIssued = sectorsIssued + sectorsInSlot[i];
+                slotsToIssue = slotsToIssue | (1UL << i);
+            }
+
+            if (0 != slotsToIssue)
+            {
+                // mark the slots as outstanding before issuing them, the
+                // interrupt may come as soon as the first one is issued
+                _InterlockedOr(&Port->OutstandingSlots, slotsToIssue);
+
+                if (Port->NcqEnabled)
+                {
+                    Port->Registers->SataActive = slotsToIssue;
+                }
+
+                // all the commands are issued with a single register write
+                Port->Registers->CommandIssue = slotsToIssue;
+
+                pendingSlots = pendingSlots | slotsToIssue;
+
+                noOfPendingSlots = 0;
+                for (i = 0; i < AHCI_MAX_COMMAND_SLOTS; ++i)
+                {
+                    if (IsBooleanFlagOn(pendingSlots, 1UL << i))
+                    {
+                        noOfPendingSlots++;
+                    }
+
+                    if (IsBooleanFlagOn(slotsToIssue, 1UL << i))
+                    {
+                        Port->CommandsIssued++;
+                    }
+                }
+
+                Port->MaxOutstandingCommands = max(Port->MaxOutstandingCommands, noOfPendingSlots);
+            }
+
+            if (0 == pendingSlots)
+            {
+                // either we are done or we could not build a PRD table and
+                // all the commands issued before completed
+                break;
+            }
+
+            ExEventWaitForSignal(&Port->CommandsCompleted);
+
+            completedSlots = pendingSlots & (~Port->OutstandingSlots) & slotMask;
+            pendingSlots = pendingSlots & (~completedSlots);
+
+            if (0 != (completedSlots & Port->FailedSlots))
+            {
+                LOG_ERROR("Command failed on port %u, task file data: 0x%x\n",
+                          Port->PortIndex, Port->TaskFileData);
+                status = STATUS_DEVICE_INVALID_OPERATION;
+
+                // the HBA stops processing commands after an error, the
+                // remaining commands are lost when the port is restarted
+                _AhciRecoverPort(Port);
+                break;
+            }
+
+            for (i = 0; i < AHCI_MAX_COMMAND_SLOTS; ++i)
+            {
+                if (IsBooleanFlagOn(completedSlots, 1UL << i))
+                {
+                    sectorsDone = sectorsDone + sectorsInSlot[i];
+                }
+            }
+
+        }
+    }
+    __finally
+    {
+        if (NULL != pMdl)
+        {
+            IoFreeMdl(pMdl);
+            pMdl = NULL;
+        }
+
+        *SectorsReadWritten = sectorsDone;
+    }
+
+    return status;
+}
+
+static
+STATUS
+_AhciStopPort(
+    IN          PAHCI_PORT_REGISTERS                        Registers
+    )
+{
+    ASSERT(NULL != Registers);
+
+    Registers->Command = Registers->Command & (~AHCI_PORT_CMD_START);
+    if (!_AhciWaitForBitsCleared(&Registers->Command, AHCI_PORT_CMD_LIST_RUNNING))
+    {
+        return STATUS_DEVICE_BUSY;
+    }
+
+    Registers->Command = Registers->Command & (~AHCI_PORT_CMD_FIS_RECEIVE_ENABLE);
+    if (!_AhciWaitForBitsCleared(&Registers->Command, AHCI_PORT_CMD_FIS_RECEIVE_RUNNING))
+    {
+        return STATUS_DEVICE_BUSY;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_AhciStartPort(
+    IN          PAHCI_PORT_REGISTERS                        Registers
+    )
+{
+    ASSERT(NULL != Registers);
+
+    if (!_AhciWaitForBitsCleared(&Registers->TaskFileData, AHCI_PORT_TFD_STATUS_BSY | AHCI_PORT_TFD_STATUS_DRQ))
+    {
+        return STATUS_DEVICE_NOT_READY;
+    }
+
+    Registers->Command = Registers->Command | AHCI_PORT_CMD_FIS_RECEIVE_ENABLE;
+    Registers->Command = Registers->Command | AHCI_PORT_CMD_START;
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_AhciRecoverPort(
+    INOUT       PAHCI_PORT                                  Port
+    )
+{
+    STATUS status;
+
+    ASSERT(NULL != Port);
+
+    // stopping the port clears PxCI and PxSACT
+    status = _AhciStopPort(Port->Registers);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_AhciStopPort", status);
+        return status;
+    }
+
+    Port->Registers->SataError = MAX_DWORD;
+    Port->Registers->InterruptStatus = MAX_DWORD;
+
+    _InterlockedExchange(&Port->OutstandingSlots, 0);
+    _InterlockedExchange(&Port->FailedSlots, 0);
+
+    status = _AhciStartPort(Port->Registers);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_AhciStartPort", status);
+        return status;
+    }
+
+    return status;
+}
+
+static
+STATUS
+_AhciIdentifyDevice(
+    INOUT       PAHCI_PORT                                  Port,
+    OUT_WRITES_ALL(SECTOR_SIZE/sizeof(WORD))
+                PWORD                                       Identify
+    )
+{
+    PAHCI_PRD_ENTRY pPrd;
+    PHYSICAL_ADDRESS identifyPa;
+    DWORD i;
+
+    ASSERT(NULL != Port);
+    ASSERT(NULL != Identify);
+
+    identifyPa = IoGetPhysicalAddress(Identify);
+    ASSERT(NULL != identifyPa);
+
+    pPrd = &Port->CommandTables[0].Prdt[0];
+    _AhciSetPhysicalAddress(&pPrd->DataBase, &pPrd->DataBaseUpper, (QWORD)identifyPa);
+    pPrd->ByteCount = SECTOR_SIZE - 1;
+    pPrd->InterruptOnCompletion = 0;
+
+    _AhciSetupCommand(Port, 0, AHCI_ATA_CMD_IDENTIFY, 0, 0, 1, FALSE);
+
+    // interrupts are not yet enabled on the port, we poll for completion
+    Port->Registers->CommandIssue = 1;
+
+    for (i = 0; i < AHCI_POLL_MAX_ITERATIONS; ++i)
+    {
+        if (IsBooleanFlagOn(Port->Registers->InterruptStatus, AHCI_PORT_INT_ERROR_MASK))
+        {
+            LOG_ERROR("IDENTIFY failed, task file data: 0x%x\n", Port->Registers->TaskFileData);
+            return STATUS_DEVICE_INVALID_OPERATION;
+        }
+
+        if (!IsBooleanFlagOn(Port->Registers->CommandIssue, 1))
+        {
+            return STATUS_SUCCESS;
+        }
+
+        _mm_pause();
+    }
+
+    return STATUS_DEVICE_NOT_READY;
+}
+
+static
+void
+_AhciSetupCommand(
+    INOUT       PAHCI_PORT                                  Port,
+    IN          DWORD                                       Slot,
+    IN          BYTE                                        Command,
+    IN          QWORD                                       SectorIndex,
+    IN          WORD                                        SectorCount,
+    IN          WORD                                        NumberOfPrdEntries,
+    IN          BOOLEAN                                     WriteOperation
+    )
+{
+    PAHCI_COMMAND_HEADER pHeader;
+    PAHCI_FIS_REGISTER_H2D pFis;
+    PBYTE lba;
+
+    ASSERT(NULL != Port);
+    ASSERT(Slot < AHCI_MAX_COMMAND_SLOTS);
+
+    pHeader = &Port->CommandList[Slot];
+    pFis = (PAHCI_FIS_REGISTER_H2D)Port->CommandTables[Slot].CommandFis;
+    lba = (PBYTE)&SectorIndex;
+
+    memzero(pFis, sizeof(AHCI_FIS_REGISTER_H2D));
+
+    pFis->FisType = AHCI_FIS_TYPE_REGISTER_H2D;
+    pFis->CommandBit = 1;
+    pFis->Command = Command;
+    pFis->Device = (AHCI_ATA_CMD_IDENTIFY == Command) ? 0 : AHCI_ATA_DEVICE_LBA;
+
+    pFis->Lba0 = lba[0];
+    pFis->Lba1 = lba[1];
+    pFis->Lba2 = lba[2];
+    pFis->Lba3 = lba[3];
+    pFis->Lba4 = lba[4];
+    pFis->Lba5 = lba[5];
+
+    if (AHCI_ATA_CMD_READ_FPDMA_QUEUED == Command || AHCI_ATA_CMD_WRITE_FPDMA_QUEUED == Command)
+    {
+        // for queued commands the sector count goes in the features
+        // registers and the count register holds the tag
+        pFis->FeatureLow = WORD_LOW(SectorCount);
+        pFis->FeatureHigh = WORD_HIGH(SectorCount);
+        pFis->CountLow = (BYTE)(Slot << 3);
+    }
+    else
+    {
+        pFis->CountLow = WORD_LOW(SectorCount);
+        pFis->CountHigh = WORD_HIGH(SectorCount);
+    }
+
+    pHeader->CommandFisLength = sizeof(AHCI_FIS_REGISTER_H2D) / sizeof(DWORD);
+    pHeader->Atapi = 0;
+    pHeader->Write = WriteOperation;
+    pHeader->Prefetchable = 0;
+    pHeader->ClearBusyOnOk = 0;
+    pHeader->PrdtLength = NumberOfPrdEntries;
+    pHeader->PrdByteCount = 0;
+}
+
+static
+STATUS
+_AhciBuildPrdTable(
+    IN          PAHCI_PORT                                  Port,
+    INOUT       PAHCI_COMMAND_TABLE                         CommandTable,
+    IN          PMDL                                        Mdl,
+    INOUT       PAHCI_DMA_CURSOR                            Cursor,
+    IN          QWORD                                       BytesRemaining,
+    OUT         WORD*                                       NumberOfPrdEntries,
+    OUT         DWORD*                                      BytesInTable
+    )
+{
+    AHCI_DMA_CURSOR cursor;
+    DWORD indexInPrdEntries;
+    DWORD bytesInTable;
+    DWORD maxBytes;
+    DWORD excessBytes;
+
+    ASSERT(NULL != Port);
+    ASSERT(NULL != CommandTable);
+    ASSERT(NULL != Mdl);
+    ASSERT(NULL != Cursor);
+    ASSERT(0 != BytesRemaining);
+    ASSERT(NULL != NumberOfPrdEntries);
+    ASSERT(NULL != BytesInTable);
+
+    cursor = *Cursor;
+    indexInPrdEntries = 0;
+    bytesInTable = 0;
+    maxBytes = (DWORD)min(BytesRemaining, AHCI_MAX_BYTES_PER_COMMAND);
+
+    while (bytesInTable < maxBytes && indexInPrdEntries < AHCI_PRDT_ENTRIES_PER_COMMAND)
+    {
+        QWORD address;
+        DWORD byteCountForPrd;
+
+        MDL_TRANSLATION_PAIR* pCurPair = IoMdlGetTranslationPair(Mdl, cursor.PairIndex);
+        ASSERT(NULL != pCurPair);
+
+        address = (QWORD)pCurPair->Address + cursor.PairOffset;
+
+        if (!IsAddressAligned(address, AHCI_PRD_ALIGNMENT) ||
+            !IsAddressAligned(pCurPair->NumberOfBytes, AHCI_PRD_ALIGNMENT))
+        {
+            return STATUS_DEVICE_DATA_ALIGNMENT_ERROR;
+        }
+
+        if (!Port->Controller->Addressing64Bit && address + pCurPair->NumberOfBytes - cursor.PairOffset - 1 > MAX_DWORD)
+        {
+            return STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
+        }
+
+        byteCountForPrd = min(pCurPair->NumberOfBytes - cursor.PairOffset, maxBytes - bytesInTable);
+        byteCountForPrd = min(byteCountForPrd, AHCI_PRD_MAX_BYTE_COUNT);
+
+        _AhciSetPhysicalAddress(&CommandTable->Prdt[indexInPrdEntries].DataBase,
+                                &CommandTable->Prdt[indexInPrdEntries].DataBaseUpper,
+                                address);
+        CommandTable->Prdt[indexInPrdEntries].ByteCount = byteCountForPrd - 1;
+        CommandTable->Prdt[indexInPrdEntries].InterruptOnCompletion = 0;
+
+        indexInPrdEntries++;
+        bytesInTable = bytesInTable + byteCountForPrd;
+
+        cursor.PairOffset = cursor.PairOffset + byteCountForPrd;
+        if (cursor.PairOffset == pCurPair->NumberOfBytes)
+        {
+            cursor.PairIndex++;
+            cursor.PairOffset = 0;
+        }
+    }
+
+    // if the table filled up in the middle of a sector we leave the partial
+    // sector for the next command
+    excessBytes = (DWORD)AddressOffset(bytesInTable, SECTOR_SIZE);
+    bytesInTable = bytesInTable - excessBytes;
+
+    while (0 != excessBytes)
+    {
+        DWORD lastByteCount;
+
+        ASSERT(indexInPrdEntries > 0);
+
+        lastByteCount = CommandTable->Prdt[indexInPrdEntries - 1].ByteCount + 1;
+        if (lastByteCount <= excessBytes)
+        {
+            indexInPrdEntries--;
+            excessBytes = excessBytes - lastByteCount;
+        }
+        else
+        {
+            CommandTable->Prdt[indexInPrdEntries - 1].ByteCount = lastByteCount - excessBytes - 1;
+            excessBytes = 0;
+        }
+    }
+
+    ASSERT(0 != bytesInTable);
+    ASSERT(0 != indexInPrdEntries);
+
+    _AhciAdvanceDmaCursor(Mdl, Cursor, bytesInTable);
+
+    *NumberOfPrdEntries = (WORD)indexInPrdEntries;
+    *BytesInTable = bytesInTable;
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_AhciAdvanceDmaCursor(
+    IN          PMDL                                        Mdl,
+    INOUT       PAHCI_DMA_CURSOR                            Cursor,
+    IN          DWORD                                       Bytes
+    )
+{
+    DWORD bytesRemaining;
+
+    ASSERT(NULL != Mdl);
+    ASSERT(NULL != Cursor);
+
+    bytesRemaining = Bytes;
+
+    while (0 != bytesRemaining)
+    {
+        DWORD bytesInPair;
+
+        MDL_TRANSLATION_PAIR* pCurPair = IoMdlGetTranslationPair(Mdl, Cursor->PairIndex);
+        ASSERT(NULL != pCurPair);
+
+        bytesInPair = min(pCurPair->NumberOfBytes - Cursor->PairOffset, bytesRemaining);
+
+        Cursor->PairOffset = Cursor->PairOffset + bytesInPair;
+        if (Cursor->PairOffset == pCurPair->NumberOfBytes)
+        {
+            Cursor->PairIndex++;
+            Cursor->PairOffset = 0;
+        }
+
+        bytesRemaining = bytesRemaining - bytesInPair;
+    }
+}
+
+BOOLEAN
+(__cdecl _AhciInterrupt)(
+    IN      PDEVICE_OBJECT  Device
+    )
+{
+    PAHCI_PORT pInterruptPort;
+    PAHCI_CONTROLLER pController;
+    DWORD hbaInterruptStatus;
+    DWORD i;
+
+    ASSERT(NULL != Device);
+
+    pInterruptPort = IoGetDeviceExtension(Device);
+    ASSERT(NULL != pInterruptPort);
+
+    pController = pInterruptPort->Controller;
+    ASSERT(NULL != pController);
+
+    hbaInterruptStatus = pController->Registers->InterruptStatus;
+    if (0 == hbaInterruptStatus)
+    {
+        // not our interrupt
+        return FALSE;
+    }
+
+    // a single interrupt services all the ports which have completions
+    for (i = 0; i < AHCI_MAX_PORTS; ++i)
+    {
+        PAHCI_PORT pPort;
+        PAHCI_PORT_REGISTERS pRegisters;
+        DWORD portInterruptStatus;
+        DWORD completedSlots;
+
+        if (!IsBooleanFlagOn(hbaInterruptStatus, 1UL << i))
+        {
+            continue;
+        }
+
+        pRegisters = &pController->Registers->Ports[i];
+
+        portInterruptStatus = pRegisters->InterruptStatus;
+        pRegisters->InterruptStatus = portInterruptStatus;
+
+        if (NULL == pController->PortDevices[i])
+        {
+            continue;
+        }
+
+        pPort = IoGetDeviceExtension(pController->PortDevices[i]);
+        ASSERT(NULL != pPort);
+
+        if (IsBooleanFlagOn(portInterruptStatus, AHCI_PORT_INT_ERROR_MASK))
+        {
+            // we can't tell which command failed, fail all of them
+            pPort->TaskFileData = pRegisters->TaskFileData;
+            completedSlots = pPort->OutstandingSlots;
+            _InterlockedOr(&pPort->FailedSlots, completedSlots);
+        }
+        else
+        {
+            // queued commands are removed from PxSACT by the Set Device Bits
+            // FIS, non-queued ones from PxCI when they complete
+            completedSlots = pPort->OutstandingSlots & (~(pRegisters->SataActive | pRegisters->CommandIssue));
+        }
+
+        if (0 != completedSlots)
+        {
+            _InterlockedAnd(&pPort->OutstandingSlots, ~completedSlots);
+            ExEventSignal(&pPort->CommandsCompleted);
+        }
+    }
+
+    pController->Registers->InterruptStatus = hbaInterruptStatus;
+
+    return TRUE;
+}
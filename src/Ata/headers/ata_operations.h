@@ -14,11 +14,11 @@ STATUS
 AtaReadWriteSectors(
     IN                              PATA_DEVICE                 Device,
     IN                              QWORD                       SectorIndex,
-    IN                              WORD                        SectorCount,
+    IN                              QWORD                       SectorCount,
     _When_(WriteOperation, OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
     _When_(!WriteOperation, IN_READS_BYTES(SectorCount*SECTOR_SIZE))
                                     PVOID                       Buffer,
-    OUT                             WORD*                       SectorsReadWriten,
+    OUT                             QWORD*                      SectorsReadWriten,
     IN                              BOOLEAN                     Asynchronous,
     IN                              BOOLEAN                     WriteOperation
     );
\ No newline at end of file
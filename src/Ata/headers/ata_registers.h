@@ -84,6 +84,14 @@ typedef enum _ATA_REGISTER
 #define ATA_DMA_MAX_PHYSICAL_ADDRESS            MAX_DWORD
 #define ATA_DMA_ALIGNMENT                       4
 
+// The PRD table of each device is preallocated as a single page, a page
+// aligned table never crosses the 64KB boundary forbidden by the bus master
+#define ATA_DMA_PRD_TABLE_SIZE                  PAGE_SIZE
+#define ATA_DMA_MAX_PRD_ENTRIES                 (ATA_DMA_PRD_TABLE_SIZE / ATA_PRD_ENTRY_PREDEFINED_SIZE)
+
+// Larger requests are split in multiple commands
+#define ATA_MAX_SECTORS_PER_COMMAND             MAX_WORD
+
 // PRD (Physical Region Descriptor)
 #pragma pack(push,1)
 
@@ -14,7 +14,14 @@ typedef struct _ATA_CURRENT_TRANSFER
     volatile DWORD              State;
     EX_EVENT                    TransferReady;
 
+    // allocated when the device is initialized and reused by all the DMA
+    // transfers, only the entries are rewritten for each command
     union _PRD_ENTRY*           Prdt;
+    DWORD                       PrdtPhysicalAddress;
+
+    // written by the interrupt handler when the command completes
+    volatile BYTE               DeviceStatus;
+    volatile BYTE               DeviceError;
 } ATA_CURRENT_TRANSFER, *PATA_CURRENT_TRANSPER;
 
 typedef struct _ATA_DEVICE_REGISTERS
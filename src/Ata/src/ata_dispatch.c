@@ -31,7 +31,7 @@ STATUS
 _AtaCheckIOParameters(
     IN                                          PATA_DEVICE     Device,
     IN                                          QWORD           SectorIndex,
-    IN                                          WORD            SectorCount
+    IN                                          QWORD           SectorCount
     )
 {
     ASSERT(NULL != Device);
@@ -75,7 +75,7 @@ STATUS
     STATUS status;
     QWORD sizeInBytes;
     QWORD offset;
-    WORD sectorsRead;
+    QWORD sectorsRead;
     BOOLEAN writeOperation;
 
     ASSERT(NULL != DeviceObject);
@@ -120,13 +120,15 @@ STATUS
 
         LOG_TRACE_STORAGE("Sector index, Sector count: 0x%X, 0x%X\n", sectorIndex, sectorCount);
 
-        if (sectorCount > MAX_WORD)
+        // larger requests are split by AtaReadWriteSectors, but the whole
+        // buffer must be described by a single MDL
+        if (sizeInBytes > MAX_DWORD)
         {
             status = STATUS_DEVICE_SECTOR_COUNT_EXCEEDED;
             __leave;
         }
 
-        status = _AtaCheckIOParameters(pAtaDevice, sectorIndex, (WORD)sectorCount);
+        status = _AtaCheckIOParameters(pAtaDevice, sectorIndex, sectorCount);
         if (!SUCCEEDED(status))
         {
             __leave;
@@ -138,7 +140,7 @@ STATUS
 
         ASSERT(AtaTransferStateFree == _InterlockedCompareExchange(&pAtaDevice->CurrentTransfer.State, AtaTransferStateInProgress, AtaTransferStateFree));
 
-        status = AtaReadWriteSectors(pAtaDevice, sectorIndex, (WORD)sectorCount, Irp->Buffer, &sectorsRead, (BOOLEAN)Irp->Flags.Asynchronous, writeOperation);
+        status = AtaReadWriteSectors(pAtaDevice, sectorIndex, sectorCount, Irp->Buffer, &sectorsRead, (BOOLEAN)Irp->Flags.Asynchronous, writeOperation);
 
         _InterlockedExchange(&pAtaDevice->CurrentTransfer.State, AtaTransferStateFree);
     }
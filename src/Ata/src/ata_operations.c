@@ -44,13 +44,39 @@ _AtaWriteBuffer(
     IN                          DWORD                       WordsToRead
     );
 
+// Position in the MDL of the first byte not yet described by a PRD table
+typedef struct _ATA_DMA_CURSOR
+{
+    DWORD                       PairIndex;
+    DWORD                       PairOffset;
+} ATA_DMA_CURSOR, *PATA_DMA_CURSOR;
+
 static
 STATUS
-_AtaPrepareDmaTransfer(
-    IN          PATA_DEVICE_REGISTERS                       AtaDevice,
+_AtaBuildPrdTable(
     INOUT       PATA_CURRENT_TRANSPER                       CurrentTransfer,
-    IN          PVOID                                       Buffer,
+    IN          PMDL                                        Mdl,
+    INOUT       PATA_DMA_CURSOR                             Cursor,
+    IN          QWORD                                       BytesRemaining,
+    OUT         DWORD*                                      BytesInTable
+    );
+
+static
+void
+_AtaAdvanceDmaCursor(
+    IN          PMDL                                        Mdl,
+    INOUT       PATA_DMA_CURSOR                             Cursor,
+    IN          DWORD                                       Bytes
+    );
+
+static
+STATUS
+_AtaIssueCommand(
+    IN          PATA_DEVICE                                 Device,
+    IN          QWORD                                       SectorIndex,
     IN          WORD                                        SectorCount,
+    IN          PVOID                                       Buffer,
+    IN          BOOLEAN                                     Asynchronous,
     IN          BOOLEAN                                     WriteOperation
     );
 
@@ -310,162 +336,146 @@ _AtaWriteBuffer(
 
 static
 STATUS
-_AtaPrepareDmaTransfer(
-    IN          PATA_DEVICE_REGISTERS                       AtaDevice,
+_AtaBuildPrdTable(
     INOUT       PATA_CURRENT_TRANSPER                       CurrentTransfer,
-    IN          PVOID                                       Buffer,
-    IN          WORD                                        SectorCount,
-    IN          BOOLEAN                                     WriteOperation
+    IN          PMDL                                        Mdl,
+    INOUT       PATA_DMA_CURSOR                             Cursor,
+    IN          QWORD                                       BytesRemaining,
+    OUT         DWORD*                                      BytesInTable
     )
 {
-    PMDL pMdl;
     STATUS status;
-    DWORD byteCount;
-    DWORD noOfMdlTranslationEntries;
-    DWORD indexInPrdEntries;
     PPRD_ENTRY prdTable;
-    DWORD i;
-    PHYSICAL_ADDRESS prdtPa;
-    DWORD bytesRemaining;
-    DWORD allocationSize;
-
-    LOG_FUNC_START;
+    ATA_DMA_CURSOR cursor;
+    DWORD indexInPrdEntries;
+    DWORD bytesInTable;
+    DWORD maxBytes;
+    DWORD excessBytes;
 
-    ASSERT( NULL != AtaDevice );
     ASSERT( NULL != CurrentTransfer );
-    ASSERT( NULL != Buffer );
-    ASSERT( 0 != SectorCount );
+    ASSERT( NULL != CurrentTransfer->Prdt );
+    ASSERT( NULL != Mdl );
+    ASSERT( NULL != Cursor );
+    ASSERT( 0 != BytesRemaining );
+    ASSERT( NULL != BytesInTable );
 
-    pMdl = NULL;
     status = STATUS_SUCCESS;
-    byteCount = SectorCount * SECTOR_SIZE;
-    noOfMdlTranslationEntries = 0;
-    prdTable = NULL;
-    prdtPa = NULL;
-    bytesRemaining = SectorCount * SECTOR_SIZE;
+    prdTable = CurrentTransfer->Prdt;
+    cursor = *Cursor;
     indexInPrdEntries = 0;
-    allocationSize = 0;
+    bytesInTable = 0;
+    maxBytes = (DWORD)min(BytesRemaining, ATA_MAX_SECTORS_PER_COMMAND * SECTOR_SIZE);
 
-    status = IoAllocateMdl(Buffer,byteCount,NULL,&pMdl);
-    if (!SUCCEEDED(status))
+    // describe the caller's buffer directly, each translation pair is split
+    // at the 64KB boundaries the bus master cannot cross
+    while (bytesInTable < maxBytes && indexInPrdEntries < ATA_DMA_MAX_PRD_ENTRIES)
     {
-        LOG_FUNC_ERROR("IoAllocateMdl", status);
-        return status;
-    }
+        QWORD address;
+        DWORD byteCountForPrd;
 
-    noOfMdlTranslationEntries = IoMdlGetNumberOfPairs(pMdl);
-    ASSERT( 0 != noOfMdlTranslationEntries );
+        MDL_TRANSLATION_PAIR* pCurPair = IoMdlGetTranslationPair(Mdl, cursor.PairIndex);
+        ASSERT(NULL != pCurPair);
 
-    // we allocate twice as many entries because we may have translations which cross
-    // the 64KB boundary => we will split such translations into 2 distinct PRD entries
-    allocationSize = sizeof(PRD_ENTRY) * noOfMdlTranslationEntries * 2;
-
-    __try
-    {
-        // also we align at allocationSize so that we can make sure we do not cross page boundaries
-        prdTable = IoAllocateContinuousMemoryEx(allocationSize, TRUE);
-        if (NULL == prdTable)
+        status = _AtaValidateTranslationPair(pCurPair);
+        if (!SUCCEEDED(status))
         {
-            LOG_FUNC_ERROR("HeapAllocatePoolWithTag", allocationSize);
-            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
-            __leave;
+            return status;
         }
-        ASSERT(IsInSameBoundary(prdTable, allocationSize, PAGE_SIZE));
 
-        for (i = 0; i < noOfMdlTranslationEntries; ++i)
-        {
-            WORD byteCountForPrd;
-            WORD byteCountForAlignment;
+        address = (QWORD)pCurPair->Address + cursor.PairOffset;
 
-            MDL_TRANSLATION_PAIR* pCurPair = IoMdlGetTranslationPair(pMdl, i);
-            ASSERT(NULL != pCurPair);
+        byteCountForPrd = min(pCurPair->NumberOfBytes - cursor.PairOffset, maxBytes - bytesInTable);
+        byteCountForPrd = (DWORD)min(byteCountForPrd, ATA_DMA_PHYSICAL_BOUNDARY - AddressOffset(address, ATA_DMA_PHYSICAL_BOUNDARY));
 
-            status = _AtaValidateTranslationPair(pCurPair);
-            if (!SUCCEEDED(status))
-            {
-                __leave;
-            }
+        prdTable[indexInPrdEntries].PhysicalAddress = (DWORD)address;
 
-            byteCountForPrd = (WORD)min(pCurPair->NumberOfBytes, bytesRemaining);
-            byteCountForAlignment = 0;
+        // a full 64KB region is described with a byte count of 0
+        prdTable[indexInPrdEntries].ByteCount = (WORD)byteCountForPrd;
+        prdTable[indexInPrdEntries].LastEntry = 0;
 
-            if (!IsInSameBoundary(pCurPair->Address, byteCountForPrd, ATA_DMA_PHYSICAL_BOUNDARY))
-            {
-                byteCountForAlignment = (WORD)(ATA_DMA_PHYSICAL_BOUNDARY - AddressOffset(pCurPair->Address, ATA_DMA_PHYSICAL_BOUNDARY));
+        indexInPrdEntries++;
+        bytesInTable = bytesInTable + byteCountForPrd;
 
-                // warning C4311: 'type cast': pointer truncation from 'PHYSICAL_ADDRESS' to 'DWORD'
-#pragma warning(suppress:4311)
-                prdTable[indexInPrdEntries].PhysicalAddress = (DWORD)pCurPair->Address;
-                prdTable[indexInPrdEntries].ByteCount = byteCountForAlignment;
-                prdTable[indexInPrdEntries].LastEntry = 0;
+        cursor.PairOffset = cursor.PairOffset + byteCountForPrd;
+        if (cursor.PairOffset == pCurPair->NumberOfBytes)
+        {
+            cursor.PairIndex++;
+            cursor.PairOffset = 0;
+        }
+    }
 
-                indexInPrdEntries++;
-            }
+    // if the table filled up in the middle of a sector we leave the partial
+    // sector for the next command
+    excessBytes = (DWORD)AddressOffset(bytesInTable, SECTOR_SIZE);
+    bytesInTable = bytesInTable - excessBytes;
 
-            // warning C4311: 'type cast': pointer truncation from 'PHYSICAL_ADDRESS' to 'DWORD'
-#pragma warning(suppress:4311)
-            prdTable[indexInPrdEntries].PhysicalAddress = (DWORD)pCurPair->Address + byteCountForAlignment;
-            prdTable[indexInPrdEntries].ByteCount = byteCountForPrd - byteCountForAlignment;
-            prdTable[indexInPrdEntries].LastEntry = 0;
+    while (0 != excessBytes)
+    {
+        DWORD lastByteCount;
 
-            // increment lbaOffset
-            bytesRemaining = bytesRemaining - byteCountForPrd;
+        ASSERT(indexInPrdEntries > 0);
 
-            indexInPrdEntries++;
+        lastByteCount = (0 == prdTable[indexInPrdEntries - 1].ByteCount) ? (DWORD)ATA_DMA_PHYSICAL_BOUNDARY : prdTable[indexInPrdEntries - 1].ByteCount;
+        if (lastByteCount <= excessBytes)
+        {
+            indexInPrdEntries--;
+            excessBytes = excessBytes - lastByteCount;
         }
+        else
+        {
+            prdTable[indexInPrdEntries - 1].ByteCount = (WORD)(lastByteCount - excessBytes);
+            excessBytes = 0;
+        }
+    }
 
-        ASSERT(0 == bytesRemaining);
+    ASSERT(0 != bytesInTable);
+    ASSERT(0 != indexInPrdEntries);
 
-        // mark last entry
-        prdTable[indexInPrdEntries - 1].LastEntry = 1;
+    // mark last entry
+    prdTable[indexInPrdEntries - 1].LastEntry = 1;
 
-        LOG_TRACE_STORAGE("Number of entries: 0x%x\n", indexInPrdEntries);
-        for (i = 0; i < indexInPrdEntries; ++i)
-        {
-            LOG_TRACE_STORAGE("prdTable[i].PhysicalAddress: 0x%x\n", prdTable[i].PhysicalAddress);
-            LOG_TRACE_STORAGE("prdTable[i].ByteCount: 0x%x\n", prdTable[i].ByteCount);
-            LOG_TRACE_STORAGE("prdTable[i].LastEntry: 0x%x\n", prdTable[i].LastEntry);
-            LOG_TRACE_STORAGE("prdTable[i].Raw: 0x%X\n", prdTable[i].Raw);
-        }
+    LOG_TRACE_STORAGE("Number of entries: 0x%x\n", indexInPrdEntries);
+    LOG_TRACE_STORAGE("Bytes in table: 0x%x\n", bytesInTable);
 
-        prdtPa = IoGetPhysicalAddress(prdTable);
-        ASSERT(NULL != prdtPa);
-        if ((QWORD)prdtPa > MAX_DWORD)
-        {
-            status = STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
-            __leave;
-        }
+    _AtaAdvanceDmaCursor(Mdl, Cursor, bytesInTable);
+    *BytesInTable = bytesInTable;
+
+    return status;
+}
 
-        LOG_TRACE_STORAGE("About to set up DMA registers!\n");
+static
+void
+_AtaAdvanceDmaCursor(
+    IN          PMDL                                        Mdl,
+    INOUT       PATA_DMA_CURSOR                             Cursor,
+    IN          DWORD                                       Bytes
+    )
+{
+    DWORD bytesRemaining;
 
-        // setup DMA registers
+    ASSERT( NULL != Mdl );
+    ASSERT( NULL != Cursor );
 
-    // warning C4311: 'type cast': pointer truncation from 'PHYSICAL_ADDRESS' to 'DWORD'
-#pragma warning(suppress:4311)
-        _AtaWriteDmaRegisters(AtaDevice, (DWORD)prdtPa, WriteOperation);
+    bytesRemaining = Bytes;
 
-        CurrentTransfer->Prdt = prdTable;
-    }
-    __finally
+    while (0 != bytesRemaining)
     {
-        if (!SUCCEEDED(status))
-        {
-            if (NULL != prdTable)
-            {
-                IoFreeContinuousMemory(prdTable);
-                prdTable = NULL;
-            }
-        }
-        if (NULL != pMdl)
+        DWORD bytesInPair;
+
+        MDL_TRANSLATION_PAIR* pCurPair = IoMdlGetTranslationPair(Mdl, Cursor->PairIndex);
+        ASSERT(NULL != pCurPair);
+
+        bytesInPair = min(pCurPair->NumberOfBytes - Cursor->PairOffset, bytesRemaining);
+
+        Cursor->PairOffset = Cursor->PairOffset + bytesInPair;
+        if (Cursor->PairOffset == pCurPair->NumberOfBytes)
         {
-            IoFreeMdl(pMdl);
-            pMdl = NULL;
+            Cursor->PairIndex++;
+            Cursor->PairOffset = 0;
         }
 
-        LOG_FUNC_END;
+        bytesRemaining = bytesRemaining - bytesInPair;
     }
-
-    return status;
 }
 
 static
@@ -476,7 +486,9 @@ _AtaValidateTranslationPair(
 {
     ASSERT( NULL != TranslationPair );
 
-    if ((QWORD)TranslationPair->Address > ATA_DMA_MAX_PHYSICAL_ADDRESS)
+    // spans crossing 64KB boundaries are split when the PRD table is built,
+    // but the whole span must be addressable with 32 bits
+    if ((QWORD)TranslationPair->Address + TranslationPair->NumberOfBytes - 1 > ATA_DMA_MAX_PHYSICAL_ADDRESS)
     {
         return STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
     }
@@ -486,11 +498,6 @@ _AtaValidateTranslationPair(
         return STATUS_DEVICE_DATA_ALIGNMENT_ERROR;
     }
 
-    if (TranslationPair->NumberOfBytes > ATA_DMA_MAX_PHYSICAL_LEN)
-    {
-        return STATUS_DEVICE_DMA_PHYSICAL_SPAN_TOO_LARGE;
-    }
-
     if (!IsAddressAligned(TranslationPair->NumberOfBytes, ATA_DMA_ALIGNMENT))
     {
         return STATUS_DEVICE_DATA_ALIGNMENT_ERROR;
@@ -539,6 +546,7 @@ AtaInitialize(
     PATA_DEVICE pDeviceExtension;
     IO_INTERRUPT ioInterrupt;
     BOOLEAN bLegacyDevice;
+    PHYSICAL_ADDRESS prdtPa;
 
     LOG_FUNC_START;
 
@@ -556,6 +564,7 @@ AtaInitialize(
     data = 0;
     pDeviceExtension = NULL;
     memzero(&ioInterrupt, sizeof(IO_INTERRUPT));
+    prdtPa = NULL;
 
     pDeviceExtension = IoGetDeviceExtension(Device);
     ASSERT(NULL != pDeviceExtension);
@@ -696,6 +705,28 @@ AtaInitialize(
     // make sure DMA transfer is stopped
     _AtaWriteRegister(&pDeviceExtension->DeviceRegisters, AtaRegisterBusCommand, 0 );
 
+    // the PRD table is allocated once and reused for all the transfers
+    pDeviceExtension->CurrentTransfer.Prdt = IoAllocateContinuousMemoryEx(ATA_DMA_PRD_TABLE_SIZE, TRUE);
+    if (NULL == pDeviceExtension->CurrentTransfer.Prdt)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemoryEx", ATA_DMA_PRD_TABLE_SIZE);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+    ASSERT(IsInSameBoundary(pDeviceExtension->CurrentTransfer.Prdt, ATA_DMA_PRD_TABLE_SIZE, ATA_DMA_PHYSICAL_BOUNDARY));
+
+    prdtPa = IoGetPhysicalAddress(pDeviceExtension->CurrentTransfer.Prdt);
+    ASSERT(NULL != prdtPa);
+    if ((QWORD)prdtPa > ATA_DMA_MAX_PHYSICAL_ADDRESS)
+    {
+        IoFreeContinuousMemory(pDeviceExtension->CurrentTransfer.Prdt);
+        pDeviceExtension->CurrentTransfer.Prdt = NULL;
+        return STATUS_DEVICE_DMA_PHYSICAL_ADDRESS_TOO_HIGH;
+    }
+
+    // warning C4311: 'type cast': pointer truncation from 'PHYSICAL_ADDRESS' to 'DWORD'
+#pragma warning(suppress:4311)
+    pDeviceExtension->CurrentTransfer.PrdtPhysicalAddress = (DWORD)prdtPa;
+
     pDeviceExtension->Initialized = TRUE;
 
     return status;
@@ -705,25 +736,28 @@ STATUS
 AtaReadWriteSectors(
     IN                                          PATA_DEVICE     Device,
     IN                                          QWORD           SectorIndex,
-    IN                                          WORD            SectorCount,
+    IN                                          QWORD           SectorCount,
     _When_(WriteOperation,OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
     _When_(!WriteOperation,IN_READS_BYTES(SectorCount*SECTOR_SIZE))
                                                 PVOID           Buffer,
-    OUT                                         WORD*           SectorsReadWriten,
+    OUT                                         QWORD*          SectorsReadWriten,
     IN                                          BOOLEAN         Asynchronous,
     IN                                          BOOLEAN         WriteOperation
     )
 {
     STATUS status;
-    PATA_DEVICE_REGISTERS pDevRegisters;
-    BYTE ataCmd;
+    PMDL pMdl;
+    ATA_DMA_CURSOR cursor;
+    QWORD sectorsDone;
+    QWORD sectorsInCommand;
+    DWORD bytesInCommand;
 
     if (NULL == Device)
     {
         return STATUS_INVALID_PARAMETER1;
     }
 
-    if (0 == SectorCount)
+    if (0 == SectorCount || SectorCount * SECTOR_SIZE > MAX_DWORD)
     {
         return STATUS_INVALID_PARAMETER3;
     }
@@ -739,8 +773,104 @@ AtaReadWriteSectors(
     }
 
     status = STATUS_SUCCESS;
+    pMdl = NULL;
+    memzero(&cursor, sizeof(ATA_DMA_CURSOR));
+    sectorsDone = 0;
+    sectorsInCommand = 0;
+    bytesInCommand = 0;
+
+    LOG_TRACE_STORAGE("Asynchronous: 0x%x\n", Asynchronous );
+
+    __try
+    {
+        if (Asynchronous)
+        {
+            // the device transfers directly to/from the caller's buffer
+            status = IoAllocateMdl(Buffer, (DWORD)(SectorCount * SECTOR_SIZE), NULL, &pMdl);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("IoAllocateMdl", status);
+                __leave;
+            }
+        }
+
+        // requests which do not fit in a single command are split in
+        // multiple commands issued back to back
+        while (sectorsDone < SectorCount)
+        {
+            if (Asynchronous)
+            {
+                status = _AtaBuildPrdTable(&Device->CurrentTransfer,
+                                           pMdl,
+                                           &cursor,
+                                           (SectorCount - sectorsDone) * SECTOR_SIZE,
+                                           &bytesInCommand);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("_AtaBuildPrdTable", status);
+                    __leave;
+                }
+
+                sectorsInCommand = bytesInCommand / SECTOR_SIZE;
+            }
+            else
+            {
+                sectorsInCommand = min(SectorCount - sectorsDone, ATA_MAX_SECTORS_PER_COMMAND);
+            }
+
+            status = _AtaIssueCommand(Device,
+                                      SectorIndex + sectorsDone,
+                                      (WORD)sectorsInCommand,
+                                      (PBYTE)Buffer + sectorsDone * SECTOR_SIZE,
+                                      Asynchronous,
+                                      WriteOperation);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_AtaIssueCommand", status);
+                __leave;
+            }
+
+            sectorsDone = sectorsDone + sectorsInCommand;
+        }
+    }
+    __finally
+    {
+        if (NULL != pMdl)
+        {
+            IoFreeMdl(pMdl);
+            pMdl = NULL;
+        }
+
+        *SectorsReadWriten = sectorsDone;
+    }
+
+    return status;
+}
+
+static
+STATUS
+_AtaIssueCommand(
+    IN          PATA_DEVICE                                 Device,
+    IN          QWORD                                       SectorIndex,
+    IN          WORD                                        SectorCount,
+    IN          PVOID                                       Buffer,
+    IN          BOOLEAN                                     Asynchronous,
+    IN          BOOLEAN                                     WriteOperation
+    )
+{
+    PATA_DEVICE_REGISTERS pDevRegisters;
+    BYTE ataCmd;
+
+    ASSERT(NULL != Device);
+    ASSERT(0 != SectorCount);
+    ASSERT(NULL != Buffer);
+
     pDevRegisters = &Device->DeviceRegisters;
 
+    // The master and the slave share the task file registers of the channel
+    // but not the device lock, the other device may have been selected since
+    // the previous command so the device is always selected again.
+
     // 1. wait for device to become idle
     _AtaWaitIdle(pDevRegisters);
 
@@ -760,7 +890,6 @@ AtaReadWriteSectors(
     _AtaWaitDeviceReady(pDevRegisters);
 
     LOG_TRACE_STORAGE("Device is ready\n");
-    LOG_TRACE_STORAGE("Asynchronous: 0x%x\n", Asynchronous );
 
     // we don't want interrupts if we're performing a synchronous transfer
     pDevRegisters->NoInterrupt = Asynchronous ? 0 : ATA_DCTRL_REG_NIEN;
@@ -783,15 +912,11 @@ AtaReadWriteSectors(
 
     if (Asynchronous)
     {
-        // 4.5 write DMA parameters
+        // 4.5 write DMA parameters, the PRD table was already filled
+        _AtaWriteDmaRegisters(pDevRegisters, Device->CurrentTransfer.PrdtPhysicalAddress, WriteOperation);
 
-        // configure bus master register for DMA transfer
-        status = _AtaPrepareDmaTransfer(pDevRegisters, &Device->CurrentTransfer, Buffer, SectorCount, WriteOperation );
-        if (!SUCCEEDED(status))
-        {
-            LOG_FUNC_ERROR("_AtaPrepareDmaTransfer", status);
-            return status;
-        }
+        // for chained commands the previous one left the state as finished
+        _InterlockedExchange(&Device->CurrentTransfer.State, AtaTransferStateInProgress);
 
         LOG_TRACE_STORAGE("DMA parameters written\n");
     }
@@ -820,11 +945,12 @@ AtaReadWriteSectors(
 
         // check if transfer actually finished
         ASSERT( AtaTransferStateFinished == _InterlockedAnd( &Device->CurrentTransfer.State, MAX_DWORD ) );
-        ASSERT( NULL != Device->CurrentTransfer.Prdt );
 
-        LOG_TRACE_STORAGE("About to free PRDT\n");
-        IoFreeContinuousMemory(Device->CurrentTransfer.Prdt );
-        Device->CurrentTransfer.Prdt = NULL;
+        if (IsBooleanFlagOn(Device->CurrentTransfer.DeviceStatus, ATA_SREG_ERR))
+        {
+            LOG_ERROR("DMA command failed, error register: 0x%x\n", Device->CurrentTransfer.DeviceError);
+            return STATUS_DEVICE_INVALID_OPERATION;
+        }
 
         LOG_TRACE_STORAGE("DMA transfer complete\n");
     }
@@ -845,11 +971,7 @@ AtaReadWriteSectors(
         }
     }
 
-    *SectorsReadWriten = SectorCount;
-
-    status = STATUS_SUCCESS;
-
-    return status;
+    return STATUS_SUCCESS;
 }
 
 BOOLEAN
@@ -884,11 +1006,9 @@ BOOLEAN
     devStatus = _AtaReadRegister(pDevRegisters, AtaRegisterStatus);
     ASSERT(!IsBooleanFlagOn(devStatus, ATA_SREG_DF));
 
-    if (IsBooleanFlagOn(devStatus, ATA_SREG_ERR))
-    {
-        LOG_ERROR("DMA command failed, error register: 0x%x\n", _AtaReadRegister(pDevRegisters, AtaRegisterError ));
-        NOT_REACHED;
-    }
+    // the waiting thread decides what to do in case of failure
+    pAtaDev->CurrentTransfer.DeviceStatus = devStatus;
+    pAtaDev->CurrentTransfer.DeviceError = IsBooleanFlagOn(devStatus, ATA_SREG_ERR) ? _AtaReadRegister(pDevRegisters, AtaRegisterError) : 0;
 
     // must set Stop bit in command register
     _AtaWriteRegister(pDevRegisters, AtaRegisterBusCommand, 0 );
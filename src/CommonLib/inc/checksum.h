@@ -0,0 +1,135 @@
+#pragma once
+
+C_HEADER_START
+//******************************************************************************
+// Checksums
+//
+// The Internet checksum (RFC 1071) is computed incrementally: a partial sum
+// is started from 0 (or from a previous partial sum, such as the one of an IP
+// pseudo-header) and each piece of data is added to it, only the final sum is
+// folded. Only the last piece added may have an odd length. The sums are done
+// on the data as it is laid out in memory, the one's complement sum does not
+// depend on the byte order so the folded result can be stored in a network
+// header as it is.
+//
+// CRC32C uses the Castagnoli polynomial (iSCSI, ext4, btrfs). Crc32c may be
+// chained: Crc32c(B, Crc32c(A, 0)) is the CRC of A followed by B.
+//
+// The fastest implementation supported by the CPU is selected by
+// CommonLibInit. The SIMD implementations of the Internet checksum are only
+// used if the OS has enabled the XMM (SSE2) or the YMM (AVX2) state through
+// XSETBV, when it has not the scalar implementation is used. The SSE4.2 CRC32
+// instruction works on general purpose registers and does not depend on it.
+//******************************************************************************
+
+typedef enum _CHECKSUM_IMPLEMENTATION
+{
+    // 64 bit words summed with add with carry
+    ChecksumImplementationScalar,
+
+    ChecksumImplementationSse2,
+    ChecksumImplementationAvx2,
+
+    ChecksumImplementationReserved = ChecksumImplementationAvx2 + 1
+} CHECKSUM_IMPLEMENTATION;
+
+typedef enum _CRC32C_IMPLEMENTATION
+{
+    // slicing-by-8 lookup tables
+    Crc32cImplementationTable,
+
+    // CRC32 instruction, 3 streams interleaved to hide its latency
+    Crc32cImplementationSse42,
+
+    Crc32cImplementationReserved = Crc32cImplementationSse42 + 1
+} CRC32C_IMPLEMENTATION;
+
+//******************************************************************************
+// Function:     ChecksumSystemInit
+// Description:  Detects the supported implementations, selects the fastest
+//               ones and builds the CRC32C tables. Called by CommonLibInit.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+void
+ChecksumSystemInit(
+    void
+    );
+
+//******************************************************************************
+// Function:     ChecksumInternetAdd
+// Description:  Adds Length bytes to an Internet checksum partial sum.
+// Returns:      DWORD - The new partial sum, to be passed to further calls or
+//               to ChecksumInternetFold.
+// Parameter:    IN_READS_BYTES(Length) PVOID Buffer
+// Parameter:    IN DWORD Length
+// Parameter:    IN DWORD PartialSum - 0 for the first piece of data
+//******************************************************************************
+DWORD
+ChecksumInternetAdd(
+    IN_READS_BYTES(Length)  PVOID                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   PartialSum
+    );
+
+//******************************************************************************
+// Function:     ChecksumInternetFold
+// Description:  Folds a partial sum to 16 bits and complements it.
+// Returns:      WORD - The checksum to be stored in a header. When verifying
+//               data which already includes its checksum the result is 0 if
+//               the data is valid.
+// Parameter:    IN DWORD PartialSum
+//******************************************************************************
+WORD
+ChecksumInternetFold(
+    IN                      DWORD                   PartialSum
+    );
+
+//******************************************************************************
+// Function:     Crc32c
+// Description:  Computes the CRC32C of Length bytes starting from a previous
+//               CRC. The pre and post inversions are done internally.
+// Returns:      DWORD - The CRC of the data.
+// Parameter:    IN_READS_BYTES(Length) PVOID Buffer
+// Parameter:    IN DWORD Length
+// Parameter:    IN DWORD Crc - 0 for the first piece of data
+//******************************************************************************
+DWORD
+Crc32c(
+    IN_READS_BYTES(Length)  PVOID                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   Crc
+    );
+
+// The functions below are meant for tests and benchmarks, the implementation
+// must not be changed while checksums are computed on other CPUs.
+BOOLEAN
+ChecksumIsImplementationSupported(
+    IN                      CHECKSUM_IMPLEMENTATION Implementation
+    );
+
+STATUS
+ChecksumSelectImplementation(
+    IN                      CHECKSUM_IMPLEMENTATION Implementation
+    );
+
+CHECKSUM_IMPLEMENTATION
+ChecksumGetImplementation(
+    void
+    );
+
+BOOLEAN
+Crc32cIsImplementationSupported(
+    IN                      CRC32C_IMPLEMENTATION   Implementation
+    );
+
+STATUS
+Crc32cSelectImplementation(
+    IN                      CRC32C_IMPLEMENTATION   Implementation
+    );
+
+CRC32C_IMPLEMENTATION
+Crc32cGetImplementation(
+    void
+    );
+C_HEADER_END
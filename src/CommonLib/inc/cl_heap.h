@@ -18,6 +18,10 @@ typedef struct _HEAP_HEADER
     QWORD               FreeAddress;        // address from which to start search
     QWORD               HeapNumberOfAllocations;
 
+    // incremented on each allocation, the allocations remember the value they
+    // received, see ClHeapRetrieveAllocations
+    QWORD               AllocationSequence;
+
     PLIST_ENTRY         EntryToRestartSearch;
 
     // list of heap allocations
@@ -25,6 +29,14 @@ typedef struct _HEAP_HEADER
     LIST_ENTRY          HeapAllocations;
 } HEAP_HEADER, *PHEAP_HEADER;
 
+typedef struct _HEAP_ALLOCATION_INFO
+{
+    PVOID               Address;
+    DWORD               Size;
+    DWORD               Tag;
+    QWORD               Sequence;
+} HEAP_ALLOCATION_INFO, *PHEAP_ALLOCATION_INFO;
+
 //******************************************************************************
 // Function:    HeapInit
 // Description: Initializes the heap system. Needs to be called before any
@@ -76,4 +88,43 @@ ClHeapFreePoolWithTag(
             PVOID                   MemoryAddress,
     IN      DWORD                   Tag
     );
+
+//******************************************************************************
+// Function:    ClHeapGetAllocationSize
+// Description: Returns the number of bytes requested when the memory region
+//              was allocated.
+// Returns:     DWORD
+// Parameter:   IN PVOID MemoryAddress - returned by ClHeapAllocatePoolWithTag
+//              and not yet freed.
+//******************************************************************************
+DWORD
+ClHeapGetAllocationSize(
+    _Notnull_
+            PVOID                   MemoryAddress
+    );
+
+//******************************************************************************
+// Function:    ClHeapRetrieveAllocations
+// Description: Describes the allocations still present in the heap which
+//              received a sequence number greater than SinceSequence and not
+//              greater than UntilSequence, ordered by address.
+// Returns:     QWORD - the number of such allocations, which may be greater
+//              than MaxAllocations.
+// Parameter:   IN PHEAP_HEADER HeapHeader
+// Parameter:   IN QWORD SinceSequence - 0 for all the allocations, the value
+//              of HeapHeader->AllocationSequence for the ones made afterwards.
+// Parameter:   IN QWORD UntilSequence - MAX_QWORD for all the allocations made
+//              after SinceSequence.
+// Parameter:   IN DWORD MaxAllocations
+// Parameter:   OUT_WRITES_OPT(MaxAllocations) PHEAP_ALLOCATION_INFO Allocations
+//******************************************************************************
+QWORD
+ClHeapRetrieveAllocations(
+    IN      PHEAP_HEADER            HeapHeader,
+    IN      QWORD                   SinceSequence,
+    IN      QWORD                   UntilSequence,
+    IN      DWORD                   MaxAllocations,
+    OUT_WRITES_OPT(MaxAllocations)
+            PHEAP_ALLOCATION_INFO   Allocations
+    );
 C_HEADER_END
@@ -0,0 +1,80 @@
+#pragma once
+
+C_HEADER_START
+//******************************************************************************
+// Histograms
+//
+// Log-linear histogram of QWORD values: each power of two range is split in
+// HISTOGRAM_SUB_BUCKETS equal buckets, values below HISTOGRAM_SUB_BUCKETS
+// have a bucket of their own. A percentile is reported as the largest value
+// of the bucket it falls in, at most 1/HISTOGRAM_SUB_BUCKETS above the exact
+// value, regardless of the magnitude of the values. The count, sum, minimum
+// and maximum are kept exactly.
+//
+// The functions do not synchronize, a histogram is meant to be filled by a
+// single CPU and merged into another one afterwards.
+//******************************************************************************
+
+#define HISTOGRAM_SUB_BUCKET_BITS       4
+#define HISTOGRAM_SUB_BUCKETS           (1 << HISTOGRAM_SUB_BUCKET_BITS)
+
+// one group of buckets for the values below HISTOGRAM_SUB_BUCKETS and one for
+// each power of two from there up to 2^63
+#define HISTOGRAM_NO_OF_BUCKETS         ((sizeof(QWORD) * BITS_PER_BYTE - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct _HISTOGRAM
+{
+    QWORD                       Count;
+    QWORD                       Sum;
+    QWORD                       Min;
+    QWORD                       Max;
+
+    QWORD                       Buckets[HISTOGRAM_NO_OF_BUCKETS];
+} HISTOGRAM, *PHISTOGRAM;
+
+void
+HistogramInit(
+    OUT     PHISTOGRAM          Histogram
+    );
+
+void
+HistogramRecord(
+    INOUT   PHISTOGRAM          Histogram,
+    IN      QWORD               Value
+    );
+
+//******************************************************************************
+// Function:     HistogramMerge
+// Description:  Adds all the values recorded in Source to Destination.
+// Returns:      void
+// Parameter:    INOUT PHISTOGRAM Destination
+// Parameter:    IN PHISTOGRAM Source
+//******************************************************************************
+void
+HistogramMerge(
+    INOUT   PHISTOGRAM          Destination,
+    IN      PHISTOGRAM          Source
+    );
+
+//******************************************************************************
+// Function:     HistogramGetPercentile
+// Description:  Returns the value below or at which PerMille thousandths of
+//               the recorded values are, e.g. 500 for the median or 999 for
+//               p99.9. The value is rounded up to the end of its bucket but
+//               never exceeds the maximum recorded value.
+// Returns:      QWORD - 0 if no value was recorded.
+// Parameter:    IN PHISTOGRAM Histogram
+// Parameter:    IN DWORD PerMille - at most 1000.
+//******************************************************************************
+QWORD
+HistogramGetPercentile(
+    IN      PHISTOGRAM          Histogram,
+    IN_RANGE_UPPER(1000)
+            DWORD               PerMille
+    );
+
+QWORD
+HistogramGetMean(
+    IN      PHISTOGRAM          Histogram
+    );
+C_HEADER_END
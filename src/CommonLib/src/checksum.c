@@ -0,0 +1,725 @@
+#include "common_lib.h"
+#include "checksum.h"
+#include <immintrin.h>
+
+#define CPUID_IDX_MAX_BASIC_LEAF            0x0
+#define CPUID_IDX_FEATURE_INFORMATION       0x1
+#define CPUID_IDX_STRUCTURED_EXTENDED       0x7
+
+#define CPUID_FEATURE_ECX_SSE42             ((DWORD)1<<20)
+#define CPUID_FEATURE_ECX_OSXSAVE           ((DWORD)1<<27)
+#define CPUID_FEATURE_ECX_AVX               ((DWORD)1<<28)
+#define CPUID_FEATURE_EDX_SSE2              ((DWORD)1<<26)
+#define CPUID_STRUCTURED_EBX_AVX2           ((DWORD)1<<5)
+
+#define XCR0_INDEX_XFEATURE_ENABLED_MASK    0
+#define XCR0_STATE_SSE                      ((QWORD)1<<1)
+#define XCR0_STATE_AVX                      ((QWORD)1<<2)
+
+// reflected Castagnoli polynomial
+#define CRC32C_POLYNOMIAL                   0x82F6'3B78UL
+
+#define CRC32C_TABLE_SLICES                 8
+#define CRC32C_TABLE_SIZE                   (MAX_BYTE + 1)
+
+// sizes of the 3 interleaved streams, both must be powers of 2 so the
+// operator which shifts a CRC over them can be computed by squaring
+#define CRC32C_LONG_STREAM                  ((DWORD)(8 * KB_SIZE))
+#define CRC32C_SHORT_STREAM                 256
+
+typedef
+DWORD
+(__cdecl FUNC_ChecksumInternetAdd)(
+    IN_READS_BYTES(Length)  BYTE*                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   PartialSum
+    );
+
+typedef FUNC_ChecksumInternetAdd *PFUNC_ChecksumInternetAdd;
+
+typedef
+DWORD
+(__cdecl FUNC_Crc32c)(
+    IN_READS_BYTES(Length)  BYTE*                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   Crc
+    );
+
+typedef FUNC_Crc32c *PFUNC_Crc32c;
+
+typedef struct _CHECKSUM_DATA
+{
+    CHECKSUM_IMPLEMENTATION     InternetImplementation;
+    PFUNC_ChecksumInternetAdd   InternetAdd;
+    BOOLEAN                     InternetSupported[ChecksumImplementationReserved];
+
+    CRC32C_IMPLEMENTATION       Crc32cImplementation;
+    PFUNC_Crc32c                Crc32c;
+    BOOLEAN                     Crc32cSupported[Crc32cImplementationReserved];
+
+    // Crc32cTable[0] is the classic byte at a time table, Crc32cTable[k] gives
+    // the CRC of a byte followed by k 0 bytes
+    DWORD                       Crc32cTable[CRC32C_TABLE_SLICES][CRC32C_TABLE_SIZE];
+
+    // shift a CRC over CRC32C_LONG_STREAM and CRC32C_SHORT_STREAM 0 bytes,
+    // one table for each byte of the CRC
+    DWORD                       Crc32cLongShift[sizeof(DWORD)][CRC32C_TABLE_SIZE];
+    DWORD                       Crc32cShortShift[sizeof(DWORD)][CRC32C_TABLE_SIZE];
+} CHECKSUM_DATA, *PCHECKSUM_DATA;
+
+static CHECKSUM_DATA m_checksumData;
+
+static FUNC_ChecksumInternetAdd     _ChecksumInternetAddScalar;
+static FUNC_ChecksumInternetAdd     _ChecksumInternetAddSse2;
+static FUNC_ChecksumInternetAdd     _ChecksumInternetAddAvx2;
+
+static FUNC_Crc32c                  _Crc32cTable;
+static FUNC_Crc32c                  _Crc32cSse42;
+
+static const PFUNC_ChecksumInternetAdd INTERNET_ADD_FUNCTIONS[ChecksumImplementationReserved] =
+{
+    _ChecksumInternetAddScalar, _ChecksumInternetAddSse2, _ChecksumInternetAddAvx2
+};
+
+static const PFUNC_Crc32c CRC32C_FUNCTIONS[Crc32cImplementationReserved] =
+{
+    _Crc32cTable, _Crc32cSse42
+};
+
+__forceinline
+static
+DWORD
+_ChecksumFoldToDword(
+    IN      QWORD           Sum
+    )
+{
+    Sum = (Sum & MAX_DWORD) + (Sum >> 32);
+    Sum = (Sum & MAX_DWORD) + (Sum >> 32);
+
+    return (DWORD) Sum;
+}
+
+static
+void
+_ChecksumDetectFeatures(
+    void
+    )
+{
+    int cpuInfo[4];
+    DWORD maxLeaf;
+    DWORD featuresEcx;
+    DWORD featuresEdx;
+    DWORD structuredEbx;
+    QWORD enabledStates;
+
+    __cpuid(cpuInfo, CPUID_IDX_MAX_BASIC_LEAF);
+    maxLeaf = cpuInfo[0];
+
+    __cpuid(cpuInfo, CPUID_IDX_FEATURE_INFORMATION);
+    featuresEcx = cpuInfo[2];
+    featuresEdx = cpuInfo[3];
+
+    structuredEbx = 0;
+    if (maxLeaf >= CPUID_IDX_STRUCTURED_EXTENDED)
+    {
+        __cpuidex(cpuInfo, CPUID_IDX_STRUCTURED_EXTENDED, 0);
+        structuredEbx = cpuInfo[1];
+    }
+
+    // XGETBV is only valid once the OS has set CR4.OSXSAVE, if it has not the
+    // XMM/YMM registers may not be preserved and cannot be used
+    enabledStates = 0;
+    if (IsBooleanFlagOn(featuresEcx, CPUID_FEATURE_ECX_OSXSAVE))
+    {
+        enabledStates = _xgetbv(XCR0_INDEX_XFEATURE_ENABLED_MASK);
+    }
+
+    m_checksumData.InternetSupported[ChecksumImplementationScalar] = TRUE;
+
+    m_checksumData.InternetSupported[ChecksumImplementationSse2] =
+        IsBooleanFlagOn(featuresEdx, CPUID_FEATURE_EDX_SSE2) &&
+        IsBooleanFlagOn(enabledStates, XCR0_STATE_SSE);
+
+    m_checksumData.InternetSupported[ChecksumImplementationAvx2] =
+        IsBooleanFlagOn(featuresEcx, CPUID_FEATURE_ECX_AVX) &&
+        IsBooleanFlagOn(structuredEbx, CPUID_STRUCTURED_EBX_AVX2) &&
+        IsBooleanFlagOn(enabledStates, XCR0_STATE_SSE | XCR0_STATE_AVX);
+
+    m_checksumData.Crc32cSupported[Crc32cImplementationTable] = TRUE;
+
+    m_checksumData.Crc32cSupported[Crc32cImplementationSse42] =
+        IsBooleanFlagOn(featuresEcx, CPUID_FEATURE_ECX_SSE42);
+}
+
+static
+void
+_Crc32cBuildTables(
+    void
+    )
+{
+    DWORD crc;
+
+    for (DWORD i = 0; i < CRC32C_TABLE_SIZE; ++i)
+    {
+        crc = i;
+
+        for (DWORD bit = 0; bit < BITS_PER_BYTE; ++bit)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLYNOMIAL : (crc >> 1);
+        }
+
+        m_checksumData.Crc32cTable[0][i] = crc;
+    }
+
+    for (DWORD i = 0; i < CRC32C_TABLE_SIZE; ++i)
+    {
+        crc = m_checksumData.Crc32cTable[0][i];
+
+        for (DWORD slice = 1; slice < CRC32C_TABLE_SLICES; ++slice)
+        {
+            crc = m_checksumData.Crc32cTable[0][crc & MAX_BYTE] ^ (crc >> 8);
+            m_checksumData.Crc32cTable[slice][i] = crc;
+        }
+    }
+}
+
+// The CRC of a message followed by N 0 bytes is a linear function of the CRC
+// of the message, i.e. a 32x32 matrix over GF(2). These are used to combine
+// the CRCs of streams computed independently, see zlib's crc32_combine.
+static
+DWORD
+_Crc32cMatrixTimes(
+    IN_READS(BITS_FOR_STRUCTURE(DWORD))
+            DWORD*          Matrix,
+    IN      DWORD           Vector
+    )
+{
+    DWORD sum;
+
+    sum = 0;
+
+    while (0 != Vector)
+    {
+        if (Vector & 1)
+        {
+            sum ^= *Matrix;
+        }
+
+        Vector >>= 1;
+        Matrix++;
+    }
+
+    return sum;
+}
+
+static
+void
+_Crc32cMatrixSquare(
+    OUT_WRITES(BITS_FOR_STRUCTURE(DWORD))
+            DWORD*          Square,
+    IN_READS(BITS_FOR_STRUCTURE(DWORD))
+            DWORD*          Matrix
+    )
+{
+    for (DWORD i = 0; i < BITS_FOR_STRUCTURE(DWORD); ++i)
+    {
+        Square[i] = _Crc32cMatrixTimes(Matrix, Matrix[i]);
+    }
+}
+
+static
+void
+_Crc32cBuildShiftTable(
+    OUT     DWORD           ShiftTable[sizeof(DWORD)][CRC32C_TABLE_SIZE],
+    IN      DWORD           Length
+    )
+{
+    DWORD even[BITS_FOR_STRUCTURE(DWORD)];
+    DWORD odd[BITS_FOR_STRUCTURE(DWORD)];
+    DWORD* pOperator;
+    DWORD row;
+
+    ASSERT(0 != Length && IsAddressAligned(Length, Length));
+
+    // operator for a single 0 bit
+    odd[0] = CRC32C_POLYNOMIAL;
+    row = 1;
+    for (DWORD i = 1; i < BITS_FOR_STRUCTURE(DWORD); ++i)
+    {
+        odd[i] = row;
+        row <<= 1;
+    }
+
+    // 2 and then 4 0 bits
+    _Crc32cMatrixSquare(even, odd);
+    _Crc32cMatrixSquare(odd, even);
+
+    // each square doubles the number of 0 bits, the first one gives a byte
+    pOperator = odd;
+    do
+    {
+        _Crc32cMatrixSquare(even, odd);
+        pOperator = even;
+        Length >>= 1;
+        if (0 == Length)
+        {
+            break;
+        }
+
+        _Crc32cMatrixSquare(odd, even);
+        pOperator = odd;
+        Length >>= 1;
+    } while (0 != Length);
+
+    for (DWORD i = 0; i < CRC32C_TABLE_SIZE; ++i)
+    {
+        for (DWORD j = 0; j < sizeof(DWORD); ++j)
+        {
+            ShiftTable[j][i] = _Crc32cMatrixTimes(pOperator, i << (j * BITS_PER_BYTE));
+        }
+    }
+}
+
+__forceinline
+static
+DWORD
+_Crc32cShift(
+    IN      DWORD           ShiftTable[sizeof(DWORD)][CRC32C_TABLE_SIZE],
+    IN      DWORD           Crc
+    )
+{
+    return ShiftTable[0][Crc & MAX_BYTE] ^
+           ShiftTable[1][(Crc >> 8) & MAX_BYTE] ^
+           ShiftTable[2][(Crc >> 16) & MAX_BYTE] ^
+           ShiftTable[3][Crc >> 24];
+}
+
+void
+ChecksumSystemInit(
+    void
+    )
+{
+    memzero(&m_checksumData, sizeof(CHECKSUM_DATA));
+
+    _ChecksumDetectFeatures();
+
+    _Crc32cBuildTables();
+
+    if (m_checksumData.Crc32cSupported[Crc32cImplementationSse42])
+    {
+        _Crc32cBuildShiftTable(m_checksumData.Crc32cLongShift, CRC32C_LONG_STREAM);
+        _Crc32cBuildShiftTable(m_checksumData.Crc32cShortShift, CRC32C_SHORT_STREAM);
+    }
+
+    for (DWORD i = ChecksumImplementationReserved; i > 0; --i)
+    {
+        if (SUCCEEDED(ChecksumSelectImplementation((CHECKSUM_IMPLEMENTATION)(i - 1))))
+        {
+            break;
+        }
+    }
+
+    for (DWORD i = Crc32cImplementationReserved; i > 0; --i)
+    {
+        if (SUCCEEDED(Crc32cSelectImplementation((CRC32C_IMPLEMENTATION)(i - 1))))
+        {
+            break;
+        }
+    }
+}
+
+DWORD
+ChecksumInternetAdd(
+    IN_READS_BYTES(Length)  PVOID                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   PartialSum
+    )
+{
+    ASSERT(NULL != Buffer || 0 == Length);
+    ASSERT(NULL != m_checksumData.InternetAdd);
+
+    return m_checksumData.InternetAdd(Buffer, Length, PartialSum);
+}
+
+WORD
+ChecksumInternetFold(
+    IN                      DWORD                   PartialSum
+    )
+{
+    PartialSum = (PartialSum & MAX_WORD) + (PartialSum >> 16);
+    PartialSum = (PartialSum & MAX_WORD) + (PartialSum >> 16);
+
+    return (WORD) ~PartialSum;
+}
+
+DWORD
+Crc32c(
+    IN_READS_BYTES(Length)  PVOID                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   Crc
+    )
+{
+    ASSERT(NULL != Buffer || 0 == Length);
+    ASSERT(NULL != m_checksumData.Crc32c);
+
+    return m_checksumData.Crc32c(Buffer, Length, Crc);
+}
+
+BOOLEAN
+ChecksumIsImplementationSupported(
+    IN                      CHECKSUM_IMPLEMENTATION Implementation
+    )
+{
+    return (Implementation < ChecksumImplementationReserved) &&
+           m_checksumData.InternetSupported[Implementation];
+}
+
+STATUS
+ChecksumSelectImplementation(
+    IN                      CHECKSUM_IMPLEMENTATION Implementation
+    )
+{
+    if (Implementation >= ChecksumImplementationReserved)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (!m_checksumData.InternetSupported[Implementation])
+    {
+        return STATUS_CPU_UNSUPPORTED_FEATURE;
+    }
+
+    m_checksumData.InternetImplementation = Implementation;
+    m_checksumData.InternetAdd = INTERNET_ADD_FUNCTIONS[Implementation];
+
+    return STATUS_SUCCESS;
+}
+
+CHECKSUM_IMPLEMENTATION
+ChecksumGetImplementation(
+    void
+    )
+{
+    return m_checksumData.InternetImplementation;
+}
+
+BOOLEAN
+Crc32cIsImplementationSupported(
+    IN                      CRC32C_IMPLEMENTATION   Implementation
+    )
+{
+    return (Implementation < Crc32cImplementationReserved) &&
+           m_checksumData.Crc32cSupported[Implementation];
+}
+
+STATUS
+Crc32cSelectImplementation(
+    IN                      CRC32C_IMPLEMENTATION   Implementation
+    )
+{
+    if (Implementation >= Crc32cImplementationReserved)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (!m_checksumData.Crc32cSupported[Implementation])
+    {
+        return STATUS_CPU_UNSUPPORTED_FEATURE;
+    }
+
+    m_checksumData.Crc32cImplementation = Implementation;
+    m_checksumData.Crc32c = CRC32C_FUNCTIONS[Implementation];
+
+    return STATUS_SUCCESS;
+}
+
+CRC32C_IMPLEMENTATION
+Crc32cGetImplementation(
+    void
+    )
+{
+    return m_checksumData.Crc32cImplementation;
+}
+
+static
+DWORD
+(__cdecl _ChecksumInternetAddScalar)(
+    IN_READS_BYTES(Length)  BYTE*                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   PartialSum
+    )
+{
+    QWORD sum;
+    QWORD lastWord;
+    BYTE carry;
+
+    sum = PartialSum;
+    carry = 0;
+
+    // the one's complement sum of 64 bit words folds to the same 16 bit sum,
+    // the carry out of each addition is fed into the next one
+    while (Length >= 4 * sizeof(QWORD))
+    {
+        carry = _addcarry_u64(carry, sum, ((const QWORD*)Buffer)[0], &sum);
+        carry = _addcarry_u64(carry, sum, ((const QWORD*)Buffer)[1], &sum);
+        carry = _addcarry_u64(carry, sum, ((const QWORD*)Buffer)[2], &sum);
+        carry = _addcarry_u64(carry, sum, ((const QWORD*)Buffer)[3], &sum);
+
+        Buffer += 4 * sizeof(QWORD);
+        Length -= 4 * sizeof(QWORD);
+    }
+
+    while (Length >= sizeof(QWORD))
+    {
+        carry = _addcarry_u64(carry, sum, *((const QWORD*)Buffer), &sum);
+
+        Buffer += sizeof(QWORD);
+        Length -= sizeof(QWORD);
+    }
+
+    // the remaining bytes are padded with 0 bytes after them
+    lastWord = 0;
+    for (DWORD i = 0; i < Length; ++i)
+    {
+        lastWord |= (QWORD)Buffer[i] << (i * BITS_PER_BYTE);
+    }
+
+    carry = _addcarry_u64(carry, sum, lastWord, &sum);
+
+    // end around carry, if it overflows again sum is 0
+    sum += carry;
+
+    return _ChecksumFoldToDword(sum);
+}
+
+static
+DWORD
+(__cdecl _ChecksumInternetAddSse2)(
+    IN_READS_BYTES(Length)  BYTE*                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   PartialSum
+    )
+{
+    __m128i zero;
+    __m128i sumLow;
+    __m128i sumHigh;
+    __m128i data;
+    QWORD sum;
+
+    zero = _mm_setzero_si128();
+    sumLow = zero;
+    sumHigh = zero;
+
+    // each 32 bit word is zero extended and added to a 64 bit lane, a lane
+    // receives at most 2^30 words so it cannot overflow
+    while (Length >= 2 * sizeof(__m128i))
+    {
+        data = _mm_loadu_si128((const __m128i*)Buffer);
+        sumLow = _mm_add_epi64(sumLow, _mm_unpacklo_epi32(data, zero));
+        sumHigh = _mm_add_epi64(sumHigh, _mm_unpackhi_epi32(data, zero));
+
+        data = _mm_loadu_si128((const __m128i*)Buffer + 1);
+        sumLow = _mm_add_epi64(sumLow, _mm_unpacklo_epi32(data, zero));
+        sumHigh = _mm_add_epi64(sumHigh, _mm_unpackhi_epi32(data, zero));
+
+        Buffer += 2 * sizeof(__m128i);
+        Length -= 2 * sizeof(__m128i);
+    }
+
+    sumLow = _mm_add_epi64(sumLow, sumHigh);
+    sumLow = _mm_add_epi64(sumLow, _mm_unpackhi_epi64(sumLow, sumLow));
+
+    sum = (QWORD)_mm_cvtsi128_si64(sumLow) + PartialSum;
+
+    return _ChecksumInternetAddScalar(Buffer, Length, _ChecksumFoldToDword(sum));
+}
+
+static
+DWORD
+(__cdecl _ChecksumInternetAddAvx2)(
+    IN_READS_BYTES(Length)  BYTE*                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   PartialSum
+    )
+{
+    __m256i zero;
+    __m256i sumLow;
+    __m256i sumHigh;
+    __m256i data;
+    __m128i sum128;
+    QWORD sum;
+
+    zero = _mm256_setzero_si256();
+    sumLow = zero;
+    sumHigh = zero;
+
+    // same scheme as the SSE2 version, the unpacks work within each 128 bit
+    // half but the order in which the words are added does not matter
+    while (Length >= 2 * sizeof(__m256i))
+    {
+        data = _mm256_loadu_si256((const __m256i*)Buffer);
+        sumLow = _mm256_add_epi64(sumLow, _mm256_unpacklo_epi32(data, zero));
+        sumHigh = _mm256_add_epi64(sumHigh, _mm256_unpackhi_epi32(data, zero));
+
+        data = _mm256_loadu_si256((const __m256i*)Buffer + 1);
+        sumLow = _mm256_add_epi64(sumLow, _mm256_unpacklo_epi32(data, zero));
+        sumHigh = _mm256_add_epi64(sumHigh, _mm256_unpackhi_epi32(data, zero));
+
+        Buffer += 2 * sizeof(__m256i);
+        Length -= 2 * sizeof(__m256i);
+    }
+
+    sumLow = _mm256_add_epi64(sumLow, sumHigh);
+    sum128 = _mm_add_epi64(_mm256_castsi256_si128(sumLow), _mm256_extracti128_si256(sumLow, 1));
+    sum128 = _mm_add_epi64(sum128, _mm_unpackhi_epi64(sum128, sum128));
+
+    // avoid the penalty of mixing AVX and legacy SSE code
+    _mm256_zeroupper();
+
+    sum = (QWORD)_mm_cvtsi128_si64(sum128) + PartialSum;
+
+    return _ChecksumInternetAddScalar(Buffer, Length, _ChecksumFoldToDword(sum));
+}
+
+static
+DWORD
+(__cdecl _Crc32cTable)(
+    IN_READS_BYTES(Length)  BYTE*                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   Crc
+    )
+{
+    DWORD (*table)[CRC32C_TABLE_SIZE];
+    QWORD word;
+
+    table = m_checksumData.Crc32cTable;
+    Crc = ~Crc;
+
+    while (0 != Length && !IsAddressAligned(Buffer, sizeof(QWORD)))
+    {
+        Crc = table[0][(Crc ^ *Buffer) & MAX_BYTE] ^ (Crc >> 8);
+
+        Buffer++;
+        Length--;
+    }
+
+    while (Length >= sizeof(QWORD))
+    {
+        word = Crc ^ *((const QWORD*)Buffer);
+
+        Crc = table[7][word & MAX_BYTE] ^
+              table[6][(word >> 8) & MAX_BYTE] ^
+              table[5][(word >> 16) & MAX_BYTE] ^
+              table[4][(word >> 24) & MAX_BYTE] ^
+              table[3][(word >> 32) & MAX_BYTE] ^
+              table[2][(word >> 40) & MAX_BYTE] ^
+              table[1][(word >> 48) & MAX_BYTE] ^
+              table[0][word >> 56];
+
+        Buffer += sizeof(QWORD);
+        Length -= sizeof(QWORD);
+    }
+
+    while (0 != Length)
+    {
+        Crc = table[0][(Crc ^ *Buffer) & MAX_BYTE] ^ (Crc >> 8);
+
+        Buffer++;
+        Length--;
+    }
+
+    return ~Crc;
+}
+
+__forceinline
+static
+DWORD
+_Crc32cSse42Streams(
+    INOUT   const BYTE**            Buffer,
+    INOUT   DWORD*                  Length,
+    IN      DWORD                   Crc,
+    IN      DWORD                   StreamLength,
+    IN      DWORD                   ShiftTable[sizeof(DWORD)][CRC32C_TABLE_SIZE]
+    )
+{
+    const BYTE* pData;
+    const BYTE* pEnd;
+    QWORD crc0;
+    QWORD crc1;
+    QWORD crc2;
+
+    pData = *Buffer;
+    crc0 = Crc;
+
+    // the CRC32 instruction has a latency of 3 cycles but a throughput of 1,
+    // 3 consecutive streams are computed at the same time and then combined
+    while (*Length >= 3 * StreamLength)
+    {
+        crc1 = 0;
+        crc2 = 0;
+        pEnd = pData + StreamLength;
+
+        do
+        {
+            crc0 = _mm_crc32_u64(crc0, *((const QWORD*)pData));
+            crc1 = _mm_crc32_u64(crc1, *((const QWORD*)(pData + StreamLength)));
+            crc2 = _mm_crc32_u64(crc2, *((const QWORD*)(pData + 2 * StreamLength)));
+
+            pData += sizeof(QWORD);
+        } while (pData < pEnd);
+
+        crc0 = _Crc32cShift(ShiftTable, (DWORD)crc0) ^ crc1;
+        crc0 = _Crc32cShift(ShiftTable, (DWORD)crc0) ^ crc2;
+
+        pData += 2 * StreamLength;
+        *Length -= 3 * StreamLength;
+    }
+
+    *Buffer = pData;
+
+    return (DWORD)crc0;
+}
+
+static
+DWORD
+(__cdecl _Crc32cSse42)(
+    IN_READS_BYTES(Length)  BYTE*                   Buffer,
+    IN                      DWORD                   Length,
+    IN                      DWORD                   Crc
+    )
+{
+    QWORD crc;
+
+    Crc = ~Crc;
+
+    while (0 != Length && !IsAddressAligned(Buffer, sizeof(QWORD)))
+    {
+        Crc = _mm_crc32_u8(Crc, *Buffer);
+
+        Buffer++;
+        Length--;
+    }
+
+    Crc = _Crc32cSse42Streams(&Buffer, &Length, Crc, CRC32C_LONG_STREAM, m_checksumData.Crc32cLongShift);
+    Crc = _Crc32cSse42Streams(&Buffer, &Length, Crc, CRC32C_SHORT_STREAM, m_checksumData.Crc32cShortShift);
+
+    crc = Crc;
+    while (Length >= sizeof(QWORD))
+    {
+        crc = _mm_crc32_u64(crc, *((const QWORD*)Buffer));
+
+        Buffer += sizeof(QWORD);
+        Length -= sizeof(QWORD);
+    }
+    Crc = (DWORD)crc;
+
+    while (0 != Length)
+    {
+        Crc = _mm_crc32_u8(Crc, *Buffer);
+
+        Buffer++;
+        Length--;
+    }
+
+    return ~Crc;
+}
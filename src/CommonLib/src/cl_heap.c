@@ -22,6 +22,7 @@ STATIC_ASSERT(sizeof(HEAP_TAIL) == HEAP_TAIL_SIZE);
 -           Tag
 -           Size
 -           Offset
+-           Sequence
 -           ListEntry
 -           Data
 
@@ -41,8 +42,9 @@ struct _HEAP_ENTRY
     DWORD               Tag;            // 0x4
     DWORD               Size;           // 0x8  (sizeof actual data allocated(without header) and without MAGIC at the end of the data allocated)
     DWORD               Offset;         // 0xC  (offset to the data(may depend on the alignment)
-    LIST_ENTRY          ListEntry;      // 0x10
-} HEAP_ENTRY, *PHEAP_ENTRY;             // sizeof(HEAP_ENTRY) = 0x20
+    QWORD               Sequence;       // 0x10 (value of HEAP_HEADER.AllocationSequence after this allocation)
+    LIST_ENTRY          ListEntry;      // 0x18
+} HEAP_ENTRY, *PHEAP_ENTRY;             // sizeof(HEAP_ENTRY) = 0x28
 
 //******************************************************************************
 // Function:    InitHeapEntry
@@ -107,6 +109,7 @@ ClHeapInit(
     pHeapHeader->HeapSizeMaximum = MemoryAvailable;
     pHeapHeader->HeapSizeRemaining = pHeapHeader->HeapSizeMaximum - sizeof( HEAP_HEADER );
     pHeapHeader->HeapNumberOfAllocations = 0;
+    pHeapHeader->AllocationSequence = 0;
     pHeapHeader->EntryToRestartSearch = &pHeapHeader->HeapAllocations;
 
     pHeapHeader->FreeAddress = pHeapHeader->BaseAddress + sizeof( HEAP_HEADER );
@@ -386,6 +389,66 @@ ClHeapFreePoolWithTag(
     }
 }
 
+DWORD
+ClHeapGetAllocationSize(
+    _Notnull_
+            PVOID                   MemoryAddress
+    )
+{
+    HEAP_ENTRY* pHeapEntry;
+
+    ASSERT(NULL != MemoryAddress);
+
+    pHeapEntry = (HEAP_ENTRY*)((BYTE*)MemoryAddress - sizeof(HEAP_ENTRY));
+    ASSERT(_ValidateHeapEntry(pHeapEntry, pHeapEntry->Tag));
+
+    return pHeapEntry->Size;
+}
+
+QWORD
+ClHeapRetrieveAllocations(
+    IN      PHEAP_HEADER            HeapHeader,
+    IN      QWORD                   SinceSequence,
+    IN      QWORD                   UntilSequence,
+    IN      DWORD                   MaxAllocations,
+    OUT_WRITES_OPT(MaxAllocations)
+            PHEAP_ALLOCATION_INFO   Allocations
+    )
+{
+    LIST_ENTRY* pCurEntry;
+    QWORD noOfAllocations;
+
+    ASSERT(NULL != HeapHeader);
+    ASSERT(0 == MaxAllocations || NULL != Allocations);
+
+    noOfAllocations = 0;
+
+    for (pCurEntry = HeapHeader->HeapAllocations.Flink;
+         pCurEntry != &HeapHeader->HeapAllocations;
+         pCurEntry = pCurEntry->Flink)
+    {
+        HEAP_ENTRY* pHeapEntry = CONTAINING_RECORD(pCurEntry, HEAP_ENTRY, ListEntry);
+
+        if (pHeapEntry->Sequence <= SinceSequence
+            || pHeapEntry->Sequence > UntilSequence)
+        {
+            continue;
+        }
+
+        if (noOfAllocations < MaxAllocations)
+        {
+            Allocations[noOfAllocations].Address = (BYTE*)pHeapEntry + sizeof(HEAP_ENTRY);
+            Allocations[noOfAllocations].Size = pHeapEntry->Size;
+            Allocations[noOfAllocations].Tag = pHeapEntry->Tag;
+            Allocations[noOfAllocations].Sequence = pHeapEntry->Sequence;
+        }
+
+        noOfAllocations++;
+    }
+
+    return noOfAllocations;
+}
+
 static
 QWORD
 _InitHeapEntry(
@@ -427,6 +490,7 @@ _InitHeapEntry(
     pHeapEntry->Magic = HEAP_MAGIC;
     pHeapEntry->Size = Size;
     pHeapEntry->Tag = Tag;
+    pHeapEntry->Sequence = ++HeapHeader->AllocationSequence;
 
     // we insert the new element to the list
     if( AddToLinkedList )
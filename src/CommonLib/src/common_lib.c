@@ -1,5 +1,6 @@
 #include "common_lib.h"
 #include "lock_common.h"
+#include "checksum.h"
 
 STATUS
 CommonLibInit(
@@ -26,5 +27,7 @@ CommonLibInit(
 
     AssertSetFunction(InitSettings->AssertFunction);
 
+    ChecksumSystemInit();
+
     return status;
 }
\ No newline at end of file
@@ -0,0 +1,208 @@
+#include "common_lib.h"
+#include "histogram.h"
+
+#define HISTOGRAM_PER_MILLE_MAX         1000
+
+static
+DWORD
+_HistogramGetMostSignificantBit(
+    IN      QWORD               Value
+    );
+
+static
+DWORD
+_HistogramGetBucketIndex(
+    IN      QWORD               Value
+    );
+
+static
+QWORD
+_HistogramGetBucketUpperBound(
+    IN      DWORD               BucketIndex
+    );
+
+void
+HistogramInit(
+    OUT     PHISTOGRAM          Histogram
+    )
+{
+    ASSERT(NULL != Histogram);
+
+    memzero(Histogram, sizeof(HISTOGRAM));
+
+    Histogram->Min = MAX_QWORD;
+}
+
+void
+HistogramRecord(
+    INOUT   PHISTOGRAM          Histogram,
+    IN      QWORD               Value
+    )
+{
+    ASSERT(NULL != Histogram);
+
+    Histogram->Buckets[_HistogramGetBucketIndex(Value)]++;
+
+    Histogram->Count++;
+    Histogram->Sum = (MAX_QWORD - Histogram->Sum < Value) ? MAX_QWORD : Histogram->Sum + Value;
+
+    if (Value < Histogram->Min)
+    {
+        Histogram->Min = Value;
+    }
+
+    if (Value > Histogram->Max)
+    {
+        Histogram->Max = Value;
+    }
+}
+
+void
+HistogramMerge(
+    INOUT   PHISTOGRAM          Destination,
+    IN      PHISTOGRAM          Source
+    )
+{
+    DWORD i;
+
+    ASSERT(NULL != Destination);
+    ASSERT(NULL != Source);
+
+    if (0 == Source->Count)
+    {
+        return;
+    }
+
+    for (i = 0; i < HISTOGRAM_NO_OF_BUCKETS; ++i)
+    {
+        Destination->Buckets[i] += Source->Buckets[i];
+    }
+
+    Destination->Count += Source->Count;
+    Destination->Sum = (MAX_QWORD - Destination->Sum < Source->Sum) ? MAX_QWORD : Destination->Sum + Source->Sum;
+    Destination->Min = min(Destination->Min, Source->Min);
+    Destination->Max = max(Destination->Max, Source->Max);
+}
+
+QWORD
+HistogramGetPercentile(
+    IN      PHISTOGRAM          Histogram,
+    IN_RANGE_UPPER(1000)
+            DWORD               PerMille
+    )
+{
+    QWORD rank;
+    QWORD valuesSeen;
+    DWORD i;
+
+    ASSERT(NULL != Histogram);
+    ASSERT(PerMille <= HISTOGRAM_PER_MILLE_MAX);
+
+    if (0 == Histogram->Count)
+    {
+        return 0;
+    }
+
+    // the smallest value which has at least PerMille thousandths of the
+    // values below or at it
+    rank = (Histogram->Count * PerMille + HISTOGRAM_PER_MILLE_MAX - 1) / HISTOGRAM_PER_MILLE_MAX;
+    if (0 == rank)
+    {
+        return Histogram->Min;
+    }
+
+    valuesSeen = 0;
+    for (i = 0; i < HISTOGRAM_NO_OF_BUCKETS; ++i)
+    {
+        valuesSeen += Histogram->Buckets[i];
+        if (valuesSeen >= rank)
+        {
+            return min(_HistogramGetBucketUpperBound(i), Histogram->Max);
+        }
+    }
+
+    NOT_REACHED;
+
+    return Histogram->Max;
+}
+
+QWORD
+HistogramGetMean(
+    IN      PHISTOGRAM          Histogram
+    )
+{
+    ASSERT(NULL != Histogram);
+
+    return 0 != Histogram->Count ? Histogram->Sum / Histogram->Count : 0;
+}
+
+static
+DWORD
+_HistogramGetMostSignificantBit(
+    IN      QWORD               Value
+    )
+{
+    DWORD result;
+    DWORD shift;
+
+    ASSERT(0 != Value);
+
+    result = 0;
+
+    // binary search, the compiler intrinsics are not available in all the
+    // environments the library is built for
+    for (shift = sizeof(QWORD) * BITS_PER_BYTE / 2; shift > 0; shift = shift / 2)
+    {
+        if (0 != (Value >> shift))
+        {
+            Value = Value >> shift;
+            result = result + shift;
+        }
+    }
+
+    return result;
+}
+
+static
+DWORD
+_HistogramGetBucketIndex(
+    IN      QWORD               Value
+    )
+{
+    DWORD msb;
+
+    if (Value < HISTOGRAM_SUB_BUCKETS)
+    {
+        return (DWORD) Value;
+    }
+
+    // the bits following the most significant one select the sub-bucket
+    msb = _HistogramGetMostSignificantBit(Value);
+
+    return (msb - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+           (DWORD) ((Value >> (msb - HISTOGRAM_SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static
+QWORD
+_HistogramGetBucketUpperBound(
+    IN      DWORD               BucketIndex
+    )
+{
+    DWORD group;
+    QWORD subBucket;
+
+    ASSERT(BucketIndex < HISTOGRAM_NO_OF_BUCKETS);
+
+    group = BucketIndex / HISTOGRAM_SUB_BUCKETS;
+    subBucket = BucketIndex % HISTOGRAM_SUB_BUCKETS;
+
+    if (0 == group)
+    {
+        return subBucket;
+    }
+
+    // the bucket holds the values [lower, lower + 2^(group - 1)), the sum
+    // does not overflow for the last bucket
+    return ((HISTOGRAM_SUB_BUCKETS + subBucket) << (group - 1)) + ((1ULL << (group - 1)) - 1);
+}
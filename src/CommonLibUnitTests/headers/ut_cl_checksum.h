@@ -0,0 +1,7 @@
+#pragma once
+
+STATUS
+UtClChecksum();
+
+STATUS
+UtClChecksumBenchmark();
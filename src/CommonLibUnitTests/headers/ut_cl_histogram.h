@@ -0,0 +1,4 @@
+#pragma once
+
+STATUS
+UtClHistogram();
@@ -7,6 +7,8 @@
 #include "ut_cl_string.h"
 #include "ut_cl_stack_dynamic.h"
 #include "ut_cl_hash_table.h"
+#include "ut_cl_checksum.h"
+#include "ut_cl_histogram.h"
 
 typedef struct _CL_UNIT_TEST
 {
@@ -27,6 +29,9 @@ const CL_UNIT_TEST CL_TESTS[] =
     {"Memory", TstStrings},
     {"DynamicStack", UtClStackDynamic},
     {"HashTable", UtClHashTable},
+    {"Checksum", UtClChecksum},
+    {"ChecksumBenchmark", UtClChecksumBenchmark},
+    {"Histogram", UtClHistogram},
 };
 
 static constexpr auto NO_OF_CL_TESTS = ARRAYSIZE(CL_TESTS);
@@ -0,0 +1,362 @@
+#include "ut_base.h"
+#include "ut_cl_checksum.h"
+#include "checksum.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include "ut_cl_rng.h"
+
+typedef struct _UT_CRC_VECTOR
+{
+    const std::string           TestName;
+
+    std::vector<BYTE>           Data;
+    DWORD                       ExpectedCrc;
+} UT_CRC_VECTOR;
+
+typedef struct _UT_CHECKSUM_VECTOR
+{
+    const std::string           TestName;
+
+    std::vector<BYTE>           Data;
+
+    // as it would be stored in a network header
+    WORD                        ExpectedChecksum;
+} UT_CHECKSUM_VECTOR;
+
+// RFC 3720 B.4
+static const UT_CRC_VECTOR CRC_VECTORS[] =
+{
+    {"Check string", {'1', '2', '3', '4', '5', '6', '7', '8', '9'}, 0xE306'9283},
+    {"32 bytes of zeroes", std::vector<BYTE>(32, 0x00), 0x8A91'36AA},
+    {"32 bytes of ones", std::vector<BYTE>(32, 0xFF), 0x62A8'AB43},
+    {"Empty", {}, 0},
+};
+
+static const UT_CHECKSUM_VECTOR CHECKSUM_VECTORS[] =
+{
+    // RFC 1071 3.
+    {"RFC 1071 example", {0x00, 0x01, 0xF2, 0x03, 0xF4, 0xF5, 0xF6, 0xF7}, 0x0D22},
+    {"Odd length", {0x00, 0x01, 0xF2}, 0xFE0D},
+    {"All ones", std::vector<BYTE>(64, 0xFF), 0x0000},
+    {"Empty", {}, 0xFFFF},
+};
+
+// sizes for which the random data is checked, chosen around the block sizes
+// of the SIMD and CRC32C stream implementations
+static const DWORD RANDOM_SIZES[] =
+{
+    1, 7, 8, 15, 31, 32, 33, 63, 64, 65, 255, 767, 768, 769, 1500, 4096,
+    3 * 8192 - 1, 3 * 8192, 3 * 8192 + 13, 100'000
+};
+
+static constexpr DWORD RANDOM_OFFSETS = 8;
+
+static constexpr DWORD BENCHMARK_BUFFER_SIZE = 64 * 1024;
+static constexpr DWORD BENCHMARK_ITERATIONS = 4096;
+
+static const char* CHECKSUM_IMPLEMENTATION_NAMES[ChecksumImplementationReserved] =
+{
+    "Scalar", "SSE2", "AVX2"
+};
+
+static const char* CRC32C_IMPLEMENTATION_NAMES[Crc32cImplementationReserved] =
+{
+    "Table", "SSE4.2"
+};
+
+static
+WORD
+_UtChecksumReference(
+    _In_reads_bytes_(Length)    const BYTE*     Buffer,
+    _In_                        DWORD           Length
+    )
+{
+    QWORD sum = 0;
+
+    for (DWORD i = 0; i + 1 < Length; i += 2)
+    {
+        sum += BYTES_TO_WORD(Buffer[i + 1], Buffer[i]);
+    }
+
+    if (Length % 2 != 0)
+    {
+        sum += Buffer[Length - 1];
+    }
+
+    while ((sum >> 16) != 0)
+    {
+        sum = (sum & MAX_WORD) + (sum >> 16);
+    }
+
+    return (WORD) ~sum;
+}
+
+static
+DWORD
+_UtCrc32cReference(
+    _In_reads_bytes_(Length)    const BYTE*     Buffer,
+    _In_                        DWORD           Length
+    )
+{
+    DWORD crc = MAX_DWORD;
+
+    for (DWORD i = 0; i < Length; ++i)
+    {
+        crc ^= Buffer[i];
+
+        for (DWORD bit = 0; bit < BITS_PER_BYTE; ++bit)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82F6'3B78 : (crc >> 1);
+        }
+    }
+
+    return ~crc;
+}
+
+static
+STATUS
+_UtChecksumCheck(
+    _In_reads_bytes_(Length)    const BYTE*     Buffer,
+    _In_                        DWORD           Length,
+    _In_                        WORD            ExpectedChecksum
+    )
+{
+    WORD checksum = ChecksumInternetFold(ChecksumInternetAdd((PVOID)Buffer, Length, 0));
+    if (checksum != ExpectedChecksum)
+    {
+        LOG_ERROR("[%s] checksum of %u bytes is 0x%04X, expected 0x%04X\n",
+            CHECKSUM_IMPLEMENTATION_NAMES[ChecksumGetImplementation()], Length, checksum, ExpectedChecksum);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    // a split at an even offset must not change the result
+    DWORD split = (Length / 3) & ~1UL;
+    DWORD partialSum = ChecksumInternetAdd((PVOID)Buffer, split, 0);
+
+    checksum = ChecksumInternetFold(ChecksumInternetAdd((PVOID)(Buffer + split), Length - split, partialSum));
+    if (checksum != ExpectedChecksum)
+    {
+        LOG_ERROR("[%s] checksum of %u bytes split at %u is 0x%04X, expected 0x%04X\n",
+            CHECKSUM_IMPLEMENTATION_NAMES[ChecksumGetImplementation()], Length, split, checksum, ExpectedChecksum);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+static
+STATUS
+_UtCrc32cCheck(
+    _In_reads_bytes_(Length)    const BYTE*     Buffer,
+    _In_                        DWORD           Length,
+    _In_                        DWORD           ExpectedCrc
+    )
+{
+    DWORD crc = Crc32c((PVOID)Buffer, Length, 0);
+    if (crc != ExpectedCrc)
+    {
+        LOG_ERROR("[%s] CRC of %u bytes is 0x%08X, expected 0x%08X\n",
+            CRC32C_IMPLEMENTATION_NAMES[Crc32cGetImplementation()], Length, crc, ExpectedCrc);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    DWORD split = Length / 3;
+
+    crc = Crc32c((PVOID)(Buffer + split), Length - split, Crc32c((PVOID)Buffer, split, 0));
+    if (crc != ExpectedCrc)
+    {
+        LOG_ERROR("[%s] CRC of %u bytes split at %u is 0x%08X, expected 0x%08X\n",
+            CRC32C_IMPLEMENTATION_NAMES[Crc32cGetImplementation()], Length, split, crc, ExpectedCrc);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+static
+STATUS
+_UtChecksumRunImplementation(
+    _In_ const std::vector<BYTE>&   RandomData
+    )
+{
+    STATUS status;
+
+    for (const auto& vect : CHECKSUM_VECTORS)
+    {
+        status = _UtChecksumCheck(vect.Data.data(), (DWORD) vect.Data.size(), vect.ExpectedChecksum);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Test vector [%s] failed\n", vect.TestName.c_str());
+            return status;
+        }
+    }
+
+    for (const auto& size : RANDOM_SIZES)
+    {
+        for (DWORD offset = 0; offset < RANDOM_OFFSETS; ++offset)
+        {
+            ASSERT(offset + size <= RandomData.size());
+
+            status = _UtChecksumCheck(&RandomData[offset], size,
+                                      _UtChecksumReference(&RandomData[offset], size));
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_UtChecksumCheck", status);
+                return status;
+            }
+        }
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+static
+STATUS
+_UtCrc32cRunImplementation(
+    _In_ const std::vector<BYTE>&   RandomData
+    )
+{
+    STATUS status;
+
+    for (const auto& vect : CRC_VECTORS)
+    {
+        status = _UtCrc32cCheck(vect.Data.data(), (DWORD) vect.Data.size(), vect.ExpectedCrc);
+        if (!SUCCEEDED(status))
+        {
+            LOG_ERROR("Test vector [%s] failed\n", vect.TestName.c_str());
+            return status;
+        }
+    }
+
+    for (const auto& size : RANDOM_SIZES)
+    {
+        for (DWORD offset = 0; offset < RANDOM_OFFSETS; ++offset)
+        {
+            ASSERT(offset + size <= RandomData.size());
+
+            status = _UtCrc32cCheck(&RandomData[offset], size,
+                                    _UtCrc32cReference(&RandomData[offset], size));
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_UtCrc32cCheck", status);
+                return status;
+            }
+        }
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+static
+std::vector<BYTE>
+_UtChecksumGenerateData(
+    _In_ size_t             Size
+    )
+{
+    UtCl::RNG& rngInstance = UtCl::RNG::GetInstance();
+    std::vector<BYTE> data(Size);
+
+    for (auto& byte : data)
+    {
+        byte = (BYTE) rngInstance.GetNextRandom();
+    }
+
+    return data;
+}
+
+STATUS
+UtClChecksum()
+{
+    STATUS status;
+    CHECKSUM_IMPLEMENTATION checksumImplementation = ChecksumGetImplementation();
+    CRC32C_IMPLEMENTATION crcImplementation = Crc32cGetImplementation();
+    std::vector<BYTE> randomData = _UtChecksumGenerateData(100'000 + RANDOM_OFFSETS);
+
+    status = CL_STATUS_SUCCESS;
+
+    for (DWORD i = 0; i < ChecksumImplementationReserved && SUCCEEDED(status); ++i)
+    {
+        if (!ChecksumIsImplementationSupported((CHECKSUM_IMPLEMENTATION)i))
+        {
+            LOG("Checksum implementation [%s] is not supported\n", CHECKSUM_IMPLEMENTATION_NAMES[i]);
+            continue;
+        }
+
+        ChecksumSelectImplementation((CHECKSUM_IMPLEMENTATION)i);
+
+        status = _UtChecksumRunImplementation(randomData);
+    }
+
+    for (DWORD i = 0; i < Crc32cImplementationReserved && SUCCEEDED(status); ++i)
+    {
+        if (!Crc32cIsImplementationSupported((CRC32C_IMPLEMENTATION)i))
+        {
+            LOG("CRC32C implementation [%s] is not supported\n", CRC32C_IMPLEMENTATION_NAMES[i]);
+            continue;
+        }
+
+        Crc32cSelectImplementation((CRC32C_IMPLEMENTATION)i);
+
+        status = _UtCrc32cRunImplementation(randomData);
+    }
+
+    ChecksumSelectImplementation(checksumImplementation);
+    Crc32cSelectImplementation(crcImplementation);
+
+    return status;
+}
+
+template <typename Func>
+static
+void
+_UtChecksumMeasure(
+    _In_z_  const char*                 Name,
+    _In_    const std::vector<BYTE>&    Data,
+    _In_    Func                        Function
+    )
+{
+    DWORD result = 0;
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (DWORD i = 0; i < BENCHMARK_ITERATIONS; ++i)
+    {
+        // feed the result back so the calls cannot be dropped
+        result = Function((PVOID)Data.data(), (DWORD)Data.size(), result);
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double megabytes = (double) Data.size() * BENCHMARK_ITERATIONS / (1024 * 1024);
+
+    LOG("[%s] %.0f MB/s (result 0x%X)\n", Name, megabytes / seconds, result);
+}
+
+STATUS
+UtClChecksumBenchmark()
+{
+    CHECKSUM_IMPLEMENTATION checksumImplementation = ChecksumGetImplementation();
+    CRC32C_IMPLEMENTATION crcImplementation = Crc32cGetImplementation();
+    std::vector<BYTE> data = _UtChecksumGenerateData(BENCHMARK_BUFFER_SIZE);
+
+    for (DWORD i = 0; i < ChecksumImplementationReserved; ++i)
+    {
+        if (!SUCCEEDED(ChecksumSelectImplementation((CHECKSUM_IMPLEMENTATION)i))) continue;
+
+        _UtChecksumMeasure(CHECKSUM_IMPLEMENTATION_NAMES[i], data, ChecksumInternetAdd);
+    }
+
+    for (DWORD i = 0; i < Crc32cImplementationReserved; ++i)
+    {
+        if (!SUCCEEDED(Crc32cSelectImplementation((CRC32C_IMPLEMENTATION)i))) continue;
+
+        _UtChecksumMeasure(CRC32C_IMPLEMENTATION_NAMES[i], data, Crc32c);
+    }
+
+    ChecksumSelectImplementation(checksumImplementation);
+    Crc32cSelectImplementation(crcImplementation);
+
+    return CL_STATUS_SUCCESS;
+}
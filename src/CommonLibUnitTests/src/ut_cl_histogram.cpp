@@ -0,0 +1,149 @@
+#include "ut_base.h"
+#include "ut_cl_histogram.h"
+#include "histogram.h"
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "ut_cl_rng.h"
+
+static constexpr DWORD RANDOM_VALUES = 100'000;
+
+// the histograms are too large to be kept on the stack
+typedef std::unique_ptr<HISTOGRAM> UT_HISTOGRAM_PTR;
+
+static const DWORD PERCENTILES[] =
+{
+    0, 1, 100, 500, 900, 990, 999, 1000
+};
+
+static
+UT_HISTOGRAM_PTR
+_UtHistogramCreate(
+    void
+    )
+{
+    UT_HISTOGRAM_PTR histogram = std::make_unique<HISTOGRAM>();
+
+    HistogramInit(histogram.get());
+
+    return histogram;
+}
+
+static
+QWORD
+_UtHistogramReferencePercentile(
+    _In_    const std::vector<QWORD>&   SortedValues,
+    _In_    DWORD                       PerMille
+    )
+{
+    QWORD rank = ((QWORD) SortedValues.size() * PerMille + 999) / 1000;
+
+    return SortedValues[rank != 0 ? rank - 1 : 0];
+}
+
+static
+STATUS
+_UtHistogramCheckPercentiles(
+    _In_    PHISTOGRAM                  Histogram,
+    _In_    std::vector<QWORD>          Values
+    )
+{
+    std::sort(Values.begin(), Values.end());
+
+    if (Histogram->Count != Values.size() ||
+        Histogram->Min != Values.front() ||
+        Histogram->Max != Values.back())
+    {
+        LOG_ERROR("Histogram has %I64u values in [%I64u, %I64u], expected %I64u in [%I64u, %I64u]\n",
+            Histogram->Count, Histogram->Min, Histogram->Max,
+            (QWORD) Values.size(), Values.front(), Values.back());
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    for (const auto& perMille : PERCENTILES)
+    {
+        QWORD expected = _UtHistogramReferencePercentile(Values, perMille);
+        QWORD value = HistogramGetPercentile(Histogram, perMille);
+
+        // rounded up to the end of the bucket, at most 1/HISTOGRAM_SUB_BUCKETS
+        if (value < expected || value - expected > expected / HISTOGRAM_SUB_BUCKETS)
+        {
+            LOG_ERROR("Percentile %u/1000 is %I64u, expected %I64u\n", perMille, value, expected);
+            return CL_STATUS_VALUE_MISMATCH;
+        }
+    }
+
+    return CL_STATUS_SUCCESS;
+}
+
+STATUS
+UtClHistogram()
+{
+    STATUS status;
+    UtCl::RNG& rngInstance = UtCl::RNG::GetInstance();
+    std::vector<QWORD> values;
+
+    UT_HISTOGRAM_PTR histogram = _UtHistogramCreate();
+
+    if (0 != HistogramGetPercentile(histogram.get(), 500) ||
+        0 != HistogramGetMean(histogram.get()))
+    {
+        LOG_ERROR("An empty histogram must report 0\n");
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    // the small values have a bucket each and must be exact
+    for (QWORD i = 0; i < HISTOGRAM_SUB_BUCKETS * 2; ++i)
+    {
+        HistogramRecord(histogram.get(), i);
+        values.push_back(i);
+    }
+
+    status = _UtHistogramCheckPercentiles(histogram.get(), values);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_UtHistogramCheckPercentiles", status);
+        return status;
+    }
+
+    if (HistogramGetPercentile(histogram.get(), 500) != HISTOGRAM_SUB_BUCKETS - 1)
+    {
+        LOG_ERROR("The median of [0, %u) is not exact\n", HISTOGRAM_SUB_BUCKETS * 2);
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    // values spread over most of the QWORD range, half of them go to a second
+    // histogram which is then merged into the first one
+    UT_HISTOGRAM_PTR other = _UtHistogramCreate();
+
+    for (DWORD i = 0; i < RANDOM_VALUES; ++i)
+    {
+        QWORD value = ((QWORD) rngInstance.GetNextRandom() << 32) | rngInstance.GetNextRandom();
+
+        value = value >> (rngInstance.GetNextRandom() % 64);
+
+        HistogramRecord(i % 2 == 0 ? histogram.get() : other.get(), value);
+        values.push_back(value);
+    }
+
+    HistogramMerge(histogram.get(), other.get());
+
+    status = _UtHistogramCheckPercentiles(histogram.get(), values);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_UtHistogramCheckPercentiles", status);
+        return status;
+    }
+
+    // the largest value goes in the last bucket
+    HistogramInit(other.get());
+    HistogramRecord(other.get(), MAX_QWORD);
+
+    if (HistogramGetPercentile(other.get(), 999) != MAX_QWORD)
+    {
+        LOG_ERROR("MAX_QWORD was not recorded correctly\n");
+        return CL_STATUS_VALUE_MISMATCH;
+    }
+
+    return CL_STATUS_SUCCESS;
+}
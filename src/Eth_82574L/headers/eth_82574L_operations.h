@@ -10,15 +10,19 @@ _No_competing_thread_
 STATUS
 EthReceiveFrame(
     IN                              PETH_DEVICE     Device,
-    IN_OPT                          WORD            MaximumNumberOfFrames
+    IN                              BYTE            QueueIndex,
+    IN_OPT                          WORD            MaximumNumberOfFrames,
+    OUT_OPT                         WORD*           NumberOfFramesReceived
     );
 
 _No_competing_thread_
 STATUS
-EthSendFrame(
+EthSendFrames(
     IN                              PETH_DEVICE     Device,
-    IN                              WORD            DescriptorIndex,
-    IN                              WORD            Length
+    IN                              BYTE            QueueIndex,
+    IN                              WORD            FirstDescriptorIndex,
+    IN                              WORD            NumberOfFrames,
+    IN_READS(NumberOfFrames)        WORD*           Lengths
     );
 
 _No_competing_thread_
@@ -27,6 +31,20 @@ EthHandleInterrupt(
     IN                              PETH_DEVICE     Device
     );
 
+// called on the MSI-X vector of QueueIndex, the queue interrupts are masked
+// by the device when the message is sent
+BOOLEAN
+EthHandleQueueInterrupt(
+    IN                              PETH_DEVICE     Device,
+    IN                              BYTE            QueueIndex
+    );
+
+void
+EthGetInterruptModeration(
+    IN                              PETH_DEVICE                     Device,
+    OUT                             PNETWORK_INTERRUPT_MODERATION   InterruptModeration
+    );
+
 _No_competing_thread_
 void
 EthChangeDeviceStatus(
@@ -96,6 +96,33 @@ typedef union _DEVICE_STATUS_REGISTER
 } DEVICE_STATUS_REGISTER, *PDEVICE_STATUS_REGISTER;
 STATIC_ASSERT(sizeof(DEVICE_STATUS_REGISTER) == ETH_INTERNAL_REG_SIZE);
 
+// 0x18 - RW
+typedef union _EXTENDED_DEVICE_CONTROL_REGISTER
+{
+    struct
+    {
+        // these fields are only read and written back unchanged
+        DWORD               __Reserved0                     : 24;
+
+        // When set, the bits set in IAM are cleared from IMS when the MSI-X
+        // message of their interrupt cause is sent.
+        DWORD               MsiXAutoMaskEnable              : 1;
+
+        DWORD               __Reserved1                     : 2;
+
+        // When set, a read or write of ICR clears the bits set in IAM from IMS.
+        DWORD               InterruptAckAutoMaskEnable      : 1;
+
+        DWORD               __Reserved2                     : 3;
+
+        // Must be set when MSI-X is used, the PBA is then reported through the
+        // MSI-X PBA table instead of ICR.
+        DWORD               PbaSupport                      : 1;
+    };
+    DWORD                   Raw;
+} EXTENDED_DEVICE_CONTROL_REGISTER, *PEXTENDED_DEVICE_CONTROL_REGISTER;
+STATIC_ASSERT(sizeof(EXTENDED_DEVICE_CONTROL_REGISTER) == ETH_INTERNAL_REG_SIZE);
+
 //////////////////////////////////////////////////////////////////////////////////////
 //////                      Interrupt Register Descriptors                     ///////
 //////////////////////////////////////////////////////////////////////////////////////
@@ -138,7 +165,21 @@ typedef union _INT_CAUSE_READ_REGISTER
 
         DWORD               __Reserved2                     : 1;
 
-        DWORD               __Reserved3                     : 22;
+        DWORD               __Reserved3                     : 11;
+
+        // Set when receive queue 0 or 1 generates an interrupt, valid only
+        // when multiple queues are used.
+        DWORD               RxQueue0                        : 1;
+        DWORD               RxQueue1                        : 1;
+
+        // Set when transmit queue 0 or 1 generates an interrupt.
+        DWORD               TxQueue0                        : 1;
+        DWORD               TxQueue1                        : 1;
+
+        // Set for any interrupt cause not mapped to a queue.
+        DWORD               OtherInterrupt                  : 1;
+
+        DWORD               __Reserved4                     : 6;
 
         // This bit is set when the LAN port has a pending interrupt.If the
         // interrupt is enabled in the PCI configuration space, an interrupt is
@@ -286,6 +327,60 @@ typedef union _INT_MASK_CLEAR_REGISTER
     DWORD                   Raw;
 } INT_MASK_CLEAR_REGISTER, *PINT_MASK_CLEAR_REGISTER;
 
+// 0xC4 - RW
+typedef union _INT_THROTTLING_REGISTER
+{
+    struct
+    {
+        // Minimum inter-interrupt interval in 256 ns increments. A value of
+        // zero disables interrupt throttling.
+        DWORD               Interval                        : 16;
+
+        DWORD               __Reserved0                     : 16;
+    };
+    DWORD                   Raw;
+} INT_THROTTLING_REGISTER, *PINT_THROTTLING_REGISTER;
+STATIC_ASSERT(sizeof(INT_THROTTLING_REGISTER) == ETH_INTERNAL_REG_SIZE);
+
+// the queue interrupt causes in ICR/IMS/IMC, EIAC and IAM
+#define ETH_INT_RX_QUEUE0_BIT               20
+#define ETH_INT_TX_QUEUE0_BIT               22
+#define ETH_INT_OTHER_BIT                   24
+
+#define ETH_INT_QUEUE_MASK(Queue)           ((1UL << (ETH_INT_RX_QUEUE0_BIT + (Queue))) | (1UL << (ETH_INT_TX_QUEUE0_BIT + (Queue))))
+
+// 0xE4 - RW
+typedef union _INT_VECTOR_ALLOCATION_REGISTER
+{
+    struct
+    {
+        // Each interrupt cause is mapped to the MSI-X vector written in its
+        // allocation field, the mapping is used only if its valid bit is set.
+        DWORD               RxQueue0Vector                  : 3;
+        DWORD               RxQueue0Valid                   : 1;
+
+        DWORD               RxQueue1Vector                  : 3;
+        DWORD               RxQueue1Valid                   : 1;
+
+        DWORD               TxQueue0Vector                  : 3;
+        DWORD               TxQueue0Valid                   : 1;
+
+        DWORD               TxQueue1Vector                  : 3;
+        DWORD               TxQueue1Valid                   : 1;
+
+        DWORD               OtherVector                     : 3;
+        DWORD               OtherValid                      : 1;
+
+        DWORD               __Reserved0                     : 11;
+
+        // When set, a TX interrupt is generated on every descriptor write
+        // back instead of only when the TX interrupt delay timers expire.
+        DWORD               TxOnEveryWriteBack              : 1;
+    };
+    DWORD                   Raw;
+} INT_VECTOR_ALLOCATION_REGISTER, *PINT_VECTOR_ALLOCATION_REGISTER;
+STATIC_ASSERT(sizeof(INT_VECTOR_ALLOCATION_REGISTER) == ETH_INTERNAL_REG_SIZE);
+
 //////////////////////////////////////////////////////////////////////////////////////
 //////                      Receive Register Descriptors                       ///////
 //////////////////////////////////////////////////////////////////////////////////////
@@ -575,6 +670,64 @@ typedef union _RECEIVE_FILTER_CONTROL_REGISTER
 } RECEIVE_FILTER_CONTROL_REGISTER, *PRECEIVE_FILTER_CONTROL_REGISTER;
 STATIC_ASSERT(sizeof(RECEIVE_FILTER_CONTROL_REGISTER) == ETH_INTERNAL_REG_SIZE);
 
+#define MRQE_DISABLED                   0b00
+#define MRQE_RSS                        0b01
+
+// 0x5818 - RW
+typedef union _MULTIPLE_RX_QUEUES_COMMAND_REGISTER
+{
+    struct
+    {
+        // 00b = Multiple receive queues are disabled.
+        // 01b = Multiple receive queues as defined by MSFT RSS. The RSS field
+        // enable bits define the header fields used by the hash function.
+        DWORD                   MultipleRxQueuesEnable          :  2;
+
+        DWORD                   __Reserved0                     : 14;
+
+        // RSS field enable bits, each enables hashing of a packet type.
+        DWORD                   HashTcpIpv4                     :  1;
+        DWORD                   HashIpv4                        :  1;
+        DWORD                   HashTcpIpv6Ex                   :  1;
+        DWORD                   HashIpv6Ex                      :  1;
+        DWORD                   HashIpv6                        :  1;
+
+        DWORD                   __Reserved1                     : 11;
+    };
+    DWORD                       Raw;
+} MULTIPLE_RX_QUEUES_COMMAND_REGISTER, *PMULTIPLE_RX_QUEUES_COMMAND_REGISTER;
+STATIC_ASSERT(sizeof(MULTIPLE_RX_QUEUES_COMMAND_REGISTER) == ETH_INTERNAL_REG_SIZE);
+
+// the 7 LSBs of the RSS hash select one of the entries of the redirection
+// table, the entry selects the queue which receives the packet
+#define ETH_RSS_REDIRECTION_TABLE_ENTRIES       128
+#define ETH_RSS_REDIRECTION_TABLE_REGISTERS     (ETH_RSS_REDIRECTION_TABLE_ENTRIES / sizeof(DWORD))
+
+// the secret key of the Toeplitz hash function
+#define ETH_RSS_KEY_SIZE                        40
+#define ETH_RSS_KEY_REGISTERS                   (ETH_RSS_KEY_SIZE / sizeof(DWORD))
+
+// 0x5C00 - 0x5C7C - RW
+typedef union _REDIRECTION_TABLE_ENTRY
+{
+    struct
+    {
+        BYTE                    __Reserved0                     :  7;
+
+        // index of the queue which receives the packets with this hash
+        BYTE                    QueueIndex                      :  1;
+    };
+    BYTE                        Raw;
+} REDIRECTION_TABLE_ENTRY, *PREDIRECTION_TABLE_ENTRY;
+STATIC_ASSERT(sizeof(REDIRECTION_TABLE_ENTRY) == sizeof(BYTE));
+
+typedef union _REDIRECTION_TABLE_REGISTER
+{
+    REDIRECTION_TABLE_ENTRY     Entries[sizeof(DWORD)];
+    DWORD                       Raw;
+} REDIRECTION_TABLE_REGISTER, *PREDIRECTION_TABLE_REGISTER;
+STATIC_ASSERT(sizeof(REDIRECTION_TABLE_REGISTER) == ETH_INTERNAL_REG_SIZE);
+
 //////////////////////////////////////////////////////////////////////////////////////
 //////                      Transmit Register Descriptors                      ///////
 //////////////////////////////////////////////////////////////////////////////////////
@@ -723,5 +876,27 @@ typedef union _TD_TAIL
 } TD_TAIL, *PTD_TAIL;
 STATIC_ASSERT(sizeof(TD_TAIL) == ETH_INTERNAL_REG_SIZE);
 
+// 0x3840 - RW
+typedef union _TRANSMIT_ARBITRATION_COUNT
+{
+    struct
+    {
+        // Number of packets sent from this queue before moving to the other
+        // queue.
+        DWORD                       Count                           :  7;
+
+        DWORD                       __Reserved0                     :  3;
+
+        // When set, the queue takes part in the arbitration, queue 0 is
+        // enabled by default.
+        DWORD                       Enable                          :  1;
+
+        // these fields are only read and written back unchanged
+        DWORD                       __Reserved1                     : 21;
+    };
+    DWORD                           Raw;
+} TRANSMIT_ARBITRATION_COUNT, *PTRANSMIT_ARBITRATION_COUNT;
+STATIC_ASSERT(sizeof(TRANSMIT_ARBITRATION_COUNT) == ETH_INTERNAL_REG_SIZE);
+
 #pragma warning(pop)
 #pragma pack(pop)
@@ -2,6 +2,7 @@
 
 #include "eth_82574L_regs.h"
 #include "lock_common.h"
+#include "ex_event.h"
 
 #define INTEL_82574L_DEV_ID                     0x10D3
 
@@ -14,14 +15,24 @@
 #define ETH_FLASH_SIZE                          (4*KB_SIZE)
 #define ETH_MSI_X_TABLES_SIZE                   (16*KB_SIZE)
 
+#define ETH_OFFSET_CTRL_EXT                     0x0018
 #define ETH_OFFSET_ICR                          0x00C0
+#define ETH_OFFSET_ITR                          0x00C4
 #define ETH_OFFSET_IMS                          0x00D0
+#define ETH_OFFSET_EIAC                         0x00DC
+#define ETH_OFFSET_IVAR                         0x00E4
 #define ETH_OFFSET_RCTL                         0x0100
 #define ETH_OFFSET_TCTL                         0x0400
 #define ETH_OFFSET_RDBAL                        0x2800
 #define ETH_OFFSET_TDBAL                        0x3800
 #define ETH_OFFSET_RFCTL                        0x5008
+#define ETH_OFFSET_MRQC                         0x5818
 #define ETH_OFFSET_TO_IP_ADDRESS_VALID          0x5838
+#define ETH_OFFSET_RETA                         0x5C00
+#define ETH_OFFSET_RSSRK                        0x5C80
+
+// the registers of queue 1 follow those of queue 0
+#define ETH_QUEUE_REGISTERS_SIZE                0x100
 
 #define ETH_DESCRIPTOR_SIZE                     16
 
@@ -31,6 +42,13 @@
 #define ETH_NO_OF_RX_DESCS                      32
 #define ETH_NO_OF_TX_DESCS                      32
 
+// each queue has its own RX and TX ring, received frames are spread between
+// the queues by RSS
+#define ETH_NO_OF_QUEUES                        2
+
+// maximum number of frames the RX poll thread processes before yielding
+#define ETH_RX_POLL_BUDGET                      16
+
 #define ETH_BUFFER_SIZE                         4*KB_SIZE
 
 #define ETH_BSIZE_4KB_SEX                       0b11
@@ -60,50 +78,8 @@ typedef union _EERD_REGISTER
 } EERD_REGISTER, *PEERD_REGISTER;
 STATIC_ASSERT(sizeof(EERD_REGISTER) == ETH_INTERNAL_REG_SIZE);
 
-typedef struct _ETH_INTERNAL_REGS
+typedef struct _ETH_RX_QUEUE_REGS
 {
-    // 0x0 - 0x4 - RW
-    VOL_DWORD                               DeviceControlRegister[2];
-
-    // 0x8 - R
-    VOL_DWORD                               DeviceStatusRegister;
-
-    // 0xC
-    VOL_DWORD                               __Reserved0;
-
-    // 0x10 - RW/R0
-    VOL_DWORD                               EepromFlashControlRegister;
-
-    // 0x14 - RW
-    VOL_DWORD                               EepromReadRegister;
-
-    BYTE                                    __Reserved1[0xA8];
-
-    // 0xC0 - RC/WC
-    VOL_DWORD                               InterruptCauseReadRegister;
-
-    BYTE                                    __Reserved99[0xC];
-
-    // 0xD0 - RW
-    VOL_DWORD                               InterruptMaskSetRegister;
-
-    VOL_DWORD                               __Reserved98;
-
-    // 0xD8 - W
-    VOL_DWORD                               InterruptMaskClearRegister;
-
-    BYTE                                    __Reserved2[0x24];
-
-    // 0x100 - RW
-    VOL_DWORD                               ReceiveControlRegister;
-
-    BYTE                                    __Reserved3[0x2FC];
-
-    // 0x400 - RW
-    VOL_DWORD                               TransmitControlRegister;
-
-    BYTE                                    __Reserved4[0x23FC];
-
     // 0x2800 - RW
     VOL_DWORD                               ReceiveDescriptorAddressLow;
 
@@ -113,30 +89,34 @@ typedef struct _ETH_INTERNAL_REGS
     // 0x2808 - RW
     VOL_DWORD                               ReceiveDescriptorLength;
 
-    VOL_DWORD                               __Reserved5;
+    VOL_DWORD                               __Reserved0;
 
     // 0x2810 - RW
     VOL_DWORD                               ReceiveDescriptorHead;
 
-    VOL_DWORD                               __Reserved6;
+    VOL_DWORD                               __Reserved1;
 
     // 0x2818 - RW
     VOL_DWORD                               ReceiveDescriptorTail;
 
-    VOL_DWORD                               __Reserved7;
+    VOL_DWORD                               __Reserved2;
 
-    // 0x2820 - RW
+    // 0x2820 - RW, only in the registers of queue 0, used by both queues
     VOL_DWORD                               ReceiveInterruptRelativeDelayTimer;
 
-    VOL_DWORD                               __Reserved8;
+    VOL_DWORD                               __Reserved3;
 
-    VOL_DWORD                               __Reserved9;
+    VOL_DWORD                               __Reserved4;
 
-    // 0x282C - RW
+    // 0x282C - RW, only in the registers of queue 0, used by both queues
     VOL_DWORD                               ReceiveInterruptAbsoluteDelayTimer;
 
-    BYTE                                    __Reserved10[0xFD0];
+    BYTE                                    __Reserved5[0xD0];
+} ETH_RX_QUEUE_REGS, *PETH_RX_QUEUE_REGS;
+STATIC_ASSERT(sizeof(ETH_RX_QUEUE_REGS) == ETH_QUEUE_REGISTERS_SIZE);
 
+typedef struct _ETH_TX_QUEUE_REGS
+{
     // 0x3800 - RW
     VOL_DWORD                               TransmitDescriptorAddressLow;
 
@@ -146,32 +126,113 @@ typedef struct _ETH_INTERNAL_REGS
     // 0x3808 - RW
     VOL_DWORD                               TransmitDescriptorLength;
 
-    VOL_DWORD                               __Reserved11;
+    VOL_DWORD                               __Reserved0;
 
     // 0x3810 - RW
     VOL_DWORD                               TransmitDescriptorHead;
 
-    VOL_DWORD                               __Reserved12;
+    VOL_DWORD                               __Reserved1;
 
     // 0x3818 - RW
     VOL_DWORD                               TransmitDescriptorTail;
 
-    VOL_DWORD                               __Reserved13;
+    VOL_DWORD                               __Reserved2;
 
-    // 0x3820 - RW
+    // 0x3820 - RW, only in the registers of queue 0, used by both queues
     VOL_DWORD                               TransmitInterruptRelativeDelayTimer;
 
-    VOL_DWORD                               __Reserved14[2];
+    VOL_DWORD                               __Reserved3[2];
 
-    // 0x382C - RW
+    // 0x382C - RW, only in the registers of queue 0, used by both queues
     VOL_DWORD                               TransmitInterruptAbsoluteDelayTimer;
 
-    BYTE                                    __Reserved15[0x17D8];
+    BYTE                                    __Reserved4[0x10];
+
+    // 0x3840 - RW
+    VOL_DWORD                               TransmitArbitrationCount;
+
+    BYTE                                    __Reserved5[0xBC];
+} ETH_TX_QUEUE_REGS, *PETH_TX_QUEUE_REGS;
+STATIC_ASSERT(sizeof(ETH_TX_QUEUE_REGS) == ETH_QUEUE_REGISTERS_SIZE);
+
+typedef struct _ETH_INTERNAL_REGS
+{
+    // 0x0 - 0x4 - RW
+    VOL_DWORD                               DeviceControlRegister[2];
+
+    // 0x8 - R
+    VOL_DWORD                               DeviceStatusRegister;
+
+    // 0xC
+    VOL_DWORD                               __Reserved0;
+
+    // 0x10 - RW/R0
+    VOL_DWORD                               EepromFlashControlRegister;
+
+    // 0x14 - RW
+    VOL_DWORD                               EepromReadRegister;
+
+    // 0x18 - RW
+    VOL_DWORD                               ExtendedDeviceControlRegister;
+
+    BYTE                                    __Reserved1[0xA4];
+
+    // 0xC0 - RC/WC
+    VOL_DWORD                               InterruptCauseReadRegister;
+
+    // 0xC4 - RW
+    VOL_DWORD                               InterruptThrottlingRegister;
+
+    BYTE                                    __Reserved99[0x8];
+
+    // 0xD0 - RW
+    VOL_DWORD                               InterruptMaskSetRegister;
+
+    VOL_DWORD                               __Reserved98;
+
+    // 0xD8 - W
+    VOL_DWORD                               InterruptMaskClearRegister;
+
+    // 0xDC - RW
+    VOL_DWORD                               InterruptAutoClearRegister;
+
+    // 0xE0 - RW
+    VOL_DWORD                               InterruptAutoMaskRegister;
+
+    // 0xE4 - RW
+    VOL_DWORD                               InterruptVectorAllocationRegister;
+
+    BYTE                                    __Reserved2[0x18];
+
+    // 0x100 - RW
+    VOL_DWORD                               ReceiveControlRegister;
+
+    BYTE                                    __Reserved3[0x2FC];
+
+    // 0x400 - RW
+    VOL_DWORD                               TransmitControlRegister;
+
+    BYTE                                    __Reserved4[0x23FC];
+
+    // 0x2800 - 0x29FF
+    ETH_RX_QUEUE_REGS                       RxQueues[ETH_NO_OF_QUEUES];
+
+    BYTE                                    __Reserved10[0xE00];
+
+    // 0x3800 - 0x39FF
+    ETH_TX_QUEUE_REGS                       TxQueues[ETH_NO_OF_QUEUES];
+
+    BYTE                                    __Reserved15[0x1608];
 
     // 0x5008 - RW
     VOL_DWORD                               ReceiveFilterControlRegister;
 
-    BYTE                                    __Reserved16[0x82C];
+    BYTE                                    __Reserved16[0x80C];
+
+    // 0x5818 - RW
+    VOL_DWORD                               MultipleRxQueuesCommandRegister;
+
+    BYTE                                    __Reserved18[0x1C];
 
     // 0x5838 - RW
     VOL_DWORD                               IpAddressValid;
@@ -181,15 +242,30 @@ typedef struct _ETH_INTERNAL_REGS
 
     // 0x5840
     VOL_DWORD                               IpAddress0;
+
+    BYTE                                    __Reserved19[0x3BC];
+
+    // 0x5C00 - 0x5C7C - RW
+    VOL_DWORD                               RedirectionTable[ETH_RSS_REDIRECTION_TABLE_REGISTERS];
+
+    // 0x5C80 - 0x5CA4 - RW
+    VOL_DWORD                               RssRandomKey[ETH_RSS_KEY_REGISTERS];
 } ETH_INTERNAL_REGS, *PETH_INTERNAL_REGS;
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ExtendedDeviceControlRegister) == ETH_OFFSET_CTRL_EXT);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,InterruptCauseReadRegister) == ETH_OFFSET_ICR);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,InterruptThrottlingRegister) == ETH_OFFSET_ITR);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,InterruptMaskSetRegister) == ETH_OFFSET_IMS);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,InterruptAutoClearRegister) == ETH_OFFSET_EIAC);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,InterruptVectorAllocationRegister) == ETH_OFFSET_IVAR);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ReceiveControlRegister) == ETH_OFFSET_RCTL);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,TransmitControlRegister) == ETH_OFFSET_TCTL);
-STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ReceiveDescriptorAddressLow) == ETH_OFFSET_RDBAL);
-STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,TransmitDescriptorAddressLow) == ETH_OFFSET_TDBAL);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,RxQueues) == ETH_OFFSET_RDBAL);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,TxQueues) == ETH_OFFSET_TDBAL);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,ReceiveFilterControlRegister) == ETH_OFFSET_RFCTL);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,MultipleRxQueuesCommandRegister) == ETH_OFFSET_MRQC);
 STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,IpAddressValid) == ETH_OFFSET_TO_IP_ADDRESS_VALID );
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,RedirectionTable) == ETH_OFFSET_RETA);
+STATIC_ASSERT(FIELD_OFFSET(ETH_INTERNAL_REGS,RssRandomKey) == ETH_OFFSET_RSSRK);
 STATIC_ASSERT(sizeof(ETH_INTERNAL_REGS) <= ETH_INTERNAL_REGISTER_SIZE);
 
 typedef struct _RECEIVE_DESCRIPTOR_SHADOW
@@ -314,15 +390,46 @@ typedef struct _RX_DATA
 {
     PRECEIVE_DESCRIPTOR                     ReceiveBuffer;
     ETH_BUFFERS                             Buffers;
+
+    // the ISR masks the RX interrupts and signals the event, the poll thread
+    // then drains the ring in batches of at most ETH_RX_POLL_BUDGET frames
+    // and unmasks the interrupts only once the ring is empty
+    EX_EVENT                                PollEvent;
+    struct _THREAD*                         PollThread;
+
+    // the poll thread receives the queue as its context
+    struct _ETH_DEVICE*                     Device;
+    BYTE                                    QueueIndex;
+
+    QWORD                                   NumberOfPolls;
+    QWORD                                   NumberOfExhaustedBudgets;
 } RX_DATA, *PRX_DATA;
 
 typedef struct _TX_DATA
 {
     PTRANSMIT_DESCRIPTOR                    TransmitBuffer;
     ETH_BUFFERS                             Buffers;
+
+    // first descriptor handed to the device which was not yet reported as
+    // completed to the port driver
+    WORD                                    CleanDescriptor;
     LOCK                                    TxInterruptLock;
 } TX_DATA, *PTX_DATA;
 
+typedef struct _ETH_INTERRUPT_MODERATION
+{
+    NETWORK_INTERRUPT_PROFILE               Profile;
+
+    // traffic seen since the previous interrupt, accumulated by the RX poll
+    // thread and by the send path and consumed by the ISR which decides if
+    // the profile must change
+    volatile DWORD                          Packets;
+    volatile DWORD                          Bytes;
+
+    QWORD                                   NumberOfInterrupts;
+    QWORD                                   NumberOfProfileChanges;
+} ETH_INTERRUPT_MODERATION, *PETH_INTERRUPT_MODERATION;
+
 #pragma warning(pop)
 
 typedef struct _ETH_DEVICE
@@ -333,8 +440,15 @@ typedef struct _ETH_DEVICE
     volatile DWORD*                         Flash;
     volatile DWORD*                         MsiX;
 
-    RX_DATA                                 RxData;
-    TX_DATA                                 TxData;
+    BYTE                                    NumberOfQueues;
+    RX_DATA                                 RxQueues[ETH_NO_OF_QUEUES];
+    TX_DATA                                 TxQueues[ETH_NO_OF_QUEUES];
+
+    // if TRUE each queue has its own MSI-X vector and the link changes are
+    // reported on a separate vector, else the single interrupt serves all
+    BOOLEAN                                 MsiXEnabled;
+
+    ETH_INTERRUPT_MODERATION                InterruptModeration;
 } ETH_DEVICE, *PETH_DEVICE;
 
 // General
@@ -354,6 +468,17 @@ EthGetDeviceStatusRegister(
     IN      PETH_DEVICE         Device
     );
 
+EXTENDED_DEVICE_CONTROL_REGISTER
+EthGetExtendedDeviceControlRegister(
+    IN      PETH_DEVICE         Device
+    );
+
+void
+EthSetExtendedDeviceControlRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      EXTENDED_DEVICE_CONTROL_REGISTER    ControlRegister
+    );
+
 // Interrupt
 INT_CAUSE_READ_REGISTER
 EthGetInterruptReason(
@@ -377,6 +502,37 @@ EthSetInterruptMaskClearRegister(
     IN      INT_MASK_CLEAR_REGISTER     Mask
     );
 
+// 0 means the interrupts are not throttled
+DWORD
+EthGetInterruptThrottlingRate(
+    IN      PETH_DEVICE                 Device
+    );
+
+void
+EthSetInterruptThrottlingRate(
+    IN      PETH_DEVICE                 Device,
+    IN      DWORD                       InterruptsPerSecond
+    );
+
+// Mask is a combination of ETH_INT_QUEUE_MASK values
+void
+EthSetInterruptAutoClearRegister(
+    IN      PETH_DEVICE                 Device,
+    IN      DWORD                       Mask
+    );
+
+void
+EthSetInterruptAutoMaskRegister(
+    IN      PETH_DEVICE                 Device,
+    IN      DWORD                       Mask
+    );
+
+void
+EthSetInterruptVectorAllocationRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      INT_VECTOR_ALLOCATION_REGISTER      Allocation
+    );
+
 // Receive
 DWORD
 EthGetRxControlRegister(
@@ -395,37 +551,63 @@ EthSetRxFilterControlRegister(
     IN      RECEIVE_FILTER_CONTROL_REGISTER     FilterRegister
     );
 
+void
+EthSetRxMultipleQueuesCommandRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      MULTIPLE_RX_QUEUES_COMMAND_REGISTER CommandRegister
+    );
+
+void
+EthSetRxRedirectionTableRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      DWORD                               Index,
+    IN      REDIRECTION_TABLE_REGISTER          Entries
+    );
+
+void
+EthSetRxRssKey(
+    IN      PETH_DEVICE                         Device,
+    IN_READS_BYTES(ETH_RSS_KEY_SIZE)
+            PBYTE                               Key
+    );
+
 void
 EthSetRxRingBufferAddress(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      PHYSICAL_ADDRESS    Address
     );
 
 void
 EthSetRxRingBufferSize(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      DWORD               Size
     );
 
 WORD
 EthGetRxHead(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
     );
 
 void
 EthSetRxHead(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      WORD                Index
     );
 
 WORD
 EthGetRxTail(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
     );
 
 void
 EthSetRxTail(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      WORD                Index
     );
 
@@ -464,37 +646,56 @@ EthSetTxControlRegister(
     IN      TRANSMIT_CONTROL_REGISTER   ControlRegister
     );
 
+TRANSMIT_ARBITRATION_COUNT
+EthGetTxArbitrationCount(
+    IN      PETH_DEVICE                 Device,
+    IN      BYTE                        QueueIndex
+    );
+
+void
+EthSetTxArbitrationCount(
+    IN      PETH_DEVICE                 Device,
+    IN      BYTE                        QueueIndex,
+    IN      TRANSMIT_ARBITRATION_COUNT  ArbitrationCount
+    );
+
 void
 EthSetTxRingBufferAddress(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      PHYSICAL_ADDRESS    Address
     );
 
 void
 EthSetTxRingBufferSize(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      DWORD               Size
     );
 
 WORD
 EthGetTxHead(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
     );
 
 void
 EthSetTxHead(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      WORD                Index
     );
 
 WORD
 EthGetTxTail(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
     );
 
 void
 EthSetTxTail(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      WORD                Index
     );
 
@@ -4,9 +4,11 @@
 #include "network_port.h"
 
 static FUNC_NetworkMiniportInitializeDevice     _Eth82574LInitializeMiniport;
-static FUNC_NetworkMiniportSendBuffer           _Eth82574LSendBuffer;
+static FUNC_NetworkMiniportSendBuffers          _Eth82574LSendBuffers;
 static FUNC_NetworkMiniportInterruptHandler     _Eth82574LReceiveInterrupt;
+static FUNC_NetworkMiniportQueueInterruptHandler    _Eth82574LQueueInterrupt;
 static FUNC_NetworkMiniportChangeDeviceStatus   _Eth82574LChangeDeviceStatus;
+static FUNC_NetworkMiniportGetInterruptModeration   _Eth82574LGetInterruptModeration;
 
 __forceinline
 void
@@ -67,6 +69,7 @@ STATUS
     memzero(&registration, sizeof(MINIPORT_REGISTRATION));
 
     registration.DeviceContextSize = sizeof(ETH_DEVICE);
+    registration.NumberOfQueues = ETH_NO_OF_QUEUES;
 
     registration.RxBuffers.BufferSize = ETH_BUFFER_SIZE;
     registration.RxBuffers.DescriptorSize = ETH_DESCRIPTOR_SIZE;
@@ -83,9 +86,11 @@ STATUS
 
     registration.MiniportFunctions.MiniportInitializeDevice = _Eth82574LInitializeMiniport;
     registration.MiniportFunctions.MiniportUninitializeDevice = NULL;
-    registration.MiniportFunctions.MiniportSendBuffer = _Eth82574LSendBuffer;
+    registration.MiniportFunctions.MiniportSendBuffers = _Eth82574LSendBuffers;
     registration.MiniportFunctions.MiniportInterruptHandler = _Eth82574LReceiveInterrupt;
     registration.MiniportFunctions.MiniportChangeDeviceStatus = _Eth82574LChangeDeviceStatus;
+    registration.MiniportFunctions.MiniportGetInterruptModeration = _Eth82574LGetInterruptModeration;
+    registration.MiniportFunctions.MiniportQueueInterruptHandler = _Eth82574LQueueInterrupt;
 
     // if we don't have any devices or we haven't managed to actually initialize
     // any device there is no reason for the driver to remain 'loaded' =>
@@ -113,20 +118,13 @@ STATUS
 {
     STATUS status;
     PETH_DEVICE pEthDevice;
+    BYTE i;
 
     ASSERT( NULL != MiniportDevice );
     ASSERT( NULL != MiniportInitialization );
     ASSERT( NULL != MiniportInitialization->PciBar );
-
-    ASSERT( ETH_NO_OF_RX_DESCS == MiniportInitialization->RxBuffers.NumberOfBuffers );
-    ASSERT( NULL != MiniportInitialization->RxBuffers.Buffers );
-    ASSERT( NULL != MiniportInitialization->RxBuffers.RingBuffer );
-    ASSERT( ETH_BUFFER_SIZE == MiniportInitialization->RxBuffers.BufferSize );
-
-    ASSERT(ETH_NO_OF_TX_DESCS == MiniportInitialization->TxBuffers.NumberOfBuffers);
-    ASSERT(NULL != MiniportInitialization->TxBuffers.Buffers);
-    ASSERT(NULL != MiniportInitialization->TxBuffers.RingBuffer);
-    ASSERT( ETH_BUFFER_SIZE == MiniportInitialization->TxBuffers.BufferSize );
+    ASSERT( 0 != MiniportInitialization->NumberOfQueues );
+    ASSERT( MiniportInitialization->NumberOfQueues <= ETH_NO_OF_QUEUES );
 
     LOG_FUNC_START;
 
@@ -136,11 +134,27 @@ STATUS
     pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
     ASSERT( NULL != pEthDevice );
 
-    _EthInitializeBuffers(&MiniportInitialization->RxBuffers, &pEthDevice->RxData.Buffers, FALSE );
-    pEthDevice->RxData.ReceiveBuffer = MiniportInitialization->RxBuffers.RingBuffer;
+    pEthDevice->NumberOfQueues = MiniportInitialization->NumberOfQueues;
+    pEthDevice->MsiXEnabled = MiniportInitialization->MsiXEnabled;
+
+    for (i = 0; i < pEthDevice->NumberOfQueues; ++i)
+    {
+        ASSERT( ETH_NO_OF_RX_DESCS == MiniportInitialization->RxBuffers[i].NumberOfBuffers );
+        ASSERT( NULL != MiniportInitialization->RxBuffers[i].Buffers );
+        ASSERT( NULL != MiniportInitialization->RxBuffers[i].RingBuffer );
+        ASSERT( ETH_BUFFER_SIZE == MiniportInitialization->RxBuffers[i].BufferSize );
+
+        ASSERT( ETH_NO_OF_TX_DESCS == MiniportInitialization->TxBuffers[i].NumberOfBuffers );
+        ASSERT( NULL != MiniportInitialization->TxBuffers[i].Buffers );
+        ASSERT( NULL != MiniportInitialization->TxBuffers[i].RingBuffer );
+        ASSERT( ETH_BUFFER_SIZE == MiniportInitialization->TxBuffers[i].BufferSize );
 
-    _EthInitializeBuffers(&MiniportInitialization->TxBuffers, &pEthDevice->TxData.Buffers, TRUE );
-    pEthDevice->TxData.TransmitBuffer = MiniportInitialization->TxBuffers.RingBuffer;
+        _EthInitializeBuffers(&MiniportInitialization->RxBuffers[i], &pEthDevice->RxQueues[i].Buffers, FALSE );
+        pEthDevice->RxQueues[i].ReceiveBuffer = MiniportInitialization->RxBuffers[i].RingBuffer;
+
+        _EthInitializeBuffers(&MiniportInitialization->TxBuffers[i], &pEthDevice->TxQueues[i].Buffers, TRUE );
+        pEthDevice->TxQueues[i].TransmitBuffer = MiniportInitialization->TxBuffers[i].RingBuffer;
+    }
 
     pEthDevice->MiniportDevice = MiniportDevice;
 
@@ -158,10 +172,13 @@ STATUS
 
 static
 STATUS
-(__cdecl _Eth82574LSendBuffer)(
+(__cdecl _Eth82574LSendBuffers)(
     IN  PMINIPORT_DEVICE            MiniportDevice,
-    IN  WORD                        DescriptorIndex,
-    IN  WORD                        Length
+    IN  BYTE                        QueueIndex,
+    IN  WORD                        FirstDescriptorIndex,
+    IN  WORD                        NumberOfBuffers,
+    IN_READS(NumberOfBuffers)
+        WORD*                       Lengths
     )
 {
     PETH_DEVICE pEthDevice;
@@ -171,7 +188,7 @@ STATUS
     pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
     ASSERT(NULL != pEthDevice);
 
-    return EthSendFrame(pEthDevice, DescriptorIndex, Length);
+    return EthSendFrames(pEthDevice, QueueIndex, FirstDescriptorIndex, NumberOfBuffers, Lengths);
 }
 
 static
@@ -190,6 +207,23 @@ BOOLEAN
     return EthHandleInterrupt(pEthDevice);
 }
 
+static
+BOOLEAN
+(__cdecl _Eth82574LQueueInterrupt)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  BYTE                        QueueIndex
+    )
+{
+    PETH_DEVICE pEthDevice;
+
+    ASSERT( NULL != MiniportDevice );
+
+    pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pEthDevice );
+
+    return EthHandleQueueInterrupt(pEthDevice, QueueIndex);
+}
+
 static
 void
 (__cdecl _Eth82574LChangeDeviceStatus)(
@@ -206,4 +240,22 @@ void
     ASSERT(NULL != pEthDevice);
 
     EthChangeDeviceStatus(pEthDevice, DeviceStatus );
+}
+
+static
+void
+(__cdecl _Eth82574LGetInterruptModeration)(
+    IN  PMINIPORT_DEVICE                MiniportDevice,
+    OUT PNETWORK_INTERRUPT_MODERATION   InterruptModeration
+    )
+{
+    PETH_DEVICE pEthDevice;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != InterruptModeration );
+
+    pEthDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT(NULL != pEthDevice);
+
+    EthGetInterruptModeration(pEthDevice, InterruptModeration);
 }
\ No newline at end of file
@@ -3,6 +3,49 @@
 #include "eth_eeprom.h"
 #include "network_port.h"
 
+typedef struct _ETH_MODERATION_SETTINGS
+{
+    DWORD                   MaximumInterruptsPerSecond;
+
+    WORD                    RxRelativeDelay;
+    WORD                    RxAbsoluteDelay;
+    WORD                    TxRelativeDelay;
+    WORD                    TxAbsoluteDelay;
+} ETH_MODERATION_SETTINGS, *PETH_MODERATION_SETTINGS;
+
+// delays are in microseconds
+static const ETH_MODERATION_SETTINGS ETH_MODERATION_PROFILES[NetworkInterruptProfileReserved] =
+{
+    // NetworkInterruptProfileLowLatency
+    { 70000,    0,      0,      8,      32  },
+
+    // NetworkInterruptProfileBalanced
+    { 20000,    32,     128,    32,     128 },
+
+    // NetworkInterruptProfileBulk
+    { 4000,     128,    512,    128,    512 }
+};
+
+// thresholds used to decide the interrupt profile from the traffic seen
+// between two consecutive interrupts
+#define ETH_MODERATION_BULK_BYTES                   10000
+#define ETH_MODERATION_BULK_STAY_BYTES              6000
+#define ETH_MODERATION_BULK_PACKETS                 35
+#define ETH_MODERATION_BULK_BYTES_PER_PACKET        1200
+#define ETH_MODERATION_LOW_LATENCY_BYTES            1500
+#define ETH_MODERATION_LOW_LATENCY_PACKETS          4
+
+// the key from the RSS verification suite, any key spreads the flows but
+// this one makes the hashes easy to check
+static const BYTE ETH_RSS_KEY[ETH_RSS_KEY_SIZE] =
+{
+    0x6D, 0x5A, 0x56, 0xDA, 0x25, 0x5B, 0x0E, 0xC2,
+    0x41, 0x67, 0x25, 0x3D, 0x43, 0xA3, 0x8F, 0xB0,
+    0xD0, 0xCA, 0x2B, 0xCB, 0xAE, 0x7B, 0x30, 0xB4,
+    0x77, 0xCB, 0x2D, 0xA3, 0x80, 0x30, 0xF2, 0x0C,
+    0x6A, 0x42, 0xB7, 0x3B, 0xBE, 0xAC, 0x01, 0xFA
+};
+
 __forceinline
 static
 void
@@ -37,6 +80,64 @@ _EthChangeTxStatus(
     EthSetTxControlRegister(Device, ctrlRegister);
 }
 
+__forceinline
+static
+void
+_EthChangeRxInterruptStatus(
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
+    IN      BOOLEAN             Enable
+    )
+{
+    INT_MASK_SET_REGISTER intSetMaskReg;
+    INT_MASK_CLEAR_REGISTER intClearMaskReg;
+
+    ASSERT( NULL != Device );
+    ASSERT( QueueIndex < Device->NumberOfQueues );
+
+    if (Device->MsiXEnabled)
+    {
+        // each queue has its own causes, the TX cause of the queue shares
+        // the vector with the RX one so it is masked and unmasked with it
+        if (Enable)
+        {
+            intSetMaskReg.Raw = ETH_INT_QUEUE_MASK(QueueIndex);
+            EthSetInterruptMaskSetRegister(Device, intSetMaskReg);
+        }
+        else
+        {
+            intClearMaskReg.Raw = ETH_INT_QUEUE_MASK(QueueIndex);
+            EthSetInterruptMaskClearRegister(Device, intClearMaskReg);
+        }
+
+        return;
+    }
+
+    // without MSI-X the RX causes are shared by all the queues
+    if (Enable)
+    {
+        intSetMaskReg.Raw = 0;
+
+        intSetMaskReg.RdMinimumThresholdHit = TRUE;
+        intSetMaskReg.ReceiverOverrun = TRUE;
+        intSetMaskReg.ReceiverTimerInterrupt = TRUE;
+
+        EthSetInterruptMaskSetRegister(Device, intSetMaskReg);
+    }
+    else
+    {
+        intClearMaskReg.Raw = 0;
+
+        intClearMaskReg.RdMinimumThresholdHit = TRUE;
+        intClearMaskReg.ReceiverOverrun = TRUE;
+        intClearMaskReg.ReceiverTimerInterrupt = TRUE;
+
+        EthSetInterruptMaskClearRegister(Device, intClearMaskReg);
+    }
+}
+
+static FUNC_ThreadStart     _EthRxPollFunction;
+
 static
 PTR_SUCCESS
 PVOID
@@ -64,12 +165,25 @@ _EthTxInit(
     IN      PETH_DEVICE         Device
     );
 
+static
+void
+_EthRssInit(
+    IN      PETH_DEVICE         Device
+    );
+
 static
 STATUS
 _EthInterruptInit(
     IN      PETH_DEVICE         Device
     );
 
+static
+void
+_EthMsiXInit(
+    IN      PETH_DEVICE         Device,
+    OUT     PINT_MASK_SET_REGISTER  InterruptMask
+    );
+
 static
 void
 _EthDeviceControlsInit(
@@ -78,10 +192,31 @@ _EthDeviceControlsInit(
 
 static
 void
-_EthSignalTxQueueFullIfNecessary(
+_EthApplyInterruptProfile(
+    IN      PETH_DEVICE                 Device,
+    IN      NETWORK_INTERRUPT_PROFILE   Profile
+    );
+
+static
+void
+_EthUpdateInterruptModeration(
     IN      PETH_DEVICE         Device
     );
 
+static
+WORD
+_EthReclaimTxDescriptors(
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
+    );
+
+static
+void
+_EthCompleteTxDescriptors(
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
+    );
+
 STATUS
 EthInitializeDevice(
     IN_READS(ETH_NO_OF_BARS_USED)   PPCI_BAR        Bars,
@@ -207,38 +342,51 @@ _No_competing_thread_
 STATUS
 EthReceiveFrame(
     IN                              PETH_DEVICE     Device,
-    IN_OPT                          WORD            MaximumNumberOfFrames
+    IN                              BYTE            QueueIndex,
+    IN_OPT                          WORD            MaximumNumberOfFrames,
+    OUT_OPT                         WORD*           NumberOfFramesReceived
     )
 {
     STATUS status;
     WORD curRxIndex;
     WORD prevRxIndex;
     WORD noOfFramesReceived;
+    DWORD noOfBytesReceived;
+    PHYSICAL_ADDRESS bufferAddress;
+    PRX_DATA pRxData;
 
     ASSERT( NULL != Device );
+    ASSERT( QueueIndex < Device->NumberOfQueues );
 
     status = STATUS_SUCCESS;
-    curRxIndex = Device->RxData.Buffers.CurrentDescriptor;
-    ASSERT( curRxIndex < Device->RxData.Buffers.NumberOfDescriptors );
+    pRxData = &Device->RxQueues[QueueIndex];
+    curRxIndex = pRxData->Buffers.CurrentDescriptor;
+    ASSERT( curRxIndex < pRxData->Buffers.NumberOfDescriptors );
 
+    prevRxIndex = curRxIndex;
     noOfFramesReceived = 0;
+    noOfBytesReceived = 0;
 
-    while (Device->RxData.ReceiveBuffer[curRxIndex].Status.DescriptorDone)
+    while (pRxData->ReceiveBuffer[curRxIndex].Status.DescriptorDone)
     {
-        WORD len = Device->RxData.ReceiveBuffer[curRxIndex].Length;
+        WORD len = pRxData->ReceiveBuffer[curRxIndex].Length;
 
-        ASSERT( len <= Device->RxData.Buffers.BufferSize );
-        ASSERT( 1 == Device->RxData.ReceiveBuffer[curRxIndex].Status.EOP );
+        ASSERT( len <= pRxData->Buffers.BufferSize );
+        ASSERT( 1 == pRxData->ReceiveBuffer[curRxIndex].Status.EOP );
 
-        status = NetworkPortNotifyReceiveBuffer(Device->MiniportDevice, curRxIndex, len );
+        status = NetworkPortNotifyReceiveBuffer(Device->MiniportDevice, QueueIndex, curRxIndex, len, &bufferAddress );
         ASSERT( SUCCEEDED(status));
 
-        Device->RxData.ReceiveBuffer[curRxIndex].Status.DescriptorDone = 0;
+        // the received buffer was loaned to the port driver, re-arm the
+        // descriptor with the buffer we got in exchange
+        pRxData->ReceiveBuffer[curRxIndex].BufferAddress = bufferAddress;
+
+        pRxData->ReceiveBuffer[curRxIndex].Status.DescriptorDone = 0;
         prevRxIndex = curRxIndex;
-        curRxIndex = (curRxIndex + 1) % Device->RxData.Buffers.NumberOfDescriptors;
-        EthSetRxTail(Device, prevRxIndex);
+        curRxIndex = (curRxIndex + 1) % pRxData->Buffers.NumberOfDescriptors;
 
         noOfFramesReceived = noOfFramesReceived + 1;
+        noOfBytesReceived = noOfBytesReceived + len;
 
         if (noOfFramesReceived == MaximumNumberOfFrames)
         {
@@ -246,48 +394,87 @@ EthReceiveFrame(
         }
     }
 
-    Device->RxData.Buffers.CurrentDescriptor = curRxIndex;
+    pRxData->Buffers.CurrentDescriptor = curRxIndex;
+
+    // all the descriptors re-armed in this pass are given back to the device
+    // with a single tail write
+    if (0 != noOfFramesReceived)
+    {
+        EthSetRxTail(Device, QueueIndex, prevRxIndex);
+
+        _InterlockedExchangeAdd(&Device->InterruptModeration.Packets, noOfFramesReceived);
+        _InterlockedExchangeAdd(&Device->InterruptModeration.Bytes, noOfBytesReceived);
+    }
+
+    if (NULL != NumberOfFramesReceived)
+    {
+        *NumberOfFramesReceived = noOfFramesReceived;
+    }
 
     return status;
 }
 
 _No_competing_thread_
 STATUS
-EthSendFrame(
+EthSendFrames(
     IN                              PETH_DEVICE     Device,
-    IN                              WORD            DescriptorIndex,
-    IN                              WORD            Length
+    IN                              BYTE            QueueIndex,
+    IN                              WORD            FirstDescriptorIndex,
+    IN                              WORD            NumberOfFrames,
+    IN_READS(NumberOfFrames)        WORD*           Lengths
     )
 {
     WORD curTxIndex;
+    WORD i;
+    DWORD noOfBytes;
     PTRANSMIT_DESCRIPTOR pDescriptor;
+    PTX_DATA pTxData;
 
     ASSERT( NULL != Device );
-    ASSERT( Length <= Device->TxData.Buffers.BufferSize );
+    ASSERT( QueueIndex < Device->NumberOfQueues );
+    ASSERT( 0 != NumberOfFrames );
+    ASSERT( NULL != Lengths );
+
+    pTxData = &Device->TxQueues[QueueIndex];
+    ASSERT( NumberOfFrames < pTxData->Buffers.NumberOfDescriptors );
 
-    curTxIndex = DescriptorIndex;
-    ASSERT( curTxIndex == Device->TxData.Buffers.CurrentDescriptor );
-    ASSERT( curTxIndex < Device->TxData.Buffers.NumberOfDescriptors );
-    pDescriptor = &Device->TxData.TransmitBuffer[curTxIndex];
-    ASSERT(pDescriptor->DescriptorDone);
+    curTxIndex = FirstDescriptorIndex;
+    ASSERT( curTxIndex == pTxData->Buffers.CurrentDescriptor );
+    ASSERT( curTxIndex < pTxData->Buffers.NumberOfDescriptors );
+    noOfBytes = 0;
 
-    pDescriptor->Command.DEXT = FALSE;
-    pDescriptor->Command.IC = FALSE;
-    pDescriptor->Command.IFCS = TRUE;
-    pDescriptor->Command.EOP = TRUE;
-    pDescriptor->Command.IDE = TRUE;
-    pDescriptor->Command.RS = TRUE;
-    pDescriptor->Command.VLE = FALSE;
+    for (i = 0; i < NumberOfFrames; ++i)
+    {
+        ASSERT( Lengths[i] <= pTxData->Buffers.BufferSize );
 
-    pDescriptor->DescriptorDone = 0;
-    pDescriptor->Length = Length;
+        pDescriptor = &pTxData->TransmitBuffer[curTxIndex];
+        ASSERT(pDescriptor->DescriptorDone);
 
-    curTxIndex = (curTxIndex + 1) % Device->TxData.Buffers.NumberOfDescriptors;
-    Device->TxData.Buffers.CurrentDescriptor = curTxIndex;
+        pDescriptor->Command.DEXT = FALSE;
+        pDescriptor->Command.IC = FALSE;
+        pDescriptor->Command.IFCS = TRUE;
+        pDescriptor->Command.EOP = TRUE;
+        pDescriptor->Command.IDE = TRUE;
+        pDescriptor->Command.RS = TRUE;
+        pDescriptor->Command.VLE = FALSE;
 
-    _EthSignalTxQueueFullIfNecessary(Device);
+        pDescriptor->DescriptorDone = 0;
+        pDescriptor->Length = Lengths[i];
+        noOfBytes = noOfBytes + Lengths[i];
 
-    EthSetTxTail(Device, curTxIndex);
+        curTxIndex = (curTxIndex + 1) % pTxData->Buffers.NumberOfDescriptors;
+    }
+
+    // the descriptors must be filled before _EthReclaimTxDescriptors can see
+    // them as in flight
+    _ReadWriteBarrier();
+    pTxData->Buffers.CurrentDescriptor = curTxIndex;
+
+    // a single doorbell for the whole vector
+    EthSetTxTail(Device, QueueIndex, curTxIndex);
+
+    _InterlockedExchangeAdd(&Device->InterruptModeration.Packets, NumberOfFrames);
+    _InterlockedExchangeAdd(&Device->InterruptModeration.Bytes, noOfBytes);
 
     return STATUS_SUCCESS;
 }
@@ -301,6 +488,7 @@ EthHandleInterrupt(
     INT_CAUSE_READ_REGISTER intReason;
     STATUS status;
     BOOLEAN bSolvedInterrupt;
+    BYTE i;
 
     ASSERT( NULL != Device );
 
@@ -311,33 +499,53 @@ EthHandleInterrupt(
     LOG_TRACE_COMP(LogComponentNetwork | LogComponentInterrupt,
                    "intReason: 0x%x on device 0x%X\n", intReason.Raw, Device);
 
+    if (Device->MsiXEnabled)
+    {
+        // this is the vector of the causes not mapped to a queue, it is not
+        // shared so there is no need to check IntAsserted
+        if (intReason.LinkStatusChange)
+        {
+            DEVICE_STATUS_REGISTER devStatus = EthGetDeviceStatusRegister(Device);
+
+            LOG("Link status is [%s]\n", devStatus.LinkUp ? "UP" : "DOWN" );
+
+            NetworkPortNotifyLinkStatusChange(Device->MiniportDevice,
+                                              (BOOLEAN) devStatus.LinkUp
+                                              );
+        }
+
+        return TRUE;
+    }
+
     // not our interrupt, sorry
     if (!intReason.IntAsserted)
     {
         return FALSE;
     }
 
-    if (intReason.RdMinimumThresholdHit || intReason.ReceiverTimerInterrupt)
+    _EthUpdateInterruptModeration(Device);
+
+    if (intReason.RdMinimumThresholdHit || intReason.ReceiverTimerInterrupt || intReason.ReceiverOverrun)
     {
-        status = EthReceiveFrame(Device, 0);
-        if (!SUCCEEDED(status))
+        // the frames are not processed in interrupt context, the RX interrupts
+        // remain masked until the poll threads empty the rings, we cannot know
+        // which of the queues received frames
+        _EthChangeRxInterruptStatus(Device, 0, FALSE);
+
+        for (i = 0; i < Device->NumberOfQueues; ++i)
         {
-            LOG_FUNC_ERROR("EthReceiveFrame", status);
-            return FALSE;
+            ExEventSignal(&Device->RxQueues[i].PollEvent);
         }
+
         bSolvedInterrupt = TRUE;
     }
 
     if (intReason.TdWrittenBack || intReason.TxQueueEmpty)
     {
-        INTR_STATE dummyState;
-
-        LockAcquire(&Device->TxData.TxInterruptLock, &dummyState );
-
-        // notify port driver we have free descriptors
-        NetworkPortNotifyTxDescriptorAvailable(Device->MiniportDevice);
-
-        LockRelease(&Device->TxData.TxInterruptLock, INTR_OFF );
+        for (i = 0; i < Device->NumberOfQueues; ++i)
+        {
+            _EthCompleteTxDescriptors(Device, i);
+        }
 
         bSolvedInterrupt = TRUE;
     }
@@ -358,6 +566,59 @@ EthHandleInterrupt(
     return bSolvedInterrupt;
 }
 
+BOOLEAN
+EthHandleQueueInterrupt(
+    IN                              PETH_DEVICE     Device,
+    IN                              BYTE            QueueIndex
+    )
+{
+    ASSERT( NULL != Device );
+    ASSERT( Device->MsiXEnabled );
+    ASSERT( QueueIndex < Device->NumberOfQueues );
+
+    LOG_TRACE_COMP(LogComponentNetwork | LogComponentInterrupt,
+                   "Interrupt for queue %u on device 0x%X\n", QueueIndex, Device);
+
+    // the throttling rate is shared by all the queues, the first queue
+    // decides it for all of them
+    if (0 == QueueIndex)
+    {
+        _EthUpdateInterruptModeration(Device);
+    }
+
+    _EthCompleteTxDescriptors(Device, QueueIndex);
+
+    // the causes of the queue were auto-masked when the message was sent, the
+    // poll thread unmasks them once the ring is empty
+    ExEventSignal(&Device->RxQueues[QueueIndex].PollEvent);
+
+    return TRUE;
+}
+
+void
+EthGetInterruptModeration(
+    IN                              PETH_DEVICE                     Device,
+    OUT                             PNETWORK_INTERRUPT_MODERATION   InterruptModeration
+    )
+{
+    ASSERT( NULL != Device );
+    ASSERT( NULL != InterruptModeration );
+
+    InterruptModeration->Supported = TRUE;
+    InterruptModeration->Adaptive = TRUE;
+    InterruptModeration->Profile = Device->InterruptModeration.Profile;
+
+    InterruptModeration->MaximumInterruptsPerSecond = EthGetInterruptThrottlingRate(Device);
+
+    InterruptModeration->RxRelativeDelayUs = EthGetRxInterruptRelativeDelay(Device);
+    InterruptModeration->RxAbsoluteDelayUs = EthGetRxInterruptAbsoluteDelay(Device);
+    InterruptModeration->TxRelativeDelayUs = EthGetTxInterruptRelativeDelay(Device);
+    InterruptModeration->TxAbsoluteDelayUs = EthGetTxInterruptAbsoluteDelay(Device);
+
+    InterruptModeration->NumberOfInterrupts = Device->InterruptModeration.NumberOfInterrupts;
+    InterruptModeration->NumberOfProfileChanges = Device->InterruptModeration.NumberOfProfileChanges;
+}
+
 _No_competing_thread_
 void
 EthChangeDeviceStatus(
@@ -468,6 +729,8 @@ _EthRxInit(
     PHYSICAL_ADDRESS ringBufferPa;
     RECEIVE_CONTROL_REGISTER ctrlRegister;
     RECEIVE_FILTER_CONTROL_REGISTER filterRegister;
+    PRX_DATA pRxData;
+    BYTE i;
 
     ASSERT(NULL != Device);
 
@@ -478,25 +741,57 @@ _EthRxInit(
     ctrlRegister.Raw = 0;
     filterRegister.Raw = 0;
 
-    ringBufferPa = IoGetPhysicalAddress((PVOID)Device->RxData.ReceiveBuffer);
-    if (NULL == ringBufferPa)
+    for (i = 0; i < Device->NumberOfQueues; ++i)
     {
-        LOG_ERROR("IoGetPhysicalAddress cannot map VA 0x%X\n", Device->RxData.ReceiveBuffer);
-        return STATUS_MEMORY_CANNOT_BE_MAPPED;
-    }
+        pRxData = &Device->RxQueues[i];
 
-    LOG_TRACE_NETWORK("Ring buffer PA: 0x%X\n", ringBufferPa );
+        pRxData->Device = Device;
+        pRxData->QueueIndex = i;
 
-    EthSetRxRingBufferAddress(Device, ringBufferPa);
+        status = ExEventInit(&pRxData->PollEvent, ExEventTypeSynchronization, FALSE);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ExEventInit", status);
+            return status;
+        }
 
-    EthSetRxRingBufferSize(Device, Device->RxData.Buffers.NumberOfDescriptors * ETH_DESCRIPTOR_SIZE );
+        status = ThreadCreate("RX poll thread",
+                              ThreadPriorityDefault,
+                              _EthRxPollFunction,
+                              pRxData,
+                              &pRxData->PollThread
+                              );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ThreadCreate", status);
+            return status;
+        }
 
-    EthSetRxHead(Device, 0 );
+        ringBufferPa = IoGetPhysicalAddress((PVOID)pRxData->ReceiveBuffer);
+        if (NULL == ringBufferPa)
+        {
+            LOG_ERROR("IoGetPhysicalAddress cannot map VA 0x%X\n", pRxData->ReceiveBuffer);
+            return STATUS_MEMORY_CANNOT_BE_MAPPED;
+        }
+
+        LOG_TRACE_NETWORK("Ring buffer %u PA: 0x%X\n", i, ringBufferPa );
+
+        EthSetRxRingBufferAddress(Device, i, ringBufferPa);
+
+        EthSetRxRingBufferSize(Device, i, pRxData->Buffers.NumberOfDescriptors * ETH_DESCRIPTOR_SIZE );
 
-    // this is a HACK to simplify LIFE
-    // simply state that the last descriptor is not available
-    // and make it available only after the first packet is processed
-    EthSetRxTail(Device, Device->RxData.Buffers.NumberOfDescriptors - 1);
+        EthSetRxHead(Device, i, 0 );
+
+        // this is a HACK to simplify LIFE
+        // simply state that the last descriptor is not available
+        // and make it available only after the first packet is processed
+        EthSetRxTail(Device, i, pRxData->Buffers.NumberOfDescriptors - 1);
+    }
+
+    if (Device->NumberOfQueues > 1)
+    {
+        _EthRssInit(Device);
+    }
 
     // Enable RX
     ctrlRegister.Enable = TRUE;
@@ -521,13 +816,6 @@ _EthRxInit(
 
     EthSetRxFilterControlRegister( Device, filterRegister );
 
-    EthSetRxInterruptRelativeDelay( Device, 10 * MS_IN_US );
-    EthSetRxInterruptAbsoluteDelay( Device, 64 * MS_IN_US );
-
-    LOG_TRACE_NETWORK("Relative delay: %u, absolute delay: %u\n",
-         EthGetRxInterruptRelativeDelay(Device),
-         EthGetRxInterruptAbsoluteDelay(Device));
-
     LOG_FUNC_END;
 
     return status;
@@ -542,6 +830,9 @@ _EthTxInit(
     STATUS status;
     PHYSICAL_ADDRESS ringBufferPa;
     TRANSMIT_CONTROL_REGISTER ctrlRegister;
+    TRANSMIT_ARBITRATION_COUNT arbitration;
+    PTX_DATA pTxData;
+    BYTE i;
 
     ASSERT( NULL != Device );
 
@@ -551,22 +842,34 @@ _EthTxInit(
     ctrlRegister.Raw = 0;
     ringBufferPa = NULL;
 
-    ringBufferPa = IoGetPhysicalAddress((PVOID)Device->TxData.TransmitBuffer);
-    if (NULL == ringBufferPa)
+    for (i = 0; i < Device->NumberOfQueues; ++i)
     {
-        LOG_ERROR("IoGetPhysicalAddress cannot map VA 0x%X\n", Device->TxData.TransmitBuffer);
-        return STATUS_MEMORY_CANNOT_BE_MAPPED;
-    }
+        pTxData = &Device->TxQueues[i];
+
+        ringBufferPa = IoGetPhysicalAddress((PVOID)pTxData->TransmitBuffer);
+        if (NULL == ringBufferPa)
+        {
+            LOG_ERROR("IoGetPhysicalAddress cannot map VA 0x%X\n", pTxData->TransmitBuffer);
+            return STATUS_MEMORY_CANNOT_BE_MAPPED;
+        }
+
+        LOG_TRACE_NETWORK("Ring buffer %u PA: 0x%X\n", i, ringBufferPa);
 
-    LOG_TRACE_NETWORK("Ring buffer PA: 0x%X\n", ringBufferPa);
+        EthSetTxRingBufferAddress(Device, i, ringBufferPa);
 
-    EthSetTxRingBufferAddress(Device, ringBufferPa);
+        EthSetTxRingBufferSize(Device, i, pTxData->Buffers.NumberOfDescriptors * ETH_DESCRIPTOR_SIZE);
 
-    EthSetTxRingBufferSize(Device, Device->TxData.Buffers.NumberOfDescriptors * ETH_DESCRIPTOR_SIZE);
+        EthSetTxHead(Device, i, 0);
 
-    EthSetTxHead(Device, 0);
+        EthSetTxTail(Device, i, 0);
 
-    EthSetTxTail(Device, 0);
+        // the device arbitrates only between the enabled queues
+        arbitration = EthGetTxArbitrationCount(Device, i);
+        arbitration.Enable = TRUE;
+        EthSetTxArbitrationCount(Device, i, arbitration);
+
+        LockInit(&pTxData->TxInterruptLock);
+    }
 
     // enable TX
     ctrlRegister.Enable = TRUE;
@@ -576,18 +879,53 @@ _EthTxInit(
 
     EthSetTxControlRegister(Device, ctrlRegister );
 
-    EthSetTxInterruptRelativeDelay(Device, 10 * MS_IN_US);
-    EthSetTxInterruptAbsoluteDelay(Device, 64 * MS_IN_US);
+    LOG_FUNC_END;
+
+    return status;
+}
+
+static
+void
+_EthRssInit(
+    IN      PETH_DEVICE         Device
+    )
+{
+    MULTIPLE_RX_QUEUES_COMMAND_REGISTER mrqc;
+    REDIRECTION_TABLE_REGISTER reta;
+    DWORD i;
+    DWORD j;
+
+    ASSERT( NULL != Device );
+    ASSERT( Device->NumberOfQueues > 1 );
 
-    LOG_TRACE_NETWORK("Relative delay: %u, absolute delay: %u\n",
-         EthGetTxInterruptRelativeDelay(Device),
-         EthGetTxInterruptAbsoluteDelay(Device));
+    mrqc.Raw = 0;
 
-    LockInit(&Device->TxData.TxInterruptLock);
+    EthSetRxRssKey(Device, (PBYTE) ETH_RSS_KEY);
 
-    LOG_FUNC_END;
+    // consecutive hash values go to different queues so the flows are spread
+    // evenly between the queues and thus between the CPUs serving them
+    for (i = 0; i < ETH_RSS_REDIRECTION_TABLE_REGISTERS; ++i)
+    {
+        reta.Raw = 0;
 
-    return status;
+        for (j = 0; j < sizeof(DWORD); ++j)
+        {
+            reta.Entries[j].QueueIndex = ( i * sizeof(DWORD) + j ) % Device->NumberOfQueues;
+        }
+
+        EthSetRxRedirectionTableRegister(Device, i, reta);
+    }
+
+    mrqc.MultipleRxQueuesEnable = MRQE_RSS;
+    mrqc.HashTcpIpv4 = TRUE;
+    mrqc.HashIpv4 = TRUE;
+    mrqc.HashTcpIpv6Ex = TRUE;
+    mrqc.HashIpv6Ex = TRUE;
+    mrqc.HashIpv6 = TRUE;
+
+    EthSetRxMultipleQueuesCommandRegister(Device, mrqc);
+
+    LOG_TRACE_NETWORK("RSS enabled for %u queues\n", Device->NumberOfQueues);
 }
 
 static
@@ -617,13 +955,25 @@ _EthInterruptInit(
 
     // clear all interrupts then set those which we want to intercept
 
-    intSetMaskReg.RdMinimumThresholdHit = TRUE;
-    intSetMaskReg.ReceiverOverrun = TRUE;
-    intSetMaskReg.ReceiverTimerInterrupt = TRUE;
-    intSetMaskReg.TdWrittenBack = TRUE;
+    if (Device->MsiXEnabled)
+    {
+        _EthMsiXInit(Device, &intSetMaskReg);
+    }
+    else
+    {
+        intSetMaskReg.RdMinimumThresholdHit = TRUE;
+        intSetMaskReg.ReceiverOverrun = TRUE;
+        intSetMaskReg.ReceiverTimerInterrupt = TRUE;
+        intSetMaskReg.TdWrittenBack = TRUE;
+    }
     intSetMaskReg.LinkStatusChange = TRUE;
 
     EthSetInterruptMaskClearRegister(Device, intClearMaskReg);
+
+    // start in the middle, the ISR will move to one of the other profiles
+    // depending on the traffic it sees
+    _EthApplyInterruptProfile(Device, NetworkInterruptProfileBalanced);
+
     EthSetInterruptMaskSetRegister(Device, intSetMaskReg);
 
     LOG_FUNC_END;
@@ -631,6 +981,65 @@ _EthInterruptInit(
     return status;
 }
 
+static
+void
+_EthMsiXInit(
+    IN      PETH_DEVICE             Device,
+    OUT     PINT_MASK_SET_REGISTER  InterruptMask
+    )
+{
+    EXTENDED_DEVICE_CONTROL_REGISTER ctrlExt;
+    INT_VECTOR_ALLOCATION_REGISTER ivar;
+    DWORD queueMask;
+    BYTE i;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != InterruptMask );
+
+    ivar.Raw = 0;
+    queueMask = 0;
+
+    // vector i serves the RX and TX causes of queue i, the vector after the
+    // last queue serves everything else
+    for (i = 0; i < Device->NumberOfQueues; ++i)
+    {
+        if (0 == i)
+        {
+            ivar.RxQueue0Vector = i;
+            ivar.RxQueue0Valid = TRUE;
+            ivar.TxQueue0Vector = i;
+            ivar.TxQueue0Valid = TRUE;
+        }
+        else
+        {
+            ivar.RxQueue1Vector = i;
+            ivar.RxQueue1Valid = TRUE;
+            ivar.TxQueue1Vector = i;
+            ivar.TxQueue1Valid = TRUE;
+        }
+
+        queueMask = queueMask | ETH_INT_QUEUE_MASK(i);
+    }
+    ivar.OtherVector = Device->NumberOfQueues;
+    ivar.OtherValid = TRUE;
+
+    EthSetInterruptVectorAllocationRegister(Device, ivar);
+
+    // the queue causes are cleared and masked by the device when their
+    // message is sent, no ICR access is needed on the queue vectors
+    EthSetInterruptAutoClearRegister(Device, queueMask);
+    EthSetInterruptAutoMaskRegister(Device, queueMask);
+
+    ctrlExt = EthGetExtendedDeviceControlRegister(Device);
+    ctrlExt.PbaSupport = TRUE;
+    ctrlExt.MsiXAutoMaskEnable = TRUE;
+    ctrlExt.InterruptAckAutoMaskEnable = FALSE;
+    EthSetExtendedDeviceControlRegister(Device, ctrlExt);
+
+    InterruptMask->Raw = InterruptMask->Raw | queueMask;
+    InterruptMask->OtherInterrupt = TRUE;
+}
+
 static
 void
 _EthDeviceControlsInit(
@@ -654,29 +1063,211 @@ _EthDeviceControlsInit(
 
 static
 void
-_EthSignalTxQueueFullIfNecessary(
+_EthApplyInterruptProfile(
+    IN      PETH_DEVICE                 Device,
+    IN      NETWORK_INTERRUPT_PROFILE   Profile
+    )
+{
+    const ETH_MODERATION_SETTINGS* pSettings;
+
+    ASSERT( NULL != Device );
+    ASSERT( Profile < NetworkInterruptProfileReserved );
+
+    pSettings = &ETH_MODERATION_PROFILES[Profile];
+
+    EthSetInterruptThrottlingRate(Device, pSettings->MaximumInterruptsPerSecond);
+
+    EthSetRxInterruptRelativeDelay(Device, pSettings->RxRelativeDelay);
+    EthSetRxInterruptAbsoluteDelay(Device, pSettings->RxAbsoluteDelay);
+
+    EthSetTxInterruptRelativeDelay(Device, pSettings->TxRelativeDelay);
+    EthSetTxInterruptAbsoluteDelay(Device, pSettings->TxAbsoluteDelay);
+
+    Device->InterruptModeration.Profile = Profile;
+}
+
+static
+void
+_EthUpdateInterruptModeration(
     IN      PETH_DEVICE         Device
     )
 {
-    WORD nextTxIndex;
-    INTR_STATE intrState;
+    DWORD noOfPackets;
+    DWORD noOfBytes;
+    NETWORK_INTERRUPT_PROFILE curProfile;
+    NETWORK_INTERRUPT_PROFILE newProfile;
 
     ASSERT( NULL != Device );
 
-    nextTxIndex = ( Device->TxData.Buffers.CurrentDescriptor + 1 ) % Device->TxData.Buffers.NumberOfDescriptors;
+    noOfPackets = _InterlockedExchange(&Device->InterruptModeration.Packets, 0);
+    noOfBytes = _InterlockedExchange(&Device->InterruptModeration.Bytes, 0);
+
+    Device->InterruptModeration.NumberOfInterrupts = Device->InterruptModeration.NumberOfInterrupts + 1;
 
-    // the check is done twice because we don't want each time we send a packet to take the interrupt
-    // lock => in most cases the validation will be quick
-    if (nextTxIndex == EthGetTxHead(Device))
+    if (0 == noOfPackets)
     {
-        LockAcquire(&Device->TxData.TxInterruptLock, &intrState);
+        // link status changes or TX completions of frames already accounted
+        return;
+    }
+
+    curProfile = Device->InterruptModeration.Profile;
+    newProfile = curProfile;
 
-        if (nextTxIndex == EthGetTxHead(Device))
+    switch (curProfile)
+    {
+    case NetworkInterruptProfileLowLatency:
+    case NetworkInterruptProfileBalanced:
+        if (noOfBytes > ETH_MODERATION_BULK_BYTES)
+        {
+            newProfile = ( noOfBytes / noOfPackets > ETH_MODERATION_BULK_BYTES_PER_PACKET ||
+                           noOfPackets > ETH_MODERATION_BULK_PACKETS )
+                         ? NetworkInterruptProfileBulk : NetworkInterruptProfileBalanced;
+        }
+        else if (noOfBytes < ETH_MODERATION_LOW_LATENCY_BYTES &&
+                 noOfPackets <= ETH_MODERATION_LOW_LATENCY_PACKETS)
         {
-            LOGL("Queue is full\n");
-            NetworkPortNotifyTxQueueFull(Device->MiniportDevice);
+            newProfile = NetworkInterruptProfileLowLatency;
         }
+        else
+        {
+            newProfile = NetworkInterruptProfileBalanced;
+        }
+        break;
+    case NetworkInterruptProfileBulk:
+        // leave the bulk profile only after the traffic dropped noticeably
+        if (noOfBytes < ETH_MODERATION_BULK_STAY_BYTES)
+        {
+            newProfile = NetworkInterruptProfileBalanced;
+        }
+        break;
+    default:
+        ASSERT(FALSE);
+    }
+
+    if (newProfile != curProfile)
+    {
+        LOG_TRACE_NETWORK("Changing interrupt profile %u -> %u after %u packets and %u bytes\n",
+                          curProfile, newProfile, noOfPackets, noOfBytes);
+
+        _EthApplyInterruptProfile(Device, newProfile);
+        Device->InterruptModeration.NumberOfProfileChanges = Device->InterruptModeration.NumberOfProfileChanges + 1;
+    }
+}
+
+static
+WORD
+_EthReclaimTxDescriptors(
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
+    )
+{
+    WORD cleanIndex;
+    WORD curTxIndex;
+    WORD noOfDescriptors;
+    PTX_DATA pTxData;
+
+    ASSERT( NULL != Device );
+    ASSERT( QueueIndex < Device->NumberOfQueues );
+
+    pTxData = &Device->TxQueues[QueueIndex];
+    cleanIndex = pTxData->CleanDescriptor;
+    curTxIndex = pTxData->Buffers.CurrentDescriptor;
+    noOfDescriptors = 0;
+
+    // every descriptor is sent with RS set so the device writes back DD once
+    // it is done with it, there is no need to read the TX head register
+    while (cleanIndex != curTxIndex && pTxData->TransmitBuffer[cleanIndex].DescriptorDone)
+    {
+        cleanIndex = (cleanIndex + 1) % pTxData->Buffers.NumberOfDescriptors;
+        noOfDescriptors = noOfDescriptors + 1;
+    }
+
+    pTxData->CleanDescriptor = cleanIndex;
+
+    return noOfDescriptors;
+}
+
+static
+void
+_EthCompleteTxDescriptors(
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
+    )
+{
+    INTR_STATE dummyState;
+    WORD noOfDescriptors;
+    PTX_DATA pTxData;
+
+    ASSERT( NULL != Device );
+    ASSERT( QueueIndex < Device->NumberOfQueues );
 
-        LockRelease(&Device->TxData.TxInterruptLock, intrState);
+    pTxData = &Device->TxQueues[QueueIndex];
+
+    LockAcquire(&pTxData->TxInterruptLock, &dummyState );
+
+    noOfDescriptors = _EthReclaimTxDescriptors(Device, QueueIndex);
+    if (0 != noOfDescriptors)
+    {
+        // notify port driver we have free descriptors
+        NetworkPortNotifyTxDescriptorAvailable(Device->MiniportDevice, QueueIndex, noOfDescriptors);
     }
-}
\ No newline at end of file
+
+    LockRelease(&pTxData->TxInterruptLock, INTR_OFF );
+}
+
+static
+STATUS
+(__cdecl _EthRxPollFunction)(
+    IN_OPT      PVOID       Context
+    )
+{
+    PETH_DEVICE pDevice;
+    PRX_DATA pRxData;
+    STATUS status;
+    WORD noOfFramesReceived;
+
+    ASSERT( NULL != Context );
+
+    pRxData = Context;
+    pDevice = pRxData->Device;
+    status = STATUS_SUCCESS;
+    noOfFramesReceived = 0;
+
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        // wait for the ISR to hand over the ring
+        ExEventWaitForSignal(&pRxData->PollEvent);
+
+#pragma warning(suppress:4127)
+        while (TRUE)
+        {
+            status = EthReceiveFrame(pDevice, pRxData->QueueIndex, ETH_RX_POLL_BUDGET, &noOfFramesReceived);
+            ASSERT(SUCCEEDED(status));
+
+            pRxData->NumberOfPolls = pRxData->NumberOfPolls + 1;
+
+            if (noOfFramesReceived == ETH_RX_POLL_BUDGET)
+            {
+                // there may be more frames waiting, but let the other threads
+                // run before processing the next batch
+                pRxData->NumberOfExhaustedBudgets = pRxData->NumberOfExhaustedBudgets + 1;
+                ThreadYield();
+                continue;
+            }
+
+            _EthChangeRxInterruptStatus(pDevice, pRxData->QueueIndex, TRUE);
+
+            // a frame received after the ring was found empty but before the
+            // interrupts were unmasked would not generate an interrupt
+            if (!pRxData->ReceiveBuffer[pRxData->Buffers.CurrentDescriptor].Status.DescriptorDone)
+            {
+                break;
+            }
+
+            _EthChangeRxInterruptStatus(pDevice, pRxData->QueueIndex, FALSE);
+        }
+    }
+
+    return status;
+}
@@ -76,6 +76,31 @@ EthGetDeviceStatusRegister(
     return result;
 }
 
+EXTENDED_DEVICE_CONTROL_REGISTER
+EthGetExtendedDeviceControlRegister(
+    IN      PETH_DEVICE         Device
+    )
+{
+    EXTENDED_DEVICE_CONTROL_REGISTER result;
+
+    ASSERT( NULL != Device );
+
+    result.Raw = Device->InternalRegisters->ExtendedDeviceControlRegister;
+
+    return result;
+}
+
+void
+EthSetExtendedDeviceControlRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      EXTENDED_DEVICE_CONTROL_REGISTER    ControlRegister
+    )
+{
+    ASSERT( NULL != Device );
+
+    Device->InternalRegisters->ExtendedDeviceControlRegister = ControlRegister.Raw;
+}
+
 INT_CAUSE_READ_REGISTER
 EthGetInterruptReason(
     IN      PETH_DEVICE         Device
@@ -126,6 +151,81 @@ EthSetInterruptMaskClearRegister(
     Device->InternalRegisters->InterruptMaskClearRegister = Mask.Raw;
 }
 
+DWORD
+EthGetInterruptThrottlingRate(
+    IN      PETH_DEVICE                 Device
+    )
+{
+    INT_THROTTLING_REGISTER throttling;
+
+    ASSERT(NULL != Device);
+
+    throttling.Raw = Device->InternalRegisters->InterruptThrottlingRegister;
+
+    if (0 == throttling.Interval)
+    {
+        return 0;
+    }
+
+    return (DWORD) ( SEC_IN_NS / ( (QWORD) throttling.Interval * 256 ) );
+}
+
+void
+EthSetInterruptThrottlingRate(
+    IN      PETH_DEVICE                 Device,
+    IN      DWORD                       InterruptsPerSecond
+    )
+{
+    INT_THROTTLING_REGISTER throttling;
+    QWORD interval;
+
+    ASSERT(NULL != Device);
+
+    throttling.Raw = 0;
+
+    if (0 != InterruptsPerSecond)
+    {
+        // the interval is expressed in 256 ns increments
+        interval = SEC_IN_NS / ( (QWORD) InterruptsPerSecond * 256 );
+        throttling.Interval = (DWORD) min(interval, MAX_WORD);
+    }
+
+    Device->InternalRegisters->InterruptThrottlingRegister = throttling.Raw;
+}
+
+void
+EthSetInterruptAutoClearRegister(
+    IN      PETH_DEVICE                 Device,
+    IN      DWORD                       Mask
+    )
+{
+    ASSERT( NULL != Device );
+
+    Device->InternalRegisters->InterruptAutoClearRegister = Mask;
+}
+
+void
+EthSetInterruptAutoMaskRegister(
+    IN      PETH_DEVICE                 Device,
+    IN      DWORD                       Mask
+    )
+{
+    ASSERT( NULL != Device );
+
+    Device->InternalRegisters->InterruptAutoMaskRegister = Mask;
+}
+
+void
+EthSetInterruptVectorAllocationRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      INT_VECTOR_ALLOCATION_REGISTER      Allocation
+    )
+{
+    ASSERT( NULL != Device );
+
+    Device->InternalRegisters->InterruptVectorAllocationRegister = Allocation.Raw;
+}
+
 DWORD
 EthGetRxControlRegister(
     IN      PETH_DEVICE                 Device
@@ -158,9 +258,57 @@ EthSetRxFilterControlRegister(
     Device->InternalRegisters->ReceiveFilterControlRegister = FilterRegister.Raw;
 }
 
+void
+EthSetRxMultipleQueuesCommandRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      MULTIPLE_RX_QUEUES_COMMAND_REGISTER CommandRegister
+    )
+{
+    ASSERT(NULL != Device);
+
+    Device->InternalRegisters->MultipleRxQueuesCommandRegister = CommandRegister.Raw;
+}
+
+void
+EthSetRxRedirectionTableRegister(
+    IN      PETH_DEVICE                         Device,
+    IN      DWORD                               Index,
+    IN      REDIRECTION_TABLE_REGISTER          Entries
+    )
+{
+    ASSERT(NULL != Device);
+    ASSERT(Index < ETH_RSS_REDIRECTION_TABLE_REGISTERS);
+
+    Device->InternalRegisters->RedirectionTable[Index] = Entries.Raw;
+}
+
+void
+EthSetRxRssKey(
+    IN      PETH_DEVICE                         Device,
+    IN_READS_BYTES(ETH_RSS_KEY_SIZE)
+            PBYTE                               Key
+    )
+{
+    DWORD i;
+    DWORD keyDword;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Key);
+
+    for (i = 0; i < ETH_RSS_KEY_REGISTERS; ++i)
+    {
+        // the first byte of the key is the least significant byte of the
+        // first register
+        memcpy(&keyDword, &Key[i * sizeof(DWORD)], sizeof(DWORD));
+
+        Device->InternalRegisters->RssRandomKey[i] = keyDword;
+    }
+}
+
 void
 EthSetRxRingBufferAddress(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      PHYSICAL_ADDRESS    Address
     )
 {
@@ -170,6 +318,7 @@ EthSetRxRingBufferAddress(
     RD_BASE_ADDRESS_HIGH rdBah;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
     ASSERT(NULL != Address);
 
     rdBal.Raw = 0;
@@ -182,38 +331,42 @@ EthSetRxRingBufferAddress(
     rdBal.Raw = ringBufferLow;
     rdBah.BaseAddressHigh = ringBufferHigh;
 
-    Device->InternalRegisters->ReceiveDescriptorAddressLow = rdBal.Raw;
-    Device->InternalRegisters->ReceiveDescriptorAddressHigh = rdBah.Raw;
+    Device->InternalRegisters->RxQueues[QueueIndex].ReceiveDescriptorAddressLow = rdBal.Raw;
+    Device->InternalRegisters->RxQueues[QueueIndex].ReceiveDescriptorAddressHigh = rdBah.Raw;
 }
 
 void
 EthSetRxRingBufferSize(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      DWORD               Size
     )
 {
     RD_LENGTH rdLen;
 
     ASSERT( NULL != Device );
+    ASSERT( QueueIndex < ETH_NO_OF_QUEUES );
 
     rdLen.Raw = 0;
 
     // Set descriptor length
     rdLen.Length = Size;
 
-    Device->InternalRegisters->ReceiveDescriptorLength = rdLen.Raw;
+    Device->InternalRegisters->RxQueues[QueueIndex].ReceiveDescriptorLength = rdLen.Raw;
 }
 
 WORD
 EthGetRxHead(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
     )
 {
     RD_HEAD rdHead;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
 
-    rdHead.Raw = Device->InternalRegisters->ReceiveDescriptorHead;
+    rdHead.Raw = Device->InternalRegisters->RxQueues[QueueIndex].ReceiveDescriptorHead;
 
     return rdHead.Head;
 }
@@ -221,29 +374,33 @@ EthGetRxHead(
 void
 EthSetRxHead(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      WORD                Index
     )
 {
     RD_HEAD rdHead;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
 
     rdHead.Raw = 0;
     rdHead.Head = Index;
 
-    Device->InternalRegisters->ReceiveDescriptorHead = rdHead.Raw;
+    Device->InternalRegisters->RxQueues[QueueIndex].ReceiveDescriptorHead = rdHead.Raw;
 }
 
 WORD
 EthGetRxTail(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
     )
 {
     RD_TAIL rdTail;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
 
-    rdTail.Raw = Device->InternalRegisters->ReceiveDescriptorTail;
+    rdTail.Raw = Device->InternalRegisters->RxQueues[QueueIndex].ReceiveDescriptorTail;
 
     return rdTail.Tail;
 }
@@ -251,17 +408,19 @@ EthGetRxTail(
 void
 EthSetRxTail(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      WORD                Index
     )
 {
     RD_TAIL rdTail;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
 
     rdTail.Raw = 0;
     rdTail.Tail = Index;
 
-    Device->InternalRegisters->ReceiveDescriptorTail = rdTail.Raw;
+    Device->InternalRegisters->RxQueues[QueueIndex].ReceiveDescriptorTail = rdTail.Raw;
 }
 
 WORD
@@ -273,7 +432,7 @@ EthGetRxInterruptRelativeDelay(
 
     ASSERT(NULL != Device);
 
-    timer.Raw = Device->InternalRegisters->ReceiveInterruptRelativeDelayTimer;
+    timer.Raw = Device->InternalRegisters->RxQueues[0].ReceiveInterruptRelativeDelayTimer;
 
     return _EthTransform1Dot024ToMicroseconds( timer.Delay );
 }
@@ -291,7 +450,7 @@ EthSetRxInterruptRelativeDelay(
     timer.Raw = 0;
     timer.Delay = _EthTransformMicrosecondsTo1Dot024(Microseconds);
 
-    Device->InternalRegisters->ReceiveInterruptRelativeDelayTimer = timer.Raw;
+    Device->InternalRegisters->RxQueues[0].ReceiveInterruptRelativeDelayTimer = timer.Raw;
 }
 
 WORD
@@ -303,7 +462,7 @@ EthGetRxInterruptAbsoluteDelay(
 
     ASSERT(NULL != Device);
 
-    timer.Raw = Device->InternalRegisters->ReceiveInterruptAbsoluteDelayTimer;
+    timer.Raw = Device->InternalRegisters->RxQueues[0].ReceiveInterruptAbsoluteDelayTimer;
 
     return _EthTransform1Dot024ToMicroseconds( timer.Delay );
 }
@@ -321,7 +480,7 @@ EthSetRxInterruptAbsoluteDelay(
     timer.Raw = 0;
     timer.Delay = _EthTransformMicrosecondsTo1Dot024(Microseconds);
 
-    Device->InternalRegisters->ReceiveInterruptAbsoluteDelayTimer = timer.Raw;
+    Device->InternalRegisters->RxQueues[0].ReceiveInterruptAbsoluteDelayTimer = timer.Raw;
 }
 
 DWORD
@@ -345,9 +504,39 @@ EthSetTxControlRegister(
     Device->InternalRegisters->TransmitControlRegister = ControlRegister.Raw;
 }
 
+TRANSMIT_ARBITRATION_COUNT
+EthGetTxArbitrationCount(
+    IN      PETH_DEVICE                 Device,
+    IN      BYTE                        QueueIndex
+    )
+{
+    TRANSMIT_ARBITRATION_COUNT result;
+
+    ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
+
+    result.Raw = Device->InternalRegisters->TxQueues[QueueIndex].TransmitArbitrationCount;
+
+    return result;
+}
+
+void
+EthSetTxArbitrationCount(
+    IN      PETH_DEVICE                 Device,
+    IN      BYTE                        QueueIndex,
+    IN      TRANSMIT_ARBITRATION_COUNT  ArbitrationCount
+    )
+{
+    ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
+
+    Device->InternalRegisters->TxQueues[QueueIndex].TransmitArbitrationCount = ArbitrationCount.Raw;
+}
+
 void
 EthSetTxRingBufferAddress(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      PHYSICAL_ADDRESS    Address
     )
 {
@@ -357,6 +546,7 @@ EthSetTxRingBufferAddress(
     TD_BASE_ADDRESS_HIGH tdBah;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
     ASSERT(NULL != Address);
 
     tdBal.Raw = 0;
@@ -369,38 +559,42 @@ EthSetTxRingBufferAddress(
     tdBal.Raw = ringBufferLow;
     tdBah.BaseAddressHigh = ringBufferHigh;
 
-    Device->InternalRegisters->TransmitDescriptorAddressLow = tdBal.Raw;
-    Device->InternalRegisters->TransmitDescriptorAddressHigh = tdBah.Raw;
+    Device->InternalRegisters->TxQueues[QueueIndex].TransmitDescriptorAddressLow = tdBal.Raw;
+    Device->InternalRegisters->TxQueues[QueueIndex].TransmitDescriptorAddressHigh = tdBah.Raw;
 }
 
 void
 EthSetTxRingBufferSize(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      DWORD               Size
     )
 {
     TD_LENGTH tdLen;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
 
     tdLen.Raw = 0;
 
     // Set descriptor length
     tdLen.Length = Size;
 
-    Device->InternalRegisters->TransmitDescriptorLength = tdLen.Raw;
+    Device->InternalRegisters->TxQueues[QueueIndex].TransmitDescriptorLength = tdLen.Raw;
 }
 
 WORD
 EthGetTxHead(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
     )
 {
     TD_HEAD tdHead;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
 
-    tdHead.Raw = Device->InternalRegisters->TransmitDescriptorHead;
+    tdHead.Raw = Device->InternalRegisters->TxQueues[QueueIndex].TransmitDescriptorHead;
 
     return tdHead.Head;
 }
@@ -408,29 +602,33 @@ EthGetTxHead(
 void
 EthSetTxHead(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      WORD                Index
     )
 {
     TD_HEAD tdHead;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
 
     tdHead.Raw = 0;
     tdHead.Head = Index;
 
-    Device->InternalRegisters->TransmitDescriptorHead = tdHead.Raw;
+    Device->InternalRegisters->TxQueues[QueueIndex].TransmitDescriptorHead = tdHead.Raw;
 }
 
 WORD
 EthGetTxTail(
-    IN      PETH_DEVICE         Device
+    IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex
     )
 {
     TD_TAIL tdTail;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
 
-    tdTail.Raw = Device->InternalRegisters->TransmitDescriptorTail;
+    tdTail.Raw = Device->InternalRegisters->TxQueues[QueueIndex].TransmitDescriptorTail;
 
     return tdTail.Tail;
 }
@@ -438,17 +636,19 @@ EthGetTxTail(
 void
 EthSetTxTail(
     IN      PETH_DEVICE         Device,
+    IN      BYTE                QueueIndex,
     IN      WORD                Index
     )
 {
     TD_TAIL tdTail;
 
     ASSERT(NULL != Device);
+    ASSERT(QueueIndex < ETH_NO_OF_QUEUES);
 
     tdTail.Raw = 0;
     tdTail.Tail = Index;
 
-    Device->InternalRegisters->TransmitDescriptorTail = tdTail.Raw;
+    Device->InternalRegisters->TxQueues[QueueIndex].TransmitDescriptorTail = tdTail.Raw;
 }
 
 WORD
@@ -460,7 +660,7 @@ EthGetTxInterruptRelativeDelay(
 
     ASSERT(NULL != Device);
 
-    timer.Raw = Device->InternalRegisters->TransmitInterruptRelativeDelayTimer;
+    timer.Raw = Device->InternalRegisters->TxQueues[0].TransmitInterruptRelativeDelayTimer;
 
     return _EthTransform1Dot024ToMicroseconds(timer.Delay);
 }
@@ -478,7 +678,7 @@ EthSetTxInterruptRelativeDelay(
     timer.Raw = 0;
     timer.Delay = _EthTransformMicrosecondsTo1Dot024(Microseconds);
 
-    Device->InternalRegisters->TransmitInterruptRelativeDelayTimer = timer.Raw;
+    Device->InternalRegisters->TxQueues[0].TransmitInterruptRelativeDelayTimer = timer.Raw;
 }
 
 WORD
@@ -490,7 +690,7 @@ EthGetTxInterruptAbsoluteDelay(
 
     ASSERT(NULL != Device);
 
-    timer.Raw = Device->InternalRegisters->TransmitInterruptAbsoluteDelayTimer;
+    timer.Raw = Device->InternalRegisters->TxQueues[0].TransmitInterruptAbsoluteDelayTimer;
 
     return _EthTransform1Dot024ToMicroseconds(timer.Delay);
 }
@@ -508,5 +708,5 @@ EthSetTxInterruptAbsoluteDelay(
     timer.Raw = 0;
     timer.Delay = _EthTransformMicrosecondsTo1Dot024(Microseconds);
 
-    Device->InternalRegisters->TransmitInterruptAbsoluteDelayTimer = timer.Raw;
+    Device->InternalRegisters->TxQueues[0].TransmitInterruptAbsoluteDelayTimer = timer.Raw;
 }
\ No newline at end of file
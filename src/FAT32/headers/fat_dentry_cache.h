@@ -0,0 +1,98 @@
+#pragma once
+
+#include "hash_table.h"
+
+// Number of buckets in the directory entry hash table
+#define FAT_DENTRY_CACHE_BUCKETS            256
+
+// Maximum number of cached entries (positive and negative), when this value
+// is reached the least recently used entry is evicted
+#define FAT_DENTRY_CACHE_MAX_ENTRIES        1024
+
+// Caches the results of directory entry lookups: the key of each entry is
+// formed from the cluster of the parent directory and a hash of the case
+// folded name, the names are compared on lookup to resolve hash collisions.
+//
+// Negative entries (names which were not found in the parent directory) are
+// also cached so failed opens don't touch the disk either.
+//
+// All accesses are serialized by the file system device lock taken by
+// IoCallDriver before calling into the FAT dispatch routines.
+typedef struct _FAT_DENTRY_CACHE
+{
+    HASH_TABLE          Table;
+
+    // Most recently used entries are at the head of the list
+    LIST_ENTRY          LruList;
+
+    DWORD               NumberOfEntries;
+
+    QWORD               Hits;
+    QWORD               Misses;
+    QWORD               Evictions;
+} FAT_DENTRY_CACHE, *PFAT_DENTRY_CACHE;
+
+STATUS
+FatDentryCacheInit(
+    OUT     PFAT_DENTRY_CACHE       Cache
+    );
+
+void
+FatDentryCacheUninit(
+    INOUT   PFAT_DENTRY_CACHE       Cache
+    );
+
+//******************************************************************************
+// Function:     FatDentryCacheLookup
+// Description:  Searches for Name in the directory starting at cluster
+//               ParentCluster.
+// Returns:      STATUS - STATUS_ELEMENT_NOT_FOUND if nothing is cached for the
+//               name, STATUS_FILE_NOT_FOUND for a negative entry and
+//               STATUS_SUCCESS if the outputs were populated.
+// Parameter:    OUT BYTE* Attributes - (DIR_ATTR & (ATTR_DIRECTORY | ATTR_VOLUME_ID))
+//               of the cached entry.
+//******************************************************************************
+STATUS
+FatDentryCacheLookup(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name,
+    OUT     BYTE*                   Attributes,
+    OUT     QWORD*                  FileSector,
+    OUT     QWORD*                  EntrySector,
+    OUT     PFILE_INFORMATION       FileInformation
+    );
+
+void
+FatDentryCacheInsert(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name,
+    IN      BYTE                    Attributes,
+    IN      QWORD                   FileSector,
+    IN      QWORD                   EntrySector,
+    IN      PFILE_INFORMATION       FileInformation
+    );
+
+void
+FatDentryCacheInsertNegative(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name
+    );
+
+// Removes the entry (positive or negative) cached for Name in ParentCluster
+void
+FatDentryCacheInvalidate(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name
+    );
+
+// Removes all the positive entries referring to the file whose data starts
+// at FileSector, used when the on-disk directory entry changes
+void
+FatDentryCacheInvalidateFile(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   FileSector
+    );
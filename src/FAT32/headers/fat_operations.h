@@ -1,5 +1,8 @@
 #pragma once
 
+#include "fat_dentry_cache.h"
+#include "fat_stream.h"
+
 // Structure containing information about the
 // FAT32 partition
 typedef struct _FAT_DATA
@@ -19,6 +22,10 @@ typedef struct _FAT_DATA
     DWORD               EntriesPerSector;           // Directory entries / sector
 
     DWORD               AllocationSize;
+
+    FAT_DENTRY_CACHE    DentryCache;
+
+    FAT_STREAM_WORKER   StreamWorker;
 } FAT_DATA, *PFAT_DATA;
 
  typedef
@@ -74,6 +81,18 @@ FatReadFile(
     IN      BOOLEAN     Asynchronous
     );
 
+// Same as FatReadFile, but does not update the last access date of the file
+STATUS
+FatReadFileData(
+    IN      PFAT_DATA   FatData,
+    IN      QWORD       BaseFileSector,
+    IN      QWORD       SectorOffset,
+    IN      PVOID       Buffer,
+    IN      QWORD       SectorsToRead,
+    OUT     QWORD*      SectorsRead,
+    IN      BOOLEAN     Asynchronous
+    );
+
 STATUS
 FatWriteFile(
     IN      PFAT_DATA   FatData,
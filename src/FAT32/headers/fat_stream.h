@@ -0,0 +1,146 @@
+#pragma once
+
+#include "ex_event.h"
+#include "thread.h"
+
+// FAT_DATA embeds the stream worker, so it can only be referenced here
+struct _FAT_DATA;
+
+// Maximum read-ahead window, the minimum window is a cluster
+#define FAT_STREAM_MAX_READ_AHEAD           (128 * KB_SIZE)
+
+// Size of the buffer in which contiguous writes are coalesced
+#define FAT_STREAM_WRITE_BEHIND_SIZE        (64 * KB_SIZE)
+
+#define FAT_STREAM_OPERATION_READ_AHEAD     0x1
+#define FAT_STREAM_OPERATION_FLUSH          0x2
+
+// Each volume has a worker thread which performs the read-ahead and the
+// write-behind operations queued by the streams of the volume.
+//
+// The worker acquires the lock of the file system device before touching
+// any stream, so it is serialized with the FAT dispatch routines which are
+// always called with the same lock held by IoCallDriver. As a result the
+// stream state itself needs no additional locking, only the queue does.
+typedef struct _FAT_STREAM_WORKER
+{
+    PDEVICE_OBJECT              FileSystemDevice;
+
+    LOCK                        QueueLock;
+
+    _Guarded_by_(QueueLock)
+    LIST_ENTRY                  Queue;
+
+    EX_EVENT                    QueueNotEmpty;
+
+    PTHREAD                     Thread;
+
+    // all the streams open on the volume, protected by the lock of the file
+    // system device
+    LIST_ENTRY                  Streams;
+} FAT_STREAM_WORKER, *PFAT_STREAM_WORKER;
+
+// Per FILE_OBJECT caching context: detects sequential reads and keeps an
+// adaptive read-ahead window ahead of the reader, while contiguous writes
+// are gathered in a write-behind buffer which is flushed in a single request.
+//
+// A file may be opened more than once, before a stream goes to the disk the
+// other streams of the same file flush their dirty data in the range and a
+// write invalidates their read-ahead data in the range.
+typedef struct _FAT_STREAM
+{
+    struct _FAT_DATA*           FatData;
+
+    QWORD                       BaseFileSector;
+    QWORD                       DirEntrySector;
+
+    // file size in bytes, aligned to the sector size
+    QWORD                       FileSize;
+
+    // last value received from the IRP, used for the worker requests
+    BOOLEAN                     Asynchronous;
+
+    BOOLEAN                     AccessDateUpdated;
+
+    // Read-ahead state
+    QWORD                       NextReadOffset;
+    DWORD                       SequentialReads;
+    DWORD                       Window;
+    DWORD                       MinWindow;
+    DWORD                       MaxWindow;
+
+    PBYTE                       ReadAheadBuffer;
+    QWORD                       ReadAheadOffset;
+    DWORD                       ReadAheadLength;
+
+    // Write-behind state
+    PBYTE                       WriteBehindBuffer;
+    DWORD                       WriteBehindSize;
+    QWORD                       DirtyOffset;
+    DWORD                       DirtyLength;
+
+    // failure of a write-behind flush done by the worker, reported on the
+    // next write or when the stream is closed
+    STATUS                      DeferredStatus;
+
+    // Worker queue state
+    DWORD                       PendingOperations;
+    BOOLEAN                     Queued;
+    LIST_ENTRY                  QueueEntry;
+
+    // entry in the Streams list of the worker
+    LIST_ENTRY                  StreamEntry;
+
+    // Statistics
+    QWORD                       ReadAheadHits;
+    QWORD                       BytesReadAhead;
+    QWORD                       Flushes;
+} FAT_STREAM, *PFAT_STREAM;
+
+STATUS
+FatStreamWorkerInit(
+    INOUT   struct _FAT_DATA*       FatData,
+    IN      PDEVICE_OBJECT          FileSystemDevice
+    );
+
+STATUS
+FatStreamCreate(
+    IN      struct _FAT_DATA*       FatData,
+    IN      QWORD                   BaseFileSector,
+    IN      QWORD                   DirEntrySector,
+    IN      QWORD                   FileSize,
+    OUT_PTR PFAT_STREAM*            Stream
+    );
+
+//******************************************************************************
+// Function:     FatStreamClose
+// Description:  Cancels any pending worker operation, flushes the dirty data
+//               and frees the stream.
+// Returns:      STATUS - the status of the final flush or of a previously
+//               failed deferred flush.
+// Parameter:    IN PFAT_STREAM Stream
+//******************************************************************************
+STATUS
+FatStreamClose(
+    IN      PFAT_STREAM             Stream
+    );
+
+STATUS
+FatStreamRead(
+    INOUT                   PFAT_STREAM     Stream,
+    IN                      QWORD           Offset,
+    IN                      QWORD           Length,
+    OUT_WRITES_BYTES(Length)PVOID           Buffer,
+    IN                      BOOLEAN         Asynchronous,
+    OUT                     QWORD*          BytesRead
+    );
+
+STATUS
+FatStreamWrite(
+    INOUT                   PFAT_STREAM     Stream,
+    IN                      QWORD           Offset,
+    IN                      QWORD           Length,
+    IN_READS_BYTES(Length)  PVOID           Buffer,
+    IN                      BOOLEAN         Asynchronous,
+    OUT                     QWORD*          BytesWritten
+    );
@@ -16,6 +16,9 @@ typedef struct _FCB
     QWORD               ParentOffsetInVolume;
 
     FILE_INFORMATION    FileInformation;
+
+    // read-ahead and write-behind context, NULL for directories
+    PFAT_STREAM         Stream;
 } FCB, *PFCB;
 
 STATUS
@@ -142,6 +145,13 @@ STATUS
 
             LOG_TRACE_FILESYSTEM("FatInitVolume succeeded\n");
 
+            status = FatStreamWorkerInit(pFatData, pFileSystemDevice);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("FatStreamWorkerInit", status);
+                continue;
+            }
+
             // attach to volume
             IoAttachDevice(pFileSystemDevice, pCurVolume);
 
@@ -253,6 +263,23 @@ STATUS
         pFcb->ParentOffsetInVolume = parentSector;
         memcpy(&pFcb->FileInformation, &fileInformation, sizeof(FILE_INFORMATION));
 
+        if (!IsBooleanFlagOn(fileInformation.FileAttributes, FILE_ATTRIBUTE_DIRECTORY))
+        {
+            status = FatStreamCreate(pFatData,
+                                     fileSector,
+                                     parentSector,
+                                     fileInformation.FileSize,
+                                     &pFcb->Stream
+                                     );
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("FatStreamCreate", status);
+                ExFreePoolWithTag(pFcb, HEAP_FS_TAG);
+                pFcb = NULL;
+                __leave;
+            }
+        }
+
         pStackLocation->FileObject->FileSize = fileInformation.FileSize;
         pStackLocation->FileObject->FsContext2 = pFcb;
     }
@@ -296,6 +323,17 @@ STATUS
 
     ASSERT(NULL != pFcb);
 
+    if (NULL != pFcb->Stream)
+    {
+        // any data still held in the write-behind buffer reaches the disk here
+        status = FatStreamClose(pFcb->Stream);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("FatStreamClose", status);
+        }
+        pFcb->Stream = NULL;
+    }
+
     // as part of the close we need to free the FCB
     ExFreePoolWithTag(pFcb, HEAP_FS_TAG);
     pFcb = NULL;
@@ -321,6 +359,7 @@ STATUS
     PFAT_DATA pFatData;
     PFCB pFcb;
     QWORD sectorsReadOrWritten;
+    QWORD bytesReadOrWritten;
 
     PFUNC_FatReadWriteFile FatReadWriteFunc;
 
@@ -334,6 +373,7 @@ STATUS
     pFatData = NULL;
     pFcb = NULL;
     sectorsReadOrWritten = 0;
+    bytesReadOrWritten = 0;
 
     pStackLocation = IoGetCurrentIrpStackLocation(Irp);
     ASSERT(IRP_MJ_READ == pStackLocation->MajorFunction || IRP_MJ_WRITE == pStackLocation->MajorFunction);
@@ -352,6 +392,35 @@ STATUS
 
     __try
     {
+        if (NULL != pFcb->Stream)
+        {
+            if (IRP_MJ_READ == pStackLocation->MajorFunction)
+            {
+                status = FatStreamRead(pFcb->Stream,
+                                       pStackLocation->Parameters.ReadWrite.Offset,
+                                       pStackLocation->Parameters.ReadWrite.Length,
+                                       Irp->Buffer,
+                                       (BOOLEAN)Irp->Flags.Asynchronous,
+                                       &bytesReadOrWritten
+                                       );
+            }
+            else
+            {
+                status = FatStreamWrite(pFcb->Stream,
+                                        pStackLocation->Parameters.ReadWrite.Offset,
+                                        pStackLocation->Parameters.ReadWrite.Length,
+                                        Irp->Buffer,
+                                        (BOOLEAN)Irp->Flags.Asynchronous,
+                                        &bytesReadOrWritten
+                                        );
+            }
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("FatStreamRead/FatStreamWrite", status);
+            }
+            __leave;
+        }
+
         if (IRP_MJ_READ == pStackLocation->MajorFunction)
         {
             FatReadWriteFunc = FatReadFile;
@@ -377,11 +446,13 @@ STATUS
             LOG_FUNC_ERROR("FatReadWriteFunc", status);
             __leave;
         }
+
+        bytesReadOrWritten = sectorsReadOrWritten * pFatData->BytesPerSector;
     }
     __finally
     {
         Irp->IoStatus.Status = status;
-        Irp->IoStatus.Information = sectorsReadOrWritten * pFatData->BytesPerSector;
+        Irp->IoStatus.Information = bytesReadOrWritten;
 
         IoCompleteIrp(Irp);
 
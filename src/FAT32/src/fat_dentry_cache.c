@@ -0,0 +1,437 @@
+#include "fat32_base.h"
+#include "fat_dentry_cache.h"
+
+#define FNV_OFFSET_BASIS_32             0x811C9DC5UL
+#define FNV_PRIME_32                    0x01000193UL
+
+#pragma warning(push)
+
+// warning C4200: nonstandard extension used: zero-sized array in struct/union
+#pragma warning(disable:4200)
+typedef struct _FAT_DENTRY
+{
+    HASH_ENTRY          HashEntry;
+
+    // ParentCluster in the high DWORD, hash of the folded name in the low DWORD
+    QWORD               Key;
+
+    LIST_ENTRY          LruEntry;
+
+    BOOLEAN             Negative;
+
+    // valid only for positive entries
+    BYTE                Attributes;
+    QWORD               FileSector;
+    QWORD               EntrySector;
+    FILE_INFORMATION    FileInformation;
+
+    // case folded name, NULL terminated
+    DWORD               NameLength;
+    char                Name[0];
+} FAT_DENTRY, *PFAT_DENTRY;
+#pragma warning(pop)
+
+static
+DWORD
+_FatDentryFoldName(
+    IN_Z                        char*       Name,
+    OUT_WRITES_Z(BufferSize)    char*       Buffer,
+    IN                          DWORD       BufferSize,
+    OUT                         DWORD*      Hash
+    );
+
+static
+QWORD
+_FatDentryBuildKey(
+    IN      QWORD                   ParentCluster,
+    IN      DWORD                   NameHash
+    );
+
+static
+PFAT_DENTRY
+_FatDentryFind(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name
+    );
+
+static
+void
+_FatDentryRemove(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    INOUT   PFAT_DENTRY             Dentry
+    );
+
+static
+void
+_FatDentryAdd(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name,
+    IN      BOOLEAN                 Negative,
+    IN      BYTE                    Attributes,
+    IN      QWORD                   FileSector,
+    IN      QWORD                   EntrySector,
+    IN_OPT  PFILE_INFORMATION       FileInformation
+    );
+
+static FUNC_FreeFunction _FatDentryFree;
+
+STATUS
+FatDentryCacheInit(
+    OUT     PFAT_DENTRY_CACHE       Cache
+    )
+{
+    DWORD tableSize;
+    PHASH_TABLE_DATA pTableData;
+
+    ASSERT(NULL != Cache);
+
+    memzero(Cache, sizeof(FAT_DENTRY_CACHE));
+
+    InitializeListHead(&Cache->LruList);
+
+    tableSize = HashTablePreinit(&Cache->Table, FAT_DENTRY_CACHE_BUCKETS, sizeof(QWORD));
+
+    pTableData = ExAllocatePoolWithTag(0, tableSize, HEAP_FS_TAG, 0);
+    if (NULL == pTableData)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", tableSize);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    HashTableInit(&Cache->Table,
+                  pTableData,
+                  HashFuncUniversal,
+                  FIELD_OFFSET(FAT_DENTRY, Key) - FIELD_OFFSET(FAT_DENTRY, HashEntry));
+
+    return STATUS_SUCCESS;
+}
+
+void
+FatDentryCacheUninit(
+    INOUT   PFAT_DENTRY_CACHE       Cache
+    )
+{
+    ASSERT(NULL != Cache);
+
+    if (NULL == Cache->Table.TableData)
+    {
+        return;
+    }
+
+    HashTableClear(&Cache->Table, _FatDentryFree, NULL);
+    InitializeListHead(&Cache->LruList);
+    Cache->NumberOfEntries = 0;
+
+    ExFreePoolWithTag(Cache->Table.TableData, HEAP_FS_TAG);
+    Cache->Table.TableData = NULL;
+}
+
+STATUS
+FatDentryCacheLookup(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name,
+    OUT     BYTE*                   Attributes,
+    OUT     QWORD*                  FileSector,
+    OUT     QWORD*                  EntrySector,
+    OUT     PFILE_INFORMATION       FileInformation
+    )
+{
+    PFAT_DENTRY pDentry;
+
+    ASSERT(NULL != Cache);
+    ASSERT(NULL != Name);
+    ASSERT(NULL != Attributes);
+    ASSERT(NULL != FileSector);
+    ASSERT(NULL != EntrySector);
+    ASSERT(NULL != FileInformation);
+
+    pDentry = _FatDentryFind(Cache, ParentCluster, Name);
+    if (NULL == pDentry)
+    {
+        Cache->Misses++;
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    Cache->Hits++;
+
+    // move the entry to the head of the LRU list
+    RemoveEntryList(&pDentry->LruEntry);
+    InsertHeadList(&Cache->LruList, &pDentry->LruEntry);
+
+    if (pDentry->Negative)
+    {
+        LOG_TRACE_FILESYSTEM("Negative dentry hit for [%s] in cluster 0x%X\n", Name, ParentCluster);
+        return STATUS_FILE_NOT_FOUND;
+    }
+
+    LOG_TRACE_FILESYSTEM("Dentry hit for [%s] in cluster 0x%X\n", Name, ParentCluster);
+
+    *Attributes = pDentry->Attributes;
+    *FileSector = pDentry->FileSector;
+    *EntrySector = pDentry->EntrySector;
+    memcpy(FileInformation, &pDentry->FileInformation, sizeof(FILE_INFORMATION));
+
+    return STATUS_SUCCESS;
+}
+
+void
+FatDentryCacheInsert(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name,
+    IN      BYTE                    Attributes,
+    IN      QWORD                   FileSector,
+    IN      QWORD                   EntrySector,
+    IN      PFILE_INFORMATION       FileInformation
+    )
+{
+    ASSERT(NULL != FileInformation);
+
+    _FatDentryAdd(Cache, ParentCluster, Name, FALSE, Attributes, FileSector, EntrySector, FileInformation);
+}
+
+void
+FatDentryCacheInsertNegative(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name
+    )
+{
+    _FatDentryAdd(Cache, ParentCluster, Name, TRUE, 0, 0, 0, NULL);
+}
+
+void
+FatDentryCacheInvalidate(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name
+    )
+{
+    PFAT_DENTRY pDentry;
+
+    ASSERT(NULL != Cache);
+    ASSERT(NULL != Name);
+
+    pDentry = _FatDentryFind(Cache, ParentCluster, Name);
+    if (NULL != pDentry)
+    {
+        LOG_TRACE_FILESYSTEM("Invalidating dentry [%s] in cluster 0x%X\n", Name, ParentCluster);
+        _FatDentryRemove(Cache, pDentry);
+    }
+}
+
+void
+FatDentryCacheInvalidateFile(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   FileSector
+    )
+{
+    LIST_ITERATOR it;
+    PLIST_ENTRY pListEntry;
+
+    ASSERT(NULL != Cache);
+
+    // the same file may be cached under both its long and short name
+    ListIteratorInit(&Cache->LruList, &it);
+
+    while ((pListEntry = ListIteratorNext(&it)) != NULL)
+    {
+        PFAT_DENTRY pDentry = CONTAINING_RECORD(pListEntry, FAT_DENTRY, LruEntry);
+
+        if (!pDentry->Negative && pDentry->FileSector == FileSector)
+        {
+            _FatDentryRemove(Cache, pDentry);
+        }
+    }
+}
+
+static
+DWORD
+_FatDentryFoldName(
+    IN_Z                        char*       Name,
+    OUT_WRITES_Z(BufferSize)    char*       Buffer,
+    IN                          DWORD       BufferSize,
+    OUT                         DWORD*      Hash
+    )
+{
+    DWORD i;
+    DWORD hash;
+
+    ASSERT(NULL != Name);
+    ASSERT(NULL != Buffer);
+    ASSERT(0 != BufferSize);
+    ASSERT(NULL != Hash);
+
+    hash = FNV_OFFSET_BASIS_32;
+
+    // fold the same way stricmp does so that two names considered equal by
+    // FatSearchDirectoryEntry always map to the same key
+    for (i = 0; i < BufferSize - 1 && Name[i] != '\0'; ++i)
+    {
+        Buffer[i] = tolower(Name[i]);
+
+        hash = hash ^ (BYTE)Buffer[i];
+        hash = hash * FNV_PRIME_32;
+    }
+    Buffer[i] = '\0';
+
+    *Hash = hash;
+
+    return i;
+}
+
+static
+QWORD
+_FatDentryBuildKey(
+    IN      QWORD                   ParentCluster,
+    IN      DWORD                   NameHash
+    )
+{
+    ASSERT(ParentCluster <= MAX_DWORD);
+
+    return DWORDS_TO_QWORD((DWORD)ParentCluster, NameHash);
+}
+
+static
+PFAT_DENTRY
+_FatDentryFind(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name
+    )
+{
+    char foldedName[LONG_NAME_MAX_CHARS + 1];
+    DWORD nameHash;
+    QWORD key;
+    PHASH_ENTRY pHashEntry;
+    PFAT_DENTRY pDentry;
+
+    ASSERT(NULL != Cache);
+    ASSERT(NULL != Name);
+
+    _FatDentryFoldName(Name, foldedName, sizeof(foldedName), &nameHash);
+    key = _FatDentryBuildKey(ParentCluster, nameHash);
+
+    pHashEntry = HashTableLookup(&Cache->Table, (PHASH_KEY)&key);
+    if (NULL == pHashEntry)
+    {
+        return NULL;
+    }
+
+    pDentry = CONTAINING_RECORD(pHashEntry, FAT_DENTRY, HashEntry);
+
+    // different names may hash to the same key
+    return (0 == strcmp(pDentry->Name, foldedName)) ? pDentry : NULL;
+}
+
+static
+void
+_FatDentryRemove(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    INOUT   PFAT_DENTRY             Dentry
+    )
+{
+    ASSERT(NULL != Cache);
+    ASSERT(NULL != Dentry);
+    ASSERT(0 != Cache->NumberOfEntries);
+
+    HashTableRemoveEntry(&Cache->Table, &Dentry->HashEntry);
+    RemoveEntryList(&Dentry->LruEntry);
+    Cache->NumberOfEntries--;
+
+    ExFreePoolWithTag(Dentry, HEAP_FS_TAG);
+}
+
+static
+void
+_FatDentryAdd(
+    INOUT   PFAT_DENTRY_CACHE       Cache,
+    IN      QWORD                   ParentCluster,
+    IN_Z    char*                   Name,
+    IN      BOOLEAN                 Negative,
+    IN      BYTE                    Attributes,
+    IN      QWORD                   FileSector,
+    IN      QWORD                   EntrySector,
+    IN_OPT  PFILE_INFORMATION       FileInformation
+    )
+{
+    char foldedName[LONG_NAME_MAX_CHARS + 1];
+    DWORD nameHash;
+    DWORD nameLength;
+    DWORD allocationSize;
+    PFAT_DENTRY pDentry;
+    PHASH_ENTRY pPreviousEntry;
+
+    ASSERT(NULL != Cache);
+    ASSERT(NULL != Name);
+
+    nameLength = _FatDentryFoldName(Name, foldedName, sizeof(foldedName), &nameHash);
+
+    if (Cache->NumberOfEntries >= FAT_DENTRY_CACHE_MAX_ENTRIES)
+    {
+        PFAT_DENTRY pVictim = CONTAINING_RECORD(Cache->LruList.Blink, FAT_DENTRY, LruEntry);
+
+        _FatDentryRemove(Cache, pVictim);
+        Cache->Evictions++;
+    }
+
+    allocationSize = sizeof(FAT_DENTRY) + nameLength + 1;
+
+    // the cache is only an optimization, if we can't allocate memory the next
+    // search will simply go to the disk
+    pDentry = ExAllocatePoolWithTag(PoolAllocateZeroMemory, allocationSize, HEAP_FS_TAG, 0);
+    if (NULL == pDentry)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", allocationSize);
+        return;
+    }
+
+    pDentry->Key = _FatDentryBuildKey(ParentCluster, nameHash);
+    pDentry->Negative = Negative;
+    pDentry->Attributes = Attributes;
+    pDentry->FileSector = FileSector;
+    pDentry->EntrySector = EntrySector;
+    if (NULL != FileInformation)
+    {
+        memcpy(&pDentry->FileInformation, FileInformation, sizeof(FILE_INFORMATION));
+    }
+    pDentry->NameLength = nameLength;
+    memcpy(pDentry->Name, foldedName, nameLength + 1);
+
+    pPreviousEntry = HashTableInsert(&Cache->Table, &pDentry->HashEntry);
+    if (NULL != pPreviousEntry)
+    {
+        // the previous entry was already unlinked from the hash table, it is
+        // either stale or a different name which collided with this one
+        PFAT_DENTRY pPrevious = CONTAINING_RECORD(pPreviousEntry, FAT_DENTRY, HashEntry);
+
+        RemoveEntryList(&pPrevious->LruEntry);
+        ExFreePoolWithTag(pPrevious, HEAP_FS_TAG);
+    }
+    else
+    {
+        Cache->NumberOfEntries++;
+    }
+
+    InsertHeadList(&Cache->LruList, &pDentry->LruEntry);
+}
+
+static
+void
+(__cdecl _FatDentryFree)(
+    IN      PVOID       Object,
+    IN_OPT  PVOID       Context
+    )
+{
+    PFAT_DENTRY pDentry;
+
+    ASSERT(NULL != Object);
+    UNREFERENCED_PARAMETER(Context);
+
+    pDentry = CONTAINING_RECORD(Object, FAT_DENTRY, HashEntry);
+
+    ExFreePoolWithTag(pDentry, HEAP_FS_TAG);
+}
@@ -138,6 +138,13 @@ FatInitVolume(
     ASSERT_INFO(FatData->AllocationSize >= pVolumeDevice->DeviceAlignment,
         "The FAT driver does not handle issues caused by greater device alignment needed by volume devices");
 
+    status = FatDentryCacheInit(&FatData->DentryCache);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("FatDentryCacheInit", status);
+        return status;
+    }
+
     return status;
 }
 
@@ -284,6 +291,70 @@ FatReadFile(
     OUT     QWORD*      SectorsRead,
     IN      BOOLEAN     Asynchronous
 )
+{
+    STATUS status;
+    QWORD sectorsRead;
+
+    DIR_ENTRY  dirEntry = { 0 };
+    QWORD dirEntryIndex = 0;
+    DATETIME currentDateTime = { 0 };
+    FATDATE fatDate = { 0 };
+    FATTIME fatTime = { 0 };
+
+    LOG_FUNC_START;
+
+    ASSERT(NULL != SectorsRead);
+
+    sectorsRead = 0;
+
+    if (0 == SectorsToRead)
+    {
+        *SectorsRead = 0;
+        return STATUS_SUCCESS;
+    }
+
+    status = FatReadFileData(FatData, BaseFileSector, SectorOffset, Buffer, SectorsToRead, &sectorsRead, Asynchronous);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("FatReadFileData", status);
+        return status;
+    }
+
+    status = GetDirEntryFromSector(FatData, DirEntrySector, BaseFileSector, &dirEntryIndex, &dirEntry);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("GetDirEntryFromSector", status);
+        return status;
+    }
+
+    currentDateTime = IoGetCurrentDateTime();
+
+    ConvertDateTimeToFatDateTime(&currentDateTime, &fatDate, &fatTime);
+
+    dirEntry.DIR_LstAccDate = fatDate;
+
+    status = WriteDirEntryToSector(FatData, DirEntrySector, dirEntryIndex, &dirEntry);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("WriteDirEntryToSector", status);
+        return status;
+    }
+
+    *SectorsRead = sectorsRead;
+
+    return status;
+}
+
+STATUS
+FatReadFileData(
+    IN      PFAT_DATA   FatData,
+    IN      QWORD       BaseFileSector,
+    IN      QWORD       SectorOffset,
+    IN      PVOID       Buffer,
+    IN      QWORD       SectorsToRead,
+    OUT     QWORD*      SectorsRead,
+    IN      BOOLEAN     Asynchronous
+)
 {
     STATUS status;
     QWORD currentSector;                // the sector in which the file is
@@ -294,16 +365,11 @@ FatReadFile(
     PBYTE pData;
     QWORD sectorsTraversed;
 
-    DIR_ENTRY  dirEntry = { 0 };
-    QWORD dirEntryIndex = 0;
-    DATETIME currentDateTime = { 0 };
-    FATDATE fatDate = { 0 };
-    FATTIME fatTime = { 0 };
-
     LOG_FUNC_START;
 
     ASSERT(NULL != FatData);
     ASSERT(NULL != Buffer);
+    ASSERT(NULL != SectorsRead);
 
     ASSERT(IsAddressAligned(BaseFileSector, FatData->SectorsPerCluster));
 
@@ -336,6 +402,13 @@ FatReadFile(
             return status;
         }
 
+        if (0 == nextSector)
+        {
+            // the offset is past the end of the cluster chain
+            *SectorsRead = 0;
+            return STATUS_SUCCESS;
+        }
+
         currentSector = nextSector;
         sectorsTraversed = sectorsTraversed + FatData->SectorsPerCluster;
     }
@@ -396,26 +469,6 @@ FatReadFile(
         bytesToRead = sectorsToRead * FatData->BytesPerSector;
     }
 
-    status = GetDirEntryFromSector(FatData, DirEntrySector, BaseFileSector, &dirEntryIndex, &dirEntry);
-    if (!SUCCEEDED(status))
-    {
-        LOG_FUNC_ERROR("GetDirEntryFromSector", status);
-        return status;
-    }
-
-    currentDateTime = IoGetCurrentDateTime();
-
-    ConvertDateTimeToFatDateTime(&currentDateTime, &fatDate, &fatTime);
-
-    dirEntry.DIR_LstAccDate = fatDate;
-
-    status = WriteDirEntryToSector(FatData, DirEntrySector, dirEntryIndex, &dirEntry);
-    if (!SUCCEEDED(status))
-    {
-        LOG_FUNC_ERROR("WriteDirEntryToSector", status);
-        return status;
-    }
-
     *SectorsRead = SectorsToRead - sectorsRemaining;
 
     return status;
@@ -560,6 +613,9 @@ FatWriteFile(
     dirEntry.DIR_WrtDate = fatDate;
     dirEntry.DIR_WrtTime = fatTime;
 
+    // the file size and write time kept in the dentry cache are now stale
+    FatDentryCacheInvalidateFile(&FatData->DentryCache, BaseFileSector);
+
     status = WriteDirEntryToSector(FatData, DirEntrySector, dirEntryIndex, &dirEntry);
     if (!SUCCEEDED(status))
     {
@@ -592,6 +648,10 @@ FatSearchDirectoryEntry(
     char normalizedShortName[SHORT_NAME_MAX_LENGTH] = { 0 };
     char normalizedLongName[LONG_NAME_MAX_CHARS + 1] = { 0 };
     DWORD requiredLength;
+    QWORD parentCluster;
+    BYTE cachedAttributes;
+    QWORD cachedEntrySector;
+    FILE_INFORMATION fileInformation;
 
     LOG_FUNC_START;
 
@@ -612,6 +672,52 @@ FatSearchDirectoryEntry(
     index = 0;
     bytesToRead = FatData->BytesPerSector * FatData->SectorsPerCluster;
     requiredLength = 0;
+    parentCluster = 0;
+    cachedAttributes = 0;
+    cachedEntrySector = 0;
+    memzero(&fileInformation, sizeof(FILE_INFORMATION));
+
+    status = ClusterOfSector(FatData, SectorToSearch, &parentCluster);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ClusterOfSector", status);
+        return status;
+    }
+
+    // first check if we have already seen this name in the parent directory
+    status = FatDentryCacheLookup(&FatData->DentryCache,
+                                  parentCluster,
+                                  Name,
+                                  &cachedAttributes,
+                                  SearchResult,
+                                  &cachedEntrySector,
+                                  &fileInformation);
+    if (STATUS_ELEMENT_NOT_FOUND != status)
+    {
+        if (SUCCEEDED(status))
+        {
+            if (cachedAttributes != SearchType)
+            {
+                LOG_WARNING("Found file, but with different attributes, Requested: [0x%x], Found: [0x%x]\n", SearchType, cachedAttributes);
+                LOG_FUNC_END;
+                return STATUS_FILE_TYPE_INVALID;
+            }
+
+            *ParentSector = cachedEntrySector;
+
+            if (NULL != FileInformation)
+            {
+                memcpy(FileInformation, &fileInformation, sizeof(FILE_INFORMATION));
+            }
+        }
+
+        LOG_FUNC_END;
+
+        // either success or STATUS_FILE_NOT_FOUND from a negative entry
+        return status;
+    }
+
+    status = STATUS_SUCCESS;
 
     __try
     {
@@ -728,12 +834,23 @@ FatSearchDirectoryEntry(
                     __leave;
                 }
 
+                // the information is always retrieved because it is kept in the dentry cache
+                _FatPopulateFileInformationFromFatEntry(FatData, &pEntry[index], &fileInformation);
+
                 if (NULL != FileInformation)
                 {
                     // if the user requested the file size we set it
-                    _FatPopulateFileInformationFromFatEntry(FatData, &pEntry[index], FileInformation);
+                    memcpy(FileInformation, &fileInformation, sizeof(FILE_INFORMATION));
                 }
 
+                FatDentryCacheInsert(&FatData->DentryCache,
+                                     parentCluster,
+                                     Name,
+                                     maskResult,
+                                     *SearchResult,
+                                     sectorToParse,
+                                     &fileInformation);
+
                 // we go to clean even if success or failure
                 __leave;
             }
@@ -761,6 +878,13 @@ FatSearchDirectoryEntry(
             pEntry = NULL;
         }
 
+        if (STATUS_FILE_NOT_FOUND == status)
+        {
+            // remember the name does not exist so the next search won't
+            // have to parse the whole directory again
+            FatDentryCacheInsertNegative(&FatData->DentryCache, parentCluster, Name);
+        }
+
         LOG_FUNC_END;
     }
 
@@ -1242,6 +1366,23 @@ FatCreateDirectoryEntry(
     }
     __finally
     {
+        QWORD parentCluster;
+        char normalizedShortName[SHORT_NAME_MAX_LENGTH] = { 0 };
+        DWORD shortNameLength;
+
+        // the search done at step 2 left a negative entry for the new name in
+        // the dentry cache, regardless of the outcome we can no longer trust it,
+        // nor a negative entry left by a search for its short name
+        if (SUCCEEDED(ClusterOfSector(FatData, parentSector, &parentCluster)))
+        {
+            FatDentryCacheInvalidate(&FatData->DentryCache, parentCluster, Name + lastBackslashIndex + 1);
+
+            if (SUCCEEDED(ConvertFatNameToName(newEntryName, SHORT_NAME_MAX_LENGTH, normalizedShortName, &shortNameLength)))
+            {
+                FatDentryCacheInvalidate(&FatData->DentryCache, parentCluster, normalizedShortName);
+            }
+        }
+
         if (NULL != pFAT)
         {
             ExFreePoolWithTag(pFAT, HEAP_TEMP_TAG);
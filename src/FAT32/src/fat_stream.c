@@ -0,0 +1,787 @@
+#include "fat32_base.h"
+#include "fat_operations.h"
+#include "fat_stream.h"
+
+static FUNC_ThreadStart _FatStreamWorkerFunction;
+
+static
+void
+_FatStreamQueue(
+    INOUT   PFAT_STREAM             Stream,
+    IN      DWORD                   Operation
+    );
+
+static
+void
+_FatStreamDequeue(
+    INOUT   PFAT_STREAM             Stream
+    );
+
+static
+STATUS
+_FatStreamFlush(
+    INOUT   PFAT_STREAM             Stream
+    );
+
+static
+STATUS
+_FatStreamFill(
+    INOUT   PFAT_STREAM             Stream
+    );
+
+static
+void
+_FatStreamSyncOtherStreams(
+    IN      PFAT_STREAM             Stream,
+    IN      QWORD                   Offset,
+    IN      QWORD                   Length,
+    IN      BOOLEAN                 Write
+    );
+
+static
+STATUS
+_FatStreamReadFromDisk(
+    INOUT                   PFAT_STREAM     Stream,
+    IN                      QWORD           Offset,
+    IN                      QWORD           Length,
+    OUT_WRITES_BYTES(Length)PVOID           Buffer,
+    OUT                     QWORD*          BytesRead
+    );
+
+__forceinline
+static
+BOOLEAN
+_FatStreamRangesOverlap(
+    IN      QWORD                   FirstOffset,
+    IN      QWORD                   FirstLength,
+    IN      QWORD                   SecondOffset,
+    IN      QWORD                   SecondLength
+    )
+{
+    return (0 != FirstLength) &&
+           (0 != SecondLength) &&
+           (FirstOffset < SecondOffset + SecondLength) &&
+           (SecondOffset < FirstOffset + FirstLength);
+}
+
+__forceinline
+static
+void
+_FatStreamAdjustWindow(
+    INOUT   PFAT_STREAM             Stream,
+    IN      BOOLEAN                 Sequential
+    )
+{
+    if (Sequential)
+    {
+        // the window grows each time the reader proves to be sequential
+        if (Stream->SequentialReads++ > 0)
+        {
+            Stream->Window = min(Stream->Window * 2, Stream->MaxWindow);
+        }
+    }
+    else
+    {
+        Stream->SequentialReads = 0;
+        Stream->Window = Stream->MinWindow;
+    }
+}
+
+STATUS
+FatStreamWorkerInit(
+    INOUT   PFAT_DATA               FatData,
+    IN      PDEVICE_OBJECT          FileSystemDevice
+    )
+{
+    STATUS status;
+    PFAT_STREAM_WORKER pWorker;
+
+    ASSERT(NULL != FatData);
+    ASSERT(NULL != FileSystemDevice);
+
+    pWorker = &FatData->StreamWorker;
+
+    pWorker->FileSystemDevice = FileSystemDevice;
+
+    LockInit(&pWorker->QueueLock);
+    InitializeListHead(&pWorker->Queue);
+    InitializeListHead(&pWorker->Streams);
+
+    status = ExEventInit(&pWorker->QueueNotEmpty, ExEventTypeNotification, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        return status;
+    }
+
+    status = ThreadCreate("FAT stream worker",
+                          ThreadPriorityDefault,
+                          _FatStreamWorkerFunction,
+                          FatData,
+                          &pWorker->Thread
+                          );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ThreadCreate", status);
+        return status;
+    }
+
+    return status;
+}
+
+STATUS
+FatStreamCreate(
+    IN      PFAT_DATA               FatData,
+    IN      QWORD                   BaseFileSector,
+    IN      QWORD                   DirEntrySector,
+    IN      QWORD                   FileSize,
+    OUT_PTR PFAT_STREAM*            Stream
+    )
+{
+    PFAT_STREAM pStream;
+
+    ASSERT(NULL != FatData);
+    ASSERT(NULL != Stream);
+
+    pStream = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(FAT_STREAM), HEAP_FS_TAG, 0);
+    if (NULL == pStream)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(FAT_STREAM));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    pStream->FatData = FatData;
+    pStream->BaseFileSector = BaseFileSector;
+    pStream->DirEntrySector = DirEntrySector;
+    pStream->FileSize = AlignAddressUpper(FileSize, FatData->BytesPerSector);
+    pStream->DeferredStatus = STATUS_SUCCESS;
+
+    pStream->MinWindow = FatData->AllocationSize;
+    pStream->MaxWindow = max((DWORD)FAT_STREAM_MAX_READ_AHEAD, FatData->AllocationSize);
+    pStream->Window = pStream->MinWindow;
+
+    pStream->WriteBehindSize = max((DWORD)FAT_STREAM_WRITE_BEHIND_SIZE, FatData->AllocationSize);
+
+    // a reader starting from the beginning of the file is a sequential reader
+    pStream->NextReadOffset = 0;
+
+    InsertTailList(&FatData->StreamWorker.Streams, &pStream->StreamEntry);
+
+    *Stream = pStream;
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+FatStreamClose(
+    IN      PFAT_STREAM             Stream
+    )
+{
+    STATUS status;
+
+    ASSERT(NULL != Stream);
+
+    _FatStreamDequeue(Stream);
+    RemoveEntryList(&Stream->StreamEntry);
+
+    status = _FatStreamFlush(Stream);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_FatStreamFlush", status);
+    }
+    else
+    {
+        status = Stream->DeferredStatus;
+    }
+
+    LOG_TRACE_FILESYSTEM("Stream closed, read-ahead hits: %U, bytes read ahead: 0x%X, flushes: %U\n",
+                         Stream->ReadAheadHits, Stream->BytesReadAhead, Stream->Flushes);
+
+    if (NULL != Stream->ReadAheadBuffer)
+    {
+        ExFreePoolWithTag(Stream->ReadAheadBuffer, HEAP_FS_TAG);
+        Stream->ReadAheadBuffer = NULL;
+    }
+
+    if (NULL != Stream->WriteBehindBuffer)
+    {
+        ExFreePoolWithTag(Stream->WriteBehindBuffer, HEAP_FS_TAG);
+        Stream->WriteBehindBuffer = NULL;
+    }
+
+    ExFreePoolWithTag(Stream, HEAP_FS_TAG);
+
+    return status;
+}
+
+STATUS
+FatStreamRead(
+    INOUT                   PFAT_STREAM     Stream,
+    IN                      QWORD           Offset,
+    IN                      QWORD           Length,
+    OUT_WRITES_BYTES(Length)PVOID           Buffer,
+    IN                      BOOLEAN         Asynchronous,
+    OUT                     QWORD*          BytesRead
+    )
+{
+    STATUS status;
+    BOOLEAN sequential;
+    QWORD bytesDone;
+    QWORD bytesFromDisk;
+    QWORD readAheadEnd;
+
+    ASSERT(NULL != Stream);
+    ASSERT(NULL != Buffer);
+    ASSERT(NULL != BytesRead);
+
+    status = STATUS_SUCCESS;
+    sequential = (Offset == Stream->NextReadOffset);
+    bytesDone = 0;
+    bytesFromDisk = 0;
+
+    Stream->Asynchronous = Asynchronous;
+
+    // if the worker didn't get to the read-ahead yet we'll do it ourselves
+    Stream->PendingOperations = Stream->PendingOperations & (~FAT_STREAM_OPERATION_READ_AHEAD);
+
+    // the data on the disk is stale if we have dirty data in the range
+    if (_FatStreamRangesOverlap(Offset, Length, Stream->DirtyOffset, Stream->DirtyLength))
+    {
+        status = _FatStreamFlush(Stream);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_FatStreamFlush", status);
+            return status;
+        }
+    }
+
+    // or if another handle of the file has
+    _FatStreamSyncOtherStreams(Stream, Offset, Length, FALSE);
+
+    _FatStreamAdjustWindow(Stream, sequential);
+
+    readAheadEnd = Stream->ReadAheadOffset + Stream->ReadAheadLength;
+
+    if (sequential &&
+        !(Stream->ReadAheadOffset <= Offset && Offset + Length <= readAheadEnd))
+    {
+        // sequential miss: read a whole window instead of only what was
+        // requested, the following reads will be satisfied from memory
+        status = _FatStreamFill(Stream);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_FatStreamFill", status);
+            return status;
+        }
+
+        readAheadEnd = Stream->ReadAheadOffset + Stream->ReadAheadLength;
+    }
+
+    if (0 != Stream->ReadAheadLength &&
+        Stream->ReadAheadOffset <= Offset && Offset < readAheadEnd)
+    {
+        bytesDone = min(Length, readAheadEnd - Offset);
+
+        memcpy(Buffer, Stream->ReadAheadBuffer + (Offset - Stream->ReadAheadOffset), (DWORD)bytesDone);
+        Stream->ReadAheadHits++;
+    }
+
+    if (bytesDone < Length)
+    {
+        status = _FatStreamReadFromDisk(Stream,
+                                        Offset + bytesDone,
+                                        Length - bytesDone,
+                                        (PBYTE)Buffer + bytesDone,
+                                        &bytesFromDisk);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_FatStreamReadFromDisk", status);
+            return status;
+        }
+
+        bytesDone = bytesDone + bytesFromDisk;
+    }
+
+    Stream->NextReadOffset = Offset + bytesDone;
+
+    if (sequential && bytesDone == Length)
+    {
+        readAheadEnd = Stream->ReadAheadOffset + Stream->ReadAheadLength;
+
+        // start reading the next window while the caller is busy with this
+        // chunk if less than half of the current window is left in memory
+        if (Stream->NextReadOffset < Stream->FileSize &&
+            (readAheadEnd <= Stream->NextReadOffset ||
+             readAheadEnd - Stream->NextReadOffset < Stream->Window / 2))
+        {
+            _FatStreamQueue(Stream, FAT_STREAM_OPERATION_READ_AHEAD);
+        }
+    }
+
+    *BytesRead = bytesDone;
+
+    return status;
+}
+
+STATUS
+FatStreamWrite(
+    INOUT                   PFAT_STREAM     Stream,
+    IN                      QWORD           Offset,
+    IN                      QWORD           Length,
+    IN_READS_BYTES(Length)  PVOID           Buffer,
+    IN                      BOOLEAN         Asynchronous,
+    OUT                     QWORD*          BytesWritten
+    )
+{
+    STATUS status;
+    PFAT_DATA pFatData;
+    QWORD sectorsWritten;
+    BOOLEAN contiguous;
+
+    ASSERT(NULL != Stream);
+    ASSERT(NULL != Buffer);
+    ASSERT(NULL != BytesWritten);
+
+    pFatData = Stream->FatData;
+    sectorsWritten = 0;
+
+    *BytesWritten = 0;
+
+    if (!SUCCEEDED(Stream->DeferredStatus))
+    {
+        // a previous write-behind failed, let the writer know
+        status = Stream->DeferredStatus;
+        Stream->DeferredStatus = STATUS_SUCCESS;
+        return status;
+    }
+
+    Stream->Asynchronous = Asynchronous;
+
+    // the read-ahead data is no longer valid
+    if (_FatStreamRangesOverlap(Offset, Length, Stream->ReadAheadOffset, Stream->ReadAheadLength))
+    {
+        Stream->ReadAheadLength = 0;
+        Stream->PendingOperations = Stream->PendingOperations & (~FAT_STREAM_OPERATION_READ_AHEAD);
+    }
+
+    // neither is the read-ahead data of the other handles of the file, and
+    // their older dirty data must not overwrite ours later
+    _FatStreamSyncOtherStreams(Stream, Offset, Length, TRUE);
+
+    contiguous = (Offset == Stream->DirtyOffset + Stream->DirtyLength);
+
+    if (0 != Stream->DirtyLength &&
+        (!contiguous || Stream->DirtyLength + Length > Stream->WriteBehindSize))
+    {
+        status = _FatStreamFlush(Stream);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_FatStreamFlush", status);
+            return status;
+        }
+    }
+
+    if (NULL == Stream->WriteBehindBuffer && Length < Stream->WriteBehindSize)
+    {
+        Stream->WriteBehindBuffer = ExAllocatePoolWithTag(0, Stream->WriteBehindSize, HEAP_FS_TAG, 0);
+        if (NULL == Stream->WriteBehindBuffer)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", Stream->WriteBehindSize);
+        }
+    }
+
+    if (Length >= Stream->WriteBehindSize || NULL == Stream->WriteBehindBuffer)
+    {
+        ASSERT(0 == Stream->DirtyLength);
+
+        // large writes are already efficient, write them directly
+        status = FatWriteFile(pFatData,
+                              Stream->BaseFileSector,
+                              Offset / pFatData->BytesPerSector,
+                              Stream->DirEntrySector,
+                              Buffer,
+                              Length / pFatData->BytesPerSector,
+                              &sectorsWritten,
+                              Asynchronous);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("FatWriteFile", status);
+            return status;
+        }
+
+        *BytesWritten = sectorsWritten * pFatData->BytesPerSector;
+    }
+    else
+    {
+        if (0 == Stream->DirtyLength)
+        {
+            Stream->DirtyOffset = Offset;
+        }
+
+        memcpy(Stream->WriteBehindBuffer + Stream->DirtyLength, Buffer, (DWORD)Length);
+        Stream->DirtyLength = Stream->DirtyLength + (DWORD)Length;
+
+        *BytesWritten = Length;
+
+        // the worker will flush the data once the device is no longer used,
+        // if more contiguous writes come until then they will be coalesced
+        _FatStreamQueue(Stream, FAT_STREAM_OPERATION_FLUSH);
+    }
+
+    Stream->FileSize = max(Stream->FileSize, Offset + *BytesWritten);
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+(__cdecl _FatStreamWorkerFunction)(
+    IN_OPT      PVOID       Context
+    )
+{
+    PFAT_DATA pFatData;
+    PFAT_STREAM_WORKER pWorker;
+    PFAT_STREAM pStream;
+    PLIST_ENTRY pEntry;
+    INTR_STATE intrState;
+    DWORD operations;
+    STATUS status;
+
+    ASSERT(NULL != Context);
+
+    pFatData = Context;
+    pWorker = &pFatData->StreamWorker;
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        pStream = NULL;
+
+        ExEventWaitForSignal(&pWorker->QueueNotEmpty);
+
+        // take the device lock first, this way a stream cannot be closed
+        // between the moment we remove it from the queue and the moment we
+        // finish working on it
+        MutexAcquire(&pWorker->FileSystemDevice->DeviceLock);
+
+        LockAcquire(&pWorker->QueueLock, &intrState);
+        pEntry = RemoveHeadList(&pWorker->Queue);
+        if (pEntry == &pWorker->Queue)
+        {
+            ExEventClearSignal(&pWorker->QueueNotEmpty);
+        }
+        else
+        {
+            pStream = CONTAINING_RECORD(pEntry, FAT_STREAM, QueueEntry);
+            pStream->Queued = FALSE;
+        }
+        LockRelease(&pWorker->QueueLock, intrState);
+
+        if (NULL != pStream)
+        {
+            operations = pStream->PendingOperations;
+            pStream->PendingOperations = 0;
+
+            if (IsBooleanFlagOn(operations, FAT_STREAM_OPERATION_FLUSH))
+            {
+                status = _FatStreamFlush(pStream);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("_FatStreamFlush", status);
+                    pStream->DeferredStatus = status;
+                }
+            }
+
+            if (IsBooleanFlagOn(operations, FAT_STREAM_OPERATION_READ_AHEAD))
+            {
+                // on failure the reader will simply go to the disk itself
+                status = _FatStreamFill(pStream);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("_FatStreamFill", status);
+                }
+            }
+        }
+
+        MutexRelease(&pWorker->FileSystemDevice->DeviceLock);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_FatStreamQueue(
+    INOUT   PFAT_STREAM             Stream,
+    IN      DWORD                   Operation
+    )
+{
+    PFAT_STREAM_WORKER pWorker;
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Stream);
+
+    pWorker = &Stream->FatData->StreamWorker;
+
+    Stream->PendingOperations = Stream->PendingOperations | Operation;
+
+    LockAcquire(&pWorker->QueueLock, &intrState);
+    if (!Stream->Queued)
+    {
+        InsertTailList(&pWorker->Queue, &Stream->QueueEntry);
+        Stream->Queued = TRUE;
+
+        ExEventSignal(&pWorker->QueueNotEmpty);
+    }
+    LockRelease(&pWorker->QueueLock, intrState);
+}
+
+static
+void
+_FatStreamDequeue(
+    INOUT   PFAT_STREAM             Stream
+    )
+{
+    PFAT_STREAM_WORKER pWorker;
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Stream);
+
+    pWorker = &Stream->FatData->StreamWorker;
+
+    LockAcquire(&pWorker->QueueLock, &intrState);
+    if (Stream->Queued)
+    {
+        RemoveEntryList(&Stream->QueueEntry);
+        Stream->Queued = FALSE;
+    }
+    LockRelease(&pWorker->QueueLock, intrState);
+
+    Stream->PendingOperations = 0;
+}
+
+static
+STATUS
+_FatStreamFlush(
+    INOUT   PFAT_STREAM             Stream
+    )
+{
+    STATUS status;
+    PFAT_DATA pFatData;
+    QWORD sectorsWritten;
+
+    ASSERT(NULL != Stream);
+
+    if (0 == Stream->DirtyLength)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    pFatData = Stream->FatData;
+    sectorsWritten = 0;
+
+    LOG_TRACE_FILESYSTEM("Flushing 0x%x bytes at offset 0x%X\n", Stream->DirtyLength, Stream->DirtyOffset);
+
+    status = FatWriteFile(pFatData,
+                          Stream->BaseFileSector,
+                          Stream->DirtyOffset / pFatData->BytesPerSector,
+                          Stream->DirEntrySector,
+                          Stream->WriteBehindBuffer,
+                          Stream->DirtyLength / pFatData->BytesPerSector,
+                          &sectorsWritten,
+                          Stream->Asynchronous);
+
+    // even if we failed there is no point in retrying the same write
+    Stream->DirtyLength = 0;
+    Stream->Flushes++;
+
+    return status;
+}
+
+static
+STATUS
+_FatStreamFill(
+    INOUT   PFAT_STREAM             Stream
+    )
+{
+    STATUS status;
+    QWORD start;
+    QWORD end;
+    QWORD keep;
+    QWORD bytesRead;
+
+    ASSERT(NULL != Stream);
+
+    start = Stream->NextReadOffset;
+    end = min(start + Stream->Window, Stream->FileSize);
+    keep = 0;
+    bytesRead = 0;
+
+    if (start >= end)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    if (_FatStreamRangesOverlap(start, end - start, Stream->DirtyOffset, Stream->DirtyLength))
+    {
+        status = _FatStreamFlush(Stream);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_FatStreamFlush", status);
+            return status;
+        }
+    }
+
+    _FatStreamSyncOtherStreams(Stream, start, end - start, FALSE);
+
+    if (NULL == Stream->ReadAheadBuffer)
+    {
+        Stream->ReadAheadBuffer = ExAllocatePoolWithTag(0, Stream->MaxWindow, HEAP_FS_TAG, 0);
+        if (NULL == Stream->ReadAheadBuffer)
+        {
+            // we can live without read-ahead
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", Stream->MaxWindow);
+            return STATUS_SUCCESS;
+        }
+    }
+
+    // keep the data we already have and which follows the reader
+    if (0 != Stream->ReadAheadLength &&
+        Stream->ReadAheadOffset <= start && start < Stream->ReadAheadOffset + Stream->ReadAheadLength)
+    {
+        keep = min(Stream->ReadAheadOffset + Stream->ReadAheadLength - start, end - start);
+
+        memmove(Stream->ReadAheadBuffer,
+                Stream->ReadAheadBuffer + (start - Stream->ReadAheadOffset),
+                (DWORD)keep);
+    }
+
+    Stream->ReadAheadOffset = start;
+    Stream->ReadAheadLength = (DWORD)keep;
+
+    if (start + keep < end)
+    {
+        status = _FatStreamReadFromDisk(Stream,
+                                        start + keep,
+                                        end - start - keep,
+                                        Stream->ReadAheadBuffer + keep,
+                                        &bytesRead);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_FatStreamReadFromDisk", status);
+            return status;
+        }
+
+        Stream->ReadAheadLength = Stream->ReadAheadLength + (DWORD)bytesRead;
+        Stream->BytesReadAhead = Stream->BytesReadAhead + bytesRead;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_FatStreamSyncOtherStreams(
+    IN      PFAT_STREAM             Stream,
+    IN      QWORD                   Offset,
+    IN      QWORD                   Length,
+    IN      BOOLEAN                 Write
+    )
+{
+    PLIST_ENTRY pStreamList;
+    PLIST_ENTRY pEntry;
+    PFAT_STREAM pOther;
+    STATUS status;
+
+    ASSERT(NULL != Stream);
+
+    pStreamList = &Stream->FatData->StreamWorker.Streams;
+
+    for (pEntry = pStreamList->Flink;
+         pEntry != pStreamList;
+         pEntry = pEntry->Flink)
+    {
+        pOther = CONTAINING_RECORD(pEntry, FAT_STREAM, StreamEntry);
+
+        if (pOther == Stream || pOther->BaseFileSector != Stream->BaseFileSector)
+        {
+            continue;
+        }
+
+        if (_FatStreamRangesOverlap(Offset, Length, pOther->DirtyOffset, pOther->DirtyLength))
+        {
+            // the failure belongs to the other handle, it is reported to its
+            // writer the same way as a failed write-behind of the worker
+            status = _FatStreamFlush(pOther);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_FatStreamFlush", status);
+                pOther->DeferredStatus = status;
+            }
+        }
+
+        if (Write)
+        {
+            if (_FatStreamRangesOverlap(Offset, Length, pOther->ReadAheadOffset, pOther->ReadAheadLength))
+            {
+                pOther->ReadAheadLength = 0;
+                pOther->PendingOperations = pOther->PendingOperations & (~FAT_STREAM_OPERATION_READ_AHEAD);
+            }
+
+            // the other readers may read ahead up to the new end of the file
+            pOther->FileSize = max(pOther->FileSize, AlignAddressUpper(Offset + Length, Stream->FatData->BytesPerSector));
+        }
+    }
+}
+
+static
+STATUS
+_FatStreamReadFromDisk(
+    INOUT                   PFAT_STREAM     Stream,
+    IN                      QWORD           Offset,
+    IN                      QWORD           Length,
+    OUT_WRITES_BYTES(Length)PVOID           Buffer,
+    OUT                     QWORD*          BytesRead
+    )
+{
+    STATUS status;
+    PFAT_DATA pFatData;
+    QWORD sectorsRead;
+
+    ASSERT(NULL != Stream);
+    ASSERT(NULL != Buffer);
+    ASSERT(NULL != BytesRead);
+
+    pFatData = Stream->FatData;
+    sectorsRead = 0;
+
+    if (!Stream->AccessDateUpdated)
+    {
+        // updating the last access date requires a write to the directory
+        // entry, once per open is enough
+        status = FatReadFile(pFatData,
+                             Stream->BaseFileSector,
+                             Offset / pFatData->BytesPerSector,
+                             Stream->DirEntrySector,
+                             Buffer,
+                             Length / pFatData->BytesPerSector,
+                             &sectorsRead,
+                             Stream->Asynchronous);
+        Stream->AccessDateUpdated = SUCCEEDED(status);
+    }
+    else
+    {
+        status = FatReadFileData(pFatData,
+                                 Stream->BaseFileSector,
+                                 Offset / pFatData->BytesPerSector,
+                                 Buffer,
+                                 Length / pFatData->BytesPerSector,
+                                 &sectorsRead,
+                                 Stream->Asynchronous);
+    }
+
+    *BytesRead = sectorsRead * pFatData->BytesPerSector;
+
+    return status;
+}
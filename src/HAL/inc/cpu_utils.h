@@ -86,3 +86,23 @@ CpuIsIntel(
              cpuId.edx == 'Ieni' &&
              cpuId.ecx == 'letn' );
 }
+
+__forceinline
+extern
+BOOLEAN
+CpuHasInvariantTsc(
+    void
+    )
+{
+    CPUID_INFO cpuId;
+
+    __cpuid(cpuId.values, CpuidIdxExtendedMaxFunction);
+    if (cpuId.ExtendedInformation.MaxValueForExtendedInfo < CpuidIdxAdvancedPowerManagement)
+    {
+        return FALSE;
+    }
+
+    __cpuid(cpuId.values, CpuidIdxAdvancedPowerManagement);
+
+    return (BOOLEAN) cpuId.AdvancedPowerManagement.edx.InvariantTsc;
+}
\ No newline at end of file
@@ -17,6 +17,7 @@ typedef enum _CPUID_IDX
     CpuidIdxExtendedStateEnumerationMainLeaf    = 0xD,
     CpuidIdxExtendedMaxFunction                 = 0x8000'0000,
     CpuidIdxExtendedFeatureInformation          = 0x8000'0001,
+    CpuidIdxAdvancedPowerManagement             = 0x8000'0007,
     CpuidIdxProcessorAddressSizes               = 0x8000'0008,
 } CPUID_IDX;
 
@@ -314,6 +315,26 @@ typedef struct _CPUID_EXTENDED_FEATURE_INFORMATION
 } CPUID_EXTENDED_FEATURE_INFORMATION, *PCPUID_EXTENDED_FEATURE_INFORMATION;
 STATIC_ASSERT(sizeof(CPUID_EXTENDED_FEATURE_INFORMATION) == sizeof(DWORD) * 4);
 
+// 0x8000'0007
+typedef struct _CPUID_EDX_ADVANCED_POWER_MANAGEMENT
+{
+    DWORD                                   __Reserved0         : 8;
+
+    // the TSC runs at a constant rate in all the ACPI P-, C- and T-states
+    DWORD                                   InvariantTsc        : 1;
+    DWORD                                   __Reserved1         : 23;
+} CPUID_EDX_ADVANCED_POWER_MANAGEMENT, *PCPUID_EDX_ADVANCED_POWER_MANAGEMENT;
+STATIC_ASSERT(sizeof(CPUID_EDX_ADVANCED_POWER_MANAGEMENT) == sizeof(DWORD));
+
+typedef struct _CPUID_ADVANCED_POWER_MANAGEMENT
+{
+    DWORD                                   __Reserved0;
+    DWORD                                   __Reserved1;
+    DWORD                                   __Reserved2;
+    CPUID_EDX_ADVANCED_POWER_MANAGEMENT     edx;
+} CPUID_ADVANCED_POWER_MANAGEMENT, *PCPUID_ADVANCED_POWER_MANAGEMENT;
+STATIC_ASSERT(sizeof(CPUID_ADVANCED_POWER_MANAGEMENT) == sizeof(DWORD) * 4);
+
 // 0x8000'0008
 typedef struct _CPUID_EAX_PROCESSOR_ADDRESS_SIZES_INFORMATION
 {
@@ -367,6 +388,9 @@ typedef struct _CPUID_INFO
         // 0x8000'0001
         CPUID_EXTENDED_FEATURE_INFORMATION          ExtendedFeatures;
 
+        // 0x8000'0007
+        CPUID_ADVANCED_POWER_MANAGEMENT             AdvancedPowerManagement;
+
         // 0x8000'0008
         CPUID_PROCESSOR_ADDRESS_SIZES_INFORMATION   CpuAddressSizes;
     };
@@ -49,6 +49,15 @@ LapicConfigureLvtRegisters(
     IN      BYTE                            ErrorInterruptVector
     );
 
+// Programs the LVT entry through which the PMU counter overflows are delivered,
+// the CPU masks it each time an overflow interrupt is delivered
+void
+LapicConfigurePerfCounterInterrupt(
+    IN      PVOID                           ApicBaseAddress,
+    IN      BYTE                            PerfCounterInterruptVector,
+    IN      BOOLEAN                         Enable
+    );
+
 void
 LapicSendEOI(
     IN      PVOID                           ApicBaseAddress,
@@ -33,6 +33,14 @@
 #define     IA32_SYSENTER_ESP                   0x00000175
 #define     IA32_SYSENTER_EIP                   0x00000176
 
+// IA32_PERFEVTSELx
+// Bits 15:8    - Unit mask
+// Bits 7:0     - Event select
+#define     IA32_PERFEVTSEL_USR                 ((QWORD)1<<16)
+#define     IA32_PERFEVTSEL_OS                  ((QWORD)1<<17)
+#define     IA32_PERFEVTSEL_INT                 ((QWORD)1<<20)
+#define     IA32_PERFEVTSEL_EN                  ((QWORD)1<<22)
+
 #define     IA32_PERFEVTSEL0                    0x00000186
 
 // IA32_MISC_ENABLE
@@ -130,8 +138,20 @@
 
 #define     IA32_MTRR_DEF_TYPE                  0x000002FF
 
+// IA32_FIXED_CTR0 - instructions retired
+// IA32_FIXED_CTR1 - core cycles
+// IA32_FIXED_CTR2 - reference cycles
+#define     IA32_FIXED_CTR0                     0x00000309
+
 // PERF GLOBAL CONTROL
 #define     IA32_PERF_GLOBAL_CTRL_ENABLE_PMC_BIT_BASE   0
+#define     IA32_PERF_GLOBAL_CTRL_ENABLE_FIXED_BIT_BASE 32
+
+// IA32_FIXED_CTR_CTRL, each fixed counter is controlled by 4 bits
+#define     IA32_FIXED_CTR_CTRL_OS                  ((QWORD)1<<0)
+#define     IA32_FIXED_CTR_CTRL_USR                 ((QWORD)1<<1)
+#define     IA32_FIXED_CTR_CTRL_PMI                 ((QWORD)1<<3)
+#define     IA32_FIXED_CTR_CTRL_BITS_PER_COUNTER    4
 
 #define     IA32_PERF_CAPABILITIES                  0x00000345
 #define     IA32_FIXED_CTR_CTRL                     0x0000038D
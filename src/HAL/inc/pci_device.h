@@ -17,6 +17,11 @@ PciDevRetrieveNextCapability(
     OUT_PTR PPCI_CAPABILITY_HEADER* NextCapability
     );
 
+// The following functions only update the configuration space of the device
+// through DeviceData. For PCI express devices it is memory mapped, for the
+// others it is a copy and the caller must write the changed registers back
+// through the legacy configuration mechanism, serialized with the other
+// accesses to it.
 STATUS
 PciDevDisableLegacyInterrupts(
     IN      PPCI_DEVICE_DESCRIPTION Device
@@ -35,4 +40,25 @@ PciDevProgramMsiInterrupt(
             APIC_PIN_POLARITY       PinPolarity,
     IN _Strict_type_match_
             APIC_TRIGGER_MODE       TriggerMode
-);
\ No newline at end of file
+);
+
+STATUS
+PciDevGetMsiXTable(
+    IN      PPCI_DEVICE_DESCRIPTION Device,
+    OUT     PHYSICAL_ADDRESS*       TableAddress,
+    OUT     WORD*                   NumberOfEntries
+    );
+
+// TableEntry must be mapped by the caller, the entry is left unmasked and
+// MSI-X is enabled for the whole function
+STATUS
+PciDevProgramMsiXInterrupt(
+    IN      PPCI_DEVICE_DESCRIPTION Device,
+    IN      PPCI_MSIX_TABLE_ENTRY   TableEntry,
+    IN      BYTE                    Vector,
+    IN _Strict_type_match_
+            APIC_DESTINATION_MODE   DestinationMode,
+    IN      BYTE                    Destination,
+    IN _Strict_type_match_
+            APIC_DELIVERY_MODE      DeliveryMode
+    );
\ No newline at end of file
@@ -14,6 +14,7 @@
 
 #define PREDEFINED_PCI_MSI_ADDRESS_REGISTER_SIZE    4
 #define PREDEFINED_PCI_MSI_DATA_REGISTER_SIZE       2
+#define PREDEFINED_PCI_MSIX_TABLE_ENTRY_SIZE        16
 
 #define PCI_DEVICE_NO_OF_BARS                       6U
 #define PCI_BRIDGE_NO_OF_BARS                       2U
@@ -341,12 +342,80 @@ typedef volatile struct _PCI_CAPABILITY_MSI
     };
 } PCI_CAPABILITY_MSI, *PPCI_CAPABILITY_MSI;
 
+typedef union _PCI_MSIX_STRUCTURE_LOCATION
+{
+    struct
+    {
+        // Indicates which one of the function's BARs is used to map the
+        // structure into memory space.
+        DWORD                           BarIndicator                :   3;
+
+        // The offset is QWORD aligned, its lower 3 bits are occupied by the
+        // BIR => use PCI_MSIX_STRUCTURE_OFFSET to retrieve it.
+        DWORD                           __OffsetHigh                :  29;
+    };
+    DWORD                               Raw;
+} PCI_MSIX_STRUCTURE_LOCATION, *PPCI_MSIX_STRUCTURE_LOCATION;
+STATIC_ASSERT(sizeof(PCI_MSIX_STRUCTURE_LOCATION) == sizeof(DWORD));
+
+#define PCI_MSIX_STRUCTURE_OFFSET(Loc)  ((Loc).Raw & 0xFFFF'FFF8)
+
 typedef volatile struct _PCI_CAPABILITY_MSIX
 {
-    PCI_CAPABILITY_HEADER       Header;
-    WORD                        MessageControl;
+    PCI_CAPABILITY_HEADER               Header;
+    union
+    {
+        struct
+        {
+            // RO - encoded as N - 1
+            WORD                        TableSize                   :  11;
+
+            WORD                        __Reserved0                 :   3;
+
+            // RW - if set all the vectors of the function are masked,
+            // regardless of their per-vector mask bit
+            WORD                        FunctionMask                :   1;
+
+            // RW
+            WORD                        MsiXEnable                  :   1;
+        };
+        WORD                            Raw;
+    } MessageControl;
+
+    PCI_MSIX_STRUCTURE_LOCATION         Table;
+    PCI_MSIX_STRUCTURE_LOCATION         PendingBitArray;
 } PCI_CAPABILITY_MSIX, *PPCI_CAPABILITY_MSIX;
 
+// Each MSI-X table entry lives in the memory space of the device and not in
+// its configuration space
+typedef volatile struct _PCI_MSIX_TABLE_ENTRY
+{
+    PCI_MSI_ADDRESS_REGISTER            MessageAddressLower;
+    DWORD                               MessageAddressHigher;
+
+    // only the lower WORD is used, it has the same format as the MSI data
+    // register
+    union
+    {
+        PCI_MSI_DATA_REGISTER           MessageData;
+        DWORD                           Raw;
+    } MessageData;
+
+    union
+    {
+        struct
+        {
+            // While set the function is prohibited from sending a message
+            // using this entry
+            DWORD                       Masked                      :   1;
+
+            DWORD                       __Reserved0                 :  31;
+        };
+        DWORD                           Raw;
+    } VectorControl;
+} PCI_MSIX_TABLE_ENTRY, *PPCI_MSIX_TABLE_ENTRY;
+STATIC_ASSERT(sizeof(PCI_MSIX_TABLE_ENTRY) == PREDEFINED_PCI_MSIX_TABLE_ENTRY_SIZE);
+
 typedef volatile struct _PCI_DEVICE_HEADER
 {
     // 0x10
@@ -275,6 +275,28 @@ LapicConfigureLvtRegisters(
     // ...
 }
 
+void
+LapicConfigurePerfCounterInterrupt(
+    IN      PVOID                           ApicBaseAddress,
+    IN      BYTE                            PerfCounterInterruptVector,
+    IN      BOOLEAN                         Enable
+    )
+{
+    LVT_REGISTER lvt;
+    PLAPIC pLapic;
+
+    pLapic = (PLAPIC)ApicBaseAddress;
+
+    ASSERT(NULL != pLapic);
+
+    lvt.Raw = 0;
+    lvt.Vector = PerfCounterInterruptVector;
+    lvt.DeliveryMode = ApicDeliveryModeFixed;
+    lvt.Masked = !Enable;
+
+    pLapic->LvtPerformanceMonitoringCounters.Value = lvt.Raw;
+}
+
 PHYSICAL_ADDRESS
 LapicGetBasePhysicalAddress(
     void
@@ -1,13 +1,6 @@
 #include "hal_base.h"
 #include "pci_device.h"
 
-static
-void
-_PciDevProgramIoPortMsiInterrupt(
-    IN      PPCI_DEVICE_DESCRIPTION Device,
-    IN      PPCI_CAPABILITY_MSI     PciCap
-    );
-
 STATUS
 PciDevRetrieveCapabilityById(
     IN      PPCI_DEVICE             Device,
@@ -103,15 +96,6 @@ PciDevDisableLegacyInterrupts(
 
     Device->DeviceData->Header.Command.InterruptDisable = TRUE;
 
-    if (!Device->PciExpressDevice)
-    {
-        // disable legacy interrupts
-        PciWriteConfigurationSpace(Device->DeviceLocation,
-                                   FIELD_OFFSET(PCI_COMMON_HEADER, Command),
-                                   *(DWORD*)&Device->DeviceData->Header.Command
-                                   );
-    }
-
     return STATUS_SUCCESS;
 }
 
@@ -181,57 +165,130 @@ PciDevProgramMsiInterrupt(
 
     pciCap->MessageControl.MsiEnable = TRUE;
 
-    if (!Device->PciExpressDevice)
+    return STATUS_SUCCESS;
+}
+
+STATUS
+PciDevGetMsiXTable(
+    IN      PPCI_DEVICE_DESCRIPTION Device,
+    OUT     PHYSICAL_ADDRESS*       TableAddress,
+    OUT     WORD*                   NumberOfEntries
+    )
+{
+    STATUS status;
+    PPCI_CAPABILITY_MSIX pciCap;
+    PPCI_BAR pBar;
+    BYTE barIndex;
+
+    if (NULL == Device)
     {
-        _PciDevProgramIoPortMsiInterrupt(Device, pciCap);
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == TableAddress)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == NumberOfEntries)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    pciCap = NULL;
+
+    status = PciDevRetrieveCapabilityById(Device->DeviceData,
+                                          PCI_CAPABILITY_ID_MSIX,
+                                          (PPCI_CAPABILITY_HEADER*)&pciCap
+    );
+    if (!SUCCEEDED(status))
+    {
+        return STATUS_DEVICE_INTERRUPT_TYPE_NOT_SUPPORTED;
+    }
+    ASSERT(NULL != pciCap);
+
+    barIndex = (BYTE) pciCap->Table.BarIndicator;
+    if (barIndex >= PCI_DEVICE_NO_OF_BARS)
+    {
+        return STATUS_DEVICE_INTERRUPT_TYPE_NOT_SUPPORTED;
+    }
+
+    pBar = &Device->DeviceData->Header.Device.Bar[barIndex];
+    if (0 != pBar->MemorySpace.Zero)
+    {
+        // the table must always be mapped in memory space
+        return STATUS_DEVICE_INTERRUPT_TYPE_NOT_SUPPORTED;
     }
 
+    *TableAddress = PtrOffset(PCI_GET_PA_FROM_MEM_ADDR(pBar), PCI_MSIX_STRUCTURE_OFFSET(pciCap->Table));
+    *NumberOfEntries = (WORD) pciCap->MessageControl.TableSize + 1;
+
     return STATUS_SUCCESS;
 }
 
-static
-void
-_PciDevProgramIoPortMsiInterrupt(
+STATUS
+PciDevProgramMsiXInterrupt(
     IN      PPCI_DEVICE_DESCRIPTION Device,
-    IN      PPCI_CAPABILITY_MSI     PciCap
+    IN      PPCI_MSIX_TABLE_ENTRY   TableEntry,
+    IN      BYTE                    Vector,
+    IN _Strict_type_match_
+            APIC_DESTINATION_MODE   DestinationMode,
+    IN      BYTE                    Destination,
+    IN _Strict_type_match_
+            APIC_DELIVERY_MODE      DeliveryMode
     )
-{  
-
-    ASSERT(NULL != Device);
-    ASSERT(NULL != PciCap);
-
-    // write Message Address Lower
-    PciWriteConfigurationSpace(Device->DeviceLocation,
-                               (BYTE)(PtrDiff(PciCap,Device->DeviceData) + FIELD_OFFSET(PCI_CAPABILITY_MSI,MessageAddressLower)),
-                               *((PDWORD)PciCap + 1)
-                               );
+{
+    STATUS status;
+    PPCI_CAPABILITY_MSIX pciCap;
+    PCI_MSI_DATA_REGISTER msgData;
+    PCI_MSI_ADDRESS_REGISTER msgAddrLower;
 
-    if (PciCap->MessageControl.Is64BitCapable)
+    if (NULL == Device)
     {
-        // write message address upper
-        PciWriteConfigurationSpace(Device->DeviceLocation,
-                                   (BYTE)(PtrDiff(PciCap,Device->DeviceData) + FIELD_OFFSET(PCI_CAPABILITY_MSI,Capability64Bit.MessageAddressHigher)),
-                                   *((PDWORD)PciCap + 2)
-                                   );
+        return STATUS_INVALID_PARAMETER1;
+    }
 
-        // write message data
-        PciWriteConfigurationSpace(Device->DeviceLocation,
-                                   (BYTE)(PtrDiff(PciCap, Device->DeviceData) + FIELD_OFFSET(PCI_CAPABILITY_MSI, Capability64Bit.MessageData)),
-                                   *((PDWORD)PciCap + 3)
-                                   );
+    if (NULL == TableEntry)
+    {
+        return STATUS_INVALID_PARAMETER2;
     }
-    else
+
+    pciCap = NULL;
+    msgData.Raw = 0;
+    msgAddrLower.Raw = 0;
+
+    status = PciDevRetrieveCapabilityById(Device->DeviceData,
+                                          PCI_CAPABILITY_ID_MSIX,
+                                          (PPCI_CAPABILITY_HEADER*)&pciCap
+    );
+    if (!SUCCEEDED(status))
     {
-        // write message data
-        PciWriteConfigurationSpace(Device->DeviceLocation,
-                                   (BYTE)(PtrDiff(PciCap, Device->DeviceData) + FIELD_OFFSET(PCI_CAPABILITY_MSI, Capability32Bit.MessageData)),
-                                   *((PDWORD)PciCap + 2)
-                                   );
+        return STATUS_DEVICE_INTERRUPT_TYPE_NOT_SUPPORTED;
     }
+    ASSERT(NULL != pciCap);
 
-    // write Message Control, this will enable MSI interrupts
-    PciWriteConfigurationSpace(Device->DeviceLocation,
-                               (BYTE)(PtrDiff(PciCap, Device->DeviceData)),
-                               *(PDWORD)PciCap
-                               );
-}
\ No newline at end of file
+    msgAddrLower.DestinationId = Destination;
+    msgAddrLower.DestinationMode = DestinationMode;
+    msgAddrLower.RedirectionHint = (ApicDestinationModeLogical == DestinationMode);
+    msgAddrLower.UpperFixedAddress = 0xFEE;
+
+    // MSI-X messages are always edge triggered
+    msgData.Vector = Vector;
+    msgData.DeliveryMode = DeliveryMode;
+    msgData.Assert = ApicPinPolarityActiveHigh;
+    msgData.TriggerMode = ApicTriggerModeEdge;
+
+    // the entry must not be used while it is only partially written
+    TableEntry->VectorControl.Masked = TRUE;
+
+    TableEntry->MessageAddressLower.Raw = msgAddrLower.Raw;
+    TableEntry->MessageAddressHigher = 0;
+    TableEntry->MessageData.Raw = msgData.Raw;
+
+    TableEntry->VectorControl.Masked = FALSE;
+
+    pciCap->MessageControl.FunctionMask = FALSE;
+    pciCap->MessageControl.MsiXEnable = TRUE;
+
+    return STATUS_SUCCESS;
+}
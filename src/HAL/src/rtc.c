@@ -7,7 +7,7 @@
 #define RTC_LOWEST_RATE                     3
 #define RTC_HIGHEST_RATE                    15
 
-#define RDTSC_TIMER_CONFIGURATION_SLEEP     1*MS_IN_US
+#define RDTSC_TIMER_CONFIGURATION_SLEEP     10*MS_IN_US
 #define RDTSC_TIMER_CONFIGURATION_SAMPLES   4
 
 static QWORD                            m_tscFrequency;
@@ -95,9 +95,11 @@ _RtcDetermineTscFrequency(
 
     for (i = 0; i < NoOfSamples; ++i)
     {
-        initialRdtsc = RtcGetTickCount(); 
         PitSetTimer(SleepUsPerSample, FALSE);
 
+        // the timer is programmed before the TSC is read, only the time it
+        // takes to start it is included in the sample
+        initialRdtsc = RtcGetTickCount();
         PitStartTimer();
 
         PitWaitTimer();
@@ -0,0 +1,56 @@
+#pragma once
+
+#define BOOT_TIMELINE_MAX_ENTRIES       64
+
+#define BOOT_TIMELINE_INVALID_ENTRY     MAX_DWORD
+
+typedef enum _BOOT_TIMELINE_ENTRY_TYPE
+{
+    // a step of SystemInit
+    BootTimelineEntryPhase,
+
+    // the DriverEntry of a driver loaded by the IOMU
+    BootTimelineEntryDriver,
+
+    BootTimelineEntryReserved
+} BOOT_TIMELINE_ENTRY_TYPE;
+
+_No_competing_thread_
+void
+BootTimelinePreinit(
+    void
+    );
+
+//******************************************************************************
+// Function:     BootTimelineBegin
+// Description:  Records the TSC and the CPU at which a boot step starts.
+// Returns:      DWORD - the index of the entry to pass to BootTimelineEnd or
+//               BOOT_TIMELINE_INVALID_ENTRY if the timeline is full.
+// Parameter:    IN_Z char* Name - must remain valid until the system is shut
+//               down, only the pointer is stored.
+// Parameter:    IN BOOT_TIMELINE_ENTRY_TYPE Type
+// NOTE:         It does not take any locks, the entries of the drivers loaded
+//               in parallel are recorded by multiple CPUs.
+//******************************************************************************
+DWORD
+BootTimelineBegin(
+    IN_Z    char*                       Name,
+    IN      BOOT_TIMELINE_ENTRY_TYPE    Type
+    );
+
+void
+BootTimelineEnd(
+    IN      DWORD                       Index
+    );
+
+//******************************************************************************
+// Function:     BootTimelineDump
+// Description:  Displays the recorded steps ordered by their start time, with
+//               their offset from the first step, duration and CPU.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+void
+BootTimelineDump(
+    void
+    );
@@ -5,4 +5,5 @@
 FUNC_GenericCommand CmdListNetworks;
 FUNC_GenericCommand CmdNetRecv;
 FUNC_GenericCommand CmdNetSend;
-FUNC_GenericCommand CmdChangeDevStatus;
\ No newline at end of file
+FUNC_GenericCommand CmdChangeDevStatus;
+FUNC_GenericCommand CmdNetperf;
\ No newline at end of file
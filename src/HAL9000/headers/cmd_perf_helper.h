@@ -0,0 +1,9 @@
+#pragma once
+
+#include "cmd_common.h"
+
+FUNC_GenericCommand CmdTrace;
+FUNC_GenericCommand CmdProfile;
+FUNC_GenericCommand CmdBootTimeline;
+FUNC_GenericCommand CmdPoolStat;
+FUNC_GenericCommand CmdPmu;
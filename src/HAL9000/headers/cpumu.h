@@ -6,10 +6,13 @@
 #include "list.h"
 #include "synch.h"
 #include "cpu_structures.h"
+#include "ipc.h"
 
 #define STACK_DEFAULT_SIZE          (8*PAGE_SIZE)
 #define STACK_GUARD_SIZE            (2*PAGE_SIZE)
 
+#define RUN_QUEUE_HISTORY_SIZE      16
+
 typedef struct _THREADING_DATA
 {
     DWORD               RunningThreadTicks;
@@ -21,6 +24,13 @@ typedef struct _THREADING_DATA
 
     QWORD               IdleTicks;
     QWORD               KernelTicks;
+
+    // The length of the ready list is sampled on each clock tick, the last
+    // RUN_QUEUE_HISTORY_SIZE samples are kept in RunQueueHistory
+    QWORD               RunQueueSamples;
+    QWORD               RunQueueLengthSum;
+    DWORD               RunQueueLengthMax;
+    DWORD               RunQueueHistory[RUN_QUEUE_HISTORY_SIZE];
 } THREADING_DATA, *PTHREADING_DATA;
 
 typedef struct _PCPU
@@ -47,9 +57,23 @@ typedef struct _PCPU
     THREADING_DATA              ThreadData;
 
     // IPC data
-    LIST_ENTRY                  EventList;
-    LOCK                        EventListLock;
-    DWORD                       NoOfEventsInList;
+    IPC_EVENT_QUEUE             EventQueue;
+
+    // allocated by TraceStart, never freed afterwards
+    struct _TRACE_BUFFER*       TraceBuffer;
+
+    // allocated by ProfilerStart, never freed afterwards
+    struct _PROFILER_BUFFER*    ProfilerBuffer;
+
+    // allocated by CpuMuAllocCpu, never freed afterwards
+    struct _POOL_STATS_CPU*     PoolStats;
+
+    // allocated by PmuStart, never freed afterwards
+    struct _PMU_CPU*            Pmu;
+
+    // Valid only while an interrupt handler is running, it describes the code
+    // which was interrupted (used by the profiler to take its samples)
+    struct _INTERRUPT_STACK_COMPLETE*   InterruptStack;
 
     // Used to mark the fact that the VMM specialized functions for
     // allocating or freeing a VA reservation are working with the VA reservation
@@ -118,6 +142,19 @@ CpuMuIsPcidFeaturePresent(
     void
     );
 
+//******************************************************************************
+// Function:     CpuMuGetArchPerfMonLeaf
+// Description:  Returns the architectural performance monitoring CPUID leaf
+//               collected by CpuMuPreinit, it is zeroed if the CPU does not
+//               report it.
+// Returns:      void
+// Parameter:    OUT PCPUID_ARCH_PERF_MON_LEAF ArchPerfMonLeaf
+//******************************************************************************
+void
+CpuMuGetArchPerfMonLeaf(
+    OUT         PCPUID_ARCH_PERF_MON_LEAF   ArchPerfMonLeaf
+    );
+
 STATUS
 CpuMuActivateFpuFeatures(
     void
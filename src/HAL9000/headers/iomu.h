@@ -110,6 +110,11 @@ IomuTickCountToUs(
     IN          QWORD                   TickCount
     );
 
+QWORD
+IomuTickCountToNs(
+    IN          QWORD                   TickCount
+    );
+
 void
 IomuCmosUpdateOccurred(
     void
@@ -10,34 +10,104 @@ STATUS
 
 typedef FUNC_IpcProcessEvent* PFUNC_IpcProcessEvent;
 
+typedef struct _IPC_EVENT* PIPC_EVENT;
+
 typedef struct _IPC_EVENT_CPU
 {
-    LIST_ENTRY              ListEntry;
-    struct _IPC_EVENT*      Event;
+    struct _IPC_EVENT_CPU*  Next;
+    PIPC_EVENT              Event;
 } IPC_EVENT_CPU, *PIPC_EVENT_CPU;
 
-_Ret_writes_maybenull_(NumberOfCpus)
+// Multiple producer, single consumer queue of the events a CPU has to
+// process. Any CPU may queue events with a single atomic operation, only the
+// CPU owning the queue takes them out, all at once.
+typedef struct _IPC_EVENT_QUEUE
+{
+    PIPC_EVENT_CPU volatile Head;
+} IPC_EVENT_QUEUE, *PIPC_EVENT_QUEUE;
+
+//******************************************************************************
+// Function:     IpcInit
+// Description:  Preallocates the events used for sending IPIs, each of them
+//               can be queued on at most NumberOfCpus CPUs. If all the
+//               preallocated events are in use new ones are allocated from
+//               the heap.
+// Returns:      STATUS
+// Parameter:    IN DWORD NumberOfCpus
+//******************************************************************************
+_No_competing_thread_
+STATUS
+IpcInit(
+    IN_RANGE_LOWER(1)
+            DWORD                   NumberOfCpus
+    );
+
+void
+IpcQueueInit(
+    OUT     PIPC_EVENT_QUEUE        Queue
+    );
+
+//******************************************************************************
+// Function:     IpcGenerateEvent
+// Description:  Creates an event which will execute BroadcastFunction on each
+//               CPU it is queued on. After it was queued on all its CPUs the
+//               event must be passed to IpcCompleteEvent.
+// Returns:      PIPC_EVENT
+// Parameter:    IN PFUNC_IpcProcessEvent BroadcastFunction
+// Parameter:    IN_OPT PVOID Context
+// Parameter:    IN_OPT PFUNC_FreeFunction FreeFunction
+// Parameter:    IN_OPT PVOID FreeContext
+// Parameter:    IN BOOLEAN WaitForHandling - if TRUE IpcCompleteEvent waits
+//               for all the CPUs to process the event.
+//******************************************************************************
 PTR_SUCCESS
-PIPC_EVENT_CPU
+PIPC_EVENT
 IpcGenerateEvent(
     IN      PFUNC_IpcProcessEvent   BroadcastFunction,
     IN_OPT  PVOID                   Context,
     IN_OPT  PFUNC_FreeFunction      FreeFunction,
     IN_OPT  PVOID                   FreeContext,
-    IN      BOOLEAN                 WaitForHandling,
-    IN_RANGE_LOWER(1)      
-            DWORD                   NumberOfCpus
+    IN      BOOLEAN                 WaitForHandling
     );
 
+//******************************************************************************
+// Function:     IpcQueueEvent
+// Description:  Queues Event on the queue of a CPU.
+// Returns:      BOOLEAN - TRUE if the queue was empty, in which case the CPU
+//               must be sent an IPI to process it. Otherwise an IPI is
+//               already on its way.
+// Parameter:    INOUT PIPC_EVENT Event
+// Parameter:    INOUT PIPC_EVENT_QUEUE Queue
+//******************************************************************************
+BOOLEAN
+IpcQueueEvent(
+    INOUT   PIPC_EVENT              Event,
+    INOUT   PIPC_EVENT_QUEUE        Queue
+    );
+
+//******************************************************************************
+// Function:     IpcCompleteEvent
+// Description:  Called once the event was queued on all its CPUs. If the event
+//               was generated with WaitForHandling the function returns only
+//               after all the CPUs processed it. The event must not be used
+//               afterwards.
+// Returns:      void
+// Parameter:    PIPC_EVENT Event
+//******************************************************************************
 void
-IpcWaitForEventHandling(
+IpcCompleteEvent(
     _Pre_valid_ _Post_ptr_invalid_
-            PIPC_EVENT_CPU          Event
+            PIPC_EVENT              Event
     );
 
+//******************************************************************************
+// Function:     IpcProcessQueue
+// Description:  Processes all the events queued on Queue, must be called on
+//               the CPU owning the queue.
+// Returns:      STATUS - the status of the last event which failed, if any.
+// Parameter:    INOUT PIPC_EVENT_QUEUE Queue
+//******************************************************************************
 STATUS
-IpcProcessEvent(
-    _Pre_valid_ _Post_ptr_invalid_
-            PIPC_EVENT_CPU      CpuEvent,
-    OUT     STATUS*             FunctionStatus
-    );
\ No newline at end of file
+IpcProcessQueue(
+    INOUT   PIPC_EVENT_QUEUE        Queue
+    );
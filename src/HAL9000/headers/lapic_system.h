@@ -41,6 +41,21 @@ LapicSystemSetTimer(
     IN      DWORD                           Microseconds
     );
 
+//******************************************************************************
+// Function:     LapicSystemSetPerfCounterInterrupt
+// Description:  Unmasks or masks the delivery of the PMU counter overflows on
+//               the current CPU. The CPU masks it again after each overflow
+//               interrupt it delivers.
+// Returns:      void
+// Parameter:    IN BYTE Vector
+// Parameter:    IN BOOLEAN Enable
+//******************************************************************************
+void
+LapicSystemSetPerfCounterInterrupt(
+    IN      BYTE                            Vector,
+    IN      BOOLEAN                         Enable
+    );
+
 void
 LapicSystemSendIpi(
     _When_(ApicDestinationShorthandNone == DeliveryMode, IN)
@@ -2,6 +2,7 @@
 
 #include "mem_structures.h"
 #include "lock_common.h"
+#include "cl_heap.h"
 
 typedef struct _PROCESS* PPROCESS;
 typedef struct _PE_NT_HEADER_INFO *PPE_NT_HEADER_INFO;
@@ -256,6 +257,47 @@ MmuFreePoolWithTag(
     IN      DWORD                   Tag
     );
 
+//******************************************************************************
+// Function:     MmuGetPoolAllocationSequence
+// Description:  Returns the sequence number of the last allocation made from
+//               the pool, see MmuRetrievePoolAllocations.
+// Returns:      QWORD
+// Parameter:    void
+//******************************************************************************
+QWORD
+MmuGetPoolAllocationSequence(
+    void
+    );
+
+//******************************************************************************
+// Function:     MmuRetrievePoolAllocations
+// Description:  Describes the allocations made from the pool after the one
+//               with the sequence number SinceSequence and up to the one with
+//               UntilSequence which are not yet freed. The heap is locked
+//               while its allocations are walked.
+// Returns:      QWORD - the number of such allocations, which may be greater
+//               than MaxAllocations.
+// Parameter:    IN QWORD SinceSequence
+// Parameter:    IN QWORD UntilSequence
+// Parameter:    IN DWORD MaxAllocations
+// Parameter:    OUT_WRITES_OPT(MaxAllocations) PHEAP_ALLOCATION_INFO Allocations
+//******************************************************************************
+QWORD
+MmuRetrievePoolAllocations(
+    IN      QWORD                   SinceSequence,
+    IN      QWORD                   UntilSequence,
+    IN      DWORD                   MaxAllocations,
+    OUT_WRITES_OPT(MaxAllocations)
+            PHEAP_ALLOCATION_INFO   Allocations
+    );
+
+void
+MmuGetPoolUsage(
+    OUT     QWORD*                  HeapSize,
+    OUT     QWORD*                  BytesUsed,
+    OUT     QWORD*                  NumberOfAllocations
+    );
+
 //******************************************************************************
 // Function:     MmuProbeMemory
 // Description:  Ensures the virtual memory described by the Buffer is mapped
@@ -440,3 +482,40 @@ void
 MmuFreeSystemVirtualAddressForUserBuffer(
     IN          PVOID               KernelAddress
     );
+
+//******************************************************************************
+// Function:     MmuGetUserVirtualAddressForSystemBuffer
+// Description:  Maps the physical memory which backs the kernel buffer
+//               KernelAddress into the address space of the Process process
+//               with PageRights rights. The physical memory still belongs to
+//               the kernel and must outlive the mapping.
+// Returns:      STATUS
+// Parameter:    IN PVOID KernelAddress
+// Parameter:    IN QWORD Size
+// Parameter:    IN PAGE_RIGHTS PageRights
+// Parameter:    IN PPROCESS Process
+// Parameter:    OUT PVOID * UserAddress
+//******************************************************************************
+STATUS
+MmuGetUserVirtualAddressForSystemBuffer(
+    IN          PVOID               KernelAddress,
+    IN          QWORD               Size,
+    IN          PAGE_RIGHTS         PageRights,
+    IN          PPROCESS            Process,
+    OUT         PVOID*              UserAddress
+    );
+
+//******************************************************************************
+// Function:     MmuFreeUserVirtualAddressForSystemBuffer
+// Description:  Unmaps a kernel buffer previously mapped in Process with
+//               MmuGetUserVirtualAddressForSystemBuffer, the physical memory
+//               is not released.
+// Returns:      void
+// Parameter:    IN PVOID UserAddress
+// Parameter:    IN PPROCESS Process
+//******************************************************************************
+void
+MmuFreeUserVirtualAddressForSystemBuffer(
+    IN          PVOID               UserAddress,
+    IN          PPROCESS            Process
+    );
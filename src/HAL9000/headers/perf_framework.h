@@ -1,12 +1,51 @@
 #pragma once
 
+typedef enum _PERFORMANCE_UNIT
+{
+    PerformanceUnitTicks,
+    PerformanceUnitNs,
+    PerformanceUnitUs,
+
+    PerformanceUnitReserved = PerformanceUnitUs + 1
+} PERFORMANCE_UNIT;
+
 typedef struct _PERFORMANCE_STATS
 {
     QWORD               Mean;
     QWORD               Min;
     QWORD               Max;
+
+    // taken from a histogram, they are at most 1/16 larger than the exact
+    // values
+    QWORD               P50;
+    QWORD               P90;
+    QWORD               P99;
+    QWORD               P999;
+
+    // measured iterations on all the CPUs
+    QWORD               Iterations;
+    DWORD               NumberOfCpus;
+
+    PERFORMANCE_UNIT    Unit;
 } PERFORMANCE_STATS, *PPERFORMANCE_STATS;
 
+typedef struct _PERFORMANCE_PARAMETERS
+{
+    // iterations executed before the measurements start, they are not
+    // included in the results
+    DWORD               WarmupIterations;
+
+    // measured iterations, on each CPU
+    DWORD               Iterations;
+
+    // if 1 the function is executed on the calling thread, else it is
+    // executed at the same time on NumberOfCpus CPUs from IPI context, with
+    // the interrupts disabled, in which case it must not block
+    DWORD               NumberOfCpus;
+
+    PERFORMANCE_UNIT    Unit;
+} PERFORMANCE_PARAMETERS, *PPERFORMANCE_PARAMETERS;
+
 typedef
 void
 (__cdecl FUNC_TestPerformance)(
@@ -15,6 +54,28 @@ void
 
 typedef FUNC_TestPerformance*   PFUNC_TestPerformance;
 
+//******************************************************************************
+// Function:     RunPerformanceFunctionEx
+// Description:  Times each iteration of Function with the TSC. When it runs
+//               on multiple CPUs they all finish their warm-up before any of
+//               them starts measuring. The cost of reading the TSC is
+//               subtracted from each sample.
+// Returns:      STATUS
+// Parameter:    IN PFUNC_TestPerformance Function
+// Parameter:    IN_OPT PVOID Context
+// Parameter:    IN PPERFORMANCE_PARAMETERS Parameters
+// Parameter:    OUT PPERFORMANCE_STATS PerfStats
+//******************************************************************************
+STATUS
+RunPerformanceFunctionEx(
+    IN      PFUNC_TestPerformance   Function,
+    IN_OPT  PVOID                   Context,
+    IN      PPERFORMANCE_PARAMETERS Parameters,
+    OUT     PPERFORMANCE_STATS      PerfStats
+    );
+
+// Runs Function on the calling thread after IterationCount / 10 warm-up
+// iterations, the results are in TSC ticks or in us.
 void
 RunPerformanceFunction(
     IN      PFUNC_TestPerformance   Function,
@@ -31,4 +92,21 @@ DisplayPerformanceStats(
     IN      DWORD                   NumberOfStats,
     IN_READS(NumberOfStats)
             char**                  StatNames
-    );
\ No newline at end of file
+    );
+
+//******************************************************************************
+// Function:     ReportPerformanceStats
+// Description:  Logs the results as a single line which is easy to parse from
+//               the serial output:
+//               PERF name=<Name> cpus=<n> iterations=<n> unit=<ns|us|ticks>
+//                    min=<n> mean=<n> p50=<n> p90=<n> p99=<n> p999=<n> max=<n>
+//               all on one line. Name must not contain white spaces.
+// Returns:      void
+// Parameter:    IN_Z char* Name
+// Parameter:    IN PPERFORMANCE_STATS PerfStats
+//******************************************************************************
+void
+ReportPerformanceStats(
+    IN_Z    char*                   Name,
+    IN      PPERFORMANCE_STATS      PerfStats
+    );
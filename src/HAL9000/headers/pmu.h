@@ -0,0 +1,146 @@
+#pragma once
+
+#define PMU_DEFAULT_SAMPLING_PERIOD     1000000
+
+// the general-purpose counters are written through IA32_PMCx which only takes
+// the low 32 bits and sign-extends them
+#define PMU_MAX_SAMPLING_PERIOD         (MAX_DWORD >> 1)
+
+typedef enum _PMU_EVENT
+{
+    PmuEventCycles,
+    PmuEventInstructions,
+    PmuEventLlcMisses,
+    PmuEventBranchMisses,
+
+    PmuEventReserved
+} PMU_EVENT;
+
+typedef enum _PMU_MODE
+{
+    // all the available events are counted and accounted to the threads
+    // which were running when they occurred
+    PmuModeCounting,
+
+    // a single event is counted, each time it occurs Period times the
+    // overflow interrupt takes a profiler sample
+    PmuModeSampling,
+
+    PmuModeReserved
+} PMU_MODE;
+
+typedef struct _PMU_INFO
+{
+    // 0 if CPUID reports no architectural PMU, nothing can be counted
+    BYTE                    Version;
+
+    BYTE                    NumberOfGeneralCounters;
+    BYTE                    NumberOfFixedCounters;
+
+    BOOLEAN                 EventAvailable[PmuEventReserved];
+} PMU_INFO, *PPMU_INFO;
+
+// Embedded in each THREAD, updated only by the CPU running the thread
+typedef struct _PMU_THREAD_COUNTERS
+{
+    // the counts are valid only if they were accounted during the current
+    // PmuStart session
+    QWORD                   Session;
+
+    QWORD                   Counts[PmuEventReserved];
+} PMU_THREAD_COUNTERS, *PPMU_THREAD_COUNTERS;
+
+_No_competing_thread_
+void
+PmuSystemPreinit(
+    void
+    );
+
+//******************************************************************************
+// Function:     PmuSystemInit
+// Description:  Determines the PMU counters and events available from CPUID
+//               and installs the overflow interrupt routine. If there is no
+//               architectural PMU (e.g. under QEMU TCG) it succeeds without
+//               doing anything and PmuStart fails.
+// Returns:      STATUS
+// Parameter:    void
+//******************************************************************************
+STATUS
+PmuSystemInit(
+    void
+    );
+
+void
+PmuGetInfo(
+    OUT     PPMU_INFO               Info
+    );
+
+//******************************************************************************
+// Function:     PmuStart
+// Description:  Programs the PMU counters of all the CPUs. In counting mode
+//               each available event is counted in user and kernel mode. In
+//               sampling mode the profiler is started and a sample is taken
+//               each time Event occurs Period times.
+// Returns:      STATUS - STATUS_CPU_UNSUPPORTED_FEATURE if there is no PMU or
+//               the event cannot be counted.
+// Parameter:    IN PMU_MODE Mode
+// Parameter:    IN PMU_EVENT Event - used only in sampling mode
+// Parameter:    IN DWORD Period - used only in sampling mode, at most
+//               PMU_MAX_SAMPLING_PERIOD.
+//******************************************************************************
+STATUS
+PmuStart(
+    IN      PMU_MODE                Mode,
+    IN      PMU_EVENT               Event,
+    IN      DWORD                   Period
+    );
+
+void
+PmuStop(
+    void
+    );
+
+//******************************************************************************
+// Function:     PmuRetrieveCounts
+// Description:  Returns the events counted on all the CPUs since PmuStart,
+//               while counting the running threads are accounted their
+//               current counts as well.
+// Returns:      void
+// Parameter:    OUT_WRITES(PmuEventReserved) QWORD* Counts
+// Parameter:    OUT QWORD* Samples - overflow interrupts taken in sampling
+//               mode.
+//******************************************************************************
+void
+PmuRetrieveCounts(
+    OUT_WRITES(PmuEventReserved)
+            QWORD*                  Counts,
+    OUT     QWORD*                  Samples
+    );
+
+//******************************************************************************
+// Function:     PmuGetThreadCounts
+// Description:  Copies the events accounted to a thread since PmuStart.
+// Returns:      BOOLEAN - FALSE if the thread did not run while counting.
+// Parameter:    IN PPMU_THREAD_COUNTERS ThreadCounters
+// Parameter:    OUT_WRITES(PmuEventReserved) QWORD* Counts
+//******************************************************************************
+BOOLEAN
+PmuGetThreadCounts(
+    IN      PPMU_THREAD_COUNTERS    ThreadCounters,
+    OUT_WRITES(PmuEventReserved)
+            QWORD*                  Counts
+    );
+
+//******************************************************************************
+// Function:     PmuSwitchThread
+// Description:  Called by the scheduler before the current CPU switches to
+//               another thread, accounts the events counted since the last
+//               switch to the thread being de-scheduled.
+// Returns:      void
+// Parameter:    INOUT PPMU_THREAD_COUNTERS ThreadCounters
+// NOTE:         Must be called with the interrupts disabled.
+//******************************************************************************
+void
+PmuSwitchThread(
+    INOUT   PPMU_THREAD_COUNTERS    ThreadCounters
+    );
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "cl_heap.h"
+
+// must be a power of 2, the tags which do not fit are accounted together in
+// an entry with the tag 0
+#define POOL_STATS_MAX_TAGS                 64
+STATIC_ASSERT(0 == (POOL_STATS_MAX_TAGS & (POOL_STATS_MAX_TAGS - 1)));
+
+// size class i holds the allocations of at most POOL_STATS_SIZE_CLASS_LIMIT(i)
+// bytes which do not fit in the previous class, the last class holds all the
+// larger allocations
+#define POOL_STATS_SIZE_CLASSES             12
+#define POOL_STATS_SIZE_CLASS_LIMIT(i)      (16U << (i))
+
+typedef struct _POOL_TAG_STATS
+{
+    DWORD                   Tag;
+
+    QWORD                   LiveBytes;
+    QWORD                   PeakBytes;
+
+    QWORD                   Allocations;
+    QWORD                   Frees;
+    QWORD                   BytesAllocated;
+
+    QWORD                   SizeClasses[POOL_STATS_SIZE_CLASSES];
+} POOL_TAG_STATS, *PPOOL_TAG_STATS;
+
+_No_competing_thread_
+void
+PoolStatsPreinit(
+    void
+    );
+
+//******************************************************************************
+// Function:     PoolStatsInitCpu
+// Description:  Allocates the counters in which the allocations made on the
+//               CPU are accounted. Until they are allocated the allocations
+//               are accounted in shared counters.
+// Returns:      STATUS
+// Parameter:    INOUT PPCPU Cpu
+//******************************************************************************
+STATUS
+PoolStatsInitCpu(
+    INOUT   struct _PCPU*           Cpu
+    );
+
+//******************************************************************************
+// Function:     PoolStatsRecordAllocation
+// Description:  Accounts a successful allocation in the counters of the
+//               current CPU. Only the live and peak bytes of the tag are
+//               shared between the CPUs.
+// Returns:      void
+// Parameter:    IN DWORD Tag
+// Parameter:    IN DWORD Size
+// NOTE:         Must be called with the interrupts disabled, so that the
+//               current CPU does not change while its counters are updated.
+//******************************************************************************
+void
+PoolStatsRecordAllocation(
+    IN      DWORD                   Tag,
+    IN      DWORD                   Size
+    );
+
+void
+PoolStatsRecordFree(
+    IN      DWORD                   Tag,
+    IN      DWORD                   Size
+    );
+
+//******************************************************************************
+// Function:     PoolStatsRetrieve
+// Description:  Sums the counters of all the CPUs and returns the tags with
+//               the most live bytes, in descending order.
+// Returns:      void
+// Parameter:    IN DWORD MaxEntries
+// Parameter:    OUT_WRITES_TO(MaxEntries, *NumberOfEntries)
+//               PPOOL_TAG_STATS Entries
+// Parameter:    OUT DWORD* NumberOfEntries
+//******************************************************************************
+void
+PoolStatsRetrieve(
+    IN      DWORD                   MaxEntries,
+    OUT_WRITES_TO(MaxEntries, *NumberOfEntries)
+            PPOOL_TAG_STATS         Entries,
+    OUT     DWORD*                  NumberOfEntries
+    );
+
+//******************************************************************************
+// Function:     PoolStatsCheckpoint
+// Description:  Marks the allocations made until now, PoolStatsRetrieveLeaks
+//               only reports the ones made afterwards.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+void
+PoolStatsCheckpoint(
+    void
+    );
+
+//******************************************************************************
+// Function:     PoolStatsRetrieveLeaks
+// Description:  Describes the allocations made after the last checkpoint
+//               and up to the one with the sequence number UntilSequence
+//               which have not been freed yet.
+// Returns:      QWORD - the number of such allocations, which may be greater
+//               than MaxAllocations.
+// Parameter:    IN QWORD UntilSequence - obtained from
+//               MmuGetPoolAllocationSequence, so the allocations made by the
+//               caller afterwards are not reported.
+// Parameter:    IN DWORD MaxAllocations
+// Parameter:    OUT_WRITES_OPT(MaxAllocations) PHEAP_ALLOCATION_INFO Allocations
+//******************************************************************************
+QWORD
+PoolStatsRetrieveLeaks(
+    IN      QWORD                   UntilSequence,
+    IN      DWORD                   MaxAllocations,
+    OUT_WRITES_OPT(MaxAllocations)
+            PHEAP_ALLOCATION_INFO   Allocations
+    );
@@ -58,6 +58,12 @@ typedef struct _PROCESS
 
     // VaSpace used only for UM virtual memory allocations
     struct _VMM_RESERVATION_SPACE*  VaSpace;
+
+    // Packet rings mapped in the process address space, see um_net_ring.h
+    LOCK                            NetRingListLock;
+
+    _Guarded_by_(NetRingListLock)
+    LIST_ENTRY                      NetRingList;
 } PROCESS, *PPROCESS;
 
 //******************************************************************************
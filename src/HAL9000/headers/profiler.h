@@ -0,0 +1,126 @@
+#pragma once
+
+#define PROFILER_DEFAULT_FREQUENCY_HZ   1000
+#define PROFILER_MAX_FREQUENCY_HZ       10000
+
+// the LAPIC timer is not armed, the samples are taken by the PMU overflow
+// interrupt (see PmuStart)
+#define PROFILER_FREQUENCY_EXTERNAL     0
+
+typedef enum _PROFILER_HISTOGRAM_TYPE
+{
+    // the samples are grouped by the symbol the interrupted RIP belongs to,
+    // the symbols found in the backtrace are counted as total samples
+    ProfilerHistogramSymbols,
+
+    // the samples are grouped by the thread which was interrupted
+    ProfilerHistogramThreads,
+
+    ProfilerHistogramReserved
+} PROFILER_HISTOGRAM_TYPE;
+
+typedef struct _PROFILER_HISTOGRAM_ENTRY
+{
+    // the symbol address (see ProfilerResolveSymbol) or the TID
+    QWORD                   Key;
+
+    // samples in which the key was the one interrupted
+    QWORD                   SelfSamples;
+
+    // samples in which the key was interrupted or was found in the backtrace
+    QWORD                   TotalSamples;
+} PROFILER_HISTOGRAM_ENTRY, *PPROFILER_HISTOGRAM_ENTRY;
+
+typedef struct _PROFILER_SUMMARY
+{
+    QWORD                   Samples;
+    QWORD                   UserModeSamples;
+
+    // samples overwritten in the per-CPU buffers before the histogram was built
+    QWORD                   SamplesLost;
+
+    // samples which did not fit in the histogram, they are not accounted in
+    // any of its entries
+    QWORD                   SamplesNotAccounted;
+} PROFILER_SUMMARY, *PPROFILER_SUMMARY;
+
+_No_competing_thread_
+void
+ProfilerSystemPreinit(
+    void
+    );
+
+//******************************************************************************
+// Function:     ProfilerStart
+// Description:  Discards the previous samples and programs the LAPIC timer of
+//               each CPU to take a sample FrequencyHz times per second. A
+//               sample holds the interrupted RIP, the running thread and the
+//               return addresses found on its stack.
+// Returns:      STATUS
+// Parameter:    IN DWORD FrequencyHz - at most PROFILER_MAX_FREQUENCY_HZ or
+//               PROFILER_FREQUENCY_EXTERNAL.
+//******************************************************************************
+STATUS
+ProfilerStart(
+    IN      DWORD                   FrequencyHz
+    );
+
+void
+ProfilerStop(
+    void
+    );
+
+//******************************************************************************
+// Function:     ProfilerTakeSample
+// Description:  Called on each LAPIC timer or PMU overflow interrupt, records a
+//               sample of the interrupted code in the buffer of the current
+//               CPU.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+void
+ProfilerTakeSample(
+    void
+    );
+
+//******************************************************************************
+// Function:     ProfilerBuildHistogram
+// Description:  Aggregates the samples of all the CPUs and returns the
+//               entries with the most total samples, in descending order,
+//               entries with the same number of total samples are ordered by
+//               their self samples.
+// Returns:      STATUS - STATUS_DEVICE_BUSY if the profiler is still running.
+// Parameter:    IN PROFILER_HISTOGRAM_TYPE Type
+// Parameter:    IN DWORD MaxEntries
+// Parameter:    OUT_WRITES_TO(MaxEntries, *NumberOfEntries)
+//               PPROFILER_HISTOGRAM_ENTRY Entries
+// Parameter:    OUT DWORD* NumberOfEntries
+// Parameter:    OUT PPROFILER_SUMMARY Summary
+//******************************************************************************
+STATUS
+ProfilerBuildHistogram(
+    IN      PROFILER_HISTOGRAM_TYPE Type,
+    IN      DWORD                   MaxEntries,
+    OUT_WRITES_TO(MaxEntries, *NumberOfEntries)
+            PPROFILER_HISTOGRAM_ENTRY   Entries,
+    OUT     DWORD*                  NumberOfEntries,
+    OUT     PPROFILER_SUMMARY       Summary
+    );
+
+//******************************************************************************
+// Function:     ProfilerResolveSymbol
+// Description:  Describes an address of the kernel image as export+offset. If
+//               no export precedes the address it is described as
+//               section+offset, which can be looked up in the linker map file.
+// Returns:      void
+// Parameter:    IN PVOID Address
+// Parameter:    OUT_WRITES_Z(BufferSize) char* Buffer
+// Parameter:    IN DWORD BufferSize
+//******************************************************************************
+void
+ProfilerResolveSymbol(
+    IN      PVOID                   Address,
+    OUT_WRITES_Z(BufferSize)
+            char*                   Buffer,
+    IN      DWORD                   BufferSize
+    );
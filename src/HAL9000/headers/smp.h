@@ -77,7 +77,10 @@ SmpSendPanic(
 
 // Calls SmpSendGenericIpiEx with SmpIpiSendToAllExcludingSelf causing the
 // BroadcastFunction to be executed on each CPU except the one that is calling
-// the function.
+// the function. Such broadcasts do not allocate anything, all the CPUs share
+// a single payload and a broadcast waits for the previous one to be handled.
+// With WaitForHandling the caller spins with interrupts disabled until the
+// last CPU executed the function.
 STATUS
 SmpSendGenericIpi(
     IN      PFUNC_IpcProcessEvent   BroadcastFunction,
@@ -19,3 +19,16 @@ void
 SyscallCpuInit(
     void
     );
+
+//******************************************************************************
+// Function:     SyscallHandler
+// Description:  Dispatches the system call described by the saved user-mode
+//               registers and places its status in the saved RAX. Called by
+//               SyscallEntry with the interrupts disabled.
+// Returns:      void
+// Parameter:    INOUT COMPLETE_PROCESSOR_STATE* CompleteProcessorState
+//******************************************************************************
+void
+SyscallHandler(
+    INOUT   COMPLETE_PROCESSOR_STATE    *CompleteProcessorState
+    );
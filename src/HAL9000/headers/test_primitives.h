@@ -0,0 +1,14 @@
+#pragma once
+
+//******************************************************************************
+// Function:     TestPrimitivesPerformance
+// Description:  Measures the synchronization, scheduling, memory management,
+//               IPI and system call primitives. Each result is reported as a
+//               PERF line through ReportPerformanceStats.
+// Returns:      void
+// Parameter:    void
+//******************************************************************************
+void
+TestPrimitivesPerformance(
+    void
+    );
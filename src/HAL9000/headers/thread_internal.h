@@ -4,6 +4,8 @@
 #include "ref_cnt.h"
 #include "ex_event.h"
 #include "thread.h"
+#include "histogram.h"
+#include "pmu.h"
 
 typedef enum _THREAD_STATE
 {
@@ -28,6 +30,49 @@ typedef enum _THREAD_STATE
 
 typedef DWORD           THREAD_FLAGS;
 
+// All the times are in TSC ticks, they are updated by the scheduler while
+// holding the ready list lock
+typedef struct _THREAD_SCHEDULER_STATS
+{
+    // when the thread was last inserted in the ready list
+    QWORD                   ReadyTimestamp;
+
+    // when the thread last started running, 0 if it never ran
+    QWORD                   RunTimestamp;
+
+    QWORD                   RunTime;
+
+    // time spent in the ready list before being scheduled
+    QWORD                   WaitTime;
+    QWORD                   MaxWaitTime;
+    QWORD                   NumberOfWaits;
+
+    // the thread blocked or yielded before its time slice expired
+    QWORD                   VoluntarySwitches;
+
+    // the thread was preempted because its time slice expired
+    QWORD                   InvoluntarySwitches;
+
+    // describe the reason the thread is in the ready list
+    BOOLEAN                 WokenUp;
+    BOOLEAN                 Preempted;
+} THREAD_SCHEDULER_STATS, *PTHREAD_SCHEDULER_STATS;
+
+typedef enum _THREAD_LATENCY_TYPE
+{
+    // from the moment a blocked thread is unblocked until it runs
+    ThreadLatencyWakeup,
+
+    // from the moment a running thread yields the CPU (or is preempted)
+    // until it runs again
+    ThreadLatencyRequeue,
+
+    // from the moment a newly created thread is started until it first runs
+    ThreadLatencyStart,
+
+    ThreadLatencyReserved
+} THREAD_LATENCY_TYPE;
+
 #define THREAD_FLAG_FORCE_TERMINATE_PENDING         0x1
 #define THREAD_FLAG_FORCE_TERMINATED                0x2
 
@@ -76,6 +121,11 @@ typedef struct _THREAD
     // ticks, i.e. by yielding or by blocking
     QWORD                   TickCountEarly;
 
+    THREAD_SCHEDULER_STATS  SchedulerStats;
+
+    // the PMU events counted while the thread was running
+    PMU_THREAD_COUNTERS     PmuCounters;
+
     // The highest valid address for the kernel stack (its initial value)
     PVOID                   InitialStackBase;
 
@@ -252,6 +302,20 @@ ThreadExecuteForEachThreadEntry(
     IN_OPT  PVOID               Context
     );
 
+//******************************************************************************
+// Function:     ThreadRetrieveLatencyHistogram
+// Description:  Copies the system-wide histogram of the scheduling latencies
+//               of the given type, the values are in TSC ticks.
+// Returns:      void
+// Parameter:    IN THREAD_LATENCY_TYPE Type
+// Parameter:    OUT PHISTOGRAM Histogram
+//******************************************************************************
+void
+ThreadRetrieveLatencyHistogram(
+    IN      THREAD_LATENCY_TYPE Type,
+    OUT     PHISTOGRAM          Histogram
+    );
+
 
 //******************************************************************************O
 // Function:     GetCurrentThread
@@ -0,0 +1,121 @@
+#pragma once
+
+typedef DWORD TRACE_CATEGORY;
+
+#define TRACE_CATEGORY_THREAD           0x1
+#define TRACE_CATEGORY_VMM              0x2
+#define TRACE_CATEGORY_IO               0x4
+#define TRACE_CATEGORY_INTERRUPT        0x8
+
+#define TRACE_CATEGORY_ALL              (TRACE_CATEGORY_THREAD | TRACE_CATEGORY_VMM | TRACE_CATEGORY_IO | TRACE_CATEGORY_INTERRUPT)
+
+// The arguments of each event are described by its format string in trace.c,
+// the records are only formatted when the buffers are dumped
+typedef enum _TRACE_EVENT
+{
+    // previous TID, next TID, previous state
+    TraceEventThreadSwitch,
+
+    // TID, forced
+    TraceEventThreadYield,
+
+    // TID
+    TraceEventThreadBlock,
+
+    // TID of the unblocked thread
+    TraceEventThreadUnblock,
+
+    // faulting address, rights requested, solved
+    TraceEventVmmPageFault,
+
+    // device, IRP, major function
+    TraceEventIrpDispatch,
+
+    // device, IRP, status
+    TraceEventIrpDispatchDone,
+
+    // IRP, status
+    TraceEventIrpComplete,
+
+    // vector
+    TraceEventInterruptEnter,
+
+    // vector, handled
+    TraceEventInterruptExit,
+
+    TraceEventReserved
+} TRACE_EVENT;
+
+#define TRACE_MAX_ARGS                  4
+
+extern volatile TRACE_CATEGORY gTraceCategories;
+
+// the categories are checked inline so that a disabled tracepoint costs a
+// load and a branch
+#define TRACE_EVENT_ARGS(Category,Event,A0,A1,A2,A3)    if (IsFlagOn(gTraceCategories, (Category)))                                     \
+                                                        {                                                                               \
+                                                            TraceRecordEvent((Event),(QWORD)(A0),(QWORD)(A1),(QWORD)(A2),(QWORD)(A3));  \
+                                                        }
+
+#define TRACE_THREAD(Event,A0,A1,A2)            TRACE_EVENT_ARGS(TRACE_CATEGORY_THREAD,(Event),(A0),(A1),(A2),0)
+#define TRACE_VMM(Event,A0,A1,A2)               TRACE_EVENT_ARGS(TRACE_CATEGORY_VMM,(Event),(A0),(A1),(A2),0)
+#define TRACE_IO(Event,A0,A1,A2)                TRACE_EVENT_ARGS(TRACE_CATEGORY_IO,(Event),(A0),(A1),(A2),0)
+#define TRACE_INTERRUPT(Event,A0,A1)            TRACE_EVENT_ARGS(TRACE_CATEGORY_INTERRUPT,(Event),(A0),(A1),0,0)
+
+_No_competing_thread_
+void
+TraceSystemPreinit(
+    void
+    );
+
+//******************************************************************************
+// Function:     TraceStart
+// Description:  Allocates the trace buffers of the CPUs which do not have one
+//               yet and starts recording the events in Categories.
+// Returns:      STATUS
+// Parameter:    IN TRACE_CATEGORY Categories
+// NOTE:         The buffers are never freed, a tracepoint may be writing to
+//               one at any time.
+//******************************************************************************
+STATUS
+TraceStart(
+    IN      TRACE_CATEGORY          Categories
+    );
+
+void
+TraceStop(
+    void
+    );
+
+//******************************************************************************
+// Function:     TraceRecordEvent
+// Description:  Writes a record with the current TSC and thread in the buffer
+//               of the current CPU. It does not take any locks, so it can be
+//               called from any context, including interrupt handlers. When
+//               the buffer is full the oldest record is overwritten.
+// Returns:      void
+// Parameter:    IN TRACE_EVENT Event
+// Parameter:    IN QWORD Arg0 ... Arg3
+//******************************************************************************
+void
+TraceRecordEvent(
+    IN      TRACE_EVENT             Event,
+    IN      QWORD                   Arg0,
+    IN      QWORD                   Arg1,
+    IN      QWORD                   Arg2,
+    IN      QWORD                   Arg3
+    );
+
+//******************************************************************************
+// Function:     TraceDump
+// Description:  Formats the records written since the previous dump and sends
+//               them over the serial port, ordered by timestamp across all the
+//               CPUs.
+// Returns:      QWORD - the number of records dumped
+// Parameter:    OUT_OPT QWORD* RecordsLost - the number of records which were
+//               overwritten before they could be dumped.
+//******************************************************************************
+QWORD
+TraceDump(
+    OUT_OPT QWORD*                  RecordsLost
+    );
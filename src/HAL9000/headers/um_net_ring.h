@@ -0,0 +1,64 @@
+#pragma once
+
+#include "network.h"
+
+typedef struct _PROCESS* PPROCESS;
+
+//******************************************************************************
+// Function:     UmNetRingCreate
+// Description:  Creates a packet ring on the DeviceId network device and maps
+//               it in the address space of Process. The address at which the
+//               ring is mapped identifies it in the other functions.
+// Returns:      STATUS
+// Parameter:    INOUT PPROCESS Process
+// Parameter:    IN DEVICE_ID DeviceId
+// Parameter:    IN DWORD SlotCount
+// Parameter:    OUT PNET_RING_HEADER * Ring - user address of the ring.
+//******************************************************************************
+STATUS
+UmNetRingCreate(
+    INOUT       PPROCESS                Process,
+    IN          DEVICE_ID               DeviceId,
+    IN          DWORD                   SlotCount,
+    OUT         PNET_RING_HEADER*       Ring
+    );
+
+STATUS
+UmNetRingTransmit(
+    IN          PPROCESS                Process,
+    IN          PNET_RING_HEADER        Ring,
+    OUT_OPT     DWORD*                  FramesSent
+    );
+
+STATUS
+UmNetRingWait(
+    IN          PPROCESS                Process,
+    IN          PNET_RING_HEADER        Ring
+    );
+
+//******************************************************************************
+// Function:     UmNetRingClose
+// Description:  Detaches the ring from its device and unmaps it from Process.
+//               If another thread of the process is using the ring at the same
+//               time the ring is destroyed when that thread is done with it.
+// Returns:      STATUS
+// Parameter:    INOUT PPROCESS Process
+// Parameter:    IN PNET_RING_HEADER Ring
+//******************************************************************************
+STATUS
+UmNetRingClose(
+    INOUT       PPROCESS                Process,
+    IN          PNET_RING_HEADER        Ring
+    );
+
+//******************************************************************************
+// Function:     UmNetRingCloseAll
+// Description:  Closes all the rings of Process, called when the process is
+//               destroyed before its address space is.
+// Returns:      void
+// Parameter:    INOUT PPROCESS Process
+//******************************************************************************
+void
+UmNetRingCloseAll(
+    INOUT       PPROCESS                Process
+    );
@@ -0,0 +1,159 @@
+#include "HAL9000.h"
+#include "boot_timeline.h"
+#include "rtc.h"
+#include "iomu.h"
+
+typedef struct _BOOT_TIMELINE_ENTRY
+{
+    // set last, the entry is ignored by BootTimelineDump while it is NULL
+    char* volatile              Name;
+
+    QWORD                       Start;
+
+    // 0 while the step is running
+    volatile QWORD              End;
+
+    BOOT_TIMELINE_ENTRY_TYPE    Type;
+    APIC_ID                     ApicId;
+} BOOT_TIMELINE_ENTRY, *PBOOT_TIMELINE_ENTRY;
+
+typedef struct _BOOT_TIMELINE_DATA
+{
+    // TSC at which SystemPreinit started, the offsets are relative to it
+    QWORD                       BaseTimestamp;
+
+    // number of entries reserved, it keeps growing after the timeline is full
+    _Interlocked_
+    volatile DWORD              NumberOfEntries;
+
+    BOOT_TIMELINE_ENTRY         Entries[BOOT_TIMELINE_MAX_ENTRIES];
+} BOOT_TIMELINE_DATA, *PBOOT_TIMELINE_DATA;
+
+static BOOT_TIMELINE_DATA m_bootTimelineData;
+
+_No_competing_thread_
+void
+BootTimelinePreinit(
+    void
+    )
+{
+    memzero(&m_bootTimelineData, sizeof(BOOT_TIMELINE_DATA));
+
+    m_bootTimelineData.BaseTimestamp = RtcGetTickCount();
+}
+
+DWORD
+BootTimelineBegin(
+    IN_Z    char*                       Name,
+    IN      BOOT_TIMELINE_ENTRY_TYPE    Type
+    )
+{
+    PBOOT_TIMELINE_ENTRY pEntry;
+    DWORD index;
+
+    ASSERT(NULL != Name);
+    ASSERT(Type < BootTimelineEntryReserved);
+
+    index = _InterlockedIncrement(&m_bootTimelineData.NumberOfEntries) - 1;
+    if (index >= BOOT_TIMELINE_MAX_ENTRIES)
+    {
+        return BOOT_TIMELINE_INVALID_ENTRY;
+    }
+
+    pEntry = &m_bootTimelineData.Entries[index];
+
+    pEntry->Type = Type;
+    pEntry->ApicId = CpuGetApicId();
+    pEntry->End = 0;
+    pEntry->Start = RtcGetTickCount();
+
+    _ReadWriteBarrier();
+    pEntry->Name = Name;
+
+    return index;
+}
+
+void
+BootTimelineEnd(
+    IN      DWORD                       Index
+    )
+{
+    if (BOOT_TIMELINE_INVALID_ENTRY == Index)
+    {
+        return;
+    }
+
+    ASSERT(Index < BOOT_TIMELINE_MAX_ENTRIES);
+
+    m_bootTimelineData.Entries[Index].End = RtcGetTickCount();
+}
+
+void
+BootTimelineDump(
+    void
+    )
+{
+    BYTE order[BOOT_TIMELINE_MAX_ENTRIES];
+    DWORD noOfEntries;
+    DWORD noOfValidEntries;
+    QWORD lastEnd;
+    DWORD i;
+    DWORD j;
+
+    noOfEntries = min(m_bootTimelineData.NumberOfEntries, BOOT_TIMELINE_MAX_ENTRIES);
+    noOfValidEntries = 0;
+    lastEnd = m_bootTimelineData.BaseTimestamp;
+
+    // insertion sort by start time, the drivers loaded in parallel reserve
+    // their entries in the order in which they are started
+    for (i = 0; i < noOfEntries; ++i)
+    {
+        PBOOT_TIMELINE_ENTRY pEntry = &m_bootTimelineData.Entries[i];
+
+        if (NULL == pEntry->Name)
+        {
+            continue;
+        }
+
+        for (j = noOfValidEntries;
+             j > 0 && m_bootTimelineData.Entries[order[j - 1]].Start > pEntry->Start;
+             --j)
+        {
+            order[j] = order[j - 1];
+        }
+        order[j] = (BYTE) i;
+        noOfValidEntries++;
+
+        lastEnd = max(lastEnd, pEntry->End);
+    }
+
+    LOG("Boot timeline: %u steps, %U us since the kernel was entered\n",
+        noOfValidEntries, IomuTickCountToUs(lastEnd - m_bootTimelineData.BaseTimestamp));
+    if (m_bootTimelineData.NumberOfEntries > BOOT_TIMELINE_MAX_ENTRIES)
+    {
+        LOG_WARNING("%u steps did not fit in the timeline\n",
+                    m_bootTimelineData.NumberOfEntries - BOOT_TIMELINE_MAX_ENTRIES);
+    }
+
+    LOG("%12s%12s%6s  %s\n", "start(us)", "time(us)", "CPU", "step");
+    for (i = 0; i < noOfValidEntries; ++i)
+    {
+        PBOOT_TIMELINE_ENTRY pEntry = &m_bootTimelineData.Entries[order[i]];
+        QWORD end = pEntry->End;
+
+        LOG("%12U", IomuTickCountToUs(pEntry->Start - m_bootTimelineData.BaseTimestamp));
+        if (0 == end)
+        {
+            LOG("%12s", "running");
+        }
+        else
+        {
+            LOG("%12U", IomuTickCountToUs(end - pEntry->Start));
+        }
+
+        // the drivers are indented under the phase which loads them
+        LOG("%6x  %s%s\n", pEntry->ApicId,
+            (BootTimelineEntryDriver == pEntry->Type) ? "  " : "",
+            pEntry->Name);
+    }
+}
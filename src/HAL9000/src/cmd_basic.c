@@ -5,6 +5,7 @@
 #include "print.h"
 #include "iomu.h"
 #include "test_common.h"
+#include "test_primitives.h"
 #include "strutils.h"
 
 void
@@ -146,10 +147,23 @@ void
 
 void
 (__cdecl CmdRunAllPerformanceTests)(
-    IN          QWORD       NumberOfParameters
+    IN          QWORD       NumberOfParameters,
+    IN_Z        char*       Suite
     )
 {
-    ASSERT(NumberOfParameters == 0);
+    ASSERT(NumberOfParameters <= 1);
+
+    if (1 == NumberOfParameters)
+    {
+        if (0 != stricmp(Suite, "prim"))
+        {
+            LOG_ERROR("Unknown performance suite [%s]\n", Suite);
+            return;
+        }
+
+        TestPrimitivesPerformance();
+        return;
+    }
 
     TestRunAllPerformance();
 }
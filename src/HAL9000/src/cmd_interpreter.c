@@ -11,6 +11,7 @@
 #include "cmd_proc_helper.h"
 #include "cmd_sys_helper.h"
 #include "cmd_net_helper.h"
+#include "cmd_perf_helper.h"
 #include "cmd_basic.h"
 #include "boot_module.h"
 
@@ -61,13 +62,13 @@ static const COMMAND_DEFINITION COMMANDS[] =
 
     { "swap", "R|W [0x$OFFSET]\n\t$OFFSET - offset inside swap where to perform operation", CmdSwap, 1, 2},
 
-    { "cpu", "Displays CPU related information", CmdListCpus, 0, 0},
+    { "cpu", "Displays CPU related information and the run queue length over time", CmdListCpus, 0, 0},
     { "int", "List interrupts received", CmdListCpuInterrupts, 0, 0},
     { "yield", "Yields processor", CmdYield, 0, 0},
     { "timer", "$MODE [$TIME_IN_US] [$TIMES]\n\tSee EX_TIMER_TYPE for timer types\n\t$TIME_IN_US time in uS until timer fires"
                 "\n\t$TIMES - number of times to wait for timer, valid only if periodic", CmdTestTimer, 1, 3},
 
-    { "threads", "Displays all threads", CmdListThreads, 0, 0},
+    { "threads", "Displays all threads with their scheduling statistics and the system-wide latencies", CmdListThreads, 0, 0},
     { "run", "$TEST [$NO_OF_THREADS]\n\tRuns the $TEST specified"
              "\n\t$NO_OF_THREADS the number of threads for running the test,"
              "if the number is not specified then it will run on 2 * NumberOfProcessors",
@@ -97,9 +98,38 @@ static const COMMAND_DEFINITION COMMANDS[] =
     { "netstatus", "$DEV_ID $RX_EN $TX_EN - changes the state of a network device"
                    "\n\tDevice ID\n\tIf $RX_EN is 1 => will enable receive on device\n\tIf $TX_EN is 1 => will enable send on device",
                     CmdChangeDevStatus, 3, 3},
+    { "netperf", "$TX_DEV $RX_DEV [$FRAMES] [$FRAME_SIZE] - measures the throughput and latency between two devices"
+                 "\n\tFrames are sent from device $TX_DEV to device $RX_DEV, which may be the same device"
+                 "\n\tLost frames are not retransmitted, meant for the loopback devices",
+                    CmdNetperf, 2, 4},
 
     { "tests", "Runs functional tests", CmdRunAllFunctionalTests, 0, 0},
-    { "perf", "Runs performance tests", CmdRunAllPerformanceTests, 0, 0},
+    { "trace", "$ACTION [$ARG] - binary tracing of the scheduler, VMM, IRP and interrupt events"
+               "\n\ton [0x$CATEGORIES] - starts tracing, by default all categories, see TRACE_CATEGORY"
+               "\n\toff - stops tracing"
+               "\n\tdump - sends the records not yet dumped over serial"
+               "\n\tstream [$SECONDS] - dumps the records periodically for $SECONDS seconds",
+                CmdTrace, 1, 2},
+    { "profile", "$ACTION [$ARG] - samples the running code on each CPU using the LAPIC timer"
+                 "\n\tstart [$HZ] - discards the previous samples and starts sampling, by default at 1000 Hz"
+                 "\n\tstop - stops sampling"
+                 "\n\ttop [$N] - displays the $N symbols and threads with the most samples",
+                CmdProfile, 1, 2},
+    { "boottime", "Displays the duration of each boot phase and driver entry", CmdBootTimeline, 0, 0},
+    { "poolstat", "[$ACTION] [$ARG] - heap usage per allocation tag"
+                  "\n\twithout an action displays the tags with the most live bytes"
+                  "\n\thist $TAG - displays the size histogram of the allocations tagged with $TAG"
+                  "\n\tcheckpoint - marks the allocations made until now"
+                  "\n\tleaks [$N] - displays the first $N allocations made after the checkpoint which are still live",
+                CmdPoolStat, 0, 2},
+    { "pmu", "[$ACTION] [$EVENT] [$PERIOD] - hardware performance counters"
+             "\n\twithout an action displays the events counted on all the CPUs and by each thread"
+             "\n\tstart - counts cycles, instructions, LLC misses and branch misses per thread"
+             "\n\tsample $EVENT [$PERIOD] - takes a profiler sample each $PERIOD $EVENTs, see \"profile top\""
+             "\n\tstop - stops counting or sampling",
+                CmdPmu, 0, 3},
+
+    { "perf", "[prim] - Runs performance tests\n\tIf prim is specified only the kernel primitives are measured", CmdRunAllPerformanceTests, 0, 1},
 
     { "recursion", "Generates an infinite recursion", CmdInfiniteRecursion, 0, 0},
     { "rtcfail", "Causes an RTC check stack to assert", CmdRtcFail, 0, 0},
@@ -5,6 +5,89 @@
 #include "dmp_net_device.h"
 #include "test_net_stack.h"
 #include "strutils.h"
+#include "thread.h"
+#include "iomu.h"
+#include "rtc.h"
+
+#define NETPERF_DEFAULT_NO_OF_FRAMES        100000
+#define NETPERF_MAX_NO_OF_FRAMES            1000000
+
+// the smallest frame which does not need padding, without the FCS
+#define NETPERF_MIN_FRAME_SIZE              (IEEE_802_3_MINIMUM_FRAME_SIZE - (DWORD)sizeof(DWORD))
+#define NETPERF_MAX_FRAME_SIZE              (ETHERNET_FRAME_SIZE + 1500)
+
+// maximum number of frames sent and not yet received, small enough for the
+// receive buffers of the device never to run out
+#define NETPERF_WINDOW                      64
+
+// once no frame was received for this long the frames in flight are
+// considered lost, the window keeps the sender from going on without them
+#define NETPERF_IDLE_TIMEOUT_US             (1 * SEC_IN_US)
+
+// IEEE 802 local experimental EtherType
+#define NETPERF_ETHERNET_TYPE               __pragma(warning(suppress: 4310)) ((WORD)0x88B5ui16)
+
+#define NETPERF_MAGIC                       0x4652455054454E00ULL
+
+typedef struct _NETPERF_PAYLOAD
+{
+    QWORD                   Magic;
+    QWORD                   Sequence;
+    QWORD                   SendTicks;
+} NETPERF_PAYLOAD, *PNETPERF_PAYLOAD;
+
+STATIC_ASSERT(sizeof(ETHERNET_FRAME) + sizeof(NETPERF_PAYLOAD) <= NETPERF_MIN_FRAME_SIZE);
+
+typedef struct _NETPERF_CONTEXT
+{
+    DEVICE_ID               TxDevice;
+    MAC_ADDRESS             Destination;
+
+    DWORD                   NumberOfFrames;
+    DWORD                   FrameSize;
+
+    // written only by the receiving thread, the sender uses it to keep at
+    // most NETPERF_WINDOW frames in flight
+    volatile DWORD          FramesReceived;
+
+    // set by the receiving thread when it stops waiting for frames, the
+    // sender would otherwise wait forever for the window to move
+    volatile BOOLEAN        Aborted;
+
+    // written only by the sender, SenderDone is set once it stops sending
+    // whether it sent all the frames or failed with SenderStatus
+    volatile DWORD          FramesSent;
+    STATUS                  SenderStatus;
+    volatile BOOLEAN        SenderDone;
+} NETPERF_CONTEXT, *PNETPERF_CONTEXT;
+
+static FUNC_ThreadStart     _CmdNetperfTransmit;
+
+__forceinline
+static
+QWORD
+_CmdNetperfTicksToNs(
+    IN      QWORD                   Ticks,
+    IN      QWORD                   TickFrequency
+    )
+{
+    return (Ticks * SEC_IN_US) / (TickFrequency / 1000);
+}
+
+static
+BOOLEAN
+_CmdNetperfCheckDevice(
+    IN      DEVICE_ID               DeviceId,
+    OUT     PMAC_ADDRESS            PhysicalAddress
+    );
+
+static
+void
+_CmdNetperfSortSamples(
+    INOUT_UPDATES(NumberOfSamples)
+            QWORD*                  Samples,
+    IN      DWORD                   NumberOfSamples
+    );
 
 #pragma warning(push)
 
@@ -152,4 +235,445 @@ CmdChangeDevStatus(
     }
 }
 
+void
+CmdNetperf(
+    IN      QWORD       NumberOfParameters,
+    IN_Z    char*       TxDeviceString,
+    IN_Z    char*       RxDeviceString,
+    IN_Z    char*       FramesString,
+    IN_Z    char*       FrameSizeString
+    )
+{
+    static const DWORD PERCENTILES[] = { 500, 900, 990, 999 };
+
+    STATUS status;
+    NETPERF_CONTEXT ctx;
+    DEVICE_ID rxDevice;
+    MAC_ADDRESS txAddress;
+    PTHREAD pSender;
+    PETHERNET_FRAME pFrame;
+    PNETPERF_PAYLOAD pPayload;
+    QWORD* pLatencies;
+    QWORD tickFrequency;
+    QWORD startTicks;
+    QWORD elapsedUs;
+    QWORD receiveTicks;
+    QWORD lastReceiveTicks;
+    DWORD noOfFrames;
+    DWORD noOfLostFrames;
+    DWORD bytesReceived;
+    DWORD noOfForeignFrames;
+    DWORD noOfOutOfOrderFrames;
+    DWORD expectedSequence;
+    DWORD i;
+
+    ASSERT(2 <= NumberOfParameters && NumberOfParameters <= 4);
+
+    memzero(&ctx, sizeof(NETPERF_CONTEXT));
+
+    atoi32(&ctx.TxDevice, TxDeviceString, BASE_HEXA);
+    atoi32(&rxDevice, RxDeviceString, BASE_HEXA);
+
+    ctx.NumberOfFrames = NETPERF_DEFAULT_NO_OF_FRAMES;
+    if (NumberOfParameters >= 3)
+    {
+        atoi32(&ctx.NumberOfFrames, FramesString, BASE_TEN);
+    }
+
+    ctx.FrameSize = NETPERF_MIN_FRAME_SIZE;
+    if (NumberOfParameters >= 4)
+    {
+        atoi32(&ctx.FrameSize, FrameSizeString, BASE_TEN);
+    }
+
+    if (0 == ctx.NumberOfFrames || ctx.NumberOfFrames > NETPERF_MAX_NO_OF_FRAMES)
+    {
+        perror("Number of frames must be between 1 and %u\n", NETPERF_MAX_NO_OF_FRAMES);
+        return;
+    }
+
+    if (ctx.FrameSize < NETPERF_MIN_FRAME_SIZE || ctx.FrameSize > NETPERF_MAX_FRAME_SIZE)
+    {
+        perror("Frame size must be between %u and %u\n", NETPERF_MIN_FRAME_SIZE, NETPERF_MAX_FRAME_SIZE);
+        return;
+    }
+
+    // the frames could not get through otherwise
+    if (!_CmdNetperfCheckDevice(ctx.TxDevice, &txAddress) ||
+        !_CmdNetperfCheckDevice(rxDevice, &ctx.Destination))
+    {
+        return;
+    }
+
+    printf("Sending %u frames of %u bytes from device 0x%x to device 0x%x\n",
+           ctx.NumberOfFrames, ctx.FrameSize, ctx.TxDevice, rxDevice);
+
+    status = STATUS_SUCCESS;
+    pSender = NULL;
+    pFrame = NULL;
+    pPayload = NULL;
+    pLatencies = NULL;
+    noOfForeignFrames = 0;
+    noOfOutOfOrderFrames = 0;
+    expectedSequence = 0;
+    tickFrequency = 0;
+
+    IomuGetSystemTicks(&tickFrequency);
+
+    __try
+    {
+        pFrame = ExAllocatePoolWithTag(PoolAllocateZeroMemory, NETPERF_MAX_FRAME_SIZE, HEAP_TEMP_TAG, 0);
+        if (NULL == pFrame)
+        {
+            perror("ExAllocatePoolWithTag failed for size: 0x%x\n", NETPERF_MAX_FRAME_SIZE);
+            __leave;
+        }
+        pPayload = (PNETPERF_PAYLOAD) pFrame->Data;
+
+        pLatencies = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(QWORD) * ctx.NumberOfFrames, HEAP_TEMP_TAG, 0);
+        if (NULL == pLatencies)
+        {
+            perror("ExAllocatePoolWithTag failed for size: 0x%x\n", sizeof(QWORD) * ctx.NumberOfFrames);
+            __leave;
+        }
+
+        status = ThreadCreate("Netperf TX",
+                              ThreadPriorityDefault,
+                              _CmdNetperfTransmit,
+                              &ctx,
+                              &pSender);
+        if (!SUCCEEDED(status))
+        {
+            perror("ThreadCreate failed with status: 0x%x\n", status);
+            __leave;
+        }
+
+        startTicks = RtcGetTickCount();
+        lastReceiveTicks = startTicks;
+
+        // the receive does not block, a frame lost or not sent at all cannot
+        // leave us waiting for it forever
+        while (ctx.FramesReceived < ctx.NumberOfFrames)
+        {
+            status = NetReceiveFrame(rxDevice, FALSE, pFrame, NETPERF_MAX_FRAME_SIZE, &bytesReceived);
+            receiveTicks = RtcGetTickCount();
+            if (STATUS_NO_DATA_AVAILABLE == status)
+            {
+                if (ctx.SenderDone && ctx.FramesReceived >= ctx.FramesSent)
+                {
+                    // all the frames sent were received
+                    break;
+                }
+
+                if (IomuTickCountToUs(receiveTicks - lastReceiveTicks) >= NETPERF_IDLE_TIMEOUT_US)
+                {
+                    pwarn("No frame received for %U us, giving up\n", (QWORD) NETPERF_IDLE_TIMEOUT_US);
+                    break;
+                }
+
+                ThreadYield();
+                continue;
+            }
+
+            if (!SUCCEEDED(status))
+            {
+                perror("NetReceiveFrame failed with status: 0x%x\n", status);
+                __leave;
+            }
+
+            lastReceiveTicks = receiveTicks;
+
+            if (bytesReceived < NETPERF_MIN_FRAME_SIZE ||
+                pFrame->Type != htonw(NETPERF_ETHERNET_TYPE) ||
+                pPayload->Magic != NETPERF_MAGIC)
+            {
+                noOfForeignFrames++;
+                continue;
+            }
+
+            if (pPayload->Sequence != expectedSequence)
+            {
+                noOfOutOfOrderFrames++;
+            }
+            expectedSequence = (DWORD) pPayload->Sequence + 1;
+
+            pLatencies[ctx.FramesReceived] = receiveTicks - pPayload->SendTicks;
+
+            // the sender may send another frame once this one is counted
+            _InterlockedIncrement(&ctx.FramesReceived);
+        }
+
+        // stop the sender before looking at the number of frames it sent
+        _InterlockedExchange8(&ctx.Aborted, TRUE);
+        while (!ctx.SenderDone)
+        {
+            ThreadYield();
+        }
+
+        if (!SUCCEEDED(ctx.SenderStatus))
+        {
+            pwarn("The sender failed after %u of %u frames\n", ctx.FramesSent, ctx.NumberOfFrames);
+        }
+
+        // frames left in the queues by a previous run are counted as well
+        noOfFrames = ctx.FramesReceived;
+        noOfLostFrames = ctx.FramesSent - min(noOfFrames, ctx.FramesSent);
+
+        // the idle time spent waiting for the lost frames is not counted
+        elapsedUs = max(1, IomuTickCountToUs(lastReceiveTicks - startTicks));
+
+        LOG("Sent %u frames, received %u frames in %U us, lost %u frames",
+            ctx.FramesSent, noOfFrames, elapsedUs, noOfLostFrames);
+        LOG(", %u foreign and %u out of order frames\n", noOfForeignFrames, noOfOutOfOrderFrames);
+        if (0 == noOfFrames)
+        {
+            __leave;
+        }
+
+        LOG("Packets per second: %U\n", ((QWORD) noOfFrames * SEC_IN_US) / elapsedUs);
+        LOG("Bytes per second: %U\n", ((QWORD) noOfFrames * ctx.FrameSize * SEC_IN_US) / elapsedUs);
+
+        _CmdNetperfSortSamples(pLatencies, noOfFrames);
+
+        // the latencies are measured under load, they include the time the
+        // frames spent waiting in the queues
+        LOG("Latency (ns) min: %U", _CmdNetperfTicksToNs(pLatencies[0], tickFrequency));
+        for (i = 0; i < ARRAYSIZE(PERCENTILES); ++i)
+        {
+            QWORD sample = pLatencies[((QWORD) noOfFrames - 1) * PERCENTILES[i] / 1000];
+
+            LOG(" p%u.%u: %U", PERCENTILES[i] / 10, PERCENTILES[i] % 10, _CmdNetperfTicksToNs(sample, tickFrequency));
+        }
+        LOG(" max: %U\n", _CmdNetperfTicksToNs(pLatencies[noOfFrames - 1], tickFrequency));
+    }
+    __finally
+    {
+        if (NULL != pSender)
+        {
+            // nothing to do if the sender already sent all the frames
+            _InterlockedExchange8(&ctx.Aborted, TRUE);
+
+            ThreadWaitForTermination(pSender, &status);
+            if (!SUCCEEDED(status))
+            {
+                perror("Sender terminated with status: 0x%x\n", status);
+            }
+
+            ThreadCloseHandle(pSender);
+            pSender = NULL;
+        }
+
+        if (NULL != pLatencies)
+        {
+            ExFreePoolWithTag(pLatencies, HEAP_TEMP_TAG);
+            pLatencies = NULL;
+        }
+
+        if (NULL != pFrame)
+        {
+            ExFreePoolWithTag(pFrame, HEAP_TEMP_TAG);
+            pFrame = NULL;
+        }
+    }
+}
+
 #pragma warning(pop)
+
+static
+STATUS
+(__cdecl _CmdNetperfTransmit)(
+    IN_OPT      PVOID       Context
+    )
+{
+    STATUS status;
+    PNETPERF_CONTEXT pCtx;
+    PETHERNET_FRAME pFrame;
+    PNETPERF_PAYLOAD pPayload;
+    DWORD i;
+
+    ASSERT(NULL != Context);
+
+    pCtx = (PNETPERF_CONTEXT) Context;
+    status = STATUS_SUCCESS;
+
+    pFrame = ExAllocatePoolWithTag(PoolAllocateZeroMemory, pCtx->FrameSize, HEAP_TEMP_TAG, 0);
+    if (NULL == pFrame)
+    {
+        pCtx->SenderStatus = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+        _InterlockedExchange8(&pCtx->SenderDone, TRUE);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    pFrame->Type = htonw(NETPERF_ETHERNET_TYPE);
+    pPayload = (PNETPERF_PAYLOAD) pFrame->Data;
+    pPayload->Magic = NETPERF_MAGIC;
+
+    for (i = 0; i < pCtx->NumberOfFrames; ++i)
+    {
+        while (i - pCtx->FramesReceived >= NETPERF_WINDOW && !pCtx->Aborted)
+        {
+            ThreadYield();
+        }
+
+        if (pCtx->Aborted)
+        {
+            break;
+        }
+
+        pPayload->Sequence = i;
+        pPayload->SendTicks = RtcGetTickCount();
+
+        status = NetSendFrame(FALSE, pCtx->TxDevice, pFrame, pCtx->FrameSize, pCtx->Destination);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("NetSendFrame", status);
+            break;
+        }
+
+        // the receiver learns when to stop expecting frames from this count
+        pCtx->FramesSent = i + 1;
+    }
+
+    ExFreePoolWithTag(pFrame, HEAP_TEMP_TAG);
+
+    pCtx->SenderStatus = status;
+    _InterlockedExchange8(&pCtx->SenderDone, TRUE);
+
+    return status;
+}
+
+static
+BOOLEAN
+_CmdNetperfCheckDevice(
+    IN      DEVICE_ID               DeviceId,
+    OUT     PMAC_ADDRESS            PhysicalAddress
+    )
+{
+    PNETWORK_DEVICE_INFO pNetDevices;
+    DWORD noOfDevices;
+    STATUS status;
+    BOOLEAN bUsable;
+
+    ASSERT(NULL != PhysicalAddress);
+
+    pNetDevices = NULL;
+    noOfDevices = 0;
+    bUsable = FALSE;
+
+    status = NetGetNetworkDevices(NULL, &noOfDevices);
+    if (!SUCCEEDED(status) || 0 == noOfDevices)
+    {
+        perror("NetGetNetworkDevices failed with status: 0x%x\n", status);
+        return FALSE;
+    }
+
+    __try
+    {
+        pNetDevices = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(NETWORK_DEVICE_INFO) * noOfDevices, HEAP_TEMP_TAG, 0);
+        if (NULL == pNetDevices)
+        {
+            perror("ExAllocatePoolWithTag failed for size: 0x%x\n", sizeof(NETWORK_DEVICE_INFO) * noOfDevices);
+            __leave;
+        }
+
+        status = NetGetNetworkDevices(pNetDevices, &noOfDevices);
+        if (!SUCCEEDED(status))
+        {
+            perror("NetGetNetworkDevices failed with status: 0x%x\n", status);
+            __leave;
+        }
+
+        for (DWORD i = 0; i < noOfDevices; ++i)
+        {
+            if (pNetDevices[i].DeviceId != DeviceId)
+            {
+                continue;
+            }
+
+            bUsable = pNetDevices[i].LinkStatus &&
+                      pNetDevices[i].DeviceStatus.RxEnabled &&
+                      pNetDevices[i].DeviceStatus.TxEnabled;
+            if (!bUsable)
+            {
+                perror("Device 0x%x must have its link up and both RX and TX enabled\n", DeviceId);
+            }
+
+            *PhysicalAddress = pNetDevices[i].PhysicalAddress;
+            __leave;
+        }
+
+        perror("There is no network device 0x%x\n", DeviceId);
+    }
+    __finally
+    {
+        if (NULL != pNetDevices)
+        {
+            ExFreePoolWithTag(pNetDevices, HEAP_TEMP_TAG);
+            pNetDevices = NULL;
+        }
+    }
+
+    return bUsable;
+}
+
+static
+void
+_CmdNetperfSiftDown(
+    INOUT_UPDATES(NumberOfSamples)
+            QWORD*                  Samples,
+    IN      DWORD                   Root,
+    IN      DWORD                   NumberOfSamples
+    )
+{
+    DWORD child;
+    QWORD temp;
+
+    while ((child = 2 * Root + 1) < NumberOfSamples)
+    {
+        if (child + 1 < NumberOfSamples && Samples[child + 1] > Samples[child])
+        {
+            child = child + 1;
+        }
+
+        if (Samples[Root] >= Samples[child])
+        {
+            break;
+        }
+
+        temp = Samples[Root];
+        Samples[Root] = Samples[child];
+        Samples[child] = temp;
+
+        Root = child;
+    }
+}
+
+// heap sort, the number of samples can be too large for anything quadratic
+// and there is no room on the stack for recursion
+static
+void
+_CmdNetperfSortSamples(
+    INOUT_UPDATES(NumberOfSamples)
+            QWORD*                  Samples,
+    IN      DWORD                   NumberOfSamples
+    )
+{
+    DWORD i;
+    QWORD temp;
+
+    ASSERT(NULL != Samples);
+
+    for (i = NumberOfSamples / 2; i > 0; --i)
+    {
+        _CmdNetperfSiftDown(Samples, i - 1, NumberOfSamples);
+    }
+
+    for (i = NumberOfSamples; i > 1; --i)
+    {
+        temp = Samples[0];
+        Samples[0] = Samples[i - 1];
+        Samples[i - 1] = temp;
+
+        _CmdNetperfSiftDown(Samples, 0, i - 1);
+    }
+}
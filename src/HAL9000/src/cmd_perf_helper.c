@@ -0,0 +1,651 @@
+#include "HAL9000.h"
+#include "cmd_perf_helper.h"
+#include "print.h"
+#include "strutils.h"
+#include "ex_timer.h"
+#include "trace.h"
+#include "profiler.h"
+#include "boot_timeline.h"
+#include "pool_stats.h"
+#include "mmu.h"
+#include "pmu.h"
+#include "thread_internal.h"
+
+#define TRACE_STREAM_DEFAULT_SECONDS        10
+#define TRACE_STREAM_PERIOD_US              (100 * MS_IN_US)
+
+#define PROFILE_DEFAULT_TOP_ENTRIES         10
+#define PROFILE_MAX_TOP_ENTRIES             64
+#define PROFILE_SYMBOL_MAX_SIZE             64
+
+#define POOLSTAT_DEFAULT_LEAKS              32
+#define POOLSTAT_MAX_LEAKS                  1024
+
+static const char* PMU_EVENT_NAMES[PmuEventReserved] = { "cycles", "instructions", "llc-misses", "branch-misses" };
+
+#pragma warning(push)
+
+// warning C4212: nonstandard extension used: function declaration used ellipsis
+#pragma warning(disable:4212)
+
+// warning C4029: declared formal parameter list different from definition
+#pragma warning(disable:4029)
+
+static
+void
+_CmdTraceStream(
+    IN      DWORD       Seconds
+    );
+
+static
+void
+_CmdProfileDisplayTop(
+    IN      DWORD       NumberOfEntries
+    );
+
+static
+void
+_CmdPoolStatDisplayTags(
+    IN_OPT_Z    char*   Tag
+    );
+
+static
+void
+_CmdPoolStatDisplayLeaks(
+    IN      DWORD       MaxAllocations
+    );
+
+static
+void
+_CmdPoolStatTagToString(
+    IN      DWORD       Tag,
+    OUT_WRITES_Z(sizeof(DWORD) + 1)
+            char*       String
+    );
+
+static
+void
+_CmdPmuDisplayCounts(
+    void
+    );
+
+static FUNC_ListFunction _CmdPmuPrintThread;
+
+void
+(__cdecl CmdTrace)(
+    IN          QWORD       NumberOfParameters,
+    IN_Z        char*       Action,
+    IN_OPT_Z    char*       Argument
+    )
+{
+    STATUS status;
+    TRACE_CATEGORY categories;
+    DWORD seconds;
+    QWORD recordsDumped;
+    QWORD recordsLost;
+
+    ASSERT(1 <= NumberOfParameters && NumberOfParameters <= 2);
+
+    if (0 == stricmp(Action, "on"))
+    {
+        categories = TRACE_CATEGORY_ALL;
+        if (2 == NumberOfParameters)
+        {
+            atoi32(&categories, Argument, BASE_HEXA);
+        }
+
+        status = TraceStart(categories);
+        if (!SUCCEEDED(status))
+        {
+            perror("TraceStart failed with status 0x%x\n", status);
+            return;
+        }
+
+        printf("Tracing categories 0x%x\n", categories);
+    }
+    else if (0 == stricmp(Action, "off"))
+    {
+        TraceStop();
+    }
+    else if (0 == stricmp(Action, "dump"))
+    {
+        recordsDumped = TraceDump(&recordsLost);
+
+        printf("Dumped %U records over serial, %U records were lost\n", recordsDumped, recordsLost);
+    }
+    else if (0 == stricmp(Action, "stream"))
+    {
+        seconds = TRACE_STREAM_DEFAULT_SECONDS;
+        if (2 == NumberOfParameters)
+        {
+            atoi32(&seconds, Argument, BASE_TEN);
+        }
+
+        _CmdTraceStream(seconds);
+    }
+    else
+    {
+        perror("Unknown trace action [%s]\n", Action);
+    }
+}
+
+static
+void
+_CmdTraceStream(
+    IN      DWORD       Seconds
+    )
+{
+    STATUS status;
+    EX_TIMER timer;
+    QWORD recordsDumped;
+    QWORD recordsLost;
+    QWORD totalDumped;
+    QWORD totalLost;
+    DWORD noOfPeriods;
+    DWORD i;
+
+    totalDumped = 0;
+    totalLost = 0;
+    noOfPeriods = (DWORD) ((QWORD) Seconds * SEC_IN_US / TRACE_STREAM_PERIOD_US);
+
+    status = ExTimerInit(&timer, ExTimerTypeRelativePeriodic, TRACE_STREAM_PERIOD_US);
+    if (!SUCCEEDED(status))
+    {
+        perror("ExTimerInit failed with status 0x%x\n", status);
+        return;
+    }
+
+    printf("Streaming the trace records over serial for %u seconds\n", Seconds);
+
+    ExTimerStart(&timer);
+
+    for (i = 0; i < noOfPeriods; ++i)
+    {
+        ExTimerWait(&timer);
+
+        recordsDumped = TraceDump(&recordsLost);
+
+        totalDumped = totalDumped + recordsDumped;
+        totalLost = totalLost + recordsLost;
+    }
+
+    ExTimerUninit(&timer);
+
+    printf("Streamed %U records, %U records were lost\n", totalDumped, totalLost);
+}
+
+void
+(__cdecl CmdProfile)(
+    IN          QWORD       NumberOfParameters,
+    IN_Z        char*       Action,
+    IN_OPT_Z    char*       Argument
+    )
+{
+    STATUS status;
+    DWORD value;
+
+    ASSERT(1 <= NumberOfParameters && NumberOfParameters <= 2);
+
+    if (0 == stricmp(Action, "start"))
+    {
+        value = PROFILER_DEFAULT_FREQUENCY_HZ;
+        if (2 == NumberOfParameters)
+        {
+            atoi32(&value, Argument, BASE_TEN);
+        }
+
+        // PROFILER_FREQUENCY_EXTERNAL is used only by the PMU sampling
+        if (PROFILER_FREQUENCY_EXTERNAL == value)
+        {
+            perror("The frequency must be between 1 and %u Hz\n", PROFILER_MAX_FREQUENCY_HZ);
+            return;
+        }
+
+        status = ProfilerStart(value);
+        if (!SUCCEEDED(status))
+        {
+            perror("ProfilerStart failed with status 0x%x\n", status);
+            return;
+        }
+
+        printf("Sampling at %u Hz\n", value);
+    }
+    else if (0 == stricmp(Action, "stop"))
+    {
+        ProfilerStop();
+    }
+    else if (0 == stricmp(Action, "top"))
+    {
+        value = PROFILE_DEFAULT_TOP_ENTRIES;
+        if (2 == NumberOfParameters)
+        {
+            atoi32(&value, Argument, BASE_TEN);
+        }
+
+        _CmdProfileDisplayTop(min(value, PROFILE_MAX_TOP_ENTRIES));
+    }
+    else
+    {
+        perror("Unknown profile action [%s]\n", Action);
+    }
+}
+
+void
+(__cdecl CmdBootTimeline)(
+    IN          QWORD       NumberOfParameters
+    )
+{
+    ASSERT(NumberOfParameters == 0);
+
+    BootTimelineDump();
+}
+
+void
+(__cdecl CmdPoolStat)(
+    IN          QWORD       NumberOfParameters,
+    IN_OPT_Z    char*       Action,
+    IN_OPT_Z    char*       Argument
+    )
+{
+    DWORD value;
+
+    ASSERT(NumberOfParameters <= 2);
+
+    if (0 == NumberOfParameters)
+    {
+        _CmdPoolStatDisplayTags(NULL);
+    }
+    else if (0 == stricmp(Action, "hist"))
+    {
+        if (2 != NumberOfParameters || sizeof(DWORD) != strlen(Argument))
+        {
+            perror("A tag of %u characters must be specified\n", sizeof(DWORD));
+            return;
+        }
+
+        _CmdPoolStatDisplayTags(Argument);
+    }
+    else if (0 == stricmp(Action, "checkpoint"))
+    {
+        PoolStatsCheckpoint();
+
+        printf("Only the allocations made from now on will be reported as leaks\n");
+    }
+    else if (0 == stricmp(Action, "leaks"))
+    {
+        value = POOLSTAT_DEFAULT_LEAKS;
+        if (2 == NumberOfParameters)
+        {
+            atoi32(&value, Argument, BASE_TEN);
+        }
+
+        _CmdPoolStatDisplayLeaks(min(value, POOLSTAT_MAX_LEAKS));
+    }
+    else
+    {
+        perror("Unknown poolstat action [%s]\n", Action);
+    }
+}
+
+void
+(__cdecl CmdPmu)(
+    IN          QWORD       NumberOfParameters,
+    IN_OPT_Z    char*       Action,
+    IN_OPT_Z    char*       Event,
+    IN_OPT_Z    char*       Period
+    )
+{
+    STATUS status;
+    DWORD event;
+    DWORD period;
+
+    ASSERT(NumberOfParameters <= 3);
+
+    if (0 == NumberOfParameters)
+    {
+        _CmdPmuDisplayCounts();
+    }
+    else if (0 == stricmp(Action, "start"))
+    {
+        status = PmuStart(PmuModeCounting, PmuEventReserved, 0);
+        if (!SUCCEEDED(status))
+        {
+            perror("PmuStart failed with status 0x%x\n", status);
+            return;
+        }
+
+        printf("Counting the available events\n");
+    }
+    else if (0 == stricmp(Action, "sample"))
+    {
+        if (NumberOfParameters < 2)
+        {
+            perror("The event to sample must be specified\n");
+            return;
+        }
+
+        for (event = 0; event < PmuEventReserved && 0 != stricmp(Event, PMU_EVENT_NAMES[event]); ++event);
+        if (PmuEventReserved == event)
+        {
+            perror("Unknown event [%s]\n", Event);
+            return;
+        }
+
+        period = PMU_DEFAULT_SAMPLING_PERIOD;
+        if (3 == NumberOfParameters)
+        {
+            atoi32(&period, Period, BASE_TEN);
+        }
+
+        status = PmuStart(PmuModeSampling, event, period);
+        if (!SUCCEEDED(status))
+        {
+            perror("PmuStart failed with status 0x%x\n", status);
+            return;
+        }
+
+        printf("Sampling every %u %s\n", period, PMU_EVENT_NAMES[event]);
+    }
+    else if (0 == stricmp(Action, "stop"))
+    {
+        PmuStop();
+    }
+    else
+    {
+        perror("Unknown pmu action [%s]\n", Action);
+    }
+}
+
+static
+void
+_CmdProfileDisplayTop(
+    IN      DWORD       NumberOfEntries
+    )
+{
+    STATUS status;
+    PROFILER_HISTOGRAM_ENTRY entries[PROFILE_MAX_TOP_ENTRIES];
+    PROFILER_SUMMARY summary;
+    char symbol[PROFILE_SYMBOL_MAX_SIZE];
+    DWORD noOfEntries;
+    DWORD i;
+
+    ASSERT(NumberOfEntries <= PROFILE_MAX_TOP_ENTRIES);
+
+    if (0 == NumberOfEntries)
+    {
+        return;
+    }
+
+    status = ProfilerBuildHistogram(ProfilerHistogramSymbols, NumberOfEntries, entries, &noOfEntries, &summary);
+    if (!SUCCEEDED(status))
+    {
+        perror("ProfilerBuildHistogram failed with status 0x%x\n", status);
+        return;
+    }
+
+    printf("%U samples, %U in user-mode, %U lost, %U not accounted\n",
+           summary.Samples, summary.UserModeSamples, summary.SamplesLost, summary.SamplesNotAccounted);
+    if (0 == summary.Samples)
+    {
+        return;
+    }
+
+    printf("%7s%7s%10s%10s  %s\n", "self%", "total%", "self", "total", "symbol");
+    for (i = 0; i < noOfEntries; ++i)
+    {
+        ProfilerResolveSymbol((PVOID) entries[i].Key, symbol, PROFILE_SYMBOL_MAX_SIZE);
+
+        printf("%7U%7U%10U%10U  %s\n",
+               entries[i].SelfSamples * 100 / summary.Samples,
+               entries[i].TotalSamples * 100 / summary.Samples,
+               entries[i].SelfSamples,
+               entries[i].TotalSamples,
+               symbol);
+    }
+
+    status = ProfilerBuildHistogram(ProfilerHistogramThreads, NumberOfEntries, entries, &noOfEntries, &summary);
+    if (!SUCCEEDED(status))
+    {
+        perror("ProfilerBuildHistogram failed with status 0x%x\n", status);
+        return;
+    }
+
+    printf("\n%7s%10s  %s\n", "self%", "self", "TID");
+    for (i = 0; i < noOfEntries; ++i)
+    {
+        printf("%7U%10U  0x%X\n",
+               entries[i].SelfSamples * 100 / summary.Samples,
+               entries[i].SelfSamples,
+               entries[i].Key);
+    }
+}
+
+static
+void
+_CmdPoolStatDisplayTags(
+    IN_OPT_Z    char*   Tag
+    )
+{
+    PPOOL_TAG_STATS pEntries;
+    char tag[sizeof(DWORD) + 1];
+    QWORD heapSize;
+    QWORD bytesUsed;
+    QWORD noOfAllocations;
+    DWORD noOfEntries;
+    DWORD i;
+    DWORD j;
+
+    // the entries do not fit on the stack
+    pEntries = ExAllocatePoolWithTag(0, sizeof(POOL_TAG_STATS) * POOL_STATS_MAX_TAGS, HEAP_TEMP_TAG, 0);
+    if (NULL == pEntries)
+    {
+        perror("Failed to allocate %u bytes\n", sizeof(POOL_TAG_STATS) * POOL_STATS_MAX_TAGS);
+        return;
+    }
+
+    PoolStatsRetrieve(POOL_STATS_MAX_TAGS, pEntries, &noOfEntries);
+
+    if (NULL == Tag)
+    {
+        MmuGetPoolUsage(&heapSize, &bytesUsed, &noOfAllocations);
+
+        printf("Heap: %U KB used out of %U KB by %U allocations\n",
+               bytesUsed / KB_SIZE, heapSize / KB_SIZE, noOfAllocations);
+
+        printf("%6s%12s%12s%10s%10s%10s\n", "tag", "live", "peak", "allocs", "frees", "live#");
+    }
+
+    for (i = 0; i < noOfEntries; ++i)
+    {
+        _CmdPoolStatTagToString(pEntries[i].Tag, tag);
+
+        if (NULL == Tag)
+        {
+            printf("%6s%12U%12U%10U%10U%10U\n", tag,
+                   pEntries[i].LiveBytes, pEntries[i].PeakBytes,
+                   pEntries[i].Allocations, pEntries[i].Frees,
+                   pEntries[i].Allocations - pEntries[i].Frees);
+            continue;
+        }
+
+        if (0 != strcmp(tag, Tag))
+        {
+            continue;
+        }
+
+        printf("%U allocations, %U bytes in total\n", pEntries[i].Allocations, pEntries[i].BytesAllocated);
+        printf("%12s%10s\n", "size<=", "allocs");
+        for (j = 0; j < POOL_STATS_SIZE_CLASSES; ++j)
+        {
+            if (j == POOL_STATS_SIZE_CLASSES - 1)
+            {
+                printf("%12s%10U\n", "larger", pEntries[i].SizeClasses[j]);
+            }
+            else
+            {
+                printf("%12u%10U\n", POOL_STATS_SIZE_CLASS_LIMIT(j), pEntries[i].SizeClasses[j]);
+            }
+        }
+        break;
+    }
+
+    if (NULL != Tag && i == noOfEntries)
+    {
+        perror("No allocations were made with the tag [%s]\n", Tag);
+    }
+
+    ExFreePoolWithTag(pEntries, HEAP_TEMP_TAG);
+}
+
+static
+void
+_CmdPoolStatDisplayLeaks(
+    IN      DWORD       MaxAllocations
+    )
+{
+    PHEAP_ALLOCATION_INFO pAllocations;
+    char tag[sizeof(DWORD) + 1];
+    QWORD sequence;
+    QWORD noOfAllocations;
+    DWORD i;
+
+    pAllocations = NULL;
+
+    // the allocations made from here on, including the buffer below, are
+    // not leaks
+    sequence = MmuGetPoolAllocationSequence();
+
+    if (0 != MaxAllocations)
+    {
+        pAllocations = ExAllocatePoolWithTag(0, sizeof(HEAP_ALLOCATION_INFO) * MaxAllocations, HEAP_TEMP_TAG, 0);
+        if (NULL == pAllocations)
+        {
+            perror("Failed to allocate %u bytes\n", sizeof(HEAP_ALLOCATION_INFO) * MaxAllocations);
+            return;
+        }
+    }
+
+    noOfAllocations = PoolStatsRetrieveLeaks(sequence, MaxAllocations, pAllocations);
+
+    printf("%U allocations made after the checkpoint are still live\n", noOfAllocations);
+
+    if (0 != noOfAllocations && 0 != MaxAllocations)
+    {
+        printf("%18s%10s%6s%10s\n", "address", "size", "tag", "sequence");
+    }
+
+    for (i = 0; i < min(noOfAllocations, MaxAllocations); ++i)
+    {
+        _CmdPoolStatTagToString(pAllocations[i].Tag, tag);
+
+        printf("%18X%10u%6s%10U\n", pAllocations[i].Address, pAllocations[i].Size, tag, pAllocations[i].Sequence);
+    }
+
+    if (NULL != pAllocations)
+    {
+        ExFreePoolWithTag(pAllocations, HEAP_TEMP_TAG);
+    }
+}
+
+static
+void
+_CmdPoolStatTagToString(
+    IN      DWORD       Tag,
+    OUT_WRITES_Z(sizeof(DWORD) + 1)
+            char*       String
+    )
+{
+    // the tags are written reversed in the source, so the characters stored
+    // in memory are the ones to display
+    memcpy(String, &Tag, sizeof(DWORD));
+    String[sizeof(DWORD)] = '\0';
+
+    // the allocations of the tags which did not fit in the table
+    if (0 == Tag)
+    {
+        strcpy(String, "????");
+    }
+}
+
+static
+void
+_CmdPmuDisplayCounts(
+    void
+    )
+{
+    STATUS status;
+    PMU_INFO info;
+    QWORD counts[PmuEventReserved];
+    QWORD samples;
+    DWORD i;
+
+    PmuGetInfo(&info);
+
+    if (0 == info.Version)
+    {
+        printf("CPUID reports no architectural PMU\n");
+        return;
+    }
+
+    printf("PMU version %u, %u general-purpose and %u fixed counters\n",
+           info.Version, info.NumberOfGeneralCounters, info.NumberOfFixedCounters);
+
+    PmuRetrieveCounts(counts, &samples);
+
+    printf("%16s%18s\n", "event", "count");
+    for (i = 0; i < PmuEventReserved; ++i)
+    {
+        if (!info.EventAvailable[i])
+        {
+            printf("%16s%18s\n", PMU_EVENT_NAMES[i], "unavailable");
+            continue;
+        }
+
+        printf("%16s%18U\n", PMU_EVENT_NAMES[i], counts[i]);
+    }
+    printf("%U overflow samples\n", samples);
+
+    printf("\n%6s%19s", "TID", "name");
+    for (i = 0; i < PmuEventReserved; ++i)
+    {
+        printf("%16s", PMU_EVENT_NAMES[i]);
+    }
+    printf("\n");
+
+    status = ThreadExecuteForEachThreadEntry(_CmdPmuPrintThread, NULL);
+    ASSERT(SUCCEEDED(status));
+}
+
+static
+STATUS
+(__cdecl _CmdPmuPrintThread) (
+    IN      PLIST_ENTRY     ListEntry,
+    IN_OPT  PVOID           FunctionContext
+    )
+{
+    PTHREAD pThread;
+    QWORD counts[PmuEventReserved];
+    DWORD i;
+
+    ASSERT(NULL != ListEntry);
+    ASSERT(NULL == FunctionContext);
+
+    pThread = CONTAINING_RECORD(ListEntry, THREAD, AllList);
+
+    // the threads which did not run while counting are not displayed
+    if (!PmuGetThreadCounts(&pThread->PmuCounters, counts))
+    {
+        return STATUS_SUCCESS;
+    }
+
+    printf("%6x%19s", pThread->Id, pThread->Name);
+    for (i = 0; i < PmuEventReserved; ++i)
+    {
+        printf("%16U", counts[i]);
+    }
+    printf("\n");
+
+    return STATUS_SUCCESS;
+}
+
+#pragma warning(pop)
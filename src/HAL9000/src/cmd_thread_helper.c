@@ -16,6 +16,7 @@
 #include "ex_timer.h"
 #include "vmm.h"
 #include "pit.h"
+#include "rtc.h"
 
 
 #pragma warning(push)
@@ -73,6 +74,13 @@ _CmdReadAndDumpCpuid(
 
 static FUNC_ListFunction _CmdThreadPrint;
 
+static
+void
+_CmdPrintLatencyHistogram(
+    IN_Z    char*               Name,
+    IN      THREAD_LATENCY_TYPE Type
+    );
+
 void
 (__cdecl CmdListCpus)(
     IN          QWORD       NumberOfParameters
@@ -118,6 +126,36 @@ void
         printf("%6U%c", pCpu->PageFaults, '|' );
         printf("%14s%c", pCpu->ThreadData.CurrentThread->Name, '|');
     }
+
+    printf("\nReady list length sampled on each clock tick, oldest to newest:\n");
+    printColor(MAGENTA_COLOR, "%8s", "Apic ID|");
+    printColor(MAGENTA_COLOR, "%9s", "Samples|");
+    printColor(MAGENTA_COLOR, "%7s", "Avg|");
+    printColor(MAGENTA_COLOR, "%5s", "Max|");
+    printColor(MAGENTA_COLOR, "%s", " History\n");
+
+    for(pCurEntry = pCpuListHead->Flink;
+        pCurEntry != pCpuListHead;
+        pCurEntry = pCurEntry->Flink)
+    {
+        PPCPU pCpu = CONTAINING_RECORD( pCurEntry, PCPU, ListEntry);
+        PTHREADING_DATA pData = &pCpu->ThreadData;
+        QWORD noOfSamples = pData->RunQueueSamples;
+
+        // two decimals
+        QWORD average = 0 != noOfSamples ? (pData->RunQueueLengthSum * 100) / noOfSamples : 0;
+
+        printf("%7x%c", pCpu->ApicId, '|' );
+        printf("%8U%c", noOfSamples, '|');
+        printf("%3U.%02U%c", average / 100, average % 100, '|');
+        printf("%4u%c", pData->RunQueueLengthMax, '|');
+
+        for (QWORD i = noOfSamples - min(noOfSamples, RUN_QUEUE_HISTORY_SIZE); i < noOfSamples; ++i)
+        {
+            printf(" %u", pData->RunQueueHistory[i % RUN_QUEUE_HISTORY_SIZE]);
+        }
+        printf("\n");
+    }
 }
 
 void
@@ -137,10 +175,20 @@ void
     LOG("%10s", "Prt ticks|");
     LOG("%10s", "Ttl ticks|");
     LOG("%10s", "Process|");
+    LOG("%10s", "Run ms|");
+    LOG("%10s", "Wait us|");
+    LOG("%10s", "Max us|");
+    LOG("%8s", "Vol sw|");
+    LOG("%8s", "Inv sw|");
     LOG("\n");
 
     status = ThreadExecuteForEachThreadEntry(_CmdThreadPrint, NULL );
     ASSERT( SUCCEEDED(status));
+
+    LOG("\nScheduling latencies in us:\n");
+    _CmdPrintLatencyHistogram("Wakeup", ThreadLatencyWakeup);
+    _CmdPrintLatencyHistogram("Requeue", ThreadLatencyRequeue);
+    _CmdPrintLatencyHistogram("Start", ThreadLatencyStart);
 }
 
 void
@@ -679,11 +727,22 @@ STATUS
     )
 {
     PTHREAD pThread;
+    PTHREAD_SCHEDULER_STATS pStats;
+    QWORD runTime;
 
     ASSERT( NULL != ListEntry );
     ASSERT( NULL == FunctionContext );
 
     pThread = CONTAINING_RECORD(ListEntry, THREAD, AllList );
+    pStats = &pThread->SchedulerStats;
+
+    // the current run of a running thread is accounted only when it is
+    // de-scheduled
+    runTime = pStats->RunTime;
+    if (ThreadStateRunning == pThread->State && 0 != pStats->RunTimestamp)
+    {
+        runTime += RtcGetTickCount() - pStats->RunTimestamp;
+    }
 
     LOG("%6x%c", pThread->Id, '|');
     LOG("%19s%c", pThread->Name, '|');
@@ -693,11 +752,50 @@ STATUS
     LOG("%9U%c", pThread->TickCountEarly, '|');
     LOG("%9U%c", pThread->TickCountCompleted + pThread->TickCountEarly, '|');
     LOG("%9x%c", pThread->Process->Id, '|');
+    LOG("%9U%c", IomuTickCountToUs(runTime) / MS_IN_US, '|');
+    LOG("%9U%c", 0 != pStats->NumberOfWaits ? IomuTickCountToUs(pStats->WaitTime / pStats->NumberOfWaits) : 0, '|');
+    LOG("%9U%c", IomuTickCountToUs(pStats->MaxWaitTime), '|');
+    LOG("%7U%c", pStats->VoluntarySwitches, '|');
+    LOG("%7U%c", pStats->InvoluntarySwitches, '|');
     LOG("\n");
 
     return STATUS_SUCCESS;
 }
 
+static
+void
+_CmdPrintLatencyHistogram(
+    IN_Z    char*               Name,
+    IN      THREAD_LATENCY_TYPE Type
+    )
+{
+    PHISTOGRAM pHistogram;
+
+    ASSERT(NULL != Name);
+
+    // too large for the stack
+    pHistogram = ExAllocatePoolWithTag(0, sizeof(HISTOGRAM), HEAP_TEMP_TAG, 0);
+    if (NULL == pHistogram)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(HISTOGRAM));
+        return;
+    }
+
+    ThreadRetrieveLatencyHistogram(Type, pHistogram);
+
+    LOG("%8s: count=%U mean=%U p50=%U p90=%U p99=%U p999=%U max=%U\n",
+        Name,
+        pHistogram->Count,
+        IomuTickCountToUs(HistogramGetMean(pHistogram)),
+        IomuTickCountToUs(HistogramGetPercentile(pHistogram, 500)),
+        IomuTickCountToUs(HistogramGetPercentile(pHistogram, 900)),
+        IomuTickCountToUs(HistogramGetPercentile(pHistogram, 990)),
+        IomuTickCountToUs(HistogramGetPercentile(pHistogram, 999)),
+        IomuTickCountToUs(pHistogram->Max));
+
+    ExFreePoolWithTag(pHistogram, HEAP_TEMP_TAG);
+}
+
 static
 void
 _CmdReadAndDumpCpuid(
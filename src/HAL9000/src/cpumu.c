@@ -7,6 +7,7 @@
 #include "vmm.h"
 #include "gs_utils.h"
 #include "syscall.h"
+#include "pool_stats.h"
 
 #define STACK_MINIMUM_SIZE          PAGE_SIZE
 #define STACK_MAXIMUM_SIZE          (16*PAGE_SIZE)
@@ -23,6 +24,7 @@ typedef struct _CPUMU_DATA
     CPUID_FEATURE_INFORMATION                       FeatureInformation;
     CPUID_MONITOR_LEAF                              MonitorLeaf;
     CPUID_STRUCTURED_EXTENDED_FEATURE_FLAGS_LEAF    StructuredExtendedFeatures;
+    CPUID_ARCH_PERF_MON_LEAF                        ArchPerfMonLeaf;
     CPUID_EXTENDED_CPUID_INFORMATION                ExtendedCpuidInformation;
     CPUID_EXTENDED_FEATURE_INFORMATION              ExtendedFeatureInformation;
     CPUID_EXTENDED_STATE_ENUMERATION_MAIN_LEAF      ExtendedStateMainLeaf;
@@ -88,6 +90,12 @@ _CpuMuCollectBasicInformation(
         __cpuid((int*)&m_cpuMuData.StructuredExtendedFeatures, CpuidIdxStructuredExtendedFeaturesLeaf);
     }
 
+    // left zeroed if not reported, i.e. there is no architectural PMU
+    if (m_cpuMuData.BasicInformation.MaxValueForBasicInfo >= CpuidIdxArchPerfMonLeaf)
+    {
+        __cpuid((int*)&m_cpuMuData.ArchPerfMonLeaf, CpuidIdxArchPerfMonLeaf);
+    }
+
     if (m_cpuMuData.BasicInformation.MaxValueForBasicInfo >= CpuidIdxExtendedStateEnumerationMainLeaf)
     {
         __cpuidex((int*)&m_cpuMuData.ExtendedStateMainLeaf, CpuidIdxExtendedStateEnumerationMainLeaf, 0x0);
@@ -286,6 +294,13 @@ CpuMuAllocCpu(
 
     LOG("APIC ID: 0x%02x, logical ID: 0x%02x\n", pPcpu->ApicId, pPcpu->LogicalApicId );
 
+    status = PoolStatsInitCpu(pPcpu);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("PoolStatsInitCpu", status);
+        return status;
+    }
+
     pPcpu->StackTop = MmuAllocStack(StackSize, TRUE, FALSE, NULL);
     if (NULL == pPcpu->StackTop)
     {
@@ -312,9 +327,7 @@ CpuMuAllocCpu(
         return status;
     }
 
-    InitializeListHead(&pPcpu->EventList);
-    LockInit(&pPcpu->EventListLock);
-    pPcpu->NoOfEventsInList = 0;
+    IpcQueueInit(&pPcpu->EventQueue);
 
     *PhysicalCpu = pPcpu;
 
@@ -409,6 +422,16 @@ CpuMuIsPcidFeaturePresent(
     return (m_cpuMuData.FeatureInformation.ecx.PCID == 1);
 }
 
+void
+CpuMuGetArchPerfMonLeaf(
+    OUT         PCPUID_ARCH_PERF_MON_LEAF   ArchPerfMonLeaf
+    )
+{
+    ASSERT(NULL != ArchPerfMonLeaf);
+
+    *ArchPerfMonLeaf = m_cpuMuData.ArchPerfMonLeaf;
+}
+
 STATUS
 CpuMuActivateFpuFeatures(
     void
@@ -3,6 +3,17 @@
 #include "network_utils.h"
 #include "dmp_common.h"
 
+static
+const char*
+_NetInterruptProfileToString(
+    IN      NETWORK_INTERRUPT_PROFILE   Profile
+    )
+{
+    static const char* PROFILE_NAMES[NetworkInterruptProfileReserved] = { "LOW LATENCY", "BALANCED", "BULK" };
+
+    return Profile < NetworkInterruptProfileReserved ? PROFILE_NAMES[Profile] : "UNKNOWN";
+}
+
 void
 DumpNetworkDevice(
     IN      PNETWORK_DEVICE_INFO        NetworkDevice
@@ -26,5 +37,26 @@ DumpNetworkDevice(
     LOG("Device TX is [%s]\n",
         NetworkDevice->DeviceStatus.TxEnabled ? "ENABLED" : "DISABLED"
         );
+
+    if (NetworkDevice->InterruptModeration.Supported)
+    {
+        PNETWORK_INTERRUPT_MODERATION pModeration = &NetworkDevice->InterruptModeration;
+
+        LOG("Interrupt moderation is [%s] with profile [%s]\n",
+            pModeration->Adaptive ? "ADAPTIVE" : "FIXED",
+            _NetInterruptProfileToString(pModeration->Profile)
+            );
+        LOG("Maximum interrupts per second: %u\n", pModeration->MaximumInterruptsPerSecond );
+        LOG("RX delays: relative %u us, absolute %u us\n",
+            pModeration->RxRelativeDelayUs, pModeration->RxAbsoluteDelayUs );
+        LOG("TX delays: relative %u us, absolute %u us\n",
+            pModeration->TxRelativeDelayUs, pModeration->TxAbsoluteDelayUs );
+        LOG("Interrupts: %U, profile changes: %U\n",
+            pModeration->NumberOfInterrupts, pModeration->NumberOfProfileChanges );
+    }
+    else
+    {
+        LOG("Interrupt moderation is [NOT SUPPORTED]\n");
+    }
     DumpReleaseLock(intrState);
 }
\ No newline at end of file
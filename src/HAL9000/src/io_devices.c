@@ -9,6 +9,7 @@
 #include "mmu.h"
 #include "vmm.h"
 #include "os_time.h"
+#include "trace.h"
 
 /// TODO: These function calls cross trust boundaries, validate parameters
 /// and do not ASSERT
@@ -405,9 +406,20 @@ IoCallDriver(
     }
     else
     {
-        MutexAcquire(&Device->DeviceLock);
-        status = pDispatchFunction(Device, Irp);
-        MutexRelease(&Device->DeviceLock);
+        TRACE_IO(TraceEventIrpDispatch, Device, Irp, pStackLocation->MajorFunction);
+
+        if (Irp->Flags.Unserialized)
+        {
+            status = pDispatchFunction(Device, Irp);
+        }
+        else
+        {
+            MutexAcquire(&Device->DeviceLock);
+            status = pDispatchFunction(Device, Irp);
+            MutexRelease(&Device->DeviceLock);
+        }
+
+        TRACE_IO(TraceEventIrpDispatchDone, Device, Irp, status);
     }
     if (!SUCCEEDED(status))
     {
@@ -427,6 +439,8 @@ IoCompleteIrp(
     ASSERT(NULL != Irp);
     ASSERT(FALSE == Irp->Flags.Completed);
 
+    TRACE_IO(TraceEventIrpComplete, Irp, Irp->IoStatus.Status, 0);
+
     Irp->Flags.Completed = TRUE;
 }
 
@@ -9,6 +9,8 @@
 #include "disk.h"
 #include "volume.h"
 #include "ata.h"
+#include "ahci.h"
+#include "virtio_blk.h"
 #include "filesystem.h"
 #include "fat32.h"
 #include "swapfs.h"
@@ -17,13 +19,18 @@
 #include "isr.h"
 #include "os_info.h"
 #include "eth_82574L.h"
+#include "virtio_net.h"
+#include "loopback_net.h"
 #include "system_driver.h"
 #include "ioapic_system.h"
 #include "bitmap.h"
 #include "pit.h"
 #include "smp.h"
+#include "cpumu.h"
 #include "ex_system.h"
 #include "lock_common.h"
+#include "thread.h"
+#include "boot_timeline.h"
 
 #define PIC_MASTER_OFFSET                   0x20
 #define PIC_SLAVE_OFFSET                    0x28
@@ -71,6 +78,10 @@ typedef struct _IOMU_DATA
 
     LIST_ENTRY                  PciBridgeList;
 
+    // the drivers of different lanes are installed in parallel
+    RW_SPINLOCK                 DriverListLock;
+
+    _Guarded_by_(DriverListLock)
     LIST_ENTRY                  DriverList;
 
     LIST_ENTRY                  VpbList;
@@ -101,26 +112,47 @@ static IOMU_DATA m_iomuData;
 
 #define DRIVER_MAX_NAME         16
 
+// The drivers of a lane are loaded in the order in which they are declared,
+// because each one may attach to the devices created by the previous ones and
+// the device order determines the volume letters and the network device ids.
+// The lanes do not share any devices, so they are loaded in parallel.
+typedef enum _DRIVER_LANE
+{
+    DriverLaneStorage,
+    DriverLaneNetwork,
+
+    DriverLaneReserved
+} DRIVER_LANE;
+
 typedef struct _DRIVER_DECLARATION
 {
     char*                   DriverName;
     PFUNC_DriverEntry       DriverEntry;
     BOOLEAN                 Mandatory;
+    DRIVER_LANE             Lane;
 } DRIVER_DECLARATION, *PDRIVER_DECLARATION;
 
-#define DECLARE_DRIVER(name,entry,mand)    { name ## ".sys" , (entry), (mand) }
+#define DECLARE_DRIVER(name,entry,mand,lane)    { name ## ".sys" , (entry), (mand), (lane) }
 
-static const DRIVER_DECLARATION SYSTEM_DRIVER = DECLARE_DRIVER( "system", SystemDriverEntry, TRUE );
+static const DRIVER_DECLARATION SYSTEM_DRIVER = DECLARE_DRIVER( "system", SystemDriverEntry, TRUE, DriverLaneReserved );
 
 static const DRIVER_DECLARATION DRIVER_NAMES[] = {
-    DECLARE_DRIVER("ata", AtaDriverEntry, FALSE),
-    DECLARE_DRIVER("disk", DiskDriverEntry, FALSE),
-    DECLARE_DRIVER("vol", VolDriverEntry, FALSE),
-    DECLARE_DRIVER("fat", FatDriverEntry, FALSE),
-    DECLARE_DRIVER("swapfs", SwapFsDriverEntry, FALSE),
-    DECLARE_DRIVER("eth82574L", Eth82574LDriverEntry, FALSE)
+    DECLARE_DRIVER("ata", AtaDriverEntry, FALSE, DriverLaneStorage),
+    DECLARE_DRIVER("ahci", AhciDriverEntry, FALSE, DriverLaneStorage),
+    DECLARE_DRIVER("virtioblk", VirtioBlkDriverEntry, FALSE, DriverLaneStorage),
+    DECLARE_DRIVER("disk", DiskDriverEntry, FALSE, DriverLaneStorage),
+    DECLARE_DRIVER("vol", VolDriverEntry, FALSE, DriverLaneStorage),
+    DECLARE_DRIVER("fat", FatDriverEntry, FALSE, DriverLaneStorage),
+    DECLARE_DRIVER("swapfs", SwapFsDriverEntry, FALSE, DriverLaneStorage),
+    DECLARE_DRIVER("eth82574L", Eth82574LDriverEntry, FALSE, DriverLaneNetwork),
+    DECLARE_DRIVER("virtionet", VirtioNetDriverEntry, FALSE, DriverLaneNetwork),
+
+    // last, so the physical network devices keep the first device ids
+    DECLARE_DRIVER("loopbacknet", LoopbackNetDriverEntry, FALSE, DriverLaneNetwork)
 };
 
+static char* const DRIVER_LANE_THREAD_NAMES[DriverLaneReserved] = { "Storage drivers", "Network drivers" };
+
 static FUNC_CompareFunction     _VpbCompareFunction;
 
 static FUNC_IsrRoutine          _IomuGenericInterrupt;
@@ -176,6 +208,8 @@ _IomuInitDrivers(
     void
     );
 
+static FUNC_ThreadStart         _IomuInitDriverLane;
+
 static
 STATUS
 _IomuDetermineSystemPartition(
@@ -209,6 +243,29 @@ _IomuProgramPciInterrupt(
                 APIC_DELIVERY_MODE          DeliveryMode
     );
 
+static
+STATUS
+_IomuProgramPciMsiXInterrupt(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN          WORD                        TableEntry,
+    IN          BYTE                        ProcessorIndex,
+    IN          BYTE                        Vector
+    );
+
+static
+STATUS
+_IomuWritePciConfigurationSpace(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN          WORD                        Register,
+    IN          WORD                        Size
+    );
+
+static
+APIC_ID
+_IomuGetApicIdForProcessor(
+    IN          BYTE                        ProcessorIndex
+    );
+
 void
 _No_competing_thread_
 IomuPreinitSystem(
@@ -225,6 +282,7 @@ IomuPreinitSystem(
 
     InitializeListHead(&m_iomuData.PciDeviceList);
     InitializeListHead(&m_iomuData.PciBridgeList);
+    RwSpinlockInit(&m_iomuData.DriverListLock);
     InitializeListHead(&m_iomuData.DriverList);
     InitializeListHead(&m_iomuData.VpbList);
 
@@ -564,24 +622,29 @@ IomuGetDriverByName(
 {
     PDRIVER_OBJECT pDriver;
     PLIST_ENTRY pCurEntry;
+    INTR_STATE oldState;
 
     ASSERT(NULL != DriverName);
 
     pDriver = NULL;
+
+    RwSpinlockAcquireShared(&m_iomuData.DriverListLock, &oldState);
     for(pCurEntry = m_iomuData.DriverList.Flink;
         pCurEntry != &m_iomuData.DriverList;
         pCurEntry = pCurEntry->Flink)
     {
-        pDriver = CONTAINING_RECORD(pCurEntry, DRIVER_OBJECT, NextDriver);
+        PDRIVER_OBJECT pCurDriver = CONTAINING_RECORD(pCurEntry, DRIVER_OBJECT, NextDriver);
 
-        if (0 == strcmp(pDriver->DriverName, DriverName))
+        if (0 == strcmp(pCurDriver->DriverName, DriverName))
         {
             // found driver
-            return pDriver;
+            pDriver = pCurDriver;
+            break;
         }
     }
+    RwSpinlockReleaseShared(&m_iomuData.DriverListLock, oldState);
 
-    return NULL;
+    return pDriver;
 }
 
 void
@@ -589,9 +652,13 @@ IomuDriverInstalled(
     IN      PDRIVER_OBJECT  Driver
     )
 {
+    INTR_STATE oldState;
+
     ASSERT(NULL != Driver);
 
+    RwSpinlockAcquireExclusive(&m_iomuData.DriverListLock, &oldState);
     InsertTailList(&m_iomuData.DriverList, &Driver->NextDriver);
+    RwSpinlockReleaseExclusive(&m_iomuData.DriverListLock, oldState);
 }
 
 PLIST_ENTRY
@@ -619,6 +686,7 @@ IomuGetDevicesByType(
     DWORD i;
     PDEVICE_OBJECT* pFoundDevices;
     DWORD indexInArray;
+    INTR_STATE oldState;
 
     ASSERT(NULL != DeviceObjects);
     ASSERT(NULL != NumberOfDevices);
@@ -628,6 +696,9 @@ IomuGetDevicesByType(
     pFoundDevices = NULL;
     indexInArray = 0;
 
+    // the array is allocated with the lock held, so no driver can be installed
+    // between the two iterations
+    RwSpinlockAcquireShared(&m_iomuData.DriverListLock, &oldState);
     for (i = 0; i < 2; ++i)
     {
         if (1 == i)
@@ -677,6 +748,7 @@ IomuGetDevicesByType(
             }
         }
     }
+    RwSpinlockReleaseShared(&m_iomuData.DriverListLock, oldState);
 
     if (SUCCEEDED(status))
     {
@@ -945,6 +1017,25 @@ IomuRegisterInterrupt(
             }
         }
 
+        if (Interrupt->Type == IoInterruptTypePciMsiX)
+        {
+            LOG_TRACE_INTERRUPT("Will setup MSI-X entry %u for device at (%u.%u.%u)\n",
+                                Interrupt->PciMsiX.TableEntry,
+                                Interrupt->PciMsiX.PciDevice->DeviceLocation.Bus,
+                                Interrupt->PciMsiX.PciDevice->DeviceLocation.Device,
+                                Interrupt->PciMsiX.PciDevice->DeviceLocation.Function);
+
+            status = _IomuProgramPciMsiXInterrupt(Interrupt->PciMsiX.PciDevice,
+                                                  Interrupt->PciMsiX.TableEntry,
+                                                  Interrupt->PciMsiX.ProcessorIndex,
+                                                  interruptVector);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_IomuProgramPciMsiXInterrupt", status);
+                __leave;
+            }
+        }
+
         if (bSetupIoApicRedirEntry)
         {
             ASSERT((Interrupt->Type == IoInterruptTypeLegacy) || (Interrupt->Type == IoInterruptTypePci && !bMsiCapable));
@@ -1030,6 +1121,16 @@ IomuTickCountToUs(
     return ( TickCount * 1000 ) / ( m_iomuData.TscFrequency / 1000 );
 }
 
+QWORD
+IomuTickCountToNs(
+    IN          QWORD                   TickCount
+    )
+{
+    // split so that the multiplication cannot overflow
+    return ( TickCount / m_iomuData.TscFrequency ) * SEC_IN_NS +
+           ( ( TickCount % m_iomuData.TscFrequency ) * SEC_IN_NS ) / m_iomuData.TscFrequency;
+}
+
 void
 IomuCmosUpdateOccurred(
     void
@@ -1147,46 +1248,107 @@ _IomuInitDrivers(
     )
 {
     STATUS status;
-    PDRIVER_OBJECT pDriver;
+    STATUS laneStatus;
+    PTHREAD laneThreads[DriverLaneReserved];
     DWORD i;
 
     status = STATUS_SUCCESS;
-    pDriver = NULL;
+    memzero(laneThreads, sizeof(laneThreads));
 
-    __try
+    // most of the time spent in the driver entries is spent waiting for the
+    // devices to reset or to answer the probes, by giving each lane its own
+    // thread the lanes wait at the same time on different CPUs
+    for (i = 0; i < DriverLaneReserved; ++i)
     {
-        for (i = 0; i < ARRAYSIZE(DRIVER_NAMES); ++i)
+        laneStatus = ThreadCreate(DRIVER_LANE_THREAD_NAMES[i],
+                                  ThreadPriorityDefault,
+                                  _IomuInitDriverLane,
+                                  (PVOID) (QWORD) i,
+                                  &laneThreads[i]);
+        if (!SUCCEEDED(laneStatus))
         {
-            pDriver = IoCreateDriver(DRIVER_NAMES[i].DriverName, DRIVER_NAMES[i].DriverEntry);
-            if (NULL == pDriver)
+            LOG_FUNC_ERROR("ThreadCreate", laneStatus);
+
+            // load the lane on the current thread instead
+            laneThreads[i] = NULL;
+            laneStatus = _IomuInitDriverLane((PVOID) (QWORD) i);
+            if (!SUCCEEDED(laneStatus))
             {
-                if (DRIVER_NAMES[i].Mandatory)
-                {
-                    LOG_ERROR("Mandatory driver %s could not be loaded\n", DRIVER_NAMES[i].DriverName);
-                    status = STATUS_DEVICE_DRIVER_COULD_NOT_BE_CREATED;
-                    __leave;
-                }
-                else
-                {
-                    LOG_WARNING("Secondary driver %s could not be loaded\n", DRIVER_NAMES[i].DriverName);
-                }
+                status = laneStatus;
             }
         }
     }
-    __finally
+
+    for (i = 0; i < DriverLaneReserved; ++i)
     {
-        if (!SUCCEEDED(status))
+        if (NULL == laneThreads[i])
         {
-            // call IomuUnitDrivers
+            continue;
+        }
+
+        ThreadWaitForTermination(laneThreads[i], &laneStatus);
+        ThreadCloseHandle(laneThreads[i]);
+        laneThreads[i] = NULL;
+
+        if (!SUCCEEDED(laneStatus))
+        {
+            status = laneStatus;
         }
     }
 
+    if (!SUCCEEDED(status))
+    {
+        // call IomuUnitDrivers
+    }
+
     // dump driver list
     DumpDriverList(&m_iomuData.DriverList);
 
     return status;
 }
 
+static
+STATUS
+(__cdecl _IomuInitDriverLane)(
+    IN_OPT      PVOID       Context
+    )
+{
+    DRIVER_LANE lane;
+    PDRIVER_OBJECT pDriver;
+    DWORD timelineEntry;
+    DWORD i;
+
+    lane = (DRIVER_LANE) (QWORD) Context;
+    ASSERT(lane < DriverLaneReserved);
+
+    for (i = 0; i < ARRAYSIZE(DRIVER_NAMES); ++i)
+    {
+        if (DRIVER_NAMES[i].Lane != lane)
+        {
+            continue;
+        }
+
+        timelineEntry = BootTimelineBegin(DRIVER_NAMES[i].DriverName, BootTimelineEntryDriver);
+        pDriver = IoCreateDriver(DRIVER_NAMES[i].DriverName, DRIVER_NAMES[i].DriverEntry);
+        BootTimelineEnd(timelineEntry);
+
+        if (NULL == pDriver)
+        {
+            if (DRIVER_NAMES[i].Mandatory)
+            {
+                LOG_ERROR("Mandatory driver %s could not be loaded\n", DRIVER_NAMES[i].DriverName);
+                return STATUS_DEVICE_DRIVER_COULD_NOT_BE_CREATED;
+            }
+            else
+            {
+                LOG_WARNING("Secondary driver %s could not be loaded\n", DRIVER_NAMES[i].DriverName);
+            }
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
 static
 STATUS
 _IomuDetermineSystemPartition(
@@ -1335,18 +1497,33 @@ _IomuProgramPciInterrupt(
     )
 {
     STATUS status;
+    PPCI_CAPABILITY_MSI pciCap;
+    WORD capOffset;
+    WORD capSize;
 
     ASSERT( NULL != PciDevice );
     ASSERT(_IomuIsDeviceMsiCapable(PciDevice));
 
     LOG_FUNC_START;
 
+    pciCap = NULL;
+
     status = PciDevDisableLegacyInterrupts(PciDevice);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("PciDevDisableLegacyInterrupts", status);
         return status;
     }
+
+    status = _IomuWritePciConfigurationSpace(PciDevice,
+                                             FIELD_OFFSET(PCI_COMMON_HEADER, Command),
+                                             sizeof(DWORD)
+                                             );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_IomuWritePciConfigurationSpace", status);
+        return status;
+    }
     LOG_TRACE_INTERRUPT("Successfully disabled legacy interrupts for PCI device at (%u.%u.%u)\n",
                         PciDevice->DeviceLocation.Bus, PciDevice->DeviceLocation.Device, PciDevice->DeviceLocation.Function );
 
@@ -1364,7 +1541,227 @@ _IomuProgramPciInterrupt(
         return status;
     }
 
+    status = PciDevRetrieveCapabilityById(PciDevice->DeviceData,
+                                          PCI_CAPABILITY_ID_MSI,
+                                          (PPCI_CAPABILITY_HEADER*)&pciCap
+                                          );
+    ASSERT(SUCCEEDED(status));
+
+    capOffset = (WORD) PtrDiff(pciCap, PciDevice->DeviceData);
+    capSize = pciCap->MessageControl.Is64BitCapable
+        ? FIELD_OFFSET(PCI_CAPABILITY_MSI, Capability64Bit.MessageData) + sizeof(DWORD)
+        : FIELD_OFFSET(PCI_CAPABILITY_MSI, Capability32Bit.MessageData) + sizeof(DWORD);
+
+    // the message address and data first, Message Control is written last
+    // because it enables MSI interrupts
+    status = _IomuWritePciConfigurationSpace(PciDevice,
+                                             capOffset + sizeof(DWORD),
+                                             capSize - sizeof(DWORD)
+                                             );
+    if (SUCCEEDED(status))
+    {
+        status = _IomuWritePciConfigurationSpace(PciDevice, capOffset, sizeof(DWORD));
+    }
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_IomuWritePciConfigurationSpace", status);
+        return status;
+    }
+
     LOG_FUNC_END;
 
     return status;
+}
+
+static
+STATUS
+_IomuProgramPciMsiXInterrupt(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN          WORD                        TableEntry,
+    IN          BYTE                        ProcessorIndex,
+    IN          BYTE                        Vector
+    )
+{
+    STATUS status;
+    PHYSICAL_ADDRESS tablePa;
+    WORD noOfEntries;
+    PPCI_MSIX_TABLE_ENTRY pEntry;
+    PPCI_CAPABILITY_HEADER pciCap;
+    APIC_ID apicId;
+
+    ASSERT( NULL != PciDevice );
+
+    LOG_FUNC_START;
+
+    tablePa = NULL;
+    noOfEntries = 0;
+    pEntry = NULL;
+    pciCap = NULL;
+
+    status = PciDevGetMsiXTable(PciDevice, &tablePa, &noOfEntries);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("PciDevGetMsiXTable", status);
+        return status;
+    }
+
+    if (TableEntry >= noOfEntries)
+    {
+        LOG_ERROR("Device has only %u MSI-X entries, cannot program entry %u\n", noOfEntries, TableEntry);
+        return STATUS_DEVICE_INTERRUPT_NOT_AVAILABLE;
+    }
+
+    apicId = _IomuGetApicIdForProcessor(ProcessorIndex);
+
+    // the table lives in the device's memory space, we only need the entry
+    // mapped while we program it
+    pEntry = IoMapMemory(PtrOffset(tablePa, TableEntry * sizeof(PCI_MSIX_TABLE_ENTRY)),
+                         sizeof(PCI_MSIX_TABLE_ENTRY),
+                         PAGE_RIGHTS_READWRITE);
+    if (NULL == pEntry)
+    {
+        LOG_ERROR("IoMapMemory could not map MSI-X table at PA 0x%X\n", tablePa);
+        return STATUS_MEMORY_CANNOT_BE_MAPPED;
+    }
+
+    __try
+    {
+        status = PciDevDisableLegacyInterrupts(PciDevice);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PciDevDisableLegacyInterrupts", status);
+            __leave;
+        }
+
+        status = _IomuWritePciConfigurationSpace(PciDevice,
+                                                 FIELD_OFFSET(PCI_COMMON_HEADER, Command),
+                                                 sizeof(DWORD)
+                                                 );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_IomuWritePciConfigurationSpace", status);
+            __leave;
+        }
+
+        // each MSI-X vector is targeted at a single processor, there is no
+        // point in using lowest priority delivery
+        status = PciDevProgramMsiXInterrupt(PciDevice,
+                                            pEntry,
+                                            Vector,
+                                            ApicDestinationModePhysical,
+                                            apicId,
+                                            ApicDeliveryModeFixed
+                                            );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PciDevProgramMsiXInterrupt", status);
+            __leave;
+        }
+
+        status = PciDevRetrieveCapabilityById(PciDevice->DeviceData,
+                                              PCI_CAPABILITY_ID_MSIX,
+                                              &pciCap
+                                              );
+        ASSERT(SUCCEEDED(status));
+
+        // write Message Control, this will enable MSI-X interrupts
+        status = _IomuWritePciConfigurationSpace(PciDevice,
+                                                 (WORD) PtrDiff(pciCap, PciDevice->DeviceData),
+                                                 sizeof(DWORD)
+                                                 );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_IomuWritePciConfigurationSpace", status);
+            __leave;
+        }
+
+        LOG_TRACE_INTERRUPT("MSI-X entry %u programmed with vector 0x%02x for CPU 0x%02x\n",
+                            TableEntry, Vector, apicId);
+    }
+    __finally
+    {
+        IoUnmapMemory(pEntry, sizeof(PCI_MSIX_TABLE_ENTRY));
+        pEntry = NULL;
+
+        LOG_FUNC_END;
+    }
+
+    return status;
+}
+
+static
+STATUS
+_IomuWritePciConfigurationSpace(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN          WORD                        Register,
+    IN          WORD                        Size
+    )
+{
+    STATUS status;
+    WORD offset;
+
+    ASSERT(NULL != PciDevice);
+    ASSERT(IsAddressAligned(Register, sizeof(DWORD)));
+    ASSERT(IsAddressAligned(Size, sizeof(DWORD)));
+
+    status = STATUS_SUCCESS;
+
+    // the configuration space of PCI express devices is memory mapped, the
+    // registers were already written
+    if (PciDevice->PciExpressDevice)
+    {
+        return status;
+    }
+
+    // through the PCI system, which serializes the legacy configuration
+    // accesses with the ones of the other CPUs
+    for (offset = Register; offset < Register + Size; offset = offset + sizeof(DWORD))
+    {
+        status = PciSystemWriteConfigurationSpaceGeneric(PciDevice->DeviceLocation,
+                                                         offset,
+                                                         BITS_FOR_STRUCTURE(DWORD),
+                                                         *(DWORD*)&PciDevice->DeviceData->Data[offset]
+                                                         );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PciSystemWriteConfigurationSpaceGeneric", status);
+            break;
+        }
+    }
+
+    return status;
+}
+
+static
+APIC_ID
+_IomuGetApicIdForProcessor(
+    IN          BYTE                        ProcessorIndex
+    )
+{
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    DWORD noOfCpus;
+    DWORD i;
+
+    pCpuListHead = NULL;
+    noOfCpus = 0;
+
+    SmpGetCpuList(&pCpuListHead);
+    ASSERT(NULL != pCpuListHead);
+
+    for (pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead;
+         pCurEntry = pCurEntry->Flink)
+    {
+        noOfCpus = noOfCpus + 1;
+    }
+    ASSERT(0 != noOfCpus);
+
+    pCurEntry = pCpuListHead->Flink;
+    for (i = 0; i < ProcessorIndex % noOfCpus; ++i)
+    {
+        pCurEntry = pCurEntry->Flink;
+    }
+
+    return CONTAINING_RECORD(pCurEntry, PCPU, ListEntry)->ApicId;
 }
\ No newline at end of file
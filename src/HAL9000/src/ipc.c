@@ -3,6 +3,11 @@
 #include "synch.h"
 #include "smp.h"
 
+// the usage of the pool is kept in a single QWORD
+#define IPC_EVENT_POOL_SIZE         (sizeof(QWORD) * BITS_PER_BYTE)
+
+#define IPC_EVENT_NOT_FROM_POOL     MAX_DWORD
+
 #pragma warning(push)
 
 // warning C4200: nonstandard extension used: zero-sized array in struct/union
@@ -22,139 +27,341 @@ typedef struct _IPC_EVENT
     PFUNC_FreeFunction      FreeFunction;
     PVOID                   FreeFunctionContext;
 
+    // index of the event in the preallocated pool or IPC_EVENT_NOT_FROM_POOL
+    DWORD                   PoolIndex;
+
+    // number of CPUs the event was queued on, written only by the sender
+    DWORD                   NumberOfCpuEvents;
     IPC_EVENT_CPU           CpuEvents[0];
 } IPC_EVENT, *PIPC_EVENT;
 
 #pragma warning(pop)
 
+typedef struct _IPC_DATA
+{
+    DWORD                   NumberOfCpus;
+
+    // each event has room for NumberOfCpus CPU events
+    DWORD                   EventSize;
+
+    PBYTE                   EventPool;
+
+    // bit i is set while the event i of the pool is used
+    volatile QWORD          PoolEventsInUse;
+} IPC_DATA, *PIPC_DATA;
+
+static IPC_DATA m_ipcData;
+
 static FUNC_FreeFunction _IpcFreeEvent;
 
-_Ret_writes_maybenull_(NumberOfCpus)
+static
+PIPC_EVENT
+_IpcAllocateEvent(
+    void
+    );
+
+static
+STATUS
+_IpcProcessEvent(
+    _Pre_valid_ _Post_ptr_invalid_
+            PIPC_EVENT_CPU      CpuEvent
+    );
+
+_No_competing_thread_
+STATUS
+IpcInit(
+    IN_RANGE_LOWER(1)
+            DWORD                   NumberOfCpus
+    )
+{
+    DWORD eventSize;
+    DWORD poolSize;
+
+    if (0 == NumberOfCpus)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    ASSERT(NULL == m_ipcData.EventPool);
+
+    eventSize = (DWORD) AlignAddressUpper(sizeof(IPC_EVENT) + NumberOfCpus * sizeof(IPC_EVENT_CPU), sizeof(QWORD));
+    poolSize = eventSize * IPC_EVENT_POOL_SIZE;
+
+    m_ipcData.EventPool = ExAllocatePoolWithTag(PoolAllocateZeroMemory, poolSize, HEAP_IPC_TAG, 0);
+    if (NULL == m_ipcData.EventPool)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", poolSize);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    m_ipcData.NumberOfCpus = NumberOfCpus;
+    m_ipcData.EventSize = eventSize;
+    m_ipcData.PoolEventsInUse = 0;
+
+    LOGL("Preallocated %u IPC events of %u bytes each\n", IPC_EVENT_POOL_SIZE, eventSize);
+
+    return STATUS_SUCCESS;
+}
+
+void
+IpcQueueInit(
+    OUT     PIPC_EVENT_QUEUE        Queue
+    )
+{
+    ASSERT(NULL != Queue);
+
+    Queue->Head = NULL;
+}
+
 PTR_SUCCESS
-PIPC_EVENT_CPU
+PIPC_EVENT
 IpcGenerateEvent(
     IN      PFUNC_IpcProcessEvent   BroadcastFunction,
     IN_OPT  PVOID                   Context,
     IN_OPT  PFUNC_FreeFunction      FreeFunction,
     IN_OPT  PVOID                   FreeContext,
-    IN      BOOLEAN                 WaitForHandling,
-    IN_RANGE_LOWER(1)
-            DWORD                   NumberOfCpus
+    IN      BOOLEAN                 WaitForHandling
     )
 {
     STATUS status;
     PIPC_EVENT pEvent;
-    DWORD noOfAdditionalReferences;
-    DWORD i;
-    DWORD totalAllocationSize;
 
     if (NULL == BroadcastFunction)
     {
         return NULL;
     }
 
-    if (0 == NumberOfCpus)
+    if (0 == m_ipcData.NumberOfCpus)
     {
-        LOG_ERROR("We can't send an IPI to 0 processors! :(\n");
+        LOG_ERROR("IpcInit was not called yet!\n");
         return NULL;
     }
 
     LOG_FUNC_START;
 
     status = STATUS_SUCCESS;
-    pEvent = NULL;
-    noOfAdditionalReferences = WaitForHandling ? NumberOfCpus : NumberOfCpus - 1;
-    totalAllocationSize = sizeof(IPC_EVENT) + NumberOfCpus * sizeof(IPC_EVENT_CPU);
 
-    __try
+    pEvent = _IpcAllocateEvent();
+    if (NULL == pEvent)
     {
-        pEvent = ExAllocatePoolWithTag(PoolAllocateZeroMemory, totalAllocationSize, HEAP_IPC_TAG, 0);
-        if (NULL == pEvent)
-        {
-            LOG_FUNC_ERROR_ALLOC("HeapAllocatePoolWithTag\n", totalAllocationSize);
-            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
-            __leave;
-        }
-        LOG_TRACE_CPU("Allocated event at: 0x%X\n", pEvent);
+        LOG_FUNC_END;
+        return NULL;
+    }
+    LOG_TRACE_CPU("Allocated event at: 0x%X\n", pEvent);
 
-        pEvent->SignalTermination = WaitForHandling;
-        if (pEvent->SignalTermination)
-        {
-            status = EvtInitialize(&pEvent->TerminationEvent, EventTypeSynchronization, FALSE);
-            if (!SUCCEEDED(status))
-            {
-                LOGL("EvtInitialize failed with status: 0x%x\n", status);
-                __leave;
-            }
-        }
-        pEvent->Function = BroadcastFunction;
-        pEvent->Context = Context;
-        pEvent->FreeFunction = FreeFunction;
-        pEvent->FreeFunctionContext = FreeContext;
+    pEvent->SignalTermination = WaitForHandling;
+    if (pEvent->SignalTermination)
+    {
+        status = EvtInitialize(&pEvent->TerminationEvent, EventTypeSynchronization, FALSE);
+        ASSERT(SUCCEEDED(status));
+    }
+    pEvent->Function = BroadcastFunction;
+    pEvent->Context = Context;
+    pEvent->FreeFunction = FreeFunction;
+    pEvent->FreeFunctionContext = FreeContext;
+    pEvent->NumberOfCpuEvents = 0;
+
+    RfcPreInit(&pEvent->RefCnt);
+
+    // the reference of the caller, released by IpcCompleteEvent
+    status = RfcInit(&pEvent->RefCnt, _IpcFreeEvent, NULL);
+    ASSERT(SUCCEEDED(status));
+
+    // if the caller waits for the event to be handled an additional reference
+    // is held until it was queued on all the CPUs, else a CPU processing the
+    // event early could signal the termination before the others even got it
+    if (WaitForHandling)
+    {
+        RfcReference(&pEvent->RefCnt);
+    }
 
-        for (i = 0; i < NumberOfCpus; ++i)
-        {
-            pEvent->CpuEvents[i].Event = pEvent;
-        }
+    LOG_FUNC_END;
+
+    return pEvent;
+}
 
-        RfcPreInit(&pEvent->RefCnt);
+BOOLEAN
+IpcQueueEvent(
+    INOUT   PIPC_EVENT              Event,
+    INOUT   PIPC_EVENT_QUEUE        Queue
+    )
+{
+    PIPC_EVENT_CPU pCpuEvent;
+    PIPC_EVENT_CPU pHead;
+    PIPC_EVENT_CPU pOldHead;
+
+    ASSERT(NULL != Event);
+    ASSERT(NULL != Queue);
+
+    ASSERT(Event->NumberOfCpuEvents < m_ipcData.NumberOfCpus);
+    pCpuEvent = &Event->CpuEvents[Event->NumberOfCpuEvents];
+    Event->NumberOfCpuEvents++;
+
+    pCpuEvent->Event = Event;
+
+    // the reference of the CPU, released once it has processed the event
+    RfcReference(&Event->RefCnt);
+
+    // the consumer only ever takes the whole list, so an entry which is
+    // removed and queued again while we retry cannot corrupt the list
+    pHead = Queue->Head;
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        pCpuEvent->Next = pHead;
 
-        status = RfcInit(&pEvent->RefCnt, _IpcFreeEvent, NULL);
-        if (!SUCCEEDED(status))
+        pOldHead = _InterlockedCompareExchangePointer(&Queue->Head, pCpuEvent, pHead);
+        if (pOldHead == pHead)
         {
-            LOGL("RfcInit failed with status: 0x%x\n", status);
-            __leave;
+            break;
         }
 
-        for (i = 0; i < noOfAdditionalReferences; ++i)
+        pHead = pOldHead;
+    }
+
+    return NULL == pHead;
+}
+
+void
+IpcCompleteEvent(
+    _Pre_valid_ _Post_ptr_invalid_
+            PIPC_EVENT              Event
+    )
+{
+    ASSERT(NULL != Event);
+
+    LOG_FUNC_START;
+
+    if (Event->SignalTermination)
+    {
+        // if we held the last reference besides our own all the CPUs are
+        // already done and none of them will signal the event
+        if (1 != RfcDereference(&Event->RefCnt))
         {
-            RfcReference(&pEvent->RefCnt);
+            EvtWaitForSignal(&Event->TerminationEvent);
         }
+
+        LOG_TRACE_CPU("Event was processed\n");
     }
-    __finally
+
+    // if WaitForHandling was FALSE the event may be freed here or may have
+    // already been processed by all the CPUs it was sent to
+    RfcDereference(&Event->RefCnt);
+
+    LOG_FUNC_END;
+}
+
+STATUS
+IpcProcessQueue(
+    INOUT   PIPC_EVENT_QUEUE        Queue
+    )
+{
+    STATUS status;
+    STATUS funcStatus;
+    PIPC_EVENT_CPU pEntries;
+    PIPC_EVENT_CPU pOrdered;
+    PIPC_EVENT_CPU pCurrent;
+
+    ASSERT(NULL != Queue);
+
+    status = STATUS_SUCCESS;
+
+    // events may be queued while the previous ones are processed, their
+    // senders found the queue empty and sent another IPI which will find
+    // nothing to do
+    for (pEntries = _InterlockedExchangePointer(&Queue->Head, NULL);
+         NULL != pEntries;
+         pEntries = _InterlockedExchangePointer(&Queue->Head, NULL))
     {
-        if (!SUCCEEDED(status))
+        // the entries were pushed in front of each other, the events are
+        // processed in the order they were queued in
+        pOrdered = NULL;
+        while (NULL != pEntries)
+        {
+            pCurrent = pEntries;
+            pEntries = pEntries->Next;
+
+            pCurrent->Next = pOrdered;
+            pOrdered = pCurrent;
+        }
+
+        while (NULL != pOrdered)
         {
-            if (NULL != pEvent)
+            pCurrent = pOrdered;
+
+            // the event may be freed once it is processed
+            pOrdered = pOrdered->Next;
+
+            funcStatus = _IpcProcessEvent(pCurrent);
+            if (!SUCCEEDED(funcStatus))
             {
-                ExFreePoolWithTag(pEvent, HEAP_IPC_TAG);
-                pEvent = NULL;
+                LOG_FUNC_ERROR("Event processing failed", funcStatus);
+                status = funcStatus;
             }
         }
-
-        LOG_FUNC_END;
     }
 
-    return NULL != pEvent ? pEvent->CpuEvents : NULL;
+    return status;
 }
 
-void
-IpcWaitForEventHandling(
-    _Pre_valid_ _Post_ptr_invalid_
-            PIPC_EVENT_CPU          CpuEvent
+static
+PIPC_EVENT
+_IpcAllocateEvent(
+    void
     )
 {
-    ASSERT(NULL != CpuEvent);
+    PIPC_EVENT pEvent;
+    QWORD eventsInUse;
+    DWORD i;
 
-    LOG_FUNC_START;
+    ASSERT(NULL != m_ipcData.EventPool);
 
-    ASSERT( NULL != CpuEvent->Event );
+    for (i = 0; i < IPC_EVENT_POOL_SIZE; ++i)
+    {
+        eventsInUse = m_ipcData.PoolEventsInUse;
+        if (MAX_QWORD == eventsInUse)
+        {
+            break;
+        }
 
-    ASSERT(CpuEvent->Event->SignalTermination);
-    EvtWaitForSignal(&CpuEvent->Event->TerminationEvent);
+        if (IsBooleanFlagOn(eventsInUse, 1ULL << i))
+        {
+            continue;
+        }
 
-    LOG_TRACE_CPU("Event was processed\n");
+        if (!_interlockedbittestandset64((INT64 volatile*) &m_ipcData.PoolEventsInUse, i))
+        {
+            pEvent = (PIPC_EVENT) (m_ipcData.EventPool + (QWORD) i * m_ipcData.EventSize);
+            pEvent->PoolIndex = i;
 
-    RfcDereference(&CpuEvent->Event->RefCnt);
+            return pEvent;
+        }
+    }
 
-    LOG_FUNC_END;
+    // all the preallocated events are in use
+    LOG_TRACE_CPU("No preallocated event is available\n");
+
+    pEvent = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
+                                   sizeof(IPC_EVENT) + m_ipcData.NumberOfCpus * sizeof(IPC_EVENT_CPU),
+                                   HEAP_IPC_TAG,
+                                   0);
+    if (NULL == pEvent)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(IPC_EVENT));
+        return NULL;
+    }
+    pEvent->PoolIndex = IPC_EVENT_NOT_FROM_POOL;
+
+    return pEvent;
 }
 
+static
 STATUS
-IpcProcessEvent(
+_IpcProcessEvent(
     _Pre_valid_ _Post_ptr_invalid_
-            PIPC_EVENT_CPU      CpuEvent,
-    OUT     STATUS*             FunctionStatus
+            PIPC_EVENT_CPU      CpuEvent
     )
 {
     PIPC_EVENT pEvent;
@@ -162,17 +369,7 @@ IpcProcessEvent(
     DWORD newRefCount;
     BOOLEAN signalTermination;
 
-    if (NULL == CpuEvent)
-    {
-        return STATUS_INVALID_PARAMETER1;
-    }
-
-    if (NULL == FunctionStatus)
-    {
-        return STATUS_INVALID_PARAMETER2;
-    }
-
-    LOG_FUNC_START;
+    ASSERT(NULL != CpuEvent);
 
     pEvent = CpuEvent->Event;
     ASSERT( NULL != pEvent );
@@ -192,11 +389,8 @@ IpcProcessEvent(
     {
         EvtSignal(&pEvent->TerminationEvent);
     }
-    *FunctionStatus = funcStatus;
-
-    LOG_FUNC_END;
 
-    return STATUS_SUCCESS;
+    return funcStatus;
 }
 
 static
@@ -220,9 +414,17 @@ _IpcFreeEvent(
         pEvent->FreeFunction(pEvent->Context, pEvent->FreeFunctionContext);
     }
 
-    LOG_TRACE_CPU("Will deallocate event object at 0x%X\n", pEvent);
-    ExFreePoolWithTag(pEvent, HEAP_IPC_TAG);
+    if (IPC_EVENT_NOT_FROM_POOL != pEvent->PoolIndex)
+    {
+        LOG_TRACE_CPU("Will return event 0x%X to the pool\n", pEvent);
+        _interlockedbittestandreset64((INT64 volatile*) &m_ipcData.PoolEventsInUse, pEvent->PoolIndex);
+    }
+    else
+    {
+        LOG_TRACE_CPU("Will deallocate event object at 0x%X\n", pEvent);
+        ExFreePoolWithTag(pEvent, HEAP_IPC_TAG);
+    }
     pEvent = NULL;
 
     LOG_FUNC_END;
-}
\ No newline at end of file
+}
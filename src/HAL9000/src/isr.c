@@ -8,6 +8,7 @@
 #include "cpumu.h"
 #include "dmp_cpu.h"
 #include "process.h"
+#include "trace.h"
 
 #define UNDEFINED_INTERRUPT_TEXT                "UNKNOWN INTERRUPT"
 #define STACK_BYTES_TO_DUMP_ON_EXCEPTION        0x100
@@ -44,7 +45,8 @@ _IsrExceptionHandler(
 static
 void
 _IsrInterruptHandler(
-    IN BYTE             InterruptIndex
+    IN BYTE                         InterruptIndex,
+    IN PINTERRUPT_STACK_COMPLETE    StackPointer
     );
 
 
@@ -75,7 +77,7 @@ IsrCommonHandler(
     }
     else
     {
-        _IsrInterruptHandler(InterruptIndex);
+        _IsrInterruptHandler(InterruptIndex, StackPointer);
     }
 }
 
@@ -178,18 +180,32 @@ _IsrExceptionHandler(
 static
 void
 _IsrInterruptHandler(
-    IN BYTE             InterruptIndex
+    IN BYTE                         InterruptIndex,
+    IN PINTERRUPT_STACK_COMPLETE    StackPointer
     )
 {
     BOOLEAN interruptHandled;
     BOOLEAN bSpuriousInterrupt;
     BYTE indexInHandlers;
     IRQL prevIrql;
+    PPCPU pCpu;
+    PINTERRUPT_STACK_COMPLETE pPrevInterruptStack;
 
     interruptHandled = FALSE;
+    pPrevInterruptStack = NULL;
     indexInHandlers = InterruptIndex - NO_OF_RESERVED_EXCEPTIONS;
     bSpuriousInterrupt = FALSE;
 
+    pCpu = GetCurrentPcpu();
+    if (NULL != pCpu)
+    {
+        // the interrupt may have interrupted another interrupt handler
+        pPrevInterruptStack = pCpu->InterruptStack;
+        pCpu->InterruptStack = StackPointer;
+    }
+
+    TRACE_INTERRUPT(TraceEventInterruptEnter, InterruptIndex, 0);
+
     // In operating systems that use the lowest priority delivery mode but do not update the TPR, the TPR information
     // saved in the chipset will potentially cause the interrupt to be always delivered to the same processor from the
     // logical set. This behavior is functionally backward compatible with the P6 family processor but may result in
@@ -227,6 +243,14 @@ _IsrInterruptHandler(
     // if the thread terminates
     CpuMuLowerIrql(prevIrql);
 
+    TRACE_INTERRUPT(TraceEventInterruptExit, InterruptIndex, interruptHandled);
+
+    // after ThreadYield we may continue on a different CPU
+    if (NULL != pCpu)
+    {
+        pCpu->InterruptStack = pPrevInterruptStack;
+    }
+
     if (ThreadYieldOnInterrupt())
     {
         ThreadYield();
@@ -198,6 +198,17 @@ LapicSystemSetTimer(
     LapicSetTimerInterval(m_apicData.LocalApicAddress, timerCount);
 }
 
+void
+LapicSystemSetPerfCounterInterrupt(
+    IN      BYTE                            Vector,
+    IN      BOOLEAN                         Enable
+    )
+{
+    ASSERT(NULL != m_apicData.LocalApicAddress);
+
+    LapicConfigurePerfCounterInterrupt(m_apicData.LocalApicAddress, Vector, Enable);
+}
+
 void
 LapicSystemSendIpi(
     _When_(ApicDestinationShorthandNone == DeliveryMode, IN)
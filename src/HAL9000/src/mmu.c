@@ -15,6 +15,7 @@
 #include "thread_internal.h"
 #include "io.h"
 #include "mdl.h"
+#include "pool_stats.h"
 
 #define PAGING_STRUCTURES_BASE_MEMORY                           (128*KB_SIZE)
 
@@ -815,6 +816,69 @@ MmuFreePoolWithTag(
                             );
 }
 
+QWORD
+MmuGetPoolAllocationSequence(
+    void
+    )
+{
+    INTR_STATE oldState;
+    QWORD sequence;
+
+    LockAcquire(&m_mmuData.Heaps[MmuHeapIndexNormal].HeapLock, &oldState);
+    sequence = m_mmuData.Heaps[MmuHeapIndexNormal].Heap->AllocationSequence;
+    LockRelease(&m_mmuData.Heaps[MmuHeapIndexNormal].HeapLock, oldState);
+
+    return sequence;
+}
+
+QWORD
+MmuRetrievePoolAllocations(
+    IN      QWORD                   SinceSequence,
+    IN      QWORD                   UntilSequence,
+    IN      DWORD                   MaxAllocations,
+    OUT_WRITES_OPT(MaxAllocations)
+            PHEAP_ALLOCATION_INFO   Allocations
+    )
+{
+    INTR_STATE oldState;
+    QWORD noOfAllocations;
+
+    LockAcquire(&m_mmuData.Heaps[MmuHeapIndexNormal].HeapLock, &oldState);
+    noOfAllocations = ClHeapRetrieveAllocations(m_mmuData.Heaps[MmuHeapIndexNormal].Heap,
+                                                SinceSequence,
+                                                UntilSequence,
+                                                MaxAllocations,
+                                                Allocations
+                                                );
+    LockRelease(&m_mmuData.Heaps[MmuHeapIndexNormal].HeapLock, oldState);
+
+    return noOfAllocations;
+}
+
+void
+MmuGetPoolUsage(
+    OUT     QWORD*                  HeapSize,
+    OUT     QWORD*                  BytesUsed,
+    OUT     QWORD*                  NumberOfAllocations
+    )
+{
+    INTR_STATE oldState;
+    PHEAP_HEADER pHeap;
+
+    ASSERT(NULL != HeapSize);
+    ASSERT(NULL != BytesUsed);
+    ASSERT(NULL != NumberOfAllocations);
+
+    LockAcquire(&m_mmuData.Heaps[MmuHeapIndexNormal].HeapLock, &oldState);
+    pHeap = m_mmuData.Heaps[MmuHeapIndexNormal].Heap;
+
+    // the bytes used include the headers of the allocations
+    *HeapSize = pHeap->HeapSizeMaximum;
+    *BytesUsed = pHeap->HeapSizeMaximum - pHeap->HeapSizeRemaining;
+    *NumberOfAllocations = pHeap->HeapNumberOfAllocations;
+    LockRelease(&m_mmuData.Heaps[MmuHeapIndexNormal].HeapLock, oldState);
+}
+
 void
 MmuProbeMemory(
     IN      PVOID                   Buffer,
@@ -1280,6 +1344,104 @@ MmuFreeSystemVirtualAddressForUserBuffer(
                     NULL);
 }
 
+STATUS
+MmuGetUserVirtualAddressForSystemBuffer(
+    IN          PVOID               KernelAddress,
+    IN          QWORD               Size,
+    IN          PAGE_RIGHTS         PageRights,
+    IN          PPROCESS            Process,
+    OUT         PVOID*              UserAddress
+    )
+{
+    STATUS status;
+    PMDL pMdl;
+    PVOID pUserAddress;
+
+    if (KernelAddress == NULL)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (Size == 0 || Size > MAX_DWORD)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (Process == NULL || ProcessIsSystem(Process))
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (UserAddress == NULL)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    status = STATUS_SUCCESS;
+    pUserAddress = NULL;
+    pMdl = NULL;
+
+    __try
+    {
+        pMdl = MdlAllocate(KernelAddress, (DWORD)Size);
+        if (pMdl == NULL)
+        {
+            LOG_FUNC_ERROR_ALLOC("MdlAllocate", Size);
+            status = STATUS_UNSUCCESSFUL;
+            __leave;
+        }
+
+        pUserAddress = VmmAllocRegionEx(NULL,
+                                        Size,
+                                        VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT | VMM_ALLOC_TYPE_NOT_LAZY,
+                                        PageRights,
+                                        FALSE,
+                                        NULL,
+                                        Process->VaSpace,
+                                        Process->PagingData,
+                                        pMdl);
+        if (pUserAddress == NULL)
+        {
+            LOG_FUNC_ERROR_ALLOC("VmmAllocRegionEx", Size);
+            status = STATUS_MEMORY_CANNOT_BE_COMMITED;
+            __leave;
+        }
+    }
+    __finally
+    {
+        if (pMdl != NULL)
+        {
+            MdlFree(pMdl);
+            pMdl = NULL;
+        }
+
+        if (SUCCEEDED(status))
+        {
+            *UserAddress = PtrOffset(pUserAddress, AddressOffset(KernelAddress, PAGE_SIZE));
+        }
+    }
+
+    return status;
+}
+
+void
+MmuFreeUserVirtualAddressForSystemBuffer(
+    IN          PVOID               UserAddress,
+    IN          PPROCESS            Process
+    )
+{
+    ASSERT(UserAddress != NULL);
+    ASSERT(Process != NULL);
+
+    // the frames belong to the kernel buffer
+    VmmFreeRegionEx(UserAddress,
+                    0,
+                    VMM_FREE_TYPE_RELEASE,
+                    FALSE,
+                    Process->VaSpace,
+                    Process->PagingData);
+}
+
 static
 STATUS
 _MmuCreatePagingTables(
@@ -1940,6 +2102,10 @@ _MmuAllocateFromPoolWithTag(
                                       Tag,
                                       AllocationAlignment
                                       );
+    if (NULL != pResult)
+    {
+        PoolStatsRecordAllocation(Tag, AllocationSize);
+    }
     LockRelease(&m_mmuData.Heaps[Heap].HeapLock, oldState );
 
     return pResult;
@@ -1955,15 +2121,19 @@ _MmuFreeFromPoolWithTag(
     )
 {
     INTR_STATE oldState;
+    DWORD size;
 
     ASSERT(Heap < MmuHeapIndexReserved);
     ASSERT( NULL != m_mmuData.Heaps[Heap].Heap );
 
+    size = ClHeapGetAllocationSize(MemoryAddress);
+
     LockAcquire(&m_mmuData.Heaps[Heap].HeapLock, &oldState);
     ClHeapFreePoolWithTag(m_mmuData.Heaps[Heap].Heap,
                         MemoryAddress,
                         Tag
                         );
+    PoolStatsRecordFree(Tag, size);
     LockRelease(&m_mmuData.Heaps[Heap].HeapLock, oldState);
 }
 
@@ -4,6 +4,7 @@
 #include "acpi_interface.h"
 #include "io.h"
 #include "pcie.h"
+#include "lock_common.h"
 
 /// to remove
 #include "dmp_pci.h"
@@ -20,6 +21,11 @@ typedef struct _PCI_SYSTEM_DATA
     BOOLEAN             PciExpressSupport;
 
     LIST_ENTRY          PciRootComplexList;
+
+    // the legacy mechanism selects the register through the address port and
+    // accesses it through the data port, the two accesses must not interleave
+    // with the ones of another CPU
+    LOCK                LegacyConfigurationLock;
 } PCI_SYSTEM_DATA, *PPCI_SYSTEM_DATA;
 
 static PCI_SYSTEM_DATA  m_pciSystemData;
@@ -102,6 +108,8 @@ PciSystemPreinit(
     memzero(&m_pciSystemData, sizeof(PCI_SYSTEM_DATA));
 
     InitializeListHead(&m_pciSystemData.PciRootComplexList);
+
+    LockInit(&m_pciSystemData.LegacyConfigurationLock);
 }
 
 STATUS
@@ -543,6 +551,8 @@ _PciSystemReadConfigurationSpace(
     OUT     DWORD*                  Value
     )
 {
+    INTR_STATE oldState;
+
     if( NULL == Value )
     {
         return STATUS_INVALID_PARAMETER3;
@@ -579,7 +589,9 @@ _PciSystemReadConfigurationSpace(
             return STATUS_DEVICE_SPACE_RANGE_EXCEEDED;
         }
 
+        LockAcquire(&m_pciSystemData.LegacyConfigurationLock, &oldState);
         *Value = PciReadConfigurationSpace(DeviceLocation, (BYTE) Register);
+        LockRelease(&m_pciSystemData.LegacyConfigurationLock, oldState);
     }
 
     return STATUS_SUCCESS;
@@ -592,6 +604,8 @@ _PciSystemWriteConfigurationSpace(
     IN      DWORD                   Value
     )
 {
+    INTR_STATE oldState;
+
     ASSERT(IsAddressAligned(Register, sizeof(DWORD)));
 
     if (m_pciSystemData.PciExpressSupport)
@@ -623,7 +637,9 @@ _PciSystemWriteConfigurationSpace(
             return STATUS_DEVICE_SPACE_RANGE_EXCEEDED;
         }
 
+        LockAcquire(&m_pciSystemData.LegacyConfigurationLock, &oldState);
         PciWriteConfigurationSpace(DeviceLocation, (BYTE)Register, Value);
+        LockRelease(&m_pciSystemData.LegacyConfigurationLock, oldState);
     }
 
     return STATUS_SUCCESS;
@@ -1,89 +1,206 @@
 #include "HAL9000.h"
 #include "perf_framework.h"
+#include "histogram.h"
 #include "iomu.h"
 #include "rtc.h"
+#include "smp.h"
 
+#define PERF_TIMER_OVERHEAD_SAMPLES     128
+
+typedef struct _PERF_RUN_CONTEXT
+{
+    PFUNC_TestPerformance       Function;
+    PVOID                       Context;
+    PPERFORMANCE_PARAMETERS     Parameters;
+
+    // the minimum number of ticks between two consecutive TSC reads
+    QWORD                       TimerOverhead;
+
+    // one for each CPU running the function
+    PHISTOGRAM                  Histograms;
+
+    // each CPU entering the run takes an index, the ones with an index greater
+    // than the number of CPUs requested return immediately
+    volatile DWORD              NextIndex;
+
+    // the number of CPUs which finished their warm-up
+    volatile DWORD              CpusReady;
+} PERF_RUN_CONTEXT, *PPERF_RUN_CONTEXT;
+
+static FUNC_IpcProcessEvent     _PerfRunOnCpu;
+
+static
 void
-RunPerformanceFunction(
+_PerfRunIterations(
+    INOUT   PPERF_RUN_CONTEXT       RunContext,
+    INOUT   PHISTOGRAM              Histogram
+    );
+
+static
+QWORD
+_PerfMeasureTimerOverhead(
+    void
+    );
+
+static
+QWORD
+_PerfConvertTicks(
+    IN      QWORD                   Ticks,
+    IN      PERFORMANCE_UNIT        Unit
+    );
+
+static
+const char*
+_PerfGetUnitName(
+    IN      PERFORMANCE_UNIT        Unit
+    );
+
+STATUS
+RunPerformanceFunctionEx(
     IN      PFUNC_TestPerformance   Function,
     IN_OPT  PVOID                   Context,
-    IN      DWORD                   IterationCount,
-    IN      BOOLEAN                 MeasureInUs,
+    IN      PPERFORMANCE_PARAMETERS Parameters,
     OUT     PPERFORMANCE_STATS      PerfStats
     )
 {
-    QWORD startTick;
-    QWORD endTick;
-    QWORD* allTimes;
-    QWORD totalTime;
-    QWORD minTime;
-    QWORD maxTime;
-    QWORD meanTime;
+    STATUS status;
+    PERF_RUN_CONTEXT runContext;
+    PHISTOGRAM pResult;
+    DWORD histogramsSize;
+    BOOLEAN logState;
     DWORD i;
 
-    ASSERT( NULL != Function );
-    ASSERT( NULL != PerfStats );
+    if (NULL == Function)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
 
-    allTimes = NULL;
+    if (NULL == Parameters
+        || 0 == Parameters->Iterations
+        || 0 == Parameters->NumberOfCpus
+        || Parameters->NumberOfCpus > SmpGetNumberOfActiveCpus()
+        || Parameters->Unit >= PerformanceUnitReserved)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (NULL == PerfStats)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
 
-    allTimes = ExAllocatePoolWithTag(PoolAllocateZeroMemory | PoolAllocatePanicIfFail,
-                                     sizeof(QWORD) * IterationCount,
-                                     HEAP_TEST_TAG,
-                                     0
-                                     );
+    status = STATUS_SUCCESS;
+    memzero(&runContext, sizeof(PERF_RUN_CONTEXT));
+    histogramsSize = sizeof(HISTOGRAM) * Parameters->NumberOfCpus;
 
-    for (i = 0; i < IterationCount; ++i)
+    runContext.Function = Function;
+    runContext.Context = Context;
+    runContext.Parameters = Parameters;
+
+    if (!CpuHasInvariantTsc())
     {
-        BOOLEAN logState;
+        LOG_WARNING("The TSC is not invariant, the results may not be accurate\n");
+    }
 
-        logState = LogSetState(FALSE);
-        startTick = RtcGetTickCount();
-        Function(Context);
-        endTick = RtcGetTickCount();
-        LogSetState(logState);
+    __try
+    {
+        // the last histogram holds the merged results
+        runContext.Histograms = ExAllocatePoolWithTag(0,
+                                                      histogramsSize + sizeof(HISTOGRAM),
+                                                      HEAP_TEST_TAG,
+                                                      0);
+        if (NULL == runContext.Histograms)
+        {
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", histogramsSize + sizeof(HISTOGRAM));
+            __leave;
+        }
 
-        if (endTick == startTick)
+        for (i = 0; i <= Parameters->NumberOfCpus; ++i)
         {
-            /// TODO: why the fuck does this happen?
-            LOG_ERROR("End tick: 0x%X\nStart tick: 0x%X\n", endTick, startTick);
-            endTick = endTick + 1;
+            HistogramInit(&runContext.Histograms[i]);
         }
-        ASSERT_INFO( endTick > startTick, 
-                    "End tick: 0x%X\nStart tick: 0x%X\n", endTick, startTick );
-        allTimes[i] = endTick - startTick;
-    }
 
+        runContext.TimerOverhead = _PerfMeasureTimerOverhead();
 
-    ASSERT(NULL != allTimes);
+        logState = LogSetState(FALSE);
+        if (1 == Parameters->NumberOfCpus)
+        {
+            _PerfRunIterations(&runContext, &runContext.Histograms[0]);
+        }
+        else
+        {
+            SMP_DESTINATION dest = { 0 };
 
-    totalTime = minTime = maxTime = allTimes[0];
+            // there is no way to bind a thread to a CPU, the IPI handlers are
+            // the only code guaranteed to run on each of them
+            status = SmpSendGenericIpiEx(_PerfRunOnCpu,
+                                         &runContext,
+                                         NULL,
+                                         NULL,
+                                         TRUE,
+                                         SmpIpiSendToAllIncludingSelf,
+                                         dest);
+        }
+        LogSetState(logState);
 
-    for (i = 1; i < IterationCount; ++i)
-    {
-        if (allTimes[i] < minTime)
+        if (!SUCCEEDED(status))
         {
-            minTime = allTimes[i];
+            LOG_FUNC_ERROR("SmpSendGenericIpiEx", status);
+            __leave;
         }
-        else if (allTimes[i] > maxTime)
+
+        pResult = &runContext.Histograms[Parameters->NumberOfCpus];
+        for (i = 0; i < Parameters->NumberOfCpus; ++i)
         {
-            maxTime = allTimes[i];
+            HistogramMerge(pResult, &runContext.Histograms[i]);
         }
 
-        ASSERT (MAX_QWORD - allTimes[i] >= totalTime);
-
-        totalTime = totalTime + allTimes[i];
+        PerfStats->Min = _PerfConvertTicks(pResult->Min, Parameters->Unit);
+        PerfStats->Max = _PerfConvertTicks(pResult->Max, Parameters->Unit);
+        PerfStats->Mean = _PerfConvertTicks(HistogramGetMean(pResult), Parameters->Unit);
+        PerfStats->P50 = _PerfConvertTicks(HistogramGetPercentile(pResult, 500), Parameters->Unit);
+        PerfStats->P90 = _PerfConvertTicks(HistogramGetPercentile(pResult, 900), Parameters->Unit);
+        PerfStats->P99 = _PerfConvertTicks(HistogramGetPercentile(pResult, 990), Parameters->Unit);
+        PerfStats->P999 = _PerfConvertTicks(HistogramGetPercentile(pResult, 999), Parameters->Unit);
+        PerfStats->Iterations = pResult->Count;
+        PerfStats->NumberOfCpus = Parameters->NumberOfCpus;
+        PerfStats->Unit = Parameters->Unit;
     }
-    meanTime = totalTime / IterationCount;
-
-    PerfStats->Min = MeasureInUs ? IomuTickCountToUs(minTime) : minTime;
-    PerfStats->Max = MeasureInUs ? IomuTickCountToUs(maxTime) : maxTime;
-    PerfStats->Mean = MeasureInUs ? IomuTickCountToUs(meanTime) : meanTime;
-
-    if (NULL != allTimes)
+    __finally
     {
-        ExFreePoolWithTag(allTimes, HEAP_TEST_TAG);
-        allTimes = NULL;
+        if (NULL != runContext.Histograms)
+        {
+            ExFreePoolWithTag(runContext.Histograms, HEAP_TEST_TAG);
+            runContext.Histograms = NULL;
+        }
     }
+
+    return status;
+}
+
+void
+RunPerformanceFunction(
+    IN      PFUNC_TestPerformance   Function,
+    IN_OPT  PVOID                   Context,
+    IN      DWORD                   IterationCount,
+    IN      BOOLEAN                 MeasureInUs,
+    OUT     PPERFORMANCE_STATS      PerfStats
+    )
+{
+    STATUS status;
+    PERFORMANCE_PARAMETERS params;
+
+    ASSERT( NULL != Function );
+    ASSERT( NULL != PerfStats );
+
+    params.WarmupIterations = IterationCount / 10;
+    params.Iterations = IterationCount;
+    params.NumberOfCpus = 1;
+    params.Unit = MeasureInUs ? PerformanceUnitUs : PerformanceUnitTicks;
+
+    status = RunPerformanceFunctionEx(Function, Context, &params, PerfStats);
+    ASSERT_INFO(SUCCEEDED(status), "RunPerformanceFunctionEx failed with status 0x%x\n", status);
 }
 
 void
@@ -105,6 +222,8 @@ DisplayPerformanceStats(
         LOG("Mean time: 0x%X\n", PerfStats[i].Mean);
         LOG("Min time: 0x%X\n", PerfStats[i].Min);
         LOG("Max time: 0x%X\n", PerfStats[i].Max);
+        LOG("P50/P90/P99/P99.9: 0x%X/0x%X/0x%X/0x%X\n",
+            PerfStats[i].P50, PerfStats[i].P90, PerfStats[i].P99, PerfStats[i].P999);
 
         if ((PerfStats[i].Mean == 0)
             || (PerfStats[i].Min == 0)
@@ -135,4 +254,155 @@ DisplayPerformanceStats(
         speedUp = (PerfStats[0].Min * 1000) / PerfStats[1].Max;
         LOG("Lowest speed-up: %2u.%03u\n", speedUp / 1000, speedUp % 1000);
     }
-}
\ No newline at end of file
+}
+
+void
+ReportPerformanceStats(
+    IN_Z    char*                   Name,
+    IN      PPERFORMANCE_STATS      PerfStats
+    )
+{
+    ASSERT(NULL != Name);
+    ASSERT(NULL != PerfStats);
+
+    LOG("PERF name=%s cpus=%u iterations=%U unit=%s min=%U mean=%U p50=%U p90=%U p99=%U p999=%U max=%U\n",
+        Name,
+        PerfStats->NumberOfCpus,
+        PerfStats->Iterations,
+        _PerfGetUnitName(PerfStats->Unit),
+        PerfStats->Min,
+        PerfStats->Mean,
+        PerfStats->P50,
+        PerfStats->P90,
+        PerfStats->P99,
+        PerfStats->P999,
+        PerfStats->Max);
+}
+
+static
+STATUS
+(__cdecl _PerfRunOnCpu)(
+    IN_OPT  PVOID                   Context
+    )
+{
+    PPERF_RUN_CONTEXT pRunContext;
+    DWORD index;
+
+    ASSERT(NULL != Context);
+
+    pRunContext = (PPERF_RUN_CONTEXT) Context;
+
+    index = _InterlockedIncrement(&pRunContext->NextIndex) - 1;
+    if (index >= pRunContext->Parameters->NumberOfCpus)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    _PerfRunIterations(pRunContext, &pRunContext->Histograms[index]);
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_PerfRunIterations(
+    INOUT   PPERF_RUN_CONTEXT       RunContext,
+    INOUT   PHISTOGRAM              Histogram
+    )
+{
+    QWORD startTick;
+    QWORD endTick;
+    QWORD elapsed;
+    DWORD i;
+
+    ASSERT(NULL != RunContext);
+    ASSERT(NULL != Histogram);
+
+    // warms up the caches and the TLBs and lets the branch predictors learn
+    // the function
+    for (i = 0; i < RunContext->Parameters->WarmupIterations; ++i)
+    {
+        RunContext->Function(RunContext->Context);
+    }
+
+    // no CPU starts measuring before all of them are done warming up
+    _InterlockedIncrement(&RunContext->CpusReady);
+    while (RunContext->CpusReady < RunContext->Parameters->NumberOfCpus)
+    {
+        _mm_pause();
+    }
+
+    for (i = 0; i < RunContext->Parameters->Iterations; ++i)
+    {
+        startTick = RtcGetTickCount();
+        RunContext->Function(RunContext->Context);
+        endTick = RtcGetTickCount();
+
+        ASSERT_INFO(endTick >= startTick,
+                    "End tick: 0x%X\nStart tick: 0x%X\n", endTick, startTick);
+
+        elapsed = endTick - startTick;
+        elapsed = elapsed > RunContext->TimerOverhead ? elapsed - RunContext->TimerOverhead : 0;
+
+        HistogramRecord(Histogram, elapsed);
+    }
+}
+
+static
+QWORD
+_PerfMeasureTimerOverhead(
+    void
+    )
+{
+    QWORD startTick;
+    QWORD endTick;
+    QWORD overhead;
+    DWORD i;
+
+    overhead = MAX_QWORD;
+
+    for (i = 0; i < PERF_TIMER_OVERHEAD_SAMPLES; ++i)
+    {
+        startTick = RtcGetTickCount();
+        endTick = RtcGetTickCount();
+
+        overhead = min(overhead, endTick - startTick);
+    }
+
+    return overhead;
+}
+
+static
+QWORD
+_PerfConvertTicks(
+    IN      QWORD                   Ticks,
+    IN      PERFORMANCE_UNIT        Unit
+    )
+{
+    switch (Unit)
+    {
+    case PerformanceUnitNs:
+        return IomuTickCountToNs(Ticks);
+    case PerformanceUnitUs:
+        return IomuTickCountToUs(Ticks);
+    default:
+        return Ticks;
+    }
+}
+
+static
+const char*
+_PerfGetUnitName(
+    IN      PERFORMANCE_UNIT        Unit
+    )
+{
+    switch (Unit)
+    {
+    case PerformanceUnitNs:
+        return "ns";
+    case PerformanceUnitUs:
+        return "us";
+    default:
+        return "ticks";
+    }
+}
@@ -0,0 +1,770 @@
+#include "HAL9000.h"
+#include "pmu.h"
+#include "cpumu.h"
+#include "smp.h"
+#include "mutex.h"
+#include "io.h"
+#include "lapic_system.h"
+#include "profiler.h"
+#include "thread_internal.h"
+
+// IA32_PMC0 to IA32_PMC7 are defined
+#define PMU_MAX_GENERAL_COUNTERS        8
+
+// instructions retired and core cycles are the only fixed counters used
+#define PMU_MAX_FIXED_COUNTERS          2
+
+#define PMU_EVENT_SELECT(Event,Umask)   ((WORD) (((Umask) << 8) | (Event)))
+
+#define PMU_EVENT_BIT(Event)            ((DWORD)1 << (Event))
+
+typedef struct _PMU_ARCH_EVENT
+{
+    // bit in the EBX of CPUID leaf 0xA set if the event is not available
+    BYTE                    CpuidBit;
+
+    WORD                    EventSelect;
+
+    // the fixed counter which counts the event, if any
+    BYTE                    FixedCounter;
+    BOOLEAN                 HasFixedCounter;
+} PMU_ARCH_EVENT, *PPMU_ARCH_EVENT;
+
+// indexed by PMU_EVENT, see the architectural performance monitoring events
+// in the Intel SDM, Vol. 3B, 19.2.1.2
+static const PMU_ARCH_EVENT PMU_ARCH_EVENTS[PmuEventReserved] =
+{
+    { 0, PMU_EVENT_SELECT(0x3C, 0x00), 1, TRUE },
+    { 1, PMU_EVENT_SELECT(0xC0, 0x00), 0, TRUE },
+    { 4, PMU_EVENT_SELECT(0x2E, 0x41), 0, FALSE },
+    { 6, PMU_EVENT_SELECT(0xC5, 0x00), 0, FALSE },
+};
+
+typedef struct _PMU_COUNTER
+{
+    BOOLEAN                 Available;
+    BOOLEAN                 Fixed;
+
+    // index of the fixed or general-purpose counter
+    BYTE                    Index;
+
+    WORD                    EventSelect;
+} PMU_COUNTER, *PPMU_COUNTER;
+
+typedef struct _PMU_CPU
+{
+    // the session for which the counters of the CPU were programmed, the
+    // CPUs are programmed one after the other after the session changes
+    QWORD                   Session;
+
+    // value of each counter when it was last accounted
+    QWORD                   LastValues[PmuEventReserved];
+
+    QWORD                   Counts[PmuEventReserved];
+
+    QWORD                   Samples;
+} PMU_CPU, *PPMU_CPU;
+
+typedef struct _PMU_DATA
+{
+    // serializes PmuStart, PmuStop and PmuRetrieveCounts
+    MUTEX                   Lock;
+
+    PMU_INFO                Info;
+    PMU_COUNTER             Counters[PmuEventReserved];
+
+    QWORD                   GeneralCounterMask;
+    QWORD                   FixedCounterMask;
+
+    BYTE                    OverflowVector;
+
+    // the fields below describe the current session, they are changed only
+    // while the counters are stopped
+    volatile BOOLEAN        Running;
+
+    PMU_MODE                Mode;
+
+    // bit i is set if the event i is counted
+    DWORD                   EventsCounted;
+
+    // valid only in sampling mode
+    PMU_EVENT               SampledEvent;
+    DWORD                   Period;
+
+    // incremented by each PmuStart, the thread counters of previous sessions
+    // are discarded
+    volatile QWORD          Session;
+} PMU_DATA, *PPMU_DATA;
+
+static PMU_DATA m_pmuData;
+
+static FUNC_InterruptFunction _PmuOverflowIsr;
+static FUNC_IpcProcessEvent _PmuProgramCountersIpi;
+static FUNC_IpcProcessEvent _PmuAccumulateIpi;
+
+static
+void
+_PmuAccumulate(
+    INOUT   PPMU_CPU                Cpu,
+    INOUT_OPT PPMU_THREAD_COUNTERS  ThreadCounters
+    );
+
+static
+void
+_PmuStopCounters(
+    void
+    );
+
+__forceinline
+static
+DWORD
+_PmuGetCounterMsr(
+    IN      PPMU_COUNTER            Counter
+    )
+{
+    return Counter->Fixed ? IA32_FIXED_CTR0 + Counter->Index : IA32_PMC0 + Counter->Index;
+}
+
+__forceinline
+static
+QWORD
+_PmuGetCounterMask(
+    IN      PPMU_COUNTER            Counter
+    )
+{
+    return Counter->Fixed ? m_pmuData.FixedCounterMask : m_pmuData.GeneralCounterMask;
+}
+
+__forceinline
+static
+QWORD
+_PmuGetGlobalCtrlBit(
+    IN      PPMU_COUNTER            Counter
+    )
+{
+    return Counter->Fixed
+        ? (QWORD)1 << (IA32_PERF_GLOBAL_CTRL_ENABLE_FIXED_BIT_BASE + Counter->Index)
+        : (QWORD)1 << (IA32_PERF_GLOBAL_CTRL_ENABLE_PMC_BIT_BASE + Counter->Index);
+}
+
+_No_competing_thread_
+void
+PmuSystemPreinit(
+    void
+    )
+{
+    memzero(&m_pmuData, sizeof(PMU_DATA));
+
+    MutexInit(&m_pmuData.Lock, FALSE);
+}
+
+STATUS
+PmuSystemInit(
+    void
+    )
+{
+    STATUS status;
+    CPUID_ARCH_PERF_MON_LEAF leaf;
+    IO_INTERRUPT ioInterrupt;
+    BYTE nextGeneralCounter;
+    DWORD i;
+
+    CpuMuGetArchPerfMonLeaf(&leaf);
+
+    if (0 == leaf.eax.VersionId || 0 == leaf.eax.NumberOfPmcsPerCpu)
+    {
+        LOGL("CPUID reports no architectural PMU, the PMU counters will not be available\n");
+        return STATUS_SUCCESS;
+    }
+
+    m_pmuData.Info.Version = leaf.eax.VersionId;
+    m_pmuData.Info.NumberOfGeneralCounters = min(leaf.eax.NumberOfPmcsPerCpu, PMU_MAX_GENERAL_COUNTERS);
+    m_pmuData.GeneralCounterMask = (QWORD)-1 >> (64 - leaf.eax.BitWidth);
+
+    // the fixed counters are enumerated starting with version 2
+    if (leaf.eax.VersionId > 1 && 0 != leaf.edx.NoOfFixedPmcs)
+    {
+        m_pmuData.Info.NumberOfFixedCounters = min(leaf.edx.NoOfFixedPmcs, PMU_MAX_FIXED_COUNTERS);
+        m_pmuData.FixedCounterMask = (QWORD)-1 >> (64 - leaf.edx.BitWidthOfFixedPmcs);
+    }
+
+    nextGeneralCounter = 0;
+    for (i = 0; i < PmuEventReserved; ++i)
+    {
+        const PMU_ARCH_EVENT* pEvent = &PMU_ARCH_EVENTS[i];
+        PPMU_COUNTER pCounter = &m_pmuData.Counters[i];
+
+        pCounter->EventSelect = pEvent->EventSelect;
+
+        if (pEvent->HasFixedCounter && pEvent->FixedCounter < m_pmuData.Info.NumberOfFixedCounters)
+        {
+            pCounter->Available = TRUE;
+            pCounter->Fixed = TRUE;
+            pCounter->Index = pEvent->FixedCounter;
+        }
+        else if (pEvent->CpuidBit < leaf.eax.LengthOfEbxBitVector
+                 && !IsBooleanFlagOn(*(DWORD*)&leaf.ebx, (1UL << pEvent->CpuidBit))
+                 && nextGeneralCounter < m_pmuData.Info.NumberOfGeneralCounters)
+        {
+            pCounter->Available = TRUE;
+            pCounter->Index = nextGeneralCounter++;
+        }
+
+        m_pmuData.Info.EventAvailable[i] = pCounter->Available;
+    }
+
+    memzero(&ioInterrupt, sizeof(IO_INTERRUPT));
+
+    ioInterrupt.Type = IoInterruptTypeLapic;
+    ioInterrupt.Exclusive = TRUE;
+    ioInterrupt.ServiceRoutine = _PmuOverflowIsr;
+    ioInterrupt.Irql = IrqlClockLevel;
+
+    status = IoRegisterInterruptEx(&ioInterrupt, NULL, &m_pmuData.OverflowVector);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IoRegisterInterruptEx", status);
+        return status;
+    }
+
+    LOGL("PMU version %u, %u general-purpose counters, %u fixed counters used, overflow vector 0x%02x\n",
+         m_pmuData.Info.Version, m_pmuData.Info.NumberOfGeneralCounters,
+         m_pmuData.Info.NumberOfFixedCounters, m_pmuData.OverflowVector);
+
+    return STATUS_SUCCESS;
+}
+
+void
+PmuGetInfo(
+    OUT     PPMU_INFO               Info
+    )
+{
+    ASSERT(NULL != Info);
+
+    *Info = m_pmuData.Info;
+}
+
+STATUS
+PmuStart(
+    IN      PMU_MODE                Mode,
+    IN      PMU_EVENT               Event,
+    IN      DWORD                   Period
+    )
+{
+    STATUS status;
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    SMP_DESTINATION dest = { 0 };
+    DWORD i;
+
+    if (Mode >= PmuModeReserved)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (PmuModeSampling == Mode)
+    {
+        if (Event >= PmuEventReserved)
+        {
+            return STATUS_INVALID_PARAMETER2;
+        }
+
+        if (0 == Period || Period > PMU_MAX_SAMPLING_PERIOD)
+        {
+            return STATUS_INVALID_PARAMETER3;
+        }
+    }
+
+    if (0 == m_pmuData.Info.Version)
+    {
+        return STATUS_CPU_UNSUPPORTED_FEATURE;
+    }
+
+    if (PmuModeSampling == Mode && !m_pmuData.Counters[Event].Available)
+    {
+        return STATUS_CPU_UNSUPPORTED_FEATURE;
+    }
+
+    status = STATUS_SUCCESS;
+    pCpuListHead = NULL;
+
+    SmpGetCpuList(&pCpuListHead);
+
+    MutexAcquire(&m_pmuData.Lock);
+
+    __try
+    {
+        if (m_pmuData.Running)
+        {
+            status = STATUS_DEVICE_BUSY;
+            __leave;
+        }
+
+        for (pCurEntry = pCpuListHead->Flink;
+             pCurEntry != pCpuListHead;
+             pCurEntry = pCurEntry->Flink)
+        {
+            PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+
+            if (NULL == pCpu->Pmu)
+            {
+                pCpu->Pmu = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(PMU_CPU), HEAP_PMU_TAG, 0);
+                if (NULL == pCpu->Pmu)
+                {
+                    LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PMU_CPU));
+                    status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+                    __leave;
+                }
+            }
+        }
+
+        m_pmuData.Mode = Mode;
+        m_pmuData.Period = Period;
+        m_pmuData.EventsCounted = 0;
+
+        if (PmuModeSampling == Mode)
+        {
+            m_pmuData.SampledEvent = Event;
+            m_pmuData.EventsCounted = PMU_EVENT_BIT(Event);
+
+            status = ProfilerStart(PROFILER_FREQUENCY_EXTERNAL);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("ProfilerStart", status);
+                __leave;
+            }
+        }
+        else
+        {
+            for (i = 0; i < PmuEventReserved; ++i)
+            {
+                if (m_pmuData.Counters[i].Available)
+                {
+                    m_pmuData.EventsCounted |= PMU_EVENT_BIT(i);
+                }
+            }
+        }
+
+        m_pmuData.Session++;
+        m_pmuData.Running = TRUE;
+
+        status = SmpSendGenericIpiEx(_PmuProgramCountersIpi,
+                                     NULL,
+                                     NULL,
+                                     NULL,
+                                     TRUE,
+                                     SmpIpiSendToAllIncludingSelf,
+                                     dest);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("SmpSendGenericIpiEx", status);
+            _PmuStopCounters();
+            __leave;
+        }
+    }
+    __finally
+    {
+        MutexRelease(&m_pmuData.Lock);
+    }
+
+    return status;
+}
+
+void
+PmuStop(
+    void
+    )
+{
+    STATUS status;
+    SMP_DESTINATION dest = { 0 };
+
+    MutexAcquire(&m_pmuData.Lock);
+
+    if (m_pmuData.Running)
+    {
+        if (PmuModeCounting == m_pmuData.Mode)
+        {
+            // account the events counted until now to the running threads
+            status = SmpSendGenericIpiEx(_PmuAccumulateIpi,
+                                         NULL,
+                                         NULL,
+                                         NULL,
+                                         TRUE,
+                                         SmpIpiSendToAllIncludingSelf,
+                                         dest);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("SmpSendGenericIpiEx", status);
+            }
+        }
+
+        _PmuStopCounters();
+    }
+
+    MutexRelease(&m_pmuData.Lock);
+}
+
+void
+PmuRetrieveCounts(
+    OUT_WRITES(PmuEventReserved)
+            QWORD*                  Counts,
+    OUT     QWORD*                  Samples
+    )
+{
+    STATUS status;
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    SMP_DESTINATION dest = { 0 };
+    DWORD i;
+
+    ASSERT(NULL != Counts);
+    ASSERT(NULL != Samples);
+
+    pCpuListHead = NULL;
+
+    memzero(Counts, sizeof(QWORD) * PmuEventReserved);
+    *Samples = 0;
+
+    SmpGetCpuList(&pCpuListHead);
+
+    MutexAcquire(&m_pmuData.Lock);
+
+    if (m_pmuData.Running && PmuModeCounting == m_pmuData.Mode)
+    {
+        status = SmpSendGenericIpiEx(_PmuAccumulateIpi,
+                                     NULL,
+                                     NULL,
+                                     NULL,
+                                     TRUE,
+                                     SmpIpiSendToAllIncludingSelf,
+                                     dest);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("SmpSendGenericIpiEx", status);
+        }
+    }
+
+    for (pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead;
+         pCurEntry = pCurEntry->Flink)
+    {
+        PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+
+        if (NULL == pCpu->Pmu)
+        {
+            continue;
+        }
+
+        for (i = 0; i < PmuEventReserved; ++i)
+        {
+            Counts[i] = Counts[i] + pCpu->Pmu->Counts[i];
+        }
+
+        *Samples = *Samples + pCpu->Pmu->Samples;
+    }
+
+    MutexRelease(&m_pmuData.Lock);
+}
+
+BOOLEAN
+PmuGetThreadCounts(
+    IN      PPMU_THREAD_COUNTERS    ThreadCounters,
+    OUT_WRITES(PmuEventReserved)
+            QWORD*                  Counts
+    )
+{
+    ASSERT(NULL != ThreadCounters);
+    ASSERT(NULL != Counts);
+
+    if (0 == m_pmuData.Session || ThreadCounters->Session != m_pmuData.Session)
+    {
+        return FALSE;
+    }
+
+    memcpy(Counts, ThreadCounters->Counts, sizeof(QWORD) * PmuEventReserved);
+
+    return TRUE;
+}
+
+void
+PmuSwitchThread(
+    INOUT   PPMU_THREAD_COUNTERS    ThreadCounters
+    )
+{
+    PPCPU pCpu;
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+    ASSERT(NULL != ThreadCounters);
+
+    // the sampled counter is reloaded on each overflow, its value cannot be
+    // accounted to the threads
+    if (!m_pmuData.Running || PmuModeCounting != m_pmuData.Mode)
+    {
+        return;
+    }
+
+    pCpu = GetCurrentPcpu();
+    if (NULL == pCpu || NULL == pCpu->Pmu)
+    {
+        return;
+    }
+
+    _PmuAccumulate(pCpu->Pmu, ThreadCounters);
+}
+
+static
+BOOLEAN
+(__cdecl _PmuOverflowIsr)(
+    IN        PDEVICE_OBJECT           Device
+    )
+{
+    PPCPU pCpu;
+    PPMU_COUNTER pCounter;
+    QWORD overflowStatus;
+    QWORD initialValue;
+
+    ASSERT(NULL != Device);
+
+    pCpu = GetCurrentPcpu();
+    ASSERT(NULL != pCpu);
+
+    // an overflow already pending when the counters were stopped
+    if (!m_pmuData.Running || PmuModeSampling != m_pmuData.Mode || NULL == pCpu->Pmu)
+    {
+        return TRUE;
+    }
+
+    pCounter = &m_pmuData.Counters[m_pmuData.SampledEvent];
+
+    // version 1 has no global status, the only counter which may overflow is
+    // the sampled one
+    overflowStatus = (m_pmuData.Info.Version > 1)
+        ? __readmsr(IA32_PERF_GLOBAL_STATUS)
+        : _PmuGetGlobalCtrlBit(pCounter);
+
+    if (IsBooleanFlagOn(overflowStatus, _PmuGetGlobalCtrlBit(pCounter)))
+    {
+        ProfilerTakeSample();
+        pCpu->Pmu->Samples++;
+
+        initialValue = (QWORD)(-(INT64)m_pmuData.Period) & _PmuGetCounterMask(pCounter);
+        __writemsr(_PmuGetCounterMsr(pCounter), initialValue);
+    }
+
+    if (m_pmuData.Info.Version > 1)
+    {
+        __writemsr(IA32_PERF_GLOBAL_OVF_CTRL, overflowStatus);
+    }
+
+    // the CPU masked the LVT entry when it delivered the interrupt
+    LapicSystemSetPerfCounterInterrupt(m_pmuData.OverflowVector, TRUE);
+
+    return TRUE;
+}
+
+static
+STATUS
+(__cdecl _PmuProgramCountersIpi)(
+    IN_OPT  PVOID   Context
+    )
+{
+    PPCPU pCpu;
+    PPMU_CPU pPmu;
+    QWORD globalCtrl;
+    QWORD fixedCtrl;
+    QWORD initialValue;
+    BOOLEAN bSampling;
+    DWORD i;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pCpu = GetCurrentPcpu();
+    ASSERT(NULL != pCpu);
+
+    // stop all the counters before changing their configuration
+    if (m_pmuData.Info.Version > 1)
+    {
+        __writemsr(IA32_PERF_GLOBAL_CTRL, 0);
+    }
+
+    if (0 != m_pmuData.Info.NumberOfFixedCounters)
+    {
+        __writemsr(IA32_FIXED_CTR_CTRL, 0);
+    }
+
+    for (i = 0; i < m_pmuData.Info.NumberOfGeneralCounters; ++i)
+    {
+        __writemsr(IA32_PERFEVTSEL0 + i, 0);
+    }
+
+    LapicSystemSetPerfCounterInterrupt(m_pmuData.OverflowVector, FALSE);
+
+    pPmu = pCpu->Pmu;
+    if (!m_pmuData.Running || NULL == pPmu)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    memzero(pPmu, sizeof(PMU_CPU));
+    pPmu->Session = m_pmuData.Session;
+
+    bSampling = (PmuModeSampling == m_pmuData.Mode);
+    globalCtrl = 0;
+    fixedCtrl = 0;
+
+    for (i = 0; i < PmuEventReserved; ++i)
+    {
+        PPMU_COUNTER pCounter = &m_pmuData.Counters[i];
+
+        if (!IsBooleanFlagOn(m_pmuData.EventsCounted, PMU_EVENT_BIT(i)))
+        {
+            continue;
+        }
+
+        // the counter overflows after Period events
+        initialValue = bSampling ? (QWORD)(-(INT64)m_pmuData.Period) & _PmuGetCounterMask(pCounter) : 0;
+
+        __writemsr(_PmuGetCounterMsr(pCounter), initialValue);
+        pPmu->LastValues[i] = initialValue;
+
+        if (pCounter->Fixed)
+        {
+            fixedCtrl |= (IA32_FIXED_CTR_CTRL_OS | IA32_FIXED_CTR_CTRL_USR | (bSampling ? IA32_FIXED_CTR_CTRL_PMI : 0))
+                         << (pCounter->Index * IA32_FIXED_CTR_CTRL_BITS_PER_COUNTER);
+        }
+        else
+        {
+            __writemsr(IA32_PERFEVTSEL0 + pCounter->Index,
+                       pCounter->EventSelect | IA32_PERFEVTSEL_OS | IA32_PERFEVTSEL_USR | IA32_PERFEVTSEL_EN
+                       | (bSampling ? IA32_PERFEVTSEL_INT : 0));
+        }
+
+        globalCtrl |= _PmuGetGlobalCtrlBit(pCounter);
+    }
+
+    if (0 != fixedCtrl)
+    {
+        __writemsr(IA32_FIXED_CTR_CTRL, fixedCtrl);
+    }
+
+    if (bSampling)
+    {
+        LapicSystemSetPerfCounterInterrupt(m_pmuData.OverflowVector, TRUE);
+    }
+
+    // version 1 counters are enabled only by IA32_PERFEVTSEL_EN
+    if (m_pmuData.Info.Version > 1)
+    {
+        __writemsr(IA32_PERF_GLOBAL_OVF_CTRL, globalCtrl);
+        __writemsr(IA32_PERF_GLOBAL_CTRL, globalCtrl);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+(__cdecl _PmuAccumulateIpi)(
+    IN_OPT  PVOID   Context
+    )
+{
+    PPCPU pCpu;
+    PTHREAD pThread;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    pCpu = GetCurrentPcpu();
+    ASSERT(NULL != pCpu);
+
+    pThread = GetCurrentThread();
+
+    if (NULL != pCpu->Pmu)
+    {
+        _PmuAccumulate(pCpu->Pmu, (NULL != pThread) ? &pThread->PmuCounters : NULL);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_PmuAccumulate(
+    INOUT   PPMU_CPU                Cpu,
+    INOUT_OPT PPMU_THREAD_COUNTERS  ThreadCounters
+    )
+{
+    QWORD value;
+    QWORD delta;
+    QWORD session;
+    DWORD i;
+
+    ASSERT(NULL != Cpu);
+
+    session = m_pmuData.Session;
+    if (Cpu->Session != session)
+    {
+        return;
+    }
+
+    if (NULL != ThreadCounters && ThreadCounters->Session != session)
+    {
+        memzero(ThreadCounters->Counts, sizeof(ThreadCounters->Counts));
+        ThreadCounters->Session = session;
+    }
+
+    for (i = 0; i < PmuEventReserved; ++i)
+    {
+        PPMU_COUNTER pCounter = &m_pmuData.Counters[i];
+
+        if (!IsBooleanFlagOn(m_pmuData.EventsCounted, PMU_EVENT_BIT(i)))
+        {
+            continue;
+        }
+
+        value = __readmsr(_PmuGetCounterMsr(pCounter));
+
+        // the counter wraps around at its width
+        delta = (value - Cpu->LastValues[i]) & _PmuGetCounterMask(pCounter);
+        Cpu->LastValues[i] = value;
+
+        Cpu->Counts[i] = Cpu->Counts[i] + delta;
+
+        if (NULL != ThreadCounters)
+        {
+            ThreadCounters->Counts[i] = ThreadCounters->Counts[i] + delta;
+        }
+    }
+}
+
+static
+void
+_PmuStopCounters(
+    void
+    )
+{
+    STATUS status;
+    SMP_DESTINATION dest = { 0 };
+
+    m_pmuData.Running = FALSE;
+
+    status = SmpSendGenericIpiEx(_PmuProgramCountersIpi,
+                                 NULL,
+                                 NULL,
+                                 NULL,
+                                 TRUE,
+                                 SmpIpiSendToAllIncludingSelf,
+                                 dest);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("SmpSendGenericIpiEx", status);
+    }
+
+    if (PmuModeSampling == m_pmuData.Mode)
+    {
+        ProfilerStop();
+    }
+}
@@ -0,0 +1,378 @@
+#include "HAL9000.h"
+#include "pool_stats.h"
+#include "cpumu.h"
+#include "smp.h"
+#include "mmu.h"
+
+// the last slot accounts the tags which did not fit in the table
+#define POOL_STATS_OVERFLOW_SLOT            POOL_STATS_MAX_TAGS
+#define POOL_STATS_NO_OF_SLOTS              (POOL_STATS_MAX_TAGS + 1)
+
+typedef struct _POOL_STATS_COUNTERS
+{
+    QWORD                   Allocations;
+    QWORD                   Frees;
+    QWORD                   BytesAllocated;
+    QWORD                   BytesFreed;
+
+    QWORD                   SizeClasses[POOL_STATS_SIZE_CLASSES];
+} POOL_STATS_COUNTERS, *PPOOL_STATS_COUNTERS;
+
+typedef struct _POOL_STATS_CPU
+{
+    // indexed by the slot of the tag
+    POOL_STATS_COUNTERS     Counters[POOL_STATS_NO_OF_SLOTS];
+} POOL_STATS_CPU, *PPOOL_STATS_CPU;
+
+typedef struct _POOL_STATS_TAG_SLOT
+{
+    // 0 while the slot is free, once claimed it never changes
+    _Interlocked_
+    volatile DWORD          Tag;
+
+    // The peak needs the live bytes of all the CPUs at the moment of each
+    // allocation, so these are the only counters shared between the CPUs
+    _Interlocked_
+    volatile INT64          LiveBytes;
+
+    _Interlocked_
+    volatile INT64          PeakBytes;
+} POOL_STATS_TAG_SLOT, *PPOOL_STATS_TAG_SLOT;
+
+typedef struct _POOL_STATS_DATA
+{
+    POOL_STATS_TAG_SLOT     Slots[POOL_STATS_NO_OF_SLOTS];
+
+    // used by the CPUs whose counters are not yet allocated, these are the
+    // only per-CPU counters updated with interlocked operations
+    POOL_STATS_CPU          SharedCounters;
+
+    QWORD                   CheckpointSequence;
+} POOL_STATS_DATA, *PPOOL_STATS_DATA;
+
+static POOL_STATS_DATA m_poolStatsData;
+
+static
+DWORD
+_PoolStatsGetSlot(
+    IN      DWORD                   Tag
+    );
+
+static
+void
+_PoolStatsAccumulate(
+    INOUT   PPOOL_TAG_STATS         Stats,
+    IN      PPOOL_STATS_COUNTERS    Counters
+    );
+
+static
+__forceinline
+DWORD
+_PoolStatsGetSizeClass(
+    IN      DWORD                   Size
+    )
+{
+    DWORD sizeClass;
+
+    for (sizeClass = 0;
+         sizeClass < POOL_STATS_SIZE_CLASSES - 1 && Size > POOL_STATS_SIZE_CLASS_LIMIT(sizeClass);
+         ++sizeClass);
+
+    return sizeClass;
+}
+
+static
+__forceinline
+void
+_PoolStatsAdd(
+    INOUT   volatile QWORD*         Counter,
+    IN      QWORD                   Value,
+    IN      BOOLEAN                 Shared
+    )
+{
+    if (Shared)
+    {
+        _InterlockedExchangeAdd64(Counter, Value);
+    }
+    else
+    {
+        *Counter = *Counter + Value;
+    }
+}
+
+static
+__forceinline
+PPOOL_STATS_COUNTERS
+_PoolStatsGetCurrentCounters(
+    IN      DWORD                   Slot,
+    OUT     BOOLEAN*                Shared
+    )
+{
+    PPCPU pCpu;
+
+    ASSERT(Slot < POOL_STATS_NO_OF_SLOTS);
+    ASSERT(NULL != Shared);
+
+    pCpu = GetCurrentPcpu();
+
+    *Shared = (NULL == pCpu || NULL == pCpu->PoolStats);
+
+    return *Shared ? &m_poolStatsData.SharedCounters.Counters[Slot] : &pCpu->PoolStats->Counters[Slot];
+}
+
+_No_competing_thread_
+void
+PoolStatsPreinit(
+    void
+    )
+{
+    memzero(&m_poolStatsData, sizeof(POOL_STATS_DATA));
+}
+
+STATUS
+PoolStatsInitCpu(
+    INOUT   PPCPU                   Cpu
+    )
+{
+    PPOOL_STATS_CPU pStats;
+
+    ASSERT(NULL != Cpu);
+    ASSERT(NULL == Cpu->PoolStats);
+
+    pStats = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(POOL_STATS_CPU), HEAP_POOL_STATS_TAG, 0);
+    if (NULL == pStats)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(POOL_STATS_CPU));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    Cpu->PoolStats = pStats;
+
+    return STATUS_SUCCESS;
+}
+
+void
+PoolStatsRecordAllocation(
+    IN      DWORD                   Tag,
+    IN      DWORD                   Size
+    )
+{
+    PPOOL_STATS_TAG_SLOT pSlot;
+    PPOOL_STATS_COUNTERS pCounters;
+    BOOLEAN bShared;
+    DWORD slot;
+    INT64 liveBytes;
+    INT64 peakBytes;
+    INT64 previousPeak;
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    slot = _PoolStatsGetSlot(Tag);
+    pSlot = &m_poolStatsData.Slots[slot];
+    pCounters = _PoolStatsGetCurrentCounters(slot, &bShared);
+
+    _PoolStatsAdd(&pCounters->Allocations, 1, bShared);
+    _PoolStatsAdd(&pCounters->BytesAllocated, Size, bShared);
+    _PoolStatsAdd(&pCounters->SizeClasses[_PoolStatsGetSizeClass(Size)], 1, bShared);
+
+    liveBytes = _InterlockedExchangeAdd64(&pSlot->LiveBytes, Size) + Size;
+
+    peakBytes = pSlot->PeakBytes;
+    while (liveBytes > peakBytes)
+    {
+        previousPeak = _InterlockedCompareExchange64(&pSlot->PeakBytes, liveBytes, peakBytes);
+        if (previousPeak == peakBytes)
+        {
+            break;
+        }
+
+        peakBytes = previousPeak;
+    }
+}
+
+void
+PoolStatsRecordFree(
+    IN      DWORD                   Tag,
+    IN      DWORD                   Size
+    )
+{
+    PPOOL_STATS_COUNTERS pCounters;
+    BOOLEAN bShared;
+    DWORD slot;
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    slot = _PoolStatsGetSlot(Tag);
+    pCounters = _PoolStatsGetCurrentCounters(slot, &bShared);
+
+    _PoolStatsAdd(&pCounters->Frees, 1, bShared);
+    _PoolStatsAdd(&pCounters->BytesFreed, Size, bShared);
+
+    _InterlockedExchangeAdd64(&m_poolStatsData.Slots[slot].LiveBytes, -(INT64)Size);
+}
+
+void
+PoolStatsRetrieve(
+    IN      DWORD                   MaxEntries,
+    OUT_WRITES_TO(MaxEntries, *NumberOfEntries)
+            PPOOL_TAG_STATS         Entries,
+    OUT     DWORD*                  NumberOfEntries
+    )
+{
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    POOL_TAG_STATS stats;
+    DWORD noOfEntries;
+    DWORD slot;
+    DWORD i;
+
+    ASSERT(NULL != Entries);
+    ASSERT(NULL != NumberOfEntries);
+
+    pCpuListHead = NULL;
+    noOfEntries = 0;
+
+    SmpGetCpuList(&pCpuListHead);
+
+    for (slot = 0; slot < POOL_STATS_NO_OF_SLOTS; ++slot)
+    {
+        memzero(&stats, sizeof(POOL_TAG_STATS));
+
+        stats.Tag = m_poolStatsData.Slots[slot].Tag;
+        stats.PeakBytes = m_poolStatsData.Slots[slot].PeakBytes;
+
+        if (0 == stats.Tag && POOL_STATS_OVERFLOW_SLOT != slot)
+        {
+            continue;
+        }
+
+        _PoolStatsAccumulate(&stats, &m_poolStatsData.SharedCounters.Counters[slot]);
+
+        for (pCurEntry = pCpuListHead->Flink;
+             pCurEntry != pCpuListHead;
+             pCurEntry = pCurEntry->Flink)
+        {
+            PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+
+            if (NULL != pCpu->PoolStats)
+            {
+                _PoolStatsAccumulate(&stats, &pCpu->PoolStats->Counters[slot]);
+            }
+        }
+
+        if (0 == stats.Allocations)
+        {
+            continue;
+        }
+
+        // keep the entries ordered by the live bytes, when the array is full
+        // the entry with the fewest live bytes is dropped
+        if (noOfEntries == MaxEntries)
+        {
+            if (0 == MaxEntries || Entries[MaxEntries - 1].LiveBytes >= stats.LiveBytes)
+            {
+                continue;
+            }
+
+            noOfEntries--;
+        }
+
+        for (i = noOfEntries; i > 0 && Entries[i - 1].LiveBytes < stats.LiveBytes; --i)
+        {
+            Entries[i] = Entries[i - 1];
+        }
+
+        Entries[i] = stats;
+        noOfEntries++;
+    }
+
+    *NumberOfEntries = noOfEntries;
+}
+
+void
+PoolStatsCheckpoint(
+    void
+    )
+{
+    m_poolStatsData.CheckpointSequence = MmuGetPoolAllocationSequence();
+}
+
+QWORD
+PoolStatsRetrieveLeaks(
+    IN      QWORD                   UntilSequence,
+    IN      DWORD                   MaxAllocations,
+    OUT_WRITES_OPT(MaxAllocations)
+            PHEAP_ALLOCATION_INFO   Allocations
+    )
+{
+    return MmuRetrievePoolAllocations(m_poolStatsData.CheckpointSequence,
+                                      UntilSequence,
+                                      MaxAllocations,
+                                      Allocations
+                                      );
+}
+
+static
+DWORD
+_PoolStatsGetSlot(
+    IN      DWORD                   Tag
+    )
+{
+    DWORD start;
+    DWORD slot;
+    DWORD curTag;
+    DWORD i;
+
+    ASSERT(0 != Tag);
+
+    // Fibonacci hashing, the tags are ASCII so their low bits are similar
+    start = (DWORD) (((QWORD) Tag * 0x9E3779B9ULL) >> 16);
+
+    for (i = 0; i < POOL_STATS_MAX_TAGS; ++i)
+    {
+        slot = (start + i) & (POOL_STATS_MAX_TAGS - 1);
+
+        curTag = m_poolStatsData.Slots[slot].Tag;
+        if (0 == curTag)
+        {
+            curTag = _InterlockedCompareExchange(&m_poolStatsData.Slots[slot].Tag, Tag, 0);
+            if (0 == curTag)
+            {
+                return slot;
+            }
+        }
+
+        if (Tag == curTag)
+        {
+            return slot;
+        }
+    }
+
+    return POOL_STATS_OVERFLOW_SLOT;
+}
+
+static
+void
+_PoolStatsAccumulate(
+    INOUT   PPOOL_TAG_STATS         Stats,
+    IN      PPOOL_STATS_COUNTERS    Counters
+    )
+{
+    DWORD i;
+
+    ASSERT(NULL != Stats);
+    ASSERT(NULL != Counters);
+
+    Stats->Allocations = Stats->Allocations + Counters->Allocations;
+    Stats->Frees = Stats->Frees + Counters->Frees;
+    Stats->BytesAllocated = Stats->BytesAllocated + Counters->BytesAllocated;
+
+    // computed from the same counters as the rest of the fields, the shared
+    // live bytes may have changed since they were read
+    Stats->LiveBytes = Stats->LiveBytes + Counters->BytesAllocated - Counters->BytesFreed;
+
+    for (i = 0; i < POOL_STATS_SIZE_CLASSES; ++i)
+    {
+        Stats->SizeClasses[i] = Stats->SizeClasses[i] + Counters->SizeClasses[i];
+    }
+}
@@ -4,6 +4,7 @@
 #include "process_internal.h"
 #include "vmm.h"
 #include "um_application.h"
+#include "um_net_ring.h"
 #include "bitmap.h"
 #include "pte.h"
 #include "pe_exports.h"
@@ -457,6 +458,11 @@ _ProcessInit(
 
         RfcPreInit(&pProcess->RefCnt);
 
+        // _ProcessDestroy walks this list, it must be valid before the
+        // process can be destroyed
+        InitializeListHead(&pProcess->NetRingList);
+        LockInit(&pProcess->NetRingListLock);
+
         status = RfcInit(&pProcess->RefCnt, _ProcessDestroy, NULL);
         if (!SUCCEEDED(status))
         {
@@ -748,6 +754,10 @@ _ProcessDestroy(
         Process->HeaderInfo = NULL;
     }
 
+    // The rings are mapped in the address space of the process, they must
+    // be unmapped while it still exists
+    UmNetRingCloseAll(Process);
+
     // Because the system process will never be destroyed it is ok to free
     // these memory addresses unconditionally
     MmuDestroyAddressSpaceForProcess(Process);
@@ -0,0 +1,677 @@
+#include "HAL9000.h"
+#include "profiler.h"
+#include "cpumu.h"
+#include "smp.h"
+#include "mutex.h"
+#include "isr.h"
+#include "gdtmu.h"
+#include "lapic_system.h"
+#include "thread_internal.h"
+#include "process_internal.h"
+#include "pe_parser.h"
+
+// must be a power of 2
+#define PROFILER_SAMPLES_PER_CPU        4096
+STATIC_ASSERT(0 == (PROFILER_SAMPLES_PER_CPU & (PROFILER_SAMPLES_PER_CPU - 1)));
+
+#define PROFILER_MAX_FRAMES             4
+
+// how much of the interrupted stack is searched for return addresses
+#define PROFILER_STACK_SCAN_SIZE        (64 * sizeof(QWORD))
+
+#define PROFILER_MAX_SECTIONS           16
+
+// must be a power of 2
+#define PROFILER_HASH_ENTRIES           4096
+STATIC_ASSERT(0 == (PROFILER_HASH_ENTRIES & (PROFILER_HASH_ENTRIES - 1)));
+
+typedef struct _PROFILER_SAMPLE
+{
+    QWORD                   Rip;
+    TID                     ThreadId;
+
+    BOOLEAN                 UserMode;
+    BYTE                    NumberOfFrames;
+
+    QWORD                   Frames[PROFILER_MAX_FRAMES];
+} PROFILER_SAMPLE, *PPROFILER_SAMPLE;
+
+typedef struct _PROFILER_BUFFER
+{
+    // written only by the timer interrupt of the CPU owning the buffer, the
+    // newest PROFILER_SAMPLES_PER_CPU samples are kept
+    QWORD                   NumberOfSamples;
+
+    PROFILER_SAMPLE         Samples[PROFILER_SAMPLES_PER_CPU];
+} PROFILER_BUFFER, *PPROFILER_BUFFER;
+
+typedef struct _PROFILER_HASH_ENTRY
+{
+    BOOLEAN                 Used;
+
+    PROFILER_HISTOGRAM_ENTRY    Entry;
+} PROFILER_HASH_ENTRY, *PPROFILER_HASH_ENTRY;
+
+typedef struct _PROFILER_DATA
+{
+    // serializes ProfilerStart, ProfilerStop and ProfilerBuildHistogram
+    MUTEX                   Lock;
+
+    volatile BOOLEAN        Running;
+
+    // the kernel image layout, retrieved by the first ProfilerStart
+    PPE_NT_HEADER_INFO      KernelInfo;
+    DWORD                   NumberOfSections;
+    PE_SECTION_INFO         Sections[PROFILER_MAX_SECTIONS];
+} PROFILER_DATA, *PPROFILER_DATA;
+
+static PROFILER_DATA m_profilerData;
+
+static FUNC_IpcProcessEvent _ProfilerSetTimerIpi;
+
+static
+STATUS
+_ProfilerRetrieveKernelLayout(
+    void
+    );
+
+static
+void
+_ProfilerCaptureBacktrace(
+    IN      PTHREAD                 Thread,
+    IN      QWORD                   Rsp,
+    INOUT   PPROFILER_SAMPLE        Sample
+    );
+
+static
+BOOLEAN
+_ProfilerIsKernelCode(
+    IN      QWORD                   Address
+    );
+
+static
+QWORD
+_ProfilerRetrieveSymbolKey(
+    IN      QWORD                   Address
+    );
+
+static
+PPROFILER_HASH_ENTRY
+_ProfilerHashLookup(
+    INOUT   PPROFILER_HASH_ENTRY    Table,
+    IN      QWORD                   Key
+    );
+
+_No_competing_thread_
+void
+ProfilerSystemPreinit(
+    void
+    )
+{
+    memzero(&m_profilerData, sizeof(PROFILER_DATA));
+
+    MutexInit(&m_profilerData.Lock, FALSE);
+}
+
+STATUS
+ProfilerStart(
+    IN      DWORD                   FrequencyHz
+    )
+{
+    STATUS status;
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    SMP_DESTINATION dest = { 0 };
+
+    if (FrequencyHz > PROFILER_MAX_FREQUENCY_HZ)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    status = STATUS_SUCCESS;
+    pCpuListHead = NULL;
+
+    SmpGetCpuList(&pCpuListHead);
+
+    MutexAcquire(&m_profilerData.Lock);
+
+    __try
+    {
+        if (m_profilerData.Running)
+        {
+            status = STATUS_DEVICE_BUSY;
+            __leave;
+        }
+
+        if (NULL == m_profilerData.KernelInfo)
+        {
+            status = _ProfilerRetrieveKernelLayout();
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_ProfilerRetrieveKernelLayout", status);
+                __leave;
+            }
+        }
+
+        for (pCurEntry = pCpuListHead->Flink;
+             pCurEntry != pCpuListHead;
+             pCurEntry = pCurEntry->Flink)
+        {
+            PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+
+            if (NULL == pCpu->ProfilerBuffer)
+            {
+                pCpu->ProfilerBuffer = ExAllocatePoolWithTag(0, sizeof(PROFILER_BUFFER), HEAP_PROFILER_TAG, 0);
+                if (NULL == pCpu->ProfilerBuffer)
+                {
+                    LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PROFILER_BUFFER));
+                    status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+                    __leave;
+                }
+            }
+
+            // no timer is running, nobody else touches the buffer
+            pCpu->ProfilerBuffer->NumberOfSamples = 0;
+        }
+
+        m_profilerData.Running = TRUE;
+
+        if (PROFILER_FREQUENCY_EXTERNAL == FrequencyHz)
+        {
+            __leave;
+        }
+
+        status = SmpSendGenericIpiEx(_ProfilerSetTimerIpi,
+                                     (PVOID) (QWORD) (SEC_IN_US / FrequencyHz),
+                                     NULL,
+                                     NULL,
+                                     TRUE,
+                                     SmpIpiSendToAllIncludingSelf,
+                                     dest);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("SmpSendGenericIpiEx", status);
+            m_profilerData.Running = FALSE;
+            __leave;
+        }
+    }
+    __finally
+    {
+        MutexRelease(&m_profilerData.Lock);
+    }
+
+    return status;
+}
+
+void
+ProfilerStop(
+    void
+    )
+{
+    STATUS status;
+    SMP_DESTINATION dest = { 0 };
+
+    MutexAcquire(&m_profilerData.Lock);
+
+    if (m_profilerData.Running)
+    {
+        // a timer interrupt already pending is ignored
+        m_profilerData.Running = FALSE;
+
+        status = SmpSendGenericIpiEx(_ProfilerSetTimerIpi,
+                                     (PVOID) 0,
+                                     NULL,
+                                     NULL,
+                                     TRUE,
+                                     SmpIpiSendToAllIncludingSelf,
+                                     dest);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("SmpSendGenericIpiEx", status);
+        }
+    }
+
+    MutexRelease(&m_profilerData.Lock);
+}
+
+void
+ProfilerTakeSample(
+    void
+    )
+{
+    PPCPU pCpu;
+    PTHREAD pThread;
+    PPROFILER_BUFFER pBuffer;
+    PPROFILER_SAMPLE pSample;
+    PINTERRUPT_STACK_COMPLETE pStack;
+
+    ASSERT(INTR_OFF == CpuIntrGetState());
+
+    if (!m_profilerData.Running)
+    {
+        return;
+    }
+
+    pCpu = GetCurrentPcpu();
+    ASSERT(NULL != pCpu);
+
+    pBuffer = pCpu->ProfilerBuffer;
+    pStack = pCpu->InterruptStack;
+    if (NULL == pBuffer || NULL == pStack)
+    {
+        return;
+    }
+
+    pThread = GetCurrentThread();
+
+    pSample = &pBuffer->Samples[pBuffer->NumberOfSamples & (PROFILER_SAMPLES_PER_CPU - 1)];
+
+    pSample->Rip = pStack->Registers.Rip;
+    pSample->ThreadId = (NULL != pThread) ? pThread->Id : 0;
+    pSample->UserMode = (RING_THREE_PL == (pStack->Registers.CS & RING_THREE_PL));
+    pSample->NumberOfFrames = 0;
+
+    if (!pSample->UserMode && NULL != pThread)
+    {
+        _ProfilerCaptureBacktrace(pThread, pStack->Registers.Rsp, pSample);
+    }
+
+    pBuffer->NumberOfSamples++;
+}
+
+STATUS
+ProfilerBuildHistogram(
+    IN      PROFILER_HISTOGRAM_TYPE Type,
+    IN      DWORD                   MaxEntries,
+    OUT_WRITES_TO(MaxEntries, *NumberOfEntries)
+            PPROFILER_HISTOGRAM_ENTRY   Entries,
+    OUT     DWORD*                  NumberOfEntries,
+    OUT     PPROFILER_SUMMARY       Summary
+    )
+{
+    STATUS status;
+    PPROFILER_HASH_ENTRY pTable;
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    DWORD noOfEntries;
+    DWORD i;
+
+    if (Type >= ProfilerHistogramReserved)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (0 == MaxEntries)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Entries)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (NULL == NumberOfEntries)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (NULL == Summary)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    status = STATUS_SUCCESS;
+    pCpuListHead = NULL;
+    noOfEntries = 0;
+    memzero(Summary, sizeof(PROFILER_SUMMARY));
+
+    pTable = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(PROFILER_HASH_ENTRY) * PROFILER_HASH_ENTRIES, HEAP_PROFILER_TAG, 0);
+    if (NULL == pTable)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PROFILER_HASH_ENTRY) * PROFILER_HASH_ENTRIES);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    SmpGetCpuList(&pCpuListHead);
+
+    MutexAcquire(&m_profilerData.Lock);
+
+    __try
+    {
+        if (m_profilerData.Running)
+        {
+            status = STATUS_DEVICE_BUSY;
+            __leave;
+        }
+
+        for (pCurEntry = pCpuListHead->Flink;
+             pCurEntry != pCpuListHead;
+             pCurEntry = pCurEntry->Flink)
+        {
+            PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+            PPROFILER_BUFFER pBuffer = pCpu->ProfilerBuffer;
+            QWORD noOfSamples;
+
+            if (NULL == pBuffer)
+            {
+                continue;
+            }
+
+            noOfSamples = min(pBuffer->NumberOfSamples, PROFILER_SAMPLES_PER_CPU);
+            Summary->SamplesLost += pBuffer->NumberOfSamples - noOfSamples;
+
+            for (QWORD j = 0; j < noOfSamples; ++j)
+            {
+                PPROFILER_SAMPLE pSample = &pBuffer->Samples[j];
+                QWORD keys[1 + PROFILER_MAX_FRAMES];
+                DWORD noOfKeys;
+
+                Summary->Samples++;
+                if (pSample->UserMode)
+                {
+                    Summary->UserModeSamples++;
+                }
+
+                noOfKeys = 0;
+                if (ProfilerHistogramThreads == Type)
+                {
+                    keys[noOfKeys++] = pSample->ThreadId;
+                }
+                else
+                {
+                    keys[noOfKeys++] = _ProfilerRetrieveSymbolKey(pSample->Rip);
+
+                    for (BYTE k = 0; k < pSample->NumberOfFrames; ++k)
+                    {
+                        QWORD key = _ProfilerRetrieveSymbolKey(pSample->Frames[k]);
+                        BOOLEAN bDuplicate = FALSE;
+
+                        // recursive functions are counted only once per sample
+                        for (DWORD l = 0; l < noOfKeys; ++l)
+                        {
+                            bDuplicate = bDuplicate || (keys[l] == key);
+                        }
+
+                        if (!bDuplicate)
+                        {
+                            keys[noOfKeys++] = key;
+                        }
+                    }
+                }
+
+                for (DWORD k = 0; k < noOfKeys; ++k)
+                {
+                    PPROFILER_HASH_ENTRY pEntry = _ProfilerHashLookup(pTable, keys[k]);
+
+                    if (NULL == pEntry)
+                    {
+                        if (0 == k)
+                        {
+                            Summary->SamplesNotAccounted++;
+                        }
+                        continue;
+                    }
+
+                    pEntry->Entry.TotalSamples++;
+                    if (0 == k)
+                    {
+                        pEntry->Entry.SelfSamples++;
+                    }
+                }
+            }
+        }
+
+        // partial selection sort, MaxEntries is expected to be small
+        // the entries are ranked by their total samples so the functions which
+        // are only found in the backtraces (callers) are not left out, the
+        // self samples break the ties
+        for (noOfEntries = 0; noOfEntries < MaxEntries; ++noOfEntries)
+        {
+            PPROFILER_HASH_ENTRY pBest = NULL;
+
+            for (i = 0; i < PROFILER_HASH_ENTRIES; ++i)
+            {
+                if (!pTable[i].Used)
+                {
+                    continue;
+                }
+
+                if (NULL == pBest ||
+                    pTable[i].Entry.TotalSamples > pBest->Entry.TotalSamples ||
+                    (pTable[i].Entry.TotalSamples == pBest->Entry.TotalSamples &&
+                     pTable[i].Entry.SelfSamples > pBest->Entry.SelfSamples))
+                {
+                    pBest = &pTable[i];
+                }
+            }
+
+            if (NULL == pBest || 0 == pBest->Entry.TotalSamples)
+            {
+                break;
+            }
+
+            memcpy(&Entries[noOfEntries], &pBest->Entry, sizeof(PROFILER_HISTOGRAM_ENTRY));
+            pBest->Used = FALSE;
+        }
+    }
+    __finally
+    {
+        MutexRelease(&m_profilerData.Lock);
+
+        ExFreePoolWithTag(pTable, HEAP_PROFILER_TAG);
+    }
+
+    *NumberOfEntries = noOfEntries;
+
+    return status;
+}
+
+void
+ProfilerResolveSymbol(
+    IN      PVOID                   Address,
+    OUT_WRITES_Z(BufferSize)
+            char*                   Buffer,
+    IN      DWORD                   BufferSize
+    )
+{
+    STATUS status;
+    PE_EXPORT_INFO exportInfo;
+    PPE_NT_HEADER_INFO pKernelInfo;
+
+    ASSERT(NULL != Buffer);
+    ASSERT(0 != BufferSize);
+
+    pKernelInfo = m_profilerData.KernelInfo;
+
+    if (NULL == pKernelInfo || !CHECK_BOUNDS(Address, 1, pKernelInfo->ImageBase, pKernelInfo->Size))
+    {
+        snprintf(Buffer, BufferSize, "0x%X", Address);
+        return;
+    }
+
+    status = PeRetrieveNearestExport(pKernelInfo, Address, &exportInfo);
+    if (SUCCEEDED(status))
+    {
+        snprintf(Buffer, BufferSize, "%s+0x%X", exportInfo.Name, PtrDiff(Address, exportInfo.Address));
+        return;
+    }
+
+    for (DWORD i = 0; i < m_profilerData.NumberOfSections; ++i)
+    {
+        PPE_SECTION_INFO pSection = &m_profilerData.Sections[i];
+
+        if (CHECK_BOUNDS(Address, 1, pSection->BaseAddress, pSection->Size))
+        {
+            snprintf(Buffer, BufferSize, "%s+0x%X", pSection->Name, PtrDiff(Address, pSection->BaseAddress));
+            return;
+        }
+    }
+
+    snprintf(Buffer, BufferSize, "HAL9000+0x%X", PtrDiff(Address, pKernelInfo->ImageBase));
+}
+
+static
+STATUS
+(__cdecl _ProfilerSetTimerIpi)(
+    IN_OPT  PVOID   Context
+    )
+{
+    // 0 stops the timer
+    LapicSystemSetTimer((DWORD) (QWORD) Context);
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+_ProfilerRetrieveKernelLayout(
+    void
+    )
+{
+    STATUS status;
+    PPE_NT_HEADER_INFO pKernelInfo;
+    DWORD i;
+
+    pKernelInfo = ProcessRetrieveSystemProcess()->HeaderInfo;
+    ASSERT(NULL != pKernelInfo);
+
+    if (pKernelInfo->NumberOfSections > PROFILER_MAX_SECTIONS)
+    {
+        LOG_ERROR("The kernel has %u sections, only %u are supported\n",
+                  pKernelInfo->NumberOfSections, PROFILER_MAX_SECTIONS);
+        return STATUS_UNSUPPORTED;
+    }
+
+    for (i = 0; i < pKernelInfo->NumberOfSections; ++i)
+    {
+        status = PeRetrieveSection(pKernelInfo, i, &m_profilerData.Sections[i]);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PeRetrieveSection", status);
+            return status;
+        }
+    }
+
+    m_profilerData.NumberOfSections = pKernelInfo->NumberOfSections;
+    m_profilerData.KernelInfo = pKernelInfo;
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_ProfilerCaptureBacktrace(
+    IN      PTHREAD                 Thread,
+    IN      QWORD                   Rsp,
+    INOUT   PPROFILER_SAMPLE        Sample
+    )
+{
+    QWORD stackBase;
+    QWORD stackLimit;
+    QWORD* pCurrentItem;
+    QWORD* pLastItem;
+
+    ASSERT(NULL != Thread);
+    ASSERT(NULL != Sample);
+
+    stackBase = (QWORD) Thread->InitialStackBase;
+    stackLimit = stackBase - Thread->StackSize;
+
+    // the interrupt may have come while switching stacks
+    if (Rsp < stackLimit || Rsp >= stackBase)
+    {
+        return;
+    }
+
+    // The kernel is not built with frame pointers so there is no RBP chain
+    // to follow, the return addresses are the stack values pointing inside an
+    // executable section of the kernel. The live part of the stack is already
+    // mapped so the scan cannot fault.
+    pCurrentItem = (QWORD*) AlignAddressUpper(Rsp, sizeof(QWORD));
+    pLastItem = (QWORD*) min(stackBase, Rsp + PROFILER_STACK_SCAN_SIZE);
+
+    for (; pCurrentItem < pLastItem && Sample->NumberOfFrames < PROFILER_MAX_FRAMES; ++pCurrentItem)
+    {
+        if (_ProfilerIsKernelCode(*pCurrentItem))
+        {
+            Sample->Frames[Sample->NumberOfFrames++] = *pCurrentItem;
+        }
+    }
+}
+
+static
+BOOLEAN
+_ProfilerIsKernelCode(
+    IN      QWORD                   Address
+    )
+{
+    for (DWORD i = 0; i < m_profilerData.NumberOfSections; ++i)
+    {
+        PPE_SECTION_INFO pSection = &m_profilerData.Sections[i];
+
+        if (IsBooleanFlagOn(pSection->Characteristics, IMAGE_SCN_MEM_EXECUTE) &&
+            CHECK_BOUNDS(Address, 1, pSection->BaseAddress, pSection->Size))
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static
+QWORD
+_ProfilerRetrieveSymbolKey(
+    IN      QWORD                   Address
+    )
+{
+    PE_EXPORT_INFO exportInfo;
+    PPE_NT_HEADER_INFO pKernelInfo;
+
+    pKernelInfo = m_profilerData.KernelInfo;
+
+    // without an export the samples can only be grouped by address
+    if (NULL != pKernelInfo &&
+        CHECK_BOUNDS(Address, 1, pKernelInfo->ImageBase, pKernelInfo->Size) &&
+        SUCCEEDED(PeRetrieveNearestExport(pKernelInfo, (PVOID) Address, &exportInfo)))
+    {
+        return (QWORD) exportInfo.Address;
+    }
+
+    return Address;
+}
+
+static
+PPROFILER_HASH_ENTRY
+_ProfilerHashLookup(
+    INOUT   PPROFILER_HASH_ENTRY    Table,
+    IN      QWORD                   Key
+    )
+{
+    DWORD index;
+
+    ASSERT(NULL != Table);
+
+    // Fibonacci hashing, the low bits of code addresses are not well spread
+    index = (DWORD) ((Key * 0x9E3779B97F4A7C15ULL) >> 32);
+
+    for (DWORD i = 0; i < PROFILER_HASH_ENTRIES; ++i)
+    {
+        PPROFILER_HASH_ENTRY pEntry = &Table[(index + i) & (PROFILER_HASH_ENTRIES - 1)];
+
+        if (!pEntry->Used)
+        {
+            pEntry->Used = TRUE;
+            pEntry->Entry.Key = Key;
+            return pEntry;
+        }
+
+        if (pEntry->Entry.Key == Key)
+        {
+            return pEntry;
+        }
+    }
+
+    return NULL;
+}
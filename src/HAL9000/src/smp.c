@@ -9,6 +9,7 @@
 #include "io.h"
 #include "ex_event.h"
 #include "hw_fpu.h"
+#include "profiler.h"
 
 extern void ApAsmStub();
 
@@ -22,6 +23,39 @@ STATIC_ASSERT(SmpIpiSendToSelf == ApicDestinationShorthandSelf);
 STATIC_ASSERT(SmpIpiSendToAllIncludingSelf == ApicDestinationShorthandAll);
 STATIC_ASSERT(SmpIpiSendToAllExcludingSelf == ApicDestinationShorthandAllExcludingSelf);
 
+#define SMP_CACHE_LINE_SIZE                     64
+
+#pragma warning(push)
+
+// warning C4324: structure was padded due to alignment specifier
+#pragma warning(disable:4324)
+
+// Broadcasts to all the CPUs except the sender share a single payload, only
+// one of them can be in progress at a time
+typedef struct _SMP_BROADCAST
+{
+    // set by the sender which owns the payload, cleared once all the CPUs
+    // have executed the function
+    volatile DWORD          Busy;
+
+    PFUNC_IpcProcessEvent   Function;
+    PVOID                   Context;
+    PFUNC_FreeFunction      FreeFunction;
+    PVOID                   FreeContext;
+    BOOLEAN                 WaitForHandling;
+
+    // number of CPUs which did not execute the function yet
+    volatile DWORD          PendingCpus;
+
+    // set by the last CPU if the sender waits for the handling, on its own
+    // cache line so the sender spinning on it does not slow down the updates
+    // of PendingCpus
+    __declspec(align(SMP_CACHE_LINE_SIZE))
+    volatile BOOLEAN        Completed;
+} SMP_BROADCAST, *PSMP_BROADCAST;
+
+#pragma warning(pop)
+
 typedef struct _SMP_DATA
 {
     RW_SPINLOCK             CpuLock;
@@ -38,9 +72,11 @@ typedef struct _SMP_DATA
     BYTE                    ApicTimerVector;
     BYTE                    IpcIpiVector;
     BYTE                    AssertIpiVector;
+    BYTE                    BroadcastIpiVector;
 } SMP_DATA, *PSMP_DATA;
 
 static SMP_DATA m_smpData;
+static SMP_BROADCAST m_smpBroadcast;
 
 __forceinline
 STATUS
@@ -146,6 +182,25 @@ _SmpRetrieveMatchingCpus(
     OUT     DWORD*                  NumberOfCpusMatching
     );
 
+static
+BOOLEAN
+_SmpQueueIpcEvent(
+    INOUT   PIPC_EVENT              Event,
+    IN _Strict_type_match_
+            SMP_IPI_SEND_MODE       SendMode,
+    IN      SMP_DESTINATION         Destination
+    );
+
+static
+STATUS
+_SmpSendBroadcastIpi(
+    IN      PFUNC_IpcProcessEvent   BroadcastFunction,
+    IN_OPT  PVOID                   Context,
+    IN_OPT  PFUNC_FreeFunction      FreeFunction,
+    IN_OPT  PVOID                   FreeContext,
+    IN      BOOLEAN                 WaitForHandling
+    );
+
 static
 void
 _SmpSetupInitialApStack(
@@ -157,6 +212,7 @@ _SmpSetupInitialApStack(
 static FUNC_InterruptFunction       _SmpApicTimerIsr;
 static FUNC_InterruptFunction       _SmpAssertIpiIsr;
 static FUNC_InterruptFunction       _SmpIpcIpiIsr;
+static FUNC_InterruptFunction       _SmpBroadcastIpiIsr;
 
 _No_competing_thread_
 void
@@ -165,6 +221,7 @@ SmpPreinit(
     )
 {
     memzero(&m_smpData, sizeof(SMP_DATA));
+    memzero(&m_smpBroadcast, sizeof(SMP_BROADCAST));
 
     InitializeListHead(&m_smpData.CpuList);
     RwSpinlockInit(&m_smpData.CpuLock);
@@ -230,6 +287,13 @@ SmpInit(
 
     LOGL("The system has %u CPUs\n", m_smpData.NoOfCpus );
 
+    status = IpcInit(m_smpData.NoOfCpus);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("IpcInit", status);
+        return status;
+    }
+
     return status;
 }
 
@@ -404,14 +468,10 @@ SmpSendGenericIpiEx(
             SMP_DESTINATION         Destination
     )
 {
-    PIPC_EVENT_CPU pCpuEvents;
+    PIPC_EVENT pEvent;
     STATUS status;
     DWORD noOfMatchingCpus;
-    DWORD i;
-    PPCPU* pMatchingCpus;
-    DWORD tempResult;
     BOOLEAN bSelfInDestination;
-    APIC_ID apicId;
 
     LOG_FUNC_START;
 
@@ -425,9 +485,28 @@ SmpSendGenericIpiEx(
         return STATUS_INVALID_PARAMETER6;
     }
 
+    if (SmpIpiSendToAllExcludingSelf == SendMode)
+    {
+        if (WaitForHandling)
+        {
+            /// the sender spins until the other CPUs handle the broadcast, if
+            /// one of them is itself waiting for us to handle an event we must
+            /// be able to take its IPI: INTERRUPTS must be turned ON and our
+            /// processor priority strictly below IrqlIpiLevel
+            ASSERT(INTR_ON == CpuIntrGetState());
+            ASSERT(LapicSystemGetPpr() < IrqlIpiLevel);
+        }
+
+        return _SmpSendBroadcastIpi(BroadcastFunction,
+                                    Context,
+                                    FreeFunction,
+                                    FreeContext,
+                                    WaitForHandling
+                                    );
+    }
+
     status = STATUS_SUCCESS;
-    pCpuEvents = NULL;
-    pMatchingCpus = NULL;
+    pEvent = NULL;
     bSelfInDestination = FALSE;
 
     LOG_TRACE_CPU("Send mode 0x%x to destination 0x%02x [0x%02]\n",
@@ -455,70 +534,23 @@ SmpSendGenericIpiEx(
         return STATUS_CPU_NO_MATCHES;
     }
 
-    apicId = CpuGetApicId();
-
     __try
     {
-        // in the future we may have a preallocated array of pointers allocated in each
-        // PCPU structure. This would remove the need of memory allocation when sending
-        // IPIs and because the number of CPUs is limited not much memory is wasted
-        // E.g: even if there are 256 CPUs * sizeof(PVOID) => only 2KB of memory is used
-        // per CPU => 262KB extra
-        pMatchingCpus = ExAllocatePoolWithTag(0,
-                                              sizeof(PCPU*) * noOfMatchingCpus,
-                                              HEAP_TEMP_TAG,
-                                              0
-        );
-        ASSERT(NULL != pMatchingCpus);
-
-        status = _SmpRetrieveMatchingCpus(Destination,
-                                          SendMode,
-                                          noOfMatchingCpus,
-                                          pMatchingCpus,
-                                          &tempResult
+        pEvent = IpcGenerateEvent(BroadcastFunction,
+                                  Context,
+                                  FreeFunction,
+                                  FreeContext,
+                                  WaitForHandling
         );
-        if (!SUCCEEDED(status))
-        {
-            LOG_FUNC_ERROR("_SmpRetrieveMatchingCpus", status);
-            __leave;
-        }
-        ASSERT(tempResult == noOfMatchingCpus);
-
-        pCpuEvents = IpcGenerateEvent(BroadcastFunction,
-                                      Context,
-                                      FreeFunction,
-                                      FreeContext,
-                                      WaitForHandling,
-                                      noOfMatchingCpus
-        );
-        if (NULL == pCpuEvents)
+        if (NULL == pEvent)
         {
             status = STATUS_UNSUCCESSFUL;
             LOG_FUNC_ERROR("IpcGenerateEvent", status);
             __leave;
         }
-        LOG_TRACE_CPU("Successfully generated event at 0x%X\n", pCpuEvents);
+        LOG_TRACE_CPU("Successfully generated event at 0x%X\n", pEvent);
 
-        for (i = 0; i < noOfMatchingCpus; ++i)
-        {
-            INTR_STATE intrState;
-            PCPU* pCpu = pMatchingCpus[i];
-
-            LOG_TRACE_CPU("Will process CPU 0x%02x [0x%02x]\n", pCpu->ApicId, pCpu->LogicalApicId);
-
-            if (apicId == pCpu->ApicId)
-            {
-                bSelfInDestination = TRUE;
-            }
-
-            LockAcquire(&pCpu->EventListLock, &intrState);
-            InsertTailList(&pCpu->EventList, &(pCpuEvents[i].ListEntry));
-            pCpu->NoOfEventsInList++;
-            LockRelease(&pCpu->EventListLock, intrState);
-        }
-
-        // notify processors
-        _SmpSendIpcIpi(SendMode, Destination);
+        bSelfInDestination = _SmpQueueIpcEvent(pEvent, SendMode, Destination);
 
         if (WaitForHandling)
         {
@@ -530,22 +562,16 @@ SmpSendGenericIpiEx(
                 ASSERT(INTR_ON == CpuIntrGetState());
                 ASSERT(LapicSystemGetPpr() < IrqlIpiLevel);
             }
-
-            // if WaitForHandling is FALSE it is possible for the event to already be
-            // de-allocated => not safe to call function
-            IpcWaitForEventHandling(pCpuEvents);
         }
-        pCpuEvents = NULL;
+
+        // if WaitForHandling is FALSE it is possible for the event to already be
+        // de-allocated after this call
+        IpcCompleteEvent(pEvent);
+        pEvent = NULL;
     }
     __finally
     {
-        if( NULL != pMatchingCpus )
-        {
-            ExFreePoolWithTag(pMatchingCpus, HEAP_TEMP_TAG);
-            pMatchingCpus = NULL;
-        }
-
-        ASSERT( NULL == pCpuEvents );
+        ASSERT( NULL == pEvent );
 
         LOG_FUNC_END;
     }
@@ -665,6 +691,13 @@ _SmpInstallInterruptRoutines(
         return status;
     }
 
+    status = _SmpInstallInterruptRoutine(_SmpBroadcastIpiIsr, IrqlIpiLevel, &m_smpData.BroadcastIpiVector );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_SmpInstallInterruptRoutine", status);
+        return status;
+    }
+
     LOG_FUNC_END;
 
     return status;
@@ -743,6 +776,141 @@ _SmpRetrieveMatchingCpus(
 //  -----------------------------------------------------------------
 //  |     HalActivateFpu                                            |
 //  -----------------------------------------------------------------
+static
+BOOLEAN
+_SmpQueueIpcEvent(
+    INOUT   PIPC_EVENT              Event,
+    IN _Strict_type_match_
+            SMP_IPI_SEND_MODE       SendMode,
+    IN      SMP_DESTINATION         Destination
+    )
+{
+    PLIST_ENTRY pEntry;
+    INTR_STATE oldState;
+    BOOLEAN bSendIpi;
+    BOOLEAN bSelfInDestination;
+    APIC_ID apicId;
+
+    ASSERT(NULL != Event);
+
+    bSendIpi = FALSE;
+    bSelfInDestination = FALSE;
+
+    RwSpinlockAcquireShared(&m_smpData.CpuLock, &oldState);
+
+    apicId = CpuGetApicId();
+
+    for(pEntry = m_smpData.CpuList.Flink;
+        pEntry != &m_smpData.CpuList;
+        pEntry = pEntry->Flink)
+    {
+        PCPU* pCpu = CONTAINING_RECORD(pEntry, PCPU, ListEntry);
+
+        if (!_SmpDoesCpuMatchDestination(SendMode, Destination, pCpu))
+        {
+            continue;
+        }
+
+        LOG_TRACE_CPU("Will queue event for CPU 0x%02x [0x%02x]\n", pCpu->ApicId, pCpu->LogicalApicId);
+
+        if (apicId == pCpu->ApicId)
+        {
+            bSelfInDestination = TRUE;
+        }
+
+        // a CPU whose queue was not empty was already sent an IPI and did not
+        // yet take the events out of its queue
+        if (IpcQueueEvent(Event, &pCpu->EventQueue))
+        {
+            bSendIpi = TRUE;
+        }
+    }
+
+    // sent with interrupts still disabled, the senders which found the queues
+    // not empty rely on this IPI being on its way
+    if (bSendIpi)
+    {
+        _SmpSendIpcIpi(SendMode, Destination);
+    }
+
+    RwSpinlockReleaseShared(&m_smpData.CpuLock, oldState);
+
+    return bSelfInDestination;
+}
+
+static
+STATUS
+_SmpSendBroadcastIpi(
+    IN      PFUNC_IpcProcessEvent   BroadcastFunction,
+    IN_OPT  PVOID                   Context,
+    IN_OPT  PFUNC_FreeFunction      FreeFunction,
+    IN_OPT  PVOID                   FreeContext,
+    IN      BOOLEAN                 WaitForHandling
+    )
+{
+    INTR_STATE oldState;
+    DWORD noOfCpus;
+    BYTE vector;
+
+    ASSERT(NULL != BroadcastFunction);
+
+    noOfCpus = m_smpData.NoOfActiveCpus;
+    if (noOfCpus <= 1)
+    {
+        LOG_WARNING("There are no CPUs which match IPI destination! :(\n");
+        return STATUS_CPU_NO_MATCHES;
+    }
+
+    // while we wait for the payload interrupts stay enabled, its owner may be
+    // waiting for us to handle its broadcast
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        oldState = CpuIntrDisable();
+
+        if (FALSE == _InterlockedCompareExchange(&m_smpBroadcast.Busy, TRUE, FALSE))
+        {
+            break;
+        }
+
+        CpuIntrSetState(oldState);
+        _mm_pause();
+    }
+
+    m_smpBroadcast.Function = BroadcastFunction;
+    m_smpBroadcast.Context = Context;
+    m_smpBroadcast.FreeFunction = FreeFunction;
+    m_smpBroadcast.FreeContext = FreeContext;
+    m_smpBroadcast.WaitForHandling = WaitForHandling;
+    m_smpBroadcast.Completed = FALSE;
+    m_smpBroadcast.PendingCpus = noOfCpus - 1;
+
+    vector = m_smpData.BroadcastIpiVector;
+    LapicSystemSendIpi(0, ApicDeliveryModeFixed, ApicDestinationShorthandAllExcludingSelf, ApicDestinationModePhysical, &vector);
+
+    if (WaitForHandling)
+    {
+        while (!m_smpBroadcast.Completed)
+        {
+            _mm_pause();
+        }
+
+        if (NULL != FreeFunction)
+        {
+            FreeFunction(Context, FreeContext);
+        }
+
+        m_smpBroadcast.Busy = FALSE;
+    }
+
+    // if WaitForHandling is FALSE the last CPU to handle the broadcast
+    // releases the payload
+    CpuIntrSetState(oldState);
+
+    return STATUS_SUCCESS;
+}
+
 static
 void
 _SmpSetupInitialApStack(
@@ -785,9 +953,10 @@ BOOLEAN
 {
     ASSERT( NULL != Device );
 
-    LOGPL("What are we doing here??\n");
+    // the LAPIC timer is only armed by the profiler
+    ProfilerTakeSample();
 
-    return FALSE;
+    return TRUE;
 }
 
 static
@@ -811,59 +980,61 @@ BOOLEAN
     )
 {
     PCPU* pCpu;
-    INTR_STATE dummy;
-    PLIST_ENTRY pListEntry;
-    PIPC_EVENT_CPU pCpuEvent;
     STATUS status;
-    STATUS funcStatus;
 
     ASSERT(NULL != Device);
 
     LOG_FUNC_START;
 
-    pListEntry = NULL;
-    status = STATUS_SUCCESS;
-    pCpuEvent = NULL;
-
     pCpu = GetCurrentPcpu();
     ASSERT( NULL != pCpu );
 
-    LockAcquire(&pCpu->EventListLock, &dummy);
-    if (pCpu->NoOfEventsInList > 0)
+    // all the events queued up to now are processed, the queue may also be
+    // found empty if its events were processed on a previous IPI
+    status = IpcProcessQueue(&pCpu->EventQueue);
+    if (!SUCCEEDED(status))
     {
-        LOG_TRACE_CPU("Will remove event from list at 0x%X\n", &pCpu->EventList);
-        pListEntry = RemoveHeadList(&pCpu->EventList);
-        ASSERT( pListEntry != &pCpu->EventList );
-        pCpu->NoOfEventsInList--;
+        LOG_FUNC_ERROR("IpcProcessQueue", status);
     }
-    LockRelease(&pCpu->EventListLock, INTR_OFF);
 
-    ASSERT(NULL != pListEntry);
+    LOG_FUNC_END;
 
-    pCpuEvent = CONTAINING_RECORD(pListEntry, IPC_EVENT_CPU, ListEntry);
-    LOG_TRACE_CPU("Removed element at 0x%X\n", pCpuEvent);
+    return SUCCEEDED(status);
+}
 
-    __try
+static
+BOOLEAN
+(__cdecl _SmpBroadcastIpiIsr)(
+    IN        PDEVICE_OBJECT           Device
+    )
+{
+    STATUS status;
+
+    ASSERT(NULL != Device);
+
+    // the payload cannot change until all the CPUs decremented PendingCpus
+    status = m_smpBroadcast.Function(m_smpBroadcast.Context);
+    if (!SUCCEEDED(status))
     {
-        status = IpcProcessEvent(pCpuEvent, &funcStatus);
-        if (!SUCCEEDED(status))
-        {
-            LOG_FUNC_ERROR("IpcProcessEvent", status);
-            __leave;
-        }
+        LOG_FUNC_ERROR("Broadcast function", status);
+    }
 
-        status = funcStatus;
-        if (!SUCCEEDED(status))
+    if (0 == _InterlockedDecrement(&m_smpBroadcast.PendingCpus))
+    {
+        if (m_smpBroadcast.WaitForHandling)
         {
-            LOG_FUNC_ERROR("Event processing failed", status);
-            __leave;
+            // the sender frees the context and releases the payload
+            m_smpBroadcast.Completed = TRUE;
         }
+        else
+        {
+            if (NULL != m_smpBroadcast.FreeFunction)
+            {
+                m_smpBroadcast.FreeFunction(m_smpBroadcast.Context, m_smpBroadcast.FreeContext);
+            }
 
-        pListEntry = NULL;
-    }
-    __finally
-    {
-        LOG_FUNC_END;
+            m_smpBroadcast.Busy = FALSE;
+        }
     }
 
     return SUCCEEDED(status);
@@ -7,6 +7,7 @@
 #include "mmu.h"
 #include "process_internal.h"
 #include "dmp_cpu.h"
+#include "um_net_ring.h"
 
 extern void SyscallEntry();
 
@@ -67,6 +68,21 @@ SyscallHandler(
         case SyscallIdIdentifyVersion:
             status = SyscallValidateInterface((SYSCALL_IF_VERSION)*pSyscallParameters);
             break;
+        case SyscallIdNetRingCreate:
+            status = SyscallNetRingCreate((DWORD)pSyscallParameters[0],
+                                          (DWORD)pSyscallParameters[1],
+                                          (PNET_RING_HEADER*)pSyscallParameters[2]);
+            break;
+        case SyscallIdNetRingTransmit:
+            status = SyscallNetRingTransmit((PNET_RING_HEADER)pSyscallParameters[0],
+                                            (DWORD*)pSyscallParameters[1]);
+            break;
+        case SyscallIdNetRingWait:
+            status = SyscallNetRingWait((PNET_RING_HEADER)pSyscallParameters[0]);
+            break;
+        case SyscallIdNetRingClose:
+            status = SyscallNetRingClose((PNET_RING_HEADER)pSyscallParameters[0]);
+            break;
         // STUDENT TODO: implement the rest of the syscalls
         default:
             LOG_ERROR("Unimplemented syscall called from User-space!\n");
@@ -169,4 +185,65 @@ SyscallValidateInterface(
     return STATUS_SUCCESS;
 }
 
-// STUDENT TODO: implement the rest of the syscalls
\ No newline at end of file
+// STUDENT TODO: implement the rest of the syscalls
+
+// SyscallIdNetRingCreate
+STATUS
+SyscallNetRingCreate(
+    IN          DWORD                   DeviceId,
+    IN          DWORD                   SlotCount,
+    OUT         PNET_RING_HEADER*       Ring
+    )
+{
+    STATUS status;
+
+    status = MmuIsBufferValid(Ring, sizeof(PNET_RING_HEADER), PAGE_RIGHTS_WRITE, GetCurrentProcess());
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("MmuIsBufferValid", status);
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    return UmNetRingCreate(GetCurrentProcess(), DeviceId, SlotCount, Ring);
+}
+
+// SyscallIdNetRingTransmit
+STATUS
+SyscallNetRingTransmit(
+    IN          PNET_RING_HEADER        Ring,
+    OUT_OPT     DWORD*                  FramesSent
+    )
+{
+    STATUS status;
+
+    if (NULL != FramesSent)
+    {
+        status = MmuIsBufferValid(FramesSent, sizeof(DWORD), PAGE_RIGHTS_WRITE, GetCurrentProcess());
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("MmuIsBufferValid", status);
+            return STATUS_INVALID_PARAMETER2;
+        }
+    }
+
+    // a single system call for all the frames queued since the previous one
+    return UmNetRingTransmit(GetCurrentProcess(), Ring, FramesSent);
+}
+
+// SyscallIdNetRingWait
+STATUS
+SyscallNetRingWait(
+    IN          PNET_RING_HEADER        Ring
+    )
+{
+    return UmNetRingWait(GetCurrentProcess(), Ring);
+}
+
+// SyscallIdNetRingClose
+STATUS
+SyscallNetRingClose(
+    IN          PNET_RING_HEADER        Ring
+    )
+{
+    return UmNetRingClose(GetCurrentProcess(), Ring);
+}
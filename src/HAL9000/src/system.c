@@ -21,6 +21,11 @@
 #include "ex_system.h"
 #include "process_internal.h"
 #include "boot_module.h"
+#include "trace.h"
+#include "profiler.h"
+#include "boot_timeline.h"
+#include "pool_stats.h"
+#include "pmu.h"
 
 #define NO_OF_TSS_STACKS             7
 STATIC_ASSERT(NO_OF_TSS_STACKS <= NO_OF_IST);
@@ -43,11 +48,17 @@ SystemPreinit(
 
     m_systemData.NumberOfTssStacks = NO_OF_TSS_STACKS;
 
+    // first, so the timeline starts as close as possible to the kernel entry
+    BootTimelinePreinit();
     BootModulesPreinit();
     DumpPreinit();
     ThreadSystemPreinit();
     printSystemPreinit(NULL);
     LogSystemPreinit();
+    TraceSystemPreinit();
+    ProfilerSystemPreinit();
+    PoolStatsPreinit();
+    PmuSystemPreinit();
     OsInfoPreinit();
     MmuPreinitSystem();
     IomuPreinitSystem();
@@ -66,22 +77,31 @@ SystemInit(
 {
     STATUS status;
     PCPU* pCpu;
+    DWORD phase;
 
     status = STATUS_SUCCESS;
     pCpu = NULL;
 
+    phase = BootTimelineBegin("LogSystemInit", BootTimelineEntryPhase);
     LogSystemInit(LogLevelInfo,
                   LogComponentInterrupt | LogComponentIo | LogComponentAcpi,
                   TRUE
                   );
+    BootTimelineEnd(phase);
 
     // if validation fails => the system will HALT
+    phase = BootTimelineBegin("CpuMuValidateConfiguration", BootTimelineEntryPhase);
     CpuMuValidateConfiguration();
+    BootTimelineEnd(phase);
 
+    phase = BootTimelineBegin("HalInitialize", BootTimelineEntryPhase);
     HalInitialize();
+    BootTimelineEnd(phase);
 
     // install new GDT table
+    phase = BootTimelineBegin("GdtMuInit", BootTimelineEntryPhase);
     status = GdtMuInit();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("GdtMuInit", status);
@@ -89,7 +109,9 @@ SystemInit(
     }
 
     // initialize serial communication
+    phase = BootTimelineBegin("SerialCommunicationInitialize", BootTimelineEntryPhase);
     status = SerialCommunicationInitialize(Parameters->BiosSerialPorts, BIOS_MAX_NO_OF_SERIAL_PORTS);
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("SerialCommunicationInitialize", status);
@@ -103,7 +125,9 @@ SystemInit(
         OsGetBuildDate()
         );
 
+    phase = BootTimelineBegin("OsInfoInit", BootTimelineEntryPhase);
     status = OsInfoInit();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("OsInfoInit", status);
@@ -112,7 +136,9 @@ SystemInit(
 
     LOGL("OsInfoInit succeeded\n");
 
+    phase = BootTimelineBegin("CpuMuActivateFpuFeatures", BootTimelineEntryPhase);
     status = CpuMuActivateFpuFeatures();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("CpuMuActivateFpuFeatures", status);
@@ -124,7 +150,9 @@ SystemInit(
     // IDT handlers need to be initialized before
     // MmuInitSystem is called because the VMM
     // needs page fault handling to allocate memory
+    phase = BootTimelineBegin("InitIdtHandlers", BootTimelineEntryPhase);
     status = InitIdtHandlers(GdtMuGetCS64Supervisor(), 0);
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("InitIdtHandlers", status);
@@ -133,11 +161,13 @@ SystemInit(
 
     LOGL("InitIdtHandlers succeeded\n");
 
+    phase = BootTimelineBegin("MmuInitSystem", BootTimelineEntryPhase);
     status = MmuInitSystem(Parameters->KernelBaseAddress,
                            (DWORD) Parameters->KernelSize,
                            Parameters->MemoryMapAddress,
                            Parameters->MemoryMapEntries
                            );
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("MmuInitSystem", status);
@@ -148,8 +178,10 @@ SystemInit(
 
     if (IsBooleanFlagOn(Parameters->MultibootInformation->Flags, MULTIBOOT_FLAG_BOOT_MODULES_PRESENT))
     {
+        phase = BootTimelineBegin("BootModulesInit", BootTimelineEntryPhase);
         status = BootModulesInit((PHYSICAL_ADDRESS)(QWORD)Parameters->MultibootInformation->ModuleAddress,
                                 Parameters->MultibootInformation->ModuleCount);
+        BootTimelineEnd(phase);
         if (!SUCCEEDED(status))
         {
             LOG_FUNC_ERROR("BootModulesMap", status);
@@ -157,7 +189,9 @@ SystemInit(
         }
     }
 
+    phase = BootTimelineBegin("IomuInitSystemDriver", BootTimelineEntryPhase);
     status = IomuInitSystemDriver();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("IomuInitSystemDriver", status);
@@ -166,7 +200,9 @@ SystemInit(
     LOGL("IomuInitSystemDriver suceeded\n");
 
     // initialize ACPI interface
+    phase = BootTimelineBegin("AcpiInterfaceInit", BootTimelineEntryPhase);
     status = AcpiInterfaceInit();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("AcpiInterfaceInit", status);
@@ -174,7 +210,9 @@ SystemInit(
     }
     LOGL("AcpiInterfaceInit suceeded\n");
 
+    phase = BootTimelineBegin("LapicSystemInit", BootTimelineEntryPhase);
     status = LapicSystemInit();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("LapicSystemInit", status);
@@ -182,7 +220,9 @@ SystemInit(
     }
     LOGL("LapicSystemInit suceeded\n");
 
+    phase = BootTimelineBegin("SmpInit", BootTimelineEntryPhase);
     status = SmpInit();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("SmpInit", status);
@@ -191,9 +231,21 @@ SystemInit(
 
     LOGL("SmpInit succeded\n");
 
+    phase = BootTimelineBegin("PmuSystemInit", BootTimelineEntryPhase);
+    status = PmuSystemInit();
+    BootTimelineEnd(phase);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("PmuSystemInit", status);
+        return status;
+    }
+
+    LOGL("PmuSystemInit succeeded\n");
+
     // allocate PCPU structure for the BSP
     // this needs to be before the call to IomuInitSystem because
     // by the time we enable interrupts we want our TSS descriptor to be installed
+    phase = BootTimelineBegin("CpuMuAllocAndInitCpu", BootTimelineEntryPhase);
     status = CpuMuAllocAndInitCpu(&pCpu,
     // C28039: The type of actual parameter 'CpuGetApicId()' should exactly match the type 'APIC_ID'
 #pragma warning(suppress: 28039)
@@ -201,6 +253,7 @@ SystemInit(
                                   STACK_DEFAULT_SIZE,
                                   m_systemData.NumberOfTssStacks
                                   );
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("CpuMuAllocAndInitCpu", status);
@@ -210,7 +263,9 @@ SystemInit(
 
     // initialize IO system
     // this also initializes the IDT
+    phase = BootTimelineBegin("IomuInitSystem", BootTimelineEntryPhase);
     status = IomuInitSystem(GdtMuGetCS64Supervisor(),m_systemData.NumberOfTssStacks );
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("IomuInitSystem", status);
@@ -219,7 +274,9 @@ SystemInit(
 
     LOGL("IomuInitSystem succeeded\n");
 
+    phase = BootTimelineBegin("CoreInit", BootTimelineEntryPhase);
     status = CoreInit();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("CoreInit", status);
@@ -228,7 +285,9 @@ SystemInit(
 
     LOGL("CoreInit succeeded\n");
 
+    phase = BootTimelineBegin("SmpSetupLowerMemory", BootTimelineEntryPhase);
     status = SmpSetupLowerMemory(m_systemData.NumberOfTssStacks);
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("SmpSetupLowerMemory", status);
@@ -237,7 +296,9 @@ SystemInit(
 
     LOGL("SmpSetupLowerMemory succeded\n");
 
+    phase = BootTimelineBegin("ProcessSystemInitSystemProcess", BootTimelineEntryPhase);
     status = ProcessSystemInitSystemProcess();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("ProcessSystemInitSystemProcess", status);
@@ -246,7 +307,9 @@ SystemInit(
 
     LOGL("Successfully intiialized system process!\n");
 
+    phase = BootTimelineBegin("ThreadSystemInitIdleForCurrentCPU", BootTimelineEntryPhase);
     status = ThreadSystemInitIdleForCurrentCPU();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("ThreadSystemInitIdleForCurrentCPU", status);
@@ -255,7 +318,9 @@ SystemInit(
 
     LOGL("ThreadSystemInitIdleForCurrentCPU succeeded\n");
 
+    phase = BootTimelineBegin("AcpiInterfaceLateInit", BootTimelineEntryPhase);
     status = AcpiInterfaceLateInit();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("AcpiInterfaceLateInit", status);
@@ -263,11 +328,15 @@ SystemInit(
     }
     LOGL("AcpiInterfaceLateInit succeeded\n");
 
+    phase = BootTimelineBegin("SmpWakeupAps", BootTimelineEntryPhase);
     SmpWakeupAps();
+    BootTimelineEnd(phase);
     LOGL("SmpWakeupAps completed\n");
 
     // finish IOMU initialization
+    phase = BootTimelineBegin("IomuInitSystemAfterApWakeup", BootTimelineEntryPhase);
     status = IomuInitSystemAfterApWakeup();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("IomuInitSystemAfterApWakeup", status);
@@ -276,16 +345,22 @@ SystemInit(
     LOGL("IomuInitSystemAfterApWakeup succeeded\n");
 
     // we no longer need the lower memory mappings
+    phase = BootTimelineBegin("SmpCleanupLowerMemory", BootTimelineEntryPhase);
     SmpCleanupLowerMemory();
+    BootTimelineEnd(phase);
 
     LOGL("SmpCleanupLowerMemory completed\n");
 
     // After the APs have woken up we no longer need the 1:1 VA->PA mappings
+    phase = BootTimelineBegin("MmuDiscardIdentityMappings", BootTimelineEntryPhase);
     MmuDiscardIdentityMappings();
+    BootTimelineEnd(phase);
 
     LOGL("MmuDiscardIdentityMappings completed\n");
 
+    phase = BootTimelineBegin("MmuInitThreadingSystem", BootTimelineEntryPhase);
     status = MmuInitThreadingSystem();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("MmuInitThreadingSystem", status );
@@ -295,7 +370,9 @@ SystemInit(
     LOGL("MmuInitThreadingSystem succeded\n");
 
     // IOMU late initialization: drivers + system partition determination
+    phase = BootTimelineBegin("IomuLateInit", BootTimelineEntryPhase);
     status = IomuLateInit();
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("IomuLateInit", status);
@@ -304,7 +381,9 @@ SystemInit(
 
     LOGL("IOMU late initialization successfully completed\n");
 
+    phase = BootTimelineBegin("NetworkStackInit", BootTimelineEntryPhase);
     status = NetworkStackInit(FALSE);
+    BootTimelineEnd(phase);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("NetworkStackInit", status);
@@ -313,6 +392,8 @@ SystemInit(
 
     LOGL("Network stack successfully initialized\n");
 
+    BootTimelineDump();
+
     return status;
 }
 
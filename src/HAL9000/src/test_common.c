@@ -4,6 +4,7 @@
 #include "test_vmm.h"
 #include "test_file_io.h"
 #include "test_dma.h"
+#include "test_primitives.h"
 #include "test_thread.h"
 #include "smp.h"
 
@@ -26,6 +27,7 @@ TestRunAllPerformance(
     void
     )
 {
+    TestPrimitivesPerformance();
     TestFileReadPerformance();
     TestDmaPerformance();
 }
\ No newline at end of file
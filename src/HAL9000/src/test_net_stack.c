@@ -207,6 +207,7 @@ STATUS
         }
 
         status = NetReceiveFrame(pCtx->NetworkDevice,
+                                 TRUE,
                                  pFrame,
                                  bufferSize,
                                  &requiredBufferSize
@@ -229,6 +230,12 @@ STATUS
             LOG("Device link is down!\n");
             break;
         }
+        else if (STATUS_DEVICE_BUSY == status)
+        {
+            status = STATUS_SUCCESS;
+            LOG("Device frames are received by the network stack!\n");
+            break;
+        }
 
         ASSERT(SUCCEEDED(status));
 
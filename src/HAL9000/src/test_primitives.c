@@ -0,0 +1,663 @@
+#include "test_common.h"
+#include "test_primitives.h"
+#include "perf_framework.h"
+#include "mutex.h"
+#include "ex_event.h"
+#include "thread.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "smp.h"
+#include "cpumu.h"
+#include "syscall.h"
+#include "syscall_defs.h"
+#include "syscall_no.h"
+
+#define PRIM_LOCK_ITERATIONS            100000
+#define PRIM_SWITCH_ITERATIONS          1000
+#define PRIM_THREAD_ITERATIONS          100
+#define PRIM_POOL_ITERATIONS            10000
+#define PRIM_PMM_ITERATIONS             1000
+#define PRIM_PAGE_FAULT_ITERATIONS      1000
+#define PRIM_IPI_ITERATIONS             1000
+#define PRIM_SYSCALL_ITERATIONS         10000
+
+#define PRIM_MAX_NAME_LENGTH            64
+
+typedef struct _PRIM_PING_PONG_CTX
+{
+    MUTEX               Mutex;
+
+    EX_EVENT            Ping;
+    EX_EVENT            Pong;
+
+    volatile BOOLEAN    Stop;
+} PRIM_PING_PONG_CTX, *PPRIM_PING_PONG_CTX;
+
+typedef struct _PRIM_PAGE_FAULT_CTX
+{
+    PBYTE               Base;
+    DWORD               NumberOfPages;
+    DWORD               NextPage;
+} PRIM_PAGE_FAULT_CTX, *PPRIM_PAGE_FAULT_CTX;
+
+static const DWORD POOL_SIZE_CLASSES[] = { 16, 64, 256, KB_SIZE, 4 * KB_SIZE, 16 * KB_SIZE };
+
+// SyscallHandler validates the shadow stack against the image of the current
+// process, for the system process this is the kernel image
+static QWORD m_primSyscallShadowStack[SHADOW_STACK_SIZE / sizeof(QWORD)];
+static COMPLETE_PROCESSOR_STATE m_primSyscallState;
+
+static FUNC_TestPerformance     _PrimLockAcquireRelease;
+static FUNC_TestPerformance     _PrimMutexHandoff;
+static FUNC_TestPerformance     _PrimEventPingPong;
+static FUNC_TestPerformance     _PrimThreadYield;
+static FUNC_TestPerformance     _PrimThreadCreateExit;
+static FUNC_TestPerformance     _PrimPoolAllocFree;
+static FUNC_TestPerformance     _PrimPmmReserveRelease;
+static FUNC_TestPerformance     _PrimPageFault;
+static FUNC_TestPerformance     _PrimIpiRoundTrip;
+static FUNC_TestPerformance     _PrimSyscallDispatch;
+
+static FUNC_ThreadStart         _PrimMutexPartner;
+static FUNC_ThreadStart         _PrimEventPartner;
+static FUNC_ThreadStart         _PrimYieldPartner;
+static FUNC_ThreadStart         _PrimEmptyThread;
+
+static FUNC_IpcProcessEvent     _PrimIpiNop;
+
+static
+void
+_PrimRun(
+    IN_Z    char*                   Name,
+    IN      PFUNC_TestPerformance   Function,
+    IN_OPT  PVOID                   Context,
+    IN      DWORD                   Iterations,
+    IN      DWORD                   NumberOfCpus
+    );
+
+static
+void
+_PrimTestLocks(
+    void
+    );
+
+static
+void
+_PrimTestWakeups(
+    void
+    );
+
+static
+void
+_PrimTestThreads(
+    void
+    );
+
+static
+void
+_PrimTestMemory(
+    void
+    );
+
+static
+void
+_PrimTestIpi(
+    void
+    );
+
+static
+void
+_PrimTestSyscall(
+    void
+    );
+
+void
+TestPrimitivesPerformance(
+    void
+    )
+{
+    _PrimTestLocks();
+    _PrimTestWakeups();
+    _PrimTestThreads();
+    _PrimTestMemory();
+    _PrimTestIpi();
+    _PrimTestSyscall();
+}
+
+static
+void
+_PrimRun(
+    IN_Z    char*                   Name,
+    IN      PFUNC_TestPerformance   Function,
+    IN_OPT  PVOID                   Context,
+    IN      DWORD                   Iterations,
+    IN      DWORD                   NumberOfCpus
+    )
+{
+    STATUS status;
+    PERFORMANCE_PARAMETERS params;
+    PERFORMANCE_STATS stats;
+
+    ASSERT(NULL != Name);
+    ASSERT(NULL != Function);
+
+    params.WarmupIterations = Iterations / 10;
+    params.Iterations = Iterations;
+    params.NumberOfCpus = NumberOfCpus;
+    params.Unit = PerformanceUnitNs;
+
+    status = RunPerformanceFunctionEx(Function, Context, &params, &stats);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("RunPerformanceFunctionEx", status);
+        return;
+    }
+
+    ReportPerformanceStats(Name, &stats);
+}
+
+static
+void
+_PrimTestLocks(
+    void
+    )
+{
+    LOCK lock;
+    DWORD noOfCpus;
+
+    LockInit(&lock);
+
+    _PrimRun("LockAcquireRelease", _PrimLockAcquireRelease, &lock, PRIM_LOCK_ITERATIONS, 1);
+
+    noOfCpus = SmpGetNumberOfActiveCpus();
+    if (noOfCpus > 1)
+    {
+        // every CPU spins on the same lock
+        _PrimRun("LockAcquireReleaseContended", _PrimLockAcquireRelease, &lock, PRIM_LOCK_ITERATIONS, noOfCpus);
+    }
+}
+
+static
+void
+_PrimTestWakeups(
+    void
+    )
+{
+    STATUS status;
+    PRIM_PING_PONG_CTX ctx;
+    PTHREAD pThread;
+
+    memzero(&ctx, sizeof(PRIM_PING_PONG_CTX));
+
+    MutexInit(&ctx.Mutex, FALSE);
+
+    // the partner blocks on the mutex, each release hands it the mutex and
+    // each acquire waits for the partner to hand it back
+    MutexAcquire(&ctx.Mutex);
+
+    status = ThreadCreate("PerfMutex", ThreadPriorityDefault, _PrimMutexPartner, &ctx, &pThread);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ThreadCreate", status);
+        MutexRelease(&ctx.Mutex);
+        return;
+    }
+
+    _PrimRun("MutexHandoff", _PrimMutexHandoff, &ctx, PRIM_SWITCH_ITERATIONS, 1);
+
+    ctx.Stop = TRUE;
+    MutexRelease(&ctx.Mutex);
+
+    ThreadWaitForTermination(pThread, &status);
+    ThreadCloseHandle(pThread);
+    pThread = NULL;
+
+    status = ExEventInit(&ctx.Ping, ExEventTypeSynchronization, FALSE);
+    ASSERT(SUCCEEDED(status));
+
+    status = ExEventInit(&ctx.Pong, ExEventTypeSynchronization, FALSE);
+    ASSERT(SUCCEEDED(status));
+
+    ctx.Stop = FALSE;
+
+    status = ThreadCreate("PerfEvent", ThreadPriorityDefault, _PrimEventPartner, &ctx, &pThread);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ThreadCreate", status);
+        return;
+    }
+
+    // each iteration consists of two signal to wakeup latencies
+    _PrimRun("ExEventPingPong", _PrimEventPingPong, &ctx, PRIM_SWITCH_ITERATIONS, 1);
+
+    ctx.Stop = TRUE;
+    ExEventSignal(&ctx.Ping);
+
+    ThreadWaitForTermination(pThread, &status);
+    ThreadCloseHandle(pThread);
+    pThread = NULL;
+}
+
+static
+void
+_PrimTestThreads(
+    void
+    )
+{
+    STATUS status;
+    PTHREAD* pThreads;
+    DWORD noOfThreads;
+    DWORD i;
+    volatile BOOLEAN bStop;
+
+    // one yielding thread for each CPU, so each yield has a thread to switch
+    // to regardless of the CPU it is executed on
+    noOfThreads = SmpGetNumberOfActiveCpus();
+    bStop = FALSE;
+
+    pThreads = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(PTHREAD) * noOfThreads, HEAP_TEST_TAG, 0);
+    if (NULL == pThreads)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PTHREAD) * noOfThreads);
+        return;
+    }
+
+    for (i = 0; i < noOfThreads; ++i)
+    {
+        status = ThreadCreate("PerfYield", ThreadPriorityDefault, _PrimYieldPartner, (PVOID) &bStop, &pThreads[i]);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ThreadCreate", status);
+            break;
+        }
+    }
+
+    if (i == noOfThreads)
+    {
+        _PrimRun("ThreadYield", _PrimThreadYield, NULL, PRIM_SWITCH_ITERATIONS, 1);
+    }
+
+    bStop = TRUE;
+
+    for (i = 0; i < noOfThreads; ++i)
+    {
+        if (NULL != pThreads[i])
+        {
+            ThreadWaitForTermination(pThreads[i], &status);
+            ThreadCloseHandle(pThreads[i]);
+            pThreads[i] = NULL;
+        }
+    }
+
+    ExFreePoolWithTag(pThreads, HEAP_TEST_TAG);
+    pThreads = NULL;
+
+    _PrimRun("ThreadCreateExit", _PrimThreadCreateExit, NULL, PRIM_THREAD_ITERATIONS, 1);
+}
+
+static
+void
+_PrimTestMemory(
+    void
+    )
+{
+    PRIM_PAGE_FAULT_CTX pfCtx;
+    char name[PRIM_MAX_NAME_LENGTH];
+    DWORD i;
+
+    for (i = 0; i < ARRAYSIZE(POOL_SIZE_CLASSES); ++i)
+    {
+        snprintf(name, PRIM_MAX_NAME_LENGTH, "ExAllocatePool_%u", POOL_SIZE_CLASSES[i]);
+
+        _PrimRun(name, _PrimPoolAllocFree, (PVOID) (QWORD) POOL_SIZE_CLASSES[i], PRIM_POOL_ITERATIONS, 1);
+    }
+
+    _PrimRun("PmmReserveRelease", _PrimPmmReserveRelease, NULL, PRIM_PMM_ITERATIONS, 1);
+
+    // each iteration touches a new page of a lazily committed region, the
+    // warm-up iterations need pages too
+    memzero(&pfCtx, sizeof(PRIM_PAGE_FAULT_CTX));
+    pfCtx.NumberOfPages = PRIM_PAGE_FAULT_ITERATIONS + PRIM_PAGE_FAULT_ITERATIONS / 10;
+
+    pfCtx.Base = VmmAllocRegion(NULL,
+                                (QWORD) pfCtx.NumberOfPages * PAGE_SIZE,
+                                VMM_ALLOC_TYPE_RESERVE | VMM_ALLOC_TYPE_COMMIT,
+                                PAGE_RIGHTS_READWRITE);
+    if (NULL == pfCtx.Base)
+    {
+        LOG_FUNC_ERROR_ALLOC("VmmAllocRegion", pfCtx.NumberOfPages * PAGE_SIZE);
+        return;
+    }
+
+    _PrimRun("PageFault", _PrimPageFault, &pfCtx, PRIM_PAGE_FAULT_ITERATIONS, 1);
+
+    VmmFreeRegion(pfCtx.Base, 0, VMM_FREE_TYPE_RELEASE);
+    pfCtx.Base = NULL;
+}
+
+static
+void
+_PrimTestIpi(
+    void
+    )
+{
+    SMP_DESTINATION dest = { 0 };
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    BOOLEAN bFound;
+
+    pCpuListHead = NULL;
+    bFound = FALSE;
+
+    SmpGetCpuList(&pCpuListHead);
+
+    // the thread may migrate, if it ends up on the target CPU the IPI is
+    // still delivered, only to itself
+    for (pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead;
+         pCurEntry = pCurEntry->Flink)
+    {
+        PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+
+        if (pCpu->ApicId != GetCurrentPcpu()->ApicId)
+        {
+            dest.Cpu.ApicId = pCpu->ApicId;
+            bFound = TRUE;
+            break;
+        }
+    }
+
+    if (!bFound)
+    {
+        LOG("Skipping the IPI round trip, there is a single CPU\n");
+        return;
+    }
+
+    _PrimRun("IpiRoundTrip", _PrimIpiRoundTrip, &dest, PRIM_IPI_ITERATIONS, 1);
+}
+
+static
+void
+_PrimTestSyscall(
+    void
+    )
+{
+    REGISTER_AREA* pRegisters;
+
+    // the SYSCALL and SYSRET instructions can only be executed from user-mode,
+    // what can be measured from here is the work done by the kernel between
+    // them
+    memzero(&m_primSyscallState, sizeof(COMPLETE_PROCESSOR_STATE));
+
+    m_primSyscallShadowStack[0] = SyscallIdIdentifyVersion;
+    m_primSyscallShadowStack[1] = SYSCALL_IMPLEMENTED_IF_VERSION;
+
+    pRegisters = &m_primSyscallState.RegisterArea;
+    pRegisters->RegisterValues[RegisterRbp] = (QWORD) m_primSyscallShadowStack;
+    pRegisters->RegisterValues[RegisterR8] = SyscallIdIdentifyVersion;
+
+    _PrimRun("SyscallDispatch", _PrimSyscallDispatch, &m_primSyscallState, PRIM_SYSCALL_ITERATIONS, 1);
+}
+
+static
+void
+(__cdecl _PrimLockAcquireRelease)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PLOCK pLock;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Context);
+
+    pLock = (PLOCK) Context;
+
+    LockAcquire(pLock, &oldState);
+    LockRelease(pLock, oldState);
+}
+
+static
+void
+(__cdecl _PrimMutexHandoff)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPRIM_PING_PONG_CTX pCtx;
+
+    ASSERT(NULL != Context);
+
+    pCtx = (PPRIM_PING_PONG_CTX) Context;
+
+    MutexRelease(&pCtx->Mutex);
+    MutexAcquire(&pCtx->Mutex);
+}
+
+static
+void
+(__cdecl _PrimEventPingPong)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPRIM_PING_PONG_CTX pCtx;
+
+    ASSERT(NULL != Context);
+
+    pCtx = (PPRIM_PING_PONG_CTX) Context;
+
+    ExEventSignal(&pCtx->Ping);
+    ExEventWaitForSignal(&pCtx->Pong);
+}
+
+static
+void
+(__cdecl _PrimThreadYield)(
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    ThreadYield();
+}
+
+static
+void
+(__cdecl _PrimThreadCreateExit)(
+    IN_OPT  PVOID       Context
+    )
+{
+    STATUS status;
+    STATUS exitStatus;
+    PTHREAD pThread;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    status = ThreadCreate("PerfEmpty", ThreadPriorityDefault, _PrimEmptyThread, NULL, &pThread);
+    ASSERT(SUCCEEDED(status));
+
+    ThreadWaitForTermination(pThread, &exitStatus);
+    ThreadCloseHandle(pThread);
+}
+
+static
+void
+(__cdecl _PrimPoolAllocFree)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PVOID pBuffer;
+
+    pBuffer = ExAllocatePoolWithTag(0, (DWORD) (QWORD) Context, HEAP_TEST_TAG, 0);
+    ASSERT(NULL != pBuffer);
+
+    ExFreePoolWithTag(pBuffer, HEAP_TEST_TAG);
+}
+
+static
+void
+(__cdecl _PrimPmmReserveRelease)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PHYSICAL_ADDRESS pa;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    pa = PmmReserveMemory(1);
+    ASSERT(NULL != pa);
+
+    PmmReleaseMemory(pa, 1);
+}
+
+static
+void
+(__cdecl _PrimPageFault)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PPRIM_PAGE_FAULT_CTX pCtx;
+    volatile BYTE* pPage;
+
+    ASSERT(NULL != Context);
+
+    pCtx = (PPRIM_PAGE_FAULT_CTX) Context;
+    ASSERT(pCtx->NextPage < pCtx->NumberOfPages);
+
+    pPage = pCtx->Base + (QWORD) pCtx->NextPage * PAGE_SIZE;
+    *pPage = 1;
+
+    pCtx->NextPage++;
+}
+
+static
+void
+(__cdecl _PrimIpiRoundTrip)(
+    IN_OPT  PVOID       Context
+    )
+{
+    STATUS status;
+
+    ASSERT(NULL != Context);
+
+    status = SmpSendGenericIpiEx(_PrimIpiNop,
+                                 NULL,
+                                 NULL,
+                                 NULL,
+                                 TRUE,
+                                 SmpIpiSendToCpu,
+                                 *(PSMP_DESTINATION) Context);
+    ASSERT(SUCCEEDED(status));
+}
+
+static
+void
+(__cdecl _PrimSyscallDispatch)(
+    IN_OPT  PVOID       Context
+    )
+{
+    PCOMPLETE_PROCESSOR_STATE pState;
+    INTR_STATE oldState;
+
+    ASSERT(NULL != Context);
+
+    pState = (PCOMPLETE_PROCESSOR_STATE) Context;
+
+    // SyscallEntry calls the handler with the interrupts disabled
+    oldState = CpuIntrDisable();
+    SyscallHandler(pState);
+    CpuIntrSetState(oldState);
+
+    ASSERT(STATUS_SUCCESS == pState->RegisterArea.RegisterValues[RegisterRax]);
+}
+
+static
+STATUS
+(__cdecl _PrimMutexPartner)(
+    IN_OPT      PVOID       Context
+    )
+{
+    PPRIM_PING_PONG_CTX pCtx;
+    BOOLEAN bStop;
+
+    ASSERT(NULL != Context);
+
+    pCtx = (PPRIM_PING_PONG_CTX) Context;
+
+    do
+    {
+        MutexAcquire(&pCtx->Mutex);
+        bStop = pCtx->Stop;
+        MutexRelease(&pCtx->Mutex);
+    } while (!bStop);
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+(__cdecl _PrimEventPartner)(
+    IN_OPT      PVOID       Context
+    )
+{
+    PPRIM_PING_PONG_CTX pCtx;
+
+    ASSERT(NULL != Context);
+
+    pCtx = (PPRIM_PING_PONG_CTX) Context;
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        ExEventWaitForSignal(&pCtx->Ping);
+        if (pCtx->Stop)
+        {
+            break;
+        }
+
+        ExEventSignal(&pCtx->Pong);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+(__cdecl _PrimYieldPartner)(
+    IN_OPT      PVOID       Context
+    )
+{
+    volatile BOOLEAN* pStop;
+
+    ASSERT(NULL != Context);
+
+    pStop = (volatile BOOLEAN*) Context;
+
+    while (!*pStop)
+    {
+        ThreadYield();
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+(__cdecl _PrimEmptyThread)(
+    IN_OPT      PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+(__cdecl _PrimIpiNop)(
+    IN_OPT  PVOID       Context
+    )
+{
+    UNREFERENCED_PARAMETER(Context);
+
+    return STATUS_SUCCESS;
+}
@@ -9,6 +9,8 @@
 #include "isr.h"
 #include "gdtmu.h"
 #include "pe_exports.h"
+#include "trace.h"
+#include "rtc.h"
 
 #define TID_INCREMENT               4
 
@@ -36,6 +38,13 @@ typedef struct _THREAD_SYSTEM_DATA
 
     _Guarded_by_(ReadyThreadsLock)
     LIST_ENTRY          ReadyThreadsList;
+
+    // written under the lock, read without it by ThreadTick
+    _Guarded_by_(ReadyThreadsLock)
+    volatile DWORD      ReadyThreadsCount;
+
+    _Guarded_by_(ReadyThreadsLock)
+    HISTOGRAM           LatencyHistograms[ThreadLatencyReserved];
 } THREAD_SYSTEM_DATA, *PTHREAD_SYSTEM_DATA;
 
 static THREAD_SYSTEM_DATA m_threadSystemData;
@@ -103,6 +112,23 @@ _ThreadGetReadyThread(
     void
     );
 
+REQUIRES_EXCL_LOCK(m_threadSystemData.ReadyThreadsLock)
+static
+void
+_ThreadInsertReadyThread(
+    INOUT   PTHREAD                 Thread,
+    IN      BOOLEAN                 WokenUp,
+    IN      BOOLEAN                 Preempted
+    );
+
+REQUIRES_EXCL_LOCK(m_threadSystemData.ReadyThreadsLock)
+static
+void
+_ThreadUpdateSchedulerStats(
+    INOUT   PTHREAD                 CurrentThread,
+    INOUT   PTHREAD                 NextThread
+    );
+
 static
 void
 _ThreadForcedExit(
@@ -145,6 +171,11 @@ ThreadSystemPreinit(
 
     InitializeListHead(&m_threadSystemData.ReadyThreadsList);
     LockInit(&m_threadSystemData.ReadyThreadsLock);
+
+    for (DWORD i = 0; i < ThreadLatencyReserved; ++i)
+    {
+        HistogramInit(&m_threadSystemData.LatencyHistograms[i]);
+    }
 }
 
 STATUS
@@ -181,6 +212,7 @@ ThreadSystemInitMainForCurrentCPU(
     pThread->StackSize = pCpu->StackSize;
 
     pThread->State = ThreadStateRunning;
+    pThread->SchedulerStats.RunTimestamp = RtcGetTickCount();
     SetCurrentThread(pThread);
 
     // In case of the main thread of the BSP the process will be NULL so we need to handle that case
@@ -425,10 +457,18 @@ ThreadTick(
 {
     PPCPU pCpu = GetCurrentPcpu();
     PTHREAD pThread = GetCurrentThread();
+    DWORD runQueueLength;
 
     ASSERT( INTR_OFF == CpuIntrGetState());
     ASSERT( NULL != pCpu);
 
+    // there is a single ready list, each CPU samples it on its own ticks
+    runQueueLength = m_threadSystemData.ReadyThreadsCount;
+    pCpu->ThreadData.RunQueueHistory[pCpu->ThreadData.RunQueueSamples % RUN_QUEUE_HISTORY_SIZE] = runQueueLength;
+    pCpu->ThreadData.RunQueueSamples++;
+    pCpu->ThreadData.RunQueueLengthSum += runQueueLength;
+    pCpu->ThreadData.RunQueueLengthMax = max(pCpu->ThreadData.RunQueueLengthMax, runQueueLength);
+
     LOG_TRACE_THREAD("Thread tick\n");
     if (pCpu->ThreadData.IdleThread == pThread)
     {
@@ -469,6 +509,8 @@ ThreadYield(
     bForcedYield = pCpu->ThreadData.YieldOnInterruptReturn;
     pCpu->ThreadData.YieldOnInterruptReturn = FALSE;
 
+    TRACE_THREAD(TraceEventThreadYield, pThread->Id, bForcedYield, 0);
+
     if (THREAD_FLAG_FORCE_TERMINATE_PENDING == _InterlockedAnd(&pThread->Flags, MAX_DWORD))
     {
         _ThreadForcedExit();
@@ -478,7 +520,7 @@ ThreadYield(
     LockAcquire(&m_threadSystemData.ReadyThreadsLock, &dummyState);
     if (pThread != pCpu->ThreadData.IdleThread)
     {
-        InsertTailList(&m_threadSystemData.ReadyThreadsList, &pThread->ReadyList);
+        _ThreadInsertReadyThread(pThread, FALSE, bForcedYield);
     }
     if (!bForcedYield)
     {
@@ -511,6 +553,8 @@ ThreadBlock(
         NOT_REACHED;
     }
 
+    TRACE_THREAD(TraceEventThreadBlock, pCurrentThread->Id, 0, 0);
+
     pCurrentThread->TickCountEarly++;
     pCurrentThread->State = ThreadStateBlocked;
     LockAcquire(&m_threadSystemData.ReadyThreadsLock, &oldState);
@@ -532,8 +576,12 @@ ThreadUnblock(
 
     ASSERT(ThreadStateBlocked == Thread->State);
 
+    TRACE_THREAD(TraceEventThreadUnblock, Thread->Id, 0, 0);
+
     LockAcquire(&m_threadSystemData.ReadyThreadsLock, &dummyState);
-    InsertTailList(&m_threadSystemData.ReadyThreadsList, &Thread->ReadyList);
+
+    // a thread which never ran is not woken up, it is started
+    _ThreadInsertReadyThread(Thread, 0 != Thread->SchedulerStats.RunTimestamp, FALSE);
     Thread->State = ThreadStateReady;
     LockRelease(&m_threadSystemData.ReadyThreadsLock, dummyState );
     LockRelease(&Thread->BlockLock, oldState);
@@ -690,6 +738,22 @@ ThreadExecuteForEachThreadEntry(
     return status;
 }
 
+void
+ThreadRetrieveLatencyHistogram(
+    IN      THREAD_LATENCY_TYPE Type,
+    OUT     PHISTOGRAM          Histogram
+    )
+{
+    INTR_STATE oldState;
+
+    ASSERT(Type < ThreadLatencyReserved);
+    ASSERT(NULL != Histogram);
+
+    LockAcquire(&m_threadSystemData.ReadyThreadsLock, &oldState);
+    memcpy(Histogram, &m_threadSystemData.LatencyHistograms[Type], sizeof(HISTOGRAM));
+    LockRelease(&m_threadSystemData.ReadyThreadsLock, oldState);
+}
+
 void
 SetCurrentThread(
     IN      PTHREAD     Thread
@@ -990,6 +1054,11 @@ _ThreadSchedule(
         LOG_TRACE_THREAD("Current thread: %s\n", pCurrentThread->Name);
         LOG_TRACE_THREAD("Next thread: %s\n", pNextThread->Name);
 
+        TRACE_THREAD(TraceEventThreadSwitch, pCurrentThread->Id, pNextThread->Id, pCurrentThread->State);
+
+        _ThreadUpdateSchedulerStats(pCurrentThread, pNextThread);
+        PmuSwitchThread(&pCurrentThread->PmuCounters);
+
         if (pCurrentThread->Process != pNextThread->Process)
         {
             MmuChangeProcessSpace(pNextThread->Process);
@@ -1128,6 +1197,9 @@ _ThreadGetReadyThread(
 
         ASSERT( pNextThread->State == ThreadStateReady );
         bIdleScheduled = FALSE;
+
+        ASSERT(m_threadSystemData.ReadyThreadsCount > 0);
+        m_threadSystemData.ReadyThreadsCount--;
     }
 
     // maybe we shouldn't update idle time each time a thread is scheduled
@@ -1138,6 +1210,89 @@ _ThreadGetReadyThread(
     return pNextThread;
 }
 
+REQUIRES_EXCL_LOCK(m_threadSystemData.ReadyThreadsLock)
+static
+void
+_ThreadInsertReadyThread(
+    INOUT   PTHREAD                 Thread,
+    IN      BOOLEAN                 WokenUp,
+    IN      BOOLEAN                 Preempted
+    )
+{
+    ASSERT(NULL != Thread);
+    ASSERT(LockIsOwner(&m_threadSystemData.ReadyThreadsLock));
+
+    Thread->SchedulerStats.ReadyTimestamp = RtcGetTickCount();
+    Thread->SchedulerStats.WokenUp = WokenUp;
+    Thread->SchedulerStats.Preempted = Preempted;
+
+    InsertTailList(&m_threadSystemData.ReadyThreadsList, &Thread->ReadyList);
+    m_threadSystemData.ReadyThreadsCount++;
+}
+
+REQUIRES_EXCL_LOCK(m_threadSystemData.ReadyThreadsLock)
+static
+void
+_ThreadUpdateSchedulerStats(
+    INOUT   PTHREAD                 CurrentThread,
+    INOUT   PTHREAD                 NextThread
+    )
+{
+    PTHREAD_SCHEDULER_STATS pCurrentStats;
+    PTHREAD_SCHEDULER_STATS pNextStats;
+    QWORD now;
+    QWORD waitTime;
+    THREAD_LATENCY_TYPE latencyType;
+
+    ASSERT(NULL != CurrentThread);
+    ASSERT(NULL != NextThread);
+    ASSERT(CurrentThread != NextThread);
+    ASSERT(LockIsOwner(&m_threadSystemData.ReadyThreadsLock));
+
+    pCurrentStats = &CurrentThread->SchedulerStats;
+    pNextStats = &NextThread->SchedulerStats;
+    now = RtcGetTickCount();
+
+    if (0 != pCurrentStats->RunTimestamp)
+    {
+        pCurrentStats->RunTime += now - pCurrentStats->RunTimestamp;
+    }
+
+    if (ThreadStateReady == CurrentThread->State && pCurrentStats->Preempted)
+    {
+        pCurrentStats->InvoluntarySwitches++;
+    }
+    else
+    {
+        pCurrentStats->VoluntarySwitches++;
+    }
+
+    // the idle thread is never placed in the ready list, it is scheduled
+    // only when the list is empty
+    if (NextThread != GetCurrentPcpu()->ThreadData.IdleThread)
+    {
+        waitTime = now - pNextStats->ReadyTimestamp;
+
+        pNextStats->WaitTime += waitTime;
+        pNextStats->MaxWaitTime = max(pNextStats->MaxWaitTime, waitTime);
+        pNextStats->NumberOfWaits++;
+
+        // a thread which never ran was neither woken up nor requeued
+        if (0 == pNextStats->RunTimestamp)
+        {
+            latencyType = ThreadLatencyStart;
+        }
+        else
+        {
+            latencyType = pNextStats->WokenUp ? ThreadLatencyWakeup : ThreadLatencyRequeue;
+        }
+
+        HistogramRecord(&m_threadSystemData.LatencyHistograms[latencyType], waitTime);
+    }
+
+    pNextStats->RunTimestamp = now;
+}
+
 static
 void
 _ThreadForcedExit(
@@ -0,0 +1,410 @@
+#include "HAL9000.h"
+#include "trace.h"
+#include "cpumu.h"
+#include "smp.h"
+#include "mutex.h"
+#include "rtc.h"
+#include "iomu.h"
+#include "serial_comm.h"
+#include "thread_internal.h"
+
+// must be a power of 2
+#define TRACE_RECORDS_PER_CPU           2048
+STATIC_ASSERT(0 == (TRACE_RECORDS_PER_CPU & (TRACE_RECORDS_PER_CPU - 1)));
+
+#define TRACE_LINE_MAX_SIZE             256
+
+typedef struct _TRACE_RECORD
+{
+    // index of the record + 1 after it was completely written, 0 or the
+    // sequence of the previous lap while it is being written
+    volatile QWORD          Sequence;
+
+    QWORD                   Timestamp;
+    TID                     ThreadId;
+
+    TRACE_EVENT             Event;
+    DWORD                   Reserved;
+
+    QWORD                   Args[TRACE_MAX_ARGS];
+} TRACE_RECORD, *PTRACE_RECORD;
+STATIC_ASSERT(sizeof(TRACE_RECORD) == 64);
+
+typedef struct _TRACE_BUFFER
+{
+    // index of the next record to be written, it never wraps around
+    _Interlocked_
+    volatile QWORD          Head;
+
+    // index of the first record not yet dumped, only used by TraceDump
+    QWORD                   Tail;
+
+    TRACE_RECORD            Records[TRACE_RECORDS_PER_CPU];
+} TRACE_BUFFER, *PTRACE_BUFFER;
+
+typedef struct _TRACE_CURSOR
+{
+    PPCPU                   Cpu;
+
+    QWORD                   Next;
+    QWORD                   End;
+
+    BOOLEAN                 Valid;
+    TRACE_RECORD            Record;
+} TRACE_CURSOR, *PTRACE_CURSOR;
+
+typedef struct _TRACE_EVENT_DESCRIPTOR
+{
+    char*                   Name;
+
+    // receives all the TRACE_MAX_ARGS arguments
+    char*                   Format;
+} TRACE_EVENT_DESCRIPTOR, *PTRACE_EVENT_DESCRIPTOR;
+
+typedef struct _TRACE_DATA
+{
+    // serializes TraceStart and TraceDump
+    MUTEX                   Lock;
+} TRACE_DATA, *PTRACE_DATA;
+
+static const TRACE_EVENT_DESCRIPTOR TRACE_EVENTS[TraceEventReserved] =
+{
+    { "ThreadSwitch",       "prev=0x%X next=0x%X prev_state=%u" },
+    { "ThreadYield",        "tid=0x%X forced=%u" },
+    { "ThreadBlock",        "tid=0x%X" },
+    { "ThreadUnblock",      "tid=0x%X" },
+    { "PageFault",          "address=0x%X rights=0x%x solved=%u" },
+    { "IrpDispatch",        "device=0x%X irp=0x%X major=%u" },
+    { "IrpDispatchDone",    "device=0x%X irp=0x%X status=0x%x" },
+    { "IrpComplete",        "irp=0x%X status=0x%x" },
+    { "InterruptEnter",     "vector=0x%02x" },
+    { "InterruptExit",      "vector=0x%02x handled=%u" },
+};
+
+volatile TRACE_CATEGORY gTraceCategories;
+
+static TRACE_DATA m_traceData;
+
+static
+void
+_TraceCursorAdvance(
+    INOUT   PTRACE_CURSOR           Cursor,
+    INOUT   QWORD*                  RecordsLost
+    );
+
+static
+void
+_TraceWriteRecord(
+    IN      PTRACE_CURSOR           Cursor
+    );
+
+_No_competing_thread_
+void
+TraceSystemPreinit(
+    void
+    )
+{
+    memzero(&m_traceData, sizeof(TRACE_DATA));
+
+    MutexInit(&m_traceData.Lock, FALSE);
+
+    gTraceCategories = 0;
+}
+
+STATUS
+TraceStart(
+    IN      TRACE_CATEGORY          Categories
+    )
+{
+    STATUS status;
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+
+    status = STATUS_SUCCESS;
+    pCpuListHead = NULL;
+
+    SmpGetCpuList(&pCpuListHead);
+
+    MutexAcquire(&m_traceData.Lock);
+
+    for (pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead;
+         pCurEntry = pCurEntry->Flink)
+    {
+        PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+        PTRACE_BUFFER pBuffer;
+
+        if (NULL != pCpu->TraceBuffer)
+        {
+            continue;
+        }
+
+        pBuffer = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(TRACE_BUFFER), HEAP_TRACE_TAG, 0);
+        if (NULL == pBuffer)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(TRACE_BUFFER));
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        _InterlockedExchangePointer(&pCpu->TraceBuffer, pBuffer);
+    }
+
+    if (SUCCEEDED(status))
+    {
+        _InterlockedExchange(&gTraceCategories, Categories);
+    }
+
+    MutexRelease(&m_traceData.Lock);
+
+    return status;
+}
+
+void
+TraceStop(
+    void
+    )
+{
+    _InterlockedExchange(&gTraceCategories, 0);
+}
+
+void
+TraceRecordEvent(
+    IN      TRACE_EVENT             Event,
+    IN      QWORD                   Arg0,
+    IN      QWORD                   Arg1,
+    IN      QWORD                   Arg2,
+    IN      QWORD                   Arg3
+    )
+{
+    PPCPU pCpu;
+    PTHREAD pThread;
+    PTRACE_BUFFER pBuffer;
+    PTRACE_RECORD pRecord;
+    QWORD index;
+
+    ASSERT(Event < TraceEventReserved);
+
+    // if the thread migrates after the PCPU is read the record is written in
+    // the buffer of the previous CPU, which is fine because the slots are
+    // reserved with an atomic increment
+    pCpu = GetCurrentPcpu();
+    if (NULL == pCpu)
+    {
+        return;
+    }
+
+    pBuffer = pCpu->TraceBuffer;
+    if (NULL == pBuffer)
+    {
+        // the CPU was woken up after tracing was started
+        return;
+    }
+
+    pThread = GetCurrentThread();
+
+    index = _InterlockedIncrement64(&pBuffer->Head) - 1;
+    pRecord = &pBuffer->Records[index & (TRACE_RECORDS_PER_CPU - 1)];
+
+    pRecord->Sequence = 0;
+    _ReadWriteBarrier();
+
+    pRecord->Timestamp = RtcGetTickCount();
+    pRecord->ThreadId = (NULL != pThread) ? pThread->Id : 0;
+    pRecord->Event = Event;
+    pRecord->Args[0] = Arg0;
+    pRecord->Args[1] = Arg1;
+    pRecord->Args[2] = Arg2;
+    pRecord->Args[3] = Arg3;
+
+    _ReadWriteBarrier();
+    pRecord->Sequence = index + 1;
+}
+
+QWORD
+TraceDump(
+    OUT_OPT QWORD*                  RecordsLost
+    )
+{
+    PLIST_ENTRY pCpuListHead;
+    PLIST_ENTRY pCurEntry;
+    PTRACE_CURSOR pCursors;
+    DWORD noOfCpus;
+    DWORD noOfCursors;
+    QWORD recordsDumped;
+    QWORD recordsLost;
+    DWORD i;
+
+    pCpuListHead = NULL;
+    recordsDumped = 0;
+    recordsLost = 0;
+    noOfCpus = SmpGetNumberOfActiveCpus();
+    noOfCursors = 0;
+
+    pCursors = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(TRACE_CURSOR) * noOfCpus, HEAP_TRACE_TAG, 0);
+    if (NULL == pCursors)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(TRACE_CURSOR) * noOfCpus);
+        return 0;
+    }
+
+    SmpGetCpuList(&pCpuListHead);
+
+    MutexAcquire(&m_traceData.Lock);
+
+    // the records written after the heads are read are left for the next dump
+    for (pCurEntry = pCpuListHead->Flink;
+         pCurEntry != pCpuListHead && noOfCursors < noOfCpus;
+         pCurEntry = pCurEntry->Flink)
+    {
+        PPCPU pCpu = CONTAINING_RECORD(pCurEntry, PCPU, ListEntry);
+        PTRACE_CURSOR pCursor;
+
+        if (NULL == pCpu->TraceBuffer)
+        {
+            continue;
+        }
+
+        pCursor = &pCursors[noOfCursors];
+        pCursor->Cpu = pCpu;
+        pCursor->End = pCpu->TraceBuffer->Head;
+        pCursor->Next = pCpu->TraceBuffer->Tail;
+
+        if (pCursor->End - pCursor->Next > TRACE_RECORDS_PER_CPU)
+        {
+            recordsLost = recordsLost + (pCursor->End - pCursor->Next - TRACE_RECORDS_PER_CPU);
+            pCursor->Next = pCursor->End - TRACE_RECORDS_PER_CPU;
+        }
+
+        _TraceCursorAdvance(pCursor, &recordsLost);
+
+        noOfCursors++;
+    }
+
+    // merge the records of all the CPUs by timestamp
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        PTRACE_CURSOR pOldest = NULL;
+
+        for (i = 0; i < noOfCursors; ++i)
+        {
+            if (pCursors[i].Valid &&
+                (NULL == pOldest || pCursors[i].Record.Timestamp < pOldest->Record.Timestamp))
+            {
+                pOldest = &pCursors[i];
+            }
+        }
+
+        if (NULL == pOldest)
+        {
+            break;
+        }
+
+        _TraceWriteRecord(pOldest);
+        recordsDumped++;
+
+        _TraceCursorAdvance(pOldest, &recordsLost);
+    }
+
+    for (i = 0; i < noOfCursors; ++i)
+    {
+        pCursors[i].Cpu->TraceBuffer->Tail = pCursors[i].Next;
+    }
+
+    MutexRelease(&m_traceData.Lock);
+
+    ExFreePoolWithTag(pCursors, HEAP_TRACE_TAG);
+
+    if (NULL != RecordsLost)
+    {
+        *RecordsLost = recordsLost;
+    }
+
+    return recordsDumped;
+}
+
+static
+void
+_TraceCursorAdvance(
+    INOUT   PTRACE_CURSOR           Cursor,
+    INOUT   QWORD*                  RecordsLost
+    )
+{
+    PTRACE_RECORD pRecord;
+    QWORD sequence;
+
+    ASSERT(NULL != Cursor);
+    ASSERT(NULL != RecordsLost);
+
+    Cursor->Valid = FALSE;
+
+    while (Cursor->Next < Cursor->End)
+    {
+        pRecord = &Cursor->Cpu->TraceBuffer->Records[Cursor->Next & (TRACE_RECORDS_PER_CPU - 1)];
+
+        // A slot reserved by a writer holds the sequence of the previous lap
+        // until the writer clears it, so any sequence lower than the expected
+        // one means the record is still being written. It will be dumped the
+        // next time. A greater sequence means it was overwritten.
+        sequence = pRecord->Sequence;
+        if (sequence < Cursor->Next + 1)
+        {
+            Cursor->End = Cursor->Next;
+            break;
+        }
+
+        if (sequence == Cursor->Next + 1)
+        {
+            _ReadWriteBarrier();
+            memcpy(&Cursor->Record, (PVOID) pRecord, sizeof(TRACE_RECORD));
+            _ReadWriteBarrier();
+
+            // if the sequence changed while copying the record was overwritten
+            Cursor->Valid = (pRecord->Sequence == sequence);
+        }
+
+        Cursor->Next++;
+
+        if (Cursor->Valid)
+        {
+            break;
+        }
+
+        *RecordsLost = *RecordsLost + 1;
+    }
+}
+
+static
+void
+_TraceWriteRecord(
+    IN      PTRACE_CURSOR           Cursor
+    )
+{
+    char line[TRACE_LINE_MAX_SIZE];
+    PTRACE_RECORD pRecord;
+    DWORD length;
+
+    ASSERT(NULL != Cursor);
+    ASSERT(Cursor->Valid);
+
+    pRecord = &Cursor->Record;
+    ASSERT(pRecord->Event < TraceEventReserved);
+
+    snprintf(line, TRACE_LINE_MAX_SIZE, "TRACE %U [CPU:%02x][TID:0x%X] %s ",
+             IomuTickCountToNs(pRecord->Timestamp),
+             Cursor->Cpu->ApicId,
+             pRecord->ThreadId,
+             TRACE_EVENTS[pRecord->Event].Name);
+    length = strlen(line);
+
+    snprintf(line + length, TRACE_LINE_MAX_SIZE - length - 1, TRACE_EVENTS[pRecord->Event].Format,
+             pRecord->Args[0], pRecord->Args[1], pRecord->Args[2], pRecord->Args[3]);
+    length = strlen(line);
+
+    line[length] = '\n';
+    line[length + 1] = '\0';
+
+    SerialCommWriteBuffer(line);
+}
@@ -0,0 +1,282 @@
+#include "HAL9000.h"
+#include "um_net_ring.h"
+#include "process_internal.h"
+#include "mmu.h"
+
+typedef struct _UM_NET_RING
+{
+    // one reference is held by the process list, the others by the system
+    // calls using the ring
+    REF_COUNT                       RefCnt;
+
+    LIST_ENTRY                      NextRing;
+
+    PPROCESS                        Process;
+    PNET_RING                       Ring;
+
+    // the address at which the ring is mapped in the process
+    PNET_RING_HEADER                UserAddress;
+} UM_NET_RING, *PUM_NET_RING;
+
+static FUNC_FreeFunction            _UmNetRingDestroy;
+
+static
+PUM_NET_RING
+_UmNetRingReference(
+    IN          PPROCESS                Process,
+    IN          PNET_RING_HEADER        Ring,
+    IN          BOOLEAN                 Remove
+    );
+
+STATUS
+UmNetRingCreate(
+    INOUT       PPROCESS                Process,
+    IN          DEVICE_ID               DeviceId,
+    IN          DWORD                   SlotCount,
+    OUT         PNET_RING_HEADER*       Ring
+    )
+{
+    STATUS status;
+    PUM_NET_RING pUmRing;
+    PNET_RING_HEADER pHeader;
+    PVOID pUserAddress;
+    DWORD size;
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Process);
+    ASSERT(NULL != Ring);
+
+    status = STATUS_SUCCESS;
+    pUmRing = NULL;
+
+    __try
+    {
+        pUmRing = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(UM_NET_RING), HEAP_PROCESS_TAG, 0);
+        if (NULL == pUmRing)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(UM_NET_RING));
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        RfcPreInit(&pUmRing->RefCnt);
+        pUmRing->Process = Process;
+
+        status = NetRingCreate(DeviceId, SlotCount, &pUmRing->Ring);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("NetRingCreate", status);
+            __leave;
+        }
+
+        pHeader = NetRingGetHeader(pUmRing->Ring, &size);
+
+        status = MmuGetUserVirtualAddressForSystemBuffer(pHeader,
+                                                         size,
+                                                         PAGE_RIGHTS_READWRITE,
+                                                         Process,
+                                                         &pUserAddress);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("MmuGetUserVirtualAddressForSystemBuffer", status);
+            __leave;
+        }
+        pUmRing->UserAddress = pUserAddress;
+
+        status = RfcInit(&pUmRing->RefCnt, _UmNetRingDestroy, NULL);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("RfcInit", status);
+            __leave;
+        }
+
+        LockAcquire(&Process->NetRingListLock, &intrState);
+        InsertTailList(&Process->NetRingList, &pUmRing->NextRing);
+        LockRelease(&Process->NetRingListLock, intrState);
+
+        *Ring = pUmRing->UserAddress;
+
+        LOG_TRACE_PROCESS("Mapped ring of device %u at 0x%X in process 0x%X\n",
+                          DeviceId, pUmRing->UserAddress, Process->Id);
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status) && NULL != pUmRing)
+        {
+            _UmNetRingDestroy(&pUmRing->RefCnt, NULL);
+            pUmRing = NULL;
+        }
+    }
+
+    return status;
+}
+
+STATUS
+UmNetRingTransmit(
+    IN          PPROCESS                Process,
+    IN          PNET_RING_HEADER        Ring,
+    OUT_OPT     DWORD*                  FramesSent
+    )
+{
+    STATUS status;
+    PUM_NET_RING pUmRing;
+
+    ASSERT(NULL != Process);
+
+    pUmRing = _UmNetRingReference(Process, Ring, FALSE);
+    if (NULL == pUmRing)
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    status = NetRingTransmit(pUmRing->Ring, FramesSent);
+
+    RfcDereference(&pUmRing->RefCnt);
+
+    return status;
+}
+
+STATUS
+UmNetRingWait(
+    IN          PPROCESS                Process,
+    IN          PNET_RING_HEADER        Ring
+    )
+{
+    PUM_NET_RING pUmRing;
+
+    ASSERT(NULL != Process);
+
+    pUmRing = _UmNetRingReference(Process, Ring, FALSE);
+    if (NULL == pUmRing)
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    NetRingWait(pUmRing->Ring);
+
+    RfcDereference(&pUmRing->RefCnt);
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+UmNetRingClose(
+    INOUT       PPROCESS                Process,
+    IN          PNET_RING_HEADER        Ring
+    )
+{
+    PUM_NET_RING pUmRing;
+
+    ASSERT(NULL != Process);
+
+    pUmRing = _UmNetRingReference(Process, Ring, TRUE);
+    if (NULL == pUmRing)
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    // once for the reference just taken and once for the one of the list
+    RfcDereference(&pUmRing->RefCnt);
+    RfcDereference(&pUmRing->RefCnt);
+
+    return STATUS_SUCCESS;
+}
+
+void
+UmNetRingCloseAll(
+    INOUT       PPROCESS                Process
+    )
+{
+    PLIST_ENTRY pEntry;
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Process);
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        LockAcquire(&Process->NetRingListLock, &intrState);
+        pEntry = RemoveHeadList(&Process->NetRingList);
+        LockRelease(&Process->NetRingListLock, intrState);
+
+        if (pEntry == &Process->NetRingList)
+        {
+            break;
+        }
+
+        // no thread of the process is left to hold another reference
+        RfcDereference(&CONTAINING_RECORD(pEntry, UM_NET_RING, NextRing)->RefCnt);
+    }
+}
+
+static
+PUM_NET_RING
+_UmNetRingReference(
+    IN          PPROCESS                Process,
+    IN          PNET_RING_HEADER        Ring,
+    IN          BOOLEAN                 Remove
+    )
+{
+    PLIST_ENTRY pEntry;
+    PUM_NET_RING pUmRing;
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Process);
+
+    pUmRing = NULL;
+
+    LockAcquire(&Process->NetRingListLock, &intrState);
+
+    for (pEntry = Process->NetRingList.Flink;
+         pEntry != &Process->NetRingList;
+         pEntry = pEntry->Flink)
+    {
+        PUM_NET_RING pCurrent = CONTAINING_RECORD(pEntry, UM_NET_RING, NextRing);
+
+        if (pCurrent->UserAddress == Ring)
+        {
+            RfcReference(&pCurrent->RefCnt);
+
+            if (Remove)
+            {
+                RemoveEntryList(&pCurrent->NextRing);
+            }
+
+            pUmRing = pCurrent;
+            break;
+        }
+    }
+
+    LockRelease(&Process->NetRingListLock, intrState);
+
+    return pUmRing;
+}
+
+static
+void
+_UmNetRingDestroy(
+    IN      PVOID                   Object,
+    IN_OPT  PVOID                   Context
+    )
+{
+    PUM_NET_RING pUmRing = (PUM_NET_RING) CONTAINING_RECORD(Object, UM_NET_RING, RefCnt);
+
+    ASSERT(NULL != pUmRing);
+    ASSERT(NULL == Context);
+
+    // the process must not see the memory once it goes back to the kernel
+    if (NULL != pUmRing->UserAddress)
+    {
+        MmuFreeUserVirtualAddressForSystemBuffer(pUmRing->UserAddress, pUmRing->Process);
+        pUmRing->UserAddress = NULL;
+    }
+
+    if (NULL != pUmRing->Ring)
+    {
+        NetRingDestroy(pUmRing->Ring);
+        pUmRing->Ring = NULL;
+    }
+
+    ExFreePoolWithTag(pUmRing, HEAP_PROCESS_TAG);
+}
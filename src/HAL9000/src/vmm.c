@@ -10,6 +10,7 @@
 #include "thread_internal.h"
 #include "process_internal.h"
 #include "mdl.h"
+#include "trace.h"
 
 #define VMM_SIZE_FOR_RESERVATION_METADATA            (5*TB_SIZE)
 
@@ -860,6 +861,8 @@ VmmSolvePageFault(
 
     }
 
+    TRACE_VMM(TraceEventVmmPageFault, FaultingAddress, RightsRequested, bSolvedPageFault);
+
     return bSolvedPageFault;
 }
 
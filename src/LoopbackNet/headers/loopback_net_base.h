@@ -0,0 +1,8 @@
+#pragma once
+
+#include "common_lib.h"
+#include "log.h"
+#include "io.h"
+#include "ex.h"
+#include "network.h"
+#include "loopback_net_structures.h"
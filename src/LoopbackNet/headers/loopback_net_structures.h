@@ -0,0 +1,42 @@
+#pragma once
+
+// device 0 receives the frames it sends, devices 1 and 2 receive each
+// other's frames as if they were connected by a cable
+#define LOOPBACK_NET_NO_OF_DEVICES              3
+
+#define LOOPBACK_NET_MAX_QUEUES                 2
+
+#define LOOPBACK_NET_NO_OF_RX_BUFFERS           128
+#define LOOPBACK_NET_NO_OF_TX_BUFFERS           128
+
+#define LOOPBACK_NET_BUFFER_SIZE                (2 * KB_SIZE)
+
+typedef struct _LOOPBACK_NET_RX_QUEUE
+{
+    // the frames are written in the buffers of the descriptors in order,
+    // exactly like a device would. The only producer is the TX worker thread
+    // of the same queue of the peer, so no lock is needed
+    DWORD                                   NextDescriptor;
+    DWORD                                   NumberOfBuffers;
+
+    // Statistics
+    volatile QWORD                          NumberOfFramesReceived;
+    volatile QWORD                          NumberOfFramesDropped;
+} LOOPBACK_NET_RX_QUEUE, *PLOOPBACK_NET_RX_QUEUE;
+
+typedef struct _LOOPBACK_NET_DEVICE
+{
+    struct _MINIPORT_DEVICE*                MiniportDevice;
+
+    // index in the driver's device array, it determines the peer
+    DWORD                                   Index;
+
+    // the device which receives the frames sent on this one, the link is up
+    // only while there is one
+    struct _LOOPBACK_NET_DEVICE*            Peer;
+
+    BYTE                                    NumberOfQueues;
+
+    // the frames sent on TX queue i are received on RX queue i of the peer
+    LOOPBACK_NET_RX_QUEUE                   RxQueues[LOOPBACK_NET_MAX_QUEUES];
+} LOOPBACK_NET_DEVICE, *PLOOPBACK_NET_DEVICE;
@@ -0,0 +1,313 @@
+#include "loopback_net_base.h"
+#include "loopback_net.h"
+#include "network_port.h"
+
+STATIC_ASSERT(LOOPBACK_NET_MAX_QUEUES <= NETWORK_PORT_MAX_QUEUES);
+
+typedef struct _LOOPBACK_NET_DATA
+{
+    // in the order in which the port driver initialized them, the index of a
+    // device determines its peer
+    PLOOPBACK_NET_DEVICE                Devices[LOOPBACK_NET_NO_OF_DEVICES];
+    DWORD                               NumberOfDevices;
+} LOOPBACK_NET_DATA, *PLOOPBACK_NET_DATA;
+
+static LOOPBACK_NET_DATA m_loopbackNetData;
+
+static FUNC_NetworkMiniportInitializeDevice         _LoopbackNetInitializeMiniport;
+static FUNC_NetworkMiniportSendBuffers              _LoopbackNetSendBuffers;
+static FUNC_NetworkMiniportInterruptHandler         _LoopbackNetInterrupt;
+static FUNC_NetworkMiniportChangeDeviceStatus       _LoopbackNetChangeDeviceStatus;
+
+static
+void
+_LoopbackNetConnectDevices(
+    void
+    );
+
+static
+void
+_LoopbackNetReceiveFrame(
+    INOUT   PLOOPBACK_NET_DEVICE        Device,
+    IN      BYTE                        QueueIndex,
+    IN_READS_BYTES(Length)
+            BYTE*                       Frame,
+    IN      WORD                        Length
+    );
+
+STATUS
+(__cdecl LoopbackNetDriverEntry)(
+    INOUT       PDRIVER_OBJECT      DriverObject
+    )
+{
+    STATUS status;
+    MINIPORT_REGISTRATION registration;
+
+    ASSERT( NULL != DriverObject );
+
+    LOG_FUNC_START;
+
+    status = STATUS_SUCCESS;
+
+    memzero(&m_loopbackNetData, sizeof(LOOPBACK_NET_DATA));
+    memzero(&registration, sizeof(MINIPORT_REGISTRATION));
+
+    registration.NumberOfVirtualDevices = LOOPBACK_NET_NO_OF_DEVICES;
+
+    registration.DeviceContextSize = sizeof(LOOPBACK_NET_DEVICE);
+    registration.NumberOfQueues = LOOPBACK_NET_MAX_QUEUES;
+
+    // there is no hardware to share descriptors with, the rings are
+    // allocated only because the port driver requires them
+    registration.RxBuffers.BufferSize = LOOPBACK_NET_BUFFER_SIZE;
+    registration.RxBuffers.DescriptorSize = sizeof(QWORD);
+    registration.RxBuffers.NumberOfBuffers = LOOPBACK_NET_NO_OF_RX_BUFFERS;
+
+    registration.TxBuffers.BufferSize = LOOPBACK_NET_BUFFER_SIZE;
+    registration.TxBuffers.DescriptorSize = sizeof(QWORD);
+    registration.TxBuffers.NumberOfBuffers = LOOPBACK_NET_NO_OF_TX_BUFFERS;
+
+    registration.MiniportFunctions.MiniportInitializeDevice = _LoopbackNetInitializeMiniport;
+    registration.MiniportFunctions.MiniportUninitializeDevice = NULL;
+    registration.MiniportFunctions.MiniportSendBuffers = _LoopbackNetSendBuffers;
+    registration.MiniportFunctions.MiniportInterruptHandler = _LoopbackNetInterrupt;
+    registration.MiniportFunctions.MiniportChangeDeviceStatus = _LoopbackNetChangeDeviceStatus;
+    registration.MiniportFunctions.MiniportGetInterruptModeration = NULL;
+    registration.MiniportFunctions.MiniportQueueInterruptHandler = NULL;
+
+    status = NetworkPortRegisterMiniportDriver(DriverObject,
+                                               &registration
+                                               );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetworkPortRegisterMiniportDriver", status );
+        return status;
+    }
+
+    // the devices are connected only once all of them are initialized so a
+    // device never sends to a peer the port driver did not finish setting up
+    _LoopbackNetConnectDevices();
+
+    LOG_FUNC_END;
+
+    return status;
+}
+
+static
+STATUS
+(__cdecl _LoopbackNetInitializeMiniport)(
+    INOUT                           PMINIPORT_DEVICE                    MiniportDevice,
+    IN                              PMINIPORT_DEVICE_INITIALIZATION     MiniportInitialization
+    )
+{
+    PLOOPBACK_NET_DEVICE pNetDevice;
+    BYTE q;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != MiniportInitialization );
+    ASSERT( NULL == MiniportInitialization->PciDevice );
+    ASSERT( 0 != MiniportInitialization->NumberOfQueues );
+    ASSERT( MiniportInitialization->NumberOfQueues <= LOOPBACK_NET_MAX_QUEUES );
+
+    if (m_loopbackNetData.NumberOfDevices >= LOOPBACK_NET_NO_OF_DEVICES)
+    {
+        return STATUS_DEVICE_COULD_NOT_BE_CREATED;
+    }
+
+    pNetDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pNetDevice );
+
+    pNetDevice->MiniportDevice = MiniportDevice;
+    pNetDevice->Index = m_loopbackNetData.NumberOfDevices;
+    pNetDevice->NumberOfQueues = MiniportInitialization->NumberOfQueues;
+
+    for (q = 0; q < pNetDevice->NumberOfQueues; ++q)
+    {
+        pNetDevice->RxQueues[q].NumberOfBuffers = MiniportInitialization->RxBuffers[q].NumberOfBuffers;
+    }
+
+    // locally administered unicast address
+    MiniportDevice->PhysicalAddress.Value[0] = 0x02;
+    MiniportDevice->PhysicalAddress.Value[1] = 0x00;
+    MiniportDevice->PhysicalAddress.Value[2] = 0x00;
+    MiniportDevice->PhysicalAddress.Value[3] = 0x4C;
+    MiniportDevice->PhysicalAddress.Value[4] = 0x42;
+    MiniportDevice->PhysicalAddress.Value[5] = (BYTE) pNetDevice->Index;
+
+    // the link comes up once the device has a peer
+    MiniportDevice->LinkUp = FALSE;
+    MiniportDevice->DeviceStatus.RxEnabled = TRUE;
+    MiniportDevice->DeviceStatus.TxEnabled = TRUE;
+
+    m_loopbackNetData.Devices[pNetDevice->Index] = pNetDevice;
+    m_loopbackNetData.NumberOfDevices++;
+
+    LOG_TRACE_NETWORK("Loopback device %u has %u queues\n", pNetDevice->Index, pNetDevice->NumberOfQueues);
+
+    return STATUS_SUCCESS;
+}
+
+static
+STATUS
+(__cdecl _LoopbackNetSendBuffers)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  BYTE                        QueueIndex,
+    IN  WORD                        FirstDescriptorIndex,
+    IN  WORD                        NumberOfBuffers,
+    IN_READS(NumberOfBuffers)
+        WORD*                       Lengths
+    )
+{
+    PLOOPBACK_NET_DEVICE pNetDevice;
+    PLOOPBACK_NET_DEVICE pPeer;
+    PBYTE pFrame;
+    DWORD descriptorIndex;
+    WORD i;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != Lengths );
+
+    pNetDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pNetDevice );
+    ASSERT( QueueIndex < pNetDevice->NumberOfQueues );
+
+    // the port driver does not send while the link is down
+    pPeer = pNetDevice->Peer;
+    ASSERT( NULL != pPeer );
+
+    descriptorIndex = FirstDescriptorIndex;
+
+    for (i = 0; i < NumberOfBuffers; ++i)
+    {
+        pFrame = NetworkPortGetTransmitBuffer(MiniportDevice, QueueIndex, descriptorIndex);
+        ASSERT( NULL != pFrame );
+
+        _LoopbackNetReceiveFrame(pPeer, QueueIndex, pFrame, Lengths[i]);
+
+        descriptorIndex = (descriptorIndex + 1) % LOOPBACK_NET_NO_OF_TX_BUFFERS;
+    }
+
+    // the frames were already copied, the descriptors can be reused at once
+    NetworkPortNotifyTxDescriptorAvailable(MiniportDevice, QueueIndex, NumberOfBuffers);
+
+    return STATUS_SUCCESS;
+}
+
+static
+BOOLEAN
+(__cdecl _LoopbackNetInterrupt)(
+    IN  PMINIPORT_DEVICE            MiniportDevice
+    )
+{
+    ASSERT( NULL != MiniportDevice );
+
+    // no interrupt is ever registered for a virtual device
+    NOT_REACHED;
+
+    return FALSE;
+}
+
+static
+void
+(__cdecl _LoopbackNetChangeDeviceStatus)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  PNETWORK_DEVICE_STATUS      DeviceStatus
+    )
+{
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != DeviceStatus );
+
+    // the port driver stops sending while TX is disabled and the peer drops
+    // the frames while RX is disabled, nothing else to do
+    LOG_TRACE_NETWORK("RX enabled: %u, TX enabled: %u\n", DeviceStatus->RxEnabled, DeviceStatus->TxEnabled);
+}
+
+static
+void
+_LoopbackNetConnectDevices(
+    void
+    )
+{
+    PLOOPBACK_NET_DEVICE pFirst;
+    PLOOPBACK_NET_DEVICE pSecond;
+    DWORD i;
+
+    // the first device is connected to itself
+    pFirst = m_loopbackNetData.Devices[0];
+    if (NULL != pFirst)
+    {
+        pFirst->Peer = pFirst;
+        NetworkPortNotifyLinkStatusChange(pFirst->MiniportDevice, TRUE);
+    }
+
+    // the others are cross-connected two by two, a device left without its
+    // pair keeps its link down
+    for (i = 1; i + 1 < LOOPBACK_NET_NO_OF_DEVICES; i = i + 2)
+    {
+        pFirst = m_loopbackNetData.Devices[i];
+        pSecond = m_loopbackNetData.Devices[i + 1];
+
+        if (NULL == pFirst || NULL == pSecond)
+        {
+            continue;
+        }
+
+        // both devices use the same number of queues, TX queue q of one
+        // device feeds RX queue q of the other
+        ASSERT( pFirst->NumberOfQueues == pSecond->NumberOfQueues );
+
+        pFirst->Peer = pSecond;
+        pSecond->Peer = pFirst;
+
+        NetworkPortNotifyLinkStatusChange(pFirst->MiniportDevice, TRUE);
+        NetworkPortNotifyLinkStatusChange(pSecond->MiniportDevice, TRUE);
+
+        LOG_TRACE_NETWORK("Cross-connected loopback devices %u and %u\n", pFirst->Index, pSecond->Index);
+    }
+}
+
+static
+void
+_LoopbackNetReceiveFrame(
+    INOUT   PLOOPBACK_NET_DEVICE        Device,
+    IN      BYTE                        QueueIndex,
+    IN_READS_BYTES(Length)
+            BYTE*                       Frame,
+    IN      WORD                        Length
+    )
+{
+    PLOOPBACK_NET_RX_QUEUE pRxQueue;
+    PVOID pBuffer;
+    PHYSICAL_ADDRESS newBufferAddress;
+    STATUS status;
+
+    ASSERT( NULL != Device );
+    ASSERT( QueueIndex < Device->NumberOfQueues );
+    ASSERT( NULL != Frame );
+
+    pRxQueue = &Device->RxQueues[QueueIndex];
+
+    if (!Device->MiniportDevice->DeviceStatus.RxEnabled ||
+        Length > LOOPBACK_NET_BUFFER_SIZE)
+    {
+        _InterlockedIncrement64(&pRxQueue->NumberOfFramesDropped);
+        return;
+    }
+
+    pBuffer = NetworkPortGetReceiveBuffer(Device->MiniportDevice, QueueIndex, pRxQueue->NextDescriptor);
+    ASSERT( NULL != pBuffer );
+
+    memcpy(pBuffer, Frame, Length);
+
+    // the port driver re-arms the descriptor by itself, the new address only
+    // matters to a device doing DMA
+    status = NetworkPortNotifyReceiveBuffer(Device->MiniportDevice,
+                                            QueueIndex,
+                                            pRxQueue->NextDescriptor,
+                                            Length,
+                                            &newBufferAddress);
+    ASSERT( SUCCEEDED(status) );
+
+    pRxQueue->NextDescriptor = (pRxQueue->NextDescriptor + 1) % pRxQueue->NumberOfBuffers;
+    _InterlockedIncrement64(&pRxQueue->NumberOfFramesReceived);
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+// IOCTL_NET_SEND_FRAME and IOCTL_NET_[TRY_]RECEIVE_FRAME only touch the queues
+// under their own locks, they may be dispatched concurrently with any other
+// request, as may IOCTL_NET_WAIT_RX_READY which only waits for a status change
 FUNC_DriverDispatch             NetPortDeviceControl;
 
 FUNC_ThreadStart                NetPortTransmitFunction;
\ No newline at end of file
@@ -21,24 +21,98 @@ typedef struct _PORT_BUFFERS
 
     LOCK                        FramesLock;
     LIST_ENTRY                  FramesList;
-    EX_EVENT                    FramesListNotEmptyEvent;
 
     volatile QWORD              NumberOfFramesTransferred;
 } PORT_BUFFERS, *PPORT_BUFFERS;
 
-typedef struct _RX_DATA
+// Each received frame is loaned up the stack in the DMA buffer it was
+// received in, the descriptor is re-armed with a buffer taken from the
+// free pool and the loaned buffer joins the pool again once the consumer
+// returns it through NetworkPortReturnReceiveBuffer
+#define NETWORK_PORT_RX_SPARE_BUFFERS_PER_DESCRIPTOR        2
+
+// maximum number of frames handed to the miniport in a single
+// MiniportSendBuffers call
+#define NETWORK_PORT_TX_BATCH_SIZE                          16
+
+typedef struct _RX_BUFFER_ENTRY
+{
+    // links the entry either in the FramesList or in the FreeBuffersList
+    LIST_ENTRY                  ListEntry;
+
+    PVOID                       Buffer;
+    PHYSICAL_ADDRESS            PhysicalAddress;
+
+    // number of valid bytes, valid only while the buffer is loaned
+    DWORD                       BufferSize;
+
+    // TRUE if the buffer was allocated by the port driver and not by
+    // _NetworkPortInitializeMiniportBuffers
+    BOOLEAN                     Spare;
+
+    // the buffer always returns to the free list of this queue
+    BYTE                        QueueIndex;
+} RX_BUFFER_ENTRY, *PRX_BUFFER_ENTRY;
+
+// Each queue has its own lock so the miniport can receive on all of its
+// queues in parallel, from the CPUs their interrupts are bound to
+typedef struct _RX_QUEUE
 {
     PORT_BUFFERS                Buffers;
+
+    DWORD                       NumberOfBufferEntries;
+    PRX_BUFFER_ENTRY            BufferEntries;
+
+    // indexed by descriptor, the buffer currently armed in each descriptor
+    PRX_BUFFER_ENTRY*           ArmedBuffers;
+
+    // buffers which are neither armed nor loaned, protected by
+    // Buffers.FramesLock
+    LIST_ENTRY                  FreeBuffersList;
+
+    volatile QWORD              NumberOfFramesDropped;
+} RX_QUEUE, *PRX_QUEUE;
+
+typedef struct _RX_DATA
+{
+    BYTE                        NumberOfQueues;
+    RX_QUEUE                    Queues[NETWORK_PORT_MAX_QUEUES];
+
+    // signaled while any of the queues may have frames, the consumer clears
+    // it before looking at the queues
+    EX_EVENT                    FramesListNotEmptyEvent;
+
+    // signaled when the link or the RX status changes, the consumer clears it
+    // before looking at them
+    EX_EVENT                    StatusChangedEvent;
+
+    // the queue looked at first by the next consumer so a busy queue cannot
+    // starve the others
+    volatile DWORD              NextQueue;
 } RX_DATA, *PRX_DATA;
 
-typedef struct _TX_DATA
+typedef struct _TX_QUEUE
 {
     PORT_BUFFERS                Buffers;
+    EX_EVENT                    FramesListNotEmptyEvent;
 
+    // signaled while NumberOfFreeDescriptors is non-zero, one descriptor is
+    // never used so a full ring can be told apart from an empty one
     EX_EVENT                    DescriptorsAvailable;
+    volatile DWORD              NumberOfFreeDescriptors;
 
     struct _THREAD*             TransmitWorkerThread;
     WORD                        CurrentTxIndex;
+
+    // the worker thread receives the queue as its context
+    struct _NETWORK_PORT_DEVICE*    PortDevice;
+    BYTE                        QueueIndex;
+} TX_QUEUE, *PTX_QUEUE;
+
+typedef struct _TX_DATA
+{
+    BYTE                        NumberOfQueues;
+    TX_QUEUE                    Queues[NETWORK_PORT_MAX_QUEUES];
 } TX_DATA, *PTX_DATA;
 
 typedef struct _NETWORK_PORT_DEVICE
@@ -75,14 +149,15 @@ NetworkPortDevicePreinit(
 
 STATUS
 NetworkPortDeviceInit(
-    INOUT       PNETWORK_PORT_DEVICE    PortDevice,
-    IN          PMINIPORT_DEVICE        MiniportDevice,
-    IN          DWORD                   NumberOfReceiveBuffers,
-    IN          PVOID*                  ReceiveBuffers,
-    IN          WORD                    ReceiveBufferSize,
-    IN          DWORD                   NumberOfTransmitBuffers,
-    IN          PVOID*                  TransmitBuffers,
-    IN          WORD                    TransmitBufferSize
+    INOUT       PNETWORK_PORT_DEVICE            PortDevice,
+    IN          PMINIPORT_DEVICE                MiniportDevice,
+    IN          BYTE                            NumberOfQueues,
+    IN          PMINIPORT_BUFFER_DESCRIPTION    ReceiveBuffersDescription,
+    IN_READS(NumberOfQueues)
+                PVOID**                         ReceiveBuffers,
+    IN          PMINIPORT_BUFFER_DESCRIPTION    TransmitBuffersDescription,
+    IN_READS(NumberOfQueues)
+                PVOID**                         TransmitBuffers
     );
 
 void
@@ -99,4 +174,10 @@ NetworkPortAllocateFrameDescriptor(
 void
 NetworkPortFreeFrameDescriptor(
     IN          PFRAME_DESCRIPTOR_ENTRY Descriptor
+    );
+
+void
+NetworkPortReturnReceiveBuffer(
+    INOUT       PNETWORK_PORT_DEVICE    PortDevice,
+    IN          PRX_BUFFER_ENTRY        Buffer
     );
\ No newline at end of file
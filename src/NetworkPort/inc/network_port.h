@@ -1,5 +1,8 @@
 #pragma once
 
+// maximum number of RX/TX queue pairs a miniport can use
+#define NETWORK_PORT_MAX_QUEUES             2
+
 typedef struct _MINIPORT_DEVICE
 {
     // IN - completed by NetworkPortRegisterMiniportDriver
@@ -25,9 +28,19 @@ typedef struct _MINIPORT_BUFFER_INITIALIZATION
 typedef struct _MINIPORT_DEVICE_INITIALIZATION
 {
     PPCI_BAR                        PciBar;
+    PPCI_DEVICE_DESCRIPTION         PciDevice;
+
+    // each queue pair has its own RX and TX rings, the miniport may lower
+    // the number if the device supports fewer queue pairs
+    BYTE                            NumberOfQueues;
 
-    MINIPORT_BUFFER_INITIALIZATION  RxBuffers;
-    MINIPORT_BUFFER_INITIALIZATION  TxBuffers;
+    // if TRUE MSI-X entry i is registered for queue pair i and entry
+    // NumberOfQueues for all the other interrupt causes, else a single
+    // interrupt is used for everything
+    BOOLEAN                         MsiXEnabled;
+
+    MINIPORT_BUFFER_INITIALIZATION  RxBuffers[NETWORK_PORT_MAX_QUEUES];
+    MINIPORT_BUFFER_INITIALIZATION  TxBuffers[NETWORK_PORT_MAX_QUEUES];
 } MINIPORT_DEVICE_INITIALIZATION, *PMINIPORT_DEVICE_INITIALIZATION;
 
 typedef
@@ -47,15 +60,22 @@ STATUS
 
 typedef FUNC_NetworkMiniportUninitializeDevice* PFUNC_NetworkMiniportUninitializeDevice;
 
+// Hands NumberOfBuffers consecutive TX descriptors (modulo the ring size)
+// starting at FirstDescriptorIndex of the QueueIndex TX ring to the device,
+// the buffers are already filled by the port driver. The device should be
+// notified only once for the whole vector.
 typedef
 STATUS
-(__cdecl FUNC_NetworkMiniportSendBuffer)(
+(__cdecl FUNC_NetworkMiniportSendBuffers)(
     IN  PMINIPORT_DEVICE            MiniportDevice,
-    IN  WORD                        DesccriptorIndex,
-    IN  WORD                        Length
+    IN  BYTE                        QueueIndex,
+    IN  WORD                        FirstDescriptorIndex,
+    IN  WORD                        NumberOfBuffers,
+    IN_READS(NumberOfBuffers)
+        WORD*                       Lengths
     );
 
-typedef FUNC_NetworkMiniportSendBuffer*         PFUNC_NetworkMiniportSendBuffer;
+typedef FUNC_NetworkMiniportSendBuffers*        PFUNC_NetworkMiniportSendBuffers;
 
 typedef
 BOOLEAN
@@ -65,6 +85,17 @@ BOOLEAN
 
 typedef FUNC_NetworkMiniportInterruptHandler*   PFUNC_NetworkMiniportInterruptHandler;
 
+// Called on the MSI-X vector of the QueueIndex queue pair, the vector is
+// bound to a different CPU for each queue pair
+typedef
+BOOLEAN
+(__cdecl FUNC_NetworkMiniportQueueInterruptHandler)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  BYTE                        QueueIndex
+    );
+
+typedef FUNC_NetworkMiniportQueueInterruptHandler*  PFUNC_NetworkMiniportQueueInterruptHandler;
+
 typedef
 void
 (__cdecl FUNC_NetworkMiniportChangeDeviceStatus)(
@@ -74,17 +105,33 @@ void
 
 typedef FUNC_NetworkMiniportChangeDeviceStatus* PFUNC_NetworkMiniportChangeDeviceStatus;
 
+typedef
+void
+(__cdecl FUNC_NetworkMiniportGetInterruptModeration)(
+    IN  PMINIPORT_DEVICE                MiniportDevice,
+    OUT PNETWORK_INTERRUPT_MODERATION   InterruptModeration
+    );
+
+typedef FUNC_NetworkMiniportGetInterruptModeration* PFUNC_NetworkMiniportGetInterruptModeration;
+
 typedef struct _MINIPORT_FUNCTIONS
 {
     PFUNC_NetworkMiniportInitializeDevice       MiniportInitializeDevice;
 
     PFUNC_NetworkMiniportUninitializeDevice     MiniportUninitializeDevice;
 
-    PFUNC_NetworkMiniportSendBuffer             MiniportSendBuffer;
+    PFUNC_NetworkMiniportSendBuffers            MiniportSendBuffers;
 
     PFUNC_NetworkMiniportInterruptHandler       MiniportInterruptHandler;
 
     PFUNC_NetworkMiniportChangeDeviceStatus     MiniportChangeDeviceStatus;
+
+    // optional
+    PFUNC_NetworkMiniportGetInterruptModeration MiniportGetInterruptModeration;
+
+    // optional, if present and the device supports MSI-X each queue pair
+    // receives its own vector
+    PFUNC_NetworkMiniportQueueInterruptHandler  MiniportQueueInterruptHandler;
 } MINIPORT_FUNCTIONS, *PMINIPORT_FUNCTIONS;
 
 typedef struct _MINIPORT_BUFFER_DESCRIPTION
@@ -98,8 +145,17 @@ typedef struct _MINIPORT_REGISTRATION
 {
     PCI_SPEC                                    Specification;
 
+    // if non-zero no PCI device is looked for, this many devices are created
+    // instead: the miniport receives no PCI device and no interrupt is
+    // registered for them
+    DWORD                                       NumberOfVirtualDevices;
+
     DWORD                                       DeviceContextSize;
 
+    // 0 is treated as 1, at most NETWORK_PORT_MAX_QUEUES
+    BYTE                                        NumberOfQueues;
+
+    // describe the buffers of each queue
     MINIPORT_BUFFER_DESCRIPTION                 RxBuffers;
     MINIPORT_BUFFER_DESCRIPTION                 TxBuffers;
 
@@ -118,21 +174,46 @@ NetworkPortGetMiniportExtension(
     IN      PMINIPORT_DEVICE        Device
     );
 
+// The frame is handed up the stack in the buffer it was received in. On
+// return BufferAddress holds the physical address of the buffer the miniport
+// must re-arm the descriptor with before giving it back to the device.
 STATUS
 NetworkPortNotifyReceiveBuffer(
     IN                          PMINIPORT_DEVICE        Device,
+    IN                          BYTE                    QueueIndex,
     IN                          DWORD                   DesciptorIndex,
-    IN                          DWORD                   BufferSize
+    IN                          DWORD                   BufferSize,
+    OUT                         PHYSICAL_ADDRESS*       BufferAddress
     );
 
-void
-NetworkPortNotifyTxDescriptorAvailable(
-    IN                          PMINIPORT_DEVICE        Device
+// Returns the buffer currently armed in the DescriptorIndex RX descriptor, for
+// miniports which must fix up a received frame before notifying the port.
+PTR_SUCCESS
+PVOID
+NetworkPortGetReceiveBuffer(
+    IN                          PMINIPORT_DEVICE        Device,
+    IN                          BYTE                    QueueIndex,
+    IN                          DWORD                   DescriptorIndex
     );
 
+// Returns the buffer of the DescriptorIndex TX descriptor, for miniports
+// which move the frames themselves instead of handing them to a device.
+PTR_SUCCESS
+PVOID
+NetworkPortGetTransmitBuffer(
+    IN                          PMINIPORT_DEVICE        Device,
+    IN                          BYTE                    QueueIndex,
+    IN                          DWORD                   DescriptorIndex
+    );
+
+// Called by the miniport once the device is done with NumberOfDescriptors
+// TX descriptors of the QueueIndex ring, in the order in which they were
+// handed to it.
 void
-NetworkPortNotifyTxQueueFull(
-    IN                          PMINIPORT_DEVICE        Device
+NetworkPortNotifyTxDescriptorAvailable(
+    IN                          PMINIPORT_DEVICE        Device,
+    IN                          BYTE                    QueueIndex,
+    IN                          WORD                    NumberOfDescriptors
     );
 
 void
@@ -6,6 +6,7 @@ static
 STATUS
 _NetDispatchReceiveFrame(
     INOUT                                   PNETWORK_PORT_DEVICE        Device,
+    IN                                      BOOLEAN                     Wait,
     IN                                      DWORD                       OutputBufferSize,
     OUT_WRITES_BYTES(OutputBufferSize)      PNET_RECEIVE_FRAME_OUTPUT   ReceiveOutput,
     OUT                                     QWORD*                      Information
@@ -26,6 +27,20 @@ _NetDispatchChangeDeviceStatus(
     IN                                      PNET_GET_SET_DEVICE_STATUS  DeviceStatus
     );
 
+static
+void
+_NetDispatchWaitRxReady(
+    INOUT                                   PNETWORK_PORT_DEVICE        Device
+    );
+
+static
+BYTE
+_NetDispatchSelectTxQueue(
+    IN                                      PNETWORK_PORT_DEVICE        Device,
+    IN                                      DWORD                       FrameSize,
+    IN_READS_BYTES(FrameSize)               PBYTE                       Frame
+    );
+
 STATUS
 NetPortDeviceControl(
     INOUT       PDEVICE_OBJECT          DeviceObject,
@@ -53,6 +68,7 @@ NetPortDeviceControl(
     switch (pStackLocation->Parameters.DeviceControl.IoControlCode)
     {
     case IOCTL_NET_RECEIVE_FRAME:
+    case IOCTL_NET_TRY_RECEIVE_FRAME:
         information = sizeof(NET_RECEIVE_FRAME_OUTPUT);
 
         if (pStackLocation->Parameters.DeviceControl.OutputBufferLength < information)
@@ -61,7 +77,11 @@ NetPortDeviceControl(
             break;
         }
 
-        status = _NetDispatchReceiveFrame(pPortDevice, pStackLocation->Parameters.DeviceControl.OutputBufferLength, pStackLocation->Parameters.DeviceControl.OutputBuffer, &information );
+        status = _NetDispatchReceiveFrame(pPortDevice,
+                                          IOCTL_NET_RECEIVE_FRAME == pStackLocation->Parameters.DeviceControl.IoControlCode,
+                                          pStackLocation->Parameters.DeviceControl.OutputBufferLength,
+                                          pStackLocation->Parameters.DeviceControl.OutputBuffer,
+                                          &information );
 
         break;
     case IOCTL_NET_GET_PHYSICAL_ADDRESS:
@@ -104,6 +124,32 @@ NetPortDeviceControl(
 
         status = _NetDispatchChangeDeviceStatus(pPortDevice, Irp->Buffer);
         break;
+    case IOCTL_NET_GET_INTERRUPT_MODERATION:
+        {
+            PNET_GET_INTERRUPT_MODERATION pModeration = (PNET_GET_INTERRUPT_MODERATION) pStackLocation->Parameters.DeviceControl.OutputBuffer;
+            PNETWORK_PORT_DRIVER_DATA pDriverExtension;
+
+            information = sizeof(NET_GET_INTERRUPT_MODERATION);
+
+            if (pStackLocation->Parameters.DeviceControl.OutputBufferLength < information)
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+
+            memzero(pModeration, sizeof(NET_GET_INTERRUPT_MODERATION));
+
+            pDriverExtension = IoGetDriverExtension(DeviceObject);
+            ASSERT(NULL != pDriverExtension);
+
+            if (NULL != pDriverExtension->MiniportFunctions.MiniportGetInterruptModeration)
+            {
+                pDriverExtension->MiniportFunctions.MiniportGetInterruptModeration(pPortDevice->Miniport,
+                                                                                   &pModeration->InterruptModeration
+                                                                                   );
+            }
+        }
+        break;
     case IOCTL_NET_GET_LINK_STATUS:
         {
             PNET_GET_LINK_STATUS pLinkStatus = (PNET_GET_LINK_STATUS) pStackLocation->Parameters.DeviceControl.OutputBuffer;
@@ -119,6 +165,9 @@ NetPortDeviceControl(
             pLinkStatus->LinkUp = pPortDevice->Miniport->LinkUp;
         }
         break;
+    case IOCTL_NET_WAIT_RX_READY:
+        _NetDispatchWaitRxReady(pPortDevice);
+        break;
     default:
         status = STATUS_UNSUPPORTED;
     }
@@ -137,20 +186,25 @@ STATUS
     IN_OPT      PVOID       Context
     )
 {
+    PTX_QUEUE pTxQueue;
     PNETWORK_PORT_DEVICE pPortDevice;
     PNETWORK_PORT_DRIVER_DATA pDriverExtension;
     INTR_STATE intrState;
     PLIST_ENTRY pEntry;
-    BOOLEAN bListEmpty;
-    PFRAME_DESCRIPTOR_ENTRY pDescriptorEntry;
+    PFRAME_DESCRIPTOR_ENTRY pDescriptorEntries[NETWORK_PORT_TX_BATCH_SIZE];
+    WORD lengths[NETWORK_PORT_TX_BATCH_SIZE];
     STATUS status;
+    WORD firstTxIndex;
     WORD curTxIndex;
+    DWORD noOfFreeDescriptors;
+    WORD noOfFrames;
+    WORD i;
 
     ASSERT( NULL != Context );
 
-    pPortDevice = Context;
+    pTxQueue = Context;
+    pPortDevice = pTxQueue->PortDevice;
     pEntry = NULL;
-    bListEmpty = FALSE;
     status = STATUS_SUCCESS;
     pDriverExtension = NULL;
 
@@ -162,45 +216,81 @@ STATUS
 #pragma warning(suppress:4127)
     while (TRUE)
     {
-        pDescriptorEntry = NULL;
+        noOfFrames = 0;
 
         // wait to have actual data to send
-        ExEventWaitForSignal(&pPortDevice->TxData.Buffers.FramesListNotEmptyEvent);
+        ExEventWaitForSignal(&pTxQueue->FramesListNotEmptyEvent);
 
-        LockAcquire(&pPortDevice->TxData.Buffers.FramesLock, &intrState);
-        pEntry = RemoveHeadList(&pPortDevice->TxData.Buffers.FramesList);
-        bListEmpty = ( pEntry == &pPortDevice->TxData.Buffers.FramesList );
+        // and descriptors to send it with
+        ExEventWaitForSignal(&pTxQueue->DescriptorsAvailable);
 
-        if (bListEmpty)
+        noOfFreeDescriptors = pTxQueue->NumberOfFreeDescriptors;
+        if (0 == noOfFreeDescriptors)
+        {
+            // clear the event before checking again so a notification coming
+            // in between is not lost
+            ExEventClearSignal(&pTxQueue->DescriptorsAvailable);
+
+            if (0 == pTxQueue->NumberOfFreeDescriptors)
+            {
+                LOG_TRACE_NETWORK("Queue is full\n");
+                continue;
+            }
+
+            ExEventSignal(&pTxQueue->DescriptorsAvailable);
+            noOfFreeDescriptors = pTxQueue->NumberOfFreeDescriptors;
+        }
+
+        LockAcquire(&pTxQueue->Buffers.FramesLock, &intrState);
+
+        while (noOfFrames < min(noOfFreeDescriptors, NETWORK_PORT_TX_BATCH_SIZE))
         {
-            ExEventClearSignal(&pPortDevice->TxData.Buffers.FramesListNotEmptyEvent);
+            pEntry = RemoveHeadList(&pTxQueue->Buffers.FramesList);
+            if (pEntry == &pTxQueue->Buffers.FramesList)
+            {
+                break;
+            }
+
+            pDescriptorEntries[noOfFrames] = CONTAINING_RECORD(pEntry, FRAME_DESCRIPTOR_ENTRY, ListEntry);
+            noOfFrames = noOfFrames + 1;
         }
 
-        LockRelease(&pPortDevice->TxData.Buffers.FramesLock, intrState );
+        if (IsListEmpty(&pTxQueue->Buffers.FramesList))
+        {
+            ExEventClearSignal(&pTxQueue->FramesListNotEmptyEvent);
+        }
 
-        if (bListEmpty)
+        LockRelease(&pTxQueue->Buffers.FramesLock, intrState );
+
+        if (0 == noOfFrames)
         {
             // list is empty :(
             continue;
         }
 
-        pDescriptorEntry = CONTAINING_RECORD(pEntry, FRAME_DESCRIPTOR_ENTRY, ListEntry );
-        curTxIndex = pPortDevice->TxData.CurrentTxIndex;
+        firstTxIndex = pTxQueue->CurrentTxIndex;
+        curTxIndex = firstTxIndex;
 
-        ExEventWaitForSignal(&pPortDevice->TxData.DescriptorsAvailable);
+        for (i = 0; i < noOfFrames; ++i)
+        {
+            ASSERT( pDescriptorEntries[i]->Frame.BufferSize <= MAX_WORD );
 
-        ASSERT( pDescriptorEntry->Frame.BufferSize <= MAX_WORD );
-        memcpy( pPortDevice->TxData.Buffers.Buffers[curTxIndex], pDescriptorEntry->Frame.Buffer, pDescriptorEntry->Frame.BufferSize );
+            memcpy( pTxQueue->Buffers.Buffers[curTxIndex], pDescriptorEntries[i]->Frame.Buffer, pDescriptorEntries[i]->Frame.BufferSize );
+            lengths[i] = (WORD) pDescriptorEntries[i]->Frame.BufferSize;
 
-        status = pDriverExtension->MiniportFunctions.MiniportSendBuffer( pPortDevice->Miniport, curTxIndex, (WORD) pDescriptorEntry->Frame.BufferSize );
-        ASSERT(SUCCEEDED(status));
+            curTxIndex = ( curTxIndex + 1 ) % pTxQueue->Buffers.NumberOfBuffers;
 
-        curTxIndex = ( curTxIndex + 1 ) % pPortDevice->TxData.Buffers.NumberOfBuffers;
-        _InterlockedIncrement64(&pPortDevice->TxData.Buffers.NumberOfFramesTransferred);
-        pPortDevice->TxData.CurrentTxIndex = curTxIndex;
+            NetworkPortFreeFrameDescriptor(pDescriptorEntries[i]);
+            pDescriptorEntries[i] = NULL;
+        }
+
+        _InterlockedExchangeAdd(&pTxQueue->NumberOfFreeDescriptors, -(long)noOfFrames);
+
+        status = pDriverExtension->MiniportFunctions.MiniportSendBuffers( pPortDevice->Miniport, pTxQueue->QueueIndex, firstTxIndex, noOfFrames, lengths );
+        ASSERT(SUCCEEDED(status));
 
-        NetworkPortFreeFrameDescriptor(pDescriptorEntry);
-        pDescriptorEntry = NULL;
+        _InterlockedExchangeAdd64(&pTxQueue->Buffers.NumberOfFramesTransferred, noOfFrames);
+        pTxQueue->CurrentTxIndex = curTxIndex;
     }
 
     LOG_FUNC_END;
@@ -212,6 +302,7 @@ static
 STATUS
 _NetDispatchReceiveFrame(
     INOUT                                   PNETWORK_PORT_DEVICE        Device,
+    IN                                      BOOLEAN                     Wait,
     IN                                      DWORD                       OutputBufferSize,
     OUT_WRITES_BYTES(OutputBufferSize)      PNET_RECEIVE_FRAME_OUTPUT   ReceiveOutput,
     OUT                                     QWORD*                      Information
@@ -221,8 +312,11 @@ _NetDispatchReceiveFrame(
     INTR_STATE oldState;
     PLIST_ENTRY pListEntry;
     BOOLEAN bListEmpty;
-    PFRAME_DESCRIPTOR_ENTRY pFrame;
+    PRX_BUFFER_ENTRY pFrame;
+    PRX_QUEUE pRxQueue;
     DWORD bufferSize;
+    DWORD firstQueue;
+    DWORD i;
 
     ASSERT( NULL != Device );
     ASSERT( OutputBufferSize >= sizeof(NET_RECEIVE_FRAME_OUTPUT) );
@@ -231,7 +325,7 @@ _NetDispatchReceiveFrame(
 
     status = STATUS_SUCCESS;
     pListEntry = NULL;
-    bListEmpty = FALSE;
+    bListEmpty = TRUE;
     pFrame = NULL;
     bufferSize = 0;
 
@@ -239,35 +333,41 @@ _NetDispatchReceiveFrame(
 #pragma warning(suppress:4127)
     while (TRUE)
     {
-        LockAcquire(&Device->RxData.Buffers.FramesLock, &oldState);
+        // clear the event before looking at the queues, a frame received
+        // after this point signals it again so the wait below cannot miss it
+        ExEventClearSignal(&Device->RxData.FramesListNotEmptyEvent);
 
-        pListEntry = Device->RxData.Buffers.FramesList.Flink;
-        bListEmpty = (pListEntry == &Device->RxData.Buffers.FramesList);
+        firstQueue = _InterlockedIncrement(&Device->RxData.NextQueue);
+        bListEmpty = TRUE;
 
-        if (!bListEmpty)
+        for (i = 0; i < Device->RxData.NumberOfQueues && bListEmpty; ++i)
         {
-            pFrame = CONTAINING_RECORD(pListEntry, FRAME_DESCRIPTOR_ENTRY, ListEntry);
-            bufferSize = pFrame->Frame.BufferSize;
+            pRxQueue = &Device->RxData.Queues[(firstQueue + i) % Device->RxData.NumberOfQueues];
 
-            if (bufferSize > OutputBufferSize)
-            {
-                LOGL("Buffer received of size %u is too small. Required: %u\n", OutputBufferSize, bufferSize );
-                status = STATUS_BUFFER_TOO_SMALL;
-            }
-            else
+            LockAcquire(&pRxQueue->Buffers.FramesLock, &oldState);
+
+            pListEntry = pRxQueue->Buffers.FramesList.Flink;
+            bListEmpty = (pListEntry == &pRxQueue->Buffers.FramesList);
+
+            if (!bListEmpty)
             {
-                // actually remove element from list
-                RemoveEntryList(pListEntry);
+                pFrame = CONTAINING_RECORD(pListEntry, RX_BUFFER_ENTRY, ListEntry);
+                bufferSize = pFrame->BufferSize;
+
+                if (bufferSize > OutputBufferSize)
+                {
+                    LOGL("Buffer received of size %u is too small. Required: %u\n", OutputBufferSize, bufferSize );
+                    status = STATUS_BUFFER_TOO_SMALL;
+                }
+                else
+                {
+                    // actually remove element from list
+                    RemoveEntryList(pListEntry);
+                }
             }
-        }
-        else
-        {
-            // list empty clear event
-            ExEventClearSignal(&Device->RxData.Buffers.FramesListNotEmptyEvent);
-        }
-
-        LockRelease(&Device->RxData.Buffers.FramesLock, oldState);
 
+            LockRelease(&pRxQueue->Buffers.FramesLock, oldState);
+        }
 
         if (STATUS_BUFFER_TOO_SMALL == status)
         {
@@ -294,7 +394,13 @@ _NetDispatchReceiveFrame(
                 break;
             }
 
-            ExEventWaitForSignal(&Device->RxData.Buffers.FramesListNotEmptyEvent);
+            if (!Wait)
+            {
+                status = STATUS_NO_DATA_AVAILABLE;
+                break;
+            }
+
+            ExEventWaitForSignal(&Device->RxData.FramesListNotEmptyEvent);
         }
         else
         {
@@ -310,9 +416,11 @@ _NetDispatchReceiveFrame(
         ASSERT(NULL != pFrame);
         ASSERT(!bListEmpty);
 
-        memcpy( &ReceiveOutput->Buffer,pFrame->Frame.Buffer, pFrame->Frame.BufferSize);
+        // the only copy of the frame, straight from the DMA buffer into the
+        // IRP's output buffer
+        memcpy( &ReceiveOutput->Buffer, pFrame->Buffer, pFrame->BufferSize);
 
-        NetworkPortFreeFrameDescriptor(pFrame);
+        NetworkPortReturnReceiveBuffer(Device, pFrame);
         pFrame = NULL;
     }
 
@@ -330,6 +438,7 @@ _NetDispatchSendFrame(
 {
     STATUS status;
     PFRAME_DESCRIPTOR_ENTRY pFrameDescriptor;
+    PTX_QUEUE pTxQueue;
     INTR_STATE intrState;
     BOOLEAN bListWasEmpty;
 
@@ -349,10 +458,13 @@ _NetDispatchSendFrame(
         return STATUS_DEVICE_DISABLED;
     }
 
-    if (InputBufferSize > Device->TxData.Buffers.BufferSize)
+    // all the queues have the same buffer size
+    pTxQueue = &Device->TxData.Queues[_NetDispatchSelectTxQueue(Device, InputBufferSize, (PBYTE) SendBuffer)];
+
+    if (InputBufferSize > pTxQueue->Buffers.BufferSize)
     {
         LOG_ERROR("Transmit buffer size %u bytes too large for device buffer size of %u bytes\n",
-             InputBufferSize, Device->TxData.Buffers.BufferSize );
+             InputBufferSize, pTxQueue->Buffers.BufferSize );
         return STATUS_BUFFER_TOO_LARGE;
     }
 
@@ -370,15 +482,15 @@ _NetDispatchSendFrame(
     pFrameDescriptor->Frame.BufferSize = InputBufferSize;
     memcpy( pFrameDescriptor->Frame.Buffer, SendBuffer, InputBufferSize);
 
-    LockAcquire(&Device->TxData.Buffers.FramesLock, &intrState);
-    bListWasEmpty = IsListEmpty(&Device->TxData.Buffers.FramesList);
-    InsertTailList(&Device->TxData.Buffers.FramesList, &pFrameDescriptor->ListEntry);
-    LockRelease(&Device->TxData.Buffers.FramesLock, intrState);
+    LockAcquire(&pTxQueue->Buffers.FramesLock, &intrState);
+    bListWasEmpty = IsListEmpty(&pTxQueue->Buffers.FramesList);
+    InsertTailList(&pTxQueue->Buffers.FramesList, &pFrameDescriptor->ListEntry);
+    LockRelease(&pTxQueue->Buffers.FramesLock, intrState);
     pFrameDescriptor = NULL;
 
     if (bListWasEmpty)
     {
-        ExEventSignal(&Device->TxData.Buffers.FramesListNotEmptyEvent);
+        ExEventSignal(&pTxQueue->FramesListNotEmptyEvent);
     }
 
     return status;
@@ -412,7 +524,86 @@ _NetDispatchChangeDeviceStatus(
 
     memcpy(&Device->Miniport->DeviceStatus, &DeviceStatus->DeviceStatus, sizeof(NETWORK_DEVICE_STATUS));
 
+    ExEventSignal(&Device->RxData.StatusChangedEvent);
+
     LOG_FUNC_END;
 
     return status;
+}
+
+static
+void
+_NetDispatchWaitRxReady(
+    INOUT                                   PNETWORK_PORT_DEVICE        Device
+    )
+{
+    ASSERT(NULL != Device);
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        // clear the event before looking at the status, a change made after
+        // this point signals it again so the wait below cannot miss it
+        ExEventClearSignal(&Device->RxData.StatusChangedEvent);
+
+        if (Device->Miniport->LinkUp && Device->Miniport->DeviceStatus.RxEnabled)
+        {
+            break;
+        }
+
+        ExEventWaitForSignal(&Device->RxData.StatusChangedEvent);
+    }
+}
+
+// Frames of the same IPv4 flow always go through the same TX queue so they
+// are never reordered, everything else goes through the first queue
+static
+BYTE
+_NetDispatchSelectTxQueue(
+    IN                                      PNETWORK_PORT_DEVICE        Device,
+    IN                                      DWORD                       FrameSize,
+    IN_READS_BYTES(FrameSize)               PBYTE                       Frame
+    )
+{
+    PETHERNET_FRAME pEthFrame;
+    PIP4_PACKET pIpPacket;
+    DWORD ipHeaderSize;
+    DWORD hash;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Frame);
+
+    if (Device->TxData.NumberOfQueues <= 1)
+    {
+        return 0;
+    }
+
+    if (FrameSize < sizeof(ETHERNET_FRAME) + sizeof(IP4_PACKET))
+    {
+        return 0;
+    }
+
+    pEthFrame = (PETHERNET_FRAME) Frame;
+    if (ETHERNET_FRAME_TYPE_IP4 != ntohw(pEthFrame->Type))
+    {
+        return 0;
+    }
+
+    pIpPacket = (PIP4_PACKET) pEthFrame->Data;
+    ipHeaderSize = pIpPacket->InternetHeaderLength * sizeof(DWORD);
+
+    hash = pIpPacket->Source.DwordAddress ^ pIpPacket->Destination.DwordAddress;
+
+    if ((IP_PROTOCOL_TCP == pIpPacket->Protocol || IP_PROTOCOL_UDP == pIpPacket->Protocol) &&
+        FrameSize >= sizeof(ETHERNET_FRAME) + ipHeaderSize + sizeof(DWORD))
+    {
+        // both TCP and UDP start with the source and destination ports
+        hash ^= *((DWORD*)((PBYTE)pIpPacket + ipHeaderSize));
+    }
+
+    hash ^= hash >> 16;
+    hash ^= hash >> 8;
+
+    return (BYTE) (hash % Device->TxData.NumberOfQueues);
 }
\ No newline at end of file
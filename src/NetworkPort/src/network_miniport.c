@@ -4,29 +4,33 @@
 STATUS
 NetworkPortNotifyReceiveBuffer(
     IN                          PMINIPORT_DEVICE        Device,
+    IN                          BYTE                    QueueIndex,
     IN                          DWORD                   DesciptorIndex,
-    IN                          DWORD                   BufferSize
+    IN                          DWORD                   BufferSize,
+    OUT                         PHYSICAL_ADDRESS*       BufferAddress
     )
 {
     STATUS status;
     PDEVICE_OBJECT pDevObject;
     PNETWORK_PORT_DEVICE pPortDevice;
+    PRX_QUEUE pRxQueue;
     INTR_STATE oldState;
     PLIST_ENTRY pListEntry;
-    PFRAME_DESCRIPTOR_ENTRY pFrameDescriptor;
+    PRX_BUFFER_ENTRY pReceivedBuffer;
+    PRX_BUFFER_ENTRY pReplacementBuffer;
     BOOLEAN bListWasEmpty;
-    PVOID pReceiveBuffer;
 
     ASSERT( NULL != Device );
     ASSERT( 0 != BufferSize );
+    ASSERT( NULL != BufferAddress );
 
     status = STATUS_SUCCESS;
     pListEntry = NULL;
     pDevObject = NULL;
     pPortDevice = NULL;
-    pFrameDescriptor = NULL;
+    pReceivedBuffer = NULL;
+    pReplacementBuffer = NULL;
     bListWasEmpty = FALSE;
-    pReceiveBuffer = NULL;
 
     pDevObject = Device->DeviceObject;
     ASSERT( NULL != pDevObject );
@@ -34,79 +38,150 @@ NetworkPortNotifyReceiveBuffer(
     pPortDevice = IoGetDeviceExtension(pDevObject);
     ASSERT( NULL != pPortDevice );
 
-    if (DesciptorIndex >= pPortDevice->RxData.Buffers.NumberOfBuffers)
+    if (QueueIndex >= pPortDevice->RxData.NumberOfQueues)
     {
         return STATUS_INVALID_PARAMETER2;
     }
 
-    if (BufferSize > pPortDevice->RxData.Buffers.BufferSize)
+    pRxQueue = &pPortDevice->RxData.Queues[QueueIndex];
+
+    if (DesciptorIndex >= pRxQueue->Buffers.NumberOfBuffers)
     {
         return STATUS_INVALID_PARAMETER3;
     }
 
-    pFrameDescriptor = NetworkPortAllocateFrameDescriptor(BufferSize);
-    if (NULL == pFrameDescriptor)
+    if (BufferSize > pRxQueue->Buffers.BufferSize)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    pReceivedBuffer = pRxQueue->ArmedBuffers[DesciptorIndex];
+    ASSERT( NULL != pReceivedBuffer );
+
+    pReceivedBuffer->BufferSize = BufferSize;
+
+    LockAcquire(&pRxQueue->Buffers.FramesLock, &oldState);
+
+    pListEntry = RemoveHeadList(&pRxQueue->FreeBuffersList);
+    if (pListEntry != &pRxQueue->FreeBuffersList)
     {
-        LOG_FUNC_ERROR_ALLOC("NetworkPortAllocateFrameDescriptor", BufferSize);
-        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+        pReplacementBuffer = CONTAINING_RECORD(pListEntry, RX_BUFFER_ENTRY, ListEntry);
+
+        // loan the DMA buffer itself, no copy is made
+        bListWasEmpty = IsListEmpty(&pRxQueue->Buffers.FramesList);
+        InsertTailList(&pRxQueue->Buffers.FramesList, &pReceivedBuffer->ListEntry);
     }
 
-    pFrameDescriptor->Frame.BufferSize = BufferSize;
-    pReceiveBuffer = pPortDevice->RxData.Buffers.Buffers[DesciptorIndex];
-    ASSERT( NULL != pReceiveBuffer );
+    LockRelease(&pRxQueue->Buffers.FramesLock, oldState);
+
+    if (NULL == pReplacementBuffer)
+    {
+        // all the spare buffers are loaned to consumers which did not keep up,
+        // drop the frame and re-arm the descriptor with the same buffer
+        LOG_TRACE_NETWORK("No free RX buffer, dropping frame of %u bytes\n", BufferSize);
 
-    memcpy( pFrameDescriptor->Frame.Buffer, pReceiveBuffer, BufferSize );
+        pReceivedBuffer->BufferSize = 0;
+        *BufferAddress = pReceivedBuffer->PhysicalAddress;
 
-    LockAcquire(&pPortDevice->RxData.Buffers.FramesLock, &oldState);
+        _InterlockedIncrement64(&pRxQueue->NumberOfFramesDropped);
 
-    bListWasEmpty = IsListEmpty(&pPortDevice->RxData.Buffers.FramesList);
-    InsertTailList(&pPortDevice->RxData.Buffers.FramesList, &pFrameDescriptor->ListEntry);
+        return status;
+    }
 
-    LockRelease(&pPortDevice->RxData.Buffers.FramesLock, oldState);
+    pRxQueue->ArmedBuffers[DesciptorIndex] = pReplacementBuffer;
+    pRxQueue->Buffers.Buffers[DesciptorIndex] = pReplacementBuffer->Buffer;
+    *BufferAddress = pReplacementBuffer->PhysicalAddress;
 
     if (bListWasEmpty)
     {
         // signal event
-        ExEventSignal(&pPortDevice->RxData.Buffers.FramesListNotEmptyEvent);
+        ExEventSignal(&pPortDevice->RxData.FramesListNotEmptyEvent);
     }
 
-    _InterlockedIncrement64(&pPortDevice->RxData.Buffers.NumberOfFramesTransferred);
+    _InterlockedIncrement64(&pRxQueue->Buffers.NumberOfFramesTransferred);
 
     return status;
 }
 
-void
-NetworkPortNotifyTxDescriptorAvailable(
-    IN                          PMINIPORT_DEVICE        Device
+PTR_SUCCESS
+PVOID
+NetworkPortGetReceiveBuffer(
+    IN                          PMINIPORT_DEVICE        Device,
+    IN                          BYTE                    QueueIndex,
+    IN                          DWORD                   DescriptorIndex
     )
 {
     PNETWORK_PORT_DEVICE pPortDevice;
-    PDEVICE_OBJECT pDevObject;
+    PRX_QUEUE pRxQueue;
 
-    ASSERT(NULL != Device);
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Device->DeviceObject );
 
-    LOG_FUNC_START;
+    pPortDevice = IoGetDeviceExtension(Device->DeviceObject);
+    ASSERT( NULL != pPortDevice );
 
-    pDevObject = Device->DeviceObject;
-    ASSERT(NULL != pDevObject);
+    if (QueueIndex >= pPortDevice->RxData.NumberOfQueues)
+    {
+        return NULL;
+    }
 
-    pPortDevice = IoGetDeviceExtension(pDevObject);
-    ASSERT(NULL != pPortDevice);
+    pRxQueue = &pPortDevice->RxData.Queues[QueueIndex];
 
-    ExEventSignal(&pPortDevice->TxData.DescriptorsAvailable);
+    if (DescriptorIndex >= pRxQueue->Buffers.NumberOfBuffers)
+    {
+        return NULL;
+    }
 
-    LOG_FUNC_END;
+    ASSERT( NULL != pRxQueue->ArmedBuffers[DescriptorIndex] );
+
+    return pRxQueue->ArmedBuffers[DescriptorIndex]->Buffer;
+}
+
+PTR_SUCCESS
+PVOID
+NetworkPortGetTransmitBuffer(
+    IN                          PMINIPORT_DEVICE        Device,
+    IN                          BYTE                    QueueIndex,
+    IN                          DWORD                   DescriptorIndex
+    )
+{
+    PNETWORK_PORT_DEVICE pPortDevice;
+    PTX_QUEUE pTxQueue;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Device->DeviceObject );
+
+    pPortDevice = IoGetDeviceExtension(Device->DeviceObject);
+    ASSERT( NULL != pPortDevice );
+
+    if (QueueIndex >= pPortDevice->TxData.NumberOfQueues)
+    {
+        return NULL;
+    }
+
+    pTxQueue = &pPortDevice->TxData.Queues[QueueIndex];
+
+    if (DescriptorIndex >= pTxQueue->Buffers.NumberOfBuffers)
+    {
+        return NULL;
+    }
+
+    return pTxQueue->Buffers.Buffers[DescriptorIndex];
 }
 
 void
-NetworkPortNotifyTxQueueFull(
-    IN                          PMINIPORT_DEVICE        Device
+NetworkPortNotifyTxDescriptorAvailable(
+    IN                          PMINIPORT_DEVICE        Device,
+    IN                          BYTE                    QueueIndex,
+    IN                          WORD                    NumberOfDescriptors
     )
 {
     PNETWORK_PORT_DEVICE pPortDevice;
+    PTX_QUEUE pTxQueue;
     PDEVICE_OBJECT pDevObject;
 
     ASSERT(NULL != Device);
+    ASSERT(0 != NumberOfDescriptors);
 
     LOG_FUNC_START;
 
@@ -115,8 +190,14 @@ NetworkPortNotifyTxQueueFull(
 
     pPortDevice = IoGetDeviceExtension(pDevObject);
     ASSERT(NULL != pPortDevice);
+    ASSERT(QueueIndex < pPortDevice->TxData.NumberOfQueues);
 
-    ExEventClearSignal(&pPortDevice->TxData.DescriptorsAvailable);
+    pTxQueue = &pPortDevice->TxData.Queues[QueueIndex];
+
+    _InterlockedExchangeAdd(&pTxQueue->NumberOfFreeDescriptors, NumberOfDescriptors);
+    ASSERT(pTxQueue->NumberOfFreeDescriptors < pTxQueue->Buffers.NumberOfBuffers);
+
+    ExEventSignal(&pTxQueue->DescriptorsAvailable);
 
     LOG_FUNC_END;
 }
@@ -127,11 +208,19 @@ NetworkPortNotifyLinkStatusChange(
     IN                          BOOLEAN                 LinkUp
     )
 {
+    PNETWORK_PORT_DEVICE pPortDevice;
+
     ASSERT(NULL != Device);
+    ASSERT(NULL != Device->DeviceObject);
 
     LOG_FUNC_START;
 
+    pPortDevice = IoGetDeviceExtension(Device->DeviceObject);
+    ASSERT(NULL != pPortDevice);
+
     _InterlockedExchange8(&Device->LinkUp, LinkUp);
 
+    ExEventSignal(&pPortDevice->RxData.StatusChangedEvent);
+
     LOG_FUNC_END;
 }
\ No newline at end of file
@@ -4,6 +4,13 @@
 #include "ex.h"
 
 static FUNC_InterruptFunction   _NetworkPortGenericInterrupt;
+static FUNC_InterruptFunction   _NetworkPortQueueInterrupt0;
+static FUNC_InterruptFunction   _NetworkPortQueueInterrupt1;
+
+// the interrupt routines receive only the device object, each queue needs
+// its own routine to know which queue it serves
+static PFUNC_InterruptFunction  NETWORK_PORT_QUEUE_INTERRUPTS[NETWORK_PORT_MAX_QUEUES] = { _NetworkPortQueueInterrupt0,
+                                                                                         _NetworkPortQueueInterrupt1 };
 
 __forceinline
 BOOLEAN
@@ -14,7 +21,7 @@ _NetworkPortValidateMiniportFunctions(
     ASSERT( NULL != MiniportFunctions );
 
     if ((NULL == MiniportFunctions->MiniportInitializeDevice)   ||
-        (NULL == MiniportFunctions->MiniportSendBuffer)         ||
+        (NULL == MiniportFunctions->MiniportSendBuffers)        ||
         (NULL == MiniportFunctions->MiniportInterruptHandler)   ||
         (NULL == MiniportFunctions->MiniportChangeDeviceStatus)
         )
@@ -44,15 +51,26 @@ _NetworkPortValidateBufferDescription(
     return TRUE;
 }
 
+__forceinline
+BYTE
+_NetworkPortGetNumberOfQueues(
+    IN      PMINIPORT_REGISTRATION  MiniportRegistration
+    )
+{
+    ASSERT( NULL != MiniportRegistration );
+
+    return (BYTE) max(1, min(MiniportRegistration->NumberOfQueues, NETWORK_PORT_MAX_QUEUES));
+}
+
 static
 STATUS
 _NetworkPortConfigureDevice(
     IN                          PDRIVER_OBJECT          DriverObject,
     IN                          PMINIPORT_REGISTRATION  MiniportRegistration,
-    IN                          PPCI_DEVICE_DESCRIPTION PciDevice,
-    OUT_WRITES_ALL(MiniportRegistration->RxBuffers.NumberOfBuffers)
+    IN_OPT                      PPCI_DEVICE_DESCRIPTION PciDevice,
+    OUT_WRITES_ALL(MiniportRegistration->RxBuffers.NumberOfBuffers * _NetworkPortGetNumberOfQueues(MiniportRegistration))
                                 PHYSICAL_ADDRESS*       RxPhysicalAddresses,
-    OUT_WRITES_ALL(MiniportRegistration->TxBuffers.NumberOfBuffers)
+    OUT_WRITES_ALL(MiniportRegistration->TxBuffers.NumberOfBuffers * _NetworkPortGetNumberOfQueues(MiniportRegistration))
                                 PHYSICAL_ADDRESS*       TxPhysicalAddresses
     );
 
@@ -66,6 +84,13 @@ _NetworkPortInitializeMiniportBuffers(
     OUT_PTR PVOID*                                          DescriptorArray
     );
 
+static
+void
+_NetworkPortFreeMiniportBuffers(
+    IN      PMINIPORT_BUFFER_DESCRIPTION                    BufferDescription,
+    INOUT   PVOID**                                         BufferArray
+    );
+
 STATUS
 NetworkPortRegisterMiniportDriver(
     IN      PDRIVER_OBJECT          DriverObject,
@@ -114,8 +139,8 @@ NetworkPortRegisterMiniportDriver(
     noOfDevices = 0;
     pRxPhysicalAddresses = NULL;
     noOfDevicesInitialized = 0;
-    noOfRxBuffers = MiniportRegistration->RxBuffers.NumberOfBuffers;
-    noOfTxBuffers = MiniportRegistration->TxBuffers.NumberOfBuffers;
+    noOfRxBuffers = MiniportRegistration->RxBuffers.NumberOfBuffers * _NetworkPortGetNumberOfQueues(MiniportRegistration);
+    noOfTxBuffers = MiniportRegistration->TxBuffers.NumberOfBuffers * _NetworkPortGetNumberOfQueues(MiniportRegistration);
     pRxPhysicalAddresses = NULL;
     pTxPhysicalAddresses = NULL;
 
@@ -123,14 +148,21 @@ NetworkPortRegisterMiniportDriver(
 
     __try
     {
-        status = IoGetPciDevicesMatchingSpecification(MiniportRegistration->Specification,
-                                                      &pPciDevices,
-                                                      &noOfDevices
-        );
-        if (!SUCCEEDED(status))
+        if (0 != MiniportRegistration->NumberOfVirtualDevices)
         {
-            LOG_FUNC_ERROR("IoGetPciDevicesMatchingSpecification", status);
-            __leave;
+            noOfDevices = MiniportRegistration->NumberOfVirtualDevices;
+        }
+        else
+        {
+            status = IoGetPciDevicesMatchingSpecification(MiniportRegistration->Specification,
+                                                          &pPciDevices,
+                                                          &noOfDevices
+            );
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("IoGetPciDevicesMatchingSpecification", status);
+                __leave;
+            }
         }
 
         ASSERT(NULL == DriverObject->DriverExtension);
@@ -176,7 +208,7 @@ NetworkPortRegisterMiniportDriver(
             // configure current PCI device
             status = _NetworkPortConfigureDevice(DriverObject,
                                                  MiniportRegistration,
-                                                 pPciDevices[i],
+                                                 NULL != pPciDevices ? pPciDevices[i] : NULL,
                                                  pRxPhysicalAddresses,
                                                  pTxPhysicalAddresses
             );
@@ -186,11 +218,18 @@ NetworkPortRegisterMiniportDriver(
                 continue;
             }
 
-            LOGL("Successfully configured network device found on PCI location (%u.%u.%u)\n",
-                 pPciDevices[i]->DeviceLocation.Bus,
-                 pPciDevices[i]->DeviceLocation.Device,
-                 pPciDevices[i]->DeviceLocation.Function
-            );
+            if (NULL != pPciDevices)
+            {
+                LOGL("Successfully configured network device found on PCI location (%u.%u.%u)\n",
+                     pPciDevices[i]->DeviceLocation.Bus,
+                     pPciDevices[i]->DeviceLocation.Device,
+                     pPciDevices[i]->DeviceLocation.Function
+                );
+            }
+            else
+            {
+                LOGL("Successfully configured virtual network device %u\n", i);
+            }
 
             // if we're here => we successfully initialized the device
             noOfDevicesInitialized = noOfDevicesInitialized + 1;
@@ -242,7 +281,7 @@ NetworkPortRegisterMiniportDriver(
         }
 
         // if we initialized at least a device we can say we did our job :)
-        status = noOfDevicesInitialized > 1 ? STATUS_SUCCESS : STATUS_DEVICE_DOES_NOT_EXIST;
+        status = noOfDevicesInitialized > 0 ? STATUS_SUCCESS : STATUS_DEVICE_DOES_NOT_EXIST;
 
         if (!SUCCEEDED(status))
         {
@@ -275,10 +314,10 @@ STATUS
 _NetworkPortConfigureDevice(
     IN                          PDRIVER_OBJECT          DriverObject,
     IN                          PMINIPORT_REGISTRATION  MiniportRegistration,
-    IN                          PPCI_DEVICE_DESCRIPTION PciDevice,
-    OUT_WRITES_ALL(MiniportRegistration->RxBuffers.NumberOfBuffers)
+    IN_OPT                      PPCI_DEVICE_DESCRIPTION PciDevice,
+    OUT_WRITES_ALL(MiniportRegistration->RxBuffers.NumberOfBuffers * _NetworkPortGetNumberOfQueues(MiniportRegistration))
                                 PHYSICAL_ADDRESS*       RxPhysicalAddresses,
-    OUT_WRITES_ALL(MiniportRegistration->TxBuffers.NumberOfBuffers)
+    OUT_WRITES_ALL(MiniportRegistration->TxBuffers.NumberOfBuffers * _NetworkPortGetNumberOfQueues(MiniportRegistration))
                                 PHYSICAL_ADDRESS*       TxPhysicalAddresses
     )
 {
@@ -287,23 +326,29 @@ _NetworkPortConfigureDevice(
     PDEVICE_OBJECT pDevObj;
     PNETWORK_PORT_DEVICE pPortDevice;
     PMINIPORT_DEVICE pMiniportDevice;
-    PVOID* pRxBuffers;
-    PVOID* pTxBuffers;
-    DWORD i;
+    PVOID* pRxBuffers[NETWORK_PORT_MAX_QUEUES];
+    PVOID* pTxBuffers[NETWORK_PORT_MAX_QUEUES];
+    BYTE noOfQueues;
+    BYTE q;
     IO_INTERRUPT ioInterrupt;
+    PHYSICAL_ADDRESS msiXTable;
+    WORD noOfMsiXEntries;
 
     ASSERT( NULL != DriverObject );
     ASSERT( NULL != MiniportRegistration );
-    ASSERT( NULL != PciDevice );
+    ASSERT( (NULL != PciDevice) ^ (0 != MiniportRegistration->NumberOfVirtualDevices) );
 
     status = STATUS_SUCCESS;
     memzero(&initialization, sizeof(MINIPORT_DEVICE_INITIALIZATION));
     pDevObj = NULL;
     pPortDevice = NULL;
     pMiniportDevice= NULL;
-    pRxBuffers = NULL;
-    pTxBuffers = NULL;
+    memzero(pRxBuffers, sizeof(pRxBuffers));
+    memzero(pTxBuffers, sizeof(pTxBuffers));
+    noOfQueues = _NetworkPortGetNumberOfQueues(MiniportRegistration);
     memzero(&ioInterrupt, sizeof(IO_INTERRUPT));
+    msiXTable = NULL;
+    noOfMsiXEntries = 0;
 
     __try
     {
@@ -344,37 +389,54 @@ _NetworkPortConfigureDevice(
             }
         }
 
-        status = _NetworkPortInitializeMiniportBuffers(&MiniportRegistration->RxBuffers,
-                                                       RxPhysicalAddresses,
-                                                       &pRxBuffers,
-                                                       &initialization.RxBuffers.RingBuffer
-        );
-        if (!SUCCEEDED(status))
+        for (q = 0; q < noOfQueues; ++q)
         {
-            LOG_FUNC_ERROR("_NetworkPortInitializeMiniportBuffers", status);
-            __leave;
-        }
+            status = _NetworkPortInitializeMiniportBuffers(&MiniportRegistration->RxBuffers,
+                                                           &RxPhysicalAddresses[q * MiniportRegistration->RxBuffers.NumberOfBuffers],
+                                                           &pRxBuffers[q],
+                                                           &initialization.RxBuffers[q].RingBuffer
+            );
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_NetworkPortInitializeMiniportBuffers", status);
+                __leave;
+            }
 
-        status = _NetworkPortInitializeMiniportBuffers(&MiniportRegistration->TxBuffers,
-                                                       TxPhysicalAddresses,
-                                                       &pTxBuffers,
-                                                       &initialization.TxBuffers.RingBuffer
-        );
-        if (!SUCCEEDED(status))
-        {
-            LOG_FUNC_ERROR("_NetworkPortInitializeMiniportBuffers", status);
-            __leave;
+            status = _NetworkPortInitializeMiniportBuffers(&MiniportRegistration->TxBuffers,
+                                                           &TxPhysicalAddresses[q * MiniportRegistration->TxBuffers.NumberOfBuffers],
+                                                           &pTxBuffers[q],
+                                                           &initialization.TxBuffers[q].RingBuffer
+            );
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_NetworkPortInitializeMiniportBuffers", status);
+                __leave;
+            }
+
+            initialization.RxBuffers[q].NumberOfBuffers = MiniportRegistration->RxBuffers.NumberOfBuffers;
+            initialization.RxBuffers[q].Buffers = &RxPhysicalAddresses[q * MiniportRegistration->RxBuffers.NumberOfBuffers];
+            initialization.RxBuffers[q].BufferSize = MiniportRegistration->RxBuffers.BufferSize;
+
+            initialization.TxBuffers[q].NumberOfBuffers = MiniportRegistration->TxBuffers.NumberOfBuffers;
+            initialization.TxBuffers[q].Buffers = &TxPhysicalAddresses[q * MiniportRegistration->TxBuffers.NumberOfBuffers];
+            initialization.TxBuffers[q].BufferSize = MiniportRegistration->TxBuffers.BufferSize;
         }
 
-        initialization.PciBar = PciDevice->DeviceData->Header.Device.Bar;
+        initialization.PciBar = NULL != PciDevice ? PciDevice->DeviceData->Header.Device.Bar : NULL;
+        initialization.PciDevice = PciDevice;
+        initialization.NumberOfQueues = noOfQueues;
 
-        initialization.RxBuffers.NumberOfBuffers = MiniportRegistration->RxBuffers.NumberOfBuffers;
-        initialization.RxBuffers.Buffers = RxPhysicalAddresses;
-        initialization.RxBuffers.BufferSize = MiniportRegistration->RxBuffers.BufferSize;
+        // one vector for each queue and one for everything else
+        if (NULL != PciDevice &&
+            NULL != MiniportRegistration->MiniportFunctions.MiniportQueueInterruptHandler)
+        {
+            status = PciDevGetMsiXTable(PciDevice, &msiXTable, &noOfMsiXEntries);
+            initialization.MsiXEnabled = SUCCEEDED(status) && noOfMsiXEntries > noOfQueues;
 
-        initialization.TxBuffers.NumberOfBuffers = MiniportRegistration->TxBuffers.NumberOfBuffers;
-        initialization.TxBuffers.Buffers = TxPhysicalAddresses;
-        initialization.TxBuffers.BufferSize = MiniportRegistration->TxBuffers.BufferSize;
+            LOG_TRACE_NETWORK("MSI-X table at 0x%X with %u entries, MSI-X %s\n",
+                              msiXTable, noOfMsiXEntries, initialization.MsiXEnabled ? "enabled" : "disabled");
+            status = STATUS_SUCCESS;
+        }
 
         // initialize miniport device
         status = MiniportRegistration->MiniportFunctions.MiniportInitializeDevice(pMiniportDevice,
@@ -388,15 +450,29 @@ _NetworkPortConfigureDevice(
 
         LOG_TRACE_NETWORK("Miniport device successfully initialized\n");
 
+        // release the buffers of the queues the miniport does not use
+        ASSERT( 0 != initialization.NumberOfQueues && initialization.NumberOfQueues <= noOfQueues );
+        for (q = initialization.NumberOfQueues; q < noOfQueues; ++q)
+        {
+            _NetworkPortFreeMiniportBuffers(&MiniportRegistration->RxBuffers, &pRxBuffers[q]);
+            _NetworkPortFreeMiniportBuffers(&MiniportRegistration->TxBuffers, &pTxBuffers[q]);
+
+            IoFreeContinuousMemory(initialization.RxBuffers[q].RingBuffer);
+            initialization.RxBuffers[q].RingBuffer = NULL;
+
+            IoFreeContinuousMemory(initialization.TxBuffers[q].RingBuffer);
+            initialization.TxBuffers[q].RingBuffer = NULL;
+        }
+        noOfQueues = initialization.NumberOfQueues;
+
         // initialize port device
         status = NetworkPortDeviceInit(pPortDevice,
                                        pMiniportDevice,
-                                       MiniportRegistration->RxBuffers.NumberOfBuffers,
+                                       noOfQueues,
+                                       &MiniportRegistration->RxBuffers,
                                        pRxBuffers,
-                                       MiniportRegistration->RxBuffers.BufferSize,
-                                       MiniportRegistration->TxBuffers.NumberOfBuffers,
-                                       pTxBuffers,
-                                       MiniportRegistration->TxBuffers.BufferSize
+                                       &MiniportRegistration->TxBuffers,
+                                       pTxBuffers
         );
         if (!SUCCEEDED(status))
         {
@@ -404,17 +480,57 @@ _NetworkPortConfigureDevice(
             __leave;
         }
 
-        // register interrupt
-        ioInterrupt.Type = IoInterruptTypePci;
+        if (NULL == PciDevice)
+        {
+            // virtual devices complete everything from the calls made by the
+            // port driver, there is nothing to interrupt us
+            __leave;
+        }
+
+        // register interrupts
         ioInterrupt.Irql = IrqlNetworkLevel;
-        ioInterrupt.ServiceRoutine = _NetworkPortGenericInterrupt;
-        ioInterrupt.Exclusive = FALSE;
-        ioInterrupt.Pci.PciDevice = PciDevice;
+
+        if (initialization.MsiXEnabled)
+        {
+            ioInterrupt.Type = IoInterruptTypePciMsiX;
+            ioInterrupt.Exclusive = TRUE;
+            ioInterrupt.PciMsiX.PciDevice = PciDevice;
+
+            for (q = 0; q < noOfQueues; ++q)
+            {
+                // each queue is serviced by a different CPU
+                ioInterrupt.ServiceRoutine = NETWORK_PORT_QUEUE_INTERRUPTS[q];
+                ioInterrupt.PciMsiX.TableEntry = q;
+                ioInterrupt.PciMsiX.ProcessorIndex = q;
+
+                status = IoRegisterInterrupt(&ioInterrupt, pDevObj);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("IoRegisterInterrupt", status);
+                    __leave;
+                }
+            }
+
+            ioInterrupt.ServiceRoutine = _NetworkPortGenericInterrupt;
+            ioInterrupt.PciMsiX.TableEntry = noOfQueues;
+            ioInterrupt.PciMsiX.ProcessorIndex = 0;
+        }
+        else
+        {
+            ioInterrupt.Type = IoInterruptTypePci;
+            ioInterrupt.ServiceRoutine = _NetworkPortGenericInterrupt;
+            ioInterrupt.Exclusive = FALSE;
+            ioInterrupt.Pci.PciDevice = PciDevice;
+        }
 
         status = IoRegisterInterrupt(&ioInterrupt, pDevObj);
-        ASSERT(SUCCEEDED(status));
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoRegisterInterrupt", status);
+            __leave;
+        }
 
-        LOG_TRACE_NETWORK("Successfully registered interrupt for network device\n");
+        LOG_TRACE_NETWORK("Successfully registered interrupts for network device\n");
     }
     __finally
     {
@@ -444,34 +560,10 @@ _NetworkPortConfigureDevice(
                 pMiniportDevice = NULL;
             }
 
-            if (NULL != pRxBuffers)
-            {
-                for (i = 0; i < MiniportRegistration->RxBuffers.NumberOfBuffers; ++i)
-                {
-                    if (NULL != pRxBuffers[i])
-                    {
-                        IoFreeContinuousMemory(pRxBuffers[i]);
-                        pRxBuffers[i] = NULL;
-                    }
-                }
-
-                ExFreePoolWithTag(pRxBuffers, HEAP_PORT_TAG);
-                pRxBuffers = NULL;
-            }
-
-            if (NULL != pTxBuffers)
+            for (q = 0; q < noOfQueues; ++q)
             {
-                for (i = 0; i < MiniportRegistration->TxBuffers.NumberOfBuffers; ++i)
-                {
-                    if (NULL != pTxBuffers[i])
-                    {
-                        IoFreeContinuousMemory(pTxBuffers[i]);
-                        pTxBuffers[i] = NULL;
-                    }
-                }
-
-                ExFreePoolWithTag(pTxBuffers, HEAP_PORT_TAG);
-                pTxBuffers = NULL;
+                _NetworkPortFreeMiniportBuffers(&MiniportRegistration->RxBuffers, &pRxBuffers[q]);
+                _NetworkPortFreeMiniportBuffers(&MiniportRegistration->TxBuffers, &pTxBuffers[q]);
             }
         }
     }
@@ -570,6 +662,36 @@ _NetworkPortInitializeMiniportBuffers(
     return status;
 }
 
+static
+void
+_NetworkPortFreeMiniportBuffers(
+    IN      PMINIPORT_BUFFER_DESCRIPTION                    BufferDescription,
+    INOUT   PVOID**                                         BufferArray
+    )
+{
+    DWORD i;
+
+    ASSERT( NULL != BufferDescription );
+    ASSERT( NULL != BufferArray );
+
+    if (NULL == *BufferArray)
+    {
+        return;
+    }
+
+    for (i = 0; i < BufferDescription->NumberOfBuffers; ++i)
+    {
+        if (NULL != (*BufferArray)[i])
+        {
+            IoFreeContinuousMemory((*BufferArray)[i]);
+            (*BufferArray)[i] = NULL;
+        }
+    }
+
+    ExFreePoolWithTag(*BufferArray, HEAP_PORT_TAG);
+    *BufferArray = NULL;
+}
+
 static
 BOOLEAN
 (__cdecl _NetworkPortGenericInterrupt)(
@@ -594,4 +716,46 @@ BOOLEAN
     ASSERT( NULL != pDriverExtension->MiniportFunctions.MiniportInterruptHandler);
 
     return pDriverExtension->MiniportFunctions.MiniportInterruptHandler( pMiniportDevice );
+}
+
+static
+BOOLEAN
+_NetworkPortQueueInterrupt(
+    IN      PDEVICE_OBJECT  Device,
+    IN      BYTE            QueueIndex
+    )
+{
+    PNETWORK_PORT_DEVICE pPortDevice;
+    PNETWORK_PORT_DRIVER_DATA pDriverExtension;
+
+    ASSERT(NULL != Device);
+
+    pPortDevice = IoGetDeviceExtension(Device);
+    ASSERT(NULL != pPortDevice);
+    ASSERT(NULL != pPortDevice->Miniport);
+
+    pDriverExtension = IoGetDriverExtension( Device );
+    ASSERT( NULL != pDriverExtension );
+
+    ASSERT( NULL != pDriverExtension->MiniportFunctions.MiniportQueueInterruptHandler);
+
+    return pDriverExtension->MiniportFunctions.MiniportQueueInterruptHandler( pPortDevice->Miniport, QueueIndex );
+}
+
+static
+BOOLEAN
+(__cdecl _NetworkPortQueueInterrupt0)(
+    IN      PDEVICE_OBJECT  Device
+    )
+{
+    return _NetworkPortQueueInterrupt(Device, 0);
+}
+
+static
+BOOLEAN
+(__cdecl _NetworkPortQueueInterrupt1)(
+    IN      PDEVICE_OBJECT  Device
+    )
+{
+    return _NetworkPortQueueInterrupt(Device, 1);
 }
\ No newline at end of file
@@ -14,6 +14,45 @@ _NetworkPortPreinitBuffers(
     InitializeListHead(&Buffers->FramesList);
 }
 
+__forceinline
+void
+_NetworkPortDeviceUninitRxQueue(
+    INOUT       PRX_QUEUE               RxQueue
+    )
+{
+    DWORD i;
+
+    ASSERT( NULL != RxQueue );
+
+    if (NULL != RxQueue->BufferEntries)
+    {
+        for (i = 0; i < RxQueue->NumberOfBufferEntries; ++i)
+        {
+            if (RxQueue->BufferEntries[i].Spare &&
+                NULL != RxQueue->BufferEntries[i].Buffer)
+            {
+                IoFreeContinuousMemory(RxQueue->BufferEntries[i].Buffer);
+                RxQueue->BufferEntries[i].Buffer = NULL;
+            }
+        }
+
+        ExFreePoolWithTag(RxQueue->BufferEntries, HEAP_PORT_TAG);
+        RxQueue->BufferEntries = NULL;
+    }
+
+    if (NULL != RxQueue->ArmedBuffers)
+    {
+        ExFreePoolWithTag(RxQueue->ArmedBuffers, HEAP_PORT_TAG);
+        RxQueue->ArmedBuffers = NULL;
+    }
+
+    if (NULL != RxQueue->Buffers.Buffers)
+    {
+        ExFreePoolWithTag(RxQueue->Buffers.Buffers, HEAP_PORT_TAG);
+        RxQueue->Buffers.Buffers = NULL;
+    }
+}
+
 __forceinline
 void
 _NetworkPortDeviceInitBuffers(
@@ -35,8 +74,9 @@ _NetworkPortDeviceInitBuffers(
 
 static
 STATUS
-_NetworkPortDeviceInitRx(
-    INOUT       PRX_DATA                RxData,
+_NetworkPortDeviceInitRxQueue(
+    INOUT       PRX_QUEUE               RxQueue,
+    IN          BYTE                    QueueIndex,
     IN          DWORD                   NumberOfReceiveBuffers,
     IN          PVOID*                  ReceiveBuffers,
     IN          WORD                    ReceiveBufferSize
@@ -44,9 +84,10 @@ _NetworkPortDeviceInitRx(
 
 static
 STATUS
-_NetworkPortDeviceInitTx(
-    INOUT       PTX_DATA                TxData,
+_NetworkPortDeviceInitTxQueue(
+    INOUT       PTX_QUEUE               TxQueue,
     IN          PNETWORK_PORT_DEVICE    PortDevice,
+    IN          BYTE                    QueueIndex,
     IN          DWORD                   NumberOfTransmitBuffers,
     IN          PVOID*                  TransmitBuffers,
     IN          WORD                    TransmitBufferSize
@@ -57,27 +98,42 @@ NetworkPortDevicePreinit(
     OUT         PNETWORK_PORT_DEVICE    PortDevice
     )
 {
+    DWORD i;
+    STATUS status;
+
     ASSERT( NULL != PortDevice );
 
     memzero(PortDevice, sizeof(NETWORK_PORT_DEVICE));
 
-    _NetworkPortPreinitBuffers(&PortDevice->RxData.Buffers);
-    _NetworkPortPreinitBuffers(&PortDevice->TxData.Buffers);
+    // the miniport may notify link changes while it is initialized, before
+    // NetworkPortDeviceInit is called
+    status = ExEventInit(&PortDevice->RxData.StatusChangedEvent, ExEventTypeNotification, FALSE);
+    ASSERT(SUCCEEDED(status));
+
+    for (i = 0; i < NETWORK_PORT_MAX_QUEUES; ++i)
+    {
+        _NetworkPortPreinitBuffers(&PortDevice->RxData.Queues[i].Buffers);
+        _NetworkPortPreinitBuffers(&PortDevice->TxData.Queues[i].Buffers);
+
+        InitializeListHead(&PortDevice->RxData.Queues[i].FreeBuffersList);
+    }
 }
 
 STATUS
 NetworkPortDeviceInit(
-    INOUT       PNETWORK_PORT_DEVICE    PortDevice,
-    IN          PMINIPORT_DEVICE        MiniportDevice,
-    IN          DWORD                   NumberOfReceiveBuffers,
-    IN          PVOID*                  ReceiveBuffers,
-    IN          WORD                    ReceiveBufferSize,
-    IN          DWORD                   NumberOfTransmitBuffers,
-    IN          PVOID*                  TransmitBuffers,
-    IN          WORD                    TransmitBufferSize
+    INOUT       PNETWORK_PORT_DEVICE            PortDevice,
+    IN          PMINIPORT_DEVICE                MiniportDevice,
+    IN          BYTE                            NumberOfQueues,
+    IN          PMINIPORT_BUFFER_DESCRIPTION    ReceiveBuffersDescription,
+    IN_READS(NumberOfQueues)
+                PVOID**                         ReceiveBuffers,
+    IN          PMINIPORT_BUFFER_DESCRIPTION    TransmitBuffersDescription,
+    IN_READS(NumberOfQueues)
+                PVOID**                         TransmitBuffers
     )
 {
     STATUS status;
+    BYTE i;
 
     if (NULL == PortDevice)
     {
@@ -89,22 +145,22 @@ NetworkPortDeviceInit(
         return STATUS_INVALID_PARAMETER2;
     }
 
-    if (0 == NumberOfReceiveBuffers)
+    if (0 == NumberOfQueues || NumberOfQueues > NETWORK_PORT_MAX_QUEUES)
     {
         return STATUS_INVALID_PARAMETER3;
     }
 
-    if (NULL == ReceiveBuffers)
+    if (NULL == ReceiveBuffersDescription)
     {
         return STATUS_INVALID_PARAMETER4;
     }
 
-    if (0 == ReceiveBufferSize)
+    if (NULL == ReceiveBuffers)
     {
         return STATUS_INVALID_PARAMETER5;
     }
 
-    if (0 == NumberOfTransmitBuffers)
+    if (NULL == TransmitBuffersDescription)
     {
         return STATUS_INVALID_PARAMETER6;
     }
@@ -114,38 +170,49 @@ NetworkPortDeviceInit(
         return STATUS_INVALID_PARAMETER7;
     }
 
-    if (0 == TransmitBufferSize)
-    {
-        return STATUS_INVALID_PARAMETER8;
-    }
-
     status = STATUS_SUCCESS;
 
     PortDevice->Miniport = MiniportDevice;
 
-    status = _NetworkPortDeviceInitRx(&PortDevice->RxData,
-                                      NumberOfReceiveBuffers,
-                                      ReceiveBuffers,
-                                      ReceiveBufferSize
-                                      );
+    status = ExEventInit(&PortDevice->RxData.FramesListNotEmptyEvent, ExEventTypeNotification, FALSE);
     if (!SUCCEEDED(status))
     {
-        LOG_FUNC_ERROR("_NetworkPortDeviceInitRx", status );
+        LOG_FUNC_ERROR("ExEventInit", status);
         return status;
     }
 
-    status = _NetworkPortDeviceInitTx(&PortDevice->TxData,
-                                      PortDevice,
-                                      NumberOfTransmitBuffers,
-                                      TransmitBuffers,
-                                      TransmitBufferSize
-                                      );
-    if (!SUCCEEDED(status))
+    for (i = 0; i < NumberOfQueues; ++i)
     {
-        LOG_FUNC_ERROR("_NetworkPortDeviceInitTx", status);
-        return status;
+        status = _NetworkPortDeviceInitRxQueue(&PortDevice->RxData.Queues[i],
+                                               i,
+                                               ReceiveBuffersDescription->NumberOfBuffers,
+                                               ReceiveBuffers[i],
+                                               ReceiveBuffersDescription->BufferSize
+                                               );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_NetworkPortDeviceInitRxQueue", status );
+            return status;
+        }
+        PortDevice->RxData.NumberOfQueues = i + 1;
     }
 
+    for (i = 0; i < NumberOfQueues; ++i)
+    {
+        status = _NetworkPortDeviceInitTxQueue(&PortDevice->TxData.Queues[i],
+                                               PortDevice,
+                                               i,
+                                               TransmitBuffersDescription->NumberOfBuffers,
+                                               TransmitBuffers[i],
+                                               TransmitBuffersDescription->BufferSize
+                                               );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_NetworkPortDeviceInitTxQueue", status);
+            return status;
+        }
+        PortDevice->TxData.NumberOfQueues = i + 1;
+    }
 
     return status;
 }
@@ -156,6 +223,7 @@ NetworkPortDeviceUninit(
     )
 {
     PMINIPORT_DEVICE pMiniportDevice;
+    DWORD i;
 
     ASSERT( NULL != PortDevice );
 
@@ -185,16 +253,15 @@ NetworkPortDeviceUninit(
         pMiniportDevice = NULL;
     }
 
-    if (NULL != PortDevice->RxData.Buffers.Buffers)
+    for (i = 0; i < NETWORK_PORT_MAX_QUEUES; ++i)
     {
-        ExFreePoolWithTag(PortDevice->RxData.Buffers.Buffers, HEAP_PORT_TAG);
-        PortDevice->RxData.Buffers.Buffers = NULL;
-    }
+        _NetworkPortDeviceUninitRxQueue(&PortDevice->RxData.Queues[i]);
 
-    if (NULL != PortDevice->TxData.Buffers.Buffers)
-    {
-        ExFreePoolWithTag(PortDevice->TxData.Buffers.Buffers, HEAP_PORT_TAG);
-        PortDevice->TxData.Buffers.Buffers = NULL;
+        if (NULL != PortDevice->TxData.Queues[i].Buffers.Buffers)
+        {
+            ExFreePoolWithTag(PortDevice->TxData.Queues[i].Buffers.Buffers, HEAP_PORT_TAG);
+            PortDevice->TxData.Queues[i].Buffers.Buffers = NULL;
+        }
     }
 
     memzero(PortDevice, sizeof(NETWORK_PORT_DEVICE));
@@ -221,32 +288,104 @@ NetworkPortFreeFrameDescriptor(
     ExFreePoolWithTag(Descriptor, HEAP_PORT_TAG);
 }
 
+void
+NetworkPortReturnReceiveBuffer(
+    INOUT       PNETWORK_PORT_DEVICE    PortDevice,
+    IN          PRX_BUFFER_ENTRY        Buffer
+    )
+{
+    INTR_STATE oldState;
+    PRX_QUEUE pRxQueue;
+
+    ASSERT( NULL != PortDevice );
+    ASSERT( NULL != Buffer );
+    ASSERT( Buffer->QueueIndex < PortDevice->RxData.NumberOfQueues );
+
+    Buffer->BufferSize = 0;
+    pRxQueue = &PortDevice->RxData.Queues[Buffer->QueueIndex];
+
+    LockAcquire(&pRxQueue->Buffers.FramesLock, &oldState);
+    InsertTailList(&pRxQueue->FreeBuffersList, &Buffer->ListEntry);
+    LockRelease(&pRxQueue->Buffers.FramesLock, oldState);
+}
+
 static
 STATUS
-_NetworkPortDeviceInitRx(
-    INOUT       PRX_DATA                RxData,
+_NetworkPortDeviceInitRxQueue(
+    INOUT       PRX_QUEUE               RxQueue,
+    IN          BYTE                    QueueIndex,
     IN          DWORD                   NumberOfReceiveBuffers,
     IN          PVOID*                  ReceiveBuffers,
     IN          WORD                    ReceiveBufferSize
     )
 {
     STATUS status;
+    DWORD noOfEntries;
+    DWORD i;
+    PRX_BUFFER_ENTRY pEntry;
 
-    ASSERT( NULL != RxData );
+    ASSERT( NULL != RxQueue );
 
     status = STATUS_SUCCESS;
+    noOfEntries = NumberOfReceiveBuffers * ( 1 + NETWORK_PORT_RX_SPARE_BUFFERS_PER_DESCRIPTOR );
 
-    _NetworkPortDeviceInitBuffers(&RxData->Buffers,
+    _NetworkPortDeviceInitBuffers(&RxQueue->Buffers,
                                   NumberOfReceiveBuffers,
                                   ReceiveBuffers,
                                   ReceiveBufferSize
                                   );
 
-    status = ExEventInit(&RxData->Buffers.FramesListNotEmptyEvent, ExEventTypeNotification, FALSE);
-    if (!SUCCEEDED(status))
+    RxQueue->ArmedBuffers = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
+                                                  sizeof(PRX_BUFFER_ENTRY) * NumberOfReceiveBuffers,
+                                                  HEAP_PORT_TAG,
+                                                  0
+                                                  );
+    if (NULL == RxQueue->ArmedBuffers)
     {
-        LOG_FUNC_ERROR("ExEventInit", status);
-        return status;
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(PRX_BUFFER_ENTRY) * NumberOfReceiveBuffers);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    RxQueue->BufferEntries = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
+                                                   sizeof(RX_BUFFER_ENTRY) * noOfEntries,
+                                                   HEAP_PORT_TAG,
+                                                   0
+                                                   );
+    if (NULL == RxQueue->BufferEntries)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(RX_BUFFER_ENTRY) * noOfEntries);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+    RxQueue->NumberOfBufferEntries = noOfEntries;
+
+    for (i = 0; i < noOfEntries; ++i)
+    {
+        pEntry = &RxQueue->BufferEntries[i];
+
+        if (i < NumberOfReceiveBuffers)
+        {
+            // these are already armed in the miniport's descriptors
+            pEntry->Buffer = ReceiveBuffers[i];
+            pEntry->Spare = FALSE;
+
+            RxQueue->ArmedBuffers[i] = pEntry;
+        }
+        else
+        {
+            pEntry->Buffer = IoAllocateContinuousMemory(ReceiveBufferSize);
+            if (NULL == pEntry->Buffer)
+            {
+                LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemory", ReceiveBufferSize);
+                return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            }
+            pEntry->Spare = TRUE;
+
+            InsertTailList(&RxQueue->FreeBuffersList, &pEntry->ListEntry);
+        }
+
+        pEntry->QueueIndex = QueueIndex;
+        pEntry->PhysicalAddress = IoGetPhysicalAddress(pEntry->Buffer);
+        ASSERT( NULL != pEntry->PhysicalAddress );
     }
 
     return status;
@@ -254,9 +393,10 @@ _NetworkPortDeviceInitRx(
 
 static
 STATUS
-_NetworkPortDeviceInitTx(
-    INOUT       PTX_DATA                TxData,
+_NetworkPortDeviceInitTxQueue(
+    INOUT       PTX_QUEUE               TxQueue,
     IN          PNETWORK_PORT_DEVICE    PortDevice,
+    IN          BYTE                    QueueIndex,
     IN          DWORD                   NumberOfTransmitBuffers,
     IN          PVOID*                  TransmitBuffers,
     IN          WORD                    TransmitBufferSize
@@ -264,24 +404,30 @@ _NetworkPortDeviceInitTx(
 {
     STATUS status;
 
-    ASSERT(NULL != TxData);
+    ASSERT(NULL != TxQueue);
+    ASSERT(NULL != PortDevice);
 
     status = STATUS_SUCCESS;
 
-    _NetworkPortDeviceInitBuffers(&TxData->Buffers,
+    _NetworkPortDeviceInitBuffers(&TxQueue->Buffers,
                                   NumberOfTransmitBuffers,
                                   TransmitBuffers,
                                   TransmitBufferSize
                                   );
 
-    status = ExEventInit(&TxData->Buffers.FramesListNotEmptyEvent, ExEventTypeNotification, FALSE);
+    TxQueue->PortDevice = PortDevice;
+    TxQueue->QueueIndex = QueueIndex;
+
+    status = ExEventInit(&TxQueue->FramesListNotEmptyEvent, ExEventTypeNotification, FALSE);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("ExEventInit", status);
         return status;
     }
 
-    status = ExEventInit(&TxData->DescriptorsAvailable, ExEventTypeNotification, TRUE);
+    TxQueue->NumberOfFreeDescriptors = NumberOfTransmitBuffers - 1;
+
+    status = ExEventInit(&TxQueue->DescriptorsAvailable, ExEventTypeNotification, TRUE);
     if (!SUCCEEDED(status))
     {
         LOG_FUNC_ERROR("ExEventInit", status);
@@ -291,8 +437,8 @@ _NetworkPortDeviceInitTx(
     status = ThreadCreate("TX worker thread",
                           ThreadPriorityDefault,
                           NetPortTransmitFunction,
-                          PortDevice,
-                          &PortDevice->TxData.TransmitWorkerThread
+                          TxQueue,
+                          &TxQueue->TransmitWorkerThread
                           );
     if (!SUCCEEDED(status))
     {
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "network_packet.h"
+
+_No_competing_thread_
+STATUS
+NetArpInit(
+    void
+    );
+
+// Handles an ARP packet received on Device: the cache is updated from the
+// sender's addresses and requests for the device's address are answered by
+// turning Packet into the reply. Packet still belongs to the caller.
+void
+NetArpInput(
+    IN      PNETWORK_DEVICE     Device,
+    INOUT   PNET_PACKET         Packet
+    );
+
+// Sends an IPv4 packet to NextHop, a neighbour on Device's network. If the
+// hardware address of NextHop is not known yet the packet is held by the
+// cache until a reply comes in. The packet belongs to the ARP layer after the
+// call, regardless of the status returned.
+STATUS
+NetArpSendIp4Packet(
+    IN      PNETWORK_DEVICE     Device,
+    IN      IP4_ADDRESS         NextHop,
+    _Pre_notnull_ _Post_ptr_invalid_
+            PNET_PACKET         Packet
+    );
@@ -0,0 +1,53 @@
+#pragma once
+
+// Internet checksum (RFC 1071) helpers on top of the CommonLib checksum
+// routines (checksum.h), the partial sums are interchangeable with those of
+// ChecksumInternetAdd. All the sums are done on the data as it is laid out in
+// memory, the one's complement sum does not depend on the byte order so the
+// folded result can be stored in a header field as it is.
+//
+// A checksum is computed incrementally: a partial sum is started (usually
+// from the IP pseudo-header) and each piece of the packet is added to it, only
+// the final sum is folded. Only the last piece added may have an odd length.
+
+DWORD
+NetChecksumAdd(
+    IN_READS_BYTES(Length)  PVOID       Buffer,
+    IN                      DWORD       Length,
+    IN                      DWORD       PartialSum
+    );
+
+// Same as NetChecksumAdd but also copies the data to Destination, so the data
+// is only read once.
+DWORD
+NetChecksumCopy(
+    OUT_WRITES_BYTES_ALL(Length)    PVOID       Destination,
+    IN_READS_BYTES(Length)          PVOID       Source,
+    IN                              DWORD       Length,
+    IN                              DWORD       PartialSum
+    );
+
+DWORD
+NetChecksumPseudoHeader(
+    IN      IP4_ADDRESS         Source,
+    IN      IP4_ADDRESS         Destination,
+    IN      IP_PROTOCOL         Protocol,
+    IN      WORD                Length
+    );
+
+// Folds a partial sum and returns the checksum to be stored in a header.
+// When verifying a header which already includes its checksum the result is
+// 0 if the header is valid.
+WORD
+NetChecksumFold(
+    IN      DWORD               PartialSum
+    );
+
+// Updates Checksum after a 16 bit field it covers changed from OldValue to
+// NewValue, without summing the data again (RFC 1624, eqn. 3).
+WORD
+NetChecksumUpdateWord(
+    IN      WORD                Checksum,
+    IN      WORD                OldValue,
+    IN      WORD                NewValue
+    );
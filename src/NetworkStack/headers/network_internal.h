@@ -9,6 +9,24 @@ typedef struct _NETWORK_DEVICE
     LIST_ENTRY                  NextDevice;
 
     NETWORK_DEVICE_INFO         Info;
+
+    // set through NetSetIp4Configuration, an interface with no address
+    // configured does not take part in IP routing
+    BOOLEAN                     Ip4Configured;
+    IP4_ADDRESS                 Ip4Address;
+    IP4_ADDRESS                 SubnetMask;
+    IP4_ADDRESS                 Gateway;
+
+    // started when the first IP address is configured or when a packet ring
+    // is attached, from then on all the frames received by the device go
+    // through the stack
+    volatile BOOLEAN            ReceiveThreadStarted;
+    PTHREAD                     ReceiveThread;
+
+    LOCK                        RingLock;
+
+    _Guarded_by_(RingLock)
+    struct _NET_RING*           Ring;
 } NETWORK_DEVICE, *PNETWORK_DEVICE;
 
 typedef struct _NETWORK_STACK_DATA
@@ -39,4 +57,9 @@ NetworkDeviceInitialize(
     INOUT    PNETWORK_DEVICE    Device
     );
 
+STATUS
+NetworkDeviceStartReceiving(
+    INOUT    PNETWORK_DEVICE    Device
+    );
+
 extern NETWORK_STACK_DATA m_netStackData;
\ No newline at end of file
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "network_packet.h"
+
+#define IP4_VERSION                         4
+#define IP4_DEFAULT_TIME_TO_LIVE            64
+
+// the flags and fragment offset word, in host byte order
+#define IP4_FLAG_DONT_FRAGMENT              0x4000
+#define IP4_FLAG_MORE_FRAGMENTS             0x2000
+#define IP4_FRAGMENT_OFFSET_MASK            0x1FFF
+
+typedef struct _IP4_ROUTE
+{
+    PNETWORK_DEVICE             Device;
+    IP4_ADDRESS                 NextHop;
+
+    // the IP configuration generation the route was looked up for, once any
+    // interface is reconfigured the route must be looked up again
+    DWORD                       Generation;
+
+    // header for the packets sent on this route, with the length and the
+    // identification set to 0 and the checksum computed over it: each packet
+    // only updates the checksum for the two fields which differ
+    IP4_PACKET                  HeaderTemplate;
+} IP4_ROUTE, *PIP4_ROUTE;
+
+// Source may be 0, in which case the address of the outgoing interface is
+// used and can be found in Route->HeaderTemplate.Source.
+STATUS
+NetIp4RouteLookup(
+    IN      IP4_ADDRESS         Source,
+    IN      IP4_ADDRESS         Destination,
+    IN      IP_PROTOCOL         Protocol,
+    OUT     PIP4_ROUTE          Route
+    );
+
+BOOLEAN
+NetIp4RouteIsValid(
+    IN      PIP4_ROUTE          Route
+    );
+
+// Packet->Length covers the whole frame, the IP header is filled in from the
+// route's template. The packet belongs to the IP layer after the call.
+STATUS
+NetIp4Output(
+    IN      PIP4_ROUTE          Route,
+    _Pre_notnull_ _Post_ptr_invalid_
+            PNET_PACKET         Packet
+    );
+
+// Returns TRUE if the packet was queued by an upper layer, in which case it
+// no longer belongs to the caller.
+BOOLEAN
+NetIp4Input(
+    IN      PNETWORK_DEVICE     Device,
+    INOUT   PNET_PACKET         Packet
+    );
@@ -28,4 +28,33 @@ STATUS
 NetOpGetLinkStatus(
     IN          PDEVICE_OBJECT          DeviceObject,
     OUT         BOOLEAN*                LinkStatus
+    );
+
+STATUS
+NetOpGetInterruptModeration(
+    IN          PDEVICE_OBJECT                  DeviceObject,
+    OUT         PNETWORK_INTERRUPT_MODERATION   InterruptModeration
+    );
+
+// unlike the other operations these are on the data path, so they do not
+// trace their entry and exit
+STATUS
+NetOpSendFrame(
+    IN                      PDEVICE_OBJECT          DeviceObject,
+    IN_READS_BYTES(Size)    PVOID                   Buffer,
+    IN                      DWORD                   Size
+    );
+
+STATUS
+NetOpReceiveFrame(
+    IN                      PDEVICE_OBJECT          DeviceObject,
+    OUT_WRITES_BYTES(Size)  PVOID                   Buffer,
+    IN                      DWORD                   Size,
+    OUT                     DWORD*                  BytesWritten
+    );
+
+// blocks until the link is up and RX is enabled
+STATUS
+NetOpWaitRxReady(
+    IN                      PDEVICE_OBJECT          DeviceObject
     );
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "list.h"
+
+// large enough for any frame a 1500 byte MTU interface can receive
+#define NET_PACKET_FRAME_SIZE               (2 * KB_SIZE)
+
+#define NET_IP4_MTU                         1500
+
+// frames shorter than this (FCS not included) are padded before being sent
+#define NET_MINIMUM_FRAME_SIZE              (IEEE_802_3_MINIMUM_FRAME_SIZE - (DWORD)sizeof(DWORD))
+
+// A frame travelling through the stack. Received frames are placed here by
+// the device receive thread and, if they carry a datagram for a socket, are
+// queued on that socket as they are without any further copy.
+typedef struct _NET_PACKET
+{
+    LIST_ENTRY              ListEntry;
+
+    // number of valid bytes in Frame, starting with the ethernet header
+    DWORD                   Length;
+
+    // filled in by the UDP layer for datagrams queued on a socket, the
+    // address and port are in network byte order
+    IP4_ADDRESS             RemoteAddress;
+    PORT_NUMBER             RemotePort;
+    WORD                    DataOffset;
+    WORD                    DataLength;
+
+    BYTE                    Frame[NET_PACKET_FRAME_SIZE];
+} NET_PACKET, *PNET_PACKET;
+
+PTR_SUCCESS
+PNET_PACKET
+NetPacketAllocate(
+    void
+    );
+
+void
+NetPacketFree(
+    _Pre_notnull_ _Post_ptr_invalid_
+            PNET_PACKET         Packet
+    );
+
+// Fills in the ethernet header and sends the frame on Device. The packet
+// still belongs to the caller after the call.
+STATUS
+NetPacketSend(
+    IN      PNETWORK_DEVICE     Device,
+    INOUT   PNET_PACKET         Packet,
+    IN      const MAC_ADDRESS*  Destination,
+    IN      ETHERNET_FRAME_TYPE Type
+    );
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "network_packet.h"
+
+// Called by the device receive thread for every frame received, copies the
+// frame to the ring attached to the device, if any.
+void
+NetRingDeliver(
+    IN      PNETWORK_DEVICE     Device,
+    IN      PNET_PACKET         Packet
+    );
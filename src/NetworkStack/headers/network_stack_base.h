@@ -3,4 +3,7 @@
 #include "common_lib.h"
 #include "log.h"
 #include "io.h"
-#include "ex.h"
\ No newline at end of file
+#include "ex.h"
+#include "thread.h"
+#include "ex_event.h"
+#include "network.h"
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "network_packet.h"
+
+_No_competing_thread_
+STATUS
+NetUdpInit(
+    void
+    );
+
+// Returns TRUE if the datagram was queued on a socket, in which case the
+// packet no longer belongs to the caller.
+BOOLEAN
+NetUdpInput(
+    IN      PNETWORK_DEVICE     Device,
+    INOUT   PNET_PACKET         Packet,
+    IN      PIP4_PACKET         Header
+    );
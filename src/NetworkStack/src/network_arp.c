@@ -0,0 +1,523 @@
+#include "network_stack_base.h"
+#include "network_internal.h"
+#include "network_arp.h"
+#include "hash_table.h"
+
+#define ARP_CACHE_BUCKETS               64
+
+// when the cache is full the least recently used entry is evicted
+#define ARP_CACHE_MAX_ENTRIES           256
+
+// after this time a resolved entry is still used, but each use also sends a
+// request to confirm the address is still valid
+#define ARP_ENTRY_LIFETIME_US           (60 * SEC_IN_US)
+
+// minimum time between two requests for the same address
+#define ARP_REQUEST_INTERVAL_US         (1 * SEC_IN_US)
+
+// packets held while an address is being resolved, when the limit is reached
+// the oldest one is dropped
+#define ARP_MAX_PENDING_PACKETS         3
+
+typedef struct _ARP_ENTRY
+{
+    HASH_ENTRY                  HashEntry;
+
+    IP4_ADDRESS                 Address;
+
+    PNETWORK_DEVICE             Device;
+
+    BOOLEAN                     Resolved;
+    MAC_ADDRESS                 PhysicalAddress;
+
+    QWORD                       LastUpdateUs;
+    QWORD                       LastRequestUs;
+    QWORD                       LastUsedUs;
+
+    LIST_ENTRY                  PendingPackets;
+    DWORD                       NumberOfPendingPackets;
+} ARP_ENTRY, *PARP_ENTRY;
+
+typedef struct _ARP_CACHE
+{
+    LOCK                        Lock;
+
+    _Guarded_by_(Lock)
+    HASH_TABLE                  Table;
+} ARP_CACHE, *PARP_CACHE;
+
+static ARP_CACHE m_arpCache;
+
+__forceinline
+static
+QWORD
+_NetArpGetTimeUs(
+    void
+    )
+{
+    SYSTEM_INFORMATION sysInfo;
+
+    ExGetSystemInformation(&sysInfo);
+
+    return sysInfo.SystemUptimeUs;
+}
+
+__forceinline
+static
+BOOLEAN
+_NetArpIsBroadcast(
+    IN      PNETWORK_DEVICE     Device,
+    IN      IP4_ADDRESS         Address
+    )
+{
+    DWORD hostMask;
+
+    if (MAX_DWORD == Address.DwordAddress)
+    {
+        return TRUE;
+    }
+
+    // a /32 interface has no directed broadcast address
+    hostMask = ~Device->SubnetMask.DwordAddress;
+
+    return (0 != hostMask) && ((Address.DwordAddress & hostMask) == hostMask);
+}
+
+REQUIRES_EXCL_LOCK(m_arpCache.Lock)
+static
+PARP_ENTRY
+_NetArpCreateEntry(
+    IN      PNETWORK_DEVICE     Device,
+    IN      IP4_ADDRESS         Address,
+    INOUT   PLIST_ENTRY         EvictedPackets
+    );
+
+static
+void
+_NetArpSendPendingPackets(
+    IN      PNETWORK_DEVICE     Device,
+    IN      PMAC_ADDRESS        PhysicalAddress,
+    INOUT   PLIST_ENTRY         Packets
+    );
+
+static
+void
+_NetArpFreePackets(
+    INOUT   PLIST_ENTRY         Packets
+    );
+
+static
+STATUS
+_NetArpSendRequest(
+    IN      PNETWORK_DEVICE     Device,
+    IN      IP4_ADDRESS         Address
+    );
+
+_No_competing_thread_
+STATUS
+NetArpInit(
+    void
+    )
+{
+    DWORD tableSize;
+    PHASH_TABLE_DATA pTableData;
+
+    memzero(&m_arpCache, sizeof(ARP_CACHE));
+
+    LockInit(&m_arpCache.Lock);
+
+    tableSize = HashTablePreinit(&m_arpCache.Table, ARP_CACHE_BUCKETS, sizeof(IP4_ADDRESS));
+
+    pTableData = ExAllocatePoolWithTag(0, tableSize, HEAP_NET_TAG, 0);
+    if (NULL == pTableData)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", tableSize);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    HashTableInit(&m_arpCache.Table,
+                  pTableData,
+                  HashFuncUniversal,
+                  FIELD_OFFSET(ARP_ENTRY, Address) - FIELD_OFFSET(ARP_ENTRY, HashEntry));
+
+    return STATUS_SUCCESS;
+}
+
+void
+NetArpInput(
+    IN      PNETWORK_DEVICE     Device,
+    INOUT   PNET_PACKET         Packet
+    )
+{
+    PETHERNET_FRAME pFrame;
+    PARP_PACKET pArp;
+    PARP_ENTRY pEntry;
+    PHASH_ENTRY pHashEntry;
+    INTR_STATE intrState;
+    LIST_ENTRY packetsToSend;
+    LIST_ENTRY evictedPackets;
+    MAC_ADDRESS senderAddress;
+    BOOLEAN bTargetIsUs;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Packet);
+
+    if (Packet->Length < sizeof(ETHERNET_FRAME) + sizeof(ARP_PACKET))
+    {
+        return;
+    }
+
+    pFrame = (PETHERNET_FRAME) Packet->Frame;
+    pArp = (PARP_PACKET) pFrame->Data;
+
+    if (HARDWARE_TYPE_ETHERNET != ntohw(pArp->HardwareType) ||
+        ETHERNET_FRAME_TYPE_IP4 != ntohw(pArp->ProtocolType) ||
+        MAC_ADDRESS_SIZE != pArp->HardwareAddressLength ||
+        IP4_ADDRESS_SIZE != pArp->ProtocolAddressLength)
+    {
+        LOG_TRACE_NETWORK("Unsupported ARP packet\n");
+        return;
+    }
+
+    if (!Device->Ip4Configured)
+    {
+        return;
+    }
+
+    InitializeListHead(&packetsToSend);
+    InitializeListHead(&evictedPackets);
+    bTargetIsUs = (pArp->TargetProtocolAddress.DwordAddress == Device->Ip4Address.DwordAddress);
+    memcpy(&senderAddress, &pArp->SenderHardwareAddress, sizeof(MAC_ADDRESS));
+
+    // probes have no sender address, there is nothing to learn from them
+    if (0 != pArp->SenderProtocolAddress.DwordAddress)
+    {
+        LockAcquire(&m_arpCache.Lock, &intrState);
+
+        // RFC 826: an existing entry is always updated, a new one is created
+        // only if the packet was meant for us
+        pHashEntry = HashTableLookup(&m_arpCache.Table, (PHASH_KEY) &pArp->SenderProtocolAddress);
+        pEntry = (NULL != pHashEntry) ? CONTAINING_RECORD(pHashEntry, ARP_ENTRY, HashEntry) : NULL;
+
+        if (NULL == pEntry && bTargetIsUs)
+        {
+            pEntry = _NetArpCreateEntry(Device, pArp->SenderProtocolAddress, &evictedPackets);
+        }
+
+        if (NULL != pEntry)
+        {
+            pEntry->Device = Device;
+            pEntry->Resolved = TRUE;
+            memcpy(&pEntry->PhysicalAddress, &senderAddress, sizeof(MAC_ADDRESS));
+            pEntry->LastUpdateUs = _NetArpGetTimeUs();
+
+            if (!IsListEmpty(&pEntry->PendingPackets))
+            {
+                // move the whole list over to our local head
+                InsertTailList(&pEntry->PendingPackets, &packetsToSend);
+                RemoveEntryList(&pEntry->PendingPackets);
+                InitializeListHead(&pEntry->PendingPackets);
+                pEntry->NumberOfPendingPackets = 0;
+            }
+        }
+
+        LockRelease(&m_arpCache.Lock, intrState);
+    }
+
+    _NetArpFreePackets(&evictedPackets);
+    _NetArpSendPendingPackets(Device, &senderAddress, &packetsToSend);
+
+    if (bTargetIsUs && ARP_OPERATION_REQUEST == ntohw(pArp->Operation))
+    {
+        STATUS status;
+
+        // the request is turned into the reply in place
+        pArp->Operation = htonw(ARP_OPERATION_REPLY);
+
+        memcpy(&pArp->TargetHardwareAddress, &pArp->SenderHardwareAddress, sizeof(MAC_ADDRESS));
+        pArp->TargetProtocolAddress = pArp->SenderProtocolAddress;
+
+        memcpy(&pArp->SenderHardwareAddress, &Device->Info.PhysicalAddress, sizeof(MAC_ADDRESS));
+        pArp->SenderProtocolAddress = Device->Ip4Address;
+
+        Packet->Length = sizeof(ETHERNET_FRAME) + sizeof(ARP_PACKET);
+
+        status = NetPacketSend(Device, Packet, &senderAddress, ETHERNET_FRAME_TYPE_ARP);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("NetPacketSend", status);
+        }
+    }
+}
+
+STATUS
+NetArpSendIp4Packet(
+    IN      PNETWORK_DEVICE     Device,
+    IN      IP4_ADDRESS         NextHop,
+    _Pre_notnull_ _Post_ptr_invalid_
+            PNET_PACKET         Packet
+    )
+{
+    STATUS status;
+    PARP_ENTRY pEntry;
+    PHASH_ENTRY pHashEntry;
+    INTR_STATE intrState;
+    LIST_ENTRY droppedPackets;
+    MAC_ADDRESS destination;
+    QWORD timeUs;
+    BOOLEAN bSendNow;
+    BOOLEAN bSendRequest;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Packet);
+
+    if (_NetArpIsBroadcast(Device, NextHop))
+    {
+        status = NetPacketSend(Device, Packet, &MAC_BROADCAST, ETHERNET_FRAME_TYPE_IP4);
+        NetPacketFree(Packet);
+
+        return status;
+    }
+
+    status = STATUS_SUCCESS;
+    InitializeListHead(&droppedPackets);
+    bSendNow = FALSE;
+    bSendRequest = FALSE;
+    timeUs = _NetArpGetTimeUs();
+
+    LockAcquire(&m_arpCache.Lock, &intrState);
+
+    pHashEntry = HashTableLookup(&m_arpCache.Table, (PHASH_KEY) &NextHop);
+    if (NULL != pHashEntry)
+    {
+        pEntry = CONTAINING_RECORD(pHashEntry, ARP_ENTRY, HashEntry);
+    }
+    else
+    {
+        pEntry = _NetArpCreateEntry(Device, NextHop, &droppedPackets);
+    }
+
+    if (NULL != pEntry)
+    {
+        pEntry->LastUsedUs = timeUs;
+
+        if (pEntry->Resolved)
+        {
+            // stale entries are still used while being confirmed
+            bSendNow = TRUE;
+            memcpy(&destination, &pEntry->PhysicalAddress, sizeof(MAC_ADDRESS));
+            bSendRequest = (timeUs - pEntry->LastUpdateUs >= ARP_ENTRY_LIFETIME_US);
+        }
+        else
+        {
+            if (ARP_MAX_PENDING_PACKETS == pEntry->NumberOfPendingPackets)
+            {
+                InsertTailList(&droppedPackets, RemoveHeadList(&pEntry->PendingPackets));
+                pEntry->NumberOfPendingPackets--;
+            }
+
+            InsertTailList(&pEntry->PendingPackets, &Packet->ListEntry);
+            pEntry->NumberOfPendingPackets++;
+            Packet = NULL;
+
+            bSendRequest = TRUE;
+        }
+
+        if (bSendRequest)
+        {
+            bSendRequest = (0 == pEntry->LastRequestUs || timeUs - pEntry->LastRequestUs >= ARP_REQUEST_INTERVAL_US);
+            if (bSendRequest)
+            {
+                pEntry->LastRequestUs = timeUs;
+            }
+        }
+    }
+    else
+    {
+        status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    LockRelease(&m_arpCache.Lock, intrState);
+
+    _NetArpFreePackets(&droppedPackets);
+
+    if (bSendRequest)
+    {
+        STATUS requestStatus;
+
+        requestStatus = _NetArpSendRequest(Device, NextHop);
+        if (!SUCCEEDED(requestStatus))
+        {
+            LOG_FUNC_ERROR("_NetArpSendRequest", requestStatus);
+        }
+    }
+
+    if (NULL != Packet)
+    {
+        if (bSendNow)
+        {
+            status = NetPacketSend(Device, Packet, &destination, ETHERNET_FRAME_TYPE_IP4);
+        }
+
+        NetPacketFree(Packet);
+        Packet = NULL;
+    }
+
+    return status;
+}
+
+REQUIRES_EXCL_LOCK(m_arpCache.Lock)
+static
+PARP_ENTRY
+_NetArpCreateEntry(
+    IN      PNETWORK_DEVICE     Device,
+    IN      IP4_ADDRESS         Address,
+    INOUT   PLIST_ENTRY         EvictedPackets
+    )
+{
+    PARP_ENTRY pEntry;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != EvictedPackets);
+
+    pEntry = NULL;
+
+    if (HashTableSize(&m_arpCache.Table) >= ARP_CACHE_MAX_ENTRIES)
+    {
+        HASH_ITERATOR it;
+        PHASH_ENTRY pHashEntry;
+
+        // the cache is full only under unusual traffic, a linear search for
+        // the victim keeps the common path free of LRU bookkeeping
+        HashTableIteratorInit(&m_arpCache.Table, &it);
+        while ((pHashEntry = HashTableIteratorNext(&it)) != NULL)
+        {
+            PARP_ENTRY pCandidate = CONTAINING_RECORD(pHashEntry, ARP_ENTRY, HashEntry);
+
+            if (NULL == pEntry || pCandidate->LastUsedUs < pEntry->LastUsedUs)
+            {
+                pEntry = pCandidate;
+            }
+        }
+        ASSERT(NULL != pEntry);
+
+        LOG_TRACE_NETWORK("ARP cache full, evicting entry for 0x%x\n", pEntry->Address.DwordAddress);
+
+        HashTableRemoveEntry(&m_arpCache.Table, &pEntry->HashEntry);
+
+        if (!IsListEmpty(&pEntry->PendingPackets))
+        {
+            InsertTailList(&pEntry->PendingPackets, EvictedPackets);
+            RemoveEntryList(&pEntry->PendingPackets);
+        }
+    }
+    else
+    {
+        pEntry = ExAllocatePoolWithTag(0, sizeof(ARP_ENTRY), HEAP_NET_TAG, 0);
+        if (NULL == pEntry)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(ARP_ENTRY));
+            return NULL;
+        }
+    }
+
+    memzero(pEntry, sizeof(ARP_ENTRY));
+
+    pEntry->Address = Address;
+    pEntry->Device = Device;
+    InitializeListHead(&pEntry->PendingPackets);
+
+    HashTableInsert(&m_arpCache.Table, &pEntry->HashEntry);
+
+    return pEntry;
+}
+
+static
+void
+_NetArpSendPendingPackets(
+    IN      PNETWORK_DEVICE     Device,
+    IN      PMAC_ADDRESS        PhysicalAddress,
+    INOUT   PLIST_ENTRY         Packets
+    )
+{
+    PLIST_ENTRY pEntry;
+    STATUS status;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != PhysicalAddress);
+    ASSERT(NULL != Packets);
+
+    while ((pEntry = RemoveHeadList(Packets)) != Packets)
+    {
+        PNET_PACKET pPacket = CONTAINING_RECORD(pEntry, NET_PACKET, ListEntry);
+
+        status = NetPacketSend(Device, pPacket, PhysicalAddress, ETHERNET_FRAME_TYPE_IP4);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("NetPacketSend", status);
+        }
+
+        NetPacketFree(pPacket);
+    }
+}
+
+static
+void
+_NetArpFreePackets(
+    INOUT   PLIST_ENTRY         Packets
+    )
+{
+    PLIST_ENTRY pEntry;
+
+    ASSERT(NULL != Packets);
+
+    while ((pEntry = RemoveHeadList(Packets)) != Packets)
+    {
+        NetPacketFree(CONTAINING_RECORD(pEntry, NET_PACKET, ListEntry));
+    }
+}
+
+static
+STATUS
+_NetArpSendRequest(
+    IN      PNETWORK_DEVICE     Device,
+    IN      IP4_ADDRESS         Address
+    )
+{
+    STATUS status;
+    PNET_PACKET pPacket;
+    PARP_PACKET pArp;
+
+    ASSERT(NULL != Device);
+
+    pPacket = NetPacketAllocate();
+    if (NULL == pPacket)
+    {
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    pArp = (PARP_PACKET) ((PETHERNET_FRAME) pPacket->Frame)->Data;
+
+    pArp->HardwareType = htonw(HARDWARE_TYPE_ETHERNET);
+    pArp->ProtocolType = htonw(ETHERNET_FRAME_TYPE_IP4);
+    pArp->HardwareAddressLength = MAC_ADDRESS_SIZE;
+    pArp->ProtocolAddressLength = IP4_ADDRESS_SIZE;
+    pArp->Operation = htonw(ARP_OPERATION_REQUEST);
+
+    memcpy(&pArp->SenderHardwareAddress, &Device->Info.PhysicalAddress, sizeof(MAC_ADDRESS));
+    pArp->SenderProtocolAddress = Device->Ip4Address;
+
+    memzero(&pArp->TargetHardwareAddress, sizeof(MAC_ADDRESS));
+    pArp->TargetProtocolAddress = Address;
+
+    pPacket->Length = sizeof(ETHERNET_FRAME) + sizeof(ARP_PACKET);
+
+    LOG_TRACE_NETWORK("Sending ARP request for 0x%x\n", Address.DwordAddress);
+
+    status = NetPacketSend(Device, pPacket, &MAC_BROADCAST, ETHERNET_FRAME_TYPE_ARP);
+
+    NetPacketFree(pPacket);
+    pPacket = NULL;
+
+    return status;
+}
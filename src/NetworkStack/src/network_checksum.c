@@ -0,0 +1,121 @@
+#include "network_stack_base.h"
+#include "network_checksum.h"
+#include "checksum.h"
+
+__forceinline
+static
+DWORD
+_NetChecksumFoldToDword(
+    IN      QWORD               Sum
+    )
+{
+    Sum = (Sum & MAX_DWORD) + (Sum >> 32);
+    Sum = (Sum & MAX_DWORD) + (Sum >> 32);
+
+    return (DWORD) Sum;
+}
+
+DWORD
+NetChecksumAdd(
+    IN_READS_BYTES(Length)  PVOID       Buffer,
+    IN                      DWORD       Length,
+    IN                      DWORD       PartialSum
+    )
+{
+    return ChecksumInternetAdd(Buffer, Length, PartialSum);
+}
+
+DWORD
+NetChecksumCopy(
+    OUT_WRITES_BYTES_ALL(Length)    PVOID       Destination,
+    IN_READS_BYTES(Length)          PVOID       Source,
+    IN                              DWORD       Length,
+    IN                              DWORD       PartialSum
+    )
+{
+    QWORD sum;
+    PBYTE pSource;
+    PBYTE pDestination;
+    DWORD value;
+
+    ASSERT(NULL != Destination || 0 == Length);
+    ASSERT(NULL != Source || 0 == Length);
+
+    sum = PartialSum;
+    pSource = Source;
+    pDestination = Destination;
+
+    while (Length >= sizeof(DWORD))
+    {
+        value = *((DWORD*)pSource);
+
+        *((DWORD*)pDestination) = value;
+        sum += value;
+
+        pSource += sizeof(DWORD);
+        pDestination += sizeof(DWORD);
+        Length -= sizeof(DWORD);
+    }
+
+    if (Length >= sizeof(WORD))
+    {
+        *((WORD*)pDestination) = *((WORD*)pSource);
+        sum += *((WORD*)pSource);
+
+        pSource += sizeof(WORD);
+        pDestination += sizeof(WORD);
+        Length -= sizeof(WORD);
+    }
+
+    if (0 != Length)
+    {
+        *pDestination = *pSource;
+        sum += *pSource;
+    }
+
+    return _NetChecksumFoldToDword(sum);
+}
+
+DWORD
+NetChecksumPseudoHeader(
+    IN      IP4_ADDRESS         Source,
+    IN      IP4_ADDRESS         Destination,
+    IN      IP_PROTOCOL         Protocol,
+    IN      WORD                Length
+    )
+{
+    QWORD sum;
+
+    sum = (QWORD) Source.DwordAddress + Destination.DwordAddress;
+
+    // the protocol is preceded by a 0 byte in the pseudo-header
+    sum += htonw((WORD)Protocol);
+    sum += htonw(Length);
+
+    return _NetChecksumFoldToDword(sum);
+}
+
+WORD
+NetChecksumFold(
+    IN      DWORD               PartialSum
+    )
+{
+    return ChecksumInternetFold(PartialSum);
+}
+
+WORD
+NetChecksumUpdateWord(
+    IN      WORD                Checksum,
+    IN      WORD                OldValue,
+    IN      WORD                NewValue
+    )
+{
+    DWORD sum;
+
+    // HC' = ~(~HC + ~m + m')
+    sum = (WORD) ~Checksum;
+    sum += (WORD) ~OldValue;
+    sum += NewValue;
+
+    return NetChecksumFold(sum);
+}
@@ -1,6 +1,26 @@
 #include "network_stack_base.h"
 #include "network_internal.h"
 #include "network_operations.h"
+#include "network_packet.h"
+#include "network_arp.h"
+#include "network_ip.h"
+#include "network_ring.h"
+
+static FUNC_ThreadStart _NetworkDeviceReceiveThread;
+
+static
+BOOLEAN
+_NetworkDeviceDispatchFrame(
+    IN      PNETWORK_DEVICE     Device,
+    INOUT   PNET_PACKET         Packet
+    );
+
+static
+void
+_NetworkDeviceDropFrame(
+    IN      PNETWORK_DEVICE     Device,
+    IN      DWORD               FrameSize
+    );
 
 _No_competing_thread_
 void
@@ -15,6 +35,8 @@ NetworkDevicePreinit(
 
     Device->PhysicalDevice = DeviceObject;
     Device->Info.DeviceId = DeviceId;
+
+    LockInit(&Device->RingLock);
 }
 
 _No_competing_thread_
@@ -52,4 +74,175 @@ NetworkDeviceInitialize(
     LOG_FUNC_END;
 
     return status;
+}
+
+STATUS
+NetworkDeviceStartReceiving(
+    INOUT    PNETWORK_DEVICE    Device
+    )
+{
+    STATUS status;
+    char threadName[MAX_PATH];
+
+    ASSERT(NULL != Device);
+
+    if (_InterlockedCompareExchange8(&Device->ReceiveThreadStarted, TRUE, FALSE))
+    {
+        // already started
+        return STATUS_SUCCESS;
+    }
+
+    snprintf(threadName, MAX_PATH, "Net-RX-%u", Device->Info.DeviceId);
+
+    status = ThreadCreate(threadName,
+                          ThreadPriorityDefault,
+                          _NetworkDeviceReceiveThread,
+                          Device,
+                          &Device->ReceiveThread
+                          );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ThreadCreate", status);
+        _InterlockedExchange8(&Device->ReceiveThreadStarted, FALSE);
+        return status;
+    }
+
+    return status;
+}
+
+static
+STATUS
+(__cdecl _NetworkDeviceReceiveThread)(
+    IN_OPT      PVOID       Context
+    )
+{
+    PNETWORK_DEVICE pDevice;
+    PNET_PACKET pPacket;
+    STATUS status;
+
+    ASSERT(NULL != Context);
+
+    pDevice = Context;
+    pPacket = NULL;
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        if (NULL == pPacket)
+        {
+            pPacket = NetPacketAllocate();
+            if (NULL == pPacket)
+            {
+                ThreadYield();
+                continue;
+            }
+        }
+
+        // blocks until a frame is available, the frame is received straight
+        // into the packet which may then be queued on a socket as it is. The
+        // device lock is not held meanwhile, so the frames can be sent.
+        status = NetOpReceiveFrame(pDevice->PhysicalDevice,
+                                   pPacket->Frame,
+                                   sizeof(pPacket->Frame),
+                                   &pPacket->Length);
+        if (STATUS_BUFFER_TOO_SMALL == status)
+        {
+            _NetworkDeviceDropFrame(pDevice, pPacket->Length);
+            continue;
+        }
+
+        if (!SUCCEEDED(status))
+        {
+            // the link is down or RX is disabled, the port does not block in
+            // these cases so wait for the status to change before asking again
+            status = NetOpWaitRxReady(pDevice->PhysicalDevice);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("NetOpWaitRxReady", status);
+                ThreadYield();
+            }
+            continue;
+        }
+
+        // the ring gets the frame as it was received, before the stack
+        // strips anything from it
+        NetRingDeliver(pDevice, pPacket);
+
+        if (_NetworkDeviceDispatchFrame(pDevice, pPacket))
+        {
+            // the packet was queued, a new one is needed for the next frame
+            pPacket = NULL;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+BOOLEAN
+_NetworkDeviceDispatchFrame(
+    IN      PNETWORK_DEVICE     Device,
+    INOUT   PNET_PACKET         Packet
+    )
+{
+    PETHERNET_FRAME pFrame;
+    ETHERNET_FRAME_TYPE type;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Packet);
+
+    if (Packet->Length < sizeof(ETHERNET_FRAME))
+    {
+        return FALSE;
+    }
+
+    pFrame = (PETHERNET_FRAME) Packet->Frame;
+    type = ntohw(pFrame->Type);
+
+    switch (type)
+    {
+    case ETHERNET_FRAME_TYPE_ARP:
+        NetArpInput(Device, Packet);
+        return FALSE;
+    case ETHERNET_FRAME_TYPE_IP4:
+        return NetIp4Input(Device, Packet);
+    default:
+        LOG_TRACE_NETWORK("Dropping frame of type 0x%x\n", type);
+        return FALSE;
+    }
+}
+
+static
+void
+_NetworkDeviceDropFrame(
+    IN      PNETWORK_DEVICE     Device,
+    IN      DWORD               FrameSize
+    )
+{
+    PVOID pBuffer;
+    DWORD bytesWritten;
+    STATUS status;
+
+    ASSERT(NULL != Device);
+
+    LOG_WARNING("Dropping frame of %u bytes received on device %u\n", FrameSize, Device->Info.DeviceId);
+
+    // the port keeps a frame which does not fit in the buffer given, it has to
+    // be received to get it out of the way
+    pBuffer = ExAllocatePoolWithTag(0, FrameSize, HEAP_NET_TAG, 0);
+    if (NULL == pBuffer)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", FrameSize);
+        ThreadYield();
+        return;
+    }
+
+    status = NetOpReceiveFrame(Device->PhysicalDevice, pBuffer, FrameSize, &bytesWritten);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetOpReceiveFrame", status);
+    }
+
+    ExFreePoolWithTag(pBuffer, HEAP_NET_TAG);
 }
\ No newline at end of file
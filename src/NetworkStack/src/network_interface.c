@@ -60,6 +60,8 @@ NetSendFrame(
         );
         ASSERT(NULL != pIrp);
 
+        pIrp->Flags.Unserialized = TRUE;
+
         status = IoCallDriver(pNetDevice->PhysicalDevice,
                               pIrp
         );
@@ -91,6 +93,7 @@ NetSendFrame(
 STATUS
 NetReceiveFrame(
     IN                      DEVICE_ID       DeviceId,
+    IN                      BOOLEAN         Wait,
     OUT_WRITES_BYTES(Size)  PVOID           Buffer,
     IN                      DWORD           Size,
     OUT                     DWORD*          BytesWritten
@@ -126,9 +129,16 @@ NetReceiveFrame(
         return STATUS_DEVICE_DOES_NOT_EXIST;
     }
 
+    if (pNetDevice->ReceiveThreadStarted)
+    {
+        // the receive thread of the stack takes every frame, the caller would
+        // compete with it and get frames at random
+        return STATUS_DEVICE_BUSY;
+    }
+
     __try
     {
-        pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_RECEIVE_FRAME,
+        pIrp = IoBuildDeviceIoControlRequest(Wait ? IOCTL_NET_RECEIVE_FRAME : IOCTL_NET_TRY_RECEIVE_FRAME,
                                              pNetDevice->PhysicalDevice,
                                              NULL,
                                              0,
@@ -137,6 +147,8 @@ NetReceiveFrame(
         );
         ASSERT(NULL != pIrp);
 
+        pIrp->Flags.Unserialized = TRUE;
+
         status = IoCallDriver(pNetDevice->PhysicalDevice,
                               pIrp
         );
@@ -151,6 +163,12 @@ NetReceiveFrame(
         *BytesWritten = (DWORD)pIrp->IoStatus.Information;
         if (!SUCCEEDED(status))
         {
+            if (STATUS_NO_DATA_AVAILABLE == status)
+            {
+                // the caller polls, this is not an error
+                __leave;
+            }
+
             if (STATUS_BUFFER_TOO_SMALL != status)
             {
                 LOG_FUNC_ERROR("IoCallDriver", status);
@@ -232,6 +250,15 @@ NetGetNetworkDevices(
                         __leave;
                     }
 
+                    status = NetOpGetInterruptModeration(pNetDevice->PhysicalDevice,
+                                                         &pNetDevice->Info.InterruptModeration
+                    );
+                    if (!SUCCEEDED(status))
+                    {
+                        LOG_FUNC_ERROR("NetOpGetInterruptModeration", status);
+                        __leave;
+                    }
+
                     memcpy(&DeviceObjects[i], &pNetDevice->Info, sizeof(NETWORK_DEVICE_INFO));
                     ++i;
                 }
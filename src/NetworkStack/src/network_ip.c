@@ -0,0 +1,294 @@
+#include "network_stack_base.h"
+#include "network_internal.h"
+#include "network_operations.h"
+#include "network_utils.h"
+#include "network_checksum.h"
+#include "network_arp.h"
+#include "network_ip.h"
+#include "network_udp.h"
+
+typedef struct _IP4_DATA
+{
+    // incremented each time an interface is reconfigured
+    volatile DWORD              Generation;
+
+    volatile DWORD              NextId;
+} IP4_DATA, *PIP4_DATA;
+
+static IP4_DATA m_ip4Data;
+
+__forceinline
+static
+BOOLEAN
+_NetIp4IsLocalDestination(
+    IN      PNETWORK_DEVICE     Device,
+    IN      IP4_ADDRESS         Destination
+    )
+{
+    DWORD hostMask;
+
+    if (Destination.DwordAddress == Device->Ip4Address.DwordAddress ||
+        MAX_DWORD == Destination.DwordAddress)
+    {
+        return TRUE;
+    }
+
+    hostMask = ~Device->SubnetMask.DwordAddress;
+
+    return (0 != hostMask) &&
+           ((Destination.DwordAddress & ~hostMask) == (Device->Ip4Address.DwordAddress & ~hostMask)) &&
+           ((Destination.DwordAddress & hostMask) == hostMask);
+}
+
+STATUS
+NetSetIp4Configuration(
+    IN      DEVICE_ID           DeviceId,
+    IN      IP4_ADDRESS         Address,
+    IN      IP4_ADDRESS         SubnetMask,
+    IN      IP4_ADDRESS         Gateway
+    )
+{
+    STATUS status;
+    PNETWORK_DEVICE pNetDevice;
+    char text[TEXT_IP4_ADDRESS_CHARS_REQUIRED];
+
+    if (0 != Gateway.DwordAddress &&
+        (Gateway.DwordAddress & SubnetMask.DwordAddress) != (Address.DwordAddress & SubnetMask.DwordAddress))
+    {
+        // the gateway must be reachable without a gateway
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    pNetDevice = NetOpGetDeviceById(DeviceId);
+    if (NULL == pNetDevice)
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    pNetDevice->Ip4Configured = FALSE;
+
+    pNetDevice->Ip4Address = Address;
+    pNetDevice->SubnetMask = SubnetMask;
+    pNetDevice->Gateway = Gateway;
+
+    pNetDevice->Ip4Configured = (0 != Address.DwordAddress);
+
+    _InterlockedIncrement(&m_ip4Data.Generation);
+
+    LOG("Device %u has IP address %s\n", DeviceId, NetUtilIp4AddressToText(Address, text));
+
+    if (!pNetDevice->Ip4Configured)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    status = NetworkDeviceStartReceiving(pNetDevice);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetworkDeviceStartReceiving", status);
+        return status;
+    }
+
+    return status;
+}
+
+STATUS
+NetIp4RouteLookup(
+    IN      IP4_ADDRESS         Source,
+    IN      IP4_ADDRESS         Destination,
+    IN      IP_PROTOCOL         Protocol,
+    OUT     PIP4_ROUTE          Route
+    )
+{
+    INTR_STATE intrState;
+    PLIST_ENTRY pEntry;
+    PNETWORK_DEVICE pOnLinkDevice;
+    PNETWORK_DEVICE pGatewayDevice;
+    PIP4_PACKET pHeader;
+
+    ASSERT(NULL != Route);
+
+    pOnLinkDevice = NULL;
+    pGatewayDevice = NULL;
+
+    memzero(Route, sizeof(IP4_ROUTE));
+
+    // taken before looking at the configuration, a change which races with
+    // the lookup makes the route stale right away
+    Route->Generation = m_ip4Data.Generation;
+
+    RwSpinlockAcquireShared(&m_netStackData.DeviceLock, &intrState);
+
+    for (pEntry = m_netStackData.NetworkDeviceList.Flink;
+         pEntry != &m_netStackData.NetworkDeviceList;
+         pEntry = pEntry->Flink)
+    {
+        PNETWORK_DEVICE pNetDevice = CONTAINING_RECORD(pEntry, NETWORK_DEVICE, NextDevice);
+
+        if (!pNetDevice->Ip4Configured)
+        {
+            continue;
+        }
+
+        if (0 != Source.DwordAddress && Source.DwordAddress != pNetDevice->Ip4Address.DwordAddress)
+        {
+            continue;
+        }
+
+        if (MAX_DWORD == Destination.DwordAddress ||
+            (Destination.DwordAddress & pNetDevice->SubnetMask.DwordAddress) == (pNetDevice->Ip4Address.DwordAddress & pNetDevice->SubnetMask.DwordAddress))
+        {
+            pOnLinkDevice = pNetDevice;
+            break;
+        }
+
+        if (NULL == pGatewayDevice && 0 != pNetDevice->Gateway.DwordAddress)
+        {
+            pGatewayDevice = pNetDevice;
+        }
+    }
+
+    RwSpinlockReleaseShared(&m_netStackData.DeviceLock, intrState);
+
+    if (NULL != pOnLinkDevice)
+    {
+        Route->Device = pOnLinkDevice;
+        Route->NextHop = Destination;
+    }
+    else if (NULL != pGatewayDevice)
+    {
+        Route->Device = pGatewayDevice;
+        Route->NextHop = pGatewayDevice->Gateway;
+    }
+    else
+    {
+        LOG_TRACE_NETWORK("No route to 0x%x\n", Destination.DwordAddress);
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    pHeader = &Route->HeaderTemplate;
+
+    pHeader->Version = IP4_VERSION;
+    pHeader->InternetHeaderLength = (BYTE) (sizeof(IP4_PACKET) / sizeof(DWORD));
+    pHeader->__Reserved0 = htonw(IP4_FLAG_DONT_FRAGMENT);
+    pHeader->TimeToLive = IP4_DEFAULT_TIME_TO_LIVE;
+    pHeader->Protocol = Protocol;
+    pHeader->Source = Route->Device->Ip4Address;
+    pHeader->Destination = Destination;
+
+    pHeader->Checksum = NetChecksumFold(NetChecksumAdd(pHeader, sizeof(IP4_PACKET), 0));
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+NetIp4RouteIsValid(
+    IN      PIP4_ROUTE          Route
+    )
+{
+    ASSERT(NULL != Route);
+
+    return (NULL != Route->Device) && (Route->Generation == m_ip4Data.Generation);
+}
+
+STATUS
+NetIp4Output(
+    IN      PIP4_ROUTE          Route,
+    _Pre_notnull_ _Post_ptr_invalid_
+            PNET_PACKET         Packet
+    )
+{
+    PIP4_PACKET pHeader;
+    WORD checksum;
+    DWORD totalLength;
+
+    ASSERT(NULL != Route);
+    ASSERT(NULL != Route->Device);
+    ASSERT(NULL != Packet);
+
+    totalLength = Packet->Length - sizeof(ETHERNET_FRAME);
+    ASSERT(sizeof(IP4_PACKET) <= totalLength && totalLength <= NET_IP4_MTU);
+
+    pHeader = (PIP4_PACKET) ((PETHERNET_FRAME) Packet->Frame)->Data;
+
+    memcpy(pHeader, &Route->HeaderTemplate, sizeof(IP4_PACKET));
+
+    pHeader->Length = htonw((WORD) totalLength);
+    pHeader->Id = htonw((WORD) _InterlockedIncrement(&m_ip4Data.NextId));
+
+    // both fields are 0 in the template
+    checksum = NetChecksumUpdateWord(pHeader->Checksum, 0, pHeader->Length);
+    pHeader->Checksum = NetChecksumUpdateWord(checksum, 0, pHeader->Id);
+
+    return NetArpSendIp4Packet(Route->Device, Route->NextHop, Packet);
+}
+
+BOOLEAN
+NetIp4Input(
+    IN      PNETWORK_DEVICE     Device,
+    INOUT   PNET_PACKET         Packet
+    )
+{
+    PIP4_PACKET pHeader;
+    DWORD headerLength;
+    DWORD totalLength;
+    WORD fragment;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Packet);
+
+    if (!Device->Ip4Configured)
+    {
+        return FALSE;
+    }
+
+    if (Packet->Length < sizeof(ETHERNET_FRAME) + sizeof(IP4_PACKET))
+    {
+        return FALSE;
+    }
+
+    pHeader = (PIP4_PACKET) ((PETHERNET_FRAME) Packet->Frame)->Data;
+    headerLength = pHeader->InternetHeaderLength * sizeof(DWORD);
+    totalLength = ntohw(pHeader->Length);
+
+    if (IP4_VERSION != pHeader->Version ||
+        headerLength < sizeof(IP4_PACKET) ||
+        totalLength < headerLength ||
+        totalLength > Packet->Length - sizeof(ETHERNET_FRAME))
+    {
+        LOG_TRACE_NETWORK("Malformed IP packet\n");
+        return FALSE;
+    }
+
+    // a valid header sums up to 0 including its checksum
+    if (0 != NetChecksumFold(NetChecksumAdd(pHeader, headerLength, 0)))
+    {
+        LOG_TRACE_NETWORK("IP header checksum mismatch\n");
+        return FALSE;
+    }
+
+    fragment = ntohw(pHeader->__Reserved0);
+    if (0 != (fragment & (IP4_FLAG_MORE_FRAGMENTS | IP4_FRAGMENT_OFFSET_MASK)))
+    {
+        // there is no reassembly, we never send fragments either
+        LOG_TRACE_NETWORK("Dropping IP fragment\n");
+        return FALSE;
+    }
+
+    if (!_NetIp4IsLocalDestination(Device, pHeader->Destination))
+    {
+        return FALSE;
+    }
+
+    // strip the ethernet padding
+    Packet->Length = sizeof(ETHERNET_FRAME) + totalLength;
+
+    switch (pHeader->Protocol)
+    {
+    case IP_PROTOCOL_UDP:
+        return NetUdpInput(Device, Packet, pHeader);
+    default:
+        LOG_TRACE_NETWORK("Unhandled IP protocol %u\n", pHeader->Protocol);
+        return FALSE;
+    }
+}
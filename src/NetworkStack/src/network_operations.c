@@ -279,5 +279,193 @@ NetOpGetLinkStatus(
         LOG_FUNC_END;
     }
 
+    return status;
+}
+
+STATUS
+NetOpGetInterruptModeration(
+    IN          PDEVICE_OBJECT                  DeviceObject,
+    OUT         PNETWORK_INTERRUPT_MODERATION   InterruptModeration
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+    NET_GET_INTERRUPT_MODERATION moderation;
+
+    LOG_FUNC_START;
+
+    ASSERT(NULL != DeviceObject);
+    ASSERT(NULL != InterruptModeration);
+
+    status = STATUS_SUCCESS;
+    pIrp = NULL;
+    memzero(&moderation, sizeof(NET_GET_INTERRUPT_MODERATION));
+
+    __try
+    {
+        pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_GET_INTERRUPT_MODERATION,
+                                             DeviceObject,
+                                             NULL,
+                                             0,
+                                             &moderation,
+                                             sizeof(NET_GET_INTERRUPT_MODERATION)
+        );
+        ASSERT(NULL != pIrp);
+
+        status = IoCallDriver(DeviceObject,
+                              pIrp
+        );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        status = pIrp->IoStatus.Status;
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoCallDriver", status);
+            __leave;
+        }
+
+        memcpy(InterruptModeration, &moderation.InterruptModeration, sizeof(NETWORK_INTERRUPT_MODERATION));
+    }
+    __finally
+    {
+        if (NULL != pIrp)
+        {
+            IoFreeIrp(pIrp);
+            pIrp = NULL;
+        }
+
+        LOG_FUNC_END;
+    }
+
+    return status;
+}
+
+STATUS
+NetOpSendFrame(
+    IN                      PDEVICE_OBJECT          DeviceObject,
+    IN_READS_BYTES(Size)    PVOID                   Buffer,
+    IN                      DWORD                   Size
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+
+    ASSERT(NULL != DeviceObject);
+    ASSERT(NULL != Buffer);
+    ASSERT(0 != Size);
+
+    pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_SEND_FRAME,
+                                         DeviceObject,
+                                         Buffer,
+                                         Size,
+                                         NULL,
+                                         0
+    );
+    ASSERT(NULL != pIrp);
+
+    // must not wait behind a receive blocked on the same device
+    pIrp->Flags.Unserialized = TRUE;
+
+    status = IoCallDriver(DeviceObject,
+                          pIrp
+    );
+    if (SUCCEEDED(status))
+    {
+        status = pIrp->IoStatus.Status;
+    }
+
+    IoFreeIrp(pIrp);
+    pIrp = NULL;
+
+    return status;
+}
+
+STATUS
+NetOpReceiveFrame(
+    IN                      PDEVICE_OBJECT          DeviceObject,
+    OUT_WRITES_BYTES(Size)  PVOID                   Buffer,
+    IN                      DWORD                   Size,
+    OUT                     DWORD*                  BytesWritten
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+
+    ASSERT(NULL != DeviceObject);
+    ASSERT(NULL != Buffer);
+    ASSERT(0 != Size);
+    ASSERT(NULL != BytesWritten);
+
+    *BytesWritten = 0;
+
+    pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_RECEIVE_FRAME,
+                                         DeviceObject,
+                                         NULL,
+                                         0,
+                                         Buffer,
+                                         Size
+    );
+    ASSERT(NULL != pIrp);
+
+    // blocks until a frame is available, the device must remain usable
+    // in the meantime
+    pIrp->Flags.Unserialized = TRUE;
+
+    status = IoCallDriver(DeviceObject,
+                          pIrp
+    );
+    if (SUCCEEDED(status))
+    {
+        status = pIrp->IoStatus.Status;
+
+        // on STATUS_BUFFER_TOO_SMALL this is the size required
+        ASSERT(pIrp->IoStatus.Information <= MAX_DWORD);
+        *BytesWritten = (DWORD)pIrp->IoStatus.Information;
+    }
+
+    IoFreeIrp(pIrp);
+    pIrp = NULL;
+
+    return status;
+}
+
+STATUS
+NetOpWaitRxReady(
+    IN                      PDEVICE_OBJECT          DeviceObject
+    )
+{
+    STATUS status;
+    PIRP pIrp;
+
+    ASSERT(NULL != DeviceObject);
+
+    pIrp = IoBuildDeviceIoControlRequest(IOCTL_NET_WAIT_RX_READY,
+                                         DeviceObject,
+                                         NULL,
+                                         0,
+                                         NULL,
+                                         0
+    );
+    ASSERT(NULL != pIrp);
+
+    // blocks until the status changes, the status may only be changed
+    // through the device so it must remain usable in the meantime
+    pIrp->Flags.Unserialized = TRUE;
+
+    status = IoCallDriver(DeviceObject,
+                          pIrp
+    );
+    if (SUCCEEDED(status))
+    {
+        status = pIrp->IoStatus.Status;
+    }
+
+    IoFreeIrp(pIrp);
+    pIrp = NULL;
+
     return status;
 }
\ No newline at end of file
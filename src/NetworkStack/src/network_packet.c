@@ -0,0 +1,67 @@
+#include "network_stack_base.h"
+#include "network_internal.h"
+#include "network_operations.h"
+#include "network_packet.h"
+
+PTR_SUCCESS
+PNET_PACKET
+NetPacketAllocate(
+    void
+    )
+{
+    PNET_PACKET pPacket;
+
+    // only the header is zeroed, the frame contents are always written before
+    // being used
+    pPacket = ExAllocatePoolWithTag(0, sizeof(NET_PACKET), HEAP_NET_TAG, 0);
+    if (NULL == pPacket)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(NET_PACKET));
+        return NULL;
+    }
+
+    memzero(pPacket, FIELD_OFFSET(NET_PACKET, Frame));
+
+    return pPacket;
+}
+
+void
+NetPacketFree(
+    _Pre_notnull_ _Post_ptr_invalid_
+            PNET_PACKET         Packet
+    )
+{
+    ASSERT(NULL != Packet);
+
+    ExFreePoolWithTag(Packet, HEAP_NET_TAG);
+}
+
+STATUS
+NetPacketSend(
+    IN      PNETWORK_DEVICE     Device,
+    INOUT   PNET_PACKET         Packet,
+    IN      const MAC_ADDRESS*  Destination,
+    IN      ETHERNET_FRAME_TYPE Type
+    )
+{
+    PETHERNET_FRAME pFrame;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Packet);
+    ASSERT(NULL != Destination);
+    ASSERT(sizeof(ETHERNET_FRAME) <= Packet->Length && Packet->Length <= NET_PACKET_FRAME_SIZE);
+
+    pFrame = (PETHERNET_FRAME) Packet->Frame;
+
+    memcpy(&pFrame->Destination, (PVOID) Destination, sizeof(MAC_ADDRESS));
+    memcpy(&pFrame->Source, &Device->Info.PhysicalAddress, sizeof(MAC_ADDRESS));
+    pFrame->Type = htonw(Type);
+
+    if (Packet->Length < NET_MINIMUM_FRAME_SIZE)
+    {
+        memzero(&Packet->Frame[Packet->Length], NET_MINIMUM_FRAME_SIZE - Packet->Length);
+        Packet->Length = NET_MINIMUM_FRAME_SIZE;
+    }
+
+    return NetOpSendFrame(Device->PhysicalDevice, Packet->Frame, Packet->Length);
+}
@@ -0,0 +1,382 @@
+#include "network_stack_base.h"
+#include "network_internal.h"
+#include "network_operations.h"
+#include "network_ring.h"
+
+typedef struct _NET_RING
+{
+    PNETWORK_DEVICE             Device;
+
+    // shared with user space, none of the values the kernel depends on are
+    // read back from it
+    PNET_RING_HEADER            Header;
+    DWORD                       Size;
+
+    DWORD                       SlotCount;
+    PNET_RING_SLOT              RxSlots;
+    PNET_RING_SLOT              TxSlots;
+
+    // private copies of the indices written by the kernel, RxProducer is
+    // guarded by the RingLock of the device
+    DWORD                       RxProducer;
+
+    // the threads of the process may transmit at the same time, a mutex
+    // because the frames are sent while it is held
+    MUTEX                       TxLock;
+
+    _Guarded_by_(TxLock)
+    DWORD                       TxConsumer;
+
+    // signaled while the RX slots are not empty
+    EX_EVENT                    RxAvailable;
+} NET_RING;
+
+__forceinline
+static
+BOOLEAN
+_NetRingIsSlotCountValid(
+    IN      DWORD               SlotCount
+    )
+{
+    return (NET_RING_MIN_SLOTS <= SlotCount) &&
+           (SlotCount <= NET_RING_MAX_SLOTS) &&
+           (0 == (SlotCount & (SlotCount - 1)));
+}
+
+STATUS
+NetRingCreate(
+    IN              DEVICE_ID                       DeviceId,
+    IN              DWORD                           SlotCount,
+    OUT_PTR         PNET_RING*                      Ring
+    )
+{
+    STATUS status;
+    PNETWORK_DEVICE pNetDevice;
+    PNET_RING pRing;
+    PNET_RING_HEADER pHeader;
+    INTR_STATE intrState;
+    BOOLEAN bAttached;
+
+    if (!_NetRingIsSlotCountValid(SlotCount))
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == Ring)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    pNetDevice = NetOpGetDeviceById(DeviceId);
+    if (NULL == pNetDevice)
+    {
+        return STATUS_DEVICE_DOES_NOT_EXIST;
+    }
+
+    status = STATUS_SUCCESS;
+    pRing = NULL;
+    bAttached = FALSE;
+
+    __try
+    {
+        pRing = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(NET_RING), HEAP_NET_TAG, 0);
+        if (NULL == pRing)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(NET_RING));
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        status = ExEventInit(&pRing->RxAvailable, ExEventTypeNotification, FALSE);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ExEventInit", status);
+            __leave;
+        }
+
+        MutexInit(&pRing->TxLock, FALSE);
+
+        pRing->Device = pNetDevice;
+        pRing->SlotCount = SlotCount;
+        pRing->Size = NET_RING_SIZE(SlotCount);
+
+        // whole pages which can be mapped in a process as they are
+        pHeader = IoAllocateContinuousMemory(pRing->Size);
+        if (NULL == pHeader)
+        {
+            LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemory", pRing->Size);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+        memzero(pHeader, pRing->Size);
+
+        pHeader->SlotCount = SlotCount;
+        pHeader->SlotSize = NET_RING_SLOT_SIZE;
+        pHeader->RxSlotsOffset = NET_RING_HEADER_SIZE;
+        pHeader->TxSlotsOffset = NET_RING_HEADER_SIZE + SlotCount * NET_RING_SLOT_SIZE;
+
+        pRing->Header = pHeader;
+        pRing->RxSlots = (PNET_RING_SLOT) PtrOffset(pHeader, pHeader->RxSlotsOffset);
+        pRing->TxSlots = (PNET_RING_SLOT) PtrOffset(pHeader, pHeader->TxSlotsOffset);
+
+        LockAcquire(&pNetDevice->RingLock, &intrState);
+        if (NULL == pNetDevice->Ring)
+        {
+            pNetDevice->Ring = pRing;
+            bAttached = TRUE;
+        }
+        LockRelease(&pNetDevice->RingLock, intrState);
+
+        if (!bAttached)
+        {
+            status = STATUS_ELEMENT_FOUND;
+            __leave;
+        }
+
+        status = NetworkDeviceStartReceiving(pNetDevice);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("NetworkDeviceStartReceiving", status);
+            __leave;
+        }
+
+        LOG_TRACE_NETWORK("Attached a ring of %u slots to device %u\n", SlotCount, DeviceId);
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            if (NULL != pRing)
+            {
+                if (bAttached)
+                {
+                    NetRingDestroy(pRing);
+                }
+                else
+                {
+                    if (NULL != pRing->Header)
+                    {
+                        IoFreeContinuousMemory(pRing->Header);
+                        pRing->Header = NULL;
+                    }
+
+                    ExFreePoolWithTag(pRing, HEAP_NET_TAG);
+                }
+                pRing = NULL;
+            }
+        }
+        else
+        {
+            *Ring = pRing;
+        }
+    }
+
+    return status;
+}
+
+PNET_RING_HEADER
+NetRingGetHeader(
+    IN              PNET_RING                       Ring,
+    OUT_OPT         DWORD*                          Size
+    )
+{
+    ASSERT(NULL != Ring);
+
+    if (NULL != Size)
+    {
+        *Size = Ring->Size;
+    }
+
+    return Ring->Header;
+}
+
+STATUS
+NetRingTransmit(
+    INOUT           PNET_RING                       Ring,
+    OUT_OPT         DWORD*                          FramesSent
+    )
+{
+    STATUS status;
+    PNET_RING_SLOT pSlot;
+    PETHERNET_FRAME pFrame;
+    DWORD producer;
+    DWORD pending;
+    DWORD length;
+    DWORD framesSent;
+
+    if (NULL == Ring)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    framesSent = 0;
+
+    MutexAcquire(&Ring->TxLock);
+
+    producer = Ring->Header->TxProducer;
+    pending = producer - Ring->TxConsumer;
+    if (pending > Ring->SlotCount)
+    {
+        // the process has overwritten slots which were not sent yet
+        LOG_TRACE_NETWORK("TX producer 0x%x is out of range, consumer is 0x%x\n", producer, Ring->TxConsumer);
+        MutexRelease(&Ring->TxLock);
+        return STATUS_INVALID_BUFFER;
+    }
+
+    for (; pending > 0; --pending)
+    {
+        pSlot = &Ring->TxSlots[Ring->TxConsumer & (Ring->SlotCount - 1)];
+
+        // the process may change the slot at any time, the length is read
+        // only once
+        length = pSlot->Length;
+        if (length < sizeof(ETHERNET_FRAME) || length > NET_RING_MAX_FRAME_SIZE)
+        {
+            Ring->Header->TxErrors++;
+        }
+        else
+        {
+            pFrame = (PETHERNET_FRAME) pSlot->Frame;
+            memcpy(&pFrame->Source, &Ring->Device->Info.PhysicalAddress, sizeof(MAC_ADDRESS));
+
+            if (length < NET_MINIMUM_FRAME_SIZE)
+            {
+                memzero(&pSlot->Frame[length], NET_MINIMUM_FRAME_SIZE - length);
+                length = NET_MINIMUM_FRAME_SIZE;
+            }
+
+            status = NetOpSendFrame(Ring->Device->PhysicalDevice, pSlot->Frame, length);
+            if (SUCCEEDED(status))
+            {
+                framesSent++;
+            }
+            else
+            {
+                Ring->Header->TxErrors++;
+            }
+        }
+
+        // give the slot back as soon as possible, the process may already be
+        // waiting for it
+        Ring->TxConsumer++;
+        Ring->Header->TxConsumer = Ring->TxConsumer;
+    }
+
+    MutexRelease(&Ring->TxLock);
+
+    if (NULL != FramesSent)
+    {
+        *FramesSent = framesSent;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+void
+NetRingWait(
+    INOUT           PNET_RING                       Ring
+    )
+{
+    INTR_STATE intrState;
+    BOOLEAN bEmpty;
+
+    ASSERT(NULL != Ring);
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        LockAcquire(&Ring->Device->RingLock, &intrState);
+
+        // the event is cleared under the same lock the receive path signals
+        // it with, so a frame delivered after this point cannot be missed
+        bEmpty = (Ring->RxProducer == Ring->Header->RxConsumer);
+        if (bEmpty)
+        {
+            ExEventClearSignal(&Ring->RxAvailable);
+        }
+
+        LockRelease(&Ring->Device->RingLock, intrState);
+
+        if (!bEmpty)
+        {
+            break;
+        }
+
+        ExEventWaitForSignal(&Ring->RxAvailable);
+    }
+}
+
+void
+NetRingDestroy(
+    _Pre_notnull_ _Post_ptr_invalid_
+                    PNET_RING                       Ring
+    )
+{
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Ring);
+
+    LockAcquire(&Ring->Device->RingLock, &intrState);
+    ASSERT(Ring->Device->Ring == Ring);
+    Ring->Device->Ring = NULL;
+    LockRelease(&Ring->Device->RingLock, intrState);
+
+    // the receive path can no longer find the ring
+    if (0 != Ring->Header->RxDropped)
+    {
+        LOG_TRACE_NETWORK("Ring on device %u dropped %U frames\n",
+                          Ring->Device->Info.DeviceId, Ring->Header->RxDropped);
+    }
+
+    IoFreeContinuousMemory(Ring->Header);
+    ExFreePoolWithTag(Ring, HEAP_NET_TAG);
+}
+
+void
+NetRingDeliver(
+    IN      PNETWORK_DEVICE     Device,
+    IN      PNET_PACKET         Packet
+    )
+{
+    PNET_RING pRing;
+    PNET_RING_SLOT pSlot;
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Packet);
+
+    // checked without the lock first, most devices never have a ring
+    if (NULL == Device->Ring)
+    {
+        return;
+    }
+
+    LockAcquire(&Device->RingLock, &intrState);
+
+    pRing = Device->Ring;
+    if (NULL != pRing)
+    {
+        // if the consumer is out of range the slots are considered full
+        if (pRing->RxProducer - pRing->Header->RxConsumer >= pRing->SlotCount ||
+            Packet->Length > NET_RING_MAX_FRAME_SIZE)
+        {
+            pRing->Header->RxDropped++;
+        }
+        else
+        {
+            pSlot = &pRing->RxSlots[pRing->RxProducer & (pRing->SlotCount - 1)];
+
+            memcpy(pSlot->Frame, Packet->Frame, Packet->Length);
+            pSlot->Length = Packet->Length;
+
+            // the slot is written before the index which publishes it
+            pRing->RxProducer++;
+            pRing->Header->RxProducer = pRing->RxProducer;
+
+            ExEventSignal(&pRing->RxAvailable);
+        }
+    }
+
+    LockRelease(&Device->RingLock, intrState);
+}
@@ -2,6 +2,8 @@
 #include "network_stack.h"
 #include "network_internal.h"
 #include "network_operations.h"
+#include "network_arp.h"
+#include "network_udp.h"
 
 NETWORK_STACK_DATA m_netStackData;
 
@@ -53,6 +55,20 @@ NetworkStackInit(
     pNetworkDevices = NULL;
     numberOfDevices = 0;
 
+    status = NetArpInit();
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetArpInit", status);
+        return status;
+    }
+
+    status = NetUdpInit();
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetUdpInit", status);
+        return status;
+    }
+
     status = IoGetDevicesByType(DeviceTypePhysicalNetcard, 
                                 &pNetworkDevices, 
                                 &numberOfDevices
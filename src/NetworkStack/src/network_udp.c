@@ -0,0 +1,852 @@
+#include "network_stack_base.h"
+#include "network_internal.h"
+#include "network_checksum.h"
+#include "network_ip.h"
+#include "network_udp.h"
+#include "hash_table.h"
+
+#define UDP_SOCKET_BUCKETS                  64
+
+// datagrams which arrive while this many are waiting to be read are dropped
+#define UDP_SOCKET_MAX_QUEUED_DATAGRAMS     128
+
+#define UDP_EPHEMERAL_PORT_FIRST            49152
+#define UDP_EPHEMERAL_PORT_LAST             65535
+
+// there is no fragmentation, a datagram must fit in a single frame
+#define UDP_MAX_PAYLOAD_SIZE                (NET_IP4_MTU - sizeof(IP4_PACKET) - sizeof(UDP_DATAGRAM))
+
+// All the fields are in network byte order. Unconnected sockets have the
+// remote address and port set to 0, sockets bound to all the interfaces have
+// the local address set to 0.
+typedef struct _UDP_SOCKET_KEY
+{
+    IP4_ADDRESS                 LocalAddress;
+    IP4_ADDRESS                 RemoteAddress;
+    PORT_NUMBER                 LocalPort;
+    PORT_NUMBER                 RemotePort;
+} UDP_SOCKET_KEY, *PUDP_SOCKET_KEY;
+STATIC_ASSERT(sizeof(UDP_SOCKET_KEY) == 2 * sizeof(IP4_ADDRESS) + 2 * sizeof(PORT_NUMBER));
+
+typedef struct _UDP_SOCKET
+{
+    HASH_ENTRY                  HashEntry;
+
+    UDP_SOCKET_KEY              Key;
+
+    // one for the opener and one for each call in progress, the socket is
+    // freed when the last one is dropped
+    volatile DWORD              References;
+
+    // the route is looked up again by the sending thread while the socket
+    // may be connected by another one, taken after the UDP lock when both
+    // are needed so Key does not change while it is held
+    LOCK                        RouteLock;
+
+    // valid only for connected sockets: neither the route nor the sum of the
+    // pseudo-header (without the length) change from one datagram to the next
+    _Guarded_by_(RouteLock)
+    BOOLEAN                     Connected;
+
+    _Guarded_by_(RouteLock)
+    IP4_ROUTE                   Route;
+
+    _Guarded_by_(RouteLock)
+    DWORD                       PseudoHeaderSum;
+
+    LOCK                        QueueLock;
+
+    _Guarded_by_(QueueLock)
+    LIST_ENTRY                  ReceiveQueue;
+
+    _Guarded_by_(QueueLock)
+    DWORD                       QueueLength;
+
+    // set by NetUdpSocketClose, wakes up the blocked receivers
+    _Guarded_by_(QueueLock)
+    BOOLEAN                     Closing;
+
+    // signaled while ReceiveQueue is not empty
+    EX_EVENT                    DataAvailable;
+
+    volatile DWORD              DatagramsDropped;
+} UDP_SOCKET;
+
+typedef struct _UDP_DATA
+{
+    // taken shared by the receive path to demultiplex datagrams and exclusive
+    // when sockets are opened, connected or closed
+    RW_SPINLOCK                 Lock;
+
+    _Guarded_by_(Lock)
+    HASH_TABLE                  Sockets;
+
+    _Guarded_by_(Lock)
+    WORD                        NextEphemeralPort;
+} UDP_DATA, *PUDP_DATA;
+
+static UDP_DATA m_udpData;
+
+static FUNC_HashFunction _NetUdpHashKey;
+
+__forceinline
+static
+PUDP_SOCKET
+_NetUdpLookup(
+    IN      PUDP_SOCKET_KEY     Key
+    )
+{
+    PHASH_ENTRY pHashEntry;
+
+    pHashEntry = HashTableLookup(&m_udpData.Sockets, (PHASH_KEY) Key);
+
+    return (NULL != pHashEntry) ? CONTAINING_RECORD(pHashEntry, UDP_SOCKET, HashEntry) : NULL;
+}
+
+static
+STATUS
+_NetUdpSocketSend(
+    INOUT                   PUDP_SOCKET     Socket,
+    IN                      PIP4_ROUTE      Route,
+    IN                      DWORD           PseudoHeaderSum,
+    IN                      PORT_NUMBER     RemotePort,
+    IN_READS_BYTES(Size)    PVOID           Buffer,
+    IN                      DWORD           Size
+    );
+
+static
+void
+_NetUdpFreeQueue(
+    INOUT   PUDP_SOCKET         Socket
+    );
+
+static
+void
+_NetUdpSocketReference(
+    INOUT   PUDP_SOCKET         Socket
+    );
+
+static
+void
+_NetUdpSocketDereference(
+    INOUT   PUDP_SOCKET         Socket
+    );
+
+_No_competing_thread_
+STATUS
+NetUdpInit(
+    void
+    )
+{
+    DWORD tableSize;
+    PHASH_TABLE_DATA pTableData;
+
+    memzero(&m_udpData, sizeof(UDP_DATA));
+
+    RwSpinlockInit(&m_udpData.Lock);
+    m_udpData.NextEphemeralPort = UDP_EPHEMERAL_PORT_FIRST;
+
+    tableSize = HashTablePreinit(&m_udpData.Sockets, UDP_SOCKET_BUCKETS, sizeof(UDP_SOCKET_KEY));
+
+    pTableData = ExAllocatePoolWithTag(0, tableSize, HEAP_NET_TAG, 0);
+    if (NULL == pTableData)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", tableSize);
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    HashTableInit(&m_udpData.Sockets,
+                  pTableData,
+                  _NetUdpHashKey,
+                  FIELD_OFFSET(UDP_SOCKET, Key) - FIELD_OFFSET(UDP_SOCKET, HashEntry));
+
+    return STATUS_SUCCESS;
+}
+
+BOOLEAN
+NetUdpInput(
+    IN      PNETWORK_DEVICE     Device,
+    INOUT   PNET_PACKET         Packet,
+    IN      PIP4_PACKET         Header
+    )
+{
+    PUDP_DATAGRAM pUdp;
+    PUDP_SOCKET pSocket;
+    UDP_SOCKET_KEY key;
+    INTR_STATE intrState;
+    INTR_STATE queueIntrState;
+    DWORD headerLength;
+    DWORD ipPayloadLength;
+    DWORD udpLength;
+    BOOLEAN bQueued;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Packet);
+    ASSERT(NULL != Header);
+
+    UNREFERENCED_PARAMETER(Device);
+
+    headerLength = Header->InternetHeaderLength * sizeof(DWORD);
+    ipPayloadLength = ntohw(Header->Length) - headerLength;
+
+    if (ipPayloadLength < sizeof(UDP_DATAGRAM))
+    {
+        return FALSE;
+    }
+
+    pUdp = (PUDP_DATAGRAM) ((PBYTE) Header + headerLength);
+    udpLength = ntohw(pUdp->Length);
+
+    if (udpLength < sizeof(UDP_DATAGRAM) || udpLength > ipPayloadLength)
+    {
+        LOG_TRACE_NETWORK("Malformed UDP datagram\n");
+        return FALSE;
+    }
+
+    // a checksum of 0 means the sender did not compute it
+    if (0 != pUdp->Checksum)
+    {
+        DWORD sum;
+
+        sum = NetChecksumPseudoHeader(Header->Source, Header->Destination, IP_PROTOCOL_UDP, (WORD) udpLength);
+        sum = NetChecksumAdd(pUdp, udpLength, sum);
+
+        if (0 != NetChecksumFold(sum))
+        {
+            LOG_TRACE_NETWORK("UDP checksum mismatch\n");
+            return FALSE;
+        }
+    }
+
+    key.LocalAddress = Header->Destination;
+    key.RemoteAddress = Header->Source;
+    key.LocalPort = pUdp->Destination;
+    key.RemotePort = pUdp->Source;
+
+    bQueued = FALSE;
+
+    RwSpinlockAcquireShared(&m_udpData.Lock, &intrState);
+
+    // most specific match first: connected socket, socket bound to the
+    // destination address, socket bound to all the interfaces
+    pSocket = _NetUdpLookup(&key);
+    if (NULL == pSocket)
+    {
+        key.RemoteAddress.DwordAddress = 0;
+        key.RemotePort = 0;
+
+        pSocket = _NetUdpLookup(&key);
+        if (NULL == pSocket)
+        {
+            key.LocalAddress.DwordAddress = 0;
+
+            pSocket = _NetUdpLookup(&key);
+        }
+    }
+
+    if (NULL != pSocket)
+    {
+        Packet->RemoteAddress = Header->Source;
+        Packet->RemotePort = pUdp->Source;
+        Packet->DataOffset = (WORD) ((PBYTE) pUdp + sizeof(UDP_DATAGRAM) - Packet->Frame);
+        Packet->DataLength = (WORD) (udpLength - sizeof(UDP_DATAGRAM));
+
+        LockAcquire(&pSocket->QueueLock, &queueIntrState);
+
+        if (pSocket->QueueLength < UDP_SOCKET_MAX_QUEUED_DATAGRAMS)
+        {
+            InsertTailList(&pSocket->ReceiveQueue, &Packet->ListEntry);
+            pSocket->QueueLength++;
+            bQueued = TRUE;
+
+            ExEventSignal(&pSocket->DataAvailable);
+        }
+        else
+        {
+            pSocket->DatagramsDropped++;
+        }
+
+        LockRelease(&pSocket->QueueLock, queueIntrState);
+    }
+    else
+    {
+        LOG_TRACE_NETWORK("No socket listening on port %u\n", ntohw(pUdp->Destination));
+    }
+
+    RwSpinlockReleaseShared(&m_udpData.Lock, intrState);
+
+    return bQueued;
+}
+
+STATUS
+NetUdpSocketOpen(
+    IN              IP4_ADDRESS                     LocalAddress,
+    IN              PORT_NUMBER                     LocalPort,
+    OUT_PTR         PUDP_SOCKET*                    Socket
+    )
+{
+    STATUS status;
+    PUDP_SOCKET pSocket;
+    INTR_STATE intrState;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    status = STATUS_SUCCESS;
+
+    pSocket = ExAllocatePoolWithTag(PoolAllocateZeroMemory, sizeof(UDP_SOCKET), HEAP_NET_TAG, 0);
+    if (NULL == pSocket)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", sizeof(UDP_SOCKET));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    pSocket->References = 1;
+    LockInit(&pSocket->RouteLock);
+    LockInit(&pSocket->QueueLock);
+    InitializeListHead(&pSocket->ReceiveQueue);
+
+    status = ExEventInit(&pSocket->DataAvailable, ExEventTypeNotification, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        ExFreePoolWithTag(pSocket, HEAP_NET_TAG);
+        return status;
+    }
+
+    pSocket->Key.LocalAddress = LocalAddress;
+    pSocket->Key.LocalPort = htonw(LocalPort);
+
+    RwSpinlockAcquireExclusive(&m_udpData.Lock, &intrState);
+
+    if (0 == LocalPort)
+    {
+        UDP_SOCKET_KEY anyAddressKey;
+        DWORD i;
+
+        memzero(&anyAddressKey, sizeof(UDP_SOCKET_KEY));
+        status = STATUS_LIMIT_REACHED;
+
+        for (i = 0; i <= UDP_EPHEMERAL_PORT_LAST - UDP_EPHEMERAL_PORT_FIRST; ++i)
+        {
+            WORD port = m_udpData.NextEphemeralPort;
+
+            m_udpData.NextEphemeralPort = (WORD) ((UDP_EPHEMERAL_PORT_LAST == port) ? UDP_EPHEMERAL_PORT_FIRST : port + 1);
+
+            pSocket->Key.LocalPort = htonw(port);
+            anyAddressKey.LocalPort = pSocket->Key.LocalPort;
+
+            if (NULL == _NetUdpLookup(&pSocket->Key) && NULL == _NetUdpLookup(&anyAddressKey))
+            {
+                status = STATUS_SUCCESS;
+                break;
+            }
+        }
+    }
+    else if (NULL != _NetUdpLookup(&pSocket->Key))
+    {
+        status = STATUS_ELEMENT_FOUND;
+    }
+
+    if (SUCCEEDED(status))
+    {
+        HashTableInsert(&m_udpData.Sockets, &pSocket->HashEntry);
+    }
+
+    RwSpinlockReleaseExclusive(&m_udpData.Lock, intrState);
+
+    if (!SUCCEEDED(status))
+    {
+        LOG_WARNING("Cannot bind UDP socket to port %u, status 0x%x\n", LocalPort, status);
+        ExFreePoolWithTag(pSocket, HEAP_NET_TAG);
+        return status;
+    }
+
+    LOG_TRACE_NETWORK("Opened UDP socket on port %u\n", ntohw(pSocket->Key.LocalPort));
+
+    *Socket = pSocket;
+
+    return status;
+}
+
+STATUS
+NetUdpSocketConnect(
+    INOUT           PUDP_SOCKET                     Socket,
+    IN              IP4_ADDRESS                     RemoteAddress,
+    IN              PORT_NUMBER                     RemotePort
+    )
+{
+    STATUS status;
+    IP4_ROUTE route;
+    UDP_SOCKET_KEY key;
+    PUDP_SOCKET pExistingSocket;
+    INTR_STATE intrState;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (0 == RemoteAddress.DwordAddress)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (0 == RemotePort)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    status = NetIp4RouteLookup(Socket->Key.LocalAddress, RemoteAddress, IP_PROTOCOL_UDP, &route);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetIp4RouteLookup", status);
+        return status;
+    }
+
+    // a connected socket is always bound to the address of the interface the
+    // route goes through, this keeps the receive path to a single lookup
+    memcpy(&key, &Socket->Key, sizeof(UDP_SOCKET_KEY));
+    key.LocalAddress = route.HeaderTemplate.Source;
+    key.RemoteAddress = RemoteAddress;
+    key.RemotePort = htonw(RemotePort);
+
+    RwSpinlockAcquireExclusive(&m_udpData.Lock, &intrState);
+
+    pExistingSocket = _NetUdpLookup(&key);
+    if (NULL != pExistingSocket && Socket != pExistingSocket)
+    {
+        status = STATUS_ELEMENT_FOUND;
+    }
+    else
+    {
+        INTR_STATE routeIntrState;
+
+        LockAcquire(&Socket->RouteLock, &routeIntrState);
+
+        HashTableRemoveEntry(&m_udpData.Sockets, &Socket->HashEntry);
+        memcpy(&Socket->Key, &key, sizeof(UDP_SOCKET_KEY));
+        HashTableInsert(&m_udpData.Sockets, &Socket->HashEntry);
+
+        memcpy(&Socket->Route, &route, sizeof(IP4_ROUTE));
+        Socket->PseudoHeaderSum = NetChecksumPseudoHeader(key.LocalAddress, key.RemoteAddress, IP_PROTOCOL_UDP, 0);
+        Socket->Connected = TRUE;
+
+        LockRelease(&Socket->RouteLock, routeIntrState);
+    }
+
+    RwSpinlockReleaseExclusive(&m_udpData.Lock, intrState);
+
+    return status;
+}
+
+STATUS
+NetUdpSocketSend(
+    INOUT           PUDP_SOCKET                     Socket,
+    IN_READS_BYTES(Size)    PVOID                   Buffer,
+    IN              DWORD                           Size
+    )
+{
+    STATUS status;
+    IP4_ROUTE route;
+    UDP_SOCKET_KEY key;
+    DWORD pseudoHeaderSum;
+    BOOLEAN bConnected;
+    INTR_STATE intrState;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffer && 0 != Size)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    _NetUdpSocketReference(Socket);
+
+    __try
+    {
+        // the datagram is sent on a copy of the route, the socket may be
+        // connected again meanwhile
+        LockAcquire(&Socket->RouteLock, &intrState);
+        bConnected = Socket->Connected;
+        memcpy(&key, &Socket->Key, sizeof(UDP_SOCKET_KEY));
+        memcpy(&route, &Socket->Route, sizeof(IP4_ROUTE));
+        pseudoHeaderSum = Socket->PseudoHeaderSum;
+        LockRelease(&Socket->RouteLock, intrState);
+
+        if (!bConnected)
+        {
+            status = STATUS_DEVICE_NOT_CONNECTED;
+            __leave;
+        }
+
+        if (!NetIp4RouteIsValid(&route))
+        {
+            // an interface was reconfigured since the socket was connected, the
+            // local address of the socket does not change
+            status = NetIp4RouteLookup(key.LocalAddress, key.RemoteAddress, IP_PROTOCOL_UDP, &route);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("NetIp4RouteLookup", status);
+                __leave;
+            }
+
+            // unless it was connected again, the next datagrams use the new
+            // route as well
+            LockAcquire(&Socket->RouteLock, &intrState);
+            if (0 == memcmp(&Socket->Key, &key, sizeof(UDP_SOCKET_KEY)))
+            {
+                memcpy(&Socket->Route, &route, sizeof(IP4_ROUTE));
+            }
+            LockRelease(&Socket->RouteLock, intrState);
+        }
+
+        status = _NetUdpSocketSend(Socket,
+                                   &route,
+                                   pseudoHeaderSum,
+                                   key.RemotePort,
+                                   Buffer,
+                                   Size);
+    }
+    __finally
+    {
+        _NetUdpSocketDereference(Socket);
+    }
+
+    return status;
+}
+
+STATUS
+NetUdpSocketSendTo(
+    INOUT           PUDP_SOCKET                     Socket,
+    IN              IP4_ADDRESS                     RemoteAddress,
+    IN              PORT_NUMBER                     RemotePort,
+    IN_READS_BYTES(Size)    PVOID                   Buffer,
+    IN              DWORD                           Size
+    )
+{
+    STATUS status;
+    IP4_ROUTE route;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (0 == RemotePort)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (NULL == Buffer && 0 != Size)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    _NetUdpSocketReference(Socket);
+
+    __try
+    {
+        status = NetIp4RouteLookup(Socket->Key.LocalAddress, RemoteAddress, IP_PROTOCOL_UDP, &route);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("NetIp4RouteLookup", status);
+            __leave;
+        }
+
+        status = _NetUdpSocketSend(Socket,
+                                   &route,
+                                   NetChecksumPseudoHeader(route.HeaderTemplate.Source, RemoteAddress, IP_PROTOCOL_UDP, 0),
+                                   htonw(RemotePort),
+                                   Buffer,
+                                   Size);
+    }
+    __finally
+    {
+        _NetUdpSocketDereference(Socket);
+    }
+
+    return status;
+}
+
+STATUS
+NetUdpSocketReceive(
+    INOUT           PUDP_SOCKET                     Socket,
+    OUT_WRITES_BYTES(Size)  PVOID                   Buffer,
+    IN              DWORD                           Size,
+    OUT             DWORD*                          BytesReceived,
+    OUT_OPT         PIP4_ADDRESS                    RemoteAddress,
+    OUT_OPT         PORT_NUMBER*                    RemotePort
+    )
+{
+    PLIST_ENTRY pEntry;
+    PNET_PACKET pPacket;
+    INTR_STATE intrState;
+    BOOLEAN bClosing;
+
+    if (NULL == Socket)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffer && 0 != Size)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == BytesReceived)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    // keeps the socket alive if it is closed while waiting
+    _NetUdpSocketReference(Socket);
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        LockAcquire(&Socket->QueueLock, &intrState);
+
+        pEntry = RemoveHeadList(&Socket->ReceiveQueue);
+        if (pEntry != &Socket->ReceiveQueue)
+        {
+            Socket->QueueLength--;
+        }
+
+        // the event is cleared under the same lock the receive path signals
+        // it with, so a datagram queued after this point cannot be missed,
+        // once the socket is closing it stays signaled
+        bClosing = Socket->Closing;
+        if (IsListEmpty(&Socket->ReceiveQueue) && !bClosing)
+        {
+            ExEventClearSignal(&Socket->DataAvailable);
+        }
+
+        LockRelease(&Socket->QueueLock, intrState);
+
+        if (pEntry != &Socket->ReceiveQueue || bClosing)
+        {
+            break;
+        }
+
+        ExEventWaitForSignal(&Socket->DataAvailable);
+    }
+
+    if (pEntry == &Socket->ReceiveQueue)
+    {
+        *BytesReceived = 0;
+        _NetUdpSocketDereference(Socket);
+        return STATUS_NO_DATA_AVAILABLE;
+    }
+
+    pPacket = CONTAINING_RECORD(pEntry, NET_PACKET, ListEntry);
+
+    memcpy(Buffer, &pPacket->Frame[pPacket->DataOffset], min(Size, pPacket->DataLength));
+    *BytesReceived = pPacket->DataLength;
+
+    if (NULL != RemoteAddress)
+    {
+        *RemoteAddress = pPacket->RemoteAddress;
+    }
+
+    if (NULL != RemotePort)
+    {
+        *RemotePort = ntohw(pPacket->RemotePort);
+    }
+
+    NetPacketFree(pPacket);
+    pPacket = NULL;
+
+    _NetUdpSocketDereference(Socket);
+
+    return (Size < *BytesReceived) ? STATUS_BUFFER_TOO_SMALL : STATUS_SUCCESS;
+}
+
+void
+NetUdpSocketClose(
+    _Pre_notnull_ _Post_ptr_invalid_
+                    PUDP_SOCKET                     Socket
+    )
+{
+    INTR_STATE intrState;
+
+    ASSERT(NULL != Socket);
+
+    RwSpinlockAcquireExclusive(&m_udpData.Lock, &intrState);
+    HashTableRemoveEntry(&m_udpData.Sockets, &Socket->HashEntry);
+    RwSpinlockReleaseExclusive(&m_udpData.Lock, intrState);
+
+    // the receive path can no longer find the socket, the threads waiting
+    // for a datagram return without one
+    LockAcquire(&Socket->QueueLock, &intrState);
+    Socket->Closing = TRUE;
+    ExEventSignal(&Socket->DataAvailable);
+    LockRelease(&Socket->QueueLock, intrState);
+
+    _NetUdpFreeQueue(Socket);
+
+    // the socket is freed once the calls still in progress return
+    _NetUdpSocketDereference(Socket);
+}
+
+static
+STATUS
+_NetUdpSocketSend(
+    INOUT                   PUDP_SOCKET     Socket,
+    IN                      PIP4_ROUTE      Route,
+    IN                      DWORD           PseudoHeaderSum,
+    IN                      PORT_NUMBER     RemotePort,
+    IN_READS_BYTES(Size)    PVOID           Buffer,
+    IN                      DWORD           Size
+    )
+{
+    PNET_PACKET pPacket;
+    PUDP_DATAGRAM pUdp;
+    DWORD sum;
+    WORD udpLength;
+    WORD checksum;
+
+    ASSERT(NULL != Socket);
+    ASSERT(NULL != Route);
+
+    if (Size > UDP_MAX_PAYLOAD_SIZE)
+    {
+        return STATUS_BUFFER_TOO_LARGE;
+    }
+
+    pPacket = NetPacketAllocate();
+    if (NULL == pPacket)
+    {
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    pUdp = (PUDP_DATAGRAM) &pPacket->Frame[sizeof(ETHERNET_FRAME) + sizeof(IP4_PACKET)];
+    udpLength = (WORD) (sizeof(UDP_DATAGRAM) + Size);
+
+    pUdp->Source = Socket->Key.LocalPort;
+    pUdp->Destination = RemotePort;
+    pUdp->Length = htonw(udpLength);
+    pUdp->Checksum = 0;
+
+    // the length is part of both the pseudo-header and the UDP header, the
+    // cached pseudo-header sum does not include it
+    sum = NetChecksumAdd(pUdp, sizeof(UDP_DATAGRAM), PseudoHeaderSum);
+    sum = NetChecksumAdd(&pUdp->Length, sizeof(WORD), sum);
+
+    // the payload is summed while it is copied into the frame
+    sum = NetChecksumCopy(pUdp + 1, Buffer, Size, sum);
+
+    // a computed checksum of 0 is sent as all ones, 0 means no checksum
+    checksum = NetChecksumFold(sum);
+    pUdp->Checksum = (0 == checksum) ? MAX_WORD : checksum;
+
+    pPacket->Length = sizeof(ETHERNET_FRAME) + sizeof(IP4_PACKET) + udpLength;
+
+    return NetIp4Output(Route, pPacket);
+}
+
+static
+void
+_NetUdpFreeQueue(
+    INOUT   PUDP_SOCKET         Socket
+    )
+{
+    PLIST_ENTRY pEntry;
+    INTR_STATE intrState;
+    LIST_ENTRY packets;
+
+    ASSERT(NULL != Socket);
+
+    InitializeListHead(&packets);
+
+    LockAcquire(&Socket->QueueLock, &intrState);
+
+    if (!IsListEmpty(&Socket->ReceiveQueue))
+    {
+        InsertTailList(&Socket->ReceiveQueue, &packets);
+        RemoveEntryList(&Socket->ReceiveQueue);
+        InitializeListHead(&Socket->ReceiveQueue);
+    }
+    Socket->QueueLength = 0;
+
+    LockRelease(&Socket->QueueLock, intrState);
+
+    while ((pEntry = RemoveHeadList(&packets)) != &packets)
+    {
+        NetPacketFree(CONTAINING_RECORD(pEntry, NET_PACKET, ListEntry));
+    }
+}
+
+static
+void
+_NetUdpSocketReference(
+    INOUT   PUDP_SOCKET         Socket
+    )
+{
+    DWORD references;
+
+    ASSERT(NULL != Socket);
+
+    references = _InterlockedIncrement(&Socket->References);
+
+    // the caller must already hold a reference
+    ASSERT(references > 1);
+}
+
+static
+void
+_NetUdpSocketDereference(
+    INOUT   PUDP_SOCKET         Socket
+    )
+{
+    ASSERT(NULL != Socket);
+
+    if (0 != _InterlockedDecrement(&Socket->References))
+    {
+        return;
+    }
+
+    if (0 != Socket->DatagramsDropped)
+    {
+        LOG_TRACE_NETWORK("UDP socket on port %u dropped %u datagrams\n",
+                          ntohw(Socket->Key.LocalPort), Socket->DatagramsDropped);
+    }
+
+    ExFreePoolWithTag(Socket, HEAP_NET_TAG);
+}
+
+static
+QWORD
+(__cdecl _NetUdpHashKey)(
+    IN_READS_BYTES(KeyLength)   PHASH_KEY   Key,
+    IN                          DWORD       KeyLength,
+    IN                          DWORD       MaxKeys
+    )
+{
+    PUDP_SOCKET_KEY pKey;
+    DWORD hash;
+
+    ASSERT(NULL != Key);
+    ASSERT(sizeof(UDP_SOCKET_KEY) == KeyLength);
+
+    UNREFERENCED_PARAMETER(KeyLength);
+
+    pKey = (PUDP_SOCKET_KEY) Key;
+
+    hash = pKey->LocalAddress.DwordAddress ^ pKey->RemoteAddress.DwordAddress;
+    hash ^= ((DWORD) pKey->LocalPort << 16) | pKey->RemotePort;
+
+    // mix the high bits in, most of the entropy of an address is in its
+    // last byte which ends up in the high bits of the DWORD
+    hash ^= hash >> 16;
+    hash *= 0x45D9F3B;
+    hash ^= hash >> 16;
+
+    return hash % MaxKeys;
+}
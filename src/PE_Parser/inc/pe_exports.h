@@ -88,11 +88,16 @@ typedef struct _PE_NT_HEADER_INFO
 #define IMAGE_SCN_MEM_READ                   0x40000000  // Section is readable.
 #define IMAGE_SCN_MEM_WRITE                  0x80000000  // Section is writeable.
 
+#define PE_SECTION_NAME_MAX_LENGTH          8
+
 typedef struct _PE_SECTION_INFO
 {
     PVOID               BaseAddress;
     DWORD               Size;
     DWORD               Characteristics;
+
+    // NULL terminated, even if the name in the section header is not
+    char                Name[PE_SECTION_NAME_MAX_LENGTH + 1];
 } PE_SECTION_INFO, *PPE_SECTION_INFO;
 
 #define IMAGE_DIRECTORY_ENTRY_EXPORT          0   // Export Directory
@@ -115,4 +120,12 @@ typedef struct _PE_DATA_DIRECTORY
 {
     PVOID               BaseAddress;
     DWORD               Size;
-} PE_DATA_DIRECTORY, *PPE_DATA_DIRECTORY;
\ No newline at end of file
+} PE_DATA_DIRECTORY, *PPE_DATA_DIRECTORY;
+
+typedef struct _PE_EXPORT_INFO
+{
+    PVOID               Address;
+
+    // points inside the image
+    char*               Name;
+} PE_EXPORT_INFO, *PPE_EXPORT_INFO;
\ No newline at end of file
@@ -21,4 +21,21 @@ PeRetrieveDataDirectory(
     IN                          PPE_NT_HEADER_INFO      NtInfo,
     IN                          BYTE                    DataDirectory,
     OUT                         PPE_DATA_DIRECTORY      DataDirectoryInfo
+    );
+
+//******************************************************************************
+// Function:     PeRetrieveNearestExport
+// Description:  Finds the exported function with the highest address which is
+//               lower or equal to Address. Forwarded exports are ignored.
+// Returns:      STATUS - STATUS_ELEMENT_NOT_FOUND if the image has no export
+//               placed before Address.
+// Parameter:    IN PPE_NT_HEADER_INFO NtInfo
+// Parameter:    IN PVOID Address - Must be inside the image.
+// Parameter:    OUT PPE_EXPORT_INFO ExportInfo
+//******************************************************************************
+STATUS
+PeRetrieveNearestExport(
+    IN                          PPE_NT_HEADER_INFO      NtInfo,
+    IN                          PVOID                   Address,
+    OUT                         PPE_EXPORT_INFO         ExportInfo
     );
\ No newline at end of file
@@ -109,6 +109,10 @@ PeRetrieveSection(
     SectionInfo->Size = pSections[SectionIndex].Misc.VirtualSize;
     SectionInfo->Characteristics = pSections[SectionIndex].Characteristics;
 
+    STATIC_ASSERT(PE_SECTION_NAME_MAX_LENGTH == IMAGE_SIZEOF_SHORT_NAME);
+    memcpy(SectionInfo->Name, pSections[SectionIndex].Name, IMAGE_SIZEOF_SHORT_NAME);
+    SectionInfo->Name[PE_SECTION_NAME_MAX_LENGTH] = '\0';
+
     if (!CHECK_BOUNDS(SectionInfo->BaseAddress, SectionInfo->Size, NtInfo->ImageBase, NtInfo->Size))
     {
         return STATUS_INVALID_IMAGE_SIZE;
@@ -169,5 +173,110 @@ PeRetrieveDataDirectory(
         return STATUS_INVALID_IMAGE_SIZE;
     }
 
+    return STATUS_SUCCESS;
+}
+
+STATUS
+PeRetrieveNearestExport(
+    IN                          PPE_NT_HEADER_INFO      NtInfo,
+    IN                          PVOID                   Address,
+    OUT                         PPE_EXPORT_INFO         ExportInfo
+    )
+{
+    STATUS status;
+    PE_DATA_DIRECTORY exportDirectory;
+    PIMAGE_EXPORT_DIRECTORY pExports;
+    DWORD* pFunctions;
+    DWORD* pNames;
+    WORD* pOrdinals;
+    QWORD rva;
+    DWORD bestRva;
+    DWORD bestName;
+    BOOLEAN bFound;
+    DWORD i;
+
+    if (NULL == NtInfo)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (!CHECK_BOUNDS(Address, 1, NtInfo->ImageBase, NtInfo->Size))
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (NULL == ExportInfo)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    status = PeRetrieveDataDirectory(NtInfo, IMAGE_DIRECTORY_ENTRY_EXPORT, &exportDirectory);
+    if (!SUCCEEDED(status))
+    {
+        return status;
+    }
+
+    if (exportDirectory.Size < sizeof(IMAGE_EXPORT_DIRECTORY))
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    pExports = (PIMAGE_EXPORT_DIRECTORY) exportDirectory.BaseAddress;
+
+    pFunctions = (DWORD*) PtrOffset(NtInfo->ImageBase, pExports->AddressOfFunctions);
+    pNames = (DWORD*) PtrOffset(NtInfo->ImageBase, pExports->AddressOfNames);
+    pOrdinals = (WORD*) PtrOffset(NtInfo->ImageBase, pExports->AddressOfNameOrdinals);
+
+    if (!CHECK_BOUNDS(pFunctions, sizeof(DWORD) * (QWORD) pExports->NumberOfFunctions, NtInfo->ImageBase, NtInfo->Size) ||
+        !CHECK_BOUNDS(pNames, sizeof(DWORD) * (QWORD) pExports->NumberOfNames, NtInfo->ImageBase, NtInfo->Size) ||
+        !CHECK_BOUNDS(pOrdinals, sizeof(WORD) * (QWORD) pExports->NumberOfNames, NtInfo->ImageBase, NtInfo->Size))
+    {
+        return STATUS_INVALID_IMAGE_SIZE;
+    }
+
+    rva = (QWORD) PtrDiff(Address, NtInfo->ImageBase);
+    bestRva = 0;
+    bestName = 0;
+    bFound = FALSE;
+
+    // only the exports which have a name are of any use to the caller
+    for (i = 0; i < pExports->NumberOfNames; ++i)
+    {
+        DWORD functionRva;
+
+        if (pOrdinals[i] >= pExports->NumberOfFunctions)
+        {
+            continue;
+        }
+
+        functionRva = pFunctions[pOrdinals[i]];
+
+        // forwarded exports point to a string inside the export directory
+        if (CHECK_BOUNDS(PtrOffset(NtInfo->ImageBase, functionRva), 1, exportDirectory.BaseAddress, exportDirectory.Size))
+        {
+            continue;
+        }
+
+        if (functionRva <= rva && (!bFound || functionRva > bestRva))
+        {
+            bestRva = functionRva;
+            bestName = pNames[i];
+            bFound = TRUE;
+        }
+    }
+
+    if (!bFound)
+    {
+        return STATUS_ELEMENT_NOT_FOUND;
+    }
+
+    if (!CHECK_BOUNDS(PtrOffset(NtInfo->ImageBase, bestName), 1, NtInfo->ImageBase, NtInfo->Size))
+    {
+        return STATUS_INVALID_IMAGE_SIZE;
+    }
+
+    ExportInfo->Address = PtrOffset(NtInfo->ImageBase, bestRva);
+    ExportInfo->Name = (char*) PtrOffset(NtInfo->ImageBase, bestName);
+
     return STATUS_SUCCESS;
 }
\ No newline at end of file
@@ -196,3 +196,42 @@ SyscallFileWrite(
 {
     return SyscallEntry(SyscallIdFileWrite, FileHandle, Buffer, BytesToWrite, BytesWritten);
 }
+
+// SyscallIdNetRingCreate
+STATUS
+SyscallNetRingCreate(
+    IN          DWORD                   DeviceId,
+    IN          DWORD                   SlotCount,
+    OUT         PNET_RING_HEADER*       Ring
+    )
+{
+    return SyscallEntry(SyscallIdNetRingCreate, DeviceId, SlotCount, Ring);
+}
+
+// SyscallIdNetRingTransmit
+STATUS
+SyscallNetRingTransmit(
+    IN          PNET_RING_HEADER        Ring,
+    OUT_OPT     DWORD*                  FramesSent
+    )
+{
+    return SyscallEntry(SyscallIdNetRingTransmit, Ring, FramesSent);
+}
+
+// SyscallIdNetRingWait
+STATUS
+SyscallNetRingWait(
+    IN          PNET_RING_HEADER        Ring
+    )
+{
+    return SyscallEntry(SyscallIdNetRingWait, Ring);
+}
+
+// SyscallIdNetRingClose
+STATUS
+SyscallNetRingClose(
+    IN          PNET_RING_HEADER        Ring
+    )
+{
+    return SyscallEntry(SyscallIdNetRingClose, Ring);
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+#include "virtio_registers.h"
+
+// Configuration structures mapped from the BARs of the device
+typedef struct _VIRTIO_MAPPED_REGION
+{
+    PVOID                           VirtualAddress;
+    DWORD                           Size;
+} VIRTIO_MAPPED_REGION, *PVIRTIO_MAPPED_REGION;
+
+typedef struct _VIRTIO_DEVICE
+{
+    PPCI_DEVICE_DESCRIPTION         PciDevice;
+
+    PVIRTIO_PCI_COMMON_CONFIG       CommonConfig;
+    volatile BYTE*                  IsrStatus;
+    PBYTE                           NotifyBase;
+    DWORD                           NotifyOffsetMultiplier;
+    volatile BYTE*                  DeviceConfig;
+    DWORD                           DeviceConfigSize;
+
+    // features offered by the device and the ones we accepted
+    QWORD                           DeviceFeatures;
+    QWORD                           NegotiatedFeatures;
+
+    VIRTIO_MAPPED_REGION            Regions[VirtioPciCapabilityReserved];
+} VIRTIO_DEVICE, *PVIRTIO_DEVICE;
+
+//******************************************************************************
+// Function:     VirtioInitializeDevice
+// Description:  Locates and maps the configuration structures of a virtio PCI
+//               device, resets the device and acknowledges it. On success the
+//               features offered by the device are in DeviceFeatures.
+// Returns:      STATUS - STATUS_DEVICE_NOT_SUPPORTED if the device does not
+//               implement the modern (virtio 1.0) PCI interface.
+// Parameter:    IN PPCI_DEVICE_DESCRIPTION PciDevice
+// Parameter:    OUT PVIRTIO_DEVICE Device
+//******************************************************************************
+STATUS
+VirtioInitializeDevice(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    OUT         PVIRTIO_DEVICE              Device
+    );
+
+//******************************************************************************
+// Function:     VirtioUninitializeDevice
+// Description:  Resets the device (it stops accessing the virtqueues) and
+//               unmaps its configuration structures.
+// Returns:      void
+// Parameter:    INOUT PVIRTIO_DEVICE Device
+//******************************************************************************
+void
+VirtioUninitializeDevice(
+    INOUT       PVIRTIO_DEVICE              Device
+    );
+
+//******************************************************************************
+// Function:     VirtioNegotiateFeatures
+// Description:  Accepts the features from DriverFeatures which the device
+//               offers. VIRTIO_F_VERSION_1 is always requested.
+// Returns:      STATUS - STATUS_DEVICE_NOT_SUPPORTED if the device does not
+//               accept the feature set.
+// Parameter:    INOUT PVIRTIO_DEVICE Device
+// Parameter:    IN QWORD DriverFeatures
+//******************************************************************************
+STATUS
+VirtioNegotiateFeatures(
+    INOUT       PVIRTIO_DEVICE              Device,
+    IN          QWORD                       DriverFeatures
+    );
+
+//******************************************************************************
+// Function:     VirtioSetDriverOk
+// Description:  Tells the device the driver finished setting it up, must be
+//               called after all the virtqueues are initialized.
+// Returns:      void
+// Parameter:    INOUT PVIRTIO_DEVICE Device
+//******************************************************************************
+void
+VirtioSetDriverOk(
+    INOUT       PVIRTIO_DEVICE              Device
+    );
+
+//******************************************************************************
+// Function:     VirtioReadDeviceConfig
+// Description:  Reads a consistent copy of a part of the device specific
+//               configuration structure.
+// Returns:      STATUS
+// Parameter:    IN PVIRTIO_DEVICE Device
+// Parameter:    IN DWORD Offset
+// Parameter:    IN DWORD Size
+// Parameter:    OUT_WRITES_BYTES_ALL(Size) PVOID Buffer
+//******************************************************************************
+STATUS
+VirtioReadDeviceConfig(
+    IN          PVIRTIO_DEVICE              Device,
+    IN          DWORD                       Offset,
+    IN          DWORD                       Size,
+    OUT_WRITES_BYTES_ALL(Size)
+                PVOID                       Buffer
+    );
+
+//******************************************************************************
+// Function:     VirtioSetConfigMsixVector
+// Description:  Selects the MSI-X table entry used for the configuration
+//               change interrupts, only meaningful if MSI-X is used.
+// Returns:      STATUS - STATUS_DEVICE_NOT_SUPPORTED if the device could not
+//               assign the vector.
+// Parameter:    INOUT PVIRTIO_DEVICE Device
+// Parameter:    IN WORD Vector - VIRTIO_MSI_NO_VECTOR disables the interrupt.
+//******************************************************************************
+STATUS
+VirtioSetConfigMsixVector(
+    INOUT       PVIRTIO_DEVICE              Device,
+    IN          WORD                        Vector
+    );
+
+//******************************************************************************
+// Function:     VirtioAcknowledgeInterrupt
+// Description:  Reads (and by doing so clears) the ISR status of the device,
+//               must be called by the interrupt handler when the device uses
+//               legacy interrupts.
+// Returns:      BYTE - VIRTIO_ISR_* bits, 0 if the interrupt is not ours.
+// Parameter:    IN PVIRTIO_DEVICE Device
+//******************************************************************************
+BYTE
+VirtioAcknowledgeInterrupt(
+    IN          PVIRTIO_DEVICE              Device
+    );
+
+__forceinline
+static
+BOOLEAN
+VirtioIsFeatureNegotiated(
+    IN          PVIRTIO_DEVICE              Device,
+    IN          QWORD                       Feature
+    )
+{
+    return IsBooleanFlagOn(Device->NegotiatedFeatures, Feature);
+}
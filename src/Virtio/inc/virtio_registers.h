@@ -0,0 +1,162 @@
+#pragma once
+
+// Virtual I/O Device (VIRTIO) Version 1.0 Specification
+
+#define VIRTIO_PCI_VENDOR_ID                    0x1AF4
+
+// Devices which only implement the modern interface have the device ID
+// 0x1040 + the virtio device type
+#define VIRTIO_PCI_MODERN_DEVICE_ID(Type)       (0x1040 + (Type))
+
+#define VIRTIO_DEVICE_TYPE_NETWORK              1
+#define VIRTIO_DEVICE_TYPE_BLOCK                2
+
+// Device Status Field
+#define VIRTIO_STATUS_ACKNOWLEDGE               (1<<0)
+#define VIRTIO_STATUS_DRIVER                    (1<<1)
+#define VIRTIO_STATUS_DRIVER_OK                 (1<<2)
+#define VIRTIO_STATUS_FEATURES_OK               (1<<3)
+#define VIRTIO_STATUS_DEVICE_NEEDS_RESET        (1<<6)
+#define VIRTIO_STATUS_FAILED                    (1<<7)
+
+// Reserved Feature Bits, the bits below 24 are device specific
+#define VIRTIO_F_RING_INDIRECT_DESC             (1ULL<<28)
+#define VIRTIO_F_RING_EVENT_IDX                 (1ULL<<29)
+#define VIRTIO_F_VERSION_1                      (1ULL<<32)
+
+// ISR status
+#define VIRTIO_ISR_QUEUE_INTERRUPT              (1<<0)
+#define VIRTIO_ISR_CONFIGURATION_CHANGE         (1<<1)
+
+// MSI-X vector meaning the event does not generate an interrupt, this is
+// also what the device reports if it could not assign the vector
+#define VIRTIO_MSI_NO_VECTOR                    0xFFFF
+
+// The maximum queue size allowed by the split virtqueue format
+#define VIRTQ_MAX_SIZE                          32768
+
+// Virtqueue descriptor flags
+#define VIRTQ_DESC_F_NEXT                       (1<<0)
+#define VIRTQ_DESC_F_WRITE                      (1<<1)
+#define VIRTQ_DESC_F_INDIRECT                   (1<<2)
+
+#define VIRTQ_AVAIL_F_NO_INTERRUPT              (1<<0)
+#define VIRTQ_USED_F_NO_NOTIFY                  (1<<0)
+
+// Alignment requirements of the virtqueue parts
+#define VIRTQ_DESC_ALIGNMENT                    16
+#define VIRTQ_AVAIL_ALIGNMENT                   2
+#define VIRTQ_USED_ALIGNMENT                    4
+
+typedef enum _VIRTIO_PCI_CAPABILITY_TYPE
+{
+    VirtioPciCapabilityCommonConfig = 1,
+    VirtioPciCapabilityNotifyConfig,
+    VirtioPciCapabilityIsrConfig,
+    VirtioPciCapabilityDeviceConfig,
+    VirtioPciCapabilityPciConfig,
+    VirtioPciCapabilityReserved
+} VIRTIO_PCI_CAPABILITY_TYPE;
+
+#pragma pack(push,1)
+
+#pragma warning(push)
+
+// warning C4200: nonstandard extension used: zero-sized array in struct/union
+#pragma warning(disable:4200)
+
+// Vendor specific PCI capability (PCI_CAPABILITY_ID_VENDOR) describing where
+// one of the configuration structures lives
+typedef struct _VIRTIO_PCI_CAPABILITY
+{
+    PCI_CAPABILITY_HEADER               Header;
+    BYTE                                Length;
+
+    // VIRTIO_PCI_CAPABILITY_TYPE
+    BYTE                                ConfigType;
+    BYTE                                Bar;
+    BYTE                                __Reserved0[3];
+    DWORD                               Offset;
+    DWORD                               Size;
+} VIRTIO_PCI_CAPABILITY, *PVIRTIO_PCI_CAPABILITY;
+STATIC_ASSERT(sizeof(VIRTIO_PCI_CAPABILITY) == 16);
+
+typedef struct _VIRTIO_PCI_NOTIFY_CAPABILITY
+{
+    VIRTIO_PCI_CAPABILITY               Capability;
+
+    // the notification address of a queue is
+    // Offset + QueueNotifyOffset * NotifyOffsetMultiplier
+    DWORD                               NotifyOffsetMultiplier;
+} VIRTIO_PCI_NOTIFY_CAPABILITY, *PVIRTIO_PCI_NOTIFY_CAPABILITY;
+STATIC_ASSERT(sizeof(VIRTIO_PCI_NOTIFY_CAPABILITY) == 20);
+
+typedef volatile struct _VIRTIO_PCI_COMMON_CONFIG
+{
+    // About the whole device
+    DWORD                               DeviceFeatureSelect;
+    DWORD                               DeviceFeature;
+    DWORD                               DriverFeatureSelect;
+    DWORD                               DriverFeature;
+
+    // 0x10
+    WORD                                MsixConfig;
+    WORD                                NumberOfQueues;
+    BYTE                                DeviceStatus;
+    BYTE                                ConfigGeneration;
+
+    // About a specific virtqueue, selected by QueueSelect
+    WORD                                QueueSelect;
+
+    // 0x18
+    WORD                                QueueSize;
+    WORD                                QueueMsixVector;
+    WORD                                QueueEnable;
+    WORD                                QueueNotifyOffset;
+
+    // 0x20
+    QWORD                               QueueDescriptors;
+    QWORD                               QueueDriver;
+    QWORD                               QueueDevice;
+} VIRTIO_PCI_COMMON_CONFIG, *PVIRTIO_PCI_COMMON_CONFIG;
+STATIC_ASSERT(sizeof(VIRTIO_PCI_COMMON_CONFIG) == 0x38);
+
+typedef struct _VIRTQ_DESC
+{
+    QWORD                               Address;
+    DWORD                               Length;
+    WORD                                Flags;
+    WORD                                Next;
+} VIRTQ_DESC, *PVIRTQ_DESC;
+STATIC_ASSERT(sizeof(VIRTQ_DESC) == 16);
+
+// Driver area, followed by a WORD holding the used event index if
+// VIRTIO_F_RING_EVENT_IDX was negotiated
+typedef volatile struct _VIRTQ_AVAIL
+{
+    WORD                                Flags;
+    WORD                                Index;
+    WORD                                Ring[0];
+} VIRTQ_AVAIL, *PVIRTQ_AVAIL;
+
+typedef struct _VIRTQ_USED_ELEM
+{
+    // index of the head of the descriptor chain
+    DWORD                               Id;
+
+    // number of bytes written by the device into the buffers
+    DWORD                               Length;
+} VIRTQ_USED_ELEM, *PVIRTQ_USED_ELEM;
+STATIC_ASSERT(sizeof(VIRTQ_USED_ELEM) == 8);
+
+// Device area, followed by a WORD holding the available event index if
+// VIRTIO_F_RING_EVENT_IDX was negotiated
+typedef volatile struct _VIRTQ_USED
+{
+    WORD                                Flags;
+    WORD                                Index;
+    VIRTQ_USED_ELEM                     Ring[0];
+} VIRTQ_USED, *PVIRTQ_USED;
+
+#pragma warning(pop)
+#pragma pack(pop)
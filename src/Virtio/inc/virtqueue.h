@@ -0,0 +1,175 @@
+#pragma once
+
+#include "virtio.h"
+
+typedef struct _VIRTQUEUE_BUFFER
+{
+    PHYSICAL_ADDRESS                PhysicalAddress;
+    DWORD                           Length;
+
+    // TRUE if the device writes into the buffer, FALSE if it reads from it
+    BOOLEAN                         DeviceWritable;
+} VIRTQUEUE_BUFFER, *PVIRTQUEUE_BUFFER;
+
+// Split virtqueue. The functions operating on a virtqueue are not synchronized
+// with each other, the caller must serialize them.
+typedef struct _VIRTQUEUE
+{
+    PVIRTIO_DEVICE                  Device;
+    WORD                            QueueIndex;
+    WORD                            Size;
+    volatile WORD*                  NotifyAddress;
+
+    // descriptor table, driver area and device area in a single allocation
+    PVOID                           RingMemory;
+    PVIRTQ_DESC                     Descriptors;
+    PVIRTQ_AVAIL                    Available;
+    PVIRTQ_USED                     Used;
+
+    // valid only if EventIndex is TRUE
+    volatile WORD*                  UsedEvent;
+    volatile WORD*                  AvailableEvent;
+
+    BOOLEAN                         EventIndex;
+
+    // if TRUE each descriptor has its own table of MaxIndirectEntries
+    // entries and a chain of buffers occupies a single descriptor
+    BOOLEAN                         Indirect;
+    WORD                            MaxIndirectEntries;
+    PVIRTQ_DESC                     IndirectTables;
+    PHYSICAL_ADDRESS                IndirectTablesPhysicalAddress;
+
+    WORD                            FreeHead;
+    WORD                            NumberOfFreeDescriptors;
+
+    // shadow of Available->Index
+    WORD                            AvailableIndex;
+
+    // Available->Index when the device was last notified
+    WORD                            LastNotifiedIndex;
+    WORD                            LastUsedIndex;
+
+    // per descriptor chain head: the caller context and the number of
+    // descriptors in the chain
+    PVOID*                          Cookies;
+    WORD*                           ChainLengths;
+
+    // Statistics
+    QWORD                           Notifications;
+    QWORD                           SuppressedNotifications;
+} VIRTQUEUE, *PVIRTQUEUE;
+
+//******************************************************************************
+// Function:     VirtqueueInitialize
+// Description:  Allocates and enables the virtqueue QueueIndex of the device.
+//               Must be called after the features were negotiated and before
+//               VirtioSetDriverOk.
+// Returns:      STATUS
+// Parameter:    IN PVIRTIO_DEVICE Device
+// Parameter:    IN WORD QueueIndex
+// Parameter:    IN WORD MaxSize - the queue will have at most this many
+//               descriptors (rounded down to a power of 2).
+// Parameter:    IN WORD MaxIndirectEntries - maximum number of buffers added
+//               at once, used for the indirect tables if
+//               VIRTIO_F_RING_INDIRECT_DESC was negotiated.
+// Parameter:    OUT PVIRTQUEUE Queue
+//******************************************************************************
+STATUS
+VirtqueueInitialize(
+    IN          PVIRTIO_DEVICE              Device,
+    IN          WORD                        QueueIndex,
+    IN          WORD                        MaxSize,
+    IN          WORD                        MaxIndirectEntries,
+    OUT         PVIRTQUEUE                  Queue
+    );
+
+void
+VirtqueueUninitialize(
+    INOUT       PVIRTQUEUE                  Queue
+    );
+
+//******************************************************************************
+// Function:     VirtqueueSetMsixVector
+// Description:  Selects the MSI-X table entry used for the interrupts of the
+//               virtqueue, must be called before VirtioSetDriverOk.
+// Returns:      STATUS - STATUS_DEVICE_NOT_SUPPORTED if the device could not
+//               assign the vector.
+// Parameter:    INOUT PVIRTQUEUE Queue
+// Parameter:    IN WORD Vector - VIRTIO_MSI_NO_VECTOR disables the interrupt.
+//******************************************************************************
+STATUS
+VirtqueueSetMsixVector(
+    INOUT       PVIRTQUEUE                  Queue,
+    IN          WORD                        Vector
+    );
+
+//******************************************************************************
+// Function:     VirtqueueAddBuffers
+// Description:  Makes a chain of buffers available to the device, the
+//               device-readable buffers must come before the device-writable
+//               ones. The device is not notified until VirtqueueKick is
+//               called, so multiple chains can be published at once.
+// Returns:      STATUS - STATUS_DEVICE_BUSY if there are not enough free
+//               descriptors.
+// Parameter:    INOUT PVIRTQUEUE Queue
+// Parameter:    IN_READS(NumberOfBuffers) PVIRTQUEUE_BUFFER Buffers
+// Parameter:    IN WORD NumberOfBuffers
+// Parameter:    IN PVOID Cookie - returned by VirtqueueGetUsedBuffer when the
+//               device is done with the chain.
+//******************************************************************************
+STATUS
+VirtqueueAddBuffers(
+    INOUT       PVIRTQUEUE                  Queue,
+    IN_READS(NumberOfBuffers)
+                PVIRTQUEUE_BUFFER           Buffers,
+    IN          WORD                        NumberOfBuffers,
+    IN          PVOID                       Cookie
+    );
+
+//******************************************************************************
+// Function:     VirtqueueKick
+// Description:  Notifies the device of the chains added since the last kick,
+//               unless the device asked not to be notified.
+// Returns:      void
+// Parameter:    INOUT PVIRTQUEUE Queue
+//******************************************************************************
+void
+VirtqueueKick(
+    INOUT       PVIRTQUEUE                  Queue
+    );
+
+//******************************************************************************
+// Function:     VirtqueueGetUsedBuffer
+// Description:  Retrieves the next chain the device finished with and frees
+//               its descriptors.
+// Returns:      PVOID - the cookie given to VirtqueueAddBuffers, NULL if the
+//               device did not use any other chain.
+// Parameter:    INOUT PVIRTQUEUE Queue
+// Parameter:    OUT_OPT DWORD* Length - bytes written by the device.
+//******************************************************************************
+PVOID
+VirtqueueGetUsedBuffer(
+    INOUT       PVIRTQUEUE                  Queue,
+    OUT_OPT     DWORD*                      Length
+    );
+
+//******************************************************************************
+// Function:     VirtqueueEnableInterrupts
+// Description:  Asks the device to interrupt after UsedBuffers more chains
+//               are used. Without VIRTIO_F_RING_EVENT_IDX the device
+//               interrupts after each chain.
+// Returns:      BOOLEAN - FALSE if there are already used chains to retrieve,
+//               in which case the caller should not wait for an interrupt.
+// Parameter:    INOUT PVIRTQUEUE Queue
+// Parameter:    IN WORD UsedBuffers
+//******************************************************************************
+BOOLEAN
+VirtqueueEnableInterrupts(
+    INOUT       PVIRTQUEUE                  Queue,
+    IN          WORD                        UsedBuffers
+    );
+
+void
+VirtqueueDisableInterrupts(
+    INOUT       PVIRTQUEUE                  Queue
+    );
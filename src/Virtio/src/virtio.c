@@ -0,0 +1,382 @@
+#include "virtio_base.h"
+
+// Number of times we retry reading the device configuration if the device
+// changes it while we read it
+#define VIRTIO_CONFIG_READ_RETRIES          10
+
+static
+STATUS
+_VirtioMapCapability(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN          PVIRTIO_PCI_CAPABILITY      Capability,
+    OUT         PVIRTIO_MAPPED_REGION       Region
+    );
+
+static
+void
+_VirtioEnableBusMaster(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice
+    );
+
+STATUS
+VirtioInitializeDevice(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    OUT         PVIRTIO_DEVICE              Device
+    )
+{
+    STATUS status;
+    PPCI_CAPABILITY_HEADER pPciCap;
+    PVIRTIO_PCI_CAPABILITY pVirtioCap;
+    PVIRTIO_MAPPED_REGION pRegion;
+    DWORD i;
+
+    LOG_FUNC_START;
+
+    if (NULL == PciDevice)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Device)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+    pPciCap = NULL;
+    pVirtioCap = NULL;
+
+    memzero(Device, sizeof(VIRTIO_DEVICE));
+    Device->PciDevice = PciDevice;
+
+    __try
+    {
+        // each configuration structure is described by a vendor specific
+        // capability, if there are multiple of the same type we use the first
+        for (status = PciDevRetrieveNextCapability(PciDevice->DeviceData, NULL, &pPciCap);
+             SUCCEEDED(status);
+             status = PciDevRetrieveNextCapability(PciDevice->DeviceData, pPciCap, &pPciCap))
+        {
+            if (PCI_CAPABILITY_ID_VENDOR != pPciCap->CapabilityId)
+            {
+                continue;
+            }
+
+            pVirtioCap = (PVIRTIO_PCI_CAPABILITY)pPciCap;
+            if (pVirtioCap->ConfigType < VirtioPciCapabilityCommonConfig ||
+                pVirtioCap->ConfigType > VirtioPciCapabilityDeviceConfig)
+            {
+                // we don't use the PCI configuration access capability
+                continue;
+            }
+
+            pRegion = &Device->Regions[pVirtioCap->ConfigType];
+            if (NULL != pRegion->VirtualAddress)
+            {
+                continue;
+            }
+
+            status = _VirtioMapCapability(PciDevice, pVirtioCap, pRegion);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_VirtioMapCapability", status);
+                __leave;
+            }
+
+            if (VirtioPciCapabilityNotifyConfig == pVirtioCap->ConfigType)
+            {
+                Device->NotifyOffsetMultiplier = ((PVIRTIO_PCI_NOTIFY_CAPABILITY)pVirtioCap)->NotifyOffsetMultiplier;
+            }
+        }
+        status = STATUS_SUCCESS;
+
+        Device->CommonConfig = Device->Regions[VirtioPciCapabilityCommonConfig].VirtualAddress;
+        Device->NotifyBase = Device->Regions[VirtioPciCapabilityNotifyConfig].VirtualAddress;
+        Device->IsrStatus = Device->Regions[VirtioPciCapabilityIsrConfig].VirtualAddress;
+        Device->DeviceConfig = Device->Regions[VirtioPciCapabilityDeviceConfig].VirtualAddress;
+        Device->DeviceConfigSize = Device->Regions[VirtioPciCapabilityDeviceConfig].Size;
+
+        if (NULL == Device->CommonConfig || NULL == Device->NotifyBase || NULL == Device->IsrStatus)
+        {
+            LOG_WARNING("Device does not implement the virtio 1.0 PCI interface\n");
+            status = STATUS_DEVICE_NOT_SUPPORTED;
+            __leave;
+        }
+
+        _VirtioEnableBusMaster(PciDevice);
+
+        // writing 0 resets the device, the reset is complete when it reads 0
+        Device->CommonConfig->DeviceStatus = 0;
+        for (i = 0; i < MAX_WORD && 0 != Device->CommonConfig->DeviceStatus; ++i)
+        {
+            _mm_pause();
+        }
+
+        if (0 != Device->CommonConfig->DeviceStatus)
+        {
+            status = STATUS_DEVICE_NOT_READY;
+            __leave;
+        }
+
+        Device->CommonConfig->DeviceStatus = VIRTIO_STATUS_ACKNOWLEDGE;
+        Device->CommonConfig->DeviceStatus = VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER;
+
+        Device->CommonConfig->DeviceFeatureSelect = 0;
+        Device->DeviceFeatures = Device->CommonConfig->DeviceFeature;
+        Device->CommonConfig->DeviceFeatureSelect = 1;
+        Device->DeviceFeatures = Device->DeviceFeatures | ((QWORD)Device->CommonConfig->DeviceFeature << 32);
+
+        LOG_TRACE_IO("Virtio device features: 0x%X\n", Device->DeviceFeatures);
+        LOG_TRACE_IO("Number of queues: %u\n", Device->CommonConfig->NumberOfQueues);
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            VirtioUninitializeDevice(Device);
+        }
+
+        LOG_FUNC_END;
+    }
+
+    return status;
+}
+
+void
+VirtioUninitializeDevice(
+    INOUT       PVIRTIO_DEVICE              Device
+    )
+{
+    DWORD i;
+
+    ASSERT(NULL != Device);
+
+    if (NULL != Device->CommonConfig)
+    {
+        Device->CommonConfig->DeviceStatus = 0;
+    }
+
+    for (i = 0; i < VirtioPciCapabilityReserved; ++i)
+    {
+        if (NULL != Device->Regions[i].VirtualAddress)
+        {
+            IoUnmapMemory(Device->Regions[i].VirtualAddress, Device->Regions[i].Size);
+            Device->Regions[i].VirtualAddress = NULL;
+        }
+    }
+
+    Device->CommonConfig = NULL;
+    Device->NotifyBase = NULL;
+    Device->IsrStatus = NULL;
+    Device->DeviceConfig = NULL;
+}
+
+STATUS
+VirtioNegotiateFeatures(
+    INOUT       PVIRTIO_DEVICE              Device,
+    IN          QWORD                       DriverFeatures
+    )
+{
+    ASSERT(NULL != Device);
+
+    if (!IsBooleanFlagOn(Device->DeviceFeatures, VIRTIO_F_VERSION_1))
+    {
+        LOG_WARNING("Device does not offer VIRTIO_F_VERSION_1\n");
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    Device->NegotiatedFeatures = Device->DeviceFeatures & (DriverFeatures | VIRTIO_F_VERSION_1);
+
+    Device->CommonConfig->DriverFeatureSelect = 0;
+    Device->CommonConfig->DriverFeature = (DWORD)QWORD_LOW(Device->NegotiatedFeatures);
+    Device->CommonConfig->DriverFeatureSelect = 1;
+    Device->CommonConfig->DriverFeature = (DWORD)QWORD_HIGH(Device->NegotiatedFeatures);
+
+    Device->CommonConfig->DeviceStatus = Device->CommonConfig->DeviceStatus | VIRTIO_STATUS_FEATURES_OK;
+
+    // the device clears FEATURES_OK if it does not accept our subset
+    if (!IsBooleanFlagOn(Device->CommonConfig->DeviceStatus, VIRTIO_STATUS_FEATURES_OK))
+    {
+        Device->CommonConfig->DeviceStatus = Device->CommonConfig->DeviceStatus | VIRTIO_STATUS_FAILED;
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    LOG_TRACE_IO("Negotiated features: 0x%X\n", Device->NegotiatedFeatures);
+
+    return STATUS_SUCCESS;
+}
+
+void
+VirtioSetDriverOk(
+    INOUT       PVIRTIO_DEVICE              Device
+    )
+{
+    ASSERT(NULL != Device);
+
+    Device->CommonConfig->DeviceStatus = Device->CommonConfig->DeviceStatus | VIRTIO_STATUS_DRIVER_OK;
+}
+
+STATUS
+VirtioReadDeviceConfig(
+    IN          PVIRTIO_DEVICE              Device,
+    IN          DWORD                       Offset,
+    IN          DWORD                       Size,
+    OUT_WRITES_BYTES_ALL(Size)
+                PVOID                       Buffer
+    )
+{
+    BYTE generation;
+    DWORD i;
+    DWORD retries;
+
+    if (NULL == Device)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Device->DeviceConfig || Offset + Size > Device->DeviceConfigSize)
+    {
+        return STATUS_DEVICE_SPACE_RANGE_EXCEEDED;
+    }
+
+    if (NULL == Buffer)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    for (retries = 0; retries < VIRTIO_CONFIG_READ_RETRIES; ++retries)
+    {
+        generation = Device->CommonConfig->ConfigGeneration;
+
+        for (i = 0; i < Size; ++i)
+        {
+            ((PBYTE)Buffer)[i] = Device->DeviceConfig[Offset + i];
+        }
+
+        if (generation == Device->CommonConfig->ConfigGeneration)
+        {
+            return STATUS_SUCCESS;
+        }
+    }
+
+    return STATUS_DEVICE_BUSY;
+}
+
+STATUS
+VirtioSetConfigMsixVector(
+    INOUT       PVIRTIO_DEVICE              Device,
+    IN          WORD                        Vector
+    )
+{
+    if (NULL == Device)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    Device->CommonConfig->MsixConfig = Vector;
+
+    // the device reads back VIRTIO_MSI_NO_VECTOR if it failed to map it
+    if (Device->CommonConfig->MsixConfig != Vector)
+    {
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+BYTE
+VirtioAcknowledgeInterrupt(
+    IN          PVIRTIO_DEVICE              Device
+    )
+{
+    ASSERT(NULL != Device);
+
+    return *Device->IsrStatus;
+}
+
+static
+STATUS
+_VirtioMapCapability(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN          PVIRTIO_PCI_CAPABILITY      Capability,
+    OUT         PVIRTIO_MAPPED_REGION       Region
+    )
+{
+    PPCI_BAR pBar;
+    QWORD barPa;
+
+    ASSERT(NULL != PciDevice);
+    ASSERT(NULL != Capability);
+    ASSERT(NULL != Region);
+
+    if (Capability->Bar >= PCI_DEVICE_NO_OF_BARS || 0 == Capability->Size)
+    {
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    pBar = &PciDevice->DeviceData->Header.Device.Bar[Capability->Bar];
+    if (0 != pBar->MemorySpace.Zero)
+    {
+        // the legacy interface is accessed through I/O ports, we only
+        // support the memory mapped configuration structures
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    barPa = (QWORD)PCI_GET_PA_FROM_MEM_ADDR(pBar);
+    if (PCI_MEM_SPACE_64_BIT == pBar->MemorySpace.Type)
+    {
+        if (Capability->Bar + 1 >= PCI_DEVICE_NO_OF_BARS)
+        {
+            return STATUS_DEVICE_NOT_SUPPORTED;
+        }
+
+        barPa = barPa | ((QWORD)PciDevice->DeviceData->Header.Device.Bar[Capability->Bar + 1].Raw << 32);
+    }
+
+    if (0 == barPa)
+    {
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    LOG_TRACE_IO("Virtio structure %u at BAR %u PA 0x%X offset 0x%x size 0x%x\n",
+                 Capability->ConfigType, Capability->Bar, barPa, Capability->Offset, Capability->Size);
+
+    Region->VirtualAddress = IoMapMemory((PHYSICAL_ADDRESS)(barPa + Capability->Offset),
+                                         Capability->Size,
+                                         PAGE_RIGHTS_READWRITE);
+    if (NULL == Region->VirtualAddress)
+    {
+        LOG_ERROR("IoMapMemory could not map PA 0x%X\n", barPa + Capability->Offset);
+        return STATUS_MEMORY_CANNOT_BE_MAPPED;
+    }
+    Region->Size = Capability->Size;
+
+    return STATUS_SUCCESS;
+}
+
+static
+void
+_VirtioEnableBusMaster(
+    IN          PPCI_DEVICE_DESCRIPTION     PciDevice
+    )
+{
+    ASSERT(NULL != PciDevice);
+
+    // the virtqueues are accessed by the device through DMA
+    PciDevice->DeviceData->Header.Command.BusMaster = TRUE;
+
+    if (!PciDevice->PciExpressDevice)
+    {
+        // through the PCI system, which serializes the legacy configuration
+        // accesses with the drivers probing on other CPUs
+        STATUS status = PciSystemWriteConfigurationSpaceGeneric(PciDevice->DeviceLocation,
+                                                                FIELD_OFFSET(PCI_COMMON_HEADER, Command),
+                                                                BITS_FOR_STRUCTURE(DWORD),
+                                                                *(DWORD*)&PciDevice->DeviceData->Header.Command
+                                                                );
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("PciSystemWriteConfigurationSpaceGeneric", status);
+        }
+    }
+}
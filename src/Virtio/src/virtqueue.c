@@ -0,0 +1,486 @@
+#include "virtio_base.h"
+
+#define VIRTQ_AVAIL_SIZE(N)         (sizeof(VIRTQ_AVAIL) + (N) * sizeof(WORD) + sizeof(WORD))
+#define VIRTQ_USED_SIZE(N)          (sizeof(VIRTQ_USED) + (N) * sizeof(VIRTQ_USED_ELEM) + sizeof(WORD))
+
+// Returns TRUE if the index crossed EventIndex when it moved from OldIndex to
+// NewIndex, i.e. if the other side asked to be notified
+__forceinline
+static
+BOOLEAN
+_VirtqueueNeedEvent(
+    IN          WORD                        EventIndex,
+    IN          WORD                        NewIndex,
+    IN          WORD                        OldIndex
+    )
+{
+    return (WORD)(NewIndex - EventIndex - 1) < (WORD)(NewIndex - OldIndex);
+}
+
+STATUS
+VirtqueueInitialize(
+    IN          PVIRTIO_DEVICE              Device,
+    IN          WORD                        QueueIndex,
+    IN          WORD                        MaxSize,
+    IN          WORD                        MaxIndirectEntries,
+    OUT         PVIRTQUEUE                  Queue
+    )
+{
+    STATUS status;
+    PVIRTIO_PCI_COMMON_CONFIG pCommonConfig;
+    WORD size;
+    DWORD availableOffset;
+    DWORD usedOffset;
+    DWORD ringSize;
+    DWORD indirectSize;
+    PHYSICAL_ADDRESS ringPa;
+    WORD i;
+
+    LOG_FUNC_START;
+
+    if (NULL == Device)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (0 == MaxSize)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (0 == MaxIndirectEntries)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (NULL == Queue)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    status = STATUS_SUCCESS;
+    pCommonConfig = Device->CommonConfig;
+    size = 0;
+    ringPa = NULL;
+
+    memzero(Queue, sizeof(VIRTQUEUE));
+    Queue->Device = Device;
+    Queue->QueueIndex = QueueIndex;
+
+    __try
+    {
+        if (QueueIndex >= pCommonConfig->NumberOfQueues)
+        {
+            status = STATUS_DEVICE_DOES_NOT_EXIST;
+            __leave;
+        }
+
+        pCommonConfig->QueueSelect = QueueIndex;
+
+        size = pCommonConfig->QueueSize;
+        if (0 == size || pCommonConfig->QueueEnable)
+        {
+            status = STATUS_DEVICE_NOT_READY;
+            __leave;
+        }
+
+        // split virtqueues must have a power of 2 size
+        size = min(size, MaxSize);
+        while (0 != (size & (size - 1)))
+        {
+            size = size & (size - 1);
+        }
+        Queue->Size = size;
+
+        availableOffset = size * sizeof(VIRTQ_DESC);
+        usedOffset = (DWORD)AlignAddressUpper(availableOffset + VIRTQ_AVAIL_SIZE(size), VIRTQ_USED_ALIGNMENT);
+        ringSize = usedOffset + (DWORD)VIRTQ_USED_SIZE(size);
+
+        Queue->RingMemory = IoAllocateContinuousMemory(ringSize);
+        if (NULL == Queue->RingMemory)
+        {
+            LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemory", ringSize);
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+        memzero(Queue->RingMemory, ringSize);
+
+        Queue->Descriptors = Queue->RingMemory;
+        Queue->Available = (PVIRTQ_AVAIL)PtrOffset(Queue->RingMemory, availableOffset);
+        Queue->Used = (PVIRTQ_USED)PtrOffset(Queue->RingMemory, usedOffset);
+        Queue->UsedEvent = &Queue->Available->Ring[size];
+        Queue->AvailableEvent = (volatile WORD*)&Queue->Used->Ring[size];
+
+        Queue->EventIndex = VirtioIsFeatureNegotiated(Device, VIRTIO_F_RING_EVENT_IDX);
+        Queue->MaxIndirectEntries = MaxIndirectEntries;
+
+        if (VirtioIsFeatureNegotiated(Device, VIRTIO_F_RING_INDIRECT_DESC) && MaxIndirectEntries > 1)
+        {
+            indirectSize = size * MaxIndirectEntries * sizeof(VIRTQ_DESC);
+
+            Queue->IndirectTables = IoAllocateContinuousMemory(indirectSize);
+            if (NULL == Queue->IndirectTables)
+            {
+                LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemory", indirectSize);
+                status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+                __leave;
+            }
+
+            Queue->IndirectTablesPhysicalAddress = IoGetPhysicalAddress(Queue->IndirectTables);
+            ASSERT(NULL != Queue->IndirectTablesPhysicalAddress);
+
+            Queue->Indirect = TRUE;
+        }
+
+        Queue->Cookies = ExAllocatePoolWithTag(PoolAllocateZeroMemory, size * sizeof(PVOID), HEAP_VIRTIO_TAG, 0);
+        if (NULL == Queue->Cookies)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", size * sizeof(PVOID));
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        Queue->ChainLengths = ExAllocatePoolWithTag(PoolAllocateZeroMemory, size * sizeof(WORD), HEAP_VIRTIO_TAG, 0);
+        if (NULL == Queue->ChainLengths)
+        {
+            LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", size * sizeof(WORD));
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        // all the descriptors are free, the Next fields link the free list
+        for (i = 0; i < size; ++i)
+        {
+            Queue->Descriptors[i].Next = i + 1;
+        }
+        Queue->FreeHead = 0;
+        Queue->NumberOfFreeDescriptors = size;
+
+        ringPa = IoGetPhysicalAddress(Queue->RingMemory);
+        ASSERT(NULL != ringPa);
+
+        pCommonConfig->QueueSize = size;
+        pCommonConfig->QueueDescriptors = (QWORD)ringPa;
+        pCommonConfig->QueueDriver = (QWORD)ringPa + availableOffset;
+        pCommonConfig->QueueDevice = (QWORD)ringPa + usedOffset;
+
+        Queue->NotifyAddress = (volatile WORD*)PtrOffset(Device->NotifyBase,
+                                                         (QWORD)pCommonConfig->QueueNotifyOffset * Device->NotifyOffsetMultiplier);
+
+        pCommonConfig->QueueEnable = 1;
+
+        LOG_TRACE_IO("Virtqueue %u has %u descriptors, indirect: %u, event index: %u\n",
+                     QueueIndex, size, Queue->Indirect, Queue->EventIndex);
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            VirtqueueUninitialize(Queue);
+        }
+
+        LOG_FUNC_END;
+    }
+
+    return status;
+}
+
+void
+VirtqueueUninitialize(
+    INOUT       PVIRTQUEUE                  Queue
+    )
+{
+    ASSERT(NULL != Queue);
+
+    // the device must have been reset before freeing the memory it accesses
+    if (NULL != Queue->ChainLengths)
+    {
+        ExFreePoolWithTag(Queue->ChainLengths, HEAP_VIRTIO_TAG);
+        Queue->ChainLengths = NULL;
+    }
+
+    if (NULL != Queue->Cookies)
+    {
+        ExFreePoolWithTag(Queue->Cookies, HEAP_VIRTIO_TAG);
+        Queue->Cookies = NULL;
+    }
+
+    if (NULL != Queue->IndirectTables)
+    {
+        IoFreeContinuousMemory(Queue->IndirectTables);
+        Queue->IndirectTables = NULL;
+    }
+
+    if (NULL != Queue->RingMemory)
+    {
+        IoFreeContinuousMemory(Queue->RingMemory);
+        Queue->RingMemory = NULL;
+    }
+}
+
+STATUS
+VirtqueueSetMsixVector(
+    INOUT       PVIRTQUEUE                  Queue,
+    IN          WORD                        Vector
+    )
+{
+    PVIRTIO_PCI_COMMON_CONFIG pCommonConfig;
+
+    if (NULL == Queue)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    pCommonConfig = Queue->Device->CommonConfig;
+
+    pCommonConfig->QueueSelect = Queue->QueueIndex;
+    pCommonConfig->QueueMsixVector = Vector;
+
+    // the device reads back VIRTIO_MSI_NO_VECTOR if it failed to map it
+    if (pCommonConfig->QueueMsixVector != Vector)
+    {
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+STATUS
+VirtqueueAddBuffers(
+    INOUT       PVIRTQUEUE                  Queue,
+    IN_READS(NumberOfBuffers)
+                PVIRTQUEUE_BUFFER           Buffers,
+    IN          WORD                        NumberOfBuffers,
+    IN          PVOID                       Cookie
+    )
+{
+    BOOLEAN useIndirect;
+    WORD head;
+    WORD current;
+    WORD last;
+    WORD i;
+    PVIRTQ_DESC pTable;
+
+    if (NULL == Queue)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Buffers)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    if (0 == NumberOfBuffers || NumberOfBuffers > Queue->MaxIndirectEntries)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (NULL == Cookie)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    useIndirect = Queue->Indirect && NumberOfBuffers > 1;
+
+    if (Queue->NumberOfFreeDescriptors < (useIndirect ? 1 : NumberOfBuffers))
+    {
+        return STATUS_DEVICE_BUSY;
+    }
+
+    head = Queue->FreeHead;
+
+    if (useIndirect)
+    {
+        // the whole chain is described by the indirect table of the head
+        pTable = &Queue->IndirectTables[(QWORD)head * Queue->MaxIndirectEntries];
+
+        for (i = 0; i < NumberOfBuffers; ++i)
+        {
+            pTable[i].Address = (QWORD)Buffers[i].PhysicalAddress;
+            pTable[i].Length = Buffers[i].Length;
+            pTable[i].Flags = (Buffers[i].DeviceWritable ? VIRTQ_DESC_F_WRITE : 0) |
+                              (i + 1 < NumberOfBuffers ? VIRTQ_DESC_F_NEXT : 0);
+            pTable[i].Next = i + 1;
+        }
+
+        Queue->Descriptors[head].Address = (QWORD)Queue->IndirectTablesPhysicalAddress +
+                                           (QWORD)head * Queue->MaxIndirectEntries * sizeof(VIRTQ_DESC);
+        Queue->Descriptors[head].Length = NumberOfBuffers * sizeof(VIRTQ_DESC);
+        Queue->Descriptors[head].Flags = VIRTQ_DESC_F_INDIRECT;
+
+        last = head;
+        Queue->ChainLengths[head] = 1;
+    }
+    else
+    {
+        // the chain follows the free list, so the Next fields are already set
+        current = head;
+        last = head;
+
+        for (i = 0; i < NumberOfBuffers; ++i)
+        {
+            Queue->Descriptors[current].Address = (QWORD)Buffers[i].PhysicalAddress;
+            Queue->Descriptors[current].Length = Buffers[i].Length;
+            Queue->Descriptors[current].Flags = (Buffers[i].DeviceWritable ? VIRTQ_DESC_F_WRITE : 0) |
+                                                (i + 1 < NumberOfBuffers ? VIRTQ_DESC_F_NEXT : 0);
+
+            last = current;
+            current = Queue->Descriptors[current].Next;
+        }
+
+        Queue->ChainLengths[head] = NumberOfBuffers;
+    }
+
+    Queue->FreeHead = Queue->Descriptors[last].Next;
+    Queue->NumberOfFreeDescriptors = Queue->NumberOfFreeDescriptors - Queue->ChainLengths[head];
+    Queue->Cookies[head] = Cookie;
+
+    Queue->Available->Ring[Queue->AvailableIndex & (Queue->Size - 1)] = head;
+    Queue->AvailableIndex++;
+
+    // the descriptors must be visible before the index
+    _ReadWriteBarrier();
+    Queue->Available->Index = Queue->AvailableIndex;
+
+    return STATUS_SUCCESS;
+}
+
+void
+VirtqueueKick(
+    INOUT       PVIRTQUEUE                  Queue
+    )
+{
+    WORD oldIndex;
+    WORD newIndex;
+    BOOLEAN notify;
+
+    ASSERT(NULL != Queue);
+
+    // the index must be visible before we read what the device asked for
+    _mm_mfence();
+
+    oldIndex = Queue->LastNotifiedIndex;
+    newIndex = Queue->AvailableIndex;
+
+    if (oldIndex == newIndex)
+    {
+        return;
+    }
+
+    Queue->LastNotifiedIndex = newIndex;
+
+    if (Queue->EventIndex)
+    {
+        notify = _VirtqueueNeedEvent(*Queue->AvailableEvent, newIndex, oldIndex);
+    }
+    else
+    {
+        notify = !IsBooleanFlagOn(Queue->Used->Flags, VIRTQ_USED_F_NO_NOTIFY);
+    }
+
+    if (notify)
+    {
+        *Queue->NotifyAddress = Queue->QueueIndex;
+        Queue->Notifications++;
+    }
+    else
+    {
+        Queue->SuppressedNotifications++;
+    }
+}
+
+PVOID
+VirtqueueGetUsedBuffer(
+    INOUT       PVIRTQUEUE                  Queue,
+    OUT_OPT     DWORD*                      Length
+    )
+{
+    VIRTQ_USED_ELEM usedElement;
+    WORD head;
+    WORD last;
+    WORD i;
+    PVOID pCookie;
+
+    ASSERT(NULL != Queue);
+
+    if (Queue->LastUsedIndex == Queue->Used->Index)
+    {
+        return NULL;
+    }
+
+    // the index must be read before the element
+    _ReadWriteBarrier();
+
+    usedElement = Queue->Used->Ring[Queue->LastUsedIndex & (Queue->Size - 1)];
+    Queue->LastUsedIndex++;
+
+    ASSERT(usedElement.Id < Queue->Size);
+    head = (WORD)usedElement.Id;
+
+    pCookie = Queue->Cookies[head];
+    ASSERT(NULL != pCookie);
+    Queue->Cookies[head] = NULL;
+
+    // put the chain back at the start of the free list
+    last = head;
+    for (i = 1; i < Queue->ChainLengths[head]; ++i)
+    {
+        last = Queue->Descriptors[last].Next;
+    }
+
+    Queue->Descriptors[last].Next = Queue->FreeHead;
+    Queue->FreeHead = head;
+    Queue->NumberOfFreeDescriptors = Queue->NumberOfFreeDescriptors + Queue->ChainLengths[head];
+
+    if (NULL != Length)
+    {
+        *Length = usedElement.Length;
+    }
+
+    return pCookie;
+}
+
+BOOLEAN
+VirtqueueEnableInterrupts(
+    INOUT       PVIRTQUEUE                  Queue,
+    IN          WORD                        UsedBuffers
+    )
+{
+    ASSERT(NULL != Queue);
+    ASSERT(0 != UsedBuffers);
+
+    if (Queue->EventIndex)
+    {
+        // the device interrupts when its used index passes this value
+        *Queue->UsedEvent = Queue->LastUsedIndex + UsedBuffers - 1;
+    }
+    else
+    {
+        Queue->Available->Flags = 0;
+    }
+
+    // the device may have used buffers before it saw the change
+    _mm_mfence();
+
+    return Queue->LastUsedIndex == Queue->Used->Index;
+}
+
+void
+VirtqueueDisableInterrupts(
+    INOUT       PVIRTQUEUE                  Queue
+    )
+{
+    ASSERT(NULL != Queue);
+
+    if (Queue->EventIndex)
+    {
+        // an event index behind the used index is reached again only after
+        // the index wraps around
+        *Queue->UsedEvent = Queue->LastUsedIndex - 1;
+    }
+    else
+    {
+        Queue->Available->Flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+    }
+}
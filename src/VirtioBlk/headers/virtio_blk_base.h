@@ -0,0 +1,9 @@
+#pragma once
+
+#include "common_lib.h"
+#include "log.h"
+#include "io.h"
+#include "virtio.h"
+#include "virtqueue.h"
+#include "virtio_blk_registers.h"
+#include "virtio_blk_structures.h"
@@ -0,0 +1,4 @@
+#pragma once
+
+FUNC_DriverDispatch              VirtioBlkDispatchReadWrite;
+FUNC_DriverDispatch              VirtioBlkDispatchDeviceControl;
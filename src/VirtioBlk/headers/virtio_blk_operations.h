@@ -0,0 +1,43 @@
+#pragma once
+
+//******************************************************************************
+// Function:     VirtioBlkInitialize
+// Description:  Negotiates the features of the device, sets up its request
+//               queue and interrupt and reads its capacity.
+// Returns:      STATUS
+// Parameter:    IN PPCI_DEVICE_DESCRIPTION PciDevice
+// Parameter:    IN PDEVICE_OBJECT Device - device whose extension is the
+//               VIRTIO_BLK_DEVICE structure.
+//******************************************************************************
+STATUS
+VirtioBlkInitialize(
+    IN                              PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN                              PDEVICE_OBJECT              Device
+    );
+
+void
+VirtioBlkUninitialize(
+    IN                              PDEVICE_OBJECT              Device
+    );
+
+//******************************************************************************
+// Function:     VirtioBlkReadWriteSectors
+// Description:  Transfers SectorCount sectors directly from/to Buffer. The
+//               transfer is split in requests of at most
+//               VIRTIO_BLK_MAX_BYTES_PER_REQUEST bytes which are queued to the
+//               device together.
+// Returns:      STATUS
+// Parameter:    OUT QWORD* SectorsReadWritten - number of sectors for which
+//               the requests completed successfully.
+//******************************************************************************
+STATUS
+VirtioBlkReadWriteSectors(
+    IN                              PVIRTIO_BLK_DEVICE          Device,
+    IN                              QWORD                       SectorIndex,
+    IN                              QWORD                       SectorCount,
+    _When_(WriteOperation, IN_READS_BYTES(SectorCount*SECTOR_SIZE))
+    _When_(!WriteOperation, OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
+                                    PVOID                       Buffer,
+    OUT                             QWORD*                      SectorsReadWritten,
+    IN                              BOOLEAN                     WriteOperation
+    );
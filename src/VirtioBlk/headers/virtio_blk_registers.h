@@ -0,0 +1,63 @@
+#pragma once
+
+// Virtio 1.0 Specification, 5.2 Block Device
+
+// transitional devices (which also implement the legacy interface) keep the
+// legacy device ID
+#define VIRTIO_BLK_PCI_TRANSITIONAL_DEVICE_ID   0x1001
+
+#define VIRTIO_BLK_REQUEST_QUEUE_INDEX          0
+
+// Feature bits
+#define VIRTIO_BLK_F_SIZE_MAX                   (1ULL<<1)
+#define VIRTIO_BLK_F_SEG_MAX                    (1ULL<<2)
+#define VIRTIO_BLK_F_RO                         (1ULL<<5)
+#define VIRTIO_BLK_F_BLK_SIZE                   (1ULL<<6)
+#define VIRTIO_BLK_F_FLUSH                      (1ULL<<9)
+
+// Request types
+#define VIRTIO_BLK_T_IN                         0
+#define VIRTIO_BLK_T_OUT                        1
+#define VIRTIO_BLK_T_FLUSH                      4
+
+// Request status, written by the device in the last byte of the request
+#define VIRTIO_BLK_S_OK                         0
+#define VIRTIO_BLK_S_IOERR                      1
+#define VIRTIO_BLK_S_UNSUPP                     2
+
+// The capacity is always expressed in 512 byte sectors
+#define VIRTIO_BLK_SECTOR_SIZE                  512
+
+#pragma pack(push,1)
+
+typedef struct _VIRTIO_BLK_CONFIG
+{
+    QWORD                               Capacity;
+
+    // valid if VIRTIO_BLK_F_SIZE_MAX was negotiated
+    DWORD                               SizeMax;
+
+    // valid if VIRTIO_BLK_F_SEG_MAX was negotiated
+    DWORD                               SegMax;
+
+    struct
+    {
+        WORD                            Cylinders;
+        BYTE                            Heads;
+        BYTE                            Sectors;
+    } Geometry;
+
+    // valid if VIRTIO_BLK_F_BLK_SIZE was negotiated
+    DWORD                               BlockSize;
+} VIRTIO_BLK_CONFIG, *PVIRTIO_BLK_CONFIG;
+STATIC_ASSERT(sizeof(VIRTIO_BLK_CONFIG) == 24);
+
+typedef struct _VIRTIO_BLK_REQUEST_HEADER
+{
+    DWORD                               Type;
+    DWORD                               __Reserved0;
+    QWORD                               Sector;
+} VIRTIO_BLK_REQUEST_HEADER, *PVIRTIO_BLK_REQUEST_HEADER;
+STATIC_ASSERT(sizeof(VIRTIO_BLK_REQUEST_HEADER) == 16);
+
+#pragma pack(pop)
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "ex_event.h"
+
+// Maximum number of requests in flight for a device
+#define VIRTIO_BLK_MAX_REQUESTS                 32
+
+// Limits of a single request, larger transfers are split in multiple
+// requests which are queued to the device simultaneously
+#define VIRTIO_BLK_MAX_SEGMENTS                 32
+#define VIRTIO_BLK_MAX_BYTES_PER_REQUEST        (128 * KB_SIZE)
+
+// each request has a header and a status buffer besides its data segments
+#define VIRTIO_BLK_MAX_BUFFERS_PER_REQUEST      (VIRTIO_BLK_MAX_SEGMENTS + 2)
+
+#define VIRTIO_BLK_MAX_QUEUE_SIZE               256
+
+// The part of a request shared with the device
+typedef struct _VIRTIO_BLK_REQUEST_DMA
+{
+    VIRTIO_BLK_REQUEST_HEADER   Header;
+    volatile BYTE               Status;
+    BYTE                        __Reserved0[15];
+} VIRTIO_BLK_REQUEST_DMA, *PVIRTIO_BLK_REQUEST_DMA;
+STATIC_ASSERT(sizeof(VIRTIO_BLK_REQUEST_DMA) == 32);
+
+typedef struct _VIRTIO_BLK_REQUEST
+{
+    PVIRTIO_BLK_REQUEST_DMA     Dma;
+    PHYSICAL_ADDRESS            DmaPhysicalAddress;
+
+    DWORD                       SectorCount;
+    BOOLEAN                     InUse;
+} VIRTIO_BLK_REQUEST, *PVIRTIO_BLK_REQUEST;
+
+typedef struct _VIRTIO_BLK_DEVICE
+{
+    VIRTIO_DEVICE               Transport;
+    VIRTQUEUE                   RequestQueue;
+
+    BOOLEAN                     Initialized;
+    QWORD                       TotalSectors;
+    BOOLEAN                     ReadOnly;
+
+    // limits imposed by the device on the data segments of a request
+    WORD                        MaxSegments;
+    DWORD                       MaxSegmentSize;
+
+    PVOID                       RequestsDma;
+    VIRTIO_BLK_REQUEST          Requests[VIRTIO_BLK_MAX_REQUESTS];
+
+    // signaled by the interrupt handler when the device used requests
+    EX_EVENT                    RequestsCompleted;
+
+    // Statistics
+    QWORD                       RequestsIssued;
+    DWORD                       MaxOutstandingRequests;
+} VIRTIO_BLK_DEVICE, *PVIRTIO_BLK_DEVICE;
@@ -0,0 +1,3 @@
+#pragma once
+
+FUNC_DriverEntry                                VirtioBlkDriverEntry;
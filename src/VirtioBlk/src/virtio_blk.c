@@ -0,0 +1,113 @@
+#include "virtio_blk_base.h"
+#include "virtio_blk.h"
+#include "virtio_blk_dispatch.h"
+#include "virtio_blk_operations.h"
+
+static const WORD VIRTIO_BLK_DEVICE_IDS[] = { VIRTIO_BLK_PCI_TRANSITIONAL_DEVICE_ID,
+                                              VIRTIO_PCI_MODERN_DEVICE_ID(VIRTIO_DEVICE_TYPE_BLOCK) };
+
+STATUS
+(__cdecl VirtioBlkDriverEntry)(
+    INOUT       PDRIVER_OBJECT      Driver
+    )
+{
+    STATUS status;
+    PPCI_DEVICE_DESCRIPTION* pPciDevices;
+    DWORD i;
+    DWORD j;
+    PDEVICE_OBJECT pVirtioDevice;
+    BOOLEAN foundDevice;
+    DWORD noOfDevices;
+    PCI_SPEC pciSpec;
+
+    ASSERT(NULL != Driver);
+
+    LOG_FUNC_START;
+
+    status = STATUS_SUCCESS;
+    pPciDevices = NULL;
+    pVirtioDevice = NULL;
+    foundDevice = FALSE;
+    noOfDevices = 0;
+    i = 0;
+    j = 0;
+    memzero(&pciSpec, sizeof(PCI_SPEC));
+
+    pciSpec.MatchVendor = TRUE;
+    pciSpec.MatchDevice = TRUE;
+
+    pciSpec.Description.VendorId = VIRTIO_PCI_VENDOR_ID;
+
+    Driver->DispatchFunctions[IRP_MJ_READ] = VirtioBlkDispatchReadWrite;
+    Driver->DispatchFunctions[IRP_MJ_WRITE] = VirtioBlkDispatchReadWrite;
+    Driver->DispatchFunctions[IRP_MJ_DEVICE_CONTROL] = VirtioBlkDispatchDeviceControl;
+
+    for (j = 0; j < ARRAYSIZE(VIRTIO_BLK_DEVICE_IDS); ++j)
+    {
+        pciSpec.Description.DeviceId = VIRTIO_BLK_DEVICE_IDS[j];
+
+        status = IoGetPciDevicesMatchingSpecification(pciSpec, &pPciDevices, &noOfDevices);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoGetPciDevicesMatchingSpecification", status);
+            continue;
+        }
+        ASSERT(noOfDevices == 0 || pPciDevices != NULL);
+        LOGL("Found %d virtio block devices with ID 0x%x\n", noOfDevices, VIRTIO_BLK_DEVICE_IDS[j]);
+
+        for (i = 0; i < noOfDevices; ++i)
+        {
+            ASSERT(pPciDevices[i] != NULL);
+
+            if (NULL == pVirtioDevice)
+            {
+                // the disk driver sits on top of the devices of this type
+                pVirtioDevice = IoCreateDevice(Driver, sizeof(VIRTIO_BLK_DEVICE), DeviceTypeHarddiskController);
+                if (NULL == pVirtioDevice)
+                {
+                    LOG_FUNC_ERROR_ALLOC("IoCreateDevice", sizeof(VIRTIO_BLK_DEVICE));
+                    status = STATUS_DEVICE_COULD_NOT_BE_CREATED;
+                    break;
+                }
+                pVirtioDevice->DeviceAlignment = SECTOR_SIZE;
+            }
+
+            status = VirtioBlkInitialize(pPciDevices[i], pVirtioDevice);
+            if (!SUCCEEDED(status))
+            {
+                LOG_WARNING("VirtioBlkInitialize failed with status: 0x%x\n", status);
+
+                // the device object is reused for the next device
+                memzero(IoGetDeviceExtension(pVirtioDevice), sizeof(VIRTIO_BLK_DEVICE));
+                continue;
+            }
+            LOG("VirtioBlkInitialize succeeded\n");
+
+            foundDevice = TRUE;
+            pVirtioDevice = NULL;
+        }
+
+        if (NULL != pPciDevices)
+        {
+            IoFreeTemporaryData(pPciDevices);
+            pPciDevices = NULL;
+        }
+    }
+
+    if (NULL != pVirtioDevice)
+    {
+        // it means something failed
+        IoDeleteDevice(pVirtioDevice);
+        pVirtioDevice = NULL;
+    }
+
+    if (foundDevice)
+    {
+        // if we found at least a device we succeeded
+        status = STATUS_SUCCESS;
+    }
+
+    LOG_FUNC_END;
+
+    return status;
+}
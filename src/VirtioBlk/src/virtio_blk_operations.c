@@ -0,0 +1,570 @@
+#include "virtio_blk_base.h"
+#include "virtio_blk_operations.h"
+
+STATIC_ASSERT(SECTOR_SIZE == VIRTIO_BLK_SECTOR_SIZE);
+
+// Features we can make use of, the others are left to the device defaults
+#define VIRTIO_BLK_DRIVER_FEATURES          (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX | \
+                                             VIRTIO_BLK_F_RO | VIRTIO_BLK_F_BLK_SIZE |      \
+                                             VIRTIO_F_RING_INDIRECT_DESC | VIRTIO_F_RING_EVENT_IDX)
+
+// Position in the MDL of the first byte not yet added to a request
+typedef struct _VIRTIO_BLK_DMA_CURSOR
+{
+    DWORD                       PairIndex;
+    DWORD                       PairOffset;
+} VIRTIO_BLK_DMA_CURSOR, *PVIRTIO_BLK_DMA_CURSOR;
+
+static FUNC_InterruptFunction           _VirtioBlkInterrupt;
+
+static
+PVIRTIO_BLK_REQUEST
+_VirtioBlkGetFreeRequest(
+    IN          PVIRTIO_BLK_DEVICE                          Device
+    );
+
+static
+void
+_VirtioBlkBuildDataBuffers(
+    IN          PVIRTIO_BLK_DEVICE                          Device,
+    IN          PMDL                                        Mdl,
+    INOUT       PVIRTIO_BLK_DMA_CURSOR                      Cursor,
+    IN          QWORD                                       BytesRemaining,
+    OUT_WRITES(VIRTIO_BLK_MAX_SEGMENTS)
+                PVIRTQUEUE_BUFFER                           Buffers,
+    OUT         WORD*                                       NumberOfBuffers,
+    OUT         DWORD*                                      BytesInBuffers
+    );
+
+STATUS
+VirtioBlkInitialize(
+    IN                              PPCI_DEVICE_DESCRIPTION     PciDevice,
+    IN                              PDEVICE_OBJECT              Device
+    )
+{
+    STATUS status;
+    PVIRTIO_BLK_DEVICE pDevice;
+    VIRTIO_BLK_CONFIG config;
+    IO_INTERRUPT ioInterrupt;
+    PHYSICAL_ADDRESS requestsPa;
+    DWORD i;
+
+    LOG_FUNC_START;
+
+    if (NULL == PciDevice)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (NULL == Device)
+    {
+        return STATUS_INVALID_PARAMETER2;
+    }
+
+    status = STATUS_SUCCESS;
+    pDevice = IoGetDeviceExtension(Device);
+    ASSERT(NULL != pDevice);
+    memzero(&config, sizeof(VIRTIO_BLK_CONFIG));
+    memzero(&ioInterrupt, sizeof(IO_INTERRUPT));
+    requestsPa = NULL;
+
+    __try
+    {
+        status = VirtioInitializeDevice(PciDevice, &pDevice->Transport);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("VirtioInitializeDevice", status);
+            __leave;
+        }
+
+        status = VirtioNegotiateFeatures(&pDevice->Transport, VIRTIO_BLK_DRIVER_FEATURES);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("VirtioNegotiateFeatures", status);
+            __leave;
+        }
+
+        status = VirtioReadDeviceConfig(&pDevice->Transport, 0, sizeof(VIRTIO_BLK_CONFIG), &config);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("VirtioReadDeviceConfig", status);
+            __leave;
+        }
+
+        if (VirtioIsFeatureNegotiated(&pDevice->Transport, VIRTIO_BLK_F_BLK_SIZE) &&
+            SECTOR_SIZE != config.BlockSize)
+        {
+            LOG_WARNING("We do not support disks with %u byte blocks\n", config.BlockSize);
+            status = STATUS_DEVICE_NOT_SUPPORTED;
+            __leave;
+        }
+
+        pDevice->TotalSectors = config.Capacity;
+        pDevice->ReadOnly = VirtioIsFeatureNegotiated(&pDevice->Transport, VIRTIO_BLK_F_RO);
+
+        pDevice->MaxSegments = VIRTIO_BLK_MAX_SEGMENTS;
+        if (VirtioIsFeatureNegotiated(&pDevice->Transport, VIRTIO_BLK_F_SEG_MAX) && 0 != config.SegMax)
+        {
+            pDevice->MaxSegments = (WORD)min(config.SegMax, VIRTIO_BLK_MAX_SEGMENTS);
+        }
+
+        pDevice->MaxSegmentSize = VIRTIO_BLK_MAX_BYTES_PER_REQUEST;
+        if (VirtioIsFeatureNegotiated(&pDevice->Transport, VIRTIO_BLK_F_SIZE_MAX) && 0 != config.SizeMax)
+        {
+            pDevice->MaxSegmentSize = min(config.SizeMax, VIRTIO_BLK_MAX_BYTES_PER_REQUEST);
+        }
+
+        status = VirtqueueInitialize(&pDevice->Transport,
+                                     VIRTIO_BLK_REQUEST_QUEUE_INDEX,
+                                     VIRTIO_BLK_MAX_QUEUE_SIZE,
+                                     pDevice->MaxSegments + 2,
+                                     &pDevice->RequestQueue);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("VirtqueueInitialize", status);
+            __leave;
+        }
+
+        pDevice->RequestsDma = IoAllocateContinuousMemory(VIRTIO_BLK_MAX_REQUESTS * sizeof(VIRTIO_BLK_REQUEST_DMA));
+        if (NULL == pDevice->RequestsDma)
+        {
+            LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemory", VIRTIO_BLK_MAX_REQUESTS * sizeof(VIRTIO_BLK_REQUEST_DMA));
+            status = STATUS_HEAP_INSUFFICIENT_RESOURCES;
+            __leave;
+        }
+
+        requestsPa = IoGetPhysicalAddress(pDevice->RequestsDma);
+        ASSERT(NULL != requestsPa);
+
+        for (i = 0; i < VIRTIO_BLK_MAX_REQUESTS; ++i)
+        {
+            pDevice->Requests[i].Dma = (PVIRTIO_BLK_REQUEST_DMA)pDevice->RequestsDma + i;
+            pDevice->Requests[i].DmaPhysicalAddress = PtrOffset(requestsPa, i * sizeof(VIRTIO_BLK_REQUEST_DMA));
+        }
+
+        status = ExEventInit(&pDevice->RequestsCompleted, ExEventTypeSynchronization, FALSE);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("ExEventInit", status);
+            __leave;
+        }
+
+        // we ask for interrupts only when we wait for requests
+        VirtqueueDisableInterrupts(&pDevice->RequestQueue);
+
+        // virtio devices are not MSI capable, this will be a legacy
+        // interrupt routed through the IO APIC
+        ioInterrupt.Type = IoInterruptTypePci;
+        ioInterrupt.Irql = IrqlStorageLevel;
+        ioInterrupt.ServiceRoutine = _VirtioBlkInterrupt;
+        ioInterrupt.Exclusive = FALSE;
+        ioInterrupt.Pci.PciDevice = PciDevice;
+
+        status = IoRegisterInterrupt(&ioInterrupt, Device);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoRegisterInterrupt", status);
+            __leave;
+        }
+
+        VirtioSetDriverOk(&pDevice->Transport);
+
+        LOG("Virtio disk: 0x%X sectors, read-only: %u, segments: %u, segment size: 0x%x\n",
+            pDevice->TotalSectors, pDevice->ReadOnly, pDevice->MaxSegments, pDevice->MaxSegmentSize);
+
+        pDevice->Initialized = TRUE;
+    }
+    __finally
+    {
+        if (!SUCCEEDED(status))
+        {
+            VirtioBlkUninitialize(Device);
+        }
+
+        LOG_FUNC_END;
+    }
+
+    return status;
+}
+
+void
+VirtioBlkUninitialize(
+    IN                              PDEVICE_OBJECT              Device
+    )
+{
+    PVIRTIO_BLK_DEVICE pDevice;
+
+    ASSERT(NULL != Device);
+
+    pDevice = IoGetDeviceExtension(Device);
+    ASSERT(NULL != pDevice);
+
+    // resetting the device makes it stop accessing the queue memory
+    VirtioUninitializeDevice(&pDevice->Transport);
+    VirtqueueUninitialize(&pDevice->RequestQueue);
+
+    if (NULL != pDevice->RequestsDma)
+    {
+        IoFreeContinuousMemory(pDevice->RequestsDma);
+        pDevice->RequestsDma = NULL;
+    }
+
+    pDevice->Initialized = FALSE;
+}
+
+STATUS
+VirtioBlkReadWriteSectors(
+    IN                              PVIRTIO_BLK_DEVICE          Device,
+    IN                              QWORD                       SectorIndex,
+    IN                              QWORD                       SectorCount,
+    _When_(WriteOperation, IN_READS_BYTES(SectorCount*SECTOR_SIZE))
+    _When_(!WriteOperation, OUT_WRITES_BYTES(SectorCount*SECTOR_SIZE))
+                                    PVOID                       Buffer,
+    OUT                             QWORD*                      SectorsReadWritten,
+    IN                              BOOLEAN                     WriteOperation
+    )
+{
+    STATUS status;
+    PMDL pMdl;
+    VIRTIO_BLK_DMA_CURSOR cursor;
+    QWORD sectorsIssued;
+    QWORD sectorsDone;
+    DWORD noOfOutstandingRequests;
+    VIRTQUEUE_BUFFER buffers[VIRTIO_BLK_MAX_BUFFERS_PER_REQUEST];
+    PVIRTIO_BLK_REQUEST pRequest;
+    BOOLEAN issuedRequests;
+    BOOLEAN completedRequests;
+    WORD noOfDataBuffers;
+    DWORD bytesInRequest;
+    WORD i;
+
+    if (NULL == Device)
+    {
+        return STATUS_INVALID_PARAMETER1;
+    }
+
+    if (0 == SectorCount || SectorCount * SECTOR_SIZE > MAX_DWORD)
+    {
+        return STATUS_INVALID_PARAMETER3;
+    }
+
+    if (NULL == Buffer)
+    {
+        return STATUS_INVALID_PARAMETER4;
+    }
+
+    if (NULL == SectorsReadWritten)
+    {
+        return STATUS_INVALID_PARAMETER5;
+    }
+
+    status = STATUS_SUCCESS;
+    pMdl = NULL;
+    memzero(&cursor, sizeof(VIRTIO_BLK_DMA_CURSOR));
+    sectorsIssued = 0;
+    sectorsDone = 0;
+    noOfOutstandingRequests = 0;
+
+    __try
+    {
+        // the device transfers directly to/from the caller's buffer
+        status = IoAllocateMdl(Buffer, (DWORD)(SectorCount * SECTOR_SIZE), NULL, &pMdl);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("IoAllocateMdl", status);
+            __leave;
+        }
+
+// warning C4127: conditional expression is constant
+#pragma warning(suppress:4127)
+        while (TRUE)
+        {
+            issuedRequests = FALSE;
+
+            // queue as many requests as we have free slots and descriptors for,
+            // after a failure we only wait for the requests already queued
+            while (SUCCEEDED(status) && sectorsIssued < SectorCount)
+            {
+                VIRTIO_BLK_DMA_CURSOR nextCursor;
+
+                pRequest = _VirtioBlkGetFreeRequest(Device);
+                if (NULL == pRequest)
+                {
+                    break;
+                }
+
+                nextCursor = cursor;
+                _VirtioBlkBuildDataBuffers(Device,
+                                           pMdl,
+                                           &nextCursor,
+                                           (SectorCount - sectorsIssued) * SECTOR_SIZE,
+                                           &buffers[1],
+                                           &noOfDataBuffers,
+                                           &bytesInRequest);
+
+                pRequest->Dma->Header.Type = WriteOperation ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+                pRequest->Dma->Header.__Reserved0 = 0;
+                pRequest->Dma->Header.Sector = SectorIndex + sectorsIssued;
+                pRequest->Dma->Status = MAX_BYTE;
+
+                buffers[0].PhysicalAddress = pRequest->DmaPhysicalAddress;
+                buffers[0].Length = sizeof(VIRTIO_BLK_REQUEST_HEADER);
+                buffers[0].DeviceWritable = FALSE;
+
+                for (i = 1; i <= noOfDataBuffers; ++i)
+                {
+                    buffers[i].DeviceWritable = !WriteOperation;
+                }
+
+                buffers[noOfDataBuffers + 1].PhysicalAddress = PtrOffset(pRequest->DmaPhysicalAddress,
+                                                                         FIELD_OFFSET(VIRTIO_BLK_REQUEST_DMA, Status));
+                buffers[noOfDataBuffers + 1].Length = sizeof(BYTE);
+                buffers[noOfDataBuffers + 1].DeviceWritable = TRUE;
+
+                status = VirtqueueAddBuffers(&Device->RequestQueue, buffers, noOfDataBuffers + 2, pRequest);
+                if (STATUS_DEVICE_BUSY == status)
+                {
+                    // out of descriptors, we'll retry when requests complete
+                    status = STATUS_SUCCESS;
+                    break;
+                }
+                else if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("VirtqueueAddBuffers", status);
+                    break;
+                }
+
+                cursor = nextCursor;
+                pRequest->SectorCount = bytesInRequest / SECTOR_SIZE;
+                pRequest->InUse = TRUE;
+
+                sectorsIssued = sectorsIssued + pRequest->SectorCount;
+                noOfOutstandingRequests++;
+                issuedRequests = TRUE;
+
+                Device->RequestsIssued++;
+                Device->MaxOutstandingRequests = max(Device->MaxOutstandingRequests, noOfOutstandingRequests);
+            }
+
+            if (issuedRequests)
+            {
+                // a single notification for all the requests queued above
+                VirtqueueKick(&Device->RequestQueue);
+            }
+
+            if (0 == noOfOutstandingRequests)
+            {
+                break;
+            }
+
+            completedRequests = FALSE;
+            while (NULL != (pRequest = VirtqueueGetUsedBuffer(&Device->RequestQueue, NULL)))
+            {
+                ASSERT(pRequest->InUse);
+
+                if (VIRTIO_BLK_S_OK == pRequest->Dma->Status)
+                {
+                    sectorsDone = sectorsDone + pRequest->SectorCount;
+                }
+                else
+                {
+                    LOG_ERROR("Request for sector 0x%X failed with status %u\n",
+                              pRequest->Dma->Header.Sector, pRequest->Dma->Status);
+
+                    if (SUCCEEDED(status))
+                    {
+                        status = VIRTIO_BLK_S_UNSUPP == pRequest->Dma->Status
+                                    ? STATUS_DEVICE_NOT_SUPPORTED
+                                    : STATUS_DEVICE_INVALID_OPERATION;
+                    }
+                }
+
+                pRequest->InUse = FALSE;
+                noOfOutstandingRequests--;
+                completedRequests = TRUE;
+            }
+
+            if (!completedRequests)
+            {
+                // if there is more to issue we want to refill the queue when
+                // half of it completes, else a single interrupt when all the
+                // requests are done is enough
+                WORD requestsToWaitFor = (WORD)((sectorsIssued < SectorCount && SUCCEEDED(status))
+                                                ? max(1, noOfOutstandingRequests / 2)
+                                                : noOfOutstandingRequests);
+
+                if (VirtqueueEnableInterrupts(&Device->RequestQueue, requestsToWaitFor))
+                {
+                    ExEventWaitForSignal(&Device->RequestsCompleted);
+                }
+
+                VirtqueueDisableInterrupts(&Device->RequestQueue);
+            }
+        }
+    }
+    __finally
+    {
+        if (NULL != pMdl)
+        {
+            IoFreeMdl(pMdl);
+            pMdl = NULL;
+        }
+
+        *SectorsReadWritten = sectorsDone;
+    }
+
+    return status;
+}
+
+static
+PVIRTIO_BLK_REQUEST
+_VirtioBlkGetFreeRequest(
+    IN          PVIRTIO_BLK_DEVICE                          Device
+    )
+{
+    DWORD i;
+
+    ASSERT(NULL != Device);
+
+    for (i = 0; i < VIRTIO_BLK_MAX_REQUESTS; ++i)
+    {
+        if (!Device->Requests[i].InUse)
+        {
+            return &Device->Requests[i];
+        }
+    }
+
+    return NULL;
+}
+
+static
+void
+_VirtioBlkBuildDataBuffers(
+    IN          PVIRTIO_BLK_DEVICE                          Device,
+    IN          PMDL                                        Mdl,
+    INOUT       PVIRTIO_BLK_DMA_CURSOR                      Cursor,
+    IN          QWORD                                       BytesRemaining,
+    OUT_WRITES(VIRTIO_BLK_MAX_SEGMENTS)
+                PVIRTQUEUE_BUFFER                           Buffers,
+    OUT         WORD*                                       NumberOfBuffers,
+    OUT         DWORD*                                      BytesInBuffers
+    )
+{
+    WORD noOfBuffers;
+    DWORD bytesInBuffers;
+    DWORD maxBytes;
+    DWORD excessBytes;
+
+    ASSERT(NULL != Device);
+    ASSERT(NULL != Mdl);
+    ASSERT(NULL != Cursor);
+    ASSERT(0 != BytesRemaining);
+    ASSERT(NULL != Buffers);
+    ASSERT(NULL != NumberOfBuffers);
+    ASSERT(NULL != BytesInBuffers);
+
+    noOfBuffers = 0;
+    bytesInBuffers = 0;
+    maxBytes = (DWORD)min(BytesRemaining, VIRTIO_BLK_MAX_BYTES_PER_REQUEST);
+
+    while (bytesInBuffers < maxBytes && noOfBuffers < Device->MaxSegments)
+    {
+        DWORD bytesInBuffer;
+
+        MDL_TRANSLATION_PAIR* pCurPair = IoMdlGetTranslationPair(Mdl, Cursor->PairIndex);
+        ASSERT(NULL != pCurPair);
+
+        bytesInBuffer = min(pCurPair->NumberOfBytes - Cursor->PairOffset, maxBytes - bytesInBuffers);
+        bytesInBuffer = min(bytesInBuffer, Device->MaxSegmentSize);
+
+        Buffers[noOfBuffers].PhysicalAddress = PtrOffset(pCurPair->Address, Cursor->PairOffset);
+        Buffers[noOfBuffers].Length = bytesInBuffer;
+
+        noOfBuffers++;
+        bytesInBuffers = bytesInBuffers + bytesInBuffer;
+
+        Cursor->PairOffset = Cursor->PairOffset + bytesInBuffer;
+        if (Cursor->PairOffset == pCurPair->NumberOfBytes)
+        {
+            Cursor->PairIndex++;
+            Cursor->PairOffset = 0;
+        }
+    }
+
+    // if we ran out of segments in the middle of a sector the partial sector
+    // goes into the next request
+    excessBytes = (DWORD)AddressOffset(bytesInBuffers, SECTOR_SIZE);
+    bytesInBuffers = bytesInBuffers - excessBytes;
+
+    while (0 != excessBytes)
+    {
+        DWORD bytesToRemove;
+
+        ASSERT(noOfBuffers > 0);
+
+        bytesToRemove = min(excessBytes, Buffers[noOfBuffers - 1].Length);
+
+        Buffers[noOfBuffers - 1].Length = Buffers[noOfBuffers - 1].Length - bytesToRemove;
+        excessBytes = excessBytes - bytesToRemove;
+
+        // move the cursor back over the bytes we removed
+        if (Cursor->PairOffset >= bytesToRemove)
+        {
+            Cursor->PairOffset = Cursor->PairOffset - bytesToRemove;
+        }
+        else
+        {
+            MDL_TRANSLATION_PAIR* pPrevPair;
+
+            ASSERT(0 == Cursor->PairOffset);
+            ASSERT(Cursor->PairIndex > 0);
+
+            Cursor->PairIndex--;
+            pPrevPair = IoMdlGetTranslationPair(Mdl, Cursor->PairIndex);
+            ASSERT(NULL != pPrevPair);
+
+            Cursor->PairOffset = pPrevPair->NumberOfBytes - bytesToRemove;
+        }
+
+        if (0 == Buffers[noOfBuffers - 1].Length)
+        {
+            noOfBuffers--;
+        }
+    }
+
+    ASSERT(0 != bytesInBuffers);
+    ASSERT(0 != noOfBuffers);
+
+    *NumberOfBuffers = noOfBuffers;
+    *BytesInBuffers = bytesInBuffers;
+}
+
+BOOLEAN
+(__cdecl _VirtioBlkInterrupt)(
+    IN      PDEVICE_OBJECT  Device
+    )
+{
+    PVIRTIO_BLK_DEVICE pDevice;
+    BYTE isrStatus;
+
+    ASSERT(NULL != Device);
+
+    pDevice = IoGetDeviceExtension(Device);
+    ASSERT(NULL != pDevice);
+
+    // reading the ISR status deasserts the interrupt line
+    isrStatus = VirtioAcknowledgeInterrupt(&pDevice->Transport);
+    if (0 == isrStatus)
+    {
+        // not our interrupt
+        return FALSE;
+    }
+
+    if (IsBooleanFlagOn(isrStatus, VIRTIO_ISR_QUEUE_INTERRUPT))
+    {
+        // the waiting thread retrieves the used requests
+        ExEventSignal(&pDevice->RequestsCompleted);
+    }
+
+    return TRUE;
+}
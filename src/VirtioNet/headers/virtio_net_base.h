@@ -0,0 +1,12 @@
+#pragma once
+
+#include "common_lib.h"
+#include "log.h"
+#include "io.h"
+#include "ex.h"
+#include "thread.h"
+#include "network.h"
+#include "virtio.h"
+#include "virtqueue.h"
+#include "virtio_net_registers.h"
+#include "virtio_net_structures.h"
@@ -0,0 +1,40 @@
+#pragma once
+
+//******************************************************************************
+// Function:     VirtioNetInitializeDevice
+// Description:  Negotiates the features of the device, sets up a RX and a TX
+//               virtqueue for each queue pair on top of the buffers allocated
+//               by the port driver and starts the RX poll threads.
+// Returns:      STATUS
+// Parameter:    INOUT struct _MINIPORT_DEVICE_INITIALIZATION* Initialization -
+//               NumberOfQueues is lowered if the device has fewer queue pairs.
+// Parameter:    INOUT PVIRTIO_NET_DEVICE Device
+//******************************************************************************
+STATUS
+VirtioNetInitializeDevice(
+    INOUT                           struct _MINIPORT_DEVICE_INITIALIZATION*    Initialization,
+    INOUT                           PVIRTIO_NET_DEVICE                          Device
+    );
+
+_No_competing_thread_
+STATUS
+VirtioNetSendFrames(
+    IN                              PVIRTIO_NET_DEVICE  Device,
+    IN                              BYTE                QueueIndex,
+    IN                              WORD                FirstDescriptorIndex,
+    IN                              WORD                NumberOfFrames,
+    IN_READS(NumberOfFrames)        WORD*               Lengths
+    );
+
+// used when the device has a single interrupt for all of its queues
+BOOLEAN
+VirtioNetHandleInterrupt(
+    IN                              PVIRTIO_NET_DEVICE  Device
+    );
+
+// called on the MSI-X vector of the QueueIndex queue pair
+BOOLEAN
+VirtioNetHandleQueueInterrupt(
+    IN                              PVIRTIO_NET_DEVICE  Device,
+    IN                              BYTE                QueueIndex
+    );
@@ -0,0 +1,91 @@
+#pragma once
+
+// Virtio 1.0 Specification, 5.1 Network Device
+
+// transitional devices (which also implement the legacy interface) keep the
+// legacy device ID
+#define VIRTIO_NET_PCI_TRANSITIONAL_DEVICE_ID   0x1000
+
+// the receive and transmit queues of each pair come first, the control queue
+// is the last one
+#define VIRTIO_NET_RX_QUEUE_INDEX(Pair)         ((WORD)(2 * (Pair)))
+#define VIRTIO_NET_TX_QUEUE_INDEX(Pair)         ((WORD)(2 * (Pair) + 1))
+#define VIRTIO_NET_CONTROL_QUEUE_INDEX(Pairs)   ((WORD)(2 * (Pairs)))
+
+// Feature bits
+#define VIRTIO_NET_F_CSUM                       (1ULL<<0)
+#define VIRTIO_NET_F_GUEST_CSUM                 (1ULL<<1)
+#define VIRTIO_NET_F_MAC                        (1ULL<<5)
+#define VIRTIO_NET_F_MRG_RXBUF                  (1ULL<<15)
+#define VIRTIO_NET_F_STATUS                     (1ULL<<16)
+#define VIRTIO_NET_F_CTRL_VQ                    (1ULL<<17)
+#define VIRTIO_NET_F_MQ                         (1ULL<<22)
+
+// VIRTIO_NET_CONFIG.Status
+#define VIRTIO_NET_S_LINK_UP                    (1<<0)
+
+// VIRTIO_NET_HDR.Flags
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM             (1<<0)
+#define VIRTIO_NET_HDR_F_DATA_VALID             (1<<1)
+
+// VIRTIO_NET_HDR.GsoType
+#define VIRTIO_NET_HDR_GSO_NONE                 0
+
+// Control queue classes and commands
+#define VIRTIO_NET_CTRL_MQ                      4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET         0
+
+// Control command status, written by the device in the last byte of the
+// command
+#define VIRTIO_NET_OK                           0
+#define VIRTIO_NET_ERR                          1
+
+#pragma pack(push,1)
+
+typedef struct _VIRTIO_NET_CONFIG
+{
+    // valid if VIRTIO_NET_F_MAC was negotiated
+    MAC_ADDRESS                         Mac;
+
+    // valid if VIRTIO_NET_F_STATUS was negotiated
+    WORD                                Status;
+
+    // valid if VIRTIO_NET_F_MQ was negotiated
+    WORD                                MaxVirtqueuePairs;
+} VIRTIO_NET_CONFIG, *PVIRTIO_NET_CONFIG;
+STATIC_ASSERT(sizeof(VIRTIO_NET_CONFIG) == 10);
+
+// Precedes each frame, with VIRTIO_F_VERSION_1 NumBuffers is always present
+typedef struct _VIRTIO_NET_HDR
+{
+    BYTE                                Flags;
+    BYTE                                GsoType;
+    WORD                                HdrLen;
+    WORD                                GsoSize;
+
+    // valid if VIRTIO_NET_HDR_F_NEEDS_CSUM is set: the checksum of the bytes
+    // from CsumStart to the end of the frame must be placed at
+    // CsumStart + CsumOffset
+    WORD                                CsumStart;
+    WORD                                CsumOffset;
+
+    // number of buffers the received frame spans, 1 unless
+    // VIRTIO_NET_F_MRG_RXBUF was negotiated
+    WORD                                NumBuffers;
+} VIRTIO_NET_HDR, *PVIRTIO_NET_HDR;
+STATIC_ASSERT(sizeof(VIRTIO_NET_HDR) == 12);
+
+typedef struct _VIRTIO_NET_CTRL_HDR
+{
+    BYTE                                Class;
+    BYTE                                Command;
+} VIRTIO_NET_CTRL_HDR, *PVIRTIO_NET_CTRL_HDR;
+STATIC_ASSERT(sizeof(VIRTIO_NET_CTRL_HDR) == 2);
+
+typedef struct _VIRTIO_NET_CTRL_MQ_PAIRS
+{
+    WORD                                VirtqueuePairs;
+} VIRTIO_NET_CTRL_MQ_PAIRS, *PVIRTIO_NET_CTRL_MQ_PAIRS;
+STATIC_ASSERT(sizeof(VIRTIO_NET_CTRL_MQ_PAIRS) == 2);
+
+#pragma pack(pop)
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "ex_event.h"
+
+// the device may support fewer queue pairs, in which case we use as many as
+// it has
+#define VIRTIO_NET_MAX_QUEUE_PAIRS              2
+
+#define VIRTIO_NET_NO_OF_RX_BUFFERS             128
+#define VIRTIO_NET_NO_OF_TX_BUFFERS             128
+
+// large enough for a full Ethernet frame, larger frames would be spread by
+// the device over multiple buffers
+#define VIRTIO_NET_BUFFER_SIZE                  (2 * KB_SIZE)
+
+#define VIRTIO_NET_MAX_QUEUE_SIZE               256
+
+// each frame is described by its header and the buffer holding it
+#define VIRTIO_NET_BUFFERS_PER_FRAME            2
+
+// maximum number of used RX buffers processed by the poll thread before it
+// yields the CPU
+#define VIRTIO_NET_RX_POLL_BUDGET               16
+
+// The part of a control command shared with the device
+#pragma pack(push,1)
+typedef struct _VIRTIO_NET_CONTROL_DMA
+{
+    VIRTIO_NET_CTRL_HDR                     Header;
+    VIRTIO_NET_CTRL_MQ_PAIRS                Pairs;
+    volatile BYTE                           Ack;
+} VIRTIO_NET_CONTROL_DMA, *PVIRTIO_NET_CONTROL_DMA;
+#pragma pack(pop)
+
+typedef struct _VIRTIO_NET_RX_QUEUE
+{
+    VIRTQUEUE                               Queue;
+
+    // the headers are kept in the ring buffer allocated by the port driver,
+    // the device writes the header of the frame in Headers[i] and the frame
+    // itself at the start of the buffer posted together with it, so it can
+    // be loaned up the stack as it is
+    PVIRTIO_NET_HDR                         Headers;
+    PHYSICAL_ADDRESS                        HeadersPhysicalAddress;
+
+    // indexed by descriptor, the buffer currently posted with each header
+    PHYSICAL_ADDRESS*                       BufferAddresses;
+    WORD                                    NumberOfBuffers;
+    WORD                                    BufferSize;
+
+    // the ISR disables the queue interrupts and signals the event, the poll
+    // thread then processes the used buffers in batches of at most
+    // VIRTIO_NET_RX_POLL_BUDGET and enables the interrupts only once there
+    // are no more used buffers
+    EX_EVENT                                PollEvent;
+    struct _THREAD*                         PollThread;
+
+    // the poll thread receives the queue as its context
+    struct _VIRTIO_NET_DEVICE*              Device;
+    BYTE                                    QueueIndex;
+
+    // the remaining buffers of a dropped frame which spanned multiple buffers
+    WORD                                    MergedBuffersToSkip;
+
+    // Statistics
+    QWORD                                   NumberOfPolls;
+    QWORD                                   NumberOfExhaustedBudgets;
+    QWORD                                   NumberOfMergedFramesDropped;
+    QWORD                                   NumberOfChecksumsCompleted;
+    QWORD                                   NumberOfChecksumsValidated;
+} VIRTIO_NET_RX_QUEUE, *PVIRTIO_NET_RX_QUEUE;
+
+typedef struct _VIRTIO_NET_TX_QUEUE
+{
+    VIRTQUEUE                               Queue;
+
+    // zeroed headers, one for each port buffer: the stack hands complete
+    // frames so no offload is requested from the device
+    PVIRTIO_NET_HDR                         Headers;
+    PHYSICAL_ADDRESS                        HeadersPhysicalAddress;
+
+    // indexed by descriptor, the buffers filled by the port driver
+    PHYSICAL_ADDRESS*                       BufferAddresses;
+    WORD                                    NumberOfBuffers;
+
+    // the device may use the buffers in any order but the port driver must
+    // be notified in the order they were sent
+    BOOLEAN*                                Completed;
+
+    // first buffer sent which was not yet reported to the port driver
+    WORD                                    CleanIndex;
+
+    // number of buffers not yet used by the device
+    WORD                                    NumberOfPending;
+
+    // taken by both the send path and the ISR
+    LOCK                                    TxLock;
+} VIRTIO_NET_TX_QUEUE, *PVIRTIO_NET_TX_QUEUE;
+
+typedef struct _VIRTIO_NET_DEVICE
+{
+    VIRTIO_DEVICE                           Transport;
+    struct _MINIPORT_DEVICE*                MiniportDevice;
+
+    BYTE                                    NumberOfQueuePairs;
+
+    // if TRUE the RX and TX queues of pair i use MSI-X entry i and the
+    // configuration changes use entry NumberOfQueuePairs
+    BOOLEAN                                 MsiXEnabled;
+
+    VIRTIO_NET_RX_QUEUE                     RxQueues[VIRTIO_NET_MAX_QUEUE_PAIRS];
+    VIRTIO_NET_TX_QUEUE                     TxQueues[VIRTIO_NET_MAX_QUEUE_PAIRS];
+
+    // used only to tell the device how many queue pairs we use
+    VIRTQUEUE                               ControlQueue;
+    PVIRTIO_NET_CONTROL_DMA                 ControlDma;
+    PHYSICAL_ADDRESS                        ControlDmaPhysicalAddress;
+} VIRTIO_NET_DEVICE, *PVIRTIO_NET_DEVICE;
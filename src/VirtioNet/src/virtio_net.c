@@ -0,0 +1,180 @@
+#include "virtio_net_base.h"
+#include "virtio_net.h"
+#include "virtio_net_operations.h"
+#include "network_port.h"
+
+STATIC_ASSERT(VIRTIO_NET_MAX_QUEUE_PAIRS <= NETWORK_PORT_MAX_QUEUES);
+
+static FUNC_NetworkMiniportInitializeDevice         _VirtioNetInitializeMiniport;
+static FUNC_NetworkMiniportSendBuffers              _VirtioNetSendBuffers;
+static FUNC_NetworkMiniportInterruptHandler         _VirtioNetInterrupt;
+static FUNC_NetworkMiniportQueueInterruptHandler    _VirtioNetQueueInterrupt;
+static FUNC_NetworkMiniportChangeDeviceStatus       _VirtioNetChangeDeviceStatus;
+
+STATUS
+(__cdecl VirtioNetDriverEntry)(
+    INOUT       PDRIVER_OBJECT      DriverObject
+    )
+{
+    STATUS status;
+    MINIPORT_REGISTRATION registration;
+
+    ASSERT( NULL != DriverObject );
+
+    LOG_FUNC_START;
+
+    status = STATUS_SUCCESS;
+
+    memzero(&registration, sizeof(MINIPORT_REGISTRATION));
+
+    registration.DeviceContextSize = sizeof(VIRTIO_NET_DEVICE);
+    registration.NumberOfQueues = VIRTIO_NET_MAX_QUEUE_PAIRS;
+
+    // the header of each frame is kept in the ring buffer
+    registration.RxBuffers.BufferSize = VIRTIO_NET_BUFFER_SIZE;
+    registration.RxBuffers.DescriptorSize = sizeof(VIRTIO_NET_HDR);
+    registration.RxBuffers.NumberOfBuffers = VIRTIO_NET_NO_OF_RX_BUFFERS;
+
+    // both the transitional (0x1000) and the modern (0x1041) devices are
+    // network controllers while the other virtio devices are not
+    registration.Specification.MatchVendor = TRUE;
+    registration.Specification.MatchClass = TRUE;
+    registration.Specification.Description.VendorId = VIRTIO_PCI_VENDOR_ID;
+    registration.Specification.Description.ClassCode = PciDeviceClassNetworkController;
+
+    registration.TxBuffers.BufferSize = VIRTIO_NET_BUFFER_SIZE;
+    registration.TxBuffers.DescriptorSize = sizeof(VIRTIO_NET_HDR);
+    registration.TxBuffers.NumberOfBuffers = VIRTIO_NET_NO_OF_TX_BUFFERS;
+
+    registration.MiniportFunctions.MiniportInitializeDevice = _VirtioNetInitializeMiniport;
+    registration.MiniportFunctions.MiniportUninitializeDevice = NULL;
+    registration.MiniportFunctions.MiniportSendBuffers = _VirtioNetSendBuffers;
+    registration.MiniportFunctions.MiniportInterruptHandler = _VirtioNetInterrupt;
+    registration.MiniportFunctions.MiniportChangeDeviceStatus = _VirtioNetChangeDeviceStatus;
+    registration.MiniportFunctions.MiniportGetInterruptModeration = NULL;
+    registration.MiniportFunctions.MiniportQueueInterruptHandler = _VirtioNetQueueInterrupt;
+
+    // if we don't have any devices or we haven't managed to actually initialize
+    // any device there is no reason for the driver to remain 'loaded' =>
+    // NetworkPortRegisterMiniportDriver will fail
+    status = NetworkPortRegisterMiniportDriver(DriverObject,
+                                               &registration
+                                               );
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetworkPortRegisterMiniportDriver", status );
+        return status;
+    }
+
+    LOG_FUNC_END;
+
+    return status;
+}
+
+static
+STATUS
+(__cdecl _VirtioNetInitializeMiniport)(
+    INOUT                           PMINIPORT_DEVICE                    MiniportDevice,
+    IN                              PMINIPORT_DEVICE_INITIALIZATION     MiniportInitialization
+    )
+{
+    STATUS status;
+    PVIRTIO_NET_DEVICE pNetDevice;
+
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != MiniportInitialization );
+    ASSERT( NULL != MiniportInitialization->PciDevice );
+    ASSERT( 0 != MiniportInitialization->NumberOfQueues );
+    ASSERT( MiniportInitialization->NumberOfQueues <= VIRTIO_NET_MAX_QUEUE_PAIRS );
+
+    LOG_FUNC_START;
+
+    status = STATUS_SUCCESS;
+    pNetDevice = NULL;
+
+    pNetDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pNetDevice );
+
+    pNetDevice->MiniportDevice = MiniportDevice;
+
+    status = VirtioNetInitializeDevice(MiniportInitialization, pNetDevice);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("VirtioNetInitializeDevice", status );
+        return status;
+    }
+
+    LOG_FUNC_END;
+
+    return status;
+}
+
+static
+STATUS
+(__cdecl _VirtioNetSendBuffers)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  BYTE                        QueueIndex,
+    IN  WORD                        FirstDescriptorIndex,
+    IN  WORD                        NumberOfBuffers,
+    IN_READS(NumberOfBuffers)
+        WORD*                       Lengths
+    )
+{
+    PVIRTIO_NET_DEVICE pNetDevice;
+
+    ASSERT( NULL != MiniportDevice );
+
+    pNetDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pNetDevice );
+
+    return VirtioNetSendFrames(pNetDevice, QueueIndex, FirstDescriptorIndex, NumberOfBuffers, Lengths);
+}
+
+static
+BOOLEAN
+(__cdecl _VirtioNetInterrupt)(
+    IN  PMINIPORT_DEVICE            MiniportDevice
+    )
+{
+    PVIRTIO_NET_DEVICE pNetDevice;
+
+    ASSERT( NULL != MiniportDevice );
+
+    pNetDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pNetDevice );
+
+    return VirtioNetHandleInterrupt(pNetDevice);
+}
+
+static
+BOOLEAN
+(__cdecl _VirtioNetQueueInterrupt)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  BYTE                        QueueIndex
+    )
+{
+    PVIRTIO_NET_DEVICE pNetDevice;
+
+    ASSERT( NULL != MiniportDevice );
+
+    pNetDevice = NetworkPortGetMiniportExtension(MiniportDevice);
+    ASSERT( NULL != pNetDevice );
+
+    return VirtioNetHandleQueueInterrupt(pNetDevice, QueueIndex);
+}
+
+static
+void
+(__cdecl _VirtioNetChangeDeviceStatus)(
+    IN  PMINIPORT_DEVICE            MiniportDevice,
+    IN  PNETWORK_DEVICE_STATUS      DeviceStatus
+    )
+{
+    ASSERT( NULL != MiniportDevice );
+    ASSERT( NULL != DeviceStatus );
+
+    // virtio has no way of stopping a single direction: the RX poll threads
+    // recycle the frames received while RX is disabled and the port driver
+    // does not send while TX is disabled
+    LOG_TRACE_NETWORK("RX enabled: %u, TX enabled: %u\n", DeviceStatus->RxEnabled, DeviceStatus->TxEnabled);
+}
@@ -0,0 +1,1163 @@
+#include "virtio_net_base.h"
+#include "virtio_net_operations.h"
+#include "network_port.h"
+
+// Features we can make use of. The checksums of partially checksummed frames
+// are completed in software, VIRTIO_NET_F_CSUM is of no use because the stack
+// sends complete frames.
+#define VIRTIO_NET_DRIVER_FEATURES          (VIRTIO_NET_F_GUEST_CSUM | VIRTIO_NET_F_MAC |       \
+                                             VIRTIO_NET_F_MRG_RXBUF | VIRTIO_NET_F_STATUS |    \
+                                             VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ |          \
+                                             VIRTIO_F_RING_INDIRECT_DESC | VIRTIO_F_RING_EVENT_IDX)
+
+// the control queue holds a single command at a time
+#define VIRTIO_NET_CONTROL_QUEUE_SIZE       16
+#define VIRTIO_NET_CONTROL_BUFFERS          3
+
+// the control queue is polled, the command is issued only once during
+// initialization
+#define VIRTIO_NET_CONTROL_MAX_POLLS        (1 << 24)
+
+static FUNC_ThreadStart     _VirtioNetRxPollFunction;
+
+static
+STATUS
+_VirtioNetInitializeQueue(
+    IN          PVIRTIO_NET_DEVICE                  Device,
+    IN          WORD                                VirtqueueIndex,
+    IN          WORD                                NumberOfFrames,
+    OUT         PVIRTQUEUE                          Queue
+    );
+
+static
+STATUS
+_VirtioNetInitializeRxQueue(
+    INOUT       PVIRTIO_NET_DEVICE                  Device,
+    IN          PMINIPORT_BUFFER_INITIALIZATION     BufferInit,
+    IN          BYTE                                QueueIndex
+    );
+
+static
+STATUS
+_VirtioNetInitializeTxQueue(
+    INOUT       PVIRTIO_NET_DEVICE                  Device,
+    IN          PMINIPORT_BUFFER_INITIALIZATION     BufferInit,
+    IN          BYTE                                QueueIndex
+    );
+
+static
+STATUS
+_VirtioNetInitializeControlQueue(
+    INOUT       PVIRTIO_NET_DEVICE                  Device,
+    IN          WORD                                MaxVirtqueuePairs
+    );
+
+static
+STATUS
+_VirtioNetSetQueuePairs(
+    INOUT       PVIRTIO_NET_DEVICE                  Device
+    );
+
+static
+void
+_VirtioNetUninitializeDevice(
+    INOUT       PVIRTIO_NET_DEVICE                  Device
+    );
+
+static
+STATUS
+_VirtioNetPostRxBuffer(
+    INOUT       PVIRTIO_NET_RX_QUEUE                RxQueue,
+    IN          WORD                                Index
+    );
+
+static
+WORD
+_VirtioNetReceiveFrames(
+    IN          PVIRTIO_NET_DEVICE                  Device,
+    INOUT       PVIRTIO_NET_RX_QUEUE                RxQueue,
+    IN          WORD                                MaximumNumberOfFrames
+    );
+
+static
+void
+_VirtioNetProcessRxBuffer(
+    IN          PVIRTIO_NET_DEVICE                  Device,
+    INOUT       PVIRTIO_NET_RX_QUEUE                RxQueue,
+    IN          WORD                                Index,
+    IN          DWORD                               UsedLength
+    );
+
+static
+BOOLEAN
+_VirtioNetCompleteChecksum(
+    INOUT_UPDATES(FrameLength)
+                PBYTE                               Frame,
+    IN          DWORD                               FrameLength,
+    IN          PVIRTIO_NET_HDR                     Header
+    );
+
+static
+void
+_VirtioNetCompleteTxBuffers(
+    IN          PVIRTIO_NET_DEVICE                  Device,
+    IN          BYTE                                QueueIndex
+    );
+
+static
+void
+_VirtioNetServiceQueuePair(
+    IN          PVIRTIO_NET_DEVICE                  Device,
+    IN          BYTE                                QueueIndex
+    );
+
+static
+void
+_VirtioNetUpdateLinkStatus(
+    IN          PVIRTIO_NET_DEVICE                  Device
+    );
+
+STATUS
+VirtioNetInitializeDevice(
+    INOUT                           struct _MINIPORT_DEVICE_INITIALIZATION*    Initialization,
+    INOUT                           PVIRTIO_NET_DEVICE                          Device
+    )
+{
+    STATUS status;
+    VIRTIO_NET_CONFIG config;
+    DWORD configSize;
+    WORD maxPairs;
+    PPCI_DEVICE_LOCATION pLocation;
+    BYTE i;
+
+    ASSERT( NULL != Initialization );
+    ASSERT( NULL != Initialization->PciDevice );
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Device->MiniportDevice );
+
+    LOG_FUNC_START;
+
+    status = STATUS_SUCCESS;
+    memzero(&config, sizeof(VIRTIO_NET_CONFIG));
+    configSize = 0;
+    maxPairs = 1;
+    pLocation = &Initialization->PciDevice->DeviceLocation;
+
+    __try
+    {
+        status = VirtioInitializeDevice(Initialization->PciDevice, &Device->Transport);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("VirtioInitializeDevice", status);
+            __leave;
+        }
+
+        status = VirtioNegotiateFeatures(&Device->Transport, VIRTIO_NET_DRIVER_FEATURES);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("VirtioNegotiateFeatures", status);
+            __leave;
+        }
+
+        // the device exposes only the fields of the features it offers
+        if (VirtioIsFeatureNegotiated(&Device->Transport, VIRTIO_NET_F_MQ))
+        {
+            configSize = sizeof(VIRTIO_NET_CONFIG);
+        }
+        else if (VirtioIsFeatureNegotiated(&Device->Transport, VIRTIO_NET_F_STATUS))
+        {
+            configSize = (DWORD) FIELD_OFFSET(VIRTIO_NET_CONFIG, MaxVirtqueuePairs);
+        }
+        else
+        {
+            configSize = (DWORD) FIELD_OFFSET(VIRTIO_NET_CONFIG, Status);
+        }
+
+        status = VirtioReadDeviceConfig(&Device->Transport, 0, configSize, &config);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("VirtioReadDeviceConfig", status);
+            __leave;
+        }
+
+        // the number of queue pairs can only be changed through the control
+        // queue, without it the device uses only the first pair
+        if (VirtioIsFeatureNegotiated(&Device->Transport, VIRTIO_NET_F_MQ) &&
+            VirtioIsFeatureNegotiated(&Device->Transport, VIRTIO_NET_F_CTRL_VQ) &&
+            0 != config.MaxVirtqueuePairs)
+        {
+            maxPairs = config.MaxVirtqueuePairs;
+        }
+
+        Device->NumberOfQueuePairs = (BYTE) min(maxPairs, Initialization->NumberOfQueues);
+        Device->MsiXEnabled = Initialization->MsiXEnabled;
+        Initialization->NumberOfQueues = Device->NumberOfQueuePairs;
+
+        LOG_TRACE_NETWORK("Device has %u queue pairs, we use %u, MSI-X %s\n",
+                          maxPairs, Device->NumberOfQueuePairs, Device->MsiXEnabled ? "enabled" : "disabled");
+
+        for (i = 0; i < Device->NumberOfQueuePairs; ++i)
+        {
+            status = _VirtioNetInitializeRxQueue(Device, &Initialization->RxBuffers[i], i);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_VirtioNetInitializeRxQueue", status);
+                __leave;
+            }
+
+            status = _VirtioNetInitializeTxQueue(Device, &Initialization->TxBuffers[i], i);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_VirtioNetInitializeTxQueue", status);
+                __leave;
+            }
+        }
+
+        if (Device->NumberOfQueuePairs > 1)
+        {
+            status = _VirtioNetInitializeControlQueue(Device, maxPairs);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_VirtioNetInitializeControlQueue", status);
+                __leave;
+            }
+        }
+
+        if (Device->MsiXEnabled)
+        {
+            // the port driver registers entry i for queue pair i and entry
+            // NumberOfQueuePairs for everything else, the control queue is
+            // polled and has no vector
+            for (i = 0; i < Device->NumberOfQueuePairs; ++i)
+            {
+                status = VirtqueueSetMsixVector(&Device->RxQueues[i].Queue, i);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("VirtqueueSetMsixVector", status);
+                    __leave;
+                }
+
+                status = VirtqueueSetMsixVector(&Device->TxQueues[i].Queue, i);
+                if (!SUCCEEDED(status))
+                {
+                    LOG_FUNC_ERROR("VirtqueueSetMsixVector", status);
+                    __leave;
+                }
+            }
+
+            status = VirtioSetConfigMsixVector(&Device->Transport, Device->NumberOfQueuePairs);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("VirtioSetConfigMsixVector", status);
+                __leave;
+            }
+        }
+
+        VirtioSetDriverOk(&Device->Transport);
+
+        if (Device->NumberOfQueuePairs > 1)
+        {
+            status = _VirtioNetSetQueuePairs(Device);
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("_VirtioNetSetQueuePairs", status);
+                __leave;
+            }
+        }
+
+        // the RX buffers were posted when the queues were initialized, but
+        // the device may be notified only after DRIVER_OK
+        for (i = 0; i < Device->NumberOfQueuePairs; ++i)
+        {
+            VirtqueueKick(&Device->RxQueues[i].Queue);
+        }
+
+        if (VirtioIsFeatureNegotiated(&Device->Transport, VIRTIO_NET_F_MAC))
+        {
+            Device->MiniportDevice->PhysicalAddress = config.Mac;
+        }
+        else
+        {
+            // locally administered unicast address derived from the PCI
+            // location of the device so that it is stable across boots
+            Device->MiniportDevice->PhysicalAddress.Value[0] = 0x02;
+            Device->MiniportDevice->PhysicalAddress.Value[1] = 0x00;
+            Device->MiniportDevice->PhysicalAddress.Value[2] = 0x00;
+            Device->MiniportDevice->PhysicalAddress.Value[3] = pLocation->Bus;
+            Device->MiniportDevice->PhysicalAddress.Value[4] = pLocation->Device;
+            Device->MiniportDevice->PhysicalAddress.Value[5] = pLocation->Function;
+        }
+
+        // without VIRTIO_NET_F_STATUS the link is assumed to be up
+        Device->MiniportDevice->LinkUp = (BOOLEAN) (!VirtioIsFeatureNegotiated(&Device->Transport, VIRTIO_NET_F_STATUS) ||
+                                                    IsBooleanFlagOn(config.Status, VIRTIO_NET_S_LINK_UP));
+
+        Device->MiniportDevice->DeviceStatus.RxEnabled = TRUE;
+        Device->MiniportDevice->DeviceStatus.TxEnabled = TRUE;
+
+        // nothing may fail after the poll threads are started
+        for (i = 0; i < Device->NumberOfQueuePairs; ++i)
+        {
+            status = ThreadCreate("RX poll thread",
+                                  ThreadPriorityDefault,
+                                  _VirtioNetRxPollFunction,
+                                  &Device->RxQueues[i],
+                                  &Device->RxQueues[i].PollThread
+                                  );
+            if (!SUCCEEDED(status))
+            {
+                LOG_FUNC_ERROR("ThreadCreate", status);
+                __leave;
+            }
+        }
+
+        LOG("Virtio network device %02x:%02x:%02x:%02x:%02x:%02x, %u queue pairs, features 0x%X\n",
+            Device->MiniportDevice->PhysicalAddress.Value[0], Device->MiniportDevice->PhysicalAddress.Value[1],
+            Device->MiniportDevice->PhysicalAddress.Value[2], Device->MiniportDevice->PhysicalAddress.Value[3],
+            Device->MiniportDevice->PhysicalAddress.Value[4], Device->MiniportDevice->PhysicalAddress.Value[5],
+            Device->NumberOfQueuePairs, Device->Transport.NegotiatedFeatures);
+    }
+    __finally
+    {
+        // a poll thread which was already started keeps using its queue
+        if (!SUCCEEDED(status) && NULL == Device->RxQueues[0].PollThread)
+        {
+            _VirtioNetUninitializeDevice(Device);
+        }
+
+        LOG_FUNC_END;
+    }
+
+    return status;
+}
+
+STATUS
+VirtioNetSendFrames(
+    IN                              PVIRTIO_NET_DEVICE  Device,
+    IN                              BYTE                QueueIndex,
+    IN                              WORD                FirstDescriptorIndex,
+    IN                              WORD                NumberOfFrames,
+    IN_READS(NumberOfFrames)        WORD*               Lengths
+    )
+{
+    STATUS status;
+    PVIRTIO_NET_TX_QUEUE pTxQueue;
+    VIRTQUEUE_BUFFER buffers[VIRTIO_NET_BUFFERS_PER_FRAME];
+    INTR_STATE oldState;
+    WORD index;
+    WORD i;
+
+    ASSERT( NULL != Device );
+    ASSERT( QueueIndex < Device->NumberOfQueuePairs );
+    ASSERT( 0 != NumberOfFrames );
+    ASSERT( NULL != Lengths );
+
+    pTxQueue = &Device->TxQueues[QueueIndex];
+    ASSERT( NumberOfFrames < pTxQueue->NumberOfBuffers );
+    ASSERT( FirstDescriptorIndex < pTxQueue->NumberOfBuffers );
+
+    status = STATUS_SUCCESS;
+    index = FirstDescriptorIndex;
+
+    buffers[0].Length = sizeof(VIRTIO_NET_HDR);
+    buffers[0].DeviceWritable = FALSE;
+    buffers[1].DeviceWritable = FALSE;
+
+    LockAcquire(&pTxQueue->TxLock, &oldState);
+
+    for (i = 0; i < NumberOfFrames; ++i)
+    {
+        ASSERT( Lengths[i] <= VIRTIO_NET_BUFFER_SIZE );
+
+        buffers[0].PhysicalAddress = PtrOffset(pTxQueue->HeadersPhysicalAddress, index * sizeof(VIRTIO_NET_HDR));
+        buffers[1].PhysicalAddress = pTxQueue->BufferAddresses[index];
+        buffers[1].Length = Lengths[i];
+
+        // the queue was checked to have room for all the buffers of the port
+        // driver, which never hands us more than it has
+        status = VirtqueueAddBuffers(&pTxQueue->Queue, buffers, VIRTIO_NET_BUFFERS_PER_FRAME, &pTxQueue->Headers[index]);
+        ASSERT(SUCCEEDED(status));
+
+        pTxQueue->NumberOfPending = pTxQueue->NumberOfPending + 1;
+        index = (index + 1) % pTxQueue->NumberOfBuffers;
+    }
+
+    // a single notification for the whole vector, none at all if the device
+    // is still processing the previous ones
+    VirtqueueKick(&pTxQueue->Queue);
+
+    // also asks for an interrupt for the frames just sent
+    _VirtioNetCompleteTxBuffers(Device, QueueIndex);
+
+    LockRelease(&pTxQueue->TxLock, oldState);
+
+    return status;
+}
+
+BOOLEAN
+VirtioNetHandleInterrupt(
+    IN                              PVIRTIO_NET_DEVICE  Device
+    )
+{
+    BYTE isrStatus;
+    BYTE i;
+
+    ASSERT( NULL != Device );
+
+    if (Device->MsiXEnabled)
+    {
+        // the queues have their own vectors, this one is used only for
+        // configuration changes and it is not shared
+        _VirtioNetUpdateLinkStatus(Device);
+
+        return TRUE;
+    }
+
+    // reading the ISR status deasserts the interrupt line
+    isrStatus = VirtioAcknowledgeInterrupt(&Device->Transport);
+    if (0 == isrStatus)
+    {
+        // not our interrupt
+        return FALSE;
+    }
+
+    LOG_TRACE_COMP(LogComponentNetwork | LogComponentInterrupt,
+                   "ISR status: 0x%x on device 0x%X\n", isrStatus, Device);
+
+    if (IsBooleanFlagOn(isrStatus, VIRTIO_ISR_QUEUE_INTERRUPT))
+    {
+        // we cannot know which of the queues were used
+        for (i = 0; i < Device->NumberOfQueuePairs; ++i)
+        {
+            _VirtioNetServiceQueuePair(Device, i);
+        }
+    }
+
+    if (IsBooleanFlagOn(isrStatus, VIRTIO_ISR_CONFIGURATION_CHANGE))
+    {
+        _VirtioNetUpdateLinkStatus(Device);
+    }
+
+    return TRUE;
+}
+
+BOOLEAN
+VirtioNetHandleQueueInterrupt(
+    IN                              PVIRTIO_NET_DEVICE  Device,
+    IN                              BYTE                QueueIndex
+    )
+{
+    ASSERT( NULL != Device );
+    ASSERT( Device->MsiXEnabled );
+    ASSERT( QueueIndex < Device->NumberOfQueuePairs );
+
+    LOG_TRACE_COMP(LogComponentNetwork | LogComponentInterrupt,
+                   "Interrupt for queue %u on device 0x%X\n", QueueIndex, Device);
+
+    _VirtioNetServiceQueuePair(Device, QueueIndex);
+
+    return TRUE;
+}
+
+static
+STATUS
+_VirtioNetInitializeQueue(
+    IN          PVIRTIO_NET_DEVICE                  Device,
+    IN          WORD                                VirtqueueIndex,
+    IN          WORD                                NumberOfFrames,
+    OUT         PVIRTQUEUE                          Queue
+    )
+{
+    STATUS status;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Queue );
+
+    status = VirtqueueInitialize(&Device->Transport,
+                                 VirtqueueIndex,
+                                 VIRTIO_NET_MAX_QUEUE_SIZE,
+                                 VIRTIO_NET_BUFFERS_PER_FRAME,
+                                 Queue);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("VirtqueueInitialize", status);
+        return status;
+    }
+
+    // with indirect descriptors each frame occupies a single descriptor of
+    // the queue, the queue must have room for all the port buffers
+    if (Queue->Size < NumberOfFrames * (Queue->Indirect ? 1 : VIRTIO_NET_BUFFERS_PER_FRAME))
+    {
+        LOG_WARNING("Virtqueue %u has only %u descriptors for %u frames\n",
+                    VirtqueueIndex, Queue->Size, NumberOfFrames);
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    return status;
+}
+
+static
+STATUS
+_VirtioNetInitializeRxQueue(
+    INOUT       PVIRTIO_NET_DEVICE                  Device,
+    IN          PMINIPORT_BUFFER_INITIALIZATION     BufferInit,
+    IN          BYTE                                QueueIndex
+    )
+{
+    STATUS status;
+    PVIRTIO_NET_RX_QUEUE pRxQueue;
+    WORD i;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != BufferInit );
+    ASSERT( NULL != BufferInit->Buffers );
+    ASSERT( NULL != BufferInit->RingBuffer );
+    ASSERT( BufferInit->NumberOfBuffers <= MAX_WORD );
+
+    pRxQueue = &Device->RxQueues[QueueIndex];
+
+    pRxQueue->Device = Device;
+    pRxQueue->QueueIndex = QueueIndex;
+    pRxQueue->NumberOfBuffers = (WORD) BufferInit->NumberOfBuffers;
+    pRxQueue->BufferSize = BufferInit->BufferSize;
+
+    pRxQueue->Headers = BufferInit->RingBuffer;
+    memzero(pRxQueue->Headers, pRxQueue->NumberOfBuffers * sizeof(VIRTIO_NET_HDR));
+
+    pRxQueue->HeadersPhysicalAddress = IoGetPhysicalAddress(pRxQueue->Headers);
+    if (NULL == pRxQueue->HeadersPhysicalAddress)
+    {
+        LOG_ERROR("IoGetPhysicalAddress cannot map VA 0x%X\n", pRxQueue->Headers);
+        return STATUS_MEMORY_CANNOT_BE_MAPPED;
+    }
+
+    // the array received from the port driver is only valid during the
+    // initialization
+    pRxQueue->BufferAddresses = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
+                                                      pRxQueue->NumberOfBuffers * sizeof(PHYSICAL_ADDRESS),
+                                                      HEAP_VIRTIO_TAG,
+                                                      0);
+    if (NULL == pRxQueue->BufferAddresses)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", pRxQueue->NumberOfBuffers * sizeof(PHYSICAL_ADDRESS));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+    memcpy(pRxQueue->BufferAddresses, BufferInit->Buffers, pRxQueue->NumberOfBuffers * sizeof(PHYSICAL_ADDRESS));
+
+    status = ExEventInit(&pRxQueue->PollEvent, ExEventTypeSynchronization, FALSE);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("ExEventInit", status);
+        return status;
+    }
+
+    status = _VirtioNetInitializeQueue(Device,
+                                       VIRTIO_NET_RX_QUEUE_INDEX(QueueIndex),
+                                       pRxQueue->NumberOfBuffers,
+                                       &pRxQueue->Queue);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_VirtioNetInitializeQueue", status);
+        return status;
+    }
+
+    for (i = 0; i < pRxQueue->NumberOfBuffers; ++i)
+    {
+        status = _VirtioNetPostRxBuffer(pRxQueue, i);
+        if (!SUCCEEDED(status))
+        {
+            LOG_FUNC_ERROR("_VirtioNetPostRxBuffer", status);
+            return status;
+        }
+    }
+
+    // the poll thread is woken by the first frame received
+    VirtqueueEnableInterrupts(&pRxQueue->Queue, 1);
+
+    return status;
+}
+
+static
+STATUS
+_VirtioNetInitializeTxQueue(
+    INOUT       PVIRTIO_NET_DEVICE                  Device,
+    IN          PMINIPORT_BUFFER_INITIALIZATION     BufferInit,
+    IN          BYTE                                QueueIndex
+    )
+{
+    STATUS status;
+    PVIRTIO_NET_TX_QUEUE pTxQueue;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != BufferInit );
+    ASSERT( NULL != BufferInit->Buffers );
+    ASSERT( NULL != BufferInit->RingBuffer );
+    ASSERT( BufferInit->NumberOfBuffers <= MAX_WORD );
+
+    pTxQueue = &Device->TxQueues[QueueIndex];
+
+    pTxQueue->NumberOfBuffers = (WORD) BufferInit->NumberOfBuffers;
+    pTxQueue->CleanIndex = 0;
+    pTxQueue->NumberOfPending = 0;
+    LockInit(&pTxQueue->TxLock);
+
+    pTxQueue->Headers = BufferInit->RingBuffer;
+    memzero(pTxQueue->Headers, pTxQueue->NumberOfBuffers * sizeof(VIRTIO_NET_HDR));
+
+    pTxQueue->HeadersPhysicalAddress = IoGetPhysicalAddress(pTxQueue->Headers);
+    if (NULL == pTxQueue->HeadersPhysicalAddress)
+    {
+        LOG_ERROR("IoGetPhysicalAddress cannot map VA 0x%X\n", pTxQueue->Headers);
+        return STATUS_MEMORY_CANNOT_BE_MAPPED;
+    }
+
+    pTxQueue->BufferAddresses = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
+                                                      pTxQueue->NumberOfBuffers * sizeof(PHYSICAL_ADDRESS),
+                                                      HEAP_VIRTIO_TAG,
+                                                      0);
+    if (NULL == pTxQueue->BufferAddresses)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", pTxQueue->NumberOfBuffers * sizeof(PHYSICAL_ADDRESS));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+    memcpy(pTxQueue->BufferAddresses, BufferInit->Buffers, pTxQueue->NumberOfBuffers * sizeof(PHYSICAL_ADDRESS));
+
+    pTxQueue->Completed = ExAllocatePoolWithTag(PoolAllocateZeroMemory,
+                                                pTxQueue->NumberOfBuffers * sizeof(BOOLEAN),
+                                                HEAP_VIRTIO_TAG,
+                                                0);
+    if (NULL == pTxQueue->Completed)
+    {
+        LOG_FUNC_ERROR_ALLOC("ExAllocatePoolWithTag", pTxQueue->NumberOfBuffers * sizeof(BOOLEAN));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    status = _VirtioNetInitializeQueue(Device,
+                                       VIRTIO_NET_TX_QUEUE_INDEX(QueueIndex),
+                                       pTxQueue->NumberOfBuffers,
+                                       &pTxQueue->Queue);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("_VirtioNetInitializeQueue", status);
+        return status;
+    }
+
+    // interrupts are requested only while frames are in flight
+    VirtqueueDisableInterrupts(&pTxQueue->Queue);
+
+    return status;
+}
+
+static
+STATUS
+_VirtioNetInitializeControlQueue(
+    INOUT       PVIRTIO_NET_DEVICE                  Device,
+    IN          WORD                                MaxVirtqueuePairs
+    )
+{
+    STATUS status;
+
+    ASSERT( NULL != Device );
+
+    status = VirtqueueInitialize(&Device->Transport,
+                                 VIRTIO_NET_CONTROL_QUEUE_INDEX(MaxVirtqueuePairs),
+                                 VIRTIO_NET_CONTROL_QUEUE_SIZE,
+                                 VIRTIO_NET_CONTROL_BUFFERS,
+                                 &Device->ControlQueue);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("VirtqueueInitialize", status);
+        return status;
+    }
+
+    VirtqueueDisableInterrupts(&Device->ControlQueue);
+
+    Device->ControlDma = IoAllocateContinuousMemory(sizeof(VIRTIO_NET_CONTROL_DMA));
+    if (NULL == Device->ControlDma)
+    {
+        LOG_FUNC_ERROR_ALLOC("IoAllocateContinuousMemory", sizeof(VIRTIO_NET_CONTROL_DMA));
+        return STATUS_HEAP_INSUFFICIENT_RESOURCES;
+    }
+
+    Device->ControlDmaPhysicalAddress = IoGetPhysicalAddress(Device->ControlDma);
+    ASSERT( NULL != Device->ControlDmaPhysicalAddress );
+
+    return status;
+}
+
+static
+STATUS
+_VirtioNetSetQueuePairs(
+    INOUT       PVIRTIO_NET_DEVICE                  Device
+    )
+{
+    STATUS status;
+    PVIRTIO_NET_CONTROL_DMA pDma;
+    VIRTQUEUE_BUFFER buffers[VIRTIO_NET_CONTROL_BUFFERS];
+    DWORD i;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != Device->ControlDma );
+
+    pDma = Device->ControlDma;
+
+    pDma->Header.Class = VIRTIO_NET_CTRL_MQ;
+    pDma->Header.Command = VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET;
+    pDma->Pairs.VirtqueuePairs = Device->NumberOfQueuePairs;
+    pDma->Ack = VIRTIO_NET_ERR;
+
+    buffers[0].PhysicalAddress = PtrOffset(Device->ControlDmaPhysicalAddress, FIELD_OFFSET(VIRTIO_NET_CONTROL_DMA, Header));
+    buffers[0].Length = sizeof(VIRTIO_NET_CTRL_HDR);
+    buffers[0].DeviceWritable = FALSE;
+
+    buffers[1].PhysicalAddress = PtrOffset(Device->ControlDmaPhysicalAddress, FIELD_OFFSET(VIRTIO_NET_CONTROL_DMA, Pairs));
+    buffers[1].Length = sizeof(VIRTIO_NET_CTRL_MQ_PAIRS);
+    buffers[1].DeviceWritable = FALSE;
+
+    buffers[2].PhysicalAddress = PtrOffset(Device->ControlDmaPhysicalAddress, FIELD_OFFSET(VIRTIO_NET_CONTROL_DMA, Ack));
+    buffers[2].Length = sizeof(BYTE);
+    buffers[2].DeviceWritable = TRUE;
+
+    status = VirtqueueAddBuffers(&Device->ControlQueue, buffers, VIRTIO_NET_CONTROL_BUFFERS, pDma);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("VirtqueueAddBuffers", status);
+        return status;
+    }
+
+    VirtqueueKick(&Device->ControlQueue);
+
+    for (i = 0; i < VIRTIO_NET_CONTROL_MAX_POLLS && NULL == VirtqueueGetUsedBuffer(&Device->ControlQueue, NULL); ++i)
+    {
+        _mm_pause();
+    }
+
+    if (VIRTIO_NET_CONTROL_MAX_POLLS == i)
+    {
+        LOG_ERROR("Device did not complete the control command\n");
+        return STATUS_DEVICE_NOT_READY;
+    }
+
+    if (VIRTIO_NET_OK != pDma->Ack)
+    {
+        LOG_ERROR("Device refused to use %u queue pairs\n", Device->NumberOfQueuePairs);
+        return STATUS_DEVICE_NOT_SUPPORTED;
+    }
+
+    return status;
+}
+
+static
+void
+_VirtioNetUninitializeDevice(
+    INOUT       PVIRTIO_NET_DEVICE                  Device
+    )
+{
+    DWORD i;
+
+    ASSERT( NULL != Device );
+
+    // resetting the device makes it stop accessing the queue memory, the
+    // headers and the buffers belong to the port driver
+    VirtioUninitializeDevice(&Device->Transport);
+
+    for (i = 0; i < VIRTIO_NET_MAX_QUEUE_PAIRS; ++i)
+    {
+        VirtqueueUninitialize(&Device->RxQueues[i].Queue);
+        VirtqueueUninitialize(&Device->TxQueues[i].Queue);
+
+        if (NULL != Device->RxQueues[i].BufferAddresses)
+        {
+            ExFreePoolWithTag(Device->RxQueues[i].BufferAddresses, HEAP_VIRTIO_TAG);
+            Device->RxQueues[i].BufferAddresses = NULL;
+        }
+
+        if (NULL != Device->TxQueues[i].BufferAddresses)
+        {
+            ExFreePoolWithTag(Device->TxQueues[i].BufferAddresses, HEAP_VIRTIO_TAG);
+            Device->TxQueues[i].BufferAddresses = NULL;
+        }
+
+        if (NULL != Device->TxQueues[i].Completed)
+        {
+            ExFreePoolWithTag(Device->TxQueues[i].Completed, HEAP_VIRTIO_TAG);
+            Device->TxQueues[i].Completed = NULL;
+        }
+    }
+
+    VirtqueueUninitialize(&Device->ControlQueue);
+
+    if (NULL != Device->ControlDma)
+    {
+        IoFreeContinuousMemory(Device->ControlDma);
+        Device->ControlDma = NULL;
+    }
+}
+
+static
+STATUS
+_VirtioNetPostRxBuffer(
+    INOUT       PVIRTIO_NET_RX_QUEUE                RxQueue,
+    IN          WORD                                Index
+    )
+{
+    VIRTQUEUE_BUFFER buffers[VIRTIO_NET_BUFFERS_PER_FRAME];
+
+    ASSERT( NULL != RxQueue );
+    ASSERT( Index < RxQueue->NumberOfBuffers );
+
+    buffers[0].PhysicalAddress = PtrOffset(RxQueue->HeadersPhysicalAddress, Index * sizeof(VIRTIO_NET_HDR));
+    buffers[0].Length = sizeof(VIRTIO_NET_HDR);
+    buffers[0].DeviceWritable = TRUE;
+
+    buffers[1].PhysicalAddress = RxQueue->BufferAddresses[Index];
+    buffers[1].Length = RxQueue->BufferSize;
+    buffers[1].DeviceWritable = TRUE;
+
+    return VirtqueueAddBuffers(&RxQueue->Queue, buffers, VIRTIO_NET_BUFFERS_PER_FRAME, &RxQueue->Headers[Index]);
+}
+
+static
+WORD
+_VirtioNetReceiveFrames(
+    IN          PVIRTIO_NET_DEVICE                  Device,
+    INOUT       PVIRTIO_NET_RX_QUEUE                RxQueue,
+    IN          WORD                                MaximumNumberOfFrames
+    )
+{
+    STATUS status;
+    PVIRTIO_NET_HDR pHeader;
+    DWORD usedLength;
+    WORD index;
+    WORD noOfBuffers;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != RxQueue );
+
+    usedLength = 0;
+
+    for (noOfBuffers = 0; noOfBuffers < MaximumNumberOfFrames; ++noOfBuffers)
+    {
+        pHeader = VirtqueueGetUsedBuffer(&RxQueue->Queue, &usedLength);
+        if (NULL == pHeader)
+        {
+            break;
+        }
+
+        index = (WORD) (pHeader - RxQueue->Headers);
+        ASSERT( index < RxQueue->NumberOfBuffers );
+
+        _VirtioNetProcessRxBuffer(Device, RxQueue, index, usedLength);
+
+        // the device just gave the chain back so there is room for it
+        status = _VirtioNetPostRxBuffer(RxQueue, index);
+        ASSERT(SUCCEEDED(status));
+    }
+
+    if (0 != noOfBuffers)
+    {
+        VirtqueueKick(&RxQueue->Queue);
+    }
+
+    return noOfBuffers;
+}
+
+static
+void
+_VirtioNetProcessRxBuffer(
+    IN          PVIRTIO_NET_DEVICE                  Device,
+    INOUT       PVIRTIO_NET_RX_QUEUE                RxQueue,
+    IN          WORD                                Index,
+    IN          DWORD                               UsedLength
+    )
+{
+    STATUS status;
+    PVIRTIO_NET_HDR pHeader;
+    DWORD frameLength;
+    PBYTE pFrame;
+
+    ASSERT( NULL != Device );
+    ASSERT( NULL != RxQueue );
+
+    pHeader = &RxQueue->Headers[Index];
+
+    if (0 != RxQueue->MergedBuffersToSkip)
+    {
+        // the continuation of a frame we dropped, it has no header of its own
+        RxQueue->MergedBuffersToSkip = RxQueue->MergedBuffersToSkip - 1;
+        return;
+    }
+
+    if (UsedLength <= sizeof(VIRTIO_NET_HDR))
+    {
+        return;
+    }
+    frameLength = UsedLength - sizeof(VIRTIO_NET_HDR);
+
+    if (pHeader->NumBuffers > 1)
+    {
+        // the port driver loans a single buffer for each frame, this happens
+        // only for frames larger than VIRTIO_NET_BUFFER_SIZE
+        LOG_TRACE_NETWORK("Dropping frame spanning %u buffers\n", pHeader->NumBuffers);
+
+        RxQueue->MergedBuffersToSkip = pHeader->NumBuffers - 1;
+        RxQueue->NumberOfMergedFramesDropped = RxQueue->NumberOfMergedFramesDropped + 1;
+        return;
+    }
+
+    if (!Device->MiniportDevice->DeviceStatus.RxEnabled)
+    {
+        return;
+    }
+
+    if (IsBooleanFlagOn(pHeader->Flags, VIRTIO_NET_HDR_F_NEEDS_CSUM))
+    {
+        pFrame = NetworkPortGetReceiveBuffer(Device->MiniportDevice, RxQueue->QueueIndex, Index);
+        ASSERT( NULL != pFrame );
+
+        if (_VirtioNetCompleteChecksum(pFrame, frameLength, pHeader))
+        {
+            RxQueue->NumberOfChecksumsCompleted = RxQueue->NumberOfChecksumsCompleted + 1;
+        }
+    }
+    else if (IsBooleanFlagOn(pHeader->Flags, VIRTIO_NET_HDR_F_DATA_VALID))
+    {
+        RxQueue->NumberOfChecksumsValidated = RxQueue->NumberOfChecksumsValidated + 1;
+    }
+
+    status = NetworkPortNotifyReceiveBuffer(Device->MiniportDevice,
+                                            RxQueue->QueueIndex,
+                                            Index,
+                                            frameLength,
+                                            &RxQueue->BufferAddresses[Index]);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("NetworkPortNotifyReceiveBuffer", status);
+    }
+}
+
+// The device placed the checksum of the pseudo-header in the checksum field,
+// which is part of the summed bytes, so only the bytes from CsumStart to the
+// end of the frame must be summed
+static
+BOOLEAN
+_VirtioNetCompleteChecksum(
+    INOUT_UPDATES(FrameLength)
+                PBYTE                               Frame,
+    IN          DWORD                               FrameLength,
+    IN          PVIRTIO_NET_HDR                     Header
+    )
+{
+    DWORD sum;
+    DWORD i;
+    DWORD checksumIndex;
+    WORD checksum;
+
+    ASSERT( NULL != Frame );
+    ASSERT( NULL != Header );
+
+    checksumIndex = (DWORD) Header->CsumStart + Header->CsumOffset;
+    if (Header->CsumStart >= FrameLength || checksumIndex + sizeof(WORD) > FrameLength)
+    {
+        LOG_WARNING("Invalid checksum position %u/%u for frame of %u bytes\n",
+                    Header->CsumStart, Header->CsumOffset, FrameLength);
+        return FALSE;
+    }
+
+    sum = 0;
+    for (i = Header->CsumStart; i + 1 < FrameLength; i += 2)
+    {
+        sum = sum + (((DWORD) Frame[i] << 8) | Frame[i + 1]);
+    }
+
+    if (i < FrameLength)
+    {
+        sum = sum + ((DWORD) Frame[i] << 8);
+    }
+
+    while (0 != (sum >> 16))
+    {
+        sum = (sum & MAX_WORD) + (sum >> 16);
+    }
+
+    // 0 and 0xFFFF are the same in one's complement, but a 0 UDP checksum
+    // means there is no checksum
+    checksum = (WORD) ~sum;
+    if (0 == checksum)
+    {
+        checksum = MAX_WORD;
+    }
+
+    Frame[checksumIndex] = (BYTE) (checksum >> 8);
+    Frame[checksumIndex + 1] = (BYTE) checksum;
+
+    return TRUE;
+}
+
+// Must be called with the TX lock held
+static
+void
+_VirtioNetCompleteTxBuffers(
+    IN          PVIRTIO_NET_DEVICE                  Device,
+    IN          BYTE                                QueueIndex
+    )
+{
+    PVIRTIO_NET_TX_QUEUE pTxQueue;
+    PVIRTIO_NET_HDR pHeader;
+    WORD index;
+    WORD noOfBuffers;
+
+    ASSERT( NULL != Device );
+    ASSERT( QueueIndex < Device->NumberOfQueuePairs );
+
+    pTxQueue = &Device->TxQueues[QueueIndex];
+
+    do
+    {
+        while (NULL != (pHeader = VirtqueueGetUsedBuffer(&pTxQueue->Queue, NULL)))
+        {
+            index = (WORD) (pHeader - pTxQueue->Headers);
+            ASSERT( index < pTxQueue->NumberOfBuffers );
+            ASSERT( !pTxQueue->Completed[index] );
+            ASSERT( 0 != pTxQueue->NumberOfPending );
+
+            pTxQueue->Completed[index] = TRUE;
+            pTxQueue->NumberOfPending = pTxQueue->NumberOfPending - 1;
+        }
+
+        noOfBuffers = 0;
+        while (pTxQueue->Completed[pTxQueue->CleanIndex])
+        {
+            pTxQueue->Completed[pTxQueue->CleanIndex] = FALSE;
+            pTxQueue->CleanIndex = (pTxQueue->CleanIndex + 1) % pTxQueue->NumberOfBuffers;
+            noOfBuffers = noOfBuffers + 1;
+        }
+
+        if (0 != noOfBuffers)
+        {
+            // notify port driver we have free descriptors
+            NetworkPortNotifyTxDescriptorAvailable(Device->MiniportDevice, QueueIndex, noOfBuffers);
+        }
+
+        if (0 == pTxQueue->NumberOfPending)
+        {
+            VirtqueueDisableInterrupts(&pTxQueue->Queue);
+            break;
+        }
+
+        // with event index the device interrupts only after it sent most of
+        // the pending frames instead of after each of them
+    } while (!VirtqueueEnableInterrupts(&pTxQueue->Queue, (WORD) max(1, pTxQueue->NumberOfPending * 3 / 4)));
+}
+
+static
+void
+_VirtioNetServiceQueuePair(
+    IN          PVIRTIO_NET_DEVICE                  Device,
+    IN          BYTE                                QueueIndex
+    )
+{
+    INTR_STATE dummyState;
+    PVIRTIO_NET_TX_QUEUE pTxQueue;
+
+    ASSERT( NULL != Device );
+    ASSERT( QueueIndex < Device->NumberOfQueuePairs );
+
+    pTxQueue = &Device->TxQueues[QueueIndex];
+
+    // the frames are not processed in interrupt context, the poll thread
+    // enables the interrupts again once it finds no more used buffers
+    VirtqueueDisableInterrupts(&Device->RxQueues[QueueIndex].Queue);
+    ExEventSignal(&Device->RxQueues[QueueIndex].PollEvent);
+
+    LockAcquire(&pTxQueue->TxLock, &dummyState);
+    _VirtioNetCompleteTxBuffers(Device, QueueIndex);
+    LockRelease(&pTxQueue->TxLock, INTR_OFF);
+}
+
+static
+void
+_VirtioNetUpdateLinkStatus(
+    IN          PVIRTIO_NET_DEVICE                  Device
+    )
+{
+    STATUS status;
+    WORD linkStatus;
+
+    ASSERT( NULL != Device );
+
+    if (!VirtioIsFeatureNegotiated(&Device->Transport, VIRTIO_NET_F_STATUS))
+    {
+        return;
+    }
+
+    linkStatus = 0;
+
+    status = VirtioReadDeviceConfig(&Device->Transport,
+                                    (DWORD) FIELD_OFFSET(VIRTIO_NET_CONFIG, Status),
+                                    sizeof(WORD),
+                                    &linkStatus);
+    if (!SUCCEEDED(status))
+    {
+        LOG_FUNC_ERROR("VirtioReadDeviceConfig", status);
+        return;
+    }
+
+    LOG("Link status is [%s]\n", IsBooleanFlagOn(linkStatus, VIRTIO_NET_S_LINK_UP) ? "UP" : "DOWN" );
+
+    NetworkPortNotifyLinkStatusChange(Device->MiniportDevice,
+                                      (BOOLEAN) IsBooleanFlagOn(linkStatus, VIRTIO_NET_S_LINK_UP)
+                                      );
+}
+
+static
+STATUS
+(__cdecl _VirtioNetRxPollFunction)(
+    IN_OPT      PVOID       Context
+    )
+{
+    PVIRTIO_NET_DEVICE pDevice;
+    PVIRTIO_NET_RX_QUEUE pRxQueue;
+    WORD noOfBuffers;
+
+    ASSERT( NULL != Context );
+
+    pRxQueue = Context;
+    pDevice = pRxQueue->Device;
+    noOfBuffers = 0;
+
+#pragma warning(suppress:4127)
+    while (TRUE)
+    {
+        // wait for the ISR to hand over the queue
+        ExEventWaitForSignal(&pRxQueue->PollEvent);
+
+#pragma warning(suppress:4127)
+        while (TRUE)
+        {
+            noOfBuffers = _VirtioNetReceiveFrames(pDevice, pRxQueue, VIRTIO_NET_RX_POLL_BUDGET);
+
+            pRxQueue->NumberOfPolls = pRxQueue->NumberOfPolls + 1;
+
+            if (noOfBuffers == VIRTIO_NET_RX_POLL_BUDGET)
+            {
+                // there may be more frames waiting, but let the other threads
+                // run before processing the next batch
+                pRxQueue->NumberOfExhaustedBudgets = pRxQueue->NumberOfExhaustedBudgets + 1;
+                ThreadYield();
+                continue;
+            }
+
+            // a frame received after the queue was found empty but before
+            // the interrupts were enabled would not generate an interrupt
+            if (VirtqueueEnableInterrupts(&pRxQueue->Queue, 1))
+            {
+                break;
+            }
+
+            VirtqueueDisableInterrupts(&pRxQueue->Queue);
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// Layout of a packet ring shared between the kernel and a user process, see
+// SyscallNetRingCreate. The header page is followed by two arrays of
+// SlotCount frame slots: the RX slots, filled by the kernel with the frames
+// received by the device, and the TX slots, filled by the process with the
+// frames to send.
+//
+// The indices are free running, index i refers to slot i & (SlotCount - 1)
+// of its array. Each index has a single writer:
+//   RxProducer - the kernel, after it has written the frame to the slot
+//   RxConsumer - the process, once it is done with the slot
+//   TxProducer - the process, after it has written the frame to the slot
+//   TxConsumer - the kernel, once the frame was handed to the device
+// The slots from the consumer up to the producer belong to the reader, the
+// others to the writer. A writer only has to store the slot before the index
+// which publishes it, x86 does not reorder stores and the volatile indices
+// keep the compiler from doing it.
+
+#define NET_RING_MIN_SLOTS              16
+#define NET_RING_MAX_SLOTS              1024
+
+#define NET_RING_SLOT_SIZE              2048
+#define NET_RING_MAX_FRAME_SIZE         (NET_RING_SLOT_SIZE - 2 * sizeof(DWORD))
+#define NET_RING_HEADER_SIZE            4096
+
+#define NET_RING_CACHE_LINE_SIZE        64
+
+// the size of the whole ring for SlotCount slots in each direction
+#define NET_RING_SIZE(SlotCount)        (NET_RING_HEADER_SIZE + 2 * (SlotCount) * NET_RING_SLOT_SIZE)
+
+typedef struct _NET_RING_SLOT
+{
+    // number of valid bytes in Frame, starting with the ethernet header
+    DWORD                       Length;
+    DWORD                       __Reserved;
+
+    BYTE                        Frame[NET_RING_MAX_FRAME_SIZE];
+} NET_RING_SLOT, *PNET_RING_SLOT;
+STATIC_ASSERT(sizeof(NET_RING_SLOT) == NET_RING_SLOT_SIZE);
+
+typedef struct _NET_RING_HEADER
+{
+    // set by the kernel when the ring is created, the kernel keeps its own
+    // copy of these values and never reads them back
+    DWORD                       SlotCount;
+    DWORD                       SlotSize;
+    DWORD                       RxSlotsOffset;
+    DWORD                       TxSlotsOffset;
+
+    BYTE                        __Reserved0[NET_RING_CACHE_LINE_SIZE - 4 * sizeof(DWORD)];
+
+    // written by the kernel
+    volatile DWORD              RxProducer;
+    volatile DWORD              TxConsumer;
+
+    // frames received while all the RX slots were taken
+    volatile QWORD              RxDropped;
+
+    // TX slots consumed without their frame being sent, because of an
+    // invalid length or a device error
+    volatile QWORD              TxErrors;
+
+    BYTE                        __Reserved1[NET_RING_CACHE_LINE_SIZE - 2 * sizeof(DWORD) - 2 * sizeof(QWORD)];
+
+    // written by the process
+    volatile DWORD              RxConsumer;
+    volatile DWORD              TxProducer;
+} NET_RING_HEADER, *PNET_RING_HEADER;
+STATIC_ASSERT(sizeof(NET_RING_HEADER) <= NET_RING_HEADER_SIZE);
+
+#define NetRingRxSlot(Header,Index)     ((PNET_RING_SLOT)((PBYTE)(Header) + (Header)->RxSlotsOffset) + ((Index) & ((Header)->SlotCount - 1)))
+#define NetRingTxSlot(Header,Index)     ((PNET_RING_SLOT)((PBYTE)(Header) + (Header)->TxSlotsOffset) + ((Index) & ((Header)->SlotCount - 1)))
@@ -13,3 +13,4 @@ typedef QWORD UM_HANDLE;
 #include "mem_structures.h"
 #include "thread_defs.h"
 #include "process_defs.h"
+#include "net_ring_defs.h"
@@ -306,3 +306,68 @@ SyscallFileWrite(
     IN  QWORD                       BytesToWrite,
     OUT QWORD*                      BytesWritten
     );
+
+// SyscallIdNetRingCreate
+//******************************************************************************
+// Function:     SyscallNetRingCreate
+// Description:  Creates a packet ring on network device DeviceId and maps it
+//               in the address space of the current process, see
+//               net_ring_defs.h for its layout. The ring receives a copy of
+//               every frame received by the device. A device has at most one
+//               ring.
+// Returns:      STATUS
+// Parameter:    IN DWORD DeviceId
+// Parameter:    IN DWORD SlotCount - number of slots in each direction, must
+//               be a power of 2 between NET_RING_MIN_SLOTS and
+//               NET_RING_MAX_SLOTS.
+// Parameter:    OUT PNET_RING_HEADER* Ring - address of the ring, it also
+//               identifies the ring in the other packet ring system calls.
+//******************************************************************************
+STATUS
+SyscallNetRingCreate(
+    IN          DWORD                   DeviceId,
+    IN          DWORD                   SlotCount,
+    OUT         PNET_RING_HEADER*       Ring
+    );
+
+// SyscallIdNetRingTransmit
+//******************************************************************************
+// Function:     SyscallNetRingTransmit
+// Description:  Sends all the frames placed in the TX slots of Ring up to
+//               TxProducer. The source address of each frame is filled in.
+//               Slots with an invalid length are consumed without being sent
+//               and counted in TxErrors.
+// Returns:      STATUS
+// Parameter:    IN PNET_RING_HEADER Ring
+// Parameter:    OUT_OPT DWORD* FramesSent
+//******************************************************************************
+STATUS
+SyscallNetRingTransmit(
+    IN          PNET_RING_HEADER        Ring,
+    OUT_OPT     DWORD*                  FramesSent
+    );
+
+// SyscallIdNetRingWait
+//******************************************************************************
+// Function:     SyscallNetRingWait
+// Description:  Blocks until there is at least one frame in the RX slots of
+//               Ring, returns right away if there already is one.
+// Returns:      STATUS
+// Parameter:    IN PNET_RING_HEADER Ring
+//******************************************************************************
+STATUS
+SyscallNetRingWait(
+    IN          PNET_RING_HEADER        Ring
+    );
+
+// SyscallIdNetRingClose
+//******************************************************************************
+// Function:     SyscallNetRingClose
+// Description:  Detaches Ring from its device and unmaps it.
+// Returns:      STATUS
+// Parameter:    IN PNET_RING_HEADER Ring
+//******************************************************************************
+STATUS
+SyscallNetRingClose(
+    IN          PNET_RING_HEADER        Ring
+    );
@@ -28,5 +28,11 @@ typedef enum _SYSCALL_ID
     SyscallIdFileRead,
     SyscallIdFileWrite,
 
-    SyscallIdReserved = SyscallIdFileWrite + 1
+    // Network packet rings
+    SyscallIdNetRingCreate,
+    SyscallIdNetRingTransmit,
+    SyscallIdNetRingWait,
+    SyscallIdNetRingClose,
+
+    SyscallIdReserved = SyscallIdNetRingClose + 1
 } SYSCALL_ID;
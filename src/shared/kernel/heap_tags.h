@@ -24,6 +24,8 @@
 #define HEAP_THREAD_TAG                 ':RHT'
 #define HEAP_MDL_TAG                    ':LMD'
 #define HEAP_ATA_TAG                    ':ATA'
+#define HEAP_AHCI_TAG                   'ICHA'
+#define HEAP_VIRTIO_TAG                 'TRIV'
 #define HEAP_IOMU_TAG                   ':MOI'
 #define HEAP_MMU_TAG                    ':UMM'
 #define HEAP_CORE_TAG                   ':ROC'
@@ -32,4 +34,8 @@
 #define HEAP_PORT_TAG                   ':TRP'
 #define HEAP_EXECUTIVE_TAG              ':XE '
 #define HEAP_PROCESS_TAG                ':CRP'
-#define HEAP_BOOT_TAG                   'TOOB'
\ No newline at end of file
+#define HEAP_BOOT_TAG                   'TOOB'
+#define HEAP_TRACE_TAG                  ':CRT'
+#define HEAP_PROFILER_TAG               'FORP'
+#define HEAP_POOL_STATS_TAG             'LOOP'
+#define HEAP_PMU_TAG                    ':UMP'
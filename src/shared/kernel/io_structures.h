@@ -122,7 +122,8 @@ typedef enum _IO_INTERRUPT_TYPE
 {
     IoInterruptTypeLegacy,
     IoInterruptTypeLapic,
-    IoInterruptTypePci
+    IoInterruptTypePci,
+    IoInterruptTypePciMsiX
 } IO_INTERRUPT_TYPE;
 
 typedef struct _IO_INTERRUPT
@@ -146,6 +147,17 @@ typedef struct _IO_INTERRUPT
         {
             PPCI_DEVICE_DESCRIPTION         PciDevice;
         } Pci;
+        struct
+        {
+            PPCI_DEVICE_DESCRIPTION         PciDevice;
+
+            // index of the MSI-X table entry programmed for the interrupt
+            WORD                            TableEntry;
+
+            // the interrupt is delivered only to this processor, the index
+            // is taken modulo the number of processors in the system
+            BYTE                            ProcessorIndex;
+        } PciMsiX;
     };
 } IO_INTERRUPT, *PIO_INTERRUPT;
 
@@ -184,7 +196,11 @@ typedef struct _IRP_FLAGS
 {
     DWORD           Completed       :  1;
     DWORD           Asynchronous    :  1;
-    DWORD           Reserved        : 30;
+
+    // the IRP is dispatched without holding the DeviceLock of the device,
+    // only for the requests the driver handles concurrently with the others
+    DWORD           Unserialized    :  1;
+    DWORD           Reserved        : 29;
 } IRP_FLAGS, *PIRP_FLAGS;
 
 typedef struct _IO_STATUS_BLOCK
@@ -301,7 +317,14 @@ struct _DISK_LAYOUT_INFORMATION
 } DISK_LAYOUT_INFORMATION, *PDISK_LAYOUT_INFORMATION;
 
 
-// IOCTL_NET_RECEIVE_FRAME
+// IOCTL_NET_RECEIVE_FRAME, IOCTL_NET_TRY_RECEIVE_FRAME
+// IOCTL_NET_RECEIVE_FRAME blocks until a frame is available, it and
+// IOCTL_NET_SEND_FRAME must be sent with the IRP Unserialized flag set or the
+// other requests to the device would wait for a frame to be received
+// IOCTL_NET_TRY_RECEIVE_FRAME fails with STATUS_NO_DATA_AVAILABLE instead of
+// blocking
+// IOCTL_NET_WAIT_RX_READY has no buffers, it blocks until the link is up and
+// RX is enabled and must be sent Unserialized as well
 typedef struct _NET_RECEIVE_FRAME_OUTPUT
 {
     ETHERNET_FRAME          Buffer;
@@ -322,6 +345,11 @@ typedef struct _NET_GET_LINK_STATUS
     BOOLEAN                 LinkUp;
 } NET_GET_LINK_STATUS, *PNET_GET_LINK_STATUS;
 
+typedef struct _NET_GET_INTERRUPT_MODERATION
+{
+    NETWORK_INTERRUPT_MODERATION    InterruptModeration;
+} NET_GET_INTERRUPT_MODERATION, *PNET_GET_INTERRUPT_MODERATION;
+
 #define IOCTL_DISK_GET_LENGTH_INFO          0x0
 #define IOCTL_DISK_LAYOUT_INFO              0x1
 #define IOCTL_VOLUME_PARTITION_INFO         0x2
@@ -332,6 +360,9 @@ typedef struct _NET_GET_LINK_STATUS
 #define IOCTL_NET_GET_DEVICE_STATUS         0x7
 #define IOCTL_NET_SET_DEVICE_STATUS         0x8
 #define IOCTL_NET_GET_LINK_STATUS           0x9
+#define IOCTL_NET_GET_INTERRUPT_MODERATION  0xA
+#define IOCTL_NET_WAIT_RX_READY             0xB
+#define IOCTL_NET_TRY_RECEIVE_FRAME         0xC
 
 // end of common packing
 #pragma warning(pop)
@@ -2,6 +2,10 @@
 
 #include "network_packets.h"
 #include "network_device.h"
+#include "net_ring_defs.h"
+
+typedef struct _UDP_SOCKET*     PUDP_SOCKET;
+typedef struct _NET_RING*       PNET_RING;
 
 STATUS
 NetSendFrame(
@@ -14,9 +18,13 @@ NetSendFrame(
     IN                      MAC_ADDRESS     DestinationAddress
     );
 
+// Fails with STATUS_DEVICE_BUSY once the stack receives the frames of the
+// device, i.e. after it was given an IP address or a packet ring. If Wait is
+// FALSE it fails with STATUS_NO_DATA_AVAILABLE instead of blocking.
 STATUS
 NetReceiveFrame(
     IN                      DEVICE_ID       DeviceId,
+    IN                      BOOLEAN         Wait,
     OUT_WRITES_BYTES(Size)  PVOID           Buffer,
     IN                      DWORD           Size,
     OUT                     DWORD*          BytesWritten
@@ -41,4 +49,117 @@ STATUS
 NetGetNetworkDeviceStatistics(
     IN              DEVICE_ID                       DeviceId,
     OUT             PNETWORK_DEVICE_STATS           Statistics
+    );
+
+// Once a device has an IP address or a packet ring all the frames it receives
+// are processed by the stack, NetReceiveFrame should no longer be used on it. An Address of 0
+// removes the configuration.
+STATUS
+NetSetIp4Configuration(
+    IN              DEVICE_ID                       DeviceId,
+    IN              IP4_ADDRESS                     Address,
+    IN              IP4_ADDRESS                     SubnetMask,
+    IN              IP4_ADDRESS                     Gateway
+    );
+
+// All the port numbers taken or returned by the UDP functions are in host
+// byte order, the addresses are in network byte order. A socket may be used
+// by one sending and one receiving thread at the same time.
+
+// LocalAddress may be 0 to receive on all interfaces and LocalPort may be 0
+// to have an ephemeral port assigned.
+STATUS
+NetUdpSocketOpen(
+    IN              IP4_ADDRESS                     LocalAddress,
+    IN              PORT_NUMBER                     LocalPort,
+    OUT_PTR         PUDP_SOCKET*                    Socket
+    );
+
+// Restricts the socket to the datagrams coming from RemoteAddress:RemotePort
+// and makes it the destination of NetUdpSocketSend. The route to the remote
+// end is looked up once here instead of for every datagram sent.
+STATUS
+NetUdpSocketConnect(
+    INOUT           PUDP_SOCKET                     Socket,
+    IN              IP4_ADDRESS                     RemoteAddress,
+    IN              PORT_NUMBER                     RemotePort
+    );
+
+STATUS
+NetUdpSocketSend(
+    INOUT           PUDP_SOCKET                     Socket,
+    IN_READS_BYTES(Size)    PVOID                   Buffer,
+    IN              DWORD                           Size
+    );
+
+STATUS
+NetUdpSocketSendTo(
+    INOUT           PUDP_SOCKET                     Socket,
+    IN              IP4_ADDRESS                     RemoteAddress,
+    IN              PORT_NUMBER                     RemotePort,
+    IN_READS_BYTES(Size)    PVOID                   Buffer,
+    IN              DWORD                           Size
+    );
+
+// Blocks until a datagram is available or the socket is closed. If the
+// datagram does not fit in Buffer it is truncated, STATUS_BUFFER_TOO_SMALL is
+// returned and BytesReceived holds its full size.
+STATUS
+NetUdpSocketReceive(
+    INOUT           PUDP_SOCKET                     Socket,
+    OUT_WRITES_BYTES(Size)  PVOID                   Buffer,
+    IN              DWORD                           Size,
+    OUT             DWORD*                          BytesReceived,
+    OUT_OPT         PIP4_ADDRESS                    RemoteAddress,
+    OUT_OPT         PORT_NUMBER*                    RemotePort
+    );
+
+// The threads blocked in NetUdpSocketReceive return STATUS_NO_DATA_AVAILABLE,
+// the socket is freed once the calls in progress return. No call may be made
+// on the socket after it is closed.
+void
+NetUdpSocketClose(
+    _Pre_notnull_ _Post_ptr_invalid_
+                    PUDP_SOCKET                     Socket
+    );
+
+// A packet ring (see net_ring_defs.h) receives a copy of every frame its
+// device receives, the frames are still processed by the stack as well. A
+// device has at most one ring. SlotCount must be a power of 2 between
+// NET_RING_MIN_SLOTS and NET_RING_MAX_SLOTS.
+STATUS
+NetRingCreate(
+    IN              DEVICE_ID                       DeviceId,
+    IN              DWORD                           SlotCount,
+    OUT_PTR         PNET_RING*                      Ring
+    );
+
+// The ring is Size bytes of page aligned and physically contiguous memory,
+// starting with the header.
+PNET_RING_HEADER
+NetRingGetHeader(
+    IN              PNET_RING                       Ring,
+    OUT_OPT         DWORD*                          Size
+    );
+
+// Sends the frames placed in the TX slots since the previous call, the
+// source address of each frame is filled in. The threads transmitting on the
+// same ring at the same time are serialized.
+STATUS
+NetRingTransmit(
+    INOUT           PNET_RING                       Ring,
+    OUT_OPT         DWORD*                          FramesSent
+    );
+
+// Blocks until there is at least one frame in the RX slots.
+void
+NetRingWait(
+    INOUT           PNET_RING                       Ring
+    );
+
+// No other thread may be using the ring when it is destroyed.
+void
+NetRingDestroy(
+    _Pre_notnull_ _Post_ptr_invalid_
+                    PNET_RING                       Ring
     );
\ No newline at end of file
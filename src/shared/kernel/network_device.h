@@ -8,6 +8,37 @@ typedef struct _NETWORK_DEVICE_STATUS
     BOOLEAN                         TxEnabled;
 } NETWORK_DEVICE_STATUS, *PNETWORK_DEVICE_STATUS;
 
+typedef enum _NETWORK_INTERRUPT_PROFILE
+{
+    // few small packets, interrupt as soon as possible
+    NetworkInterruptProfileLowLatency,
+    NetworkInterruptProfileBalanced,
+    // many large packets, coalesce as much as possible
+    NetworkInterruptProfileBulk,
+    NetworkInterruptProfileReserved = NetworkInterruptProfileBulk + 1
+} NETWORK_INTERRUPT_PROFILE;
+
+typedef struct _NETWORK_INTERRUPT_MODERATION
+{
+    // if the miniport does not support interrupt moderation none of the
+    // other fields are valid
+    BOOLEAN                         Supported;
+    BOOLEAN                         Adaptive;
+
+    NETWORK_INTERRUPT_PROFILE       Profile;
+
+    // 0 if the interrupts are not throttled
+    DWORD                           MaximumInterruptsPerSecond;
+
+    WORD                            RxRelativeDelayUs;
+    WORD                            RxAbsoluteDelayUs;
+    WORD                            TxRelativeDelayUs;
+    WORD                            TxAbsoluteDelayUs;
+
+    QWORD                           NumberOfInterrupts;
+    QWORD                           NumberOfProfileChanges;
+} NETWORK_INTERRUPT_MODERATION, *PNETWORK_INTERRUPT_MODERATION;
+
 typedef struct _NETWORK_DEVICE_INFO
 {
     DEVICE_ID               DeviceId;
@@ -16,6 +47,8 @@ typedef struct _NETWORK_DEVICE_INFO
 
     NETWORK_DEVICE_STATUS   DeviceStatus;
     BOOLEAN                 LinkStatus;
+
+    NETWORK_INTERRUPT_MODERATION    InterruptModeration;
 } NETWORK_DEVICE_INFO, *PNETWORK_DEVICE_INFO;
 
 typedef struct _NETWORK_FRAME_STATS